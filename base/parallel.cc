@@ -15,49 +15,79 @@
 namespace MLDB {
 
 
-void parallelMap(size_t first, size_t last,
-                 const std::function<void (size_t)> & doWork,
-                 int occupancyLimit)
+/** Call doNext() in occupancyLimit threads at once until it returns false
+    or throws, and rethrow the first exception.
+
+    The calling thread does work too.  The pool threads helping it belong
+    to the current job group: they are only obtained while the group has
+    threads to spare, they stop when the group goes over its limit (for
+    example when a group of higher priority starts) and the calling thread
+    asks for them again as the group gets threads back.  If the group is
+    cancelled, JobGroupCancelled is thrown.
+*/
+static void runParallel(int occupancyLimit,
+                        const std::function<bool ()> & doNext)
 {
-    ExcAssertGreaterEqual(last, first);
-    ExcAssertLess((last - first), 1ULL << 31);
-
     std::atomic<int> hasException(0);
-    std::atomic<size_t> index(first);
-    std::mutex exc_mutex;
+    std::atomic<int> exhausted(0);
+    std::atomic<int> numHelpers(0);
     std::exception_ptr exc;
 
     // This creates a thread pool that runs jobs on the default thread pool
     ThreadPool tp;
+    std::shared_ptr<JobGroup> group = tp.jobGroup();
 
-    if (occupancyLimit == -1)
-        occupancyLimit = numCpus();
-    if (occupancyLimit > (last - first))
-        occupancyLimit = (last - first);
+    std::function<void ()> addHelpers;
 
-    auto worker = [&] ()
+    auto worker = [&] (bool isHelper)
         {
-            while (!hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(1);
-                if (myindex >= last)
-                    return;
+            while (!hasException.load(std::memory_order_relaxed)
+                   && !exhausted.load(std::memory_order_relaxed)) {
                 try {
-                    doWork(myindex);
+                    if (group)
+                        group->checkCancelled();
+                    if (isHelper && JobGroup::yieldThread())
+                        return;
+                    if (!doNext()) {
+                        exhausted = true;
+                        return;
+                    }
                 } MLDB_CATCH_ALL {
                     if (hasException.fetch_add(1) == 0) {
                         ExcAssert(!exc);
                         exc = std::current_exception();
                     }
+                    return;
                 }
+
+                if (!isHelper
+                    && numHelpers.load(std::memory_order_relaxed)
+                       < occupancyLimit - 1)
+                    addHelpers();
             }
         };
 
+    auto helper = [&] ()
+        {
+            worker(true /* isHelper */);
+            --numHelpers;
+        };
+
     // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
+    addHelpers = [&] ()
+        {
+            while (numHelpers.load() < occupancyLimit - 1
+                   && !exhausted.load(std::memory_order_relaxed)
+                   && (!group || group->hasSpareThread())) {
+                ++numHelpers;
+                tp.add(helper);
+            }
+        };
+
+    addHelpers();
+
     // Do work until there is nothing left to do
-    worker();
+    worker(false /* isHelper */);
 
     // Wait for the rest of the work to be done
     tp.waitForAll();
@@ -66,6 +96,32 @@ void parallelMap(size_t first, size_t last,
         std::rethrow_exception(exc);
 }
 
+void parallelMap(size_t first, size_t last,
+                 const std::function<void (size_t)> & doWork,
+                 int occupancyLimit)
+{
+    ExcAssertGreaterEqual(last, first);
+    ExcAssertLess((last - first), 1ULL << 31);
+
+    std::atomic<size_t> index(first);
+
+    if (occupancyLimit == -1)
+        occupancyLimit = numCpus();
+    if (occupancyLimit > (last - first))
+        occupancyLimit = (last - first);
+
+    auto doNext = [&] () -> bool
+        {
+            size_t myindex = index.fetch_add(1);
+            if (myindex >= last)
+                return false;
+            doWork(myindex);
+            return true;
+        };
+
+    runParallel(occupancyLimit, doNext);
+}
+
 bool parallelMapHaltable(size_t first, size_t last,
                          const std::function<bool (size_t)> & doWork,
                          int occupancyLimit)
@@ -73,54 +129,29 @@ bool parallelMapHaltable(size_t first, size_t last,
     ExcAssertGreaterEqual(last, first);
     ExcAssertLess((last - first), 1ULL << 31);
 
-    std::atomic<int> hasException(0);
     std::atomic<int> stop(0);
     std::atomic<size_t> index(first);
-    std::mutex exc_mutex;
-    std::exception_ptr exc;
-
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
 
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first))
         occupancyLimit = (last - first);
 
-    auto worker = [&] ()
+    auto doNext = [&] () -> bool
         {
-            while (!stop.load(std::memory_order_relaxed)
-                   && !hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(1);
-                if (myindex >= last)
-                    return;
-                try {
-                    if (!doWork(myindex)) {
-                        stop = true;
-                        return;
-                    }
-                } MLDB_CATCH_ALL {
-                    if (hasException.fetch_add(1) == 0) {
-                        ExcAssert(!exc);
-                        exc = std::current_exception();
-                    }
-                    return;
-                }
+            if (stop.load(std::memory_order_relaxed))
+                return false;
+            size_t myindex = index.fetch_add(1);
+            if (myindex >= last)
+                return false;
+            if (!doWork(myindex)) {
+                stop = true;
+                return false;
             }
+            return true;
         };
 
-    // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
-    // Do work until there is nothing left to do
-    worker();
-
-    // Wait for the rest of the work to be done
-    tp.waitForAll();
-
-    if (exc)
-        std::rethrow_exception(exc);
+    runParallel(occupancyLimit, doNext);
 
     return !stop;
 }
@@ -134,49 +165,24 @@ void parallelMapChunked(size_t first, size_t last, size_t chunkSize,
     ExcAssertGreater(last, first);
     ExcAssertLess((last - first) / chunkSize, 1ULL << 31);
 
-    std::atomic<int> hasException(0);
     std::atomic<size_t> index(first);
-    std::mutex exc_mutex;
-    std::exception_ptr exc;
 
-    // This creates a thread pool that runs jobs on the default thread pool
-    ThreadPool tp;
-    
     if (occupancyLimit == -1)
         occupancyLimit = numCpus();
     if (occupancyLimit > (last - first + chunkSize - 1) / chunkSize)
         occupancyLimit = (last - first + chunkSize - 1) / chunkSize;
 
-    auto worker = [&] ()
+    auto doNext = [&] () -> bool
         {
-            while (!hasException.load(std::memory_order_relaxed)) {
-                size_t myindex = index.fetch_add(chunkSize);
-                if (myindex >= last)
-                    return;
-                size_t indexEnd = std::min(last, myindex + chunkSize);
-                try {
-                    doWork(myindex, indexEnd);
-                } MLDB_CATCH_ALL {
-                    if (hasException.fetch_add(1) == 0) {
-                        ExcAssert(!exc);
-                        exc = std::current_exception();
-                    }
-                }
-            }
+            size_t myindex = index.fetch_add(chunkSize);
+            if (myindex >= last)
+                return false;
+            size_t indexEnd = std::min(last, myindex + chunkSize);
+            doWork(myindex, indexEnd);
+            return true;
         };
 
-    // Leave one set of work for this thread to do directly
-    for (int i = 0;  i < occupancyLimit - 1;  ++i)
-        tp.add(worker);
-    
-    // Do work until there is nothing left to do
-    worker();
-    
-    // Wait for the rest of the work to be done
-    tp.waitForAll();
-
-    if (exc)
-        std::rethrow_exception(exc);
+    runParallel(occupancyLimit, doNext);
 }
 
 } // namespace MLDB
@@ -34,6 +34,11 @@ namespace MLDB {
     Different behaviour can be obtained by using a try block inside the
     doWork function, or by using another mechanism apart from exceptions
     to signal errors.
+
+    The work belongs to the current JobGroup of the calling thread (see
+    thread_pool.h), if there is one.  The number of threads is then also
+    limited by the group, and if the group is cancelled no more doWork()
+    calls are started and JobGroupCancelled is thrown.
 */
 void parallelMap(size_t first, size_t last,
                  const std::function<void (size_t)> & doWork,
@@ -165,6 +165,94 @@ BOOST_AUTO_TEST_CASE(thread_pool_test)
     BOOST_CHECK_EQUAL(jobsDone.load(), numJobs);
 }
 
+BOOST_AUTO_TEST_CASE(job_group_cancel)
+{
+    auto group = JobGroup::create("test cancel");
+    JobGroupScope scope(group);
+
+    std::atomic<int> itemsDone(0);
+
+    auto doItem = [&] (size_t i)
+        {
+            if (++itemsDone == 1000)
+                group->cancel();
+            std::this_thread::sleep_for(std::chrono::microseconds(10));
+        };
+
+    BOOST_CHECK_THROW(parallelMap(0, 1000000, doItem), JobGroupCancelled);
+    BOOST_CHECK(group->cancelled());
+    BOOST_CHECK_LT(itemsDone.load(), 1000000);
+
+    // Jobs which see the cancellation stop without crashing the pool
+    ThreadPool pool;
+    std::atomic<int> jobsRun(0);
+    for (int i = 0;  i < 100;  ++i) {
+        pool.add([&] () { ++jobsRun;  group->checkCancelled(); });
+    }
+    pool.waitForAll();
+    BOOST_CHECK_EQUAL(jobsRun.load(), 100);
+    BOOST_CHECK_EQUAL(pool.jobsRunning(), 0);
+}
+
+BOOST_AUTO_TEST_CASE(job_group_max_share)
+{
+    // One pool thread, plus the thread calling parallelMap
+    auto group = JobGroup::create("test share", JOB_PRIORITY_NORMAL, 0.0001);
+    BOOST_CHECK_EQUAL(group->maxThreads(), 1);
+
+    JobGroupScope scope(group);
+
+    std::atomic<int> running(0), maxRunning(0);
+
+    auto doItem = [&] (size_t i)
+        {
+            int r = ++running;
+            int m = maxRunning;
+            while (r > m && !maxRunning.compare_exchange_weak(m, r)) ;
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+            --running;
+        };
+
+    parallelMap(0, 500, doItem);
+
+    BOOST_CHECK_LE(maxRunning.load(), 2);
+    BOOST_CHECK_EQUAL(group->getStatus().threadsRunning, 0);
+}
+
+BOOST_AUTO_TEST_CASE(job_group_priority)
+{
+    auto background = JobGroup::create("test background",
+                                       JOB_PRIORITY_BACKGROUND);
+    int fullThreads = background->maxThreads();
+    BOOST_CHECK_EQUAL(fullThreads, numCpus());
+
+    {
+        auto interactive = JobGroup::create("test interactive",
+                                            JOB_PRIORITY_INTERACTIVE);
+        JobGroupScope scope(interactive);
+
+        // Background work gives way while there is interactive work...
+        BOOST_CHECK_EQUAL(background->maxThreads(),
+                          std::max(1, fullThreads / 4));
+        BOOST_CHECK_EQUAL(interactive->maxThreads(), fullThreads);
+
+        bool found = false;
+        for (auto & g: ThreadPool::instance().getStatus().jobGroups) {
+            if (g.name == "test interactive") {
+                found = true;
+                BOOST_CHECK_EQUAL(g.priority, JOB_PRIORITY_INTERACTIVE);
+            }
+        }
+        BOOST_CHECK(found);
+    }
+
+    // ... and gets its threads back afterwards
+    BOOST_CHECK_EQUAL(background->maxThreads(), fullThreads);
+
+    for (auto & g: ThreadPool::instance().getStatus().jobGroups)
+        BOOST_CHECK_NE(g.name, "test interactive");
+}
+
 // For the purposes of the tests, we make integers pass
 // for pointers to avoid having to actually run jobs.
 // The value zero is reserved for "no value was available".
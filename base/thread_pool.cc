@@ -17,6 +17,9 @@
 #include <vector>
 #include <thread>
 #include <iostream>
+#include <algorithm>
+#include <mutex>
+#include <cmath>
 
 
 using namespace std;
@@ -32,6 +35,250 @@ int numCpus()
     return NUM_CPUS;
 }
 
+
+/*****************************************************************************/
+/* JOB GROUP                                                                 */
+/*****************************************************************************/
+
+/// A pool thread reserved for a job group
+struct JobGroupThread {
+    JobGroupThread(std::shared_ptr<JobGroup> group);
+    ~JobGroupThread();
+
+    std::shared_ptr<JobGroup> group;
+    bool held;   ///< False once the thread was yielded
+    JobGroupThread * previous;
+    JobGroup * previousGroup;
+};
+
+/// Group of the work being done by this thread
+static __thread JobGroup * currentJobGroup = nullptr;
+
+/// Group reservation of the pool job running in this thread
+static __thread JobGroupThread * currentJobGroupThread = nullptr;
+
+/// Number of groups with an open scope at each priority
+static std::atomic<int> activeAtPriority[NUM_JOB_PRIORITIES];
+
+namespace {
+
+std::mutex jobGroupsMutex;
+std::vector<std::weak_ptr<JobGroup> > jobGroups;
+
+} // file scope
+
+const char *
+JobGroupCancelled::
+what() const noexcept
+{
+    return "job group was cancelled";
+}
+
+JobGroup::
+JobGroup(std::string name, JobPriority priority, double maxShare)
+    : name(std::move(name)), priority(priority), maxShare(maxShare),
+      cancelled_(false), threadsRunning_(0), threadsYielded_(0),
+      numScopes_(0)
+{
+    ExcAssertGreaterEqual(priority, 0);
+    ExcAssertLess(priority, NUM_JOB_PRIORITIES);
+    ExcAssertGreater(maxShare, 0.0);
+}
+
+JobGroup::
+~JobGroup()
+{
+    std::unique_lock<std::mutex> guard(jobGroupsMutex);
+    jobGroups.erase(std::remove_if(jobGroups.begin(), jobGroups.end(),
+                                   [] (const std::weak_ptr<JobGroup> & g)
+                                   { return g.expired(); }),
+                    jobGroups.end());
+}
+
+std::shared_ptr<JobGroup>
+JobGroup::
+create(std::string name, JobPriority priority, double maxShare)
+{
+    std::shared_ptr<JobGroup> result
+        (new JobGroup(std::move(name), priority, maxShare));
+
+    std::unique_lock<std::mutex> guard(jobGroupsMutex);
+    jobGroups.push_back(result);
+    return result;
+}
+
+void
+JobGroup::
+cancel()
+{
+    cancelled_ = true;
+}
+
+void
+JobGroup::
+checkCancelled() const
+{
+    if (cancelled())
+        throw JobGroupCancelled();
+}
+
+int
+JobGroup::
+maxThreads() const
+{
+    int result = std::max<int>(1, std::ceil(maxShare * numCpus()));
+
+    // Leave most of the threads to more urgent work
+    for (int p = priority + 1;  p < NUM_JOB_PRIORITIES;  ++p) {
+        if (activeAtPriority[p].load(std::memory_order_relaxed) > 0)
+            return std::max(1, result / 4);
+    }
+
+    return result;
+}
+
+bool
+JobGroup::
+hasSpareThread() const
+{
+    return threadsRunning_.load(std::memory_order_relaxed) < maxThreads();
+}
+
+bool
+JobGroup::
+tryAcquireThread()
+{
+    int limit = maxThreads();
+    int running = threadsRunning_.load();
+    while (running < limit) {
+        if (threadsRunning_.compare_exchange_weak(running, running + 1))
+            return true;
+    }
+    return false;
+}
+
+void
+JobGroup::
+releaseThread()
+{
+    ExcAssertGreater(threadsRunning_.load(), 0);
+    --threadsRunning_;
+}
+
+JobGroupStatus
+JobGroup::
+getStatus() const
+{
+    JobGroupStatus result;
+    result.name = name;
+    result.priority = priority;
+    result.maxShare = maxShare;
+    result.maxThreads = maxThreads();
+    result.threadsRunning = threadsRunning_;
+    result.threadsYielded = threadsYielded_;
+    result.cancelled = cancelled();
+    return result;
+}
+
+std::shared_ptr<JobGroup>
+JobGroup::
+current()
+{
+    if (!currentJobGroup)
+        return nullptr;
+    return currentJobGroup->shared_from_this();
+}
+
+bool
+JobGroup::
+yieldThread()
+{
+    JobGroupThread * thread = currentJobGroupThread;
+    if (!thread)
+        return false;
+    if (!thread->held)
+        return true;
+
+    JobGroup & group = *thread->group;
+    if (group.threadsRunning_.load(std::memory_order_relaxed)
+        <= group.maxThreads())
+        return false;
+
+    // Give back our thread, unless others have already done so
+    int running = group.threadsRunning_.load();
+    while (running > group.maxThreads()) {
+        if (group.threadsRunning_.compare_exchange_weak(running, running - 1)) {
+            thread->held = false;
+            ++group.threadsYielded_;
+            return true;
+        }
+    }
+
+    return false;
+}
+
+std::vector<std::shared_ptr<JobGroup> >
+JobGroup::
+all()
+{
+    std::vector<std::shared_ptr<JobGroup> > result;
+
+    std::unique_lock<std::mutex> guard(jobGroupsMutex);
+    for (auto & g: jobGroups) {
+        auto group = g.lock();
+        if (group)
+            result.emplace_back(std::move(group));
+    }
+
+    return result;
+}
+
+
+/*****************************************************************************/
+/* JOB GROUP SCOPE                                                           */
+/*****************************************************************************/
+
+JobGroupScope::
+JobGroupScope(std::shared_ptr<JobGroup> group_)
+    : group(std::move(group_)), previous(currentJobGroup)
+{
+    if (group && group->numScopes_.fetch_add(1) == 0)
+        ++activeAtPriority[group->priority];
+    currentJobGroup = group.get();
+}
+
+JobGroupScope::
+~JobGroupScope()
+{
+    currentJobGroup = previous;
+    if (group && group->numScopes_.fetch_sub(1) == 1)
+        --activeAtPriority[group->priority];
+}
+
+
+/*****************************************************************************/
+/* JOB GROUP THREAD                                                          */
+/*****************************************************************************/
+
+JobGroupThread::
+JobGroupThread(std::shared_ptr<JobGroup> group_)
+    : group(std::move(group_)), held(true),
+      previous(currentJobGroupThread),
+      previousGroup(currentJobGroup)
+{
+    currentJobGroupThread = this;
+    currentJobGroup = group.get();
+}
+
+JobGroupThread::
+~JobGroupThread()
+{
+    if (held)
+        group->releaseThread();
+    currentJobGroupThread = previous;
+    currentJobGroup = previousGroup;
+}
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -168,6 +415,11 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
     /// The maximum number of parallel jobs in the parent
     size_t maxParentJobs;
 
+    /// Group that our jobs belong to, which limits the number of parent
+    /// jobs we can use.  This is the current group of the thread which
+    /// created us.
+    std::shared_ptr<JobGroup> group;
+
     /** Return the number of jobs running.  If there are more than
         2^31 jobs running, this may give the wrong answer.
     */
@@ -223,7 +475,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
           queues(new Queues(threadCreationEpoch)),
           parent(&parent),
           parentJobs(0),
-          maxParentJobs(maxParentJobs)
+          maxParentJobs(maxParentJobs),
+          group(JobGroup::current())
     {
         submitted = 0;
         finished = 0;
@@ -265,7 +518,7 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
     void runParentWorker()
     {
-        while (!shutdown && (this->work())) ;
+        while (!shutdown && !JobGroup::yieldThread() && this->work()) ;
         --this->parentJobs;
     }
 
@@ -287,18 +540,29 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         if (!overflow) {
             if (parent) {
                 // If there aren't enough jobs alredy, we submit a new
-                // one.
+                // one.  Our group also needs to have a thread to spare;
+                // if not, the work will be done by the thread waiting for
+                // it.
                 size_t numWereActive = parentJobs.fetch_add(1);
                 if (numWereActive >= maxParentJobs) {
                     --parentJobs;
                 }
+                else if (group && !group->tryAcquireThread()) {
+                    --parentJobs;
+                }
                 else {
                     // Get a weak pointer to ourself so that we can know
                     // if we're still alive or not.
                     auto weakThis = std::weak_ptr<Itl>(this->shared_from_this());
+                    auto group = this->group;
 
-                    auto parentJob = [weakThis] ()
+                    auto parentJob = [weakThis, group] ()
                         {
+                            // Hand back the group's thread once we're done
+                            std::unique_ptr<JobGroupThread> groupThread;
+                            if (group)
+                                groupThread.reset(new JobGroupThread(group));
+
                             // GCC 4.8 uses a try/catch to implement lock()
                             // we avoid logging an exception message here
                             // by trying first, and then disabling exceptions.
@@ -312,6 +576,8 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
 
                     if (!weakThis.expired())
                         parent->add(parentJob);
+                    else if (group)
+                        group->releaseThread();
                 }
             }
             else {
@@ -422,6 +688,9 @@ struct ThreadPool::Itl: public std::enable_shared_from_this<ThreadPool::Itl> {
         try {
             job();
             finished += 1;
+        } catch (const JobGroupCancelled & exc) {
+            // The job stopped because its group was cancelled
+            finished += 1;
         } catch (const std::exception & exc) {
             finished += 1;
             cerr << "ERROR: job submitted to ThreadPool of type "
@@ -709,6 +978,32 @@ jobsRunLocally() const
     return itl->jobsRunLocally;
 }
 
+std::shared_ptr<JobGroup>
+ThreadPool::
+jobGroup() const
+{
+    return itl->group;
+}
+
+ThreadPoolStatus
+ThreadPool::
+getStatus() const
+{
+    ThreadPoolStatus result;
+    result.numThreads = numThreads();
+    result.jobsRunning = jobsRunning();
+    result.jobsSubmitted = jobsSubmitted();
+    result.jobsFinished = jobsFinished();
+    result.jobsStolen = jobsStolen();
+    result.jobsWithFullQueue = jobsWithFullQueue();
+    result.jobsRunLocally = jobsRunLocally();
+
+    for (auto & group: JobGroup::all())
+        result.jobGroups.emplace_back(group->getStatus());
+
+    return result;
+}
+
 ThreadPool &
 ThreadPool::
 instance()
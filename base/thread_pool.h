@@ -12,6 +12,10 @@
 
 #include <functional>
 #include <memory>
+#include <atomic>
+#include <string>
+#include <vector>
+#include <exception>
 
 namespace MLDB {
 
@@ -21,6 +25,133 @@ typedef std::function<void () noexcept> ThreadJob;
 int numCpus();
 
 
+/*****************************************************************************/
+/* JOB GROUP                                                                 */
+/*****************************************************************************/
+
+/// Priority of a job group.  While a group of higher priority is active,
+/// groups of lower priority give back most of their threads.
+enum JobPriority {
+    JOB_PRIORITY_BACKGROUND = 0,   ///< Long running work, eg training
+    JOB_PRIORITY_NORMAL = 1,
+    JOB_PRIORITY_INTERACTIVE = 2,  ///< Latency sensitive work, eg queries
+    NUM_JOB_PRIORITIES = 3
+};
+
+/** Thrown from parallelMap() and friends when the job group of the work
+    was cancelled.  A ThreadPool job which throws it is simply stopped.
+*/
+struct JobGroupCancelled: public std::exception {
+    virtual const char * what() const noexcept override;
+};
+
+struct JobGroupStatus {
+    std::string name;
+    JobPriority priority;
+    double maxShare;
+    int maxThreads;          ///< Current limit, including priority
+    int threadsRunning;      ///< Pool threads currently working for it
+    uint64_t threadsYielded; ///< Times a thread was given back
+    bool cancelled;
+};
+
+/** A set of jobs which belong to the same piece of work, such as a query
+    or a procedure run.  The group of the work being done is a property of
+    the current thread (see JobGroupScope); ThreadPools created in that
+    thread and the jobs they run belong to it.
+
+    A group is limited to a share of the threads of the pool, is given
+    fewer of them while groups of higher priority are active, and can be
+    cancelled, which makes the parallelMap() calls doing its work stop and
+    throw JobGroupCancelled.
+
+    Work done outside of any group isn't limited.
+*/
+struct JobGroup: public std::enable_shared_from_this<JobGroup> {
+
+    /** Create a new group.  maxShare is the proportion of the pool's
+        threads that it may use at once.
+    */
+    static std::shared_ptr<JobGroup>
+    create(std::string name,
+           JobPriority priority = JOB_PRIORITY_NORMAL,
+           double maxShare = 1.0);
+
+    ~JobGroup();
+
+    const std::string name;
+    const JobPriority priority;
+    const double maxShare;
+
+    /// Cancel all work in the group.  This can't be undone.
+    void cancel();
+
+    bool cancelled() const
+    {
+        return cancelled_.load(std::memory_order_relaxed);
+    }
+
+    /// Throw JobGroupCancelled if the group was cancelled
+    void checkCancelled() const;
+
+    /// Maximum number of pool threads that the group may use right now
+    int maxThreads() const;
+
+    /// Can the group use another pool thread right now?
+    bool hasSpareThread() const;
+
+    /** Reserve a pool thread for the group, if it's under its limit.  It
+        must be given back with releaseThread().
+    */
+    bool tryAcquireThread();
+
+    void releaseThread();
+
+    JobGroupStatus getStatus() const;
+
+    /// The group of the work the current thread is doing, or null
+    static std::shared_ptr<JobGroup> current();
+
+    /** Called by pool threads between units of work.  If the thread was
+        reserved for a group which is now over its limit, the reservation
+        is given back and true is returned; the thread should then stop
+        working for the group.
+    */
+    static bool yieldThread();
+
+    /// All groups which currently exist
+    static std::vector<std::shared_ptr<JobGroup> > all();
+
+private:
+    JobGroup(std::string name, JobPriority priority, double maxShare);
+
+    friend struct JobGroupScope;
+    friend struct JobGroupThread;
+
+    std::atomic<bool> cancelled_;
+    std::atomic<int> threadsRunning_;
+    std::atomic<uint64_t> threadsYielded_;
+
+    /// Number of JobGroupScopes currently open on the group
+    std::atomic<int> numScopes_;
+};
+
+/** Makes the given group (which may be null) the current one for this
+    thread while it's in scope.
+*/
+struct JobGroupScope {
+    JobGroupScope(std::shared_ptr<JobGroup> group);
+    ~JobGroupScope();
+
+    JobGroupScope(const JobGroupScope & other) = delete;
+    void operator = (const JobGroupScope & other) = delete;
+
+private:
+    std::shared_ptr<JobGroup> group;
+    JobGroup * previous;
+};
+
+
 /*****************************************************************************/
 /* THREAD POOL                                                               */
 /*****************************************************************************/
@@ -29,6 +160,17 @@ int numCpus();
     threads.
 */
 
+struct ThreadPoolStatus {
+    int numThreads;
+    uint64_t jobsRunning;
+    uint64_t jobsSubmitted;
+    uint64_t jobsFinished;
+    uint64_t jobsStolen;
+    uint64_t jobsWithFullQueue;
+    uint64_t jobsRunLocally;
+    std::vector<JobGroupStatus> jobGroups;
+};
+
 struct ThreadPool {
     ThreadPool(ThreadPool & parent = instance(), int numThreads = numCpus());
     ThreadPool(int numThreads);
@@ -38,7 +180,8 @@ struct ThreadPool {
 
         The job MUST NOT throw an exception; any exception thrown within the
         job WILL CRASH THE PROGRAM.  (The lambda will be marked noexcept at
-        a later date).
+        a later date).  The only exception is JobGroupCancelled, which
+        stops the job.
 
         The job may either:
         1.  Be run before the add() function terminates
@@ -67,6 +210,12 @@ struct ThreadPool {
     uint64_t jobsWithFullQueue() const;
     uint64_t jobsRunLocally() const;
 
+    /// The group that this pool's jobs belong to, if any
+    std::shared_ptr<JobGroup> jobGroup() const;
+
+    /// Return the counters of the pool and the status of all job groups
+    ThreadPoolStatus getStatus() const;
+
     static ThreadPool & instance();
     
 private:
@@ -14,6 +14,7 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/server/analytics.h"
 #include "mldb/sql/sql_expression.h"
+#include "mldb/sql/expression_value_batch.h"
 #include "mldb/sql/sql_utils.h"
 #include "mldb/jml/utils/lightweight_hash.h"
 #include "mldb/jml/utils/profile.h"
@@ -24,6 +25,7 @@
 #include "mldb/jml/utils/environment.h"
 #include "mldb/ml/jml/buckets.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/types/any_impl.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/rest/rest_request_router.h"
@@ -832,6 +834,8 @@ queryStructuredExpr(const SelectExpression & select,
                     const ProgressFunc & onProgress
                     ) const
 {
+    JobGroupScope jobGroup(getQueryJobGroup(select.surface));
+
     ExcAssert(having);
     ExcAssert(rowName);
     std::mutex lock;
@@ -909,6 +913,8 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                            Utf8String alias,
                            const ProgressFunc & onProgress) const
 {
+    JobGroupScope jobGroup(getQueryJobGroup(select.surface));
+
     if (!having->isConstantTrue() && groupBy.clauses.empty())
         throw HttpReturnException
             (400, "HAVING expression requires a GROUP BY expression");
@@ -932,12 +938,13 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
                 return onRow(path, row);
             };
 
-        iterateDatasetExpr(select, *this, alias, when, where,
+        // Rows are passed in order, one at a time, so that they come out
+        // in the same order as queryStructured()
+        return iterateDatasetExpr(select, *this, alias, when, where,
                                   { rowName->shallowCopy() },
-                                  { processor, true /*processInParallel*/ },
+                                  { processor, false /*processInParallel*/ },
                                   orderBy, offset, limit,
-                                  onProgress);
-        return true;
+                                  onProgress).first;
     }
     else {
 
@@ -956,13 +963,11 @@ queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onR
             };
 
          //QueryStructured always want a stable ordering, but it doesnt have to be by rowhash
-        iterateDatasetGrouped(select, *this, alias, when, where,
+        return iterateDatasetGrouped(select, *this, alias, when, where,
                                      groupBy, aggregators, *having, *rowName,
-                                     {processor, true/*processInParallel*/},
+                                     {processor, false/*processInParallel*/},
                                      orderBy, offset, limit,
-                                     onProgress);
-
-        return true;
+                                     onProgress).first;
     }
 }
 
@@ -1916,50 +1921,72 @@ generateRowsWhere(const SqlBindingScope & scope,
                 std::atomic_ulong rowCount(0);
 
                 ProgressState whereProgress(numRows);
-                auto onRow = [&] (size_t n)
+
+                // The where expression is evaluated a block of rows at a
+                // time, which allows the batch kernels of the expression
+                // to run over the whole block at once.
+                size_t blockSize = ExpressionValueBatch::DEFAULT_BATCH_SIZE;
+                size_t numBlocks = (numRows + blockSize - 1) / blockSize;
+
+                auto onBlock = [&] (size_t blockNum)
                     {
-                        ++rowCount;
+                        size_t begin = blockNum * blockSize;
+                        size_t end = std::min(begin + blockSize, numRows);
+                        size_t n = end - begin;
+
+                        std::vector<MatrixNamedRow> blockRows(n);
+                        std::vector<SqlExpressionDatasetScope::RowScope> scopes;
+                        std::vector<const SqlRowScope *> scopePtrs(n);
+                        scopes.reserve(n);
+
+                        for (size_t i = 0;  i < n;  ++i) {
+                            const RowPath & r = rows[begin + i];
+                            MatrixNamedRow & row = blockRows[i];
+                            if (needsColumns)
+                                row = matrix->getRow(r);
+                            else {
+                                row.rowHash = row.rowName = r;
+                            }
+                            scopes.emplace_back(dsScope.getRowScope(row, &params));
+                            scopePtrs[i] = &scopes.back();
+                        }
 
-                        if (rowCount % PROGRESS_RATE == 0) {
+                        ExpressionValueBatch keep;
+                        whereBound.execBatch(scopePtrs.data(), n, keep,
+                                             GET_LATEST);
+
+                        auto & output = accum.get();
+                        for (size_t i = 0;  i < n;  ++i) {
+                            if (keep.isTrue(i))
+                                output.push_back(rows[begin + i]);
+                        }
+
+                        size_t before = rowCount.fetch_add(n);
+                        if ((before + n) / PROGRESS_RATE
+                            != before / PROGRESS_RATE) {
                             if (onProgress) {
-                                whereProgress = rowCount;
+                                whereProgress = before + n;
                                 if (!onProgress(whereProgress)) {
                                     return false;
                                 }
                             }
                         }
 
-                        const RowPath & r = rows[n];
-
-                        MatrixNamedRow row;
-                        if (needsColumns)
-                            row = matrix->getRow(r);
-                        else {
-                            row.rowHash = row.rowName = r;
-                        }
-
-                        auto rowScope = dsScope.getRowScope(row, &params);
-                        
-                        bool keep = whereBound(rowScope, GET_LATEST).isTrue();
-                        
-                        if (keep)
-                            accum.get().push_back(r);
-
                         return true;
                     };
 
                 bool needSort = false;
                 if (rows.size() >= 1000) {
                     // Scan the whole lot with the when in parallel
-                    if (!parallelMapHaltable(0, rows.size(), onRow))
+                    if (!parallelMapHaltable(0, numBlocks, onBlock))
                         throw CancellationException("row where generation was cancelled");
 
                     needSort = true;
                 } else {
                     // Serial, since probably it's not worth the overhead
                     // to run them in parallel.
-                    for (unsigned i = 0;  i < rows.size();  ++i)
-                        if (!onRow(i))
+                    for (unsigned i = 0;  i < numBlocks;  ++i)
+                        if (!onBlock(i))
                             throw CancellationException("row where generation was cancelled");
                 }
 
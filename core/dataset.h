@@ -544,7 +544,11 @@ struct Dataset: public MldbEntity {
                         Utf8String alias = "",
                         const ProgressFunc & onProgress = nullptr) const;
 
-    /** Select from the database. */
+    /** Select from the database, passing each row to onRow as soon as it
+        is available instead of returning them all at once.  The rows are
+        passed one at a time and in the same order as queryStructured().
+        Returns false if onRow returned false, which stops the query.
+    */
     virtual bool
     queryStructuredIncremental(std::function<bool (Path &, ExpressionValue &)> & onRow,
                                const SelectExpression & select,
@@ -35,6 +35,19 @@ FunctionInfoDescription()
              "Output values that the function writes to");
 }
 
+DEFINE_STRUCTURE_DESCRIPTION(FunctionApplierCacheStats);
+
+FunctionApplierCacheStatsDescription::
+FunctionApplierCacheStatsDescription()
+{
+    addField("hits", &FunctionApplierCacheStats::hits,
+             "Number of calls that re-used the cached bound applier");
+    addField("misses", &FunctionApplierCacheStats::misses,
+             "Number of calls that needed to bind the function");
+    addField("bindTimeSeconds", &FunctionApplierCacheStats::bindTimeSeconds,
+             "Total time spent binding the function on cache misses");
+}
+
 DEFINE_STRUCTURE_DESCRIPTION_NAMED(FunctionPolyConfigDescription, PolyConfigT<Function>);
 
 FunctionPolyConfigDescription::
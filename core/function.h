@@ -85,6 +85,21 @@ struct FunctionInfo {
 DECLARE_STRUCTURE_DESCRIPTION(FunctionInfo);
 
 
+/*****************************************************************************/
+/* FUNCTION APPLIER CACHE STATS                                              */
+/*****************************************************************************/
+
+/** Counters for the cache of the bound applier used by Function::call(). */
+
+struct FunctionApplierCacheStats {
+    uint64_t hits = 0;             ///< Calls that re-used the cached applier
+    uint64_t misses = 0;           ///< Calls that needed to bind
+    double bindTimeSeconds = 0.0;  ///< Total time spent binding on misses
+};
+
+DECLARE_STRUCTURE_DESCRIPTION(FunctionApplierCacheStats);
+
+
 /*****************************************************************************/
 /* FUNCTION APPLIER                                                          */
 /*****************************************************************************/
@@ -175,10 +190,13 @@ struct Function: public MldbEntity {
     */
     virtual FunctionInfo getFunctionInfo() const = 0;
 
-    /** Call an unbound function directly with the given input.  Note
-        that this will re-bind the function on every call and is therefore
-        horrendously inefficient; it should be used only for when the
-        input is truly dynamic and there is no possible way to bind it.
+    /** Call an unbound function directly with the given input.  The
+        function is bound against its declared input (getFunctionInfo())
+        and the applier is cached, so that repeated calls don't pay for
+        the bind.  The cache is dropped as soon as any entity on the
+        server is created, replaced or deleted, as the bound applier may
+        refer to them.  Where possible, binding the function once and using
+        the applier is still preferable.
 
         It's not a virtual method as it's complex in how it interprets
         its input.
@@ -189,6 +207,25 @@ struct Function: public MldbEntity {
     */
     ExpressionValue call(const ExpressionValue & input) const;
 
+    /** Return the applier that call() uses, binding it if it's not
+        cached.  The returned pointer keeps everything the applier needs
+        alive.  Also defined in function_collection.cc.
+    */
+    std::shared_ptr<const FunctionApplier> getCachedApplier() const;
+
+    /** Drop the appliers cached by call() for every function of the given
+        server, so that they no longer hold on to the entities they were
+        bound against.  Called by the server whenever an entity is
+        created, replaced or deleted.  Also defined in
+        function_collection.cc.
+    */
+    static void dropCachedAppliers(MldbServer * server);
+
+    /** Return the hit, miss and bind time counters of the applier cache
+        used by call().
+    */
+    FunctionApplierCacheStats getApplierCacheStats() const;
+
     /** Method to overwrite to handle a request.  By default, the function
         will return that it can't handle any requests.  Used to expose
         function-specific functionality.
@@ -207,6 +244,13 @@ struct Function: public MldbEntity {
                                   const ExpressionValue & context) const = 0;
 
     friend class FunctionApplier;
+
+private:
+    /// Cache for getCachedApplier(), created on first use
+    struct ApplierCache;
+    mutable std::shared_ptr<ApplierCache> applierCache;
+
+    std::shared_ptr<ApplierCache> getApplierCache() const;
 };
 
 
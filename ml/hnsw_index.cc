@@ -0,0 +1,435 @@
+/** hnsw_index.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Hierarchical navigable small world graph.
+*/
+
+#include "hnsw_index.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/jml/db/persistent.h"
+#include <unordered_set>
+#include <queue>
+#include <algorithm>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/// Maximum layer of an item; with m >= 2, reaching it is vanishingly rare
+static constexpr int MAX_LEVEL = 31;
+
+HnswIndex::
+HnswIndex(int m, int efConstruction)
+    : m(m), m0(2 * m), efConstruction(efConstruction),
+      entryPoint(-1), maxLevel(-1)
+{
+    ExcAssertGreaterEqual(m, 2);
+    ExcAssertGreaterEqual(efConstruction, 1);
+}
+
+HnswIndex::
+HnswIndex(const HnswIndex & other)
+    : m(other.m), m0(other.m0), efConstruction(other.efConstruction),
+      levels(other.levels),
+      links0(other.links0),
+      numLinks0(other.numLinks0),
+      upperLinks(other.upperLinks),
+      entryPoint(other.entryPoint),
+      maxLevel(other.maxLevel)
+{
+}
+
+int
+HnswIndex::
+randomLevel(int item) const
+{
+    // The level depends only on the item, so that building the same index
+    // twice gives the same graph whatever order the items were added in.
+    uint64_t h = (uint64_t)item * 0x9e3779b97f4a7c15ULL + 0x632be59bd9b4e019ULL;
+    h = (h ^ (h >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    h = (h ^ (h >> 27)) * 0x94d049bb133111ebULL;
+    h ^= h >> 31;
+
+    double u = ((h >> 11) + 0.5) * (1.0 / 9007199254740992.0);
+    int level = std::floor(-std::log(u) / std::log((double)m));
+    return std::min(level, MAX_LEVEL);
+}
+
+std::vector<int>
+HnswIndex::
+copyLinks(int item, int level) const
+{
+    std::unique_lock<std::mutex> guard(lockFor(item));
+    if (level == 0) {
+        const int * l = links0.data() + (size_t)item * m0;
+        return std::vector<int>(l, l + numLinks0[item]);
+    }
+    return upperLinks[item][level - 1];
+}
+
+void
+HnswIndex::
+setLinks(int item, int level, const std::vector<Candidate> & links)
+{
+    std::unique_lock<std::mutex> guard(lockFor(item));
+    if (level == 0) {
+        ExcAssertLessEqual(links.size(), m0);
+        int * l = links0.data() + (size_t)item * m0;
+        for (size_t i = 0;  i < links.size();  ++i)
+            l[i] = links[i].second;
+        numLinks0[item] = links.size();
+    }
+    else {
+        std::vector<int> & l = upperLinks[item][level - 1];
+        l.clear();
+        for (auto & c: links)
+            l.push_back(c.second);
+    }
+}
+
+template<bool Locking>
+HnswIndex::Candidate
+HnswIndex::
+greedySearch(const QueryDistance & distance,
+             Candidate current, int fromLevel, int toLevel) const
+{
+    for (int level = fromLevel;  level > toLevel;  --level) {
+        for (bool changed = true;  changed;  ) {
+            changed = false;
+
+            auto onLink = [&] (int link)
+                {
+                    float d = distance(link);
+                    if (d < current.first) {
+                        current = { d, link };
+                        changed = true;
+                    }
+                };
+
+            if (Locking) {
+                for (int link: copyLinks(current.second, level))
+                    onLink(link);
+            }
+            else {
+                for (int link: upperLinks[current.second][level - 1])
+                    onLink(link);
+            }
+        }
+    }
+
+    return current;
+}
+
+template<bool Locking>
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+searchLayer(const QueryDistance & distance,
+            const std::vector<Candidate> & entryPoints,
+            int ef, int level) const
+{
+    std::unordered_set<int> visited;
+
+    // Closest first
+    std::priority_queue<Candidate, std::vector<Candidate>,
+                        std::greater<Candidate> > candidates;
+    // Furthest first
+    std::priority_queue<Candidate> found;
+
+    for (auto & e: entryPoints) {
+        if (!visited.insert(e.second).second)
+            continue;
+        candidates.push(e);
+        found.push(e);
+        if (found.size() > ef)
+            found.pop();
+    }
+
+    std::vector<int> linkBuffer;
+
+    while (!candidates.empty()) {
+        Candidate current = candidates.top();
+        if (found.size() >= ef && current.first > found.top().first)
+            break;
+        candidates.pop();
+
+        const int * first;
+        const int * last;
+
+        if (Locking) {
+            linkBuffer = copyLinks(current.second, level);
+            first = linkBuffer.data();
+            last = first + linkBuffer.size();
+        }
+        else if (level == 0) {
+            first = links0.data() + (size_t)current.second * m0;
+            last = first + numLinks0[current.second];
+        }
+        else {
+            auto & l = upperLinks[current.second][level - 1];
+            first = l.data();
+            last = first + l.size();
+        }
+
+        for (; first != last;  ++first) {
+            int link = *first;
+            if (!visited.insert(link).second)
+                continue;
+
+            float d = distance(link);
+            if (found.size() < ef || d < found.top().first) {
+                candidates.emplace(d, link);
+                found.emplace(d, link);
+                if (found.size() > ef)
+                    found.pop();
+            }
+        }
+    }
+
+    std::vector<Candidate> result(found.size());
+    for (size_t i = result.size();  i > 0;  --i) {
+        result[i - 1] = found.top();
+        found.pop();
+    }
+    return result;
+}
+
+std::vector<HnswIndex::Candidate>
+HnswIndex::
+selectNeighbors(const std::vector<Candidate> & candidates,
+                int maxLinks,
+                const ItemDistance & distance) const
+{
+    // Heuristic from the paper: keep a candidate only if it's closer to
+    // the item than to any of the neighbors already kept.  This keeps
+    // links going in different directions, which is what makes the graph
+    // navigable for clustered data.
+    std::vector<Candidate> result;
+
+    for (auto & c: candidates) {
+        if (result.size() >= maxLinks)
+            break;
+
+        bool keep = true;
+        for (auto & r: result) {
+            if (distance(c.second, r.second) < c.first) {
+                keep = false;
+                break;
+            }
+        }
+
+        if (keep)
+            result.push_back(c);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+connect(int item, int newLink, float newLinkDistance, int level,
+        const ItemDistance & distance)
+{
+    std::unique_lock<std::mutex> guard(lockFor(item));
+
+    int maxLinks = level == 0 ? m0 : m;
+
+    if (level == 0) {
+        if (numLinks0[item] < m0) {
+            links0[(size_t)item * m0 + numLinks0[item]++] = newLink;
+            return;
+        }
+    }
+    else {
+        std::vector<int> & l = upperLinks[item][level - 1];
+        if (l.size() < maxLinks) {
+            l.push_back(newLink);
+            return;
+        }
+    }
+
+    // Too many links; choose which ones to keep
+    std::vector<Candidate> candidates;
+    candidates.emplace_back(newLinkDistance, newLink);
+
+    if (level == 0) {
+        const int * l = links0.data() + (size_t)item * m0;
+        for (int i = 0;  i < numLinks0[item];  ++i)
+            candidates.emplace_back(distance(item, l[i]), l[i]);
+    }
+    else {
+        for (int link: upperLinks[item][level - 1])
+            candidates.emplace_back(distance(item, link), link);
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    auto selected = selectNeighbors(candidates, maxLinks, distance);
+
+    // We already hold the lock, so we can't use setLinks()
+    if (level == 0) {
+        int * l = links0.data() + (size_t)item * m0;
+        for (size_t i = 0;  i < selected.size();  ++i)
+            l[i] = selected[i].second;
+        numLinks0[item] = selected.size();
+    }
+    else {
+        std::vector<int> & l = upperLinks[item][level - 1];
+        l.clear();
+        for (auto & c: selected)
+            l.push_back(c.second);
+    }
+}
+
+void
+HnswIndex::
+insert(int item, const ItemDistance & distance)
+{
+    int level = levels[item];
+
+    int entry, topLevel;
+    {
+        std::unique_lock<std::mutex> guard(entryMutex);
+        entry = entryPoint;
+        topLevel = maxLevel;
+    }
+
+    auto distanceToItem = [&] (int other) { return distance(item, other); };
+
+    Candidate current(distanceToItem(entry), entry);
+    current = greedySearch<true>(distanceToItem, current, topLevel, level);
+
+    std::vector<Candidate> entryPoints = { current };
+
+    for (int l = std::min(level, topLevel);  l >= 0;  --l) {
+        auto found = searchLayer<true>(distanceToItem, entryPoints,
+                                       efConstruction, l);
+        auto neighbors = selectNeighbors(found, m, distance);
+
+        setLinks(item, l, neighbors);
+        for (auto & n: neighbors)
+            connect(n.second, item, n.first, l, distance);
+
+        entryPoints = std::move(found);
+    }
+
+    if (level > topLevel) {
+        std::unique_lock<std::mutex> guard(entryMutex);
+        if (level > maxLevel) {
+            maxLevel = level;
+            entryPoint = item;
+        }
+    }
+}
+
+void
+HnswIndex::
+add(size_t numItems, const ItemDistance & distance)
+{
+    size_t first = size();
+    if (numItems <= first)
+        return;
+
+    levels.resize(numItems);
+    links0.resize(numItems * m0);
+    numLinks0.resize(numItems);
+    upperLinks.resize(numItems);
+
+    for (size_t i = first;  i < numItems;  ++i) {
+        levels[i] = randomLevel(i);
+        upperLinks[i].resize(levels[i]);
+    }
+
+    if (!locks)
+        locks.reset(new std::mutex[NUM_LOCKS]);
+
+    if (entryPoint == -1) {
+        entryPoint = first;
+        maxLevel = levels[first];
+        ++first;
+    }
+
+    auto doItem = [&] (size_t i)
+        {
+            insert(i, distance);
+        };
+
+    parallelMap(first, numItems, doItem);
+}
+
+std::vector<std::pair<float, int> >
+HnswIndex::
+search(const QueryDistance & distance,
+       int numNeighbors,
+       int ef,
+       float maxDistance) const
+{
+    if (entryPoint == -1 || numNeighbors <= 0)
+        return {};
+
+    Candidate current(distance(entryPoint), entryPoint);
+    current = greedySearch<false>(distance, current, maxLevel, 0);
+
+    auto found = searchLayer<false>(distance, { current },
+                                    std::max(ef, numNeighbors), 0);
+
+    std::vector<std::pair<float, int> > result;
+    for (auto & f: found) {
+        if (result.size() >= numNeighbors || f.first > maxDistance)
+            break;
+        result.push_back(f);
+    }
+
+    return result;
+}
+
+size_t
+HnswIndex::
+memusage() const
+{
+    size_t result = sizeof(*this)
+        + levels.capacity() * sizeof(uint8_t)
+        + links0.capacity() * sizeof(int)
+        + numLinks0.capacity() * sizeof(int)
+        + upperLinks.capacity() * sizeof(upperLinks[0]);
+
+    for (auto & item: upperLinks) {
+        for (auto & l: item)
+            result += sizeof(l) + l.capacity() * sizeof(int);
+    }
+
+    return result;
+}
+
+void
+HnswIndex::
+serialize(ML::DB::Store_Writer & store) const
+{
+    store << string("HNSW_INDEX") << ML::DB::compact_size_t(1);  // version
+    store << ML::DB::compact_size_t(m)
+          << ML::DB::compact_size_t(efConstruction)
+          << ML::DB::compact_size_t(size())
+          << entryPoint << maxLevel;
+
+    for (size_t i = 0;  i < size();  ++i) {
+        store << ML::DB::compact_size_t(levels[i])
+              << ML::DB::compact_size_t(numLinks0[i]);
+        for (int j = 0;  j < numLinks0[i];  ++j)
+            store << ML::DB::compact_size_t(links0[i * m0 + j]);
+        for (auto & l: upperLinks[i]) {
+            store << ML::DB::compact_size_t(l.size());
+            for (int link: l)
+                store << ML::DB::compact_size_t(link);
+        }
+    }
+}
+
+} // namespace MLDB
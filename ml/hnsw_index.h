@@ -0,0 +1,142 @@
+/** hnsw_index.h                                                   -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Hierarchical navigable small world graph, for approximate nearest
+    neighbor search in high dimensional spaces.
+*/
+
+#pragma once
+
+#include "mldb/jml/db/persistent_fwd.h"
+#include <vector>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <cmath>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* HNSW INDEX                                                                */
+/*****************************************************************************/
+
+/** Approximate nearest neighbors index, as described in "Efficient and
+    robust approximate nearest neighbor search using Hierarchical Navigable
+    Small World graphs" by Malkov and Yashunin.
+
+    Items are integers from 0 to size() - 1, and are added in that order.
+    The index doesn't know about the coordinates of the items; they are
+    only ever accessed via the distance functions, which makes it usable
+    with any metric.
+
+    Adding items is done in parallel, and can be done again after the
+    index has been searched (but not concurrently with a search).  A
+    search is exact with high probability for small datasets, and its
+    recall can be traded off against latency with the ef parameter.
+*/
+
+struct HnswIndex {
+
+    /// Distance between two items of the index
+    typedef std::function<float (int item1, int item2)> ItemDistance;
+
+    /// Distance between an item of the index and the query
+    typedef std::function<float (int item)> QueryDistance;
+
+    /** Create an empty index.  m is the number of links of each item on
+        the upper layers (it's 2 * m on the bottom layer), and
+        efConstruction is the breadth of the search done to find the links
+        of new items.  Both trade off build time and memory against the
+        recall of searches.
+    */
+    HnswIndex(int m = 16, int efConstruction = 200);
+
+    /// Copy an index, so that more items can be added to the copy
+    HnswIndex(const HnswIndex & other);
+
+    /** Add the items from size() to numItems - 1 to the index, in
+        parallel.
+    */
+    void add(size_t numItems, const ItemDistance & distance);
+
+    /** Find the (approximate) numNeighbors nearest neighbors of the query,
+        with a distance of no more than maxDistance.  ef is the breadth of
+        the search; a higher value gives a higher recall but a slower
+        search.  The result is sorted by distance then item.
+    */
+    std::vector<std::pair<float, int> >
+    search(const QueryDistance & distance,
+           int numNeighbors,
+           int ef,
+           float maxDistance = INFINITY) const;
+
+    /// Number of items in the index
+    size_t size() const { return levels.size(); }
+
+    /// Approximate memory usage in bytes
+    size_t memusage() const;
+
+    void serialize(ML::DB::Store_Writer & store) const;
+
+    const int m;
+    const int m0;
+    const int efConstruction;
+
+private:
+    typedef std::pair<float, int> Candidate;
+
+    /// Level of each item; the item is in layers 0 to levels[item]
+    std::vector<uint8_t> levels;
+
+    /// Links of each item on layer 0; m0 slots per item
+    std::vector<int> links0;
+    std::vector<int> numLinks0;
+
+    /// Links of each item on the upper layers; upperLinks[item][layer - 1]
+    std::vector<std::vector<std::vector<int> > > upperLinks;
+
+    int entryPoint;   ///< Item at the top layer, or -1 if empty
+    int maxLevel;     ///< Layer of the entry point
+
+    /// Striped locks for the links of items, used while adding
+    static constexpr size_t NUM_LOCKS = 4096;
+    std::unique_ptr<std::mutex[]> locks;
+    std::mutex entryMutex;
+
+    std::mutex & lockFor(int item) const
+    {
+        return locks[item % NUM_LOCKS];
+    }
+
+    int randomLevel(int item) const;
+
+    std::vector<int> copyLinks(int item, int level) const;
+
+    void setLinks(int item, int level, const std::vector<Candidate> & links);
+
+    template<bool Locking>
+    std::vector<Candidate>
+    searchLayer(const QueryDistance & distance,
+                const std::vector<Candidate> & entryPoints,
+                int ef, int level) const;
+
+    template<bool Locking>
+    Candidate greedySearch(const QueryDistance & distance,
+                           Candidate current, int fromLevel, int toLevel) const;
+
+    std::vector<Candidate>
+    selectNeighbors(const std::vector<Candidate> & candidates,
+                    int maxLinks,
+                    const ItemDistance & distance) const;
+
+    void insert(int item, const ItemDistance & distance);
+
+    void connect(int item, int newLink, float newLinkDistance, int level,
+                 const ItemDistance & distance);
+};
+
+} // namespace MLDB
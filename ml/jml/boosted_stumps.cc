@@ -251,6 +251,121 @@ predict(int label, const Feature_Set & features,
     return result;
 }
 
+namespace {
+
+/** Apply the output transformation to the raw scores, as done by
+    predict(). */
+void apply_output(distribution<float> & result, Boosted_Stumps::Output output)
+{
+    if (output != Boosted_Stumps::LOGIT && output != Boosted_Stumps::LOGIT_NORM)
+        return;
+
+    double total = 0.0;
+    for (unsigned i = 0;  i < result.size();  ++i) {
+        /* Avoid an overflow from the exp. */
+        if (result[i] > fp_traits<float>::max_exp_arg * 0.9)
+            result[i] = fp_traits<float>::max_exp_arg * 0.9;
+        double e = exp(result[i]);
+        double x = e / (e + (1.0 / e));
+        total += x;
+        result[i] = x;
+    }
+
+    if (output == Boosted_Stumps::LOGIT_NORM) {
+        if ((float)total == 0.0F) {
+            result.fill(1);
+            result.normalize();
+        }
+        else result /= total;
+    }
+}
+
+} // file scope
+
+bool
+Boosted_Stumps::
+optimization_supported() const
+{
+    return true;
+}
+
+bool
+Boosted_Stumps::
+predict_is_optimized() const
+{
+    return !!compiled;
+}
+
+bool
+Boosted_Stumps::
+optimize_impl(Optimization_Info & info)
+{
+    std::shared_ptr<Compiled_Trees> result
+        (new Compiled_Trees(label_count()));
+    result->add_bias(bias);
+
+    for (auto & entry: stumps) {
+        Stump & stump = entry.second;
+        stump.split.optimize(info);
+        result->add_stump(stump.split, stump.action.pred_true,
+                          stump.action.pred_false, stump.action.pred_missing);
+    }
+
+    result->finish();
+    Compiled_Trees::publish(compiled, std::move(result));
+    return true;
+}
+
+Label_Dist
+Boosted_Stumps::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    int nl = label_count();
+    double accum[nl];
+    std::fill(accum, accum + nl, 0.0);
+    compiled->predict(features, accum);
+
+    distribution<float> result(accum, accum + nl);
+    apply_output(result, output);
+    return result;
+}
+
+void
+Boosted_Stumps::
+optimized_predict_impl(const float * features,
+                       const Optimization_Info & info,
+                       double * accum,
+                       double weight,
+                       PredictionContext * context) const
+{
+    // The compiled stumps accumulate directly unless the output needs to
+    // be transformed first
+    if (output == RAW)
+        compiled->predict(features, accum, weight);
+    else Classifier_Impl::optimized_predict_impl(features, info, accum,
+                                                 weight, context);
+}
+
+float
+Boosted_Stumps::
+optimized_predict_impl(int label,
+                       const float * features,
+                       const Optimization_Info & info,
+                       PredictionContext * context) const
+{
+    if (output == LOGIT_NORM)
+        return optimized_predict_impl(features, info, context).at(label);
+
+    float result = compiled->predict(label, features);
+    if (output == LOGIT) {
+        double e = exp(result);
+        result = e / (e + 1.0 / e);
+    }
+    return result;
+}
+
 Boosted_Stumps::iterator Boosted_Stumps::
 insert(const Stump & stump, float weight)
 {
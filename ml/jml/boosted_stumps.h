@@ -11,6 +11,7 @@
 
 #include "mldb/ml/jml/classifier.h"
 #include "stump.h"
+#include "compiled_trees.h"
 #include "mldb/jml/utils/enum_info.h"
 #include "mldb/jml/utils/floating_point.h"
 #include <boost/iterator/transform_iterator.hpp>
@@ -70,6 +71,10 @@ public:
     /** How we transform the output.  Default is no transform (raw output). */
     Output output;
 
+    /** The stumps in the form used by the optimized predict.  Built by
+        optimize(). */
+    std::shared_ptr<const Compiled_Trees> compiled;
+
     /** Iterator types.  These are just like a normal one would be. */
     typedef boost::transform_iterator<std::select2nd<stumps_type::value_type>,
                                       stumps_type::iterator>
@@ -119,6 +124,7 @@ public:
         bias.swap(other.bias);
         sum_missing.swap(other.sum_missing);
         std::swap(predicted_, other.predicted_);
+        compiled.swap(other.compiled);
     }
 
     using Classifier_Impl::predict;
@@ -132,6 +138,32 @@ public:
     predict(const Feature_Set & features,
             PredictionContext * context = 0) const;
 
+    virtual bool optimization_supported() const;
+
+    virtual bool predict_is_optimized() const;
+
+    /** Optimizes the splits and compiles the stumps, which are then
+        predicted with QuickScorer. */
+    virtual bool optimize_impl(Optimization_Info & info);
+
+    virtual Label_Dist
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
+    virtual void
+    optimized_predict_impl(const float * features,
+                           const Optimization_Info & info,
+                           double * accum,
+                           double weight,
+                           PredictionContext * context = 0) const;
+
+    virtual float
+    optimized_predict_impl(int label,
+                           const float * features,
+                           const Optimization_Info & info,
+                           PredictionContext * context = 0) const;
+
     /** This is the core of the predict algorithm.  It is parameterised by how
         it updates its results, which allows us to reuse the same code for both
         the single and multiple label prediction.
@@ -9,6 +9,8 @@
 */
 
 #include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/ml/jml/boosted_stumps.h"
 #include <memory>
 #include "mldb/jml/utils/string_functions.h"
 #include "mldb/jml/db/persistent.h"
@@ -100,16 +102,57 @@ predict_is_optimized() const
     return optimized_;
 }
 
+namespace {
+
+/** Return the compiled form of an optimized classifier whose prediction is
+    a sum of trees, or null if it isn't one. */
+const Compiled_Trees *
+get_compiled(const Classifier_Impl & classifier)
+{
+    if (!classifier.predict_is_optimized())
+        return nullptr;
+    if (auto tree = dynamic_cast<const Decision_Tree *>(&classifier))
+        return tree->compiled.get();
+    if (auto committee = dynamic_cast<const Committee *>(&classifier))
+        return committee->compiled.get();
+    if (auto stumps = dynamic_cast<const Boosted_Stumps *>(&classifier)) {
+        // The logit outputs aren't a sum
+        if (stumps->output == Boosted_Stumps::RAW)
+            return stumps->compiled.get();
+    }
+    return nullptr;
+}
+
+} // file scope
+
 bool
 Committee::
 optimize_impl(Optimization_Info & info)
 {
     bool any_succeeded = false;
+    bool all_compiled = !bias.empty();
 
     for (unsigned i = 0;  i < classifiers.size();  ++i) {
         bool succeeded = classifiers[i]->optimize_impl(info);
         if (succeeded) any_succeeded = true;
+
+        if (weights[i] == 0.0) continue;
+        const Compiled_Trees * member = get_compiled(*classifiers[i]);
+        if (!member || member->label_count() != bias.size())
+            all_compiled = false;
+    }
+
+    std::shared_ptr<Compiled_Trees> result;
+    if (all_compiled) {
+        result.reset(new Compiled_Trees(bias.size()));
+        result->add_bias(bias);
+        for (unsigned i = 0;  i < classifiers.size();  ++i) {
+            if (weights[i] == 0.0) continue;
+            result->add(*get_compiled(*classifiers[i]), weights[i]);
+        }
+        result->finish();
     }
+    Compiled_Trees::publish(compiled, std::move(result));
 
     return optimized_ = any_succeeded;
 }
@@ -122,6 +165,13 @@ optimized_predict_impl(const float * features,
 {
     int nl = bias.size();
 
+    if (compiled) {
+        double accum[nl];
+        std::fill(accum, accum + nl, 0.0);
+        compiled->predict(features, accum);
+        return Label_Dist(accum, accum + nl);
+    }
+
     double accum[nl];
     std::copy(&bias[0], &bias[0] + nl, accum);
 
@@ -143,6 +193,11 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
+    if (compiled) {
+        compiled->predict(features, accum, weight);
+        return;
+    }
+
     int nl = bias.size();
 
     for (unsigned i = 0;  i < nl;  ++i)
@@ -166,6 +221,9 @@ optimized_predict_impl(int label,
     if (label >= bias.size())
         throw Exception("Committee::predict(): invalid label");
 
+    if (compiled)
+        return compiled->predict(label, features);
+
     float result = bias[label];
 
     for (unsigned i = 0;  i < classifiers.size();  ++i) {
@@ -13,6 +13,7 @@
 
 
 #include "mldb/ml/jml/classifier.h"
+#include "mldb/ml/jml/compiled_trees.h"
 
 
 namespace ML {
@@ -42,6 +43,11 @@ public:
     distribution<float> bias;    ///< Bias to add to each label
     Output_Encoding encoding;    ///< What type of output we produce
 
+    /** When all of the members are sums of trees, the whole committee
+        flattened into one for the optimized predict.  Built by
+        optimize(). */
+    std::shared_ptr<const Compiled_Trees> compiled;
+
     /** Swap two Committee objects.  Guaranteed not to throw an
         exception. */
     void swap(Committee & other)
@@ -50,6 +56,7 @@ public:
         classifiers.swap(other.classifiers);
         weights.swap(other.weights);
         bias.swap(other.bias);
+        compiled.swap(other.compiled);
     }
 
     void add(std::shared_ptr<Classifier_Impl> classifier, float weight = 1.0);
@@ -0,0 +1,458 @@
+/** compiled_trees.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Flattened form of a weighted sum of decision trees.
+*/
+
+#include "compiled_trees.h"
+#include "mldb/arch/exception.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/compiler/compiler.h"
+#include <algorithm>
+#include <functional>
+#include <mutex>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace ML {
+
+namespace {
+
+/// Mask with the bits from begin to end (exclusive) set
+uint64_t bit_range(int begin, int end)
+{
+    uint64_t bits = end - begin == 64 ? ~0ULL : (1ULL << (end - begin)) - 1;
+    return bits << begin;
+}
+
+/// Serializes replacing the compiled trees of a classifier
+std::mutex publish_lock;
+
+} // file scope
+
+
+/*****************************************************************************/
+/* COMPILED_TREES                                                            */
+/*****************************************************************************/
+
+Compiled_Trees::
+Compiled_Trees(int label_count)
+    : nl(label_count), bias(label_count), leaves(label_count),
+      finished(false)
+{
+    if (label_count <= 0)
+        throw Exception("Compiled_Trees: need at least one label");
+}
+
+bool
+Compiled_Trees::Node::
+operator == (const Node & other) const
+{
+    return split_val == other.split_val
+        && feature == other.feature
+        && op == other.op
+        && std::equal(child, child + 3, other.child);
+}
+
+int32_t
+Compiled_Trees::
+add_leaf(const distribution<float> & pred, double weight)
+{
+    int32_t index = leaves.size() / nl;
+    for (unsigned i = 0;  i < nl;  ++i)
+        leaves.push_back(i < pred.size() ? pred[i] * weight : 0.0);
+    return index;
+}
+
+void
+Compiled_Trees::
+add_tree(const Tree & tree, double weight)
+{
+    if (!tree.root)
+        return;
+
+    if (!tree.root.node()) {
+        add_bias(tree.root.leaf()->pred, weight);
+        return;
+    }
+
+    finished = false;
+
+    int32_t base = nodes.size();
+    std::vector<const Tree::Node *> queue(1, tree.root.node());
+
+    for (size_t i = 0;  i < queue.size();  ++i) {
+        const Tree::Node & node = *queue[i];
+        if (!node.split.is_optimized())
+            throw Exception("Compiled_Trees: split is not optimized");
+
+        Node compiled;
+        compiled.split_val = node.split.split_val();
+        compiled.feature = node.split.optimized_index();
+        compiled.op = node.split.op();
+
+        const Tree::Ptr * children[3];
+        children[false] = &node.child_false;
+        children[true] = &node.child_true;
+        children[MISSING] = &node.child_missing;
+
+        for (unsigned j = 0;  j < 3;  ++j) {
+            const Tree::Ptr & child = *children[j];
+            if (!child)
+                compiled.child[j] = ~0;
+            else if (child.node()) {
+                compiled.child[j] = base + queue.size();
+                queue.push_back(child.node());
+            }
+            else compiled.child[j] = ~add_leaf(child.leaf()->pred, weight);
+        }
+
+        nodes.push_back(compiled);
+    }
+
+    roots.push_back(base);
+}
+
+void
+Compiled_Trees::
+add_stump(const Split & split,
+          const distribution<float> & pred_true,
+          const distribution<float> & pred_false,
+          const distribution<float> & pred_missing,
+          double weight)
+{
+    if (!split.is_optimized())
+        throw Exception("Compiled_Trees: split is not optimized");
+
+    finished = false;
+
+    Node compiled;
+    compiled.split_val = split.split_val();
+    compiled.feature = split.optimized_index();
+    compiled.op = split.op();
+    compiled.child[true] = ~add_leaf(pred_true, weight);
+    compiled.child[false] = ~add_leaf(pred_false, weight);
+    compiled.child[MISSING] = ~add_leaf(pred_missing, weight);
+
+    roots.push_back(nodes.size());
+    nodes.push_back(compiled);
+}
+
+void
+Compiled_Trees::
+add_bias(const distribution<float> & bias, double weight)
+{
+    for (unsigned i = 0;  i < nl && i < bias.size();  ++i)
+        this->bias[i] += bias[i] * weight;
+}
+
+void
+Compiled_Trees::
+add(const Compiled_Trees & other, double weight)
+{
+    if (other.nl != nl)
+        throw Exception("Compiled_Trees::add(): label counts don't match");
+
+    finished = false;
+
+    for (unsigned i = 0;  i < nl;  ++i)
+        bias[i] += other.bias[i] * weight;
+
+    // Leaf 0 of other is the empty leaf, which maps onto ours
+    int32_t leaf_offset = leaves.size() / nl - 1;
+    for (size_t i = nl;  i < other.leaves.size();  ++i)
+        leaves.push_back(other.leaves[i] * weight);
+
+    int32_t node_offset = nodes.size();
+    for (Node node: other.nodes) {
+        for (unsigned j = 0;  j < 3;  ++j) {
+            int32_t & child = node.child[j];
+            if (child >= 0)
+                child += node_offset;
+            else if (child != ~0)
+                child = ~(~child + leaf_offset);
+        }
+        nodes.push_back(node);
+    }
+
+    for (int32_t root: other.roots)
+        roots.push_back(root + node_offset);
+}
+
+bool
+Compiled_Trees::
+add_quickscorer_tree(int32_t root, int32_t end,
+                     std::vector<std::pair<uint32_t, QS_Test> > & less,
+                     std::vector<std::pair<uint32_t, QS_Test> > & missing)
+{
+    if (end - root > MAX_QUICKSCORER_NODES)
+        return false;
+    for (int32_t i = root;  i < end;  ++i)
+        if (nodes[i].op == Split::EQUAL)
+            return false;
+
+    uint32_t tree = qs_leaf_offsets.size();
+    uint32_t leaf_offset = qs_leaves.size();
+
+    // Number the leaves left to right, with the true subtree first, then
+    // the false one and then the missing one.  The tests that fail clear
+    // the subtrees to the left of the branch that is taken, so that the
+    // lowest remaining bit is the leaf that is reached.
+    std::function<std::pair<int, int> (int32_t)> number
+        = [&] (int32_t ref) -> std::pair<int, int>
+        {
+            int begin = qs_leaves.size() - leaf_offset;
+            if (ref < 0) {
+                qs_leaves.push_back(~ref);
+                return { begin, begin + 1 };
+            }
+
+            const Node & node = nodes[ref];
+            auto t = number(node.child[true]);
+            auto f = number(node.child[false]);
+            auto m = number(node.child[MISSING]);
+
+            if (node.op == Split::LESS) {
+                QS_Test test = { node.split_val, tree,
+                                 ~bit_range(t.first, t.second) };
+                less.emplace_back(node.feature, test);
+            }
+
+            QS_Test test = { node.split_val, tree,
+                             ~bit_range(t.first, f.second) };
+            missing.emplace_back(node.feature, test);
+
+            return { begin, m.second };
+        };
+
+    number(root);
+    ExcAssertLessEqual(qs_leaves.size() - leaf_offset, 64);
+
+    qs_leaf_offsets.push_back(leaf_offset);
+    return true;
+}
+
+void
+Compiled_Trees::
+finish()
+{
+    node_roots.clear();
+    qs_features.clear();
+    qs_less.clear();
+    qs_missing.clear();
+    qs_leaf_offsets.clear();
+    qs_leaves.clear();
+
+    std::vector<std::pair<uint32_t, QS_Test> > less, missing;
+
+    // The nodes of each tree are contiguous and the trees are in order
+    for (size_t i = 0;  i < roots.size();  ++i) {
+        int32_t end = i + 1 < roots.size() ? roots[i + 1] : nodes.size();
+        if (!add_quickscorer_tree(roots[i], end, less, missing))
+            node_roots.push_back(roots[i]);
+    }
+
+    auto byFeatureAndValue
+        = [] (const std::pair<uint32_t, QS_Test> & t1,
+              const std::pair<uint32_t, QS_Test> & t2)
+        {
+            return t1.first < t2.first
+                || (t1.first == t2.first
+                    && t1.second.split_val < t2.second.split_val);
+        };
+
+    std::stable_sort(less.begin(), less.end(), byFeatureAndValue);
+    std::stable_sort(missing.begin(), missing.end(), byFeatureAndValue);
+
+    // Group the tests by feature
+    size_t l = 0, m = 0;
+    while (l < less.size() || m < missing.size()) {
+        uint32_t feature = std::min(l < less.size() ? less[l].first : ~0U,
+                                    m < missing.size()
+                                    ? missing[m].first : ~0U);
+        QS_Feature entry;
+        entry.feature = feature;
+        entry.less_begin = qs_less.size();
+        for (;  l < less.size() && less[l].first == feature;  ++l)
+            qs_less.push_back(less[l].second);
+        entry.less_end = qs_less.size();
+        entry.missing_begin = qs_missing.size();
+        for (;  m < missing.size() && missing[m].first == feature;  ++m)
+            qs_missing.push_back(missing[m].second);
+        entry.missing_end = qs_missing.size();
+        qs_features.push_back(entry);
+    }
+
+    finished = true;
+}
+
+MLDB_ALWAYS_INLINE int32_t
+Compiled_Trees::
+walk(int32_t ref, const float * features) const
+{
+    while (ref >= 0) {
+        const Node & node = nodes[ref];
+        float val = features[node.feature];
+        int branch;
+        if (std::isnan(val))
+            branch = MISSING;
+        else if (node.op == Split::LESS)
+            branch = val < node.split_val;
+        else if (node.op == Split::EQUAL)
+            branch = val == node.split_val;
+        else branch = true;
+        ref = node.child[branch];
+    }
+    return ~ref;
+}
+
+void
+Compiled_Trees::
+quickscorer_masks(const float * features, uint64_t * masks) const
+{
+    std::fill(masks, masks + qs_leaf_offsets.size(), ~0ULL);
+
+    for (const QS_Feature & entry: qs_features) {
+        float val = features[entry.feature];
+        if (std::isnan(val)) {
+            for (uint32_t i = entry.missing_begin;  i < entry.missing_end;
+                 ++i)
+                masks[qs_missing[i].tree] &= qs_missing[i].mask;
+        }
+        else {
+            // Sorted by threshold, so the tests that fail come first
+            for (uint32_t i = entry.less_begin;
+                 i < entry.less_end && qs_less[i].split_val <= val;  ++i)
+                masks[qs_less[i].tree] &= qs_less[i].mask;
+        }
+    }
+}
+
+template<typename Add>
+void
+Compiled_Trees::
+predict_row(const float * features, const Add & add) const
+{
+    ExcAssert(finished);
+
+    for (int32_t root: node_roots)
+        add(walk(root, features));
+
+    size_t num_qs = qs_leaf_offsets.size();
+    if (num_qs == 0)
+        return;
+
+    uint64_t local[1024];
+    std::unique_ptr<uint64_t[]> allocated;
+    uint64_t * masks = local;
+    if (num_qs > 1024) {
+        allocated.reset(new uint64_t[num_qs]);
+        masks = allocated.get();
+    }
+
+    quickscorer_masks(features, masks);
+
+    for (size_t i = 0;  i < num_qs;  ++i)
+        add(qs_leaves[qs_leaf_offsets[i] + __builtin_ctzll(masks[i])]);
+}
+
+void
+Compiled_Trees::
+predict(const float * features, double * accum, double weight) const
+{
+    double result[nl];
+    std::copy(bias.begin(), bias.end(), result);
+
+    predict_row(features, [&] (int32_t index)
+                {
+                    const double * values = leaf(index);
+                    for (unsigned i = 0;  i < nl;  ++i)
+                        result[i] += values[i];
+                });
+
+    for (unsigned i = 0;  i < nl;  ++i)
+        accum[i] += weight * result[i];
+}
+
+double
+Compiled_Trees::
+predict(int label, const float * features) const
+{
+    if (label < 0 || label >= nl)
+        throw Exception("Compiled_Trees::predict(): invalid label");
+
+    double result = bias[label];
+    predict_row(features, [&] (int32_t index)
+                {
+                    result += leaf(index)[label];
+                });
+    return result;
+}
+
+void
+Compiled_Trees::
+predict_batch(const float * features, size_t num_rows, size_t row_stride,
+              double * output) const
+{
+    ExcAssert(finished);
+
+    for (size_t r = 0;  r < num_rows;  ++r)
+        std::copy(bias.begin(), bias.end(), output + r * nl);
+
+    for (int32_t root: node_roots) {
+        for (size_t r = 0;  r < num_rows;  ++r) {
+            const double * values = leaf(walk(root, features + r * row_stride));
+            double * out = output + r * nl;
+            for (unsigned i = 0;  i < nl;  ++i)
+                out[i] += values[i];
+        }
+    }
+
+    size_t num_qs = qs_leaf_offsets.size();
+    if (num_qs == 0)
+        return;
+
+    std::vector<uint64_t> masks(num_qs);
+    for (size_t r = 0;  r < num_rows;  ++r) {
+        quickscorer_masks(features + r * row_stride, masks.data());
+        double * out = output + r * nl;
+        for (size_t t = 0;  t < num_qs;  ++t) {
+            const double * values
+                = leaf(qs_leaves[qs_leaf_offsets[t]
+                                 + __builtin_ctzll(masks[t])]);
+            for (unsigned i = 0;  i < nl;  ++i)
+                out[i] += values[i];
+        }
+    }
+}
+
+bool
+Compiled_Trees::
+operator == (const Compiled_Trees & other) const
+{
+    return nl == other.nl
+        && bias == other.bias
+        && nodes == other.nodes
+        && leaves == other.leaves
+        && roots == other.roots
+        && finished == other.finished;
+}
+
+void
+Compiled_Trees::
+publish(std::shared_ptr<const Compiled_Trees> & current,
+        std::shared_ptr<const Compiled_Trees> candidate)
+{
+    std::unique_lock<std::mutex> guard(publish_lock);
+    if (current == candidate
+        || (current && candidate && *current == *candidate))
+        return;
+    current = std::move(candidate);
+}
+
+} // namespace ML
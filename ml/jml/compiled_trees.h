@@ -0,0 +1,188 @@
+/** compiled_trees.h                                               -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Flattened form of a weighted sum of decision trees, used for the
+    optimized predict of decision trees, committees and boosted stumps.
+*/
+
+#pragma once
+
+#include "mldb/ml/jml/tree.h"
+#include "mldb/ml/jml/split.h"
+#include "mldb/jml/stats/distribution.h"
+#include <memory>
+#include <vector>
+#include <stdint.h>
+
+
+namespace ML {
+
+
+/*****************************************************************************/
+/* COMPILED_TREES                                                            */
+/*****************************************************************************/
+
+/** A weighted sum of decision trees (and a bias), compiled into a form
+    that is quick to evaluate over the dense feature vector of an optimized
+    predict.
+
+    The nodes of each tree are stored contiguously in breadth first order,
+    each one holding its feature index, operation, threshold and the
+    references of its three children, so that walking a tree touches a
+    few neighbouring cache lines instead of following pointers to separate
+    heap allocations.  Leaf predictions are pre-multiplied by the weight of
+    their tree.
+
+    Trees with at most MAX_QUICKSCORER_NODES nodes and no equality tests
+    are instead evaluated with the QuickScorer algorithm: each tree has a
+    bitmask of its leaves, the thresholds of all of the trees are sorted by
+    feature, and for each feature only the tests that fail are visited,
+    each one clearing the leaves that its failure makes unreachable.  The
+    leaf reached is then the lowest bit that is still set.  This makes
+    the cost depend on the number of failed tests rather than on branch
+    mispredictions while walking each tree.
+
+    The splits must have been optimized (Split::optimize()) before the
+    trees are added, as their optimized index is the feature index.
+*/
+
+struct Compiled_Trees {
+    /** Trees with at most this number of nodes use QuickScorer.  A tree
+        with n nodes has 2n + 1 leaves (counting empty children), which
+        must fit in the 64 bits of a leaf mask. */
+    enum { MAX_QUICKSCORER_NODES = 31 };
+
+    explicit Compiled_Trees(int label_count);
+
+    /** Add the given tree, with its predictions multiplied by weight. */
+    void add_tree(const Tree & tree, double weight = 1.0);
+
+    /** Add a single split with the given predictions for its outcomes. */
+    void add_stump(const Split & split,
+                   const distribution<float> & pred_true,
+                   const distribution<float> & pred_false,
+                   const distribution<float> & pred_missing,
+                   double weight = 1.0);
+
+    /** Add a constant to the predictions. */
+    void add_bias(const distribution<float> & bias, double weight = 1.0);
+
+    /** Add all of the trees in other, with their predictions multiplied by
+        weight. */
+    void add(const Compiled_Trees & other, double weight = 1.0);
+
+    /** Build the structures used for prediction.  Must be called after the
+        last tree has been added and before predicting. */
+    void finish();
+
+    /** Add weight times the prediction for the given dense feature vector
+        to accum, which has label_count() entries. */
+    void predict(const float * features, double * accum,
+                 double weight = 1.0) const;
+
+    /** Return the prediction for a single label. */
+    double predict(int label, const float * features) const;
+
+    /** Predict num_rows rows, the first of which is at features and each of
+        which starts row_stride floats after the previous one, writing
+        label_count() values per row into output.  Each tree is applied to
+        all of the rows before moving onto the next, which keeps it in the
+        cache.  The results are the same as predict().
+    */
+    void predict_batch(const float * features, size_t num_rows,
+                       size_t row_stride, double * output) const;
+
+    int label_count() const { return nl; }
+
+    /** Number of trees; trees that are a single leaf are folded into the
+        bias and not counted. */
+    size_t tree_count() const { return roots.size(); }
+
+    size_t node_count() const { return nodes.size(); }
+
+    /** Number of trees evaluated with QuickScorer. */
+    size_t quickscorer_tree_count() const { return qs_leaf_offsets.size(); }
+
+    /** Do they hold exactly the same model? */
+    bool operator == (const Compiled_Trees & other) const;
+
+    /** Replace current by candidate, unless they hold the same model.
+        Optimizing an unchanged classifier again (as each bind of a
+        function does) then leaves the structure that other threads are
+        predicting with alone.
+    */
+    static void publish(std::shared_ptr<const Compiled_Trees> & current,
+                        std::shared_ptr<const Compiled_Trees> candidate);
+
+private:
+    /** A node of a tree.  Children are indexed by the result of
+        Split::apply(), and are either the index of a node (>= 0) or the
+        complement of the index of a leaf (< 0). */
+    struct Node {
+        float split_val;
+        uint32_t feature:30;
+        uint32_t op:2;
+        int32_t child[3];
+
+        bool operator == (const Node & other) const;
+    };
+
+    /** A QuickScorer test that fails for x >= split_val (or for a missing
+        value), clearing the leaves of the tree that aren't in mask. */
+    struct QS_Test {
+        float split_val;
+        uint32_t tree;
+        uint64_t mask;
+    };
+
+    /** The QuickScorer tests on a single feature. */
+    struct QS_Feature {
+        uint32_t feature;
+        uint32_t less_begin, less_end;        ///< Range in qs_less
+        uint32_t missing_begin, missing_end;  ///< Range in qs_missing
+    };
+
+    int nl;                          ///< Number of labels
+    std::vector<double> bias;        ///< Constant added to the predictions
+    std::vector<Node> nodes;         ///< Nodes of all trees
+    std::vector<double> leaves;      ///< nl values per leaf; leaf 0 is zero
+    std::vector<int32_t> roots;      ///< Root node of each tree
+
+    // Built by finish()
+    bool finished;
+    std::vector<int32_t> node_roots; ///< Roots of trees that are walked
+    std::vector<QS_Feature> qs_features;
+    std::vector<QS_Test> qs_less;    ///< Sorted by split_val per feature
+    std::vector<QS_Test> qs_missing;
+    std::vector<uint32_t> qs_leaf_offsets;  ///< Per tree, into qs_leaves
+    std::vector<int32_t> qs_leaves;  ///< Leaf index for each bit of a mask
+
+    int32_t add_leaf(const distribution<float> & pred, double weight);
+
+    /** Number the leaves of the tree with nodes from root to end for
+        QuickScorer, and add its tests on each feature to less and
+        missing.  Returns false if the tree isn't suitable. */
+    bool add_quickscorer_tree(int32_t root, int32_t end,
+                              std::vector<std::pair<uint32_t, QS_Test> > & less,
+                              std::vector<std::pair<uint32_t, QS_Test> > & missing);
+
+    /** Return the leaf reached by walking down from the given node. */
+    int32_t walk(int32_t ref, const float * features) const;
+
+    /** Set masks[i] to the mask of the remaining leaves of QuickScorer tree
+        i for the given row. */
+    void quickscorer_masks(const float * features, uint64_t * masks) const;
+
+    const double * leaf(int32_t index) const
+    {
+        return &leaves[(size_t)index * nl];
+    }
+
+    /** Call add(leaf) for each leaf reached by the given row. */
+    template<typename Add>
+    void predict_row(const float * features, const Add & add) const;
+};
+
+} // namespace ML
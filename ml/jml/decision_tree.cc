@@ -66,6 +66,7 @@ swap(Decision_Tree & other)
     std::swap(tree, other.tree);
     std::swap(encoding, other.encoding);
     std::swap(optimized_, other.optimized_);
+    std::swap(compiled, other.compiled);
 }
 
 namespace {
@@ -84,46 +85,6 @@ struct StandardGetFeatures {
     }
 };
 
-struct OptimizedGetFeatures {
-    OptimizedGetFeatures(const float * features)
-        : features(features)
-    {
-    }
-
-    const float * features;
-
-    MLDB_ALWAYS_INLINE Split::Weights operator () (const Split & split) const
-    {
-        return split.apply(features);
-    }
-                      
-};
-
-struct AccumResults {
-    explicit AccumResults(double * accum, int nl, double weight)
-        : accum(accum), nl(nl), weight(weight)
-    {
-    }
-
-    double * accum;
-    int nl;
-    double weight;
-
-    MLDB_ALWAYS_INLINE
-    void operator () (const Label_Dist & dist, float weight1)
-    {
-        if (MLDB_LIKELY(nl == 2)) {
-            double factor = weight1 * weight;
-            accum[0] += dist[0] * factor;
-            accum[1] += dist[1] * factor;
-            return;
-        }
-
-        for (unsigned i = 0;  i < nl;  ++i)
-            accum[i] += dist[i] * weight1 * weight;
-    }
-};
-
 struct DistResults {
     explicit DistResults(double * accum, int nl)
         : accum(accum), nl(nl)
@@ -209,6 +170,13 @@ Decision_Tree::
 optimize_impl(Optimization_Info & info)
 {
     optimize_recursive(info, tree.root);
+
+    std::shared_ptr<Compiled_Trees> result
+        (new Compiled_Trees(label_count()));
+    result->add_tree(tree);
+    result->finish();
+    Compiled_Trees::publish(compiled, std::move(result));
+
     optimized_ = true;
     return true;
 }
@@ -235,14 +203,11 @@ optimized_predict_impl(const float * features,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-
     int nl = label_count();
     double accum[nl];
-    DistResults results(accum, nl);
-
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    std::fill(accum, accum + nl, 0.0);
+    compiled->predict(features, accum);
+    return Label_Dist(accum, accum + nl);
 }
 
 void
@@ -253,10 +218,7 @@ optimized_predict_impl(const float * features,
                        double weight,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    AccumResults results(accum, label_count(), weight);
-
-    predict_recursive_impl(get_features, results, tree.root);
+    compiled->predict(features, accum, weight);
 }
 
 float
@@ -266,11 +228,7 @@ optimized_predict_impl(int label,
                        const Optimization_Info & info,
                        PredictionContext * context) const
 {
-    OptimizedGetFeatures get_features(features);
-    LabelResults results(label);
-
-    predict_recursive_impl(get_features, results, tree.root);
-    return results;
+    return compiled->predict(label, features);
 }
 
 template<class GetFeatures, class Results>
@@ -649,6 +607,7 @@ reconstitute(DB::Store_Reader & store,
         throw Exception("Decision_Tree::reconstitute: read bad marker at end");
 
     optimized_ = false;
+    compiled.reset();
 }
     
 std::string
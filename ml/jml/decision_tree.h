@@ -12,6 +12,7 @@
 #include "feature_set.h"
 #include <boost/pool/object_pool.hpp>
 #include "tree.h"
+#include "compiled_trees.h"
 #include "boolean_expression.h"
 
 
@@ -55,6 +56,10 @@ public:
     Output_Encoding encoding;  ///< How the outputs are represented
     bool optimized_;           ///< Is predict() optimized?
 
+    /** The tree in the form used by the optimized predict.  Built by
+        optimize(). */
+    std::shared_ptr<const Compiled_Trees> compiled;
+
     using Classifier_Impl::predict;
 
     virtual float predict(int label, const Feature_Set & features,
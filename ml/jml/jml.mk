@@ -47,6 +47,7 @@ LIBBOOSTING_SOURCES := \
         feature_transform.cc \
         transform_list.cc \
         committee.cc \
+        compiled_trees.cc \
         boosting_training.cc \
         null_classifier_generator.cc \
         fasttext_classifier.cc \
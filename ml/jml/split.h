@@ -190,6 +190,11 @@ public:
     float split_val() const { return split_val_; }
     Op op() const { return (Op)op_; }
 
+    /** Has optimize() been called?  If so, optimized_index() is the index
+        of the feature in the dense vector passed to an optimized predict. */
+    bool is_optimized() const { return opt_; }
+    int optimized_index() const { return idx_; }
+
     std::string print(const Feature_Space & fs, int branch = true) const;
 
     void serialize(DB::Store_Writer & store,
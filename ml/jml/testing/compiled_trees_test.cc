@@ -0,0 +1,333 @@
+/** compiled_trees_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that the compiled form of decision trees, committees and boosted
+    stumps predicts the same as the trees themselves, and benchmark it.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <iostream>
+#include <random>
+#include <cmath>
+
+#include "mldb/ml/jml/decision_tree.h"
+#include "mldb/ml/jml/committee.h"
+#include "mldb/ml/jml/boosted_stumps.h"
+#include "mldb/ml/jml/dense_features.h"
+#include "mldb/ml/jml/feature_info.h"
+#include "mldb/ml/jml/compiled_trees.h"
+#include "mldb/jml/utils/smart_ptr_utils.h"
+#include "mldb/arch/timers.h"
+
+using namespace ML;
+using namespace std;
+
+
+static const int NUM_FEATURES = 8;
+
+struct Fixture {
+    Fixture()
+        : rng(42)
+    {
+        fs.add_feature("LABEL", Feature_Info(BOOLEAN, false, true));
+        for (unsigned i = 0;  i < NUM_FEATURES;  ++i)
+            fs.add_feature("feature" + std::to_string(i), REAL);
+        fsp = make_unowned_sp(fs);
+        predicted = fs.features()[0];
+    }
+
+    Dense_Feature_Space fs;
+    std::shared_ptr<Dense_Feature_Space> fsp;
+    Feature predicted;
+    std::mt19937 rng;
+
+    float random_value()
+    {
+        // Small integers, so that the equality tests are sometimes true
+        return std::uniform_int_distribution<int>(0, 9)(rng) * 0.5f;
+    }
+
+    distribution<float> random_pred()
+    {
+        std::normal_distribution<float> dist;
+        distribution<float> result(2);
+        result[0] = dist(rng);
+        result[1] = dist(rng);
+        return result;
+    }
+
+    Split random_split(bool allow_equal)
+    {
+        Feature feature = fs.features()[1 + rng() % NUM_FEATURES];
+        int op = rng() % (allow_equal ? 6 : 5);
+        if (op == 4)
+            return Split(feature, 0.0, Split::NOT_MISSING);
+        if (op == 5)
+            return Split(feature, random_value(), Split::EQUAL);
+        return Split(feature, random_value(), Split::LESS);
+    }
+
+    Tree::Ptr random_subtree(Tree & tree, int depth, bool allow_equal)
+    {
+        int kind = rng() % 8;
+        if (depth == 0 || kind == 0)
+            return tree.new_leaf(random_pred(), 1.0);
+        if (kind == 1)
+            return Tree::Ptr();
+
+        Tree::Node * node = tree.new_node();
+        node->split = random_split(allow_equal);
+        node->pred = random_pred();
+        node->examples = 1.0;
+        node->z = 0.0;
+        node->child_true = random_subtree(tree, depth - 1, allow_equal);
+        node->child_false = random_subtree(tree, depth - 1, allow_equal);
+        node->child_missing = random_subtree(tree, depth - 1, allow_equal);
+        return node;
+    }
+
+    std::shared_ptr<Decision_Tree>
+    random_tree(int depth, bool allow_equal = true)
+    {
+        auto result = std::make_shared<Decision_Tree>(fsp, predicted);
+        result->tree.root = random_subtree(result->tree, depth, allow_equal);
+        return result;
+    }
+
+    std::shared_ptr<Committee>
+    random_committee(int num_trees, int depth)
+    {
+        auto result = std::make_shared<Committee>(fsp, predicted);
+        for (unsigned i = 0;  i < num_trees;  ++i)
+            result->add(random_tree(depth), 0.1 + (rng() % 10) * 0.1);
+        result->bias = random_pred();
+        return result;
+    }
+
+    std::shared_ptr<Boosted_Stumps>
+    random_stumps(int num_stumps, Boosted_Stumps::Output output)
+    {
+        auto result = std::make_shared<Boosted_Stumps>(fsp, predicted);
+        result->output = output;
+        result->bias = random_pred();
+        for (unsigned i = 0;  i < num_stumps;  ++i) {
+            Stump stump(fsp, predicted);
+            stump.split = random_split(true);
+            stump.action = Action(random_pred(), random_pred(),
+                                  random_pred());
+            result->insert(stump);
+        }
+        return result;
+    }
+
+    /// Rows of the full feature space, including the label
+    std::vector<std::vector<float> > random_rows(int num_rows)
+    {
+        std::vector<std::vector<float> > result;
+        for (unsigned i = 0;  i < num_rows;  ++i) {
+            std::vector<float> row(NUM_FEATURES + 1, 0.0);
+            for (unsigned j = 1;  j <= NUM_FEATURES;  ++j) {
+                if (rng() % 5 == 0)
+                    row[j] = NAN;
+                else row[j] = random_value();
+            }
+            result.push_back(row);
+        }
+        return result;
+    }
+
+    /** Check that the optimized predictions of the classifier are the same
+        as the unoptimized ones. */
+    void check_same(Classifier_Impl & classifier, int num_rows = 1000)
+    {
+        Optimization_Info info = classifier.optimize(fs.features());
+        BOOST_REQUIRE(classifier.predict_is_optimized());
+
+        for (auto & row: random_rows(num_rows)) {
+            auto fset = fs.encode(row);
+            Label_Dist expected = classifier.predict(*fset);
+            Label_Dist optimized = classifier.predict(row, info);
+            BOOST_REQUIRE_EQUAL(expected.size(), optimized.size());
+            for (unsigned i = 0;  i < expected.size();  ++i) {
+                BOOST_CHECK_CLOSE(expected[i] + 10.0, optimized[i] + 10.0,
+                                  0.001);
+                BOOST_CHECK_CLOSE(classifier.predict(i, *fset) + 10.0,
+                                  classifier.predict(i, row, info) + 10.0,
+                                  0.001);
+            }
+
+            // The accumulating form adds weight times the prediction
+            float fv[info.features_out()];
+            info.apply(row, fv);
+            std::vector<double> accum(expected.size(), 1.0);
+            classifier.optimized_predict_impl(fv, info, accum.data(), 0.5);
+            for (unsigned i = 0;  i < expected.size();  ++i) {
+                BOOST_CHECK_CLOSE(1.0 + 0.5 * expected[i] + 10.0,
+                                  accum[i] + 10.0, 0.001);
+            }
+        }
+    }
+};
+
+BOOST_FIXTURE_TEST_CASE( test_decision_trees, Fixture )
+{
+    for (unsigned i = 0;  i < 20;  ++i) {
+        // Both shallow trees, which use QuickScorer, and deep ones
+        auto tree = random_tree(i % 2 ? 2 : 6);
+        check_same(*tree, 200);
+    }
+}
+
+BOOST_FIXTURE_TEST_CASE( test_quickscorer_trees, Fixture )
+{
+    // Without equality tests, the shallow trees all use QuickScorer
+    auto committee = std::make_shared<Committee>(fsp, predicted);
+    for (unsigned i = 0;  i < 50;  ++i)
+        committee->add(random_tree(3, false /* allow_equal */), 0.5);
+    check_same(*committee);
+
+    BOOST_REQUIRE(committee->compiled);
+    BOOST_CHECK_EQUAL(committee->compiled->quickscorer_tree_count(),
+                      committee->compiled->tree_count());
+}
+
+BOOST_FIXTURE_TEST_CASE( test_committees, Fixture )
+{
+    auto committee = random_committee(50, 4);
+    check_same(*committee);
+    BOOST_CHECK(committee->compiled);
+
+    // Bagged boosted trees: a committee of committees is flattened too
+    auto bagged = std::make_shared<Committee>(fsp, predicted);
+    for (unsigned i = 0;  i < 5;  ++i)
+        bagged->add(random_committee(10, 3), 0.2);
+    check_same(*bagged);
+    BOOST_REQUIRE(bagged->compiled);
+    BOOST_CHECK_GT(bagged->compiled->tree_count(), 0);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_boosted_stumps, Fixture )
+{
+    check_same(*random_stumps(200, Boosted_Stumps::RAW));
+    check_same(*random_stumps(200, Boosted_Stumps::LOGIT));
+    check_same(*random_stumps(200, Boosted_Stumps::LOGIT_NORM));
+
+    // A committee with logit outputs isn't a sum of trees, so it keeps
+    // predicting member by member
+    auto committee = std::make_shared<Committee>(fsp, predicted);
+    committee->add(random_stumps(20, Boosted_Stumps::LOGIT), 0.5);
+    committee->add(random_tree(3), 0.5);
+    check_same(*committee);
+    BOOST_CHECK(!committee->compiled);
+}
+
+BOOST_FIXTURE_TEST_CASE( test_predict_batch, Fixture )
+{
+    auto committee = random_committee(100, 5);
+    Optimization_Info info = committee->optimize(fs.features());
+    const Compiled_Trees & compiled = *committee->compiled;
+
+    auto rows = random_rows(500);
+    size_t stride = info.features_out();
+    std::vector<float> dense(rows.size() * stride);
+    for (unsigned i = 0;  i < rows.size();  ++i)
+        info.apply(rows[i], &dense[i * stride]);
+
+    std::vector<double> output(rows.size() * 2);
+    compiled.predict_batch(dense.data(), rows.size(), stride, output.data());
+
+    for (unsigned i = 0;  i < rows.size();  ++i) {
+        double accum[2] = { 0.0, 0.0 };
+        compiled.predict(&dense[i * stride], accum);
+        BOOST_CHECK_EQUAL(accum[0], output[i * 2]);
+        BOOST_CHECK_EQUAL(accum[1], output[i * 2 + 1]);
+    }
+}
+
+/** Throughput of scoring with the trees, with the compiled form and with
+    the compiled form in batches. */
+BOOST_FIXTURE_TEST_CASE( benchmark_scoring, Fixture )
+{
+    auto run = [&] (const std::string & name, Committee & committee)
+        {
+            Optimization_Info info = committee.optimize(fs.features());
+            auto rows = random_rows(20000);
+
+            size_t stride = info.features_out();
+            std::vector<float> dense(rows.size() * stride);
+            for (unsigned i = 0;  i < rows.size();  ++i)
+                info.apply(rows[i], &dense[i * stride]);
+
+            double total = 0.0;
+
+            // Reference: walk the trees, as the optimized predict used to
+            Timer timer;
+            for (unsigned i = 0;  i < rows.size();  ++i) {
+                double accum[2] = { committee.bias[0], committee.bias[1] };
+                for (unsigned j = 0;  j < committee.classifiers.size();  ++j) {
+                    auto & tree = static_cast<Decision_Tree &>
+                        (*committee.classifiers[j]);
+                    Tree::Ptr ptr = tree.tree.root;
+                    while (ptr && ptr.node()) {
+                        const Split & split = ptr.node()->split;
+                        int branch = split.apply
+                            (dense[i * stride + split.optimized_index()]);
+                        if (branch == MISSING)
+                            ptr = ptr.node()->child_missing;
+                        else if (branch)
+                            ptr = ptr.node()->child_true;
+                        else ptr = ptr.node()->child_false;
+                    }
+                    if (ptr) {
+                        accum[0] += committee.weights[j] * ptr.pred()[0];
+                        accum[1] += committee.weights[j] * ptr.pred()[1];
+                    }
+                }
+                total += accum[1];
+            }
+            double tree_time = timer.elapsed_wall();
+
+            timer.restart();
+            for (unsigned i = 0;  i < rows.size();  ++i)
+                total += committee.optimized_predict_impl
+                    (1, &dense[i * stride], info);
+            double compiled_time = timer.elapsed_wall();
+
+            std::vector<double> output(rows.size() * 2);
+            timer.restart();
+            for (size_t i = 0;  i < rows.size();  i += 256) {
+                size_t n = std::min<size_t>(256, rows.size() - i);
+                committee.compiled->predict_batch(&dense[i * stride], n,
+                                                  stride, &output[i * 2]);
+            }
+            double batch_time = timer.elapsed_wall();
+            total += output[1];
+
+            cerr << name << ": " << committee.compiled->tree_count()
+                 << " trees, " << committee.compiled->node_count()
+                 << " nodes, " << committee.compiled->quickscorer_tree_count()
+                 << " with QuickScorer" << endl;
+            cerr << "  trees:    " << rows.size() / tree_time
+                 << " rows/second" << endl;
+            cerr << "  compiled: " << rows.size() / compiled_time
+                 << " rows/second" << endl;
+            cerr << "  batch:    " << rows.size() / batch_time
+                 << " rows/second" << endl;
+            BOOST_CHECK(std::isfinite(total));
+        };
+
+    auto shallow = std::make_shared<Committee>(fsp, predicted);
+    for (unsigned i = 0;  i < 500;  ++i)
+        shallow->add(random_tree(3, false /* allow_equal */), 0.01);
+    run("shallow trees", *shallow);
+
+    auto deep = std::make_shared<Committee>(fsp, predicted);
+    for (unsigned i = 0;  i < 100;  ++i)
+        deep->add(random_tree(8), 0.01);
+    run("deep trees", *deep);
+}
@@ -19,7 +19,8 @@ LIBML_SOURCES := \
 	value_descriptions.cc \
 	confidence_intervals.cc \
 	svd_utils.cc \
-    randomforest.cc
+    randomforest.cc \
+	hnsw_index.cc
 
 
 LIBML_LINK := boosting neural boost_filesystem jsoncpp types value_description algebra fasttext
@@ -4,7 +4,8 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Optimized random forest algorithm for dense data and binary classification
+    Optimized random forest algorithm for dense data, for binary or
+    multiclass classification and regression.
 
 */
 
@@ -26,13 +27,20 @@ namespace MLDB {
 /** Holds the set of data for a partition of a decision tree. */
 struct PartitionData {
 
+    typedef ML::FixedPointAccum64 Accum;
+
     PartitionData()
-        : fs(nullptr)
+        : fs(nullptr), numLabels(2), labelOffset(0), labelScale(1)
     {
     }
 
-    PartitionData(std::shared_ptr<const DatasetFeatureSpace> fs)
-        : fs(fs), features(fs->columnInfo.size())
+    /** Create an empty partition.  numLabels is the number of classes to
+        predict, or zero for regression.
+    */
+    PartitionData(std::shared_ptr<const DatasetFeatureSpace> fs,
+                  int numLabels = 2)
+        : fs(fs), features(fs->columnInfo.size()),
+          numLabels(numLabels), labelOffset(0), labelScale(1)
     {
         for (auto & c: fs->columnInfo) {
             Feature & f = features.at(c.second.index);
@@ -54,6 +62,9 @@ struct PartitionData {
         PartitionData data;
         data.features = this->features;
         data.fs = this->fs;
+        data.numLabels = this->numLabels;
+        data.labelOffset = this->labelOffset;
+        data.labelScale = this->labelScale;
         data.reserve(numNonZero);
 
         std::vector<WritableBucketList>
@@ -155,7 +166,7 @@ struct PartitionData {
 
     /// Entry for an individual row
     struct Row {
-        bool label;                 ///< Label associated with
+        float label;                ///< Class number, or value for regression
         float weight;               ///< Weight of the example 
         int exampleNum;             ///< index into feature array
     };
@@ -180,6 +191,15 @@ struct PartitionData {
     // All features that are active
     std::vector<Feature> features;
 
+    /// Number of classes, or zero for regression
+    int numLabels;
+
+    /// For regression, the labels of the rows are stored as
+    /// (label - labelOffset) / labelScale, which must be within [-0.5, 0.5]
+    /// so that their statistics fit in fixed point accumulators.
+    float labelOffset;
+    float labelScale;
+
     /** Reserve enough space for the given number of rows. */
     void reserve(size_t n)
     {
@@ -192,60 +212,253 @@ struct PartitionData {
         rows.push_back(row);
     }
 
-    void addRow(bool label, float weight, int exampleNum)
+    void addRow(float label, float weight, int exampleNum)
     {
         rows.emplace_back(Row{label, weight, exampleNum});
     }
 
-    //This structure hold the weights (false and true) for any particular split
-    template<typename Float>
-    struct WT {
-        WT()
-            : v { 0, 0 }
+    /** The row weights are scaled by this much before being accumulated,
+        so that the total weight of a bag (which is one) fits in a fixed
+        point accumulator.  It doesn't change which split is the best.
+    */
+    static constexpr double WEIGHT_SCALE = 0.5;
+
+    static Accum toAccum(double value)
+    {
+        Accum result;
+        result.hl = value * 9223372036854775808.0;
+        return result;
+    }
+
+    static double toDouble(const Accum & value)
+    {
+        return value.hl * (1.0 / 9223372036854775808.0);
+    }
+
+    /// Number of statistics accumulated per bucket
+    int numStats() const
+    {
+        return numLabels == 0 ? 3 : numLabels;
+    }
+
+    /** Add a row to the statistics of a bucket.  For classification,
+        there is the weight of each class.  For regression, there is the
+        weight, the weighted sum of the labels and the weighted sum of
+        their squares.
+    */
+    void accumulate(Accum * stats, const Row & row) const
+    {
+        double weight = WEIGHT_SCALE * row.weight;
+        if (numLabels == 0) {
+            stats[0] += toAccum(weight);
+            stats[1] += toAccum(weight * row.label);
+            stats[2] += toAccum(weight * row.label * row.label);
+        }
+        else stats[(int)row.label] += toAccum(weight);
+    }
+
+    /** Label statistics for a set of rows (see accumulate()).  As they are
+        in fixed point, removing a subset of the rows from the statistics
+        gives exactly the statistics of the rest.
+    */
+    struct W {
+        W()
         {
         }
 
-        Float v[2];
+        explicit W(int numStats)
+            : v(numStats)
+        {
+        }
 
-        Float & operator [] (bool i)
+        std::vector<Accum> v;
+
+        Accum & operator [] (int i)
         {
             return v[i];
         }
 
-        const Float & operator [] (bool i) const
+        const Accum & operator [] (int i) const
         {
             return v[i];
         }
 
-        bool empty() const { return total() == 0; }
+        bool empty() const
+        {
+            for (auto & x: v)
+                if (x.hl != 0)
+                    return false;
+            return true;
+        }
 
-        Float total() const { return v[0] + v[1]; }
+        void add(const Accum * stats)
+        {
+            for (size_t i = 0;  i < v.size();  ++i)
+                v[i] += stats[i];
+        }
 
-        WT & operator += (const WT & other)
+        void subtract(const Accum * stats)
         {
-            v[0] += other.v[0];
-            v[1] += other.v[1];
+            for (size_t i = 0;  i < v.size();  ++i)
+                v[i] -= stats[i];
+        }
+
+        W & operator += (const W & other)
+        {
+            if (v.empty())
+                v.resize(other.v.size());
+            add(other.v.data());
             return *this;
         }
 
-        WT operator + (const WT & other) const
+        W operator + (const W & other) const
         {
-            WT result = *this;
+            W result = *this;
             result += other;
             return result;
         }
 
-        WT & operator -= (const WT & other)
+        W & operator -= (const W & other)
         {
-            v[0] -= other.v[0];
-            v[1] -= other.v[1];
+            if (v.empty())
+                v.resize(other.v.size());
+            subtract(other.v.data());
             return *this;
         }
+    };
+
+    /** Statistics of the labels for each bucket of each feature, which is
+        all that is needed to score every possible split.
+    */
+    struct Histograms {
+        /// For each active feature, numBuckets * numStats() accumulators
+        std::vector<std::vector<Accum> > w;
+
+        /// Statistics over all rows
+        W wAll;
+
+        bool empty() const
+        {
+            return w.empty();
+        }
 
-        typedef Float FloatType;
+        size_t memusage() const
+        {
+            size_t result = wAll.v.size() * sizeof(Accum);
+            for (auto & f: w)
+                result += f.size() * sizeof(Accum);
+            return result;
+        }
+
+        /** Remove the statistics of a subset of our rows.  Features which
+            aren't in the subset are no longer active, and are dropped.
+        */
+        Histograms & operator -= (const Histograms & other)
+        {
+            ExcAssertEqual(w.size(), other.w.size());
+            for (size_t i = 0;  i < w.size();  ++i) {
+                if (other.w[i].empty()) {
+                    w[i].clear();
+                    w[i].shrink_to_fit();
+                    continue;
+                }
+                ExcAssertEqual(w[i].size(), other.w[i].size());
+                for (size_t j = 0;  j < w[i].size();  ++j)
+                    w[i][j] -= other.w[i][j];
+            }
+            wAll -= other.wAll;
+            return *this;
+        }
     };
 
-    typedef WT<ML::FixedPointAccum64> W;
+    /** Above this size, the histograms of a partition aren't kept to
+        derive those of its children, as there can be one waiting per
+        level of each tree being trained.
+    */
+    static constexpr size_t MAX_SUBTRACTION_HISTOGRAM_BYTES = 16 * 1024 * 1024;
+
+    /// Build the histograms of all active features from the rows
+    Histograms buildHistograms() const
+    {
+        int nf = features.size();
+        int ns = numStats();
+
+        Histograms result;
+        result.w.resize(nf);
+        result.wAll = W(ns);
+
+        auto doFeature = [&] (int i)
+            {
+                if (i == nf) {
+                    for (auto & r: rows)
+                        accumulate(result.wAll.v.data(), r);
+                    return;
+                }
+
+                if (!features[i].active)
+                    return;
+
+                const BucketList & buckets = features[i].buckets;
+                std::vector<Accum> & w = result.w[i];
+                w.resize((size_t)buckets.numBuckets * ns);
+
+                for (auto & r: rows) {
+                    uint32_t bucket = buckets[r.exampleNum];
+                    accumulate(&w[(size_t)bucket * ns], r);
+                }
+            };
+
+        parallelMap(0, nf + 1, doFeature);
+
+        return result;
+    }
+
+    static bool bucketEmpty(const Accum * stats, int numStats)
+    {
+        for (int i = 0;  i < numStats;  ++i)
+            if (stats[i].hl != 0)
+                return false;
+        return true;
+    }
+
+    /** Impurity of a set of rows; the best split is the one with the
+        lowest total impurity over both sides.  It is the Z score for
+        binary classification, the Gini impurity for more classes, and
+        the sum of squared errors for regression (all weighted).
+    */
+    double impurity(const W & w) const
+    {
+        if (numLabels == 0) {
+            double total = toDouble(w[0]);
+            if (total <= 0)
+                return 0.0;
+            double sum = toDouble(w[1]);
+            return std::max(0.0, toDouble(w[2]) - sum * sum / total);
+        }
+        else if (numLabels == 2) {
+            return 2.0 * sqrt(toDouble(w[0]) * toDouble(w[1]));
+        }
+
+        double total = 0.0, sumSquares = 0.0;
+        for (int i = 0;  i < numLabels;  ++i) {
+            double x = toDouble(w[i]);
+            total += x;
+            sumSquares += x * x;
+        }
+        return total <= 0 ? 0.0 : total - sumSquares / total;
+    }
+
+    /// Is there nothing left to learn from the rows with these statistics?
+    bool isPure(const W & w) const
+    {
+        if (numLabels == 0)
+            return impurity(w) <= 1e-12 * toDouble(w[0]);
+
+        int numNonZero = 0;
+        for (int i = 0;  i < numLabels;  ++i)
+            numNonZero += w[i].hl != 0;
+        return numNonZero <= 1;
+    }
 
     /** Split the partition here. */
     std::pair<PartitionData, PartitionData>
@@ -357,11 +570,12 @@ struct PartitionData {
         return { std::move(left), std::move(right) };
     }
 
-    /** Test all features for a split.  Returns the feature number,
-        the bucket number and the goodness of the split.
+    /** Test all features for a split, from the histograms of the
+        partition.  Features which have all their rows in a single bucket
+        are made inactive.
 
         Outputs
-        - Z score of split
+        - Score of split (lower is better)
         - Feature number
         - Split point
         - W for the left side of the split
@@ -369,83 +583,18 @@ struct PartitionData {
         - W total (in case no split is found)
     */
     std::tuple<double, int, int, W, W, W>
-    testAll(int depth)
+    testAll(int depth, const Histograms & histograms)
     {
         bool debug = false;
 
         int nf = features.size();
+        int ns = numStats();
 
-        // For each feature, for each bucket, for each label
-        // weight for each bucket and last valid bucket
-        std::vector< std::vector<W> > w(nf);
-        std::vector< int > maxSplits(nf);
-
-        size_t totalNumBuckets = 0;
-        size_t activeFeatures = 0;
-
-        for (unsigned i = 0;  i < nf;  ++i) {
-            if (!features[i].active)
-                continue;
-            ++activeFeatures;
-            w[i].resize(features[i].buckets.numBuckets);
-            totalNumBuckets += features[i].buckets.numBuckets;
-        }
-
-        if (debug) {
-            std::cerr << "total of " << totalNumBuckets << " buckets" << std::endl;
-            std::cerr << activeFeatures << " of " << nf << " features active"
-                 << std::endl;
-        }
-
-        W wAll;
-
-        auto doFeature = [&] (int i)
-            {
-                int maxBucket = -1;
-
-                if (i == nf) {
-                    for (auto & r: rows) {
-                        wAll[r.label] += r.weight;
-                    }
-                    return;
-                }
-
-                if (!features[i].active)
-                    return;
-                bool twoBuckets = false;
-                int lastBucket = -1;
-
-                for (size_t j = 0;  j < rows.size();  ++j) {
-                    auto & r = rows[j];
-                    int bucket = features[i].buckets[r.exampleNum];
-
-                    twoBuckets = twoBuckets
-                        || (lastBucket != -1 && bucket != lastBucket);
-                    lastBucket = bucket;
-
-                    w[i][bucket][r.label] += r.weight;
-                    maxBucket = std::max(maxBucket, bucket);
-                }
-
-                // If all examples were in a single bucket, then the
-                // feature is no longer active.
-                if (!twoBuckets)
-                    features[i].active = false;
-
-                maxSplits[i] = maxBucket;
-            };
-
-        if (depth < 4 || true) {
-            parallelMap(0, nf + 1, doFeature);
-        }
-        else {
-            for (unsigned i = 0;  i <= nf;  ++i)
-                doFeature(i);
-        }
+        const W & wAll = histograms.wAll;
 
         // We have no impurity in our bucket.  Time to stop
-        if (wAll[0] == 0 || wAll[1] == 0)
-            return std::make_tuple(1.0, -1, -1, wAll, W(), wAll);
+        if (isPure(wAll))
+            return std::make_tuple(1.0, -1, -1, wAll, W(ns), wAll);
 
         double bestScore = INFINITY;
         int bestFeature = -1;
@@ -454,56 +603,54 @@ struct PartitionData {
         W bestLeft;
         W bestRight;
 
-        int bucketsEmpty = 0;
-        int bucketsOne = 0;
-        int bucketsBoth = 0;
+        W wFalse(ns), wTrue(ns);
 
         // Score each feature
         for (unsigned i = 0;  i < nf;  ++i) {
             if (!features[i].active)
                 continue;
 
-            W wAll; // TODO: do we need this?
-            for (auto & wt: w[i]) {
-                wAll += wt;
-                bucketsEmpty += wt[0] == 0 && wt[1] == 0;
-                bucketsBoth += wt[0] != 0 && wt[1] != 0;
-                bucketsOne += (wt[0] == 0) ^ (wt[1] == 0);
+            const Accum * w = histograms.w[i].data();
+            int numBuckets = features[i].buckets.numBuckets;
+
+            // If all examples are in a single bucket, then the feature is
+            // no longer active.
+            int maxBucket = -1;
+            int numNonEmpty = 0;
+            for (int j = 0;  j < numBuckets;  ++j) {
+                if (!bucketEmpty(w + (size_t)j * ns, ns)) {
+                    maxBucket = j;
+                    ++numNonEmpty;
+                }
+            }
+
+            if (numNonEmpty < 2) {
+                features[i].active = false;
+                continue;
             }
 
-            auto score = [] (const W & wFalse, const W & wTrue) -> double
-                {
-                    double score
-                    = 2.0 * (  sqrt(wFalse[0] * wFalse[1])
-                             + sqrt(wTrue[0] * wTrue[1]));
-                    return score;
-                };
-            
             if (debug) {
                 std::cerr << "feature " << i << " " << features[i].info->columnName
                      << std::endl;
-                std::cerr << "    all: " << wAll[0] << " " << wAll[1] << std::endl;
             }
 
-            int maxBucket = maxSplits[i];
-
             if (features[i].ordinal) {
                 // Calculate best split point for ordered values
-                W wFalse = wAll, wTrue;
+                wFalse = wAll;
+                std::fill(wTrue.v.begin(), wTrue.v.end(), Accum());
 
                 // Now test split points one by one
                 for (unsigned j = 0;  j < maxBucket;  ++j) {
-                    if (w[i][j].empty())
-                        continue;                   
+                    const Accum * wj = w + (size_t)j * ns;
+                    if (bucketEmpty(wj, ns))
+                        continue;
 
-                    double s = score(wFalse, wTrue);
+                    double s = impurity(wFalse) + impurity(wTrue);
 
                     if (debug) {
                         std::cerr << "  ord split " << j << " "
                              << features[i].info->bucketDescriptions.getValue(j)
                              << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << wTrue[0] << " " << wTrue[1] << std::endl;
                     }
 
                     if (s < bestScore) {
@@ -514,9 +661,8 @@ struct PartitionData {
                         bestLeft = wTrue;
                     }
 
-                   wFalse -= w[i][j];
-                   wTrue += w[i][j];
-
+                    wFalse.subtract(wj);
+                    wTrue.add(wj);
                 }
             }
             else {
@@ -524,21 +670,20 @@ struct PartitionData {
                 // Now test split points one by one
 
                 for (unsigned j = 0;  j <= maxBucket;  ++j) {
-
-                    if (w[i][j].empty())
+                    const Accum * wj = w + (size_t)j * ns;
+                    if (bucketEmpty(wj, ns))
                         continue;
 
-                    W wFalse = wAll;
-                    wFalse -= w[i][j];                    
+                    wFalse = wAll;
+                    wFalse.subtract(wj);
+                    wTrue.v.assign(wj, wj + ns);
 
-                    double s = score(wFalse, w[i][j]);
+                    double s = impurity(wFalse) + impurity(wTrue);
 
                     if (debug) {
                         std::cerr << "  non ord split " << j << " "
                              << features[i].info->bucketDescriptions.getValue(j)
                              << " had score " << s << std::endl;
-                        std::cerr << "    false: " << wFalse[0] << " " << wFalse[1] << std::endl;
-                        std::cerr << "    true:  " << w[i][j][0] << " " << w[i][j][1] << std::endl;
                     }
              
                     if (s < bestScore) {
@@ -546,16 +691,14 @@ struct PartitionData {
                         bestFeature = i;
                         bestSplit = j;
                         bestRight = wFalse;
-                        bestLeft = w[i][j];
+                        bestLeft = wTrue;
                     }
                 }
 
             }
         }
         
-        if (debug) {
-            std::cerr << "buckets: empty " << bucketsEmpty << " one " << bucketsOne
-                 << " both " << bucketsBoth << std::endl;
+        if (debug && bestFeature != -1) {
             std::cerr << "bestScore " << bestScore << std::endl;
             std::cerr << "bestFeature " << bestFeature << " "
                  << features[bestFeature].info->columnName << std::endl;
@@ -567,14 +710,24 @@ struct PartitionData {
         return std::make_tuple(bestScore, bestFeature, bestSplit, bestLeft, bestRight, wAll);
     }
 
-    static void fillinBase(ML::Tree::Base * node, const W & wAll)
+    void fillinBase(ML::Tree::Base * node, const W & wAll) const
     {
+        if (numLabels == 0) {
+            double total = toDouble(wAll[0]);
+            double mean = total > 0 ? toDouble(wAll[1]) / total : 0.0;
+            node->examples = total / WEIGHT_SCALE;
+            node->pred = { float(mean * labelScale + labelOffset) };
+            return;
+        }
 
-        float total = float(wAll[0]) + float(wAll[1]);
-        node->examples = total;
-        node->pred = {
-             float(wAll[0]) / total,
-             float(wAll[1]) / total };
+        double total = 0.0;
+        for (int i = 0;  i < numLabels;  ++i)
+            total += toDouble(wAll[i]);
+
+        node->examples = total / WEIGHT_SCALE;
+        node->pred.resize(numLabels);
+        for (int i = 0;  i < numLabels;  ++i)
+            node->pred[i] = total > 0 ? toDouble(wAll[i]) / total : 0.0;
     }
 
     ML::Tree::Ptr getLeaf(ML::Tree & tree, const W& w)
@@ -586,12 +739,11 @@ struct PartitionData {
 
     ML::Tree::Ptr getLeaf(ML::Tree & tree)
     {
-        W wAll;
+        W wAll(numStats());
         for (auto & r: rows) {
-            int label = r.label;
-            ExcAssert(label >= 0 && label < 2);
+            ExcAssert(numLabels == 0 || (r.label >= 0 && r.label < numLabels));
             ExcAssert(r.weight > 0);
-            wAll[r.label] += r.weight;
+            accumulate(wAll.v.data(), r);
         }
         
        return getLeaf(tree, wAll);
@@ -599,6 +751,17 @@ struct PartitionData {
 
     ML::Tree::Ptr train(int depth, int maxDepth,
                         ML::Tree & tree)
+    {
+        return train(depth, maxDepth, tree, Histograms());
+    }
+
+    /** Train the subtree for this partition.  If histograms is empty,
+        it is built from the rows; otherwise it must be the histograms
+        of this partition.
+    */
+    ML::Tree::Ptr train(int depth, int maxDepth,
+                        ML::Tree & tree,
+                        Histograms histograms)
     {
         if (rows.empty())
             return ML::Tree::Ptr();
@@ -608,6 +771,9 @@ struct PartitionData {
         if (depth >= maxDepth)
             return getLeaf(tree);
 
+        if (histograms.empty())
+            histograms = buildHistograms();
+
         double bestScore;
         int bestFeature;
         int bestSplit;
@@ -616,7 +782,7 @@ struct PartitionData {
         W wAll;
         
         std::tie(bestScore, bestFeature, bestSplit, wLeft, wRight, wAll)
-            = testAll(depth);
+            = testAll(depth, histograms);
 
         if (bestFeature == -1) {
             ML::Tree::Leaf * leaf = tree.new_leaf();
@@ -625,6 +791,11 @@ struct PartitionData {
             return leaf;
         }
 
+        // split() clears our features, so keep what we need for the node
+        const DatasetFeatureSpace::ColumnInfo * splitInfo
+            = features[bestFeature].info;
+        bool splitOrdinal = features[bestFeature].ordinal;
+
         std::pair<PartitionData, PartitionData> splits
             = split(bestFeature, bestSplit, wLeft, wRight, wAll);
 
@@ -633,16 +804,40 @@ struct PartitionData {
         //cerr << "left had " << splits.first.rows.size() << " rows" << endl;
         //cerr << "right had " << splits.second.rows.size() << " rows" << endl;
 
-        ML::Tree::Ptr left, right;
-        auto runLeft = [&] () { left = splits.first.train(depth + 1, maxDepth, tree); };
-        auto runRight = [&] () { right = splits.second.train(depth + 1, maxDepth, tree); };
-
         size_t leftRows = splits.first.rows.size();
         size_t rightRows = splits.second.rows.size();
 
         if (leftRows == 0 || rightRows == 0)
             throw MLDB::Exception("Invalid split in random forest");
 
+        // Only the smallest child needs its histograms built from its
+        // rows; those of the other one are ours minus them.
+        Histograms leftHistograms, rightHistograms;
+        if (depth + 1 < maxDepth
+            && histograms.memusage() <= MAX_SUBTRACTION_HISTOGRAM_BYTES) {
+            bool leftSmaller = leftRows < rightRows;
+            Histograms smallest
+                = (leftSmaller ? splits.first : splits.second).buildHistograms();
+            histograms -= smallest;
+            leftHistograms = leftSmaller ? std::move(smallest) : std::move(histograms);
+            rightHistograms = leftSmaller ? std::move(histograms) : std::move(smallest);
+        }
+        else {
+            histograms = Histograms();
+        }
+
+        ML::Tree::Ptr left, right;
+        auto runLeft = [&] ()
+            {
+                left = splits.first.train(depth + 1, maxDepth, tree,
+                                          std::move(leftHistograms));
+            };
+        auto runRight = [&] ()
+            {
+                right = splits.second.train(depth + 1, maxDepth, tree,
+                                            std::move(rightHistograms));
+            };
+
         ThreadPool tp;
         // Put the smallest one on the thread pool, so that we have the highest
         // probability of running both on our thread in case of lots of work.
@@ -659,10 +854,10 @@ struct PartitionData {
 
         if (left && right) {
             ML::Tree::Node * node = tree.new_node();
-            ML::Feature feature = fs->getFeature(features[bestFeature].info->columnName);
+            ML::Feature feature = fs->getFeature(splitInfo->columnName);
             float splitVal = 0;
-            if (features[bestFeature].ordinal) {
-                auto splitCell = features[bestFeature].info->bucketDescriptions
+            if (splitOrdinal) {
+                auto splitCell = splitInfo->bucketDescriptions
                     .getSplit(bestSplit);
                 if (splitCell.isNumeric())
                     splitVal = splitCell.toDouble();
@@ -673,15 +868,13 @@ struct PartitionData {
             }
 
             ML::Split split(feature, splitVal,
-                            features[bestFeature].ordinal
+                            splitOrdinal
                             ? ML::Split::LESS : ML::Split::EQUAL);
             
             node->split = split;
             node->child_true = left;
             node->child_false = right;
-            W wMissing;
-            wMissing[0] = 0.0f;
-            wMissing[1] = 0.0f;
+            W wMissing(numStats());
             node->child_missing = getLeaf(tree, wMissing);
             node->z = bestScore;            
             fillinBase(node, wLeft + wRight);
@@ -0,0 +1,191 @@
+/** hnsw_index_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the HNSW approximate nearest neighbors index.  Also reports the
+    recall@k and the query time against the exact vantage point tree, for
+    different values of ef.
+*/
+
+#include "mldb/ml/hnsw_index.h"
+#include "mldb/ml/tsne/vantage_point_tree.h"
+#include "mldb/base/parallel.h"
+#include "mldb/arch/timers.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <iostream>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+typedef std::vector<distribution<float> > Points;
+
+/// Points in clusters around random centers, which is harder than uniform
+/// points for a graph index
+static Points
+createPoints(int numPoints, int numDims, int seed)
+{
+    std::mt19937 rng(seed);
+    std::normal_distribution<float> normal;
+
+    Points centers(50, distribution<float>(numDims));
+    for (auto & c: centers)
+        for (auto & x: c)
+            x = 5.0 * normal(rng);
+
+    Points result(numPoints, distribution<float>(numDims));
+    for (auto & p: result) {
+        const auto & c = centers[rng() % centers.size()];
+        for (int d = 0;  d < numDims;  ++d)
+            p[d] = c[d] + normal(rng);
+    }
+    return result;
+}
+
+static float dist(const distribution<float> & p1, const distribution<float> & p2)
+{
+    return (p1 - p2).two_norm();
+}
+
+static std::unique_ptr<ML::VantagePointTreeT<int> >
+createVpTree(const Points & points)
+{
+    std::vector<int> items;
+    for (int i = 0;  i < points.size();  ++i)
+        items.push_back(i);
+
+    auto distances = [&] (int item, const std::vector<int> & items, int depth)
+        {
+            distribution<float> result(items.size());
+            for (size_t i = 0;  i < items.size();  ++i)
+                result[i] = dist(points[item], points[items[i]]);
+            return result;
+        };
+
+    return std::unique_ptr<ML::VantagePointTreeT<int> >
+        (ML::VantagePointTreeT<int>::createParallel(items, distances));
+}
+
+/// Return the recall@k of the index against the exact VP tree
+static double
+measureRecall(const HnswIndex & index,
+              const ML::VantagePointTreeT<int> & vpTree,
+              const Points & points,
+              const Points & queries,
+              int k, int ef)
+{
+    size_t found = 0;
+    double exactTime = 0.0, approxTime = 0.0;
+
+    for (auto & q: queries) {
+        auto queryDist = [&] (int item) { return dist(q, points[item]); };
+
+        Timer timer;
+        auto exact = vpTree.search(queryDist, k, INFINITY);
+        exactTime += timer.elapsed_wall();
+
+        timer.restart();
+        auto approx = index.search(queryDist, k, ef);
+        approxTime += timer.elapsed_wall();
+
+        BOOST_CHECK_EQUAL(approx.size(), k);
+        BOOST_CHECK(std::is_sorted(approx.begin(), approx.end()));
+
+        for (auto & e: exact) {
+            for (auto & a: approx) {
+                if (a.second == e.second) {
+                    ++found;
+                    break;
+                }
+            }
+        }
+    }
+
+    double recall = 1.0 * found / (k * queries.size());
+
+    cerr << "ef " << ef << ": recall@" << k << " " << recall
+         << " vptree " << 1000.0 * exactTime / queries.size() << "ms/query"
+         << " hnsw " << 1000.0 * approxTime / queries.size() << "ms/query"
+         << endl;
+
+    return recall;
+}
+
+BOOST_AUTO_TEST_CASE(test_empty_index)
+{
+    HnswIndex index;
+    BOOST_CHECK_EQUAL(index.size(), 0);
+    auto res = index.search([] (int) { return 0.0f; }, 10, 10);
+    BOOST_CHECK(res.empty());
+}
+
+BOOST_AUTO_TEST_CASE(test_small_index_is_exact)
+{
+    Points points = createPoints(100, 4, 1);
+    HnswIndex index;
+    index.add(points.size(), [&] (int i, int j) { return dist(points[i], points[j]); });
+    BOOST_CHECK_EQUAL(index.size(), 100);
+
+    for (int i = 0;  i < points.size();  ++i) {
+        auto res = index.search([&] (int j) { return dist(points[i], points[j]); },
+                                1, 50);
+        BOOST_REQUIRE_EQUAL(res.size(), 1);
+        BOOST_CHECK_EQUAL(res[0].second, i);
+        BOOST_CHECK_EQUAL(res[0].first, 0.0);
+    }
+
+    // maxDistance filters out far away points
+    auto res = index.search([&] (int j) { return dist(points[0], points[j]); },
+                            100, 100, 1e-6);
+    BOOST_REQUIRE_EQUAL(res.size(), 1);
+    BOOST_CHECK_EQUAL(res[0].second, 0);
+}
+
+BOOST_AUTO_TEST_CASE(test_recall_against_vp_tree)
+{
+    int numPoints = 20000, numDims = 32, k = 10;
+
+    Points points = createPoints(numPoints, numDims, 2);
+    Points queries = createPoints(200, numDims, 3);
+
+    auto itemDist = [&] (int i, int j) { return dist(points[i], points[j]); };
+
+    Timer timer;
+    auto vpTree = createVpTree(points);
+    cerr << "vptree built in " << timer.elapsed() << endl;
+
+    timer.restart();
+    HnswIndex index(16, 200);
+    index.add(numPoints, itemDist);
+    cerr << "hnsw built in " << timer.elapsed() << " using "
+         << index.memusage() / 1000000.0 << "MB" << endl;
+
+    double lastRecall = 0.0;
+    for (int ef: { 10, 50, 200 }) {
+        double recall = measureRecall(index, *vpTree, points, queries, k, ef);
+        BOOST_CHECK_GE(recall, lastRecall - 0.01);
+        lastRecall = recall;
+    }
+
+    BOOST_CHECK_GE(lastRecall, 0.95);
+
+    // Add the second half to a copy of an index with only the first half;
+    // it should be as good as building it at once.
+    HnswIndex half(16, 200);
+    half.add(numPoints / 2, itemDist);
+    HnswIndex full(half);
+    full.add(numPoints, itemDist);
+    BOOST_CHECK_EQUAL(half.size(), numPoints / 2);
+    BOOST_CHECK_EQUAL(full.size(), numPoints);
+
+    double recall = measureRecall(full, *vpTree, points, queries, k, 200);
+    BOOST_CHECK_GE(recall, 0.95);
+}
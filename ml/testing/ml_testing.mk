@@ -2,3 +2,4 @@
 
 $(eval $(call test,bucketing_probabilizer_test,ml,boost))
 $(eval $(call test,kmeans_test,ml test_utils,boost))
+$(eval $(call test,hnsw_index_test,ml arch,boost))
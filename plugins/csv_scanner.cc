@@ -0,0 +1,107 @@
+/** csv_scanner.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Vectorized scanning for the structural characters of CSV rows.  The
+    AVX2 version is in csv_scanner_avx2.cc, which is compiled with -mavx2.
+*/
+
+#include "mldb/plugins/csv_scanner.h"
+#include "mldb/arch/simd.h"
+#if MLDB_INTEL_ISA
+# include <emmintrin.h>
+#endif
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char *
+findCsvSpecialScalar(const char * p, const char * end,
+                     char c1, char c2, bool & eightBit)
+{
+    unsigned char highBits = 0;
+    for (;  p < end;  ++p) {
+        char c = *p;
+        if (c == c1 || c == c2)
+            break;
+        highBits |= c;
+    }
+    if (highBits & 128)
+        eightBit = true;
+    return p;
+}
+
+#if MLDB_INTEL_ISA
+
+const char *
+findCsvSpecialSse2(const char * p, const char * end,
+                   char c1, char c2, bool & eightBit)
+{
+    __m128i cccc1 = _mm_set1_epi8(c1);
+    __m128i cccc2 = _mm_set1_epi8(c2);
+
+    for (;  p + 16 <= end;  p += 16) {
+        __m128i chars = _mm_loadu_si128((const __m128i *)p);
+        unsigned found
+            = _mm_movemask_epi8(_mm_or_si128(_mm_cmpeq_epi8(chars, cccc1),
+                                             _mm_cmpeq_epi8(chars, cccc2)));
+        // The high bit of each byte is set for non-ASCII characters
+        unsigned highBits = _mm_movemask_epi8(chars);
+
+        if (found) {
+            int n = __builtin_ctz(found);
+            if (highBits & ((1U << n) - 1))
+                eightBit = true;
+            return p + n;
+        }
+
+        if (highBits)
+            eightBit = true;
+    }
+
+    return findCsvSpecialScalar(p, end, c1, c2, eightBit);
+}
+
+static const bool useAvx2 = has_avx() && has_avx2();
+
+bool csvScannerHasAvx2()
+{
+    return useAvx2;
+}
+
+#endif // MLDB_INTEL_ISA
+
+const char *
+findCsvSpecial(const char * p, const char * end,
+               char c1, char c2, bool & eightBit)
+{
+#if MLDB_INTEL_ISA
+    if (useAvx2)
+        return findCsvSpecialAvx2(p, end, c1, c2, eightBit);
+    return findCsvSpecialSse2(p, end, c1, c2, eightBit);
+#else
+    return findCsvSpecialScalar(p, end, c1, c2, eightBit);
+#endif
+}
+
+bool
+hasEightBitChars(const char * p, const char * end)
+{
+#if MLDB_INTEL_ISA
+    for (;  p + 16 <= end;  p += 16) {
+        if (_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)p)))
+            return true;
+    }
+#endif
+
+    unsigned char highBits = 0;
+    for (;  p < end;  ++p)
+        highBits |= *p;
+    return highBits & 128;
+}
+
+} // namespace MLDB
@@ -0,0 +1,49 @@
+/** csv_scanner.h                                                   -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Vectorized scanning for the structural characters (separators and
+    quotes) of CSV rows.
+*/
+
+#pragma once
+
+#include "mldb/arch/arch.h"
+
+
+namespace MLDB {
+
+
+/** Return a pointer to the first character in [p, end) that is c1 or c2,
+    or end if there is none.  eightBit is set to true if any character
+    before that one is not ASCII (it's left alone otherwise).
+
+    This looks at 16 (SSE2) or 32 (AVX2) characters at a time, depending
+    on what the CPU supports, with a scalar loop for the tail.  It never
+    reads past end.
+*/
+const char * findCsvSpecial(const char * p, const char * end,
+                            char c1, char c2, bool & eightBit);
+
+/** Return true if any character in [p, end) is not ASCII. */
+bool hasEightBitChars(const char * p, const char * end);
+
+/** Versions of findCsvSpecial() for each instruction set.  They give the
+    same result; they are exposed for testing and benchmarking.
+*/
+const char * findCsvSpecialScalar(const char * p, const char * end,
+                                  char c1, char c2, bool & eightBit);
+
+#if MLDB_INTEL_ISA
+const char * findCsvSpecialSse2(const char * p, const char * end,
+                                char c1, char c2, bool & eightBit);
+
+const char * findCsvSpecialAvx2(const char * p, const char * end,
+                                char c1, char c2, bool & eightBit);
+
+/// Is the AVX2 version usable on this CPU?
+bool csvScannerHasAvx2();
+#endif
+
+} // namespace MLDB
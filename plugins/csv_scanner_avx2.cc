@@ -0,0 +1,48 @@
+/** csv_scanner_avx2.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    AVX2 version of the CSV structural character scanner.  This file is
+    compiled with -mavx2, and only called if the CPU supports it.
+*/
+
+#include "mldb/plugins/csv_scanner.h"
+#include <immintrin.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const char *
+findCsvSpecialAvx2(const char * p, const char * end,
+                   char c1, char c2, bool & eightBit)
+{
+    __m256i cccc1 = _mm256_set1_epi8(c1);
+    __m256i cccc2 = _mm256_set1_epi8(c2);
+
+    for (;  p + 32 <= end;  p += 32) {
+        __m256i chars = _mm256_loadu_si256((const __m256i *)p);
+        uint32_t found = _mm256_movemask_epi8
+            (_mm256_or_si256(_mm256_cmpeq_epi8(chars, cccc1),
+                             _mm256_cmpeq_epi8(chars, cccc2)));
+        uint32_t highBits = _mm256_movemask_epi8(chars);
+
+        if (found) {
+            int n = __builtin_ctz(found);
+            if (highBits & ((1U << n) - 1))
+                eightBit = true;
+            return p + n;
+        }
+
+        if (highBits)
+            eightBit = true;
+    }
+
+    // Less than 32 characters left; finish with the 16 character version
+    return findCsvSpecialSse2(p, end, c1, c2, eightBit);
+}
+
+} // namespace MLDB
@@ -9,11 +9,13 @@
 
 #include "embedding.h"
 #include "mldb/ml/tsne/vantage_point_tree.h"
+#include "mldb/ml/hnsw_index.h"
 #include "mldb/arch/rcu_protected.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/arch/simd_vector.h"
 #include "mldb/base/parallel.h"
 #include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/plugins/shared_chunked_vector.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/types/tuple_description.h"
 #include "mldb/types/vector_description.h"
@@ -29,6 +31,7 @@
 #include "mldb/utils/possibly_dynamic_buffer.h"
 #include <boost/algorithm/clamp.hpp>
 #include "mldb/utils/log.h"
+#include <thread>
 
 using namespace std;
 
@@ -68,6 +71,50 @@ EmbeddingDatasetConfigDescription()
              "good for normalized embeddings like the SVD) and 'euclidean' "
              "(which is good for geometric embeddings like the t-SNE "
              "algorithm).", METRIC_EUCLIDEAN);
+    addField("index", &EmbeddingDatasetConfig::index,
+             "Index used for nearest neighbors queries.  'exact' (the "
+             "default) always returns the exact nearest neighbors, but "
+             "becomes slow for embeddings with many dimensions.  'hnsw' "
+             "returns approximate neighbors much faster, with a recall "
+             "controlled by the hnsw parameters.", EMBEDDING_INDEX_EXACT);
+    addField("hnswM", &EmbeddingDatasetConfig::hnswM,
+             "Number of links of each row in the hnsw index.  Higher values "
+             "give a better recall, at the cost of memory and build time.",
+             16);
+    addField("hnswEfConstruction", &EmbeddingDatasetConfig::hnswEfConstruction,
+             "Breadth of the search used to find the links of each row when "
+             "building the hnsw index.  Higher values give a better recall, "
+             "at the cost of build time.", 200);
+    addField("hnswEfSearch", &EmbeddingDatasetConfig::hnswEfSearch,
+             "Default breadth of the search in the hnsw index when looking "
+             "up nearest neighbors.  Higher values give a better recall, at "
+             "the cost of latency.  It can be overridden for each query.",
+             64);
+    onPostValidate = [] (EmbeddingDatasetConfig * config,
+                         JsonParsingContext & context)
+        {
+            if (config->hnswM < 2)
+                throw HttpReturnException
+                    (400, "hnswM must be at least 2 for embedding dataset");
+            if (config->hnswEfConstruction < 1 || config->hnswEfSearch < 1)
+                throw HttpReturnException
+                    (400, "hnswEfConstruction and hnswEfSearch must be "
+                     "positive for embedding dataset");
+        };
+}
+
+DEFINE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
+EmbeddingIndexTypeDescription::
+EmbeddingIndexTypeDescription()
+{
+    addValue("exact", EMBEDDING_INDEX_EXACT,
+             "Index the rows in a vantage point tree, which gives exact "
+             "nearest neighbors.");
+    addValue("hnsw", EMBEDDING_INDEX_HNSW,
+             "Index the rows in a hierarchical navigable small world graph, "
+             "which gives approximate nearest neighbors.  This is much "
+             "faster for embeddings with many dimensions.");
 }
 
 
@@ -75,9 +122,89 @@ EmbeddingDatasetConfigDescription()
 /* EMBEDDING INTERNAL REPRESENTATION                                         */
 /*****************************************************************************/
 
+/** Nearest neighbors index over the rows of an embedding.  The index only
+    covers the first numIndexed rows; rows which were committed after it
+    was built are searched exhaustively until the index is rebuilt.  As rows
+    are only ever appended, an index stays valid for every later version of
+    the rows.
+
+    Depending on the configuration, either the exact vantage point tree or
+    the approximate hnsw index is used.
+*/
+struct EmbeddingNeighborIndex {
+    EmbeddingNeighborIndex()
+        : numIndexed(0)
+    {
+    }
+
+    std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;  // null if no rows
+    std::unique_ptr<HnswIndex> hnsw;
+    size_t numIndexed;
+};
+
+/// Rows added to an EmbeddingRowIndex before they're merged into the base
+static constexpr size_t MIN_ROW_INDEX_DELTA = 10000;
+
+/// Once the delta of an EmbeddingRowIndex is bigger than 1 /
+/// ROW_INDEX_DELTA_FRACTION of its base, they are merged
+static constexpr size_t ROW_INDEX_DELTA_FRACTION = 16;
+
+/** Map from row hash to row number, shared between versions of the
+    dataset.  Most entries live in a base map which is shared between
+    versions and never modified; entries added since it was built are in
+    a delta map which each version copies.  Once the delta gets big
+    compared with the base, consolidate() merges them into a new base.
+*/
+struct EmbeddingRowIndex {
+    typedef Lightweight_Hash<uint64_t, int> Map;
+
+    EmbeddingRowIndex()
+        : base(std::make_shared<Map>())
+    {
+    }
+
+    /// Return the row number for the hash, or -1 if there is none
+    int find(uint64_t hash) const
+    {
+        auto it = delta.find(hash);
+        if (it != delta.end())
+            return it->second;
+        auto it2 = base->find(hash);
+        if (it2 != base->end())
+            return it2->second;
+        return -1;
+    }
+
+    /// Set the row number for the hash; -1 means it has none
+    void set(uint64_t hash, int rowNum)
+    {
+        delta[hash] = rowNum;
+    }
+
+    /// Merge the delta into a new base, if it has grown big enough
+    void consolidate()
+    {
+        if (delta.size() < std::max(MIN_ROW_INDEX_DELTA,
+                                    base->size() / ROW_INDEX_DELTA_FRACTION))
+            return;
+        auto newBase = std::make_shared<Map>(*base);
+        for (auto & e: delta)
+            (*newBase)[e.first] = e.second;
+        base = std::move(newBase);
+        delta.clear();
+    }
+
+    std::shared_ptr<const Map> base;
+    Map delta;
+};
+
+/** Contents of one version of an embedding dataset.  Versions are copies
+    of each other with rows appended, so everything that is proportional
+    to the number of rows is shared between them rather than copied.
+*/
 struct EmbeddingDatasetRepr {
     EmbeddingDatasetRepr(MetricSpace metric)
-        : vpTree(new ML::VantagePointTreeT<int>()),
+        : metric(metric),
           distance(DistanceMetric::create(metric))
     {
     }
@@ -85,7 +212,7 @@ struct EmbeddingDatasetRepr {
     EmbeddingDatasetRepr(std::vector<ColumnPath> columnNames,
                          MetricSpace metric)
         : columnNames(std::move(columnNames)), columns(this->columnNames.size()),
-          vpTree(new ML::VantagePointTreeT<int>()),
+          metric(metric),
           distance(DistanceMetric::create(metric))
     {
         for (unsigned i = 0;  i < this->columnNames.size();  ++i) {
@@ -99,7 +226,8 @@ struct EmbeddingDatasetRepr {
           columnIndex(other.columnIndex),
           rows(other.rows),
           rowIndex(other.rowIndex),
-          vpTree(ML::VantagePointTreeT<int>::deepCopy(other.vpTree.get()))
+          metric(other.metric),
+          distance(other.distance->clone())
     {
     }
 
@@ -198,30 +326,78 @@ struct EmbeddingDatasetRepr {
     }
     
     std::vector<ColumnPath> columnNames;
-    std::vector<std::vector<float> > columns;
+    std::vector<SharedChunkedVector<float> > columns;
     Lightweight_Hash<ColumnHash, int> columnIndex;
 
-    std::vector<Row> rows;
-    Lightweight_Hash<uint64_t, int> rowIndex;
+    SharedChunkedVector<Row> rows;
+    EmbeddingRowIndex rowIndex;
     
-    std::unique_ptr<ML::VantagePointTreeT<int> > vpTree;
+    MetricSpace metric;
     std::unique_ptr<DistanceMetric> distance;
 
-    void save(const std::string & filename)
+    /** Search for the nearest neighbors, using the index for the rows it
+        covers and an exhaustive search for the rest.  The result is
+        exactly the same as an exhaustive search over all rows.
+    */
+    std::vector<std::pair<float, int> >
+    search(const EmbeddingNeighborIndex & index,
+           const std::function<float (int)> & dist,
+           int numNeighbors,
+           float maxDistance,
+           int efSearch) const
+    {
+        ExcAssertLessEqual(index.numIndexed, rows.size());
+
+        std::vector<std::pair<float, int> > result;
+        if (index.hnsw)
+            result = index.hnsw->search(dist, numNeighbors, efSearch, maxDistance);
+        else if (index.vpTree)
+            result = index.vpTree->search(dist, numNeighbors, maxDistance);
+
+        if (index.numIndexed == rows.size())
+            return result;
+
+        for (size_t i = index.numIndexed;  i < rows.size();  ++i) {
+            float d = dist(i);
+            if (d <= maxDistance)
+                result.emplace_back(d, i);
+        }
+
+        std::sort(result.begin(), result.end());
+        if (result.size() > numNeighbors)
+            result.resize(numNeighbors);
+        return result;
+    }
+
+    void save(const std::string & filename,
+              const EmbeddingNeighborIndex & index)
     {
         filter_ostream stream(filename);
         ML::DB::Store_Writer store(stream);
         
-        serialize(store);
+        serialize(store, index);
 
         // Make sure that we saved properly
         stream.close();
     }
-    void serialize(ML::DB::Store_Writer & store) const;
+    void serialize(ML::DB::Store_Writer & store,
+                   const EmbeddingNeighborIndex & index) const;
 };
 
 const RowHash EmbeddingDatasetRepr::nullHashIn(RowPath("null"));
 
+/// Serialized in the same format as a std::vector
+template<typename T, size_t ChunkBits>
+ML::DB::Store_Writer &
+operator << (ML::DB::Store_Writer & store,
+             const SharedChunkedVector<T, ChunkBits> & vec)
+{
+    store << ML::DB::compact_size_t(vec.size());
+    for (auto & v: vec)
+        store << v;
+    return store;
+}
+
 ML::DB::Store_Writer &
 operator << (ML::DB::Store_Writer & store, const EmbeddingDatasetRepr::Row & row)
 {
@@ -231,34 +407,61 @@ operator << (ML::DB::Store_Writer & store, const EmbeddingDatasetRepr::Row & row
 
 void
 EmbeddingDatasetRepr::
-serialize(ML::DB::Store_Writer & store) const
+serialize(ML::DB::Store_Writer & store,
+          const EmbeddingNeighborIndex & index) const
 {
     store << string("EMBEDDING_DATASET")
-          << ML::DB::compact_size_t(1);  // version
+          << ML::DB::compact_size_t(3);  // version
     store << columnNames << columns << rows;
-    vpTree->serialize(store);
+    store << ML::DB::compact_size_t(index.numIndexed);
+    if (index.hnsw) {
+        store << string("hnsw");
+        index.hnsw->serialize(store);
+    }
+    else {
+        store << string("vptree");
+        ML::VantagePointTreeT<int>::serializePtr(store, index.vpTree.get());
+    }
 }
 
+/// Rows that can be committed without rebuilding the neighbors index
+static constexpr size_t MIN_UNINDEXED_ROWS = 10000;
+
+/// Once there are more than 1 / UNINDEXED_ROWS_FRACTION of the indexed rows
+/// (and at least MIN_UNINDEXED_ROWS) that aren't in the index, it's rebuilt
+static constexpr size_t UNINDEXED_ROWS_FRACTION = 64;
+
 struct EmbeddingDataset::Itl
     : public MatrixView, public ColumnIndex {
-    Itl(MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr),
+    Itl(const EmbeddingDatasetConfig & config)
+        : config(config), metric(config.metric),
+          committed(lock, metric), uncommitted(nullptr),
+          index(std::make_shared<EmbeddingNeighborIndex>()),
+          compacting(false), shuttingDown(false),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
 
     // TODO: make it loadable...
-    Itl(const std::string & address, MetricSpace metric)
-        : metric(metric), committed(lock, metric), uncommitted(nullptr), address(address),
+    Itl(const std::string & address, const EmbeddingDatasetConfig & config)
+        : config(config), metric(config.metric),
+          committed(lock, metric), uncommitted(nullptr), address(address),
+          index(std::make_shared<EmbeddingNeighborIndex>()),
+          compacting(false), shuttingDown(false),
           logger(MLDB::getMldbLog<ProximateVoxelsFunction>())
     {
     }
 
     ~Itl()
     {
+        // Interrupt any rebuild of the index that is running
+        shuttingDown = true;
+        if (compactionThread.joinable())
+            compactionThread.join();
         delete uncommitted.load();
     }
 
+    EmbeddingDatasetConfig config;
     MetricSpace metric;
 
     GcLock lock;
@@ -270,6 +473,16 @@ struct EmbeddingDataset::Itl
     std::atomic<EmbeddingDatasetRepr *> uncommitted;
     std::string address;
 
+    /// Neighbors index for the committed rows.  Only accessed with
+    /// std::atomic_load and friends; it must be loaded BEFORE the committed
+    /// representation, so that it never covers more rows than it.
+    std::shared_ptr<const EmbeddingNeighborIndex> index;
+
+    /// Background rebuild of the index
+    std::thread compactionThread;
+    std::atomic<bool> compacting;
+    std::atomic<bool> shuttingDown;
+
     RestRequestRouter router;
 
     shared_ptr<spdlog::logger> logger;
@@ -354,8 +567,7 @@ struct EmbeddingDataset::Itl
         auto repr = committed();
         if (!repr->initialized())
             return false;
-        auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowName));
-        return it != repr->rowIndex.end() && it->second != -1;
+        return repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowName)) != -1;
     }
 
     virtual bool knownRowHash(const RowHash & rowHash) const
@@ -363,8 +575,7 @@ struct EmbeddingDataset::Itl
         auto repr = committed();
         if (!repr->initialized())
             return false;
-        auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash));
-        return it != repr->rowIndex.end() && it->second != -1;
+        return repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash)) != -1;
     }
 
     virtual MatrixNamedRow getRow(const RowPath & rowName) const override
@@ -373,11 +584,11 @@ struct EmbeddingDataset::Itl
         if (!repr->initialized())
             return MatrixNamedRow();
 
-        auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowName));
-        if (it == repr->rowIndex.end() || it->second == -1)
+        int rowNum = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowName));
+        if (rowNum == -1)
             return MatrixNamedRow();
         
-        const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
+        const EmbeddingDatasetRepr::Row & row = repr->rows[rowNum];
 
         if (row.rowName != rowName)
             return MatrixNamedRow();
@@ -399,11 +610,11 @@ struct EmbeddingDataset::Itl
         if (!repr->initialized())
             return MatrixRow();
 
-        auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash));
-        if (it == repr->rowIndex.end() || it->second == -1)
+        int rowNum = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash));
+        if (rowNum == -1)
             return MatrixRow();
         
-        const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
+        const EmbeddingDatasetRepr::Row & row = repr->rows[rowNum];
 
         MatrixRow result;
         result.rowHash = rowHash;
@@ -428,11 +639,11 @@ struct EmbeddingDataset::Itl
         if (!repr->initialized())
             throw HttpReturnException(400, "unknown row");
 
-        auto it = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash));
-        if (it == repr->rowIndex.end() || it->second == -1)
+        int rowNum = repr->rowIndex.find(EmbeddingDatasetRepr::getRowHashForIndex(rowHash));
+        if (rowNum == -1)
             throw HttpReturnException(400, "unknown row");
 
-        return repr->rows[it->second].rowName;
+        return repr->rows[rowNum].rowName;
     }
 
     virtual bool knownColumn(const ColumnPath & column) const override
@@ -494,7 +705,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        const SharedChunkedVector<float> & columnVals = repr->columns.at(it->second);
 
         toStoreResult.isNumeric_ = true;
         toStoreResult.atMostOne_ = true;
@@ -519,7 +730,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        const SharedChunkedVector<float> & columnVals = repr->columns.at(it->second);
 
         MatrixColumn result;
 
@@ -543,7 +754,7 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
+        const SharedChunkedVector<float> & columnVals = repr->columns.at(it->second);
 
         std::vector<CellValue> result(columnVals.begin(), columnVals.end());
 
@@ -562,8 +773,8 @@ struct EmbeddingDataset::Itl
         if (it == repr->columnIndex.end())
             throw HttpReturnException(400, "Can't get name of unknown column");
 
-        const vector<float> & columnVals = repr->columns.at(it->second);
-        auto sortedVals = columnVals;
+        const SharedChunkedVector<float> & columnVals = repr->columns.at(it->second);
+        std::vector<float> sortedVals(columnVals.begin(), columnVals.end());
         std::sort(sortedVals.begin(), sortedVals.end());
         sortedVals.erase(std::unique(sortedVals.begin(), sortedVals.end()),
                          sortedVals.end());
@@ -688,33 +899,29 @@ struct EmbeddingDataset::Itl
             Date ts = std::get<2>(r);
 
             int index = (*uncommitted).rows.size();
+            int existing = (*uncommitted).rowIndex.find(rowHash);
 
-            if (!(*uncommitted).rowIndex.insert({ rowHash, index }).second) {
-                if ((*uncommitted).rowIndex[rowHash] == -1)
-                    (*uncommitted).rowIndex[rowHash] = index;
+            if (existing != -1) {
+                DEBUG_MSG(logger) << "rowName = " << rowName;
+                DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
+                // Check if it's a double record or a hash collision
+                RowPath oldName = (*uncommitted).rows.at(existing).rowName;
+                if (oldName == rowName)
+                    throw HttpReturnException
+                        (400, "Row '" + rowName.toUtf8String()
+                         + "' has already been recorded into embedding dataset.  "
+                         + "Are you re-using an output dataset (1)?");
                 else {
-                                                
-                    DEBUG_MSG(logger) << "rowName = " << rowName;
-                    DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
-                    // Check if it's a double record or a hash collision
-                    RowPath oldName
-                        = (*uncommitted).rows.at((*uncommitted).rowIndex[rowHash])
-                        .rowName;
-                    if (oldName == rowName)
-                        throw HttpReturnException
-                            (400, "Row '" + rowName.toUtf8String()
-                             + "' has already been recorded into embedding dataset.  "
-                             + "Are you re-using an output dataset (1)?");
-                    else {
-                        throw HttpReturnException
-                            (400, "Row '" + rowName.toUtf8String() + "' and '"
-                             + oldName.toUtf8String() + "' both hash to '"
-                             + RowHash(rowName).toString() + "' (hash collision). "
-                             + "You may be able to modify your names to avoid the collision.");
-                    }
+                    throw HttpReturnException
+                        (400, "Row '" + rowName.toUtf8String() + "' and '"
+                         + oldName.toUtf8String() + "' both hash to '"
+                         + RowHash(rowName).toString() + "' (hash collision). "
+                         + "You may be able to modify your names to avoid the collision.");
                 }
             }
 
+            (*uncommitted).rowIndex.set(rowHash, index);
+
             size_t numRowsBefore = (*uncommitted).rows.size();
         
             try {
@@ -725,7 +932,7 @@ struct EmbeddingDataset::Itl
                                                 (*uncommitted).rows.back().coords);
             } catch (const std::exception & exc) {
                 // If there is an exception, keep the data structure consistent
-                (*uncommitted).rowIndex[rowHash] = -1;
+                (*uncommitted).rowIndex.set(rowHash, -1);
                 if ((*uncommitted).rows.size() > numRowsBefore)
                     (*uncommitted).rows.pop_back();
                 throw;
@@ -817,33 +1024,30 @@ struct EmbeddingDataset::Itl
         // rows and set everything up.
 
         int index = (*uncommitted).rows.size();
-
-        if (!(*uncommitted).rowIndex.insert({ rowHash, index }).second) {
-            if ((*uncommitted).rowIndex[rowHash] == -1)
-                (*uncommitted).rowIndex[rowHash] = index;
+        int existing = (*uncommitted).rowIndex.find(rowHash);
+
+        if (existing != -1) {
+            DEBUG_MSG(logger) << "rowName = " << rowName;
+            DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
+            // Check if it's a double record or a hash collision
+            const RowPath & oldName = (*uncommitted).rows.at(existing).rowName;
+            if (oldName == rowName)
+                throw HttpReturnException
+                    (400, "Row '" + rowName.toUtf8String()
+                     + "' has already been recorded into embedding dataset.  "
+                     + "Are you re-using an output dataset (2)?");
             else {
-                DEBUG_MSG(logger) << "rowName = " << rowName;
-                DEBUG_MSG(logger) << "rowHash = " << RowHash(rowName);
-                // Check if it's a double record or a hash collision
-                const RowPath & oldName
-                    = (*uncommitted).rows.at((*uncommitted).rowIndex[rowHash])
-                    .rowName;
-                if (oldName == rowName)
-                    throw HttpReturnException
-                        (400, "Row '" + rowName.toUtf8String()
-                         + "' has already been recorded into embedding dataset.  "
-                         + "Are you re-using an output dataset (2)?");
-                else {
-                    return;
-                    throw HttpReturnException
-                        (400, "Row '" + rowName.toUtf8String() + "' and '"
-                         + oldName.toUtf8String() + "' both hash to '"
-                         + RowHash(rowName).toString() + "' (hash collision). "
-                         + "You may be able to modify your names to avoid the collision.");
-                }
+                return;
+                throw HttpReturnException
+                    (400, "Row '" + rowName.toUtf8String() + "' and '"
+                     + oldName.toUtf8String() + "' both hash to '"
+                     + RowHash(rowName).toString() + "' (hash collision). "
+                     + "You may be able to modify your names to avoid the collision.");
             }
         }
 
+        (*uncommitted).rowIndex.set(rowHash, index);
+
         size_t numRowsBefore = (*uncommitted).rows.size();
         
         try {
@@ -854,40 +1058,53 @@ struct EmbeddingDataset::Itl
                                             (*uncommitted).rows.back().coords);
         } catch (const std::exception & exc) {
             // If there is an exception, keep the data structure consistent
-            (*uncommitted).rowIndex[rowHash] = -1;
+            (*uncommitted).rowIndex.set(rowHash, -1);
             if ((*uncommitted).rows.size() > numRowsBefore)
                 (*uncommitted).rows.pop_back();
             throw;
         }        
     }
 
-    virtual void commit()
+    /** Build the neighbors index over the first numRows rows of the
+        given representation.  An hnsw index is built by adding the new
+        rows to a copy of the previous one.  Throws if the dataset is being
+        destroyed while it's running.
+    */
+    std::shared_ptr<const EmbeddingNeighborIndex>
+    buildIndex(const EmbeddingDatasetRepr & repr, size_t numRows,
+               const EmbeddingNeighborIndex & previous) const
     {
-        std::unique_lock<Mutex> guard(mutex);
-
-        INFO_MSG(logger) << "committing embedding dataset";
+        if (config.index == EMBEDDING_INDEX_HNSW) {
+            INFO_MSG(logger) << "adding " << numRows - previous.numIndexed
+                             << " rows to hnsw index";
+            Timer timer;
 
-        if (!uncommitted)
-            return;
-
-        for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-            (*uncommitted).columns[j].resize((*uncommitted).rows.size());
+            auto itemDist = [&] (int item1, int item2) -> float
+                {
+                    if (shuttingDown)
+                        throw HttpReturnException
+                            (500, "Embedding dataset destroyed while indexing");
+                    return repr.dist(item1, item2);
+                };
 
-        // Create the column index; this is a standard matrix inversion
-        auto indexRow = [&] (size_t i)
-            {
-                for (unsigned j = 0;  j < (*uncommitted).columns.size();  ++j)
-                    (*uncommitted).columns[j][i] = (*uncommitted).rows[i].coords[j];
-            };
+            auto result = std::make_shared<EmbeddingNeighborIndex>();
+            if (previous.hnsw)
+                result->hnsw.reset(new HnswIndex(*previous.hnsw));
+            else result->hnsw.reset(new HnswIndex(config.hnswM,
+                                                  config.hnswEfConstruction));
+            result->hnsw->add(numRows, itemDist);
+            result->numIndexed = numRows;
 
-        parallelMap(0, (*uncommitted).rows.size(), indexRow);
+            INFO_MSG(logger) << "hnsw index done in " << timer.elapsed();
+            return result;
+        }
 
-        // Create the vantage point tree
-        INFO_MSG(logger) << "creating vantage point tree";
+        INFO_MSG(logger) << "creating vantage point tree over " << numRows
+                         << " rows";
         Timer timer;
         
         std::vector<int> items;
-        for (unsigned i = 0;  i < (*uncommitted).rows.size();  ++i) {
+        for (unsigned i = 0;  i < numRows;  ++i) {
             items.push_back(i);
         }
 
@@ -898,13 +1115,17 @@ struct EmbeddingDataset::Itl
             {
                 ExcAssertLessEqual(depth, 100);  // 2^100 items is enough
 
+                if (shuttingDown)
+                    throw HttpReturnException
+                        (500, "Embedding dataset destroyed while indexing");
+
                 distribution<float> result(items.size());
 
                 auto doItem = [&] (int n)
                 {
                     int i = items[n];
 
-                    result[n] = (*uncommitted).dist(item, i);
+                    result[n] = repr.dist(item, i);
 
                     if (item == i)
                         ExcAssertEqual(result[n], 0.0);
@@ -926,24 +1147,150 @@ struct EmbeddingDataset::Itl
             };
         
         // Create the VP tree for indexed lookups on distance
-        (*uncommitted).vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
+        auto result = std::make_shared<EmbeddingNeighborIndex>();
+        result->vpTree.reset(ML::VantagePointTreeT<int>::createParallel(items, dist));
+        result->numIndexed = numRows;
 
         INFO_MSG(logger) << "VP tree done in " << timer.elapsed();
-        
+
+        return result;
+    }
+
+    /// Replace the index with the given one, unless it already covers
+    /// more rows.
+    void installIndex(std::shared_ptr<const EmbeddingNeighborIndex> newIndex)
+    {
+        auto current = std::atomic_load(&index);
+        while (current->numIndexed < newIndex->numIndexed
+               && !std::atomic_compare_exchange_weak(&index, &current, newIndex)) ;
+    }
+
+    /// Rebuild the index over all committed rows in a background thread.
+    /// Must be called with the mutex held.
+    void startCompaction()
+    {
+        if (compacting.exchange(true))
+            return;  // one is already running
+
+        // The previous compaction has finished, but its thread may still
+        // need to be joined.
+        if (compactionThread.joinable())
+            compactionThread.join();
+
+        auto runCompaction = [this] ()
+            {
+                try {
+                    auto previous = std::atomic_load(&index);
+
+                    // Copying the representation is cheap as it shares
+                    // the rows, and means that we don't hold up garbage
+                    // collection of old versions while the index builds.
+                    std::unique_ptr<EmbeddingDatasetRepr> snapshot;
+                    {
+                        auto repr = committed();
+                        snapshot.reset(new EmbeddingDatasetRepr(*repr));
+                    }
+
+                    auto newIndex = buildIndex(*snapshot,
+                                               snapshot->rows.size(),
+                                               *previous);
+                    snapshot.reset();
+                    installIndex(std::move(newIndex));
+                } catch (const std::exception & exc) {
+                    if (!shuttingDown)
+                        ERROR_MSG(logger) << "error rebuilding embedding index: "
+                                          << exc.what();
+                }
+                compacting = false;
+            };
+
+        compactionThread = std::thread(runCompaction);
+    }
+
+    virtual void commit()
+    {
+        std::unique_lock<Mutex> guard(mutex);
+
+        INFO_MSG(logger) << "committing embedding dataset";
+
+        if (!uncommitted)
+            return;
+
+        EmbeddingDatasetRepr & repr = *uncommitted;
+        size_t numRows = repr.rows.size();
+
+        // Rows that were already committed are already in the column index,
+        // so only the new ones are added.  This is a standard matrix
+        // inversion.
+        auto indexColumn = [&] (size_t j)
+            {
+                auto & column = repr.columns[j];
+                for (size_t i = column.size();  i < numRows;  ++i)
+                    column.push_back(repr.rows[i].coords[j]);
+            };
+
+        parallelMap(0, repr.columns.size(), indexColumn);
+
+        repr.rowIndex.consolidate();
+
+        // New rows are searched exhaustively until there are too many of
+        // them.  Then the index is rebuilt, which is done in the background
+        // unless the new rows are the bulk of the dataset, in which case
+        // we may as well wait for it.
+        auto currentIndex = std::atomic_load(&index);
+        size_t numIndexed = currentIndex->numIndexed;
+        size_t numUnindexed = numRows - numIndexed;
+        size_t maxUnindexed = std::max(MIN_UNINDEXED_ROWS,
+                                       numIndexed / UNINDEXED_ROWS_FRACTION);
+
+        std::shared_ptr<const EmbeddingNeighborIndex> newIndex;
+        bool compact = false;
+        if (numUnindexed > maxUnindexed) {
+            if (numUnindexed >= numIndexed)
+                newIndex = buildIndex(repr, numRows, *currentIndex);
+            else compact = true;
+        }
+        else if (numIndexed == 0 && numRows > 0) {
+            // Small dataset; index it now
+            newIndex = buildIndex(repr, numRows, *currentIndex);
+        }
+
         committed.replace(uncommitted);
         uncommitted = nullptr;
 
+        // Only now that the rows are committed can the index be installed
+        if (newIndex)
+            installIndex(std::move(newIndex));
+        if (compact)
+            startCompaction();
+
         if (!address.empty()) {
             INFO_MSG(logger) << "saving embedding";
-            committed()->save(address);
+            auto savedIndex = std::atomic_load(&index);
+            committed()->save(address, *savedIndex);
         }
     }
 
+    /// Status of the dataset; the number of rows and how many are indexed
+    Json::Value getStatus() const
+    {
+        auto currentIndex = std::atomic_load(&index);
+        auto repr = committed();
+        Json::Value result;
+        result["rowCount"] = repr->rows.size();
+        result["indexedRowCount"] = currentIndex->numIndexed;
+        result["indexing"] = compacting.load();
+        result["index"] = jsonEncode(config.index);
+        return result;
+    }
+
     vector<tuple<RowPath, RowHash, float> >
     getNeighbors(const distribution<float> & coord,
                  int numNeighbors,
-                 double maxDistance)
+                 double maxDistance,
+                 int efSearch)
     {
+        auto currentIndex = std::atomic_load(&index);
         auto repr = committed();
         if (!repr->initialized())
             return {};
@@ -957,7 +1304,11 @@ struct EmbeddingDataset::Itl
 
         //Timer timer;
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        if (efSearch <= 0)
+            efSearch = config.hnswEfSearch;
+
+        auto neighbors = repr->search(*currentIndex, dist, numNeighbors,
+                                      maxDistance, efSearch);
 
         //DEBUG_MSG(logger) << "neighbors took " << timer.elapsed();
 
@@ -974,30 +1325,36 @@ struct EmbeddingDataset::Itl
     }
 
     vector<tuple<RowPath, RowHash, float> >
-    getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance)
+    getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance,
+                    int efSearch)
     {
+        auto currentIndex = std::atomic_load(&index);
         auto repr = committed();
         if (!repr->initialized())
             return {};
 
         uint64_t rowHash = EmbeddingDatasetRepr::getRowHashForIndex(row);
 
-        auto it = repr->rowIndex.find(rowHash);
-        if (it == repr->rowIndex.end() || it->second == -1) {
+        int rowNum = repr->rowIndex.find(rowHash);
+        if (rowNum == -1) {
             throw HttpReturnException(400, "Couldn't find row '" + row.toUtf8String()
                                       + "' in embedding");
         }
        
-        //const EmbeddingDatasetRepr::Row & row = repr->rows[it->second];
+        //const EmbeddingDatasetRepr::Row & row = repr->rows[rowNum];
         
         auto dist = [&] (int item) -> float
             {
-                float result = repr->dist(item, it->second);
+                float result = repr->dist(item, rowNum);
                 ExcAssert(isfinite(result));
                 return result;
             };
 
-        auto neighbors = repr->vpTree->search(dist, numNeighbors, maxDistance);
+        if (efSearch <= 0)
+            efSearch = config.hnswEfSearch;
+
+        auto neighbors = repr->search(*currentIndex, dist, numNeighbors,
+                                      maxDistance, efSearch);
 
         vector<tuple<RowPath, RowHash, float> > result;
         for (auto & n: neighbors) {
@@ -1032,7 +1389,7 @@ EmbeddingDataset(MldbServer * owner,
 {
     this->datasetConfig = config.params.convert<EmbeddingDatasetConfig>();
 #if 1
-    itl.reset(new Itl(datasetConfig.metric));
+    itl.reset(new Itl(datasetConfig));
 #else // once persistence is done
 
     if (!config.address.empty()) {
@@ -1053,7 +1410,7 @@ Any
 EmbeddingDataset::
 getStatus() const
 {
-    return Any();
+    return itl->getStatus();
 }
 
 void
@@ -1125,16 +1482,18 @@ overrideFunction(const Utf8String & tableName,
 
 vector<tuple<RowPath, RowHash, float> >
 EmbeddingDataset::
-getNeighbors(const distribution<float> & coord, int numNeighbors, double maxDistance) const
+getNeighbors(const distribution<float> & coord, int numNeighbors,
+             double maxDistance, int efSearch) const
 {
-    return itl->getNeighbors(coord, numNeighbors, maxDistance);
+    return itl->getNeighbors(coord, numNeighbors, maxDistance, efSearch);
 }
     
 vector<tuple<RowPath, RowHash, float> >
 EmbeddingDataset::
-getRowNeighbors(const RowPath & row, int numNeighbors, double maxDistance) const
+getRowNeighbors(const RowPath & row, int numNeighbors,
+                double maxDistance, int efSearch) const
 {
-    return itl->getRowNeighbors(row, numNeighbors, maxDistance);
+    return itl->getRowNeighbors(row, numNeighbors, maxDistance, efSearch);
 }
 
 KnownColumn
@@ -1184,6 +1543,13 @@ NearestNeighborsFunctionConfigDescription()
              "specified in the function call.  This can be overridden on "
              "a call-by-call basis.",
              double(INFINITY));
+    addField("defaultEfSearch",
+             &NearestNeighborsFunctionConfig::defaultEfSearch,
+             "Default breadth of the search for datasets with an approximate "
+             "(hnsw) index; higher values give a better recall at the cost "
+             "of latency.  Zero (the default) uses the `hnswEfSearch` "
+             "value of the dataset.  This can be overridden on a "
+             "call-by-call basis.", 0);
     addField("dataset", &NearestNeighborsFunctionConfig::dataset,
              "Embedding dataset in which to find neighbors.  This must be a "
              "dataset of type `embedding`.");
@@ -1215,6 +1581,9 @@ NearestNeighborsInputDescription()
     addField("maxDistance", &NearestNeighborsInput::maxDistance,
              "Maximum distance to accept.  Passing null will use the "
              "value in the config", CellValue());
+    addField("efSearch", &NearestNeighborsInput::efSearch,
+             "Breadth of the search for datasets with an approximate index.  "
+             "Passing null will use the value in the config", CellValue());
     addField("coords", &NearestNeighborsInput::coords,
              "Coordinates of the value whose neighbors are being sought, "
              "or alternatively the `rowName` of the value in the underlying "
@@ -1278,18 +1647,23 @@ applyT(const ApplierT & applier_, NearestNeighborsInput input) const
 
     if(!input.maxDistance.empty())
         maxDistance = input.maxDistance.toDouble();
+
+    int efSearch = functionConfig.defaultEfSearch;
+    if (!input.efSearch.empty())
+        efSearch = input.efSearch.toInt();
     
     Date ts;
     vector<tuple<RowPath, RowHash, float> > neighbors;
     if (inputRow.isAtom()) {
         neighbors = applier.embeddingDataset
             ->getRowNeighbors(RowPath(inputRow.toUtf8String()),
-                               numNeighbors, maxDistance);
+                               numNeighbors, maxDistance, efSearch);
     }
     else if(inputRow.isEmbedding() || inputRow.isRow()) {
         auto embedding = applier.getEmbeddingFromExpr(inputRow);
         neighbors = applier.embeddingDataset
-            ->getNeighbors(embedding.cast<float>(), numNeighbors, maxDistance);
+            ->getNeighbors(embedding.cast<float>(), numNeighbors, maxDistance,
+                           efSearch);
     }
     else {
         throw MLDB::Exception("Input row must be either a row name or an embedding");
@@ -22,13 +22,26 @@ namespace MLDB {
 /* EMBEDDING DATASET CONFIG                                                  */
 /*****************************************************************************/
 
+/// Index used to answer nearest neighbors queries
+enum EmbeddingIndexType {
+    EMBEDDING_INDEX_EXACT,  ///< Vantage point tree; exact results
+    EMBEDDING_INDEX_HNSW    ///< Navigable small world graph; approximate
+};
+
+DECLARE_ENUM_DESCRIPTION(EmbeddingIndexType);
+
 struct EmbeddingDatasetConfig {
     EmbeddingDatasetConfig()
-        : metric(METRIC_EUCLIDEAN)
+        : metric(METRIC_EUCLIDEAN), index(EMBEDDING_INDEX_EXACT),
+          hnswM(16), hnswEfConstruction(200), hnswEfSearch(64)
     {
     }
 
     MetricSpace metric;
+    EmbeddingIndexType index;
+    int hnswM;
+    int hnswEfConstruction;
+    int hnswEfSearch;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(EmbeddingDatasetConfig);
@@ -76,13 +89,17 @@ struct EmbeddingDataset: public Dataset {
     
     virtual std::shared_ptr<RowValueInfo> getRowInfo() const;
 
+    /** Return the nearest neighbors of the given coordinates.  efSearch
+        is the breadth of the search for an approximate index; zero or
+        less uses the value from the dataset's configuration.
+    */
     std::vector<std::tuple<RowPath, RowHash, float> >
     getNeighbors(const distribution<float> & coord, int numNeighbors,
-                 double maxDistance) const;
+                 double maxDistance, int efSearch = 0) const;
     
     std::vector<std::tuple<RowPath, RowHash, float> >
     getRowNeighbors(const RowPath & row, int numNeighbors,
-                    double maxDistance) const;
+                    double maxDistance, int efSearch = 0) const;
 
 private:
     EmbeddingDatasetConfig datasetConfig;
@@ -99,12 +116,13 @@ private:
 struct NearestNeighborsFunctionConfig {
     NearestNeighborsFunctionConfig()
         : defaultNumNeighbors(10), defaultMaxDistance(INFINITY),
-          columnName()
+          defaultEfSearch(0), columnName()
     {
     }
 
     unsigned defaultNumNeighbors;
     double defaultMaxDistance;
+    int defaultEfSearch;
     ColumnPath columnName;
     std::shared_ptr<TableExpression> dataset;
 };
@@ -116,6 +134,7 @@ struct NearestNeighborsInput {
     ExpressionValue coords;
     CellValue numNeighbors; // positive integer or null
     CellValue maxDistance;  // double or null
+    CellValue efSearch;     // positive integer or null
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(NearestNeighborsInput);
@@ -15,6 +15,8 @@
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/types/value_description.h"
 #include <mutex>
+#include <ostream>
+#include <algorithm>
 
 using namespace std;
 
@@ -22,6 +24,49 @@ using namespace std;
 namespace MLDB {
 
 
+namespace {
+
+/** Filter rows whose values are stored as bit packed codes into a table
+    of distinct values, with code 0 meaning null if hasNulls is set.
+    codeMatches tells whether each code matches the predicate, so that it
+    is only evaluated once per distinct value.
+*/
+void filterCodes(const uint32_t * storage, int indexBits,
+                 uint64_t firstEntry, size_t numEntries, bool hasNulls,
+                 const std::vector<uint8_t> & codeMatches, bool nullMatches,
+                 std::vector<uint8_t> & keep)
+{
+    size_t numMatching = std::count(codeMatches.begin() + hasNulls,
+                                    codeMatches.end(), 1);
+    size_t numValues = codeMatches.size() - hasNulls;
+
+    // Rows outside of those we store are null
+    size_t begin = std::min<size_t>(firstEntry, keep.size());
+    size_t end = std::min<size_t>(firstEntry + numEntries, keep.size());
+    if (!nullMatches) {
+        std::fill(keep.begin(), keep.begin() + begin, 0);
+        std::fill(keep.begin() + end, keep.end(), 0);
+    }
+
+    if (numMatching == numValues && (!hasNulls || nullMatches))
+        return;  // everything we store matches
+    if (numMatching == 0 && !(hasNulls && nullMatches)) {
+        std::fill(keep.begin() + begin, keep.begin() + end, 0);
+        return;
+    }
+
+    // Row begin is the first code, as begin == firstEntry here
+    ML::Bit_Extractor<uint32_t> bits(storage);
+    for (size_t i = begin;  i < end;  ++i) {
+        uint32_t index = bits.extract<uint32_t>(indexBits);
+        if (!codeMatches[index])
+            keep[i] = 0;
+    }
+}
+
+} // file scope
+
+
 /*****************************************************************************/
 /* TABLE FROZEN COLUMN                                                       */
 /*****************************************************************************/
@@ -59,6 +104,42 @@ struct TableFrozenColumn: public FrozenColumn {
         }
     }
 
+    TableFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        indexBits = reconstituter.readPod<uint32_t>();
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        hasNulls = reconstituter.readPod<uint8_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        table.resize(reconstituter.readCount(1 /* cell type */));
+        for (auto & v: table)
+            v = reconstituter.readCellValue();
+        storage = reconstituter.readArray<uint32_t>(numWords());
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(indexBits);
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<uint8_t>(hasNulls);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writePod<uint64_t>(table.size());
+        for (auto & v: table)
+            serializer.writeCellValue(v);
+        serializer.writeArray(storage.get(), numWords());
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)indexBits * numEntries + 31) / 32;
+    }
+
+    virtual std::string format() const
+    {
+        return "Table";
+    }
+
     virtual bool forEachImpl(const ForEachRowFn & onRow,
                              bool keepNulls) const
     {
@@ -149,6 +230,23 @@ struct TableFrozenColumn: public FrozenColumn {
         return true;
     }
 
+    virtual void filter(const FrozenColumnPredicate & predicate,
+                        std::vector<uint8_t> & keep) const override
+    {
+        // Evaluate the predicate once per entry in the table, and then
+        // only look at the codes of the rows
+        bool nullMatches = predicate.matches(CellValue());
+        std::vector<uint8_t> codeMatches;
+        codeMatches.reserve(table.size() + hasNulls);
+        if (hasNulls)
+            codeMatches.push_back(nullMatches);
+        for (auto & v: table)
+            codeMatches.push_back(predicate.matches(v));
+
+        filterCodes(storage.get(), indexBits, firstEntry, numEntries,
+                    hasNulls, codeMatches, nullMatches, keep);
+    }
+
     std::shared_ptr<const uint32_t> storage;
     uint32_t indexBits;
     uint32_t numEntries;
@@ -212,6 +310,18 @@ struct TableFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new TableFrozenColumn(column);
     }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const TableFrozenColumn &>(column).serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new TableFrozenColumn(reconstituter);
+    }
 };
 
 RegisterFrozenColumnFormatT<TableFrozenColumnFormat> regTable;
@@ -262,6 +372,44 @@ struct SparseTableFrozenColumn: public FrozenColumn {
         }
     }
 
+    SparseTableFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        rowNumBits = reconstituter.readPod<uint8_t>();
+        indexBits = reconstituter.readPod<uint8_t>();
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        lastEntry = reconstituter.readPod<uint64_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        table.resize(reconstituter.readCount(1 /* cell type */));
+        for (auto & v: table)
+            v = reconstituter.readCellValue();
+        storage = reconstituter.readArray<uint32_t>(numWords());
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint8_t>(rowNumBits);
+        serializer.writePod<uint8_t>(indexBits);
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<uint64_t>(lastEntry);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writePod<uint64_t>(table.size());
+        for (auto & v: table)
+            serializer.writeCellValue(v);
+        serializer.writeArray(storage.get(), numWords());
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)(indexBits + rowNumBits) * numEntries + 31) / 32;
+    }
+
+    virtual std::string format() const
+    {
+        return "SparseTable";
+    }
+
     virtual bool forEach(const ForEachRowFn & onRow) const
     {
         ML::Bit_Extractor<uint32_t> bits(storage.get());
@@ -447,6 +595,19 @@ struct SparseTableFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new SparseTableFrozenColumn(column);
     }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const SparseTableFrozenColumn &>(column)
+            .serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new SparseTableFrozenColumn(reconstituter);
+    }
 };
 
 RegisterFrozenColumnFormatT<SparseTableFrozenColumnFormat> regSparseTable;
@@ -606,6 +767,38 @@ struct IntegerFrozenColumn: public FrozenColumn {
 #endif
     }
 
+    IntegerFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        entryBits = reconstituter.readPod<uint32_t>();
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        offset = reconstituter.readPod<int64_t>();
+        hasNulls = reconstituter.readPod<uint8_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        storage = reconstituter.readArray<uint64_t>(numWords());
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(entryBits);
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<int64_t>(offset);
+        serializer.writePod<uint8_t>(hasNulls);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writeArray(storage.get(), numWords());
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)entryBits * numEntries + 63) / 64;
+    }
+
+    virtual std::string format() const
+    {
+        return "Integer";
+    }
+
     bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
         ML::Bit_Extractor<uint64_t> bits(storage.get());
@@ -763,6 +956,18 @@ struct IntegerFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new IntegerFrozenColumn(column);
     }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const IntegerFrozenColumn &>(column).serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new IntegerFrozenColumn(reconstituter);
+    }
 };
 
 RegisterFrozenColumnFormatT<IntegerFrozenColumnFormat> regInteger;
@@ -862,6 +1067,27 @@ struct DoubleFrozenColumn: public FrozenColumn {
         }
     }
 
+    DoubleFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        storage = reconstituter.readArray<Entry>(numEntries);
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writeArray(storage.get(), numEntries);
+    }
+
+    virtual std::string format() const
+    {
+        return "Double";
+    }
+
     bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
     {
         for (size_t i = 0;  i < numEntries;  ++i) {
@@ -1006,6 +1232,18 @@ struct DoubleFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new DoubleFrozenColumn(column);
     }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const DoubleFrozenColumn &>(column).serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new DoubleFrozenColumn(reconstituter);
+    }
 };
 
 RegisterFrozenColumnFormatT<DoubleFrozenColumnFormat> regDouble;
@@ -1039,6 +1277,23 @@ struct TimestampFrozenColumn: public FrozenColumn {
         unwrapped = column.freeze(params);
     }
 
+    TimestampFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        columnTypes = reconstituter.readColumnTypes();
+        unwrapped = reconstituter.readColumn();
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writeColumn(*unwrapped);
+    }
+
+    virtual std::string format() const
+    {
+        return "Timestamp";
+    }
+
     // Wrap a double (or null) into a timestamp (or null)
     static CellValue wrap(CellValue val)
     {
@@ -1137,134 +1392,1776 @@ struct TimestampFrozenColumnFormat: public FrozenColumnFormat {
     {
         return new TimestampFrozenColumn(column, params);
     }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const TimestampFrozenColumn &>(column)
+            .serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new TimestampFrozenColumn(reconstituter);
+    }
 };
 
 RegisterFrozenColumnFormatT<TimestampFrozenColumnFormat> regTimestamp;
 
 
 /*****************************************************************************/
-/* FROZEN COLUMN FORMAT                                                      */
+/* RUN LENGTH FROZEN COLUMN                                                  */
 /*****************************************************************************/
 
-namespace {
-
-typedef std::map<std::string, std::shared_ptr<FrozenColumnFormat> > Formats;
+/** Frozen column that stores runs of rows with the same value, each as the
+    row at which it ends and the code of its value in a lookup table.
+    Suited to low cardinality columns whose values change rarely, like
+    status flags or columns that rows were sorted by.
+*/
+struct RunLengthFrozenColumn: public FrozenColumn {
 
-atomic_shared_ptr<const Formats> & getFormats()
-{
-    static atomic_shared_ptr<const Formats> formats
-        (std::make_shared<Formats>());
-    return formats;
-}
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            indexBits = ML::highest_bit(column.indexedVals.size() + hasNulls) + 1;
+
+            // A run costs more than 32 bits, so with this many runs a
+            // table column is always smaller
+            size_t maxRuns = numEntries / 2;
+
+            const auto & sparse = column.sparseIndexes;
+            size_t i = 0;  // next entry in sparse
+            for (size_t row = 0;  row < numEntries;) {
+                uint32_t code;
+                size_t end;
+                if (i < sparse.size() && sparse[i].first == row) {
+                    code = sparse[i].second + hasNulls;
+                    end = row + 1;
+                    for (++i;  i < sparse.size() && sparse[i].first == end
+                             && sparse[i].second + hasNulls == code;  ++i)
+                        ++end;
+                }
+                else {
+                    code = 0;  // a run of nulls
+                    end = i < sparse.size() ? sparse[i].first : numEntries;
+                }
 
+                if (runEnds.size() == maxRuns)
+                    return;  // too many runs
 
-} // file scope
+                runEnds.push_back(end);
+                runCodes.push_back(code);
+                row = end;
+            }
 
-FrozenColumnFormat::
-~FrozenColumnFormat()
-{
-}
+            bytesRequired = sizeof(RunLengthFrozenColumn)
+                + runEnds.size() * sizeof(uint32_t)
+                + (indexBits * runEnds.size() + 31) / 32 * 4;
+            for (auto & v: column.indexedVals)
+                bytesRequired += v.memusage();
+        }
 
-std::shared_ptr<void>
-FrozenColumnFormat::
-registerFormat(std::shared_ptr<FrozenColumnFormat> format)
-{
-    std::string name = format->format();
-    auto & formats = getFormats();
-    for (;;) {
-        auto ptr = formats.load();
-        if (ptr->count(name)) {
-            throw HttpReturnException
-                (500, "Attempt to double-register frozen column format "
-                 + name);
+        operator ssize_t () const
+        {
+            return bytesRequired;
         }
-        auto newFormats = *ptr;
-        newFormats.emplace(name, format);
-        auto newFormatsPtr
-            = std::make_shared<Formats>(std::move(newFormats));
-        if (formats.compare_exchange_strong(ptr, newFormatsPtr)) {
 
-            auto deregister = [name] (void *)
-                {
-                    auto & formats = getFormats();
-                    for (;;) {
-                        auto ptr = formats.load();
-                        auto newFormats = *ptr;
-                        newFormats.erase(name);
-                        auto newFormatsPtr
-                            = std::make_shared<Formats>(std::move(newFormats));
-                        if (formats.compare_exchange_strong(ptr, newFormatsPtr))
-                            break;
-                    }
-                };
+        ssize_t bytesRequired = -1;
+        size_t numEntries;
+        bool hasNulls;
+        int indexBits;
+        std::vector<uint32_t> runEnds;
+        std::vector<uint32_t> runCodes;
+    };
 
-            return std::shared_ptr<void>(format.get(), deregister);
-        }
+    RunLengthFrozenColumn(TabularDatasetColumn & column,
+                          const SizingInfo & info)
+        : table(std::move(column.indexedVals)),
+          columnTypes(column.columnTypes)
+    {
+        ExcAssertNotEqual(info.bytesRequired, -1);
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        indexBits = info.indexBits;
+        numRuns = info.runEnds.size();
+
+        uint32_t * ends = new uint32_t[numRuns];
+        std::copy(info.runEnds.begin(), info.runEnds.end(), ends);
+        runEnds = std::shared_ptr<uint32_t>(ends, [] (uint32_t * p) { delete[] p; });
+
+        uint32_t * codes = new uint32_t[numCodeWords()];
+        runCodes = std::shared_ptr<uint32_t>(codes, [] (uint32_t * p) { delete[] p; });
+        ML::Bit_Writer<uint32_t> writer(codes);
+        for (auto & c: info.runCodes)
+            writer.write(c, indexBits);
     }
-}
 
+    RunLengthFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        indexBits = reconstituter.readPod<uint32_t>();
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        hasNulls = reconstituter.readPod<uint8_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        table.resize(reconstituter.readCount(1 /* cell type */));
+        for (auto & v: table)
+            v = reconstituter.readCellValue();
+        numRuns = reconstituter.readPod<uint32_t>();
+        runEnds = reconstituter.readArray<uint32_t>(numRuns);
+        runCodes = reconstituter.readArray<uint32_t>(numCodeWords());
+    }
 
-/*****************************************************************************/
-/* FROZEN COLUMN                                                             */
-/*****************************************************************************/
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(indexBits);
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<uint8_t>(hasNulls);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writePod<uint64_t>(table.size());
+        for (auto & v: table)
+            serializer.writeCellValue(v);
+        serializer.writePod<uint32_t>(numRuns);
+        serializer.writeArray(runEnds.get(), numRuns);
+        serializer.writeArray(runCodes.get(), numCodeWords());
+    }
 
-FrozenColumn::
-FrozenColumn()
-    : logger(getMldbLog<TabularDataset>()) // this class is only used by the tabular dataset
-{
-}
+    size_t numCodeWords() const
+    {
+        return ((size_t)indexBits * numRuns + 31) / 32;
+    }
 
-std::pair<ssize_t, std::function<std::shared_ptr<FrozenColumn> (TabularDatasetColumn & column)> >
-FrozenColumnFormat::
-preFreeze(const TabularDatasetColumn & column,
-          const ColumnFreezeParameters & params)
-{
-    // Get the current list of formats
-    auto formats = getFormats().load();
-    
-    ssize_t bestBytes = FrozenColumnFormat::NOT_BEST;
-    const FrozenColumnFormat * bestFormat = nullptr;
-    std::shared_ptr<void> bestData;
+    virtual std::string format() const
+    {
+        return "RunLength";
+    }
 
-    for (auto & f: *formats) {
-        std::shared_ptr<void> data;
-        if (f.second->isFeasible(column, params, data)) {
-            ssize_t bytes = f.second->columnSize(column, params, bestBytes,
-                                                 data);
-            if (bytes >= 0 && (bestBytes < 0 || bytes < bestBytes)) {
-                bestFormat = f.second.get();
-                bestData = std::move(data);
-                bestBytes = bytes;
-            }
+    CellValue decode(uint32_t code) const
+    {
+        if (hasNulls) {
+            if (code == 0)
+                return CellValue();
+            return table[code - 1];
         }
+        return table[code];
     }
 
-    if (bestFormat) {
-        return std::make_pair(bestBytes,
-                              [=] (TabularDatasetColumn & column)
-                              {
-                                  return std::shared_ptr<FrozenColumn>
-                                      (bestFormat->freeze(column, params, bestData));
-                              }
-                              );
+    /// Call onRun(start, end, code) for each run
+    template<typename Fn>
+    bool forEachRun(Fn && onRun) const
+    {
+        ML::Bit_Extractor<uint32_t> bits(runCodes.get());
+        uint32_t start = 0;
+        for (size_t i = 0;  i < numRuns;  ++i) {
+            uint32_t code = bits.extract<uint32_t>(indexBits);
+            uint32_t end = runEnds.get()[i];
+            if (!onRun(start, end, code))
+                return false;
+            start = end;
+        }
+        return true;
     }
-    
-    return std::make_pair(FrozenColumnFormat::NOT_BEST, nullptr);
-}
 
-std::shared_ptr<FrozenColumn>
-FrozenColumn::
-freeze(TabularDatasetColumn & column,
-       const ColumnFreezeParameters & params)
-{
-    ExcAssert(!column.isFrozen);
-    auto res = FrozenColumnFormat::preFreeze(column, params);
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        // The value is decoded once per run rather than once per row
+        auto onRun = [&] (uint32_t start, uint32_t end, uint32_t code)
+            {
+                if (hasNulls && code == 0 && !keepNulls)
+                    return true;
+                CellValue val = decode(code);
+                for (uint32_t i = start;  i < end;  ++i) {
+                    if (!onRow(i + firstEntry, val))
+                        return false;
+                }
+                return true;
+            };
+
+        return forEachRun(onRun);
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+
+        const uint32_t * ends = runEnds.get();
+        size_t run = std::upper_bound(ends, ends + numRuns, rowIndex) - ends;
+        ExcAssertLess(run, numRuns);
+        ML::Bit_Extractor<uint32_t> bits(runCodes.get());
+        bits.advance(run * indexBits);
+        return decode(bits.extract<uint32_t>(indexBits));
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        size_t result
+            = sizeof(*this)
+            + numRuns * sizeof(uint32_t)
+            + numCodeWords() * 4;
+
+        for (auto & v: table)
+            result += v.memusage();
+
+        return result;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls) {
+            if (!fn(CellValue()))
+                return false;
+        }
+        for (auto & v: table) {
+            if (!fn(v))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual void filter(const FrozenColumnPredicate & predicate,
+                        std::vector<uint8_t> & keep) const override
+    {
+        // Evaluate the predicate once per entry in the table, and then
+        // clear whole runs at a time
+        bool nullMatches = predicate.matches(CellValue());
+        std::vector<uint8_t> codeMatches;
+        codeMatches.reserve(table.size() + hasNulls);
+        if (hasNulls)
+            codeMatches.push_back(nullMatches);
+        for (auto & v: table)
+            codeMatches.push_back(predicate.matches(v));
+
+        size_t begin = std::min<size_t>(firstEntry, keep.size());
+        size_t end = std::min<size_t>(firstEntry + numEntries, keep.size());
+        if (!nullMatches) {
+            std::fill(keep.begin(), keep.begin() + begin, 0);
+            std::fill(keep.begin() + end, keep.end(), 0);
+        }
+
+        auto onRun = [&] (uint32_t runStart, uint32_t runEnd, uint32_t code)
+            {
+                if (!codeMatches[code]) {
+                    size_t b = std::min<size_t>(runStart + firstEntry, end);
+                    size_t e = std::min<size_t>(runEnd + firstEntry, end);
+                    std::fill(keep.begin() + b, keep.begin() + e, 0);
+                }
+                return true;
+            };
+
+        forEachRun(onRun);
+    }
+
+    std::shared_ptr<const uint32_t> runEnds;   ///< Row after each run
+    std::shared_ptr<const uint32_t> runCodes;  ///< Bit packed value codes
+    uint32_t numRuns;
+    uint32_t indexBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+
+    bool hasNulls;
+    std::vector<CellValue> table;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+};
+
+struct RunLengthFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~RunLengthFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "RunLength";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return true;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<RunLengthFrozenColumn::SizingInfo>(column);
+        ssize_t result = *info;
+        cachedInfo = info;
+        return result == -1 ? CANT_STORE : result;
+    }
+
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        auto info = std::static_pointer_cast
+            <RunLengthFrozenColumn::SizingInfo>(cachedInfo);
+        if (!info)
+            info = std::make_shared<RunLengthFrozenColumn::SizingInfo>(column);
+        return new RunLengthFrozenColumn(column, *info);
+    }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const RunLengthFrozenColumn &>(column)
+            .serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new RunLengthFrozenColumn(reconstituter);
+    }
+};
+
+RegisterFrozenColumnFormatT<RunLengthFrozenColumnFormat> regRunLength;
+
+
+/*****************************************************************************/
+/* PACKED INTEGER FROZEN COLUMN                                              */
+/*****************************************************************************/
+
+/** Frozen column for integers that is split into blocks of rows, each of
+    which is bit packed with as few bits as its own values need.  There
+    are two encodings:
+
+    - frame of reference, where each value is stored as its difference
+      from the lowest value of the block (or one more than that, if there
+      are nulls, with zero meaning null);
+    - delta, where each value is stored as its difference from the value
+      of the previous row, less the lowest such difference in the block.
+      It's used for columns without nulls whose values increase (or
+      decrease) steadily, like sorted timestamps or counters, which are
+      then stored in few or no bits per row.
+
+    Unlike the integer column, a few outlying values only cost extra bits
+    within their own block.
+*/
+struct PackedIntegerFrozenColumn: public FrozenColumn {
+
+    /// Number of rows in each block
+    static constexpr size_t BLOCK_SIZE = 128;
+
+    /// Values must be within this range for the differences to fit
+    static constexpr int64_t MAX_MAGNITUDE = 1LL << 60;
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column, bool delta)
+            : delta(delta)
+        {
+            const ColumnTypes & types = column.columnTypes;
+            if (!types.onlyIntegersAndNulls() || column.sparseIndexes.empty())
+                return;  // can't use this column type
+            if (types.hasPositiveIntegers()
+                && types.maxPositiveInteger > (uint64_t)MAX_MAGNITUDE)
+                return;  // out of range
+            if (types.hasNegativeIntegers()
+                && types.minNegativeInteger < -MAX_MAGNITUDE)
+                return;  // out of range
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            if (delta && hasNulls)
+                return;  // nulls would break the sequence
+
+            values.resize(numEntries);
+            isNull.resize(numEntries, hasNulls);
+            for (auto & r_i: column.sparseIndexes) {
+                values[r_i.first] = column.indexedVals[r_i.second].toInt();
+                isNull[r_i.first] = false;
+            }
+
+            size_t numBlocks = (numEntries + BLOCK_SIZE - 1) / BLOCK_SIZE;
+            blockBase.resize(numBlocks);
+            blockMinDelta.resize(delta ? numBlocks : 0);
+            blockBits.resize(numBlocks);
+            blockOffset.resize(numBlocks);
+
+            uint64_t totalBits = 0;
+            for (size_t b = 0;  b < numBlocks;  ++b) {
+                size_t start = b * BLOCK_SIZE;
+                size_t end = std::min(start + BLOCK_SIZE, numEntries);
+                uint64_t range = 0;
+
+                if (delta) {
+                    int64_t minDelta = 0, maxDelta = 0;
+                    for (size_t i = start + 1;  i < end;  ++i) {
+                        int64_t d = values[i] - values[i - 1];
+                        if (i == start + 1 || d < minDelta)
+                            minDelta = d;
+                        if (i == start + 1 || d > maxDelta)
+                            maxDelta = d;
+                    }
+                    blockBase[b] = values[start];
+                    blockMinDelta[b] = minDelta;
+                    range = maxDelta - minDelta;
+                }
+                else {
+                    bool any = false;
+                    int64_t minVal = 0, maxVal = 0;
+                    for (size_t i = start;  i < end;  ++i) {
+                        if (isNull[i])
+                            continue;
+                        if (!any || values[i] < minVal)
+                            minVal = values[i];
+                        if (!any || values[i] > maxVal)
+                            maxVal = values[i];
+                        any = true;
+                    }
+                    blockBase[b] = minVal;
+                    // With nulls, an all-null block needs no bits
+                    range = any ? maxVal - minVal + hasNulls : 0;
+                }
+
+                blockBits[b] = ML::highest_bit(range) + 1;
+                blockOffset[b] = totalBits;
+                totalBits += blockBits[b] * (end - start);
+            }
+
+            numWords = (totalBits + 63) / 64;
+            bytesRequired = sizeof(PackedIntegerFrozenColumn)
+                + numBlocks * (sizeof(int64_t) + 1 + sizeof(uint64_t))
+                + blockMinDelta.size() * sizeof(int64_t)
+                + numWords * 8;
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        bool delta;
+        size_t numEntries;
+        bool hasNulls;
+        size_t numWords;
+        std::vector<int64_t> values;
+        std::vector<uint8_t> isNull;
+        std::vector<int64_t> blockBase;
+        std::vector<int64_t> blockMinDelta;
+        std::vector<uint8_t> blockBits;
+        std::vector<uint64_t> blockOffset;
+    };
+
+    template<typename T>
+    static std::shared_ptr<const T> copyArray(const std::vector<T> & vals)
+    {
+        T * data = new T[vals.size()];
+        std::copy(vals.begin(), vals.end(), data);
+        return std::shared_ptr<T>(data, [] (T * p) { delete[] p; });
+    }
+
+    PackedIntegerFrozenColumn(TabularDatasetColumn & column,
+                              const SizingInfo & info)
+        : columnTypes(column.columnTypes)
+    {
+        ExcAssertNotEqual(info.bytesRequired, -1);
+        delta = info.delta;
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        numWords = info.numWords;
+
+        blockBase = copyArray(info.blockBase);
+        blockMinDelta = copyArray(info.blockMinDelta);
+        blockBits = copyArray(info.blockBits);
+        blockOffset = copyArray(info.blockOffset);
+
+        uint64_t * data = new uint64_t[numWords];
+        std::fill(data, data + numWords, 0);
+        storage = std::shared_ptr<uint64_t>(data, [] (uint64_t * p) { delete[] p; });
+
+        ML::Bit_Writer<uint64_t> writer(data);
+        for (size_t b = 0;  b < numBlocks();  ++b) {
+            int bits = info.blockBits[b];
+            if (bits == 0)
+                continue;
+            size_t start = b * BLOCK_SIZE;
+            size_t end = std::min<size_t>(start + BLOCK_SIZE, numEntries);
+            for (size_t i = start;  i < end;  ++i) {
+                uint64_t code;
+                if (delta) {
+                    code = i == start ? 0
+                        : info.values[i] - info.values[i - 1]
+                        - info.blockMinDelta[b];
+                }
+                else if (info.isNull[i]) {
+                    code = 0;
+                }
+                else {
+                    code = info.values[i] - info.blockBase[b] + hasNulls;
+                }
+                writer.write(code, bits);
+            }
+        }
+    }
+
+    PackedIntegerFrozenColumn(FrozenColumnReconstituter & reconstituter,
+                              bool delta)
+        : delta(delta)
+    {
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        hasNulls = reconstituter.readPod<uint8_t>();
+        numWords = reconstituter.readPod<uint64_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        blockBase = reconstituter.readArray<int64_t>(numBlocks());
+        blockMinDelta
+            = reconstituter.readArray<int64_t>(delta ? numBlocks() : 0);
+        blockBits = reconstituter.readArray<uint8_t>(numBlocks());
+        blockOffset = reconstituter.readArray<uint64_t>(numBlocks());
+        storage = reconstituter.readArray<uint64_t>(numWords);
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<uint8_t>(hasNulls);
+        serializer.writePod<uint64_t>(numWords);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writeArray(blockBase.get(), numBlocks());
+        serializer.writeArray(blockMinDelta.get(), delta ? numBlocks() : 0);
+        serializer.writeArray(blockBits.get(), numBlocks());
+        serializer.writeArray(blockOffset.get(), numBlocks());
+        serializer.writeArray(storage.get(), numWords);
+    }
+
+    size_t numBlocks() const
+    {
+        return (numEntries + BLOCK_SIZE - 1) / BLOCK_SIZE;
+    }
+
+    virtual std::string format() const
+    {
+        return delta ? "Delta" : "FrameOfReference";
+    }
+
+    /** Decode the first n values of the given block into vals.  Null
+        values are marked in isNull.  Returns the number of rows in the
+        block.
+    */
+    size_t decodeBlock(size_t block, int64_t * vals, uint8_t * isNull,
+                       size_t n = BLOCK_SIZE) const
+    {
+        size_t start = block * BLOCK_SIZE;
+        n = std::min<size_t>(n, numEntries - start);
+        int bits = blockBits.get()[block];
+        int64_t base = blockBase.get()[block];
+
+        ML::Bit_Extractor<uint64_t> extractor(storage.get());
+        if (bits != 0)
+            extractor.advance(blockOffset.get()[block]);
+        auto next = [&] () -> uint64_t
+            {
+                return bits == 0 ? 0 : extractor.extract<uint64_t>(bits);
+            };
+
+        if (delta) {
+            int64_t minDelta = blockMinDelta.get()[block];
+            int64_t val = base;
+            for (size_t i = 0;  i < n;  ++i) {
+                uint64_t code = next();
+                if (i != 0)
+                    val += minDelta + (int64_t)code;
+                vals[i] = val;
+                isNull[i] = false;
+            }
+        }
+        else {
+            for (size_t i = 0;  i < n;  ++i) {
+                uint64_t code = next();
+                isNull[i] = hasNulls && code == 0;
+                vals[i] = base + (int64_t)code - hasNulls;
+            }
+        }
+
+        return n;
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        int64_t vals[BLOCK_SIZE];
+        uint8_t isNull[BLOCK_SIZE];
+
+        for (size_t b = 0;  b < numBlocks();  ++b) {
+            size_t n = decodeBlock(b, vals, isNull);
+            for (size_t i = 0;  i < n;  ++i) {
+                size_t rowNum = b * BLOCK_SIZE + i + firstEntry;
+                if (isNull[i]) {
+                    if (keepNulls && !onRow(rowNum, CellValue()))
+                        return false;
+                }
+                else if (!onRow(rowNum, vals[i]))
+                    return false;
+            }
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+
+        size_t block = rowIndex / BLOCK_SIZE;
+        size_t pos = rowIndex % BLOCK_SIZE;
+        int bits = blockBits.get()[block];
+
+        if (delta) {
+            // Need the values before it in the block
+            int64_t vals[BLOCK_SIZE];
+            uint8_t isNull[BLOCK_SIZE];
+            decodeBlock(block, vals, isNull, pos + 1);
+            return result = vals[pos];
+        }
+
+        uint64_t code = 0;
+        if (bits != 0) {
+            ML::Bit_Extractor<uint64_t> extractor(storage.get());
+            extractor.advance(blockOffset.get()[block] + pos * bits);
+            code = extractor.extract<uint64_t>(bits);
+        }
+        if (hasNulls && code == 0)
+            return result;
+        return result = blockBase.get()[block] + (int64_t)code - hasNulls;
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this)
+            + numBlocks() * (sizeof(int64_t) + 1 + sizeof(uint64_t))
+            + (delta ? numBlocks() * sizeof(int64_t) : 0)
+            + numWords * 8;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        // Handle nulls first so we don't have to do them later
+        if (hasNulls && !fn(CellValue()))
+            return false;
+
+        std::vector<int64_t> allVals;
+        allVals.reserve(numEntries);
+
+        auto onRow = [&] (size_t rowNum, const CellValue & val)
+            {
+                allVals.push_back(val.toInt());
+                return true;
+            };
+        forEach(onRow);
+
+        std::sort(allVals.begin(), allVals.end());
+        auto endIt = std::unique(allVals.begin(), allVals.end());
+
+        for (auto it = allVals.begin();  it != endIt;  ++it) {
+            if (!fn(*it))
+                return false;
+        }
+
+        return true;
+    }
+
+    std::shared_ptr<const uint64_t> storage;
+    std::shared_ptr<const int64_t> blockBase;     ///< Lowest or first value
+    std::shared_ptr<const int64_t> blockMinDelta; ///< Only for delta
+    std::shared_ptr<const uint8_t> blockBits;     ///< Bits per row
+    std::shared_ptr<const uint64_t> blockOffset;  ///< Bit offset in storage
+    uint64_t numWords;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+    bool delta;
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+};
+
+/// Format for one of the two encodings of PackedIntegerFrozenColumn
+template<bool Delta>
+struct PackedIntegerFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~PackedIntegerFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return Delta ? "Delta" : "FrameOfReference";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        return column.columnTypes.onlyIntegersAndNulls()
+            && (!Delta || column.sparseIndexes.size()
+                == column.maxRowNumber - column.minRowNumber + 1);
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<PackedIntegerFrozenColumn::SizingInfo>
+            (column, Delta);
+        ssize_t result = *info;
+        cachedInfo = info;
+        return result == -1 ? CANT_STORE : result;
+    }
+
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        auto info = std::static_pointer_cast
+            <PackedIntegerFrozenColumn::SizingInfo>(cachedInfo);
+        if (!info)
+            info = std::make_shared<PackedIntegerFrozenColumn::SizingInfo>
+                (column, Delta);
+        return new PackedIntegerFrozenColumn(column, *info);
+    }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const PackedIntegerFrozenColumn &>(column)
+            .serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new PackedIntegerFrozenColumn(reconstituter, Delta);
+    }
+};
+
+RegisterFrozenColumnFormatT<PackedIntegerFrozenColumnFormat<false> >
+regFrameOfReference;
+RegisterFrozenColumnFormatT<PackedIntegerFrozenColumnFormat<true> >
+regDelta;
+
+
+/*****************************************************************************/
+/* FRONT CODED FROZEN COLUMN                                                 */
+/*****************************************************************************/
+
+namespace {
+
+void writeVarint(std::string & out, uint64_t val)
+{
+    while (val >= 128) {
+        out.push_back((char)(val | 128));
+        val >>= 7;
+    }
+    out.push_back((char)val);
+}
+
+uint64_t readVarint(const char * & p)
+{
+    uint64_t result = 0;
+    for (int shift = 0;;  shift += 7) {
+        uint8_t c = *p++;
+        result |= (uint64_t)(c & 127) << shift;
+        if (!(c & 128))
+            return result;
+    }
+}
+
+} // file scope
+
+/** Frozen column for strings, which looks up each value in a sorted
+    dictionary of the distinct strings like the table column.  The
+    dictionary is front coded: it's divided into buckets of consecutive
+    strings, and each string but the first of its bucket is stored as the
+    length of the prefix it shares with the one before and the rest of
+    its characters.  This makes it much smaller for strings with common
+    prefixes, like URLs or paths.
+*/
+struct FrontCodedFrozenColumn: public FrozenColumn {
+
+    /// Number of strings in each bucket of the dictionary
+    static constexpr size_t BUCKET_SIZE = 16;
+
+    struct SizingInfo {
+        SizingInfo(const TabularDatasetColumn & column)
+        {
+            const ColumnTypes & types = column.columnTypes;
+            if (types.numStrings == 0 || types.numIntegers || types.numReals
+                || types.numBlobs || types.numTimestamps || types.numOther)
+                return;  // can't use this column type
+
+            numEntries = column.maxRowNumber - column.minRowNumber + 1;
+            hasNulls = column.sparseIndexes.size() < numEntries;
+            indexBits = ML::highest_bit(column.indexedVals.size() + hasNulls) + 1;
+
+            // Sort the strings, and find the code of each one
+            size_t n = column.indexedVals.size();
+            std::vector<uint32_t> order(n);
+            for (size_t i = 0;  i < n;  ++i)
+                order[i] = i;
+            auto chars = [&] (uint32_t i) -> std::pair<const char *, size_t>
+                {
+                    const CellValue & v = column.indexedVals[i];
+                    return { v.stringChars(), v.toStringLength() };
+                };
+            auto compare = [&] (uint32_t i1, uint32_t i2)
+                {
+                    auto s1 = chars(i1), s2 = chars(i2);
+                    int res = std::memcmp(s1.first, s2.first,
+                                          std::min(s1.second, s2.second));
+                    return res < 0 || (res == 0 && s1.second < s2.second);
+                };
+            std::sort(order.begin(), order.end(), compare);
+
+            codes.resize(n);
+            bucketOffsets.reserve((n + BUCKET_SIZE - 1) / BUCKET_SIZE);
+            std::pair<const char *, size_t> last(nullptr, 0);
+            for (size_t i = 0;  i < n;  ++i) {
+                codes[order[i]] = i;
+                auto s = chars(order[i]);
+                size_t prefix = 0;
+                if (i % BUCKET_SIZE == 0) {
+                    bucketOffsets.push_back(dictionary.size());
+                }
+                else {
+                    size_t maxPrefix = std::min(s.second, last.second);
+                    while (prefix < maxPrefix
+                           && s.first[prefix] == last.first[prefix])
+                        ++prefix;
+                    writeVarint(dictionary, prefix);
+                }
+                writeVarint(dictionary, s.second - prefix);
+                dictionary.append(s.first + prefix, s.second - prefix);
+                last = s;
+            }
+
+            bytesRequired = sizeof(FrontCodedFrozenColumn)
+                + (indexBits * numEntries + 31) / 32 * 4
+                + bucketOffsets.size() * sizeof(uint64_t)
+                + dictionary.size();
+        }
+
+        operator ssize_t () const
+        {
+            return bytesRequired;
+        }
+
+        ssize_t bytesRequired = -1;
+        size_t numEntries;
+        bool hasNulls;
+        int indexBits;
+        std::vector<uint32_t> codes;  ///< Sorted position of each value
+        std::vector<uint64_t> bucketOffsets;
+        std::string dictionary;
+    };
+
+    FrontCodedFrozenColumn(TabularDatasetColumn & column,
+                           const SizingInfo & info)
+        : columnTypes(column.columnTypes)
+    {
+        ExcAssertNotEqual(info.bytesRequired, -1);
+        firstEntry = column.minRowNumber;
+        numEntries = info.numEntries;
+        hasNulls = info.hasNulls;
+        indexBits = info.indexBits;
+        numValues = column.indexedVals.size();
+        numBuckets = info.bucketOffsets.size();
+        dictionaryLength = info.dictionary.size();
+
+        uint64_t * offsets = new uint64_t[numBuckets];
+        std::copy(info.bucketOffsets.begin(), info.bucketOffsets.end(),
+                  offsets);
+        bucketOffsets = std::shared_ptr<uint64_t>
+            (offsets, [] (uint64_t * p) { delete[] p; });
+
+        char * dict = new char[dictionaryLength];
+        std::copy(info.dictionary.begin(), info.dictionary.end(), dict);
+        dictionary = std::shared_ptr<char>(dict, [] (char * p) { delete[] p; });
+
+        uint32_t * data = new uint32_t[numWords()];
+        std::fill(data, data + numWords(), 0);
+        storage = std::shared_ptr<uint32_t>(data, [] (uint32_t * p) { delete[] p; });
+
+        // As for the table column, nulls are left as a zero code
+        for (auto & r_i: column.sparseIndexes) {
+            ML::Bit_Writer<uint32_t> writer(data);
+            writer.skip(r_i.first * indexBits);
+            writer.write(info.codes[r_i.second] + hasNulls, indexBits);
+        }
+    }
+
+    FrontCodedFrozenColumn(FrozenColumnReconstituter & reconstituter)
+    {
+        indexBits = reconstituter.readPod<uint32_t>();
+        numEntries = reconstituter.readPod<uint32_t>();
+        firstEntry = reconstituter.readPod<uint64_t>();
+        hasNulls = reconstituter.readPod<uint8_t>();
+        columnTypes = reconstituter.readColumnTypes();
+        numValues = reconstituter.readPod<uint64_t>();
+        numBuckets = reconstituter.readPod<uint64_t>();
+        dictionaryLength = reconstituter.readPod<uint64_t>();
+        bucketOffsets = reconstituter.readArray<uint64_t>(numBuckets);
+        dictionary = reconstituter.readArray<char>(dictionaryLength);
+        storage = reconstituter.readArray<uint32_t>(numWords());
+    }
+
+    void serialize(FrozenColumnSerializer & serializer) const
+    {
+        serializer.writePod<uint32_t>(indexBits);
+        serializer.writePod<uint32_t>(numEntries);
+        serializer.writePod<uint64_t>(firstEntry);
+        serializer.writePod<uint8_t>(hasNulls);
+        serializer.writeColumnTypes(columnTypes);
+        serializer.writePod<uint64_t>(numValues);
+        serializer.writePod<uint64_t>(numBuckets);
+        serializer.writePod<uint64_t>(dictionaryLength);
+        serializer.writeArray(bucketOffsets.get(), numBuckets);
+        serializer.writeArray(dictionary.get(), dictionaryLength);
+        serializer.writeArray(storage.get(), numWords());
+    }
+
+    size_t numWords() const
+    {
+        return ((size_t)indexBits * numEntries + 31) / 32;
+    }
+
+    virtual std::string format() const
+    {
+        return "FrontCoded";
+    }
+
+    static CellValue makeValue(const std::string & str)
+    {
+        // This detects whether it's ASCII
+        return CellValue(str.data(), str.length(),
+                         STRING_IS_VALID_UTF8_NOT_ASCII);
+    }
+
+    /** Decode the first n strings of the given bucket, calling
+        onString(index, str) for each one.
+    */
+    template<typename Fn>
+    bool decodeBucket(size_t bucket, size_t n, Fn && onString) const
+    {
+        const char * p = dictionary.get() + bucketOffsets.get()[bucket];
+        size_t start = bucket * BUCKET_SIZE;
+        n = std::min<size_t>(n, numValues - start);
+        std::string str;
+        for (size_t i = 0;  i < n;  ++i) {
+            size_t prefix = i == 0 ? 0 : readVarint(p);
+            size_t suffix = readVarint(p);
+            str.resize(prefix);
+            str.append(p, suffix);
+            p += suffix;
+            if (!onString(start + i, str))
+                return false;
+        }
+        return true;
+    }
+
+    /// Return the value with the given dictionary index
+    CellValue getValue(size_t index) const
+    {
+        CellValue result;
+        auto onString = [&] (size_t i, const std::string & str)
+            {
+                if (i == index)
+                    result = makeValue(str);
+                return true;
+            };
+        decodeBucket(index / BUCKET_SIZE, index % BUCKET_SIZE + 1, onString);
+        return result;
+    }
+
+    /// Decode the whole dictionary, in order
+    std::vector<CellValue> getValues() const
+    {
+        std::vector<CellValue> result;
+        result.reserve(numValues);
+        auto onString = [&] (size_t i, const std::string & str)
+            {
+                result.emplace_back(makeValue(str));
+                return true;
+            };
+        for (size_t b = 0;  b < numBuckets;  ++b)
+            decodeBucket(b, BUCKET_SIZE, onString);
+        return result;
+    }
+
+    bool forEachImpl(const ForEachRowFn & onRow, bool keepNulls) const
+    {
+        // Decode the dictionary once rather than once per row
+        std::vector<CellValue> table = getValues();
+
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            int index = bits.extract<uint32_t>(indexBits);
+
+            CellValue val;
+            if (hasNulls) {
+                if (index > 0)
+                    val = table[index - 1];
+                else if (!keepNulls)
+                    continue;  // skip nulls
+            }
+            else {
+                val = table[index];
+            }
+
+            if (!onRow(i + firstEntry, val))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual bool forEach(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, false /* keep nulls */);
+    }
+
+    virtual bool forEachDense(const ForEachRowFn & onRow) const
+    {
+        return forEachImpl(onRow, true /* keep nulls */);
+    }
+
+    virtual CellValue get(uint32_t rowIndex) const
+    {
+        CellValue result;
+        if (rowIndex < firstEntry)
+            return result;
+        rowIndex -= firstEntry;
+        if (rowIndex >= numEntries)
+            return result;
+        ML::Bit_Extractor<uint32_t> bits(storage.get());
+        bits.advance(rowIndex * indexBits);
+        uint32_t index = bits.extract<uint32_t>(indexBits);
+        if (hasNulls) {
+            if (index == 0)
+                return result;
+            --index;
+        }
+        return getValue(index);
+    }
+
+    virtual size_t size() const
+    {
+        return numEntries;
+    }
+
+    virtual size_t memusage() const
+    {
+        return sizeof(*this)
+            + numWords() * 4
+            + numBuckets * sizeof(uint64_t)
+            + dictionaryLength;
+    }
+
+    virtual bool
+    forEachDistinctValue(std::function<bool (const CellValue &)> fn) const
+    {
+        if (hasNulls) {
+            if (!fn(CellValue()))
+                return false;
+        }
+
+        auto onString = [&] (size_t i, const std::string & str)
+            {
+                return fn(makeValue(str));
+            };
+        for (size_t b = 0;  b < numBuckets;  ++b) {
+            if (!decodeBucket(b, BUCKET_SIZE, onString))
+                return false;
+        }
+
+        return true;
+    }
+
+    virtual void filter(const FrozenColumnPredicate & predicate,
+                        std::vector<uint8_t> & keep) const override
+    {
+        bool nullMatches = predicate.matches(CellValue());
+        std::vector<uint8_t> codeMatches;
+        codeMatches.reserve(numValues + hasNulls);
+        if (hasNulls)
+            codeMatches.push_back(nullMatches);
+        auto onString = [&] (size_t i, const std::string & str)
+            {
+                codeMatches.push_back(predicate.matches(makeValue(str)));
+                return true;
+            };
+        for (size_t b = 0;  b < numBuckets;  ++b)
+            decodeBucket(b, BUCKET_SIZE, onString);
+
+        filterCodes(storage.get(), indexBits, firstEntry, numEntries,
+                    hasNulls, codeMatches, nullMatches, keep);
+    }
+
+    std::shared_ptr<const uint32_t> storage;
+    std::shared_ptr<const uint64_t> bucketOffsets;
+    std::shared_ptr<const char> dictionary;
+    uint64_t numValues;
+    uint64_t numBuckets;
+    uint64_t dictionaryLength;
+    uint32_t indexBits;
+    uint32_t numEntries;
+    uint64_t firstEntry;
+
+    bool hasNulls;
+    ColumnTypes columnTypes;
+
+    virtual ColumnTypes getColumnTypes() const
+    {
+        return columnTypes;
+    }
+};
+
+struct FrontCodedFrozenColumnFormat: public FrozenColumnFormat {
+
+    virtual ~FrontCodedFrozenColumnFormat()
+    {
+    }
+
+    virtual std::string format() const override
+    {
+        return "FrontCoded";
+    }
+
+    virtual bool isFeasible(const TabularDatasetColumn & column,
+                            const ColumnFreezeParameters & params,
+                            std::shared_ptr<void> & cachedInfo) const override
+    {
+        const ColumnTypes & types = column.columnTypes;
+        return types.numStrings && !types.numIntegers && !types.numReals
+            && !types.numBlobs && !types.numTimestamps && !types.numOther;
+    }
+
+    virtual ssize_t columnSize(const TabularDatasetColumn & column,
+                               const ColumnFreezeParameters & params,
+                               ssize_t previousBest,
+                               std::shared_ptr<void> & cachedInfo) const override
+    {
+        auto info = std::make_shared<FrontCodedFrozenColumn::SizingInfo>(column);
+        ssize_t result = *info;
+        cachedInfo = info;
+        return result == -1 ? CANT_STORE : result;
+    }
+
+    virtual FrozenColumn *
+    freeze(TabularDatasetColumn & column,
+           const ColumnFreezeParameters & params,
+           std::shared_ptr<void> cachedInfo) const override
+    {
+        auto info = std::static_pointer_cast
+            <FrontCodedFrozenColumn::SizingInfo>(cachedInfo);
+        if (!info)
+            info = std::make_shared<FrontCodedFrozenColumn::SizingInfo>(column);
+        return new FrontCodedFrozenColumn(column, *info);
+    }
+
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const override
+    {
+        dynamic_cast<const FrontCodedFrozenColumn &>(column)
+            .serialize(serializer);
+    }
+
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const override
+    {
+        return new FrontCodedFrozenColumn(reconstituter);
+    }
+};
+
+RegisterFrozenColumnFormatT<FrontCodedFrozenColumnFormat> regFrontCoded;
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN FORMAT                                                      */
+/*****************************************************************************/
+
+namespace {
+
+typedef std::map<std::string, std::shared_ptr<FrozenColumnFormat> > Formats;
+
+atomic_shared_ptr<const Formats> & getFormats()
+{
+    static atomic_shared_ptr<const Formats> formats
+        (std::make_shared<Formats>());
+    return formats;
+}
+
+
+} // file scope
+
+FrozenColumnFormat::
+~FrozenColumnFormat()
+{
+}
+
+std::shared_ptr<void>
+FrozenColumnFormat::
+registerFormat(std::shared_ptr<FrozenColumnFormat> format)
+{
+    std::string name = format->format();
+    auto & formats = getFormats();
+    for (;;) {
+        auto ptr = formats.load();
+        if (ptr->count(name)) {
+            throw HttpReturnException
+                (500, "Attempt to double-register frozen column format "
+                 + name);
+        }
+        auto newFormats = *ptr;
+        newFormats.emplace(name, format);
+        auto newFormatsPtr
+            = std::make_shared<Formats>(std::move(newFormats));
+        if (formats.compare_exchange_strong(ptr, newFormatsPtr)) {
+
+            auto deregister = [name] (void *)
+                {
+                    auto & formats = getFormats();
+                    for (;;) {
+                        auto ptr = formats.load();
+                        auto newFormats = *ptr;
+                        newFormats.erase(name);
+                        auto newFormatsPtr
+                            = std::make_shared<Formats>(std::move(newFormats));
+                        if (formats.compare_exchange_strong(ptr, newFormatsPtr))
+                            break;
+                    }
+                };
+
+            return std::shared_ptr<void>(format.get(), deregister);
+        }
+    }
+}
+
+std::shared_ptr<const FrozenColumnFormat>
+FrozenColumnFormat::
+getFormat(const std::string & name)
+{
+    auto formats = getFormats().load();
+    auto it = formats->find(name);
+    if (it == formats->end()) {
+        throw HttpReturnException
+            (400, "Unknown frozen column format '" + name + "'",
+             "format", name);
+    }
+    return it->second;
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN                                                             */
+/*****************************************************************************/
+
+FrozenColumn::
+FrozenColumn()
+    : logger(getMldbLog<TabularDataset>()) // this class is only used by the tabular dataset
+{
+}
+
+std::pair<ssize_t, std::function<std::shared_ptr<FrozenColumn> (TabularDatasetColumn & column)> >
+FrozenColumnFormat::
+preFreeze(const TabularDatasetColumn & column,
+          const ColumnFreezeParameters & params)
+{
+    // Get the current list of formats
+    auto formats = getFormats().load();
+    
+    ssize_t bestBytes = FrozenColumnFormat::NOT_BEST;
+    const FrozenColumnFormat * bestFormat = nullptr;
+    std::shared_ptr<void> bestData;
+
+    for (auto & f: *formats) {
+        std::shared_ptr<void> data;
+        if (f.second->isFeasible(column, params, data)) {
+            ssize_t bytes = f.second->columnSize(column, params, bestBytes,
+                                                 data);
+            if (bytes >= 0 && (bestBytes < 0 || bytes < bestBytes)) {
+                bestFormat = f.second.get();
+                bestData = std::move(data);
+                bestBytes = bytes;
+            }
+        }
+    }
+
+    if (bestFormat) {
+        return std::make_pair(bestBytes,
+                              [=] (TabularDatasetColumn & column)
+                              {
+                                  return std::shared_ptr<FrozenColumn>
+                                      (bestFormat->freeze(column, params, bestData));
+                              }
+                              );
+    }
+    
+    return std::make_pair(FrozenColumnFormat::NOT_BEST, nullptr);
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumn::
+freeze(TabularDatasetColumn & column,
+       const ColumnFreezeParameters & params)
+{
+    ExcAssert(!column.isFrozen);
+    auto res = FrozenColumnFormat::preFreeze(column, params);
     if (!res.second) {
         throw HttpReturnException(500, "No column format found for column");
     }
     return res.second(column);
 }
 
+void
+FrozenColumn::
+filter(const FrozenColumnPredicate & predicate,
+       std::vector<uint8_t> & keep) const
+{
+    // Rows that forEach() doesn't visit are null
+    std::vector<uint8_t> matched(keep.size(),
+                                 predicate.matches(CellValue()));
+
+    auto onRow = [&] (size_t rowNum, const CellValue & val)
+        {
+            if (rowNum < matched.size())
+                matched[rowNum] = predicate.matches(val);
+            return true;
+        };
+
+    forEach(onRow);
+
+    for (size_t i = 0;  i < keep.size();  ++i)
+        keep[i] = keep[i] && matched[i];
+}
+
+
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+void
+ColumnZoneMap::
+update(const CellValue & val)
+{
+    ExcAssert(!val.empty());
+    if (minValue.empty() || val < minValue)
+        minValue = val;
+    if (maxValue.empty() || maxValue < val)
+        maxValue = val;
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN PREDICATE                                                   */
+/*****************************************************************************/
+
+bool
+FrozenColumnPredicate::
+matches(const CellValue & val) const
+{
+    if (val.empty())
+        return op == IS_NULL;
+
+    switch (op) {
+    case EQUAL:
+        for (auto & v: values) {
+            if (val == v)
+                return true;
+        }
+        return false;
+    case LESS:           return val < values.at(0);
+    case LESS_EQUAL:     return !(values.at(0) < val);
+    case GREATER:        return values.at(0) < val;
+    case GREATER_EQUAL:  return !(val < values.at(0));
+    case IS_NULL:        return false;
+    case IS_NOT_NULL:    return true;
+    }
+
+    throw HttpReturnException(500, "Unknown frozen column predicate");
+}
+
+bool
+FrozenColumnPredicate::
+mayMatch(const ColumnZoneMap & zoneMap, size_t numRows) const
+{
+    switch (op) {
+    case IS_NULL:      return zoneMap.numNulls > 0;
+    case IS_NOT_NULL:  return zoneMap.numNulls < numRows;
+    default:           break;
+    }
+
+    if (!zoneMap.hasValues())
+        return false;
+
+    // Values that compare equal are in the same place in the ordering, so
+    // can only be found between the minimum and the maximum
+    switch (op) {
+    case EQUAL:
+        for (auto & v: values) {
+            if (!(v < zoneMap.minValue) && !(zoneMap.maxValue < v))
+                return true;
+        }
+        return false;
+    case LESS:           return zoneMap.minValue < values.at(0);
+    case LESS_EQUAL:     return !(values.at(0) < zoneMap.minValue);
+    case GREATER:        return values.at(0) < zoneMap.maxValue;
+    case GREATER_EQUAL:  return !(zoneMap.maxValue < values.at(0));
+    default:             break;
+    }
+
+    throw HttpReturnException(500, "Unknown frozen column predicate");
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN SERIALIZER                                                  */
+/*****************************************************************************/
+
+FrozenColumnSerializer::
+FrozenColumnSerializer(std::ostream & stream)
+    : stream(stream), offset_(0)
+{
+}
+
+void
+FrozenColumnSerializer::
+align(size_t alignment)
+{
+    static const char zeros[64] = { 0 };
+    ExcAssertLessEqual(alignment, sizeof(zeros));
+    size_t padding = (alignment - offset_ % alignment) % alignment;
+    stream.write(zeros, padding);
+    offset_ += padding;
+}
+
+void
+FrozenColumnSerializer::
+writeBytes(const void * data, size_t length, size_t alignment)
+{
+    align(alignment);
+    stream.write((const char *)data, length);
+    offset_ += length;
+}
+
+void
+FrozenColumnSerializer::
+writeString(const char * data, size_t length)
+{
+    writePod<uint64_t>(length);
+    writeBytes(data, length);
+}
+
+void
+FrozenColumnSerializer::
+writeString(const std::string & str)
+{
+    writeString(str.data(), str.length());
+}
+
+void
+FrozenColumnSerializer::
+writeString(const Utf8String & str)
+{
+    writeString(str.rawData(), str.rawLength());
+}
+
+void
+FrozenColumnSerializer::
+writePath(const Path & path)
+{
+    writePod<uint32_t>(path.size());
+    for (size_t i = 0;  i < path.size();  ++i)
+        writeString(path[i].toUtf8String());
+}
+
+void
+FrozenColumnSerializer::
+writeCellValue(const CellValue & val)
+{
+    auto type = val.cellType();
+    writePod<uint8_t>(type);
+
+    switch (type) {
+    case CellValue::EMPTY:
+        return;
+    case CellValue::INTEGER:
+        writePod<uint8_t>(val.isInt64());
+        if (val.isInt64())
+            writePod<int64_t>(val.toInt());
+        else writePod<uint64_t>(val.toUInt());
+        return;
+    case CellValue::FLOAT:
+        writePod<double>(val.toDouble());
+        return;
+    case CellValue::ASCII_STRING:
+    case CellValue::UTF8_STRING:
+        writeString(val.stringChars(), val.toStringLength());
+        return;
+    case CellValue::TIMESTAMP:
+        writePod<double>(val.toTimestamp().secondsSinceEpoch());
+        return;
+    case CellValue::TIMEINTERVAL: {
+        int64_t months, days;
+        double seconds;
+        std::tie(months, days, seconds) = val.toMonthDaySecond();
+        writePod<int64_t>(months);
+        writePod<int64_t>(days);
+        writePod<double>(seconds);
+        return;
+    }
+    case CellValue::BLOB:
+        writeString((const char *)val.blobData(), val.blobLength());
+        return;
+    case CellValue::PATH:
+        writePath(val.coerceToPath());
+        return;
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw HttpReturnException(500, "Can't serialize unknown cell type",
+                              "value", val);
+}
+
+void
+FrozenColumnSerializer::
+writeColumnTypes(const ColumnTypes & types)
+{
+    writePod<uint64_t>(types.numNulls);
+    writePod<uint64_t>(types.numZeros);
+    writePod<uint64_t>(types.numIntegers);
+    writePod<int64_t>(types.minNegativeInteger);
+    writePod<int64_t>(types.maxNegativeInteger);
+    writePod<uint64_t>(types.minPositiveInteger);
+    writePod<uint64_t>(types.maxPositiveInteger);
+    writePod<uint64_t>(types.numReals);
+    writePod<uint64_t>(types.numStrings);
+    writePod<uint64_t>(types.numBlobs);
+    writePod<uint64_t>(types.numTimestamps);
+    writePod<uint64_t>(types.numOther);
+}
+
+void
+FrozenColumnSerializer::
+writeColumn(const FrozenColumn & column)
+{
+    std::string format = column.format();
+    writeString(format);
+    FrozenColumnFormat::getFormat(format)->serialize(column, *this);
+}
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN RECONSTITUTER                                               */
+/*****************************************************************************/
+
+FrozenColumnReconstituter::
+FrozenColumnReconstituter(const char * start, size_t length,
+                          std::shared_ptr<const void> handle)
+    : start(start), current(start), end(start + length),
+      handle(std::move(handle))
+{
+}
+
+void
+FrozenColumnReconstituter::
+align(size_t alignment)
+{
+    size_t padding = (alignment - offset() % alignment) % alignment;
+    readBytes(padding);
+}
+
+const char *
+FrozenColumnReconstituter::
+readBytes(size_t length, size_t alignment)
+{
+    if (alignment > 1)
+        align(alignment);
+    if (length > (size_t)(end - current)) {
+        throw HttpReturnException
+            (400, "Frozen column data is truncated or corrupt",
+             "offset", offset(), "length", length,
+             "available", (size_t)(end - current));
+    }
+    const char * result = current;
+    current += length;
+    return result;
+}
+
+void
+FrozenColumnReconstituter::
+checkCount(uint64_t n, size_t itemBytes) const
+{
+    size_t available = end - current;
+    if (itemBytes > 0 && n > available / itemBytes) {
+        throw HttpReturnException
+            (400, "Frozen column data is truncated or corrupt",
+             "offset", offset(), "count", n, "itemBytes", itemBytes,
+             "available", available);
+    }
+}
+
+uint64_t
+FrozenColumnReconstituter::
+readCount(size_t minItemBytes)
+{
+    uint64_t result = readPod<uint64_t>();
+    checkCount(result, minItemBytes);
+    return result;
+}
+
+std::string
+FrozenColumnReconstituter::
+readString()
+{
+    uint64_t length = readPod<uint64_t>();
+    const char * data = readBytes(length);
+    return std::string(data, data + length);
+}
+
+Path
+FrozenColumnReconstituter::
+readPath()
+{
+    uint32_t length = readPod<uint32_t>();
+    PathBuilder builder;
+    for (uint32_t i = 0;  i < length;  ++i)
+        builder.add(PathElement(Utf8String(readString())));
+    return builder.extract();
+}
+
+CellValue
+FrozenColumnReconstituter::
+readCellValue()
+{
+    auto type = (CellValue::CellType)readPod<uint8_t>();
+
+    switch (type) {
+    case CellValue::EMPTY:
+        return CellValue();
+    case CellValue::INTEGER:
+        if (readPod<uint8_t>())
+            return readPod<int64_t>();
+        else return readPod<uint64_t>();
+    case CellValue::FLOAT:
+        return readPod<double>();
+    case CellValue::ASCII_STRING:
+        return readString();
+    case CellValue::UTF8_STRING:
+        return Utf8String(readString());
+    case CellValue::TIMESTAMP:
+        return Date::fromSecondsSinceEpoch(readPod<double>());
+    case CellValue::TIMEINTERVAL: {
+        int64_t months = readPod<int64_t>();
+        int64_t days = readPod<int64_t>();
+        double seconds = readPod<double>();
+        return CellValue::fromMonthDaySecond(months, days, seconds);
+    }
+    case CellValue::BLOB:
+        return CellValue::blob(readString());
+    case CellValue::PATH:
+        return readPath();
+    case CellValue::NUM_CELL_TYPES:
+        break;
+    }
+
+    throw HttpReturnException(400, "Frozen column data has unknown cell type",
+                              "type", (int)type, "offset", offset());
+}
+
+ColumnTypes
+FrozenColumnReconstituter::
+readColumnTypes()
+{
+    ColumnTypes result;
+    result.numNulls = readPod<uint64_t>();
+    result.numZeros = readPod<uint64_t>();
+    result.numIntegers = readPod<uint64_t>();
+    result.minNegativeInteger = readPod<int64_t>();
+    result.maxNegativeInteger = readPod<int64_t>();
+    result.minPositiveInteger = readPod<uint64_t>();
+    result.maxPositiveInteger = readPod<uint64_t>();
+    result.numReals = readPod<uint64_t>();
+    result.numStrings = readPod<uint64_t>();
+    result.numBlobs = readPod<uint64_t>();
+    result.numTimestamps = readPod<uint64_t>();
+    result.numOther = readPod<uint64_t>();
+    return result;
+}
+
+std::shared_ptr<FrozenColumn>
+FrozenColumnReconstituter::
+readColumn()
+{
+    std::string format = readString();
+    return std::shared_ptr<FrozenColumn>
+        (FrozenColumnFormat::getFormat(format)->reconstitute(*this));
+}
+
 
 } // namespace MLDB
 
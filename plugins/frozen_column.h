@@ -12,11 +12,141 @@
 #include "mldb/utils/log.h"
 #include "mldb/plugins/tabular_dataset.h"
 #include <memory>
+#include <iosfwd>
+#include <cstring>
 
 
 namespace MLDB {
 
 struct TabularDatasetColumn;
+struct FrozenColumn;
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN SERIALIZER                                                  */
+/*****************************************************************************/
+
+/** Writes frozen columns (and the structures around them) to a binary
+    stream, in a layout that can be read back from a memory mapping
+    without copying the bulk data.
+
+    All offsets are relative to the start of the stream, which is
+    assumed to be page aligned once it's mapped back into memory.
+*/
+
+struct FrozenColumnSerializer {
+    FrozenColumnSerializer(std::ostream & stream);
+
+    /// Pad with zeros until the offset is a multiple of alignment
+    void align(size_t alignment);
+
+    /// Write the given bytes, aligned as requested
+    void writeBytes(const void * data, size_t length, size_t alignment = 1);
+
+    /// Write the given fixed size value
+    template<typename T>
+    void writePod(const T & val)
+    {
+        writeBytes(&val, sizeof(val));
+    }
+
+    /// Write an array of fixed size values, aligned for zero-copy reading
+    template<typename T>
+    void writeArray(const T * data, size_t n)
+    {
+        writeBytes(data, n * sizeof(T), 8);
+    }
+
+    void writeString(const char * data, size_t length);
+    void writeString(const std::string & str);
+    void writeString(const Utf8String & str);
+
+    void writePath(const Path & path);
+    void writeCellValue(const CellValue & val);
+    void writeColumnTypes(const ColumnTypes & types);
+
+    /// Write the given column, including the name of its format
+    void writeColumn(const FrozenColumn & column);
+
+    /// Number of bytes written so far
+    uint64_t offset() const { return offset_; }
+
+private:
+    std::ostream & stream;
+    uint64_t offset_;
+};
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN RECONSTITUTER                                               */
+/*****************************************************************************/
+
+/** Reads back what was written by a FrozenColumnSerializer from a block of
+    memory, typically a read-only mapping of the file.  Arrays are returned
+    as pointers into the block which share ownership of it, so that the
+    columns which use them keep the mapping alive.
+
+    Any attempt to read past the end of the block throws, so a truncated
+    or corrupt file can't cause an out of bounds access.
+*/
+
+struct FrozenColumnReconstituter {
+    FrozenColumnReconstituter(const char * start, size_t length,
+                              std::shared_ptr<const void> handle);
+
+    void align(size_t alignment);
+
+    /// Return a pointer to the next length bytes, aligned as requested
+    const char * readBytes(size_t length, size_t alignment = 1);
+
+    template<typename T>
+    T readPod()
+    {
+        T result;
+        std::memcpy(&result, readBytes(sizeof(T)), sizeof(T));
+        return result;
+    }
+
+    /** Read a count of items which are each stored in at least
+        minItemBytes bytes, and throw if there isn't room left for that
+        many.  This stops a corrupt count from being used to size a
+        container before the items themselves are read.
+    */
+    uint64_t readCount(size_t minItemBytes);
+
+    /// Return the next n values, in place, sharing ownership of the block
+    template<typename T>
+    std::shared_ptr<const T> readArray(size_t n)
+    {
+        checkCount(n, sizeof(T));
+        const char * data = readBytes(n * sizeof(T), 8);
+        return std::shared_ptr<const T>(handle,
+                                        reinterpret_cast<const T *>(data));
+    }
+
+    std::string readString();
+    Path readPath();
+    CellValue readCellValue();
+    ColumnTypes readColumnTypes();
+
+    /// Read a column written with FrozenColumnSerializer::writeColumn()
+    std::shared_ptr<FrozenColumn> readColumn();
+
+    /// Number of bytes read so far
+    uint64_t offset() const { return current - start; }
+
+    /// Are we at the end of the data?
+    bool eof() const { return current == end; }
+
+private:
+    /// Throw if n items of itemBytes bytes don't fit in what's left
+    void checkCount(uint64_t n, size_t itemBytes) const;
+
+    const char * start;
+    const char * current;
+    const char * end;
+    std::shared_ptr<const void> handle;
+};
 
 
 /*****************************************************************************/
@@ -28,6 +158,76 @@ struct ColumnFreezeParameters {
 };
 
 
+/*****************************************************************************/
+/* COLUMN ZONE MAP                                                           */
+/*****************************************************************************/
+
+/** Summary of the values of a column within a chunk, recorded when the
+    chunk is frozen.  It allows a predicate on the column to rule out the
+    whole chunk without looking at any of its values.
+
+    The minimum and maximum use the ordering of CellValue, which is the
+    one used by the SQL comparison operators.
+*/
+
+struct ColumnZoneMap {
+    ColumnZoneMap()
+        : numNulls(0)
+    {
+    }
+
+    CellValue minValue;   ///< Lowest non-null value; null if there is none
+    CellValue maxValue;   ///< Highest non-null value; null if there is none
+    uint64_t numNulls;    ///< Number of rows of the chunk without a value
+
+    /// Does the column have any non-null value in the chunk?
+    bool hasValues() const { return !minValue.empty(); }
+
+    /// Widen the range to include the given non-null value
+    void update(const CellValue & val);
+};
+
+
+/*****************************************************************************/
+/* FROZEN COLUMN PREDICATE                                                   */
+/*****************************************************************************/
+
+/** A predicate on the value of a single column, simple enough to be
+    evaluated within a frozen column and checked against a zone map.
+    As in SQL, a null value matches nothing except IS_NULL.
+*/
+
+struct FrozenColumnPredicate {
+    enum Op {
+        EQUAL,          ///< Equal to one of the values (= or IN)
+        LESS,
+        LESS_EQUAL,
+        GREATER,
+        GREATER_EQUAL,
+        IS_NULL,
+        IS_NOT_NULL
+    };
+
+    FrozenColumnPredicate(Op op = EQUAL,
+                          std::vector<CellValue> values = {})
+        : op(op), values(std::move(values))
+    {
+    }
+
+    Op op;
+    std::vector<CellValue> values;  ///< Any number for EQUAL, else one
+
+    /// Does the given value match?
+    bool matches(const CellValue & val) const;
+
+    /** Could any row of a chunk of numRows rows with the given zone map
+        match?  This is conservative: it returns true unless it's sure
+        that no row can.
+    */
+    bool mayMatch(const ColumnZoneMap & zoneMap, size_t numRows) const;
+};
+
+
 /*****************************************************************************/
 /* FROZEN COLUMN                                                             */
 /*****************************************************************************/
@@ -57,6 +257,19 @@ struct FrozenColumn {
 
     virtual ColumnTypes getColumnTypes() const = 0;
 
+    /** Clear the entries of keep, which has one per row of the chunk, for
+        the rows whose value doesn't match the predicate.  The default
+        tests each value; columns that can answer it more directly from
+        their encoding should override it.
+    */
+    virtual void filter(const FrozenColumnPredicate & predicate,
+                        std::vector<uint8_t> & keep) const;
+
+    /** Return the name of the FrozenColumnFormat that can serialize and
+        reconstitute this column.
+    */
+    virtual std::string format() const = 0;
+
     /** Freeze the given column into the best fitting frozen column type. */
     static std::shared_ptr<FrozenColumn>
     freeze(TabularDatasetColumn & column,
@@ -122,6 +335,22 @@ struct FrozenColumnFormat {
     freeze(TabularDatasetColumn & column,
            const ColumnFreezeParameters & params,
            std::shared_ptr<void> cachedInfo) const = 0;
+
+    /** Write the given column, which must have been created by this
+        format, so that reconstitute() can recreate it.  Bulk data should
+        be written as arrays so that it can be used in place from a
+        memory mapped file.
+    */
+    virtual void serialize(const FrozenColumn & column,
+                           FrozenColumnSerializer & serializer) const = 0;
+
+    /** Recreate a column written by serialize(). */
+    virtual FrozenColumn *
+    reconstitute(FrozenColumnReconstituter & reconstituter) const = 0;
+
+    /** Return the format with the given name, or throw if there is none. */
+    static std::shared_ptr<const FrozenColumnFormat>
+    getFormat(const std::string & name);
     
     /** Register a new column format.  Returns a handle that, once released,
         will de-register the column format.
@@ -12,6 +12,7 @@
 #include "mldb/base/parallel.h"
 #include "mldb/base/thread_pool.h"
 #include "mldb/plugins/for_each_line.h"
+#include "mldb/plugins/csv_scanner.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/sql/sql_expression.h"
@@ -573,31 +574,51 @@ parseFixedWidthCsvRow(const char * & line,
                     s[len++] = c;
                 };
 
-            for (; line < lineEnd;  ++line) {
-                const char c = *line;
-                if (c == quote) {
-                    ++line;
-                    if (line >= lineEnd) {
-                        ok = true;
-                        break;
-                    }
-                    else if (*line == separator) {
-                        ok = true;
-                        ++line;
-                        break;
-                    }
-                    else if (*line == quote) {
-                        // doubled quote; take a literal value
-                        pushChar(quote);
-                    }
-                    else {
-                        // Error
-                        errorMsg = "Garbage after closing quote";
-                        break;
+            // Add a run of characters that contains no quotes
+            auto pushChars = [&] (const char * chars, size_t n)
+                {
+                    if (len + n > buflen) {
+                        while (len + n > buflen)
+                            buflen *= 2;
+                        std::unique_ptr<char[]> newBuf(new char[buflen]);
+                        std::copy(s, s + len, newBuf.get());
+                        sdynamic.swap(newBuf);
+                        s = sdynamic.get();
                     }
+
+                    std::copy(chars, chars + n, s + len);
+                    len += n;
+                };
+
+            while (line < lineEnd) {
+                // Skip to the next quote, many characters at a time
+                const char * next
+                    = findCsvSpecial(line, lineEnd, quote, quote, eightBit);
+                pushChars(line, next - line);
+                line = next;
+
+                if (line == lineEnd)
+                    break;
+
+                ++line;
+                if (line >= lineEnd) {
+                    ok = true;
+                    break;
+                }
+                else if (*line == separator) {
+                    ok = true;
+                    ++line;
+                    break;
+                }
+                else if (*line == quote) {
+                    // doubled quote; take a literal value
+                    pushChar(quote);
+                    ++line;
                 }
                 else {
-                    pushChar(c);
+                    // Error
+                    errorMsg = "Garbage after closing quote";
+                    break;
                 }
             }
 
@@ -654,16 +675,20 @@ parseFixedWidthCsvRow(const char * & line,
             // likely a non-quoted string
 
             bool eightBit = !isascii(c);
-            size_t len = 1;
+            size_t len;
 
-            for (; line < lineEnd;  ++line, ++len) {
-                const char c = *line;
-                if (c == separator && !isTextLine) {
-                    ++line;
-                    break;
-                }
-                if (!isascii(c))
-                    eightBit = true;
+            if (isTextLine) {
+                // The rest of the line is the value
+                eightBit = eightBit || hasEightBitChars(line, lineEnd);
+                len = lineEnd - start;
+                line = lineEnd;
+            }
+            else {
+                line = findCsvSpecial(line, lineEnd, separator, separator,
+                                      eightBit);
+                len = line - start;
+                if (line < lineEnd)
+                    ++line;  // skip the separator
             }
 
             values[colNum++] = finishString(start, len, eightBit);
@@ -681,6 +681,11 @@ class mldb_wrapper(object):
             self.status_code = raw_response['statusCode']
             self.text        = raw_response.get('response', '')
             self.raw         = raw_response
+            if 'responseBase64' in raw_response:
+                import base64
+                self.content = base64.b64decode(raw_response['responseBase64'])
+            else:
+                self.content = self.text
 
             self.apparent_encoding = 'unimplemented'
             self.close             = 'unimplemented'
@@ -804,11 +809,15 @@ class mldb_wrapper(object):
         def delete_async(self, url):
             return self._perform('DELETE', url, [], {}, [['async', 'true']])
 
-        def query(self, query):
-            return self._perform('GET', '/v1/query', [], {
+        def query(self, query, format='table'):
+            res = self._perform('GET', '/v1/query', [], {
                 'q' : query,
-                'format' : 'table'
-            }).json()
+                'format' : format
+            })
+            if format == 'arrow':
+                # Arrow IPC stream; pyarrow.ipc.open_stream() reads it
+                return res.content
+            return res.json()
 
         def run_tests(self):
             import StringIO
@@ -1173,6 +1182,7 @@ struct AtInit {
 
         mldb.def("debugSetPathOptimizationLevel",
                  &MldbPythonContext::setPathOptimizationLevel);
+        mldb.def("debugGetEquiJoinCounts", debugGetEquiJoinCounts);
 
         /****
          *  Functions
@@ -12,7 +12,9 @@
 #include "mldb/vfs/fs_utils.h"
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/base/optimized_path.h"
+#include "mldb/sql/execution_pipeline_impl.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/hash.h"
 #include <boost/regex.hpp>
 #include <boost/algorithm/string.hpp>
 #include <memory>
@@ -410,8 +412,14 @@ perform(MldbPythonContext * mldbCon,
         }
         result["headers"] = headers;
     }
-    if (!connection.response.empty())
-        result["response"] = connection.response;
+    if (!connection.response.empty()) {
+        // Binary responses (like format=arrow queries) can't go through
+        // a Json::Value string, which stops at the first null character
+        if (connection.contentType == "application/octet-stream"
+            || connection.contentType.find("application/vnd.apache.arrow") == 0)
+            result["responseBase64"] = base64Encode(connection.response);
+        else result["response"] = connection.response;
+    }
 
     return result;
 }
@@ -482,6 +490,19 @@ getHttpBoundAddress(MldbPythonContext * mldbCon)
     return mldbCon->getPyContext()->server->httpBoundAddress;
 }
 
+Json::Value
+debugGetEquiJoinCounts(MldbPythonContext * mldbCon)
+{
+    Json::Value result;
+    result["merge"] = (Json::UInt)
+        JoinElement::numEquiJoinsStarted(JoinElement::MERGE_JOIN);
+    result["hashBuildLeft"] = (Json::UInt)
+        JoinElement::numEquiJoinsStarted(JoinElement::HASH_BUILD_LEFT);
+    result["hashBuildRight"] = (Json::UInt)
+        JoinElement::numEquiJoinsStarted(JoinElement::HASH_BUILD_RIGHT);
+    return result;
+}
+
 
 /****************************************************************************/
 /* PYTHON CONTEXT                                                           */
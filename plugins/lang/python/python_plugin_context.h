@@ -200,6 +200,12 @@ ls(MldbPythonContext * mldbCon,
 std::string
 getHttpBoundAddress(MldbPythonContext * mldbCon);
 
+/** Return the number of equijoins that were started with each strategy,
+    so that tests can check the plan that a query was given.
+*/
+Json::Value
+debugGetEquiJoinCounts(MldbPythonContext * mldbCon);
+
 
 
 /****************************************************************************/
@@ -71,6 +71,13 @@ addRow(int rowNum, const distribution<float> & coords)
     ExcAssert(isfinite(sum_dist.back()));
 }
 
+DistanceMetric *
+EuclideanDistanceMetric::
+clone() const
+{
+    return new EuclideanDistanceMetric(*this);
+}
+
 float
 EuclideanDistanceMetric::
 calc(const distribution<float> & coords1,
@@ -169,6 +176,13 @@ addRow(int rowNum, const distribution<float> & coords)
     two_norm_recip.push_back(recip);
 }
 
+DistanceMetric *
+CosineDistanceMetric::
+clone() const
+{
+    return new CosineDistanceMetric(*this);
+}
+
 float
 CosineDistanceMetric::
 calc(const distribution<float> & coords1,
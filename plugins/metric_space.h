@@ -11,6 +11,7 @@
 
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/jml/stats/distribution.h"
+#include "mldb/plugins/shared_chunked_vector.h"
 
 
 namespace MLDB {
@@ -36,6 +37,12 @@ struct DistanceMetric {
     /** Add a row, caching information about it. */
     virtual void addRow(int rowNum, const distribution<float> & coords) = 0;
 
+    /** Return a copy of the metric.  The information cached about the
+        existing rows is shared with the copy rather than duplicated, so
+        this is cheap even for many rows.
+    */
+    virtual DistanceMetric * clone() const = 0;
+
     /** Calculate the distance between two rows.  If either of them have
         a known number, it is passed in rowNum, otherwise that rowNum
         will be -1.
@@ -57,13 +64,15 @@ struct EuclideanDistanceMetric: public DistanceMetric {
 
     void addRow(int rowNum, const distribution<float> & coords);
 
+    DistanceMetric * clone() const;
+
     float dist(int rowNum1, int rowNum2,
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
     /// Pre cached ||vec||^2 for each row, to allow optimization of the
     /// calculation.
-    std::vector<double> sum_dist;
+    SharedChunkedVector<double> sum_dist;
 
     /// Static method to perform the calculation, with no caching
     static float calc(const distribution<float> & coords1,
@@ -79,13 +88,15 @@ struct CosineDistanceMetric: public DistanceMetric {
 
     void addRow(int rowNum, const distribution<float> & coords);
 
+    DistanceMetric * clone() const;
+
     float dist(int rowNum1, int rowNum2,
                const distribution<float> & coords1,
                const distribution<float> & coords2) const;
 
     /// Pre-cached reciprocal of the two norm of each vector, to allow
     /// optimization of the calculation.
-    std::vector<double> two_norm_recip;
+    SharedChunkedVector<double> two_norm_recip;
     
     /// Static method to perform the calculation, with no caching
     static float calc(const distribution<float> & coords1,
@@ -11,6 +11,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	metric_space.cc \
 	sqlite_dataset.cc \
 	sparse_matrix_dataset.cc \
+	sparse_matrix_storage.cc \
 	script_procedure.cc \
 	permuter_procedure.cc \
 	external_python_procedure.cc \
@@ -29,6 +30,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	ranking_procedure.cc \
 	fetcher.cc \
 	importtext_procedure.cc \
+	csv_scanner.cc \
 	tabular_dataset.cc \
 	frozen_column.cc \
 	column_types.cc \
@@ -51,6 +53,7 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	tfidf.cc \
 	tokensplit.cc \
 	script_function.cc \
+	python_worker_pool.cc \
 	useragent_function.cc \
 	summary_statistics_proc.cc \
 	csv_writer.cc \
@@ -59,9 +62,14 @@ LIBMLDB_BUILTIN_PLUGIN_SOURCES:= \
 	behavior_dataset.cc \
 	binary_behavior_dataset.cc
 
+ifeq ($(ARCH),x86_64)
+LIBMLDB_BUILTIN_PLUGIN_SOURCES += csv_scanner_avx2.cc
+endif
+
 # Needed so that Python plugin can find its header
 $(eval $(call set_compile_option,python_plugin_loader.cc,-I$(PYTHON_INCLUDE_PATH)))
 $(eval $(call set_compile_option,importtext_procedure.cc,-I$(RE2_INCLUDE_PATH)))
+$(eval $(call set_single_compile_option,csv_scanner_avx2.cc,-mavx2))
 
 $(eval $(call library,mldb_builtin_plugins,$(LIBMLDB_BUILTIN_PLUGIN_SOURCES),datacratic_sqlite ml mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins tsne svm libstemmer edlib algebra svdlibc uap re2 behavior))
 $(eval $(call library_forward_dependency,mldb_builtin_plugins,mldb_lang_plugins mldb_algo_plugins mldb_misc_plugins mldb_ui_plugins))
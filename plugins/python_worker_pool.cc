@@ -0,0 +1,434 @@
+/** python_worker_pool.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Pool of Python processes that run a script on behalf of parallel
+    callers.
+*/
+
+#include "python_worker_pool.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/jml/utils/string_functions.h"
+#include "mldb/arch/exception.h"
+#include <boost/filesystem.hpp>
+#include <condition_variable>
+#include <mutex>
+#include <deque>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+#include <signal.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Overrides the Python executable used for the workers
+EnvOption<std::string>
+MLDB_PYTHON_WORKER_EXECUTABLE("MLDB_PYTHON_WORKER_EXECUTABLE", "");
+
+/** Program run by each worker.  The first message holds the script, which
+    is compiled once; each following message holds a batch of arguments,
+    and the script is run once per argument in a fresh namespace.  It works
+    under both Python 2 and 3.
+*/
+const char * WORKER_DRIVER = R"foo(
+import sys, json, struct, traceback
+
+_in = getattr(sys.stdin, 'buffer', sys.stdin)
+_out = getattr(sys.stdout, 'buffer', sys.stdout)
+
+# Anything the script prints goes to stderr, not into the protocol
+sys.stdout = sys.stderr
+
+def _read():
+    header = _in.read(4)
+    if len(header) < 4:
+        return None
+    length, = struct.unpack('<I', header)
+    return json.loads(_in.read(length).decode('utf-8'))
+
+def _write(msg):
+    data = json.dumps(msg).encode('utf-8')
+    _out.write(struct.pack('<I', len(data)))
+    _out.write(data)
+    _out.flush()
+
+def _error(info):
+    return {'message': str(info[1]), 'type': info[0].__name__,
+            'traceback': traceback.format_exception(*info)}
+
+class _Script(object):
+    def __init__(self, args):
+        self.args = args
+        self.result = None
+
+    def set_return(self, value):
+        self.result = value
+
+class _Mldb(object):
+    def __init__(self, script):
+        self.script = script
+
+    def log(self, *args):
+        sys.stderr.write(' '.join(str(a) for a in args) + '\n')
+
+    def set_return(self, value):
+        self.script.set_return(value)
+
+    def __getattr__(self, name):
+        raise NotImplementedError('mldb.' + name + ' is not available '
+                                  'in a Python worker process')
+
+_init = _read()
+try:
+    _code = compile(_init['source'], _init['uri'], 'exec')
+    _write({'ok': True})
+except Exception:
+    _write({'error': _error(sys.exc_info())})
+    sys.exit(1)
+
+while True:
+    _msg = _read()
+    if _msg is None:
+        break
+    _results = []
+    for _args in _msg['batch']:
+        _script = _Script(_args)
+        try:
+            exec(_code, {'__name__': '__main__', 'mldb': _Mldb(_script)})
+            _results.append({'result': _script.result})
+        except Exception:
+            _results.append({'error': _error(sys.exc_info())})
+    _write({'results': _results})
+)foo";
+
+struct Worker {
+    pid_t pid = -1;
+    int fd = -1;     ///< Our end of the socket to the worker
+};
+
+struct PendingCall {
+    PendingCall(const Json::Value & args)
+        : args(args)
+    {
+    }
+
+    Json::Value args;
+    Json::Value result;
+    std::exception_ptr exc;
+    bool done = false;
+};
+
+void sendAll(int fd, const char * data, size_t len)
+{
+    while (len > 0) {
+        // MSG_NOSIGNAL so that a dead worker gives us EPIPE, not SIGPIPE
+        ssize_t res = send(fd, data, len, MSG_NOSIGNAL);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw MLDB::Exception(errno, "writing to Python worker");
+        data += res;
+        len -= res;
+    }
+}
+
+void receiveAll(int fd, char * data, size_t len)
+{
+    while (len > 0) {
+        ssize_t res = recv(fd, data, len, 0);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw MLDB::Exception(errno, "reading from Python worker");
+        if (res == 0)
+            throw MLDB::Exception("Python worker exited");
+        data += res;
+        len -= res;
+    }
+}
+
+void sendMessage(const Worker & worker, const Json::Value & msg)
+{
+    std::string data = msg.toStringNoNewLine();
+    uint32_t len = data.size();
+    unsigned char header[4] = {
+        (unsigned char)len, (unsigned char)(len >> 8),
+        (unsigned char)(len >> 16), (unsigned char)(len >> 24) };
+    sendAll(worker.fd, (const char *)header, 4);
+    sendAll(worker.fd, data.data(), data.size());
+}
+
+Json::Value receiveMessage(const Worker & worker)
+{
+    unsigned char header[4];
+    receiveAll(worker.fd, (char *)header, 4);
+    uint32_t len = header[0] | (header[1] << 8) | (header[2] << 16)
+        | ((uint32_t)header[3] << 24);
+    std::string data(len, '\0');
+    receiveAll(worker.fd, &data[0], len);
+    return Json::parse(data);
+}
+
+/// Turn the error sent by the worker into an exception
+HttpReturnException workerError(const Json::Value & error,
+                                const std::string & context)
+{
+    return HttpReturnException(400, context + ": "
+                               + error["type"].asString() + ": "
+                               + error["message"].asString(),
+                               "traceback", error["traceback"]);
+}
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PYTHON WORKER POOL                                                        */
+/*****************************************************************************/
+
+struct PythonWorkerPool::Itl {
+    Itl(const std::string & source, const std::string & scriptUri,
+        int maxBatchSize)
+        : source(source), scriptUri(scriptUri),
+          maxBatchSize(std::max(maxBatchSize, 1))
+    {
+    }
+
+    ~Itl()
+    {
+        for (auto & w: workers)
+            stop(*w);
+    }
+
+    std::string source;
+    std::string scriptUri;
+    size_t maxBatchSize;
+
+    std::mutex mutex;
+    std::condition_variable cond;
+    std::vector<std::unique_ptr<Worker> > workers;
+    std::vector<Worker *> idle;                         ///< Protected by mutex
+    std::deque<std::shared_ptr<PendingCall> > queue;    ///< Protected by mutex
+
+    /// Start the worker process and compile the script in it
+    void start(Worker & worker)
+    {
+        std::vector<std::string> command
+            = ML::split(getPythonExecutable(), ' ');
+        command.push_back("-c");
+        command.push_back(WORKER_DRIVER);
+
+        // Everything the child needs is prepared before the fork, as only
+        // async signal safe functions can be called after it
+        std::vector<char *> argv;
+        for (auto & c: command)
+            argv.push_back(&c[0]);
+        argv.push_back(nullptr);
+        int maxFd = sysconf(_SC_OPEN_MAX);
+
+        int fds[2];
+        if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1)
+            throw MLDB::Exception(errno, "socketpair for Python worker");
+
+        pid_t pid = fork();
+        if (pid == -1) {
+            int err = errno;
+            close(fds[0]);
+            close(fds[1]);
+            throw MLDB::Exception(err, "fork for Python worker");
+        }
+
+        if (pid == 0) {
+            // Child; the socket is its stdin and stdout, and the server's
+            // other file descriptors are closed
+            dup2(fds[1], 0);
+            dup2(fds[1], 1);
+            for (int fd = 3;  fd < maxFd;  ++fd)
+                close(fd);
+            execvp(argv[0], argv.data());
+            _exit(127);
+        }
+
+        close(fds[1]);
+        worker.pid = pid;
+        worker.fd = fds[0];
+
+        Json::Value init;
+        init["source"] = source;
+        init["uri"] = scriptUri;
+
+        Json::Value reply;
+        try {
+            sendMessage(worker, init);
+            reply = receiveMessage(worker);
+        } catch (const std::exception & exc) {
+            stop(worker);
+            throw HttpReturnException(500, "Couldn't start Python worker "
+                                      "process: " + string(exc.what()),
+                                      "executable", getPythonExecutable());
+        }
+
+        if (reply.isMember("error")) {
+            stop(worker);
+            throw workerError(reply["error"], "Error compiling Python script");
+        }
+    }
+
+    /// Stop the worker process if it's running
+    void stop(Worker & worker)
+    {
+        if (worker.fd != -1) {
+            close(worker.fd);
+            worker.fd = -1;
+        }
+        if (worker.pid != -1) {
+            kill(worker.pid, SIGKILL);
+            while (waitpid(worker.pid, nullptr, 0) == -1 && errno == EINTR) ;
+            worker.pid = -1;
+        }
+    }
+
+    /** Run the batch of calls on the worker, setting their result or
+        exception.  A worker that fails is restarted the next time it's
+        used.
+    */
+    void run(Worker & worker,
+             const std::vector<std::shared_ptr<PendingCall> > & batch)
+    {
+        Json::Value reply;
+        try {
+            if (worker.pid == -1)
+                start(worker);
+
+            Json::Value msg;
+            Json::Value & args = msg["batch"];
+            args = Json::Value(Json::arrayValue);
+            for (auto & call: batch)
+                args.append(call->args);
+
+            sendMessage(worker, msg);
+            reply = receiveMessage(worker);
+            if (!reply["results"].isArray()
+                || reply["results"].size() != batch.size())
+                throw MLDB::Exception("Python worker sent invalid reply");
+        } catch (...) {
+            stop(worker);
+            auto exc = std::current_exception();
+            for (auto & call: batch)
+                call->exc = exc;
+            return;
+        }
+
+        for (size_t i = 0;  i < batch.size();  ++i) {
+            const Json::Value & r = reply["results"][(int)i];
+            if (r.isMember("error")) {
+                batch[i]->exc = std::make_exception_ptr
+                    (workerError(r["error"], "Error running Python script"));
+            }
+            else batch[i]->result = r["result"];
+        }
+    }
+};
+
+PythonWorkerPool::
+PythonWorkerPool(const std::string & source,
+                 const std::string & scriptUri,
+                 int numWorkers,
+                 int maxBatchSize)
+    : itl(new Itl(source, scriptUri, maxBatchSize))
+{
+    if (numWorkers < 1)
+        throw HttpReturnException(400, "Python worker pool needs at least "
+                                  "one worker", "numWorkers", numWorkers);
+
+    for (int i = 0;  i < numWorkers;  ++i) {
+        itl->workers.emplace_back(new Worker());
+        itl->start(*itl->workers.back());
+        itl->idle.push_back(itl->workers.back().get());
+    }
+}
+
+PythonWorkerPool::
+~PythonWorkerPool()
+{
+}
+
+Json::Value
+PythonWorkerPool::
+call(const Json::Value & args)
+{
+    auto pending = std::make_shared<PendingCall>(args);
+
+    std::unique_lock<std::mutex> guard(itl->mutex);
+    itl->queue.push_back(pending);
+
+    // Whoever finds a free worker runs a batch of the waiting calls on it,
+    // which aren't necessarily its own; the others wait to be woken up.
+    while (!pending->done) {
+        if (itl->idle.empty() || itl->queue.empty()) {
+            itl->cond.wait(guard);
+            continue;
+        }
+
+        Worker * worker = itl->idle.back();
+        itl->idle.pop_back();
+
+        std::vector<std::shared_ptr<PendingCall> > batch;
+        while (!itl->queue.empty() && batch.size() < itl->maxBatchSize) {
+            batch.emplace_back(std::move(itl->queue.front()));
+            itl->queue.pop_front();
+        }
+
+        guard.unlock();
+        itl->run(*worker, batch);
+        guard.lock();
+
+        itl->idle.push_back(worker);
+        for (auto & call: batch)
+            call->done = true;
+        itl->cond.notify_all();
+    }
+
+    guard.unlock();
+
+    if (pending->exc)
+        std::rethrow_exception(pending->exc);
+    return std::move(pending->result);
+}
+
+int
+PythonWorkerPool::
+numWorkers() const
+{
+    return itl->workers.size();
+}
+
+std::string
+PythonWorkerPool::
+getPythonExecutable()
+{
+    std::string executable = MLDB_PYTHON_WORKER_EXECUTABLE;
+    if (!executable.empty())
+        return executable;
+
+    // Same rules as for the external Python procedure: in docker we use the
+    // system Python, otherwise (probably a test) the virtualenv one
+    if (fs::exists(fs::path("/mldb_data/")))
+        return "/usr/bin/env python";
+    return "./virtualenv/bin/python";
+}
+
+} // namespace MLDB
@@ -0,0 +1,73 @@
+/** python_worker_pool.h                                            -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Pool of Python processes that run a script on behalf of parallel
+    callers, outside of the embedded interpreter.
+*/
+
+#pragma once
+
+#include "mldb/ext/jsoncpp/json.h"
+#include <memory>
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PYTHON WORKER POOL                                                        */
+/*****************************************************************************/
+
+/** Runs a Python script in a set of pre-forked Python processes, so that
+    calls from several threads run in parallel instead of one at a time
+    under the embedded interpreter's lock.
+
+    Each worker compiles the script once, and then runs it once per call
+    with mldb.script.args set to the call's arguments; the value passed
+    to mldb.script.set_return() is the result.  Calls that are waiting for
+    a free worker are sent together in a single batch to the next one to
+    become free, which amortizes the cost of the round trip.
+
+    Since the workers are separate processes, the script can't call back
+    into MLDB (mldb.perform and friends aren't available); mldb.log writes
+    to the server's standard error.
+
+    Messages are exchanged over a pipe per worker, as JSON prefixed with
+    its 32 bit length.  A worker that dies is restarted, and the calls it
+    was running fail.
+*/
+struct PythonWorkerPool {
+    /** Start numWorkers processes that run the given script source.
+        scriptUri is used in the tracebacks.  Throws if a worker can't be
+        started or the script doesn't compile.
+    */
+    PythonWorkerPool(const std::string & source,
+                     const std::string & scriptUri,
+                     int numWorkers,
+                     int maxBatchSize = 64);
+
+    ~PythonWorkerPool();
+
+    /** Run the script with the given arguments, and return what it
+        passed to mldb.script.set_return().  Thread safe.  Errors raised
+        by the script are rethrown as an HttpReturnException with the
+        traceback in its details.
+    */
+    Json::Value call(const Json::Value & args);
+
+    /// Number of worker processes
+    int numWorkers() const;
+
+    /// Return the Python executable used for the workers
+    static std::string getPythonExecutable();
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -4,7 +4,7 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Procedure to train a random forest binary classifier.
+    Procedure to train a random forest classifier or regressor.
 */
 
 #include "randomforest_procedure.h"
@@ -44,7 +44,9 @@ RandomForestProcedureConfigDescription()
              "Specification of the data for input to the classifier procedure. "
              "The select expression must contain these two sub-expressions: one row expression "
              "to identify the features on which to train and one scalar expression "
-             "to identify the label.  The type of the label expression must be a boolean (0 or 1)"
+             "to identify the label.  The type of the label expression must match "
+             "the `mode`: a boolean (0 or 1) for `boolean`, a number for `regression` "
+             "or any combination of numbers and strings for `categorical`. "
              "Labels with a null value will have their row skipped. "
              "The select statement does not support groupby and having clauses. "
              "Also, unlike most select expressions, this one can only select whole columns, "
@@ -72,6 +74,10 @@ RandomForestProcedureConfigDescription()
              "also be provided.");
     addField("verbosity", &RandomForestProcedureConfig::verbosity,
              "Should the procedure be verbose for debugging and tuning purposes", false);
+    addField("mode", &RandomForestProcedureConfig::mode,
+             "Model mode: `boolean`, `regression` or `categorical`. "
+             "Controls how the label is interpreted and what is the output of the "
+             "classifier.  The `multilabel` mode is not supported.", CM_BOOLEAN);
     addParent<ProcedureConfig>();
 
     onPostValidate = chain(validateQuery(&RandomForestProcedureConfig::trainingData,
@@ -146,7 +152,26 @@ run(const ProcedureRunConfig & run,
     ConvertProgressToJson convertProgressToJson(onProgress);
     auto boundDataset = runProcConf.trainingData.stm->from->bind(context, convertProgressToJson);
 
-    ML::Mutable_Feature_Info labelInfo = ML::Mutable_Feature_Info(ML::BOOLEAN);
+    std::shared_ptr<ML::Mutable_Categorical_Info> categorical;
+    ML::Mutable_Feature_Info labelInfo;
+
+    switch (runProcConf.mode) {
+    case CM_REGRESSION:
+        labelInfo = ML::Mutable_Feature_Info(ML::REAL);
+        break;
+    case CM_BOOLEAN:
+        labelInfo = ML::Mutable_Feature_Info(ML::BOOLEAN);
+        break;
+    case CM_CATEGORICAL:
+        categorical = std::make_shared<ML::Mutable_Categorical_Info>();
+        labelInfo = ML::Feature_Info(categorical);
+        break;
+    default:
+        throw HttpReturnException(400, "The random forest procedure only "
+                                  "supports the boolean, regression and "
+                                  "categorical modes");
+    }
+
     labelInfo.set_biased(true);
 
     auto extractWithinExpression = [](std::shared_ptr<SqlExpression> expr)
@@ -194,15 +219,54 @@ run(const ProcedureRunConfig & run,
 
     INFO_MSG(logger) << "got " << labels.size() << " labels in " << labelsTimer.elapsed();
 
+    auto keepRow = [&] (size_t i)
+        {
+            return !weights[i].empty()
+                && weights[i].toDouble() > 0.0
+                && !labels[i].empty()
+                && wheres[i].isTrue();
+        };
+
     size_t numRowsKept = 0;
     for (size_t i = 0;  i < labels.size();  ++i) {
-        if (!weights[i].empty()
-            && weights[i].toDouble() > 0.0
-            && !labels[i].empty()
-            && wheres[i].isTrue())
+        if (keepRow(i))
             ++numRowsKept;
     }
 
+    // Labels are stored as the class number, or for regression, scaled to
+    // within [-0.5, 0.5] (see PartitionData).
+    std::map<std::string, int> categoricalLabels;
+    float labelOffset = 0.0, labelScale = 1.0;
+
+    if (runProcConf.mode == CM_CATEGORICAL) {
+        std::set<std::string> allLabels;
+        for (size_t i = 0;  i < labels.size();  ++i) {
+            if (keepRow(i))
+                allLabels.insert(jsonEncodeStr(labels[i]));
+        }
+        for (auto & l: allLabels)
+            categoricalLabels[l] = categorical->parse_or_add(l);
+    }
+    else if (runProcConf.mode == CM_REGRESSION) {
+        double minLabel = INFINITY, maxLabel = -INFINITY;
+        for (size_t i = 0;  i < labels.size();  ++i) {
+            if (!keepRow(i))
+                continue;
+            double l = labels[i].toDouble();
+            if (!std::isfinite(l))
+                throw HttpReturnException
+                    (400, "Random forest regression labels must be finite numbers",
+                     "label", labels[i]);
+            minLabel = std::min(minLabel, l);
+            maxLabel = std::max(maxLabel, l);
+        }
+        if (numRowsKept > 0) {
+            labelOffset = 0.5 * (minLabel + maxLabel);
+            if (maxLabel > minLabel)
+                labelScale = maxLabel - minLabel;
+        }
+    }
+
     SelectExpression select({subSelect});
 
     auto getColumnsInExpression = [&] (const SqlExpression & expr)
@@ -251,7 +315,15 @@ run(const ProcedureRunConfig & run,
     int numFeatures = knownInputColumns.size();
     INFO_MSG(logger) << "NUM FEATURES : " << numFeatures;
 
-    PartitionData allData(featureSpace);
+    int numLabels = 2;
+    if (runProcConf.mode == CM_REGRESSION)
+        numLabels = 0;
+    else if (runProcConf.mode == CM_CATEGORICAL)
+        numLabels = categorical->count();
+
+    PartitionData allData(featureSpace, numLabels);
+    allData.labelOffset = labelOffset;
+    allData.labelScale = labelScale;
 
     allData.reserve(numRowsKept);
     size_t numRows = 0;
@@ -259,7 +331,20 @@ run(const ProcedureRunConfig & run,
         if (!wheres[i].isTrue() || labels[i].empty()
             || weights[i].empty() || weights[i].toDouble() == 0)
             continue;
-        allData.addRow(labels[i].isTrue(), weights[i].toDouble(), numRows++);
+
+        float label;
+        switch (runProcConf.mode) {
+        case CM_REGRESSION:
+            label = (labels[i].toDouble() - labelOffset) / labelScale;
+            break;
+        case CM_CATEGORICAL:
+            label = categoricalLabels.at(jsonEncodeStr(labels[i]));
+            break;
+        default:
+            label = labels[i].isTrue();
+        }
+
+        allData.addRow(label, weights[i].toDouble(), numRows++);
     }
     ExcAssertEqual(numRows, numRowsKept);
 
@@ -408,7 +493,7 @@ run(const ProcedureRunConfig & run,
 namespace{
 	static RegisterProcedureType<RandomForestProcedure, RandomForestProcedureConfig>
 	regPrototypeClassifier(builtinPackage(),
-	              "Train a supervised binary random forest",
+	              "Train a supervised random forest for classification or regression",
 	              "procedures/RandomForest.md.html");
 
 }
@@ -4,7 +4,7 @@
 
     This file is part of MLDB. Copyright 2016 mldb.ai inc. All rights reserved.
 
-    Procedure to train a random forest binary classifier.
+    Procedure to train a random forest classifier or regressor.
 */
 
 #pragma once
@@ -15,6 +15,7 @@
 #include "matrix.h"
 #include "mldb/types/value_description_fwd.h"
 #include "mldb/ml/jml/feature_info.h"
+#include "mldb/plugins/classifier.h"
 
 
 namespace MLDB {
@@ -28,7 +29,8 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
                                     featureVectorSamplingProp(0.3f),
                                     featureSamplingProp(0.3f),
                                     maxDepth(20),
-                                    verbosity(false)
+                                    verbosity(false),
+                                    mode(CM_BOOLEAN)
     {
     }
 
@@ -59,6 +61,9 @@ struct RandomForestProcedureConfig : public ProcedureConfig {
 
     // Function name
     Utf8String functionName;
+
+    /// What the label is; multilabel isn't supported
+    ClassifierMode mode;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(RandomForestProcedureConfig);
@@ -34,6 +34,15 @@ ScriptFunctionConfigDescription()
             "Script language (python or javascript)");
     addField("scriptConfig", &ScriptFunctionConfig::scriptConfig, 
             "Script resource configuration");
+    addField("numWorkers", &ScriptFunctionConfig::numWorkers,
+             "Number of separate Python processes to run the script in.  "
+             "Calls are run in parallel across them instead of one at "
+             "a time in the server's Python interpreter, but the script "
+             "can't call back into MLDB.  Zero (the default) runs it "
+             "in the server.  Only supported for Python.", 0);
+    addField("maxBatchSize", &ScriptFunctionConfig::maxBatchSize,
+             "Maximum number of calls waiting for a worker process that "
+             "are sent to it together", 64);
 }
 
 
@@ -63,6 +72,19 @@ ScriptFunction(MldbServer * owner,
                         "ND", functionConfig.scriptConfig.toPluginConfig());
 
     cachedResource.source = loadedResource.getScript(PackageElement::MAIN);
+
+    if (functionConfig.numWorkers > 0) {
+        if (runner != "python")
+            throw HttpReturnException(400, "numWorkers is only supported "
+                                      "for Python script functions",
+                                      "language", functionConfig.language);
+        std::string scriptUri = functionConfig.scriptConfig.address.empty()
+            ? "<" + config.id.rawString() + ">"
+            : functionConfig.scriptConfig.address;
+        workers = std::make_shared<PythonWorkerPool>
+            (cachedResource.source.rawString(), scriptUri,
+             functionConfig.numWorkers, functionConfig.maxBatchSize);
+    }
 }
 
 Any
@@ -90,24 +112,30 @@ apply(const FunctionApplier & applier,
 
     DEBUG_MSG(logger) << "script args = " << jsonEncode(copiedSR.args);
 
-    RestRequest request("POST", resource, RestParams(),
-                        
-                        jsonEncode(copiedSR).toString());
-    InProcessRestConnection connection;
+    Json::Value result;
+
+    if (workers) {
+        result = workers->call(val);
+    }
+    else {
+        RestRequest request("POST", resource, RestParams(),
+                            jsonEncode(copiedSR).toString());
+        InProcessRestConnection connection;
     
-    // TODO. this should not always be true. need to get this from the context
-    // somehow
-    request.header.headers.insert(make_pair("__mldb_child_call", "true"));
+        // TODO. this should not always be true. need to get this from the
+        // context somehow
+        request.header.headers.insert(make_pair("__mldb_child_call", "true"));
 
-    server->handleRequest(connection, request);
+        server->handleRequest(connection, request);
 
-    // TODO. better exception message
-    if(connection.responseCode != 200) {
-        throw HttpReturnException(400, "responseCode != 200 for function",
-                                  Json::parse(connection.response));
-    }
+        // TODO. better exception message
+        if(connection.responseCode != 200) {
+            throw HttpReturnException(400, "responseCode != 200 for function",
+                                      Json::parse(connection.response));
+        }
 
-    Json::Value result = Json::parse(connection.response)["result"];
+        result = Json::parse(connection.response)["result"];
+    }
     
     vector<tuple<PathElement, ExpressionValue>> vals;
     if(!result.isArray()) {
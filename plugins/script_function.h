@@ -11,6 +11,7 @@
 
 #include "mldb/core/function.h"
 #include "mldb/server/plugin_resource.h"
+#include "python_worker_pool.h"
 
 
 namespace MLDB {
@@ -21,8 +22,15 @@ namespace MLDB {
 /*****************************************************************************/
 
 struct ScriptFunctionConfig {
+    ScriptFunctionConfig()
+        : numWorkers(0), maxBatchSize(64)
+    {
+    }
+
     std::string language;
     ScriptResource scriptConfig;
+    int numWorkers;
+    int maxBatchSize;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(ScriptFunctionConfig);
@@ -49,6 +57,9 @@ struct ScriptFunction: public Function {
 
     std::string runner;
     ScriptResource cachedResource;
+
+    /// Worker processes that run the script when numWorkers is set
+    std::shared_ptr<PythonWorkerPool> workers;
 };
 
 
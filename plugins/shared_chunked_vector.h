@@ -0,0 +1,163 @@
+/** shared_chunked_vector.h                                        -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Vector that shares its elements between copies, for versioned data
+    structures that are only ever appended to.
+*/
+
+#pragma once
+
+#include "mldb/base/exc_assert.h"
+#include <vector>
+#include <memory>
+#include <iterator>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* SHARED CHUNKED VECTOR                                                     */
+/*****************************************************************************/
+
+/** Vector that can only be modified at its end, and whose elements are
+    shared between copies.
+
+    Elements are stored in chunks of CHUNK_SIZE elements, and copying the
+    vector only copies the pointers to the chunks.  A chunk that is shared
+    with another copy is never modified; the first time a copy needs to
+    change its last chunk (the only one that can be partly full) while
+    it's shared, it takes a private copy of that chunk only.  Copying a
+    vector of n elements and appending m to the copy is thus
+    O(n / CHUNK_SIZE + CHUNK_SIZE + m) rather than O(n + m).
+
+    Different copies can be used from different threads at the same time,
+    but each copy must only be modified by one thread at a time.
+*/
+
+template<typename T, size_t ChunkBits = 12>
+struct SharedChunkedVector {
+    static constexpr size_t CHUNK_SIZE = size_t(1) << ChunkBits;
+
+    SharedChunkedVector()
+        : size_(0)
+    {
+    }
+
+    size_t size() const { return size_; }
+    bool empty() const { return size_ == 0; }
+
+    const T & operator [] (size_t i) const
+    {
+        return (*chunks[i >> ChunkBits])[i & (CHUNK_SIZE - 1)];
+    }
+
+    const T & at(size_t i) const
+    {
+        ExcAssertLess(i, size_);
+        return operator [] (i);
+    }
+
+    const T & back() const
+    {
+        return at(size_ - 1);
+    }
+
+    template<typename... Args>
+    void emplace_back(Args&&... args)
+    {
+        if (size_ % CHUNK_SIZE == 0)
+            chunks.push_back(std::make_shared<Chunk>());
+        else unshareLastChunk();
+        chunks.back()->emplace_back(std::forward<Args>(args)...);
+        ++size_;
+    }
+
+    void push_back(const T & val)
+    {
+        emplace_back(val);
+    }
+
+    void pop_back()
+    {
+        ExcAssertGreater(size_, 0);
+        unshareLastChunk();
+        chunks.back()->pop_back();
+        if (chunks.back()->empty())
+            chunks.pop_back();
+        --size_;
+    }
+
+    struct const_iterator {
+        typedef std::random_access_iterator_tag iterator_category;
+        typedef T value_type;
+        typedef ssize_t difference_type;
+        typedef const T * pointer;
+        typedef const T & reference;
+
+        const_iterator(const SharedChunkedVector * owner = nullptr,
+                       size_t index = 0)
+            : owner(owner), index(index)
+        {
+        }
+
+        const T & operator * () const { return (*owner)[index]; }
+        const T * operator -> () const { return &(*owner)[index]; }
+        const T & operator [] (ssize_t n) const { return (*owner)[index + n]; }
+
+        const_iterator & operator ++ () { ++index;  return *this; }
+        const_iterator operator ++ (int) { auto r = *this;  ++index;  return r; }
+        const_iterator & operator -- () { --index;  return *this; }
+        const_iterator operator -- (int) { auto r = *this;  --index;  return r; }
+        const_iterator & operator += (ssize_t n) { index += n;  return *this; }
+        const_iterator & operator -= (ssize_t n) { index -= n;  return *this; }
+        const_iterator operator + (ssize_t n) const { return { owner, index + n }; }
+        const_iterator operator - (ssize_t n) const { return { owner, index - n }; }
+
+        ssize_t operator - (const const_iterator & other) const
+        {
+            return (ssize_t)index - (ssize_t)other.index;
+        }
+
+        bool operator == (const const_iterator & other) const
+        {
+            return index == other.index;
+        }
+
+        bool operator != (const const_iterator & other) const
+        {
+            return index != other.index;
+        }
+
+        bool operator < (const const_iterator & other) const
+        {
+            return index < other.index;
+        }
+
+    private:
+        const SharedChunkedVector * owner;
+        size_t index;
+    };
+
+    const_iterator begin() const { return { this, 0 }; }
+    const_iterator end() const { return { this, size_ }; }
+
+private:
+    typedef std::vector<T> Chunk;
+    std::vector<std::shared_ptr<Chunk> > chunks;
+    size_t size_;
+
+    /** Make sure that the last chunk belongs only to this copy.  A count
+        of one can't be racy: any other thread that could copy the pointer
+        would need to hold a reference to it, which would be counted.
+    */
+    void unshareLastChunk()
+    {
+        if (chunks.back().use_count() > 1)
+            chunks.back() = std::make_shared<Chunk>(*chunks.back());
+    }
+};
+
+} // namespace MLDB
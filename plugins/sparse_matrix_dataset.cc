@@ -12,6 +12,7 @@
 #include "mldb/types/compact_vector_description.h"
 #include "mldb/types/map_description.h"
 #include "sparse_matrix.h"
+#include "sparse_matrix_storage.h"
 #include "mldb/sql/sql_expression.h"
 #include "mldb/http/http_exception.h"
 #include "mldb/types/any_impl.h"
@@ -235,9 +236,15 @@ struct SparseMatrixDataset::Itl
     }
 
     /// Commit a set of writes to the database
-    void commitWrites(WriteTransaction & trans)
+    virtual void commitWrites(WriteTransaction & trans)
     {
         std::unique_lock<RootLock> guard(rootLock);
+        applyWrites(trans);
+    }
+
+    /// Commit a set of writes to the database.  The root lock must be held.
+    void applyWrites(WriteTransaction & trans)
+    {
         ++epoch;
 
         ThreadPool tp;
@@ -279,12 +286,18 @@ struct SparseMatrixDataset::Itl
         setDefaultTransaction(std::move(result));
     }
 
-    void optimize()
+    virtual void optimize()
+    {
+        std::unique_lock<RootLock> guard(rootLock);
+        optimizeLocked();
+    }
+
+    /// Optimize the storage.  The root lock must be held.
+    void optimizeLocked()
     {
         DEBUG_MSG(logger) << "optimize() on MutableSparseMatrixDataset";
         //Timer timer;
 
-        std::unique_lock<RootLock> guard(rootLock);
         // We don't increment the epoch since logically it's exactly the same
 
         ThreadPool tp;
@@ -1109,7 +1122,7 @@ struct MutableBaseData {
     {
     }
 
-    typedef std::unordered_map<uint64_t, compact_vector<BaseEntry, 1> > RowsEntry;
+    typedef SparseMatrixRows RowsEntry;
 
     struct Rows {
         Rows()
@@ -1118,26 +1131,31 @@ struct MutableBaseData {
         }
 
         Rows(Rows && other) noexcept
-            : entries(std::move(other.entries)),
+            : segment(std::move(other.segment)),
+              entries(std::move(other.entries)),
               cachedRowCount(other.cachedRowCount.load())
         {
         }
 
         Rows(const Rows & other)
-            : entries(other.entries),
+            : segment(other.segment),
+              entries(other.entries),
               cachedRowCount(other.cachedRowCount.load())
         {
         }
 
-        Rows(std::vector<std::shared_ptr<const RowsEntry> > entries,
+        Rows(std::shared_ptr<const SparseMatrixSegment> segment,
+             std::vector<std::shared_ptr<const RowsEntry> > entries,
              int64_t cachedRowCount)
-            : entries(std::move(entries)),
+            : segment(std::move(segment)),
+              entries(std::move(entries)),
               cachedRowCount(cachedRowCount)
         {
         }
 
         Rows & operator = (Rows && other) noexcept
         {
+            this->segment = std::move(other.segment);
             this->entries = std::move(other.entries);
             this->cachedRowCount = other.cachedRowCount.load();
             return *this;
@@ -1145,18 +1163,30 @@ struct MutableBaseData {
 
         Rows & operator = (const Rows & other)
         {
+            this->segment = other.segment;
             this->entries = other.entries;
             this->cachedRowCount = other.cachedRowCount.load();
             return *this;
         }
 
+        /// Rows of the last snapshot, on disk; they are older than entries
+        std::shared_ptr<const SparseMatrixSegment> segment;
         std::vector<std::shared_ptr<const RowsEntry> > entries;
         mutable std::atomic<int64_t> cachedRowCount;
         mutable std::mutex rowCountMutex;
-        
+
+        /// Number of separate sets of rows, which may have rows in common
+        size_t numSources() const
+        {
+            return entries.size() + (segment ? 1 : 0);
+        }
+
         bool iterateRow(uint64_t rowNum,
                         const std::function<bool (const BaseEntry & entry)> & onEntry) const
         {
+            if (segment && !segment->iterateRow(rowNum, onEntry))
+                return false;
+
             for (auto & e: entries) {
                 auto it = e->find(rowNum);
                 if (it != e->end()) {
@@ -1172,8 +1202,20 @@ struct MutableBaseData {
 
         bool iterateRows(const std::function<bool (uint64_t row)> & onRow) const
         {
+            if (segment && entries.empty())
+                return segment->iterateRows(onRow);
+
             std::vector<uint64_t> allRows;
 
+            if (segment) {
+                allRows.reserve(segment->rowCount());
+                segment->iterateRows([&] (uint64_t row)
+                                     {
+                                         allRows.emplace_back(row);
+                                         return true;
+                                     });
+            }
+
             for (auto & e: entries) {
                 for (auto & r: *e) {
                     allRows.emplace_back(r.first);
@@ -1181,7 +1223,7 @@ struct MutableBaseData {
             }
 
             std::vector<uint64_t>::iterator end;
-            if (entries.size() > 1) {
+            if (numSources() > 1) {
                 //if we haven't commited the entries yet there can be duplicates
                 parallelQuickSortRecursive(allRows);
                 end = std::unique(allRows.begin(), allRows.end());
@@ -1200,6 +1242,9 @@ struct MutableBaseData {
 
         bool knownRow(uint64_t rowNum) const
         {
+            if (segment && segment->knownRow(rowNum))
+                return true;
+
             for (auto & e: entries) {
                 if (e->count(rowNum))
                     return true;
@@ -1210,9 +1255,11 @@ struct MutableBaseData {
         
         size_t rowCount() const
         {
-            if (entries.empty())
+            if (segment && entries.empty())
+                return segment->rowCount();
+            if (!segment && entries.empty())
                 return 0;
-            if (entries.size() == 1)
+            if (!segment && entries.size() == 1)
                 return entries.back()->size();
             int64_t r = cachedRowCount.load();
             if (r != -1)
@@ -1222,6 +1269,14 @@ struct MutableBaseData {
             std::unique_lock<std::mutex> guard(rowCountMutex);
             std::vector<uint64_t> allRows;
 
+            if (segment) {
+                segment->iterateRows([&] (uint64_t row)
+                                     {
+                                         allRows.emplace_back(row);
+                                         return true;
+                                     });
+            }
+
             for (auto & e: entries) {
                 for (auto & r: *e) {
                     allRows.emplace_back(r.first);
@@ -1230,7 +1285,7 @@ struct MutableBaseData {
 
             int64_t rowCount = 0;
 
-            if (entries.size() > 1) {
+            if (numSources() > 1) {
                 //if we haven't commited the entries yet there can be duplicates
                 parallelQuickSortRecursive(allRows);
                 rowCount = std::unique(allRows.begin(), allRows.end()) - allRows.begin();
@@ -1246,6 +1301,7 @@ struct MutableBaseData {
         Rows optimize(std::vector<std::shared_ptr<RowsEntry> > & nonReadableWrites) const
         {
             Rows result;
+            result.segment = segment;
 
             RowsEntry newEntries;
 
@@ -1274,7 +1330,10 @@ struct MutableBaseData {
 
             nonReadableWrites.clear();
 
-            result.entries.emplace_back(new RowsEntry(std::move(newEntries)));
+            // The segment holds everything there is if nothing was written
+            // since it was made
+            if (!segment || !newEntries.empty())
+                result.entries.emplace_back(new RowsEntry(std::move(newEntries)));
             return result;
         }
 
@@ -1331,7 +1390,7 @@ struct MutableBaseData {
 
         bool isSingleReadEntry() const
         {
-            return entries.size() == 1;
+            return !segment && entries.size() == 1;
         }
 
     };
@@ -1346,9 +1405,10 @@ struct MutableBaseData {
         {
         }
         
-        Repr(std::vector<std::shared_ptr<const RowsEntry> > entries,
+        Repr(std::shared_ptr<const SparseMatrixSegment> segment,
+             std::vector<std::shared_ptr<const RowsEntry> > entries,
              int64_t cachedRowCount)
-            : rows(std::move(entries), cachedRowCount)
+            : rows(std::move(segment), std::move(entries), cachedRowCount)
         {
         }
 
@@ -1369,6 +1429,19 @@ struct MutableBaseData {
         repr.store(std::move(newRepr));
     }
 
+    /** Replace all of the rows by those in the given segment, which must
+        hold everything that has been written.  Used when a snapshot has
+        been written, or is loaded on startup.
+    */
+    void replaceBySegment(std::shared_ptr<const SparseMatrixSegment> segment)
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        ExcAssert(nonReadableWrites.empty());
+        repr.store(std::make_shared<Repr>(std::move(segment),
+                                          std::vector<std::shared_ptr<const RowsEntry> >(),
+                                          -1));
+    }
+
     /** Insert the given set of rows very quickly, but in a way that they
         will not be available for reading until the next commit()
         operation has completed.
@@ -1393,7 +1466,8 @@ struct MutableBaseData {
             newRows = oldRows.entries;
         newRows.emplace_back(std::move(written));
 
-        auto newRepr = std::make_shared<Repr>(std::move(newRows),
+        auto newRepr = std::make_shared<Repr>(oldRows.segment,
+                                              std::move(newRows),
                                               oldRows.cachedRowCount.load());
         repr.store(std::move(newRepr));
     }
@@ -1470,7 +1544,8 @@ struct MutableBaseData {
         // Put them back in order of size
         std::reverse(newRows.begin(), newRows.end());
 
-        auto newRepr = std::make_shared<Repr>(std::move(newRows),
+        auto newRepr = std::make_shared<Repr>(oldRows.segment,
+                                              std::move(newRows),
                                               oldRows.cachedRowCount.load());
         repr.store(std::move(newRepr));
     }
@@ -1740,7 +1815,8 @@ MutableSparseMatrixDatasetConfig::
 MutableSparseMatrixDatasetConfig()
     : timeQuantumSeconds(1.0),
       consistencyLevel(WT_READ_AFTER_COMMIT),
-      favor(TF_FAVOR_READS)
+      favor(TF_FAVOR_READS),
+      snapshotLogBytes(256 * 1024 * 1024)
 {
 }
 
@@ -1767,6 +1843,17 @@ MutableSparseMatrixDatasetConfigDescription()
              "Whether to favor reads or writes.  Only has effect for when "
              "`consistencyLevel` is set to `consistentAfterWrite`.",
              TF_FAVOR_READS);
+    addField("dataDirectory", &MutableSparseMatrixDatasetConfig::dataDirectory,
+             "URI (must be file://) of a directory in which the dataset is "
+             "persisted.  Every write is logged there before it's applied, "
+             "and the dataset is loaded back from it when it's created "
+             "again.  If empty, the dataset is only kept in memory.");
+    addField("snapshotLogBytes",
+             &MutableSparseMatrixDatasetConfig::snapshotLogBytes,
+             "Size of the write log, in bytes, after which a snapshot of "
+             "the dataset is written to `dataDirectory`.  Recovery only needs "
+             "to replay the log written since the last snapshot.",
+             (uint64_t)(256 * 1024 * 1024));
 }
 
 /*****************************************************************************/
@@ -1778,7 +1865,11 @@ struct MutableSparseMatrixDataset::Itl
 
     Itl(double timeQuantumSeconds,
         WriteTransactionLevel consistencyLevel,
-        TransactionFavor favor) 
+        TransactionFavor favor,
+        const Url & dataDirectory,
+        uint64_t snapshotLogBytes)
+        : persistent(!dataDirectory.empty()),
+          snapshotLogBytes(snapshotLogBytes)
     {
         CommitMode mode;
         if (consistencyLevel == WT_READ_AFTER_COMMIT)
@@ -1792,6 +1883,155 @@ struct MutableSparseMatrixDataset::Itl
              std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode),
              std::make_shared<MutableBaseMatrix>(mode));
+
+        if (persistent) {
+            if (dataDirectory.scheme() != "file")
+                throw HttpReturnException
+                    (400, "sparse.mutable dataset requires a file:// URI "
+                     "for dataDirectory, passed '"
+                     + dataDirectory.toUtf8String() + "'");
+            recover(dataDirectory.path());
+        }
+    }
+
+    /// Is the data logged and snapshotted to disk?
+    const bool persistent;
+
+    /// Log size after which a snapshot is made
+    uint64_t snapshotLogBytes;
+
+    /// Where the data is persisted.  Protected by the root lock.
+    std::unique_ptr<SparseMatrixStore> store;
+
+    static std::shared_ptr<MutableBaseData>
+    getData(const std::shared_ptr<BaseMatrix> & matrix)
+    {
+        return static_cast<MutableBaseMatrix &>(*matrix).data;
+    }
+
+    /// The matrices in the snapshots, in the order given to the store.
+    /// The inverse matrix isn't logged, as it's rebuilt from the matrix.
+    std::vector<std::shared_ptr<MutableBaseData> > snapshotMatrices() const
+    {
+        return { getData(values), getData(matrix), getData(inverse) };
+    }
+
+    /** Load the last snapshot from the given directory, and replay the
+        writes logged since.  */
+    void recover(const std::string & directory)
+    {
+        store.reset(new SparseMatrixStore(directory,
+                                          { "values", "matrix", "inverse" }));
+
+        auto segments = store->loadSnapshot();
+        auto matrices = snapshotMatrices();
+        for (size_t i = 0;  i < segments.size();  ++i)
+            matrices[i]->replaceBySegment(segments[i]);
+
+        auto trans = getWriteTransaction(*getReadTransaction());
+
+        auto onRecord = [&] (std::vector<SparseMatrixRows> & logged)
+            {
+                ExcAssertEqual(logged.size(), 2);
+                for (auto & r: logged[0]) {
+                    BaseEntry * entries = r.second.unsafe_raw_data();
+                    trans->values->recordRow(r.first, entries, r.second.size());
+                }
+                for (auto & r: logged[1]) {
+                    BaseEntry * entries = r.second.unsafe_raw_data();
+                    trans->inverse->recordCol(r.first,
+                                              (const BaseEntry *)entries,
+                                              r.second.size());
+                    trans->matrix->recordRow(r.first, entries, r.second.size());
+                }
+            };
+
+        store->recover(onRecord);
+
+        std::unique_lock<RootLock> guard(rootLock);
+        applyWrites(*trans);
+        optimizeLocked();
+    }
+
+    /// Encode the writes in the transaction into a log record
+    static std::string encodeWrites(WriteTransaction & trans)
+    {
+        auto written = [] (MatrixWriteTransaction & trans)
+            {
+                return static_cast<MutableWriteTransaction &>(trans)
+                    .written.get();
+            };
+
+        return SparseMatrixLog::encode({ written(*trans.values),
+                                         written(*trans.matrix) });
+    }
+
+    /** Write a snapshot of everything that's been committed, after which
+        the log written so far is no longer needed.  The root lock must be
+        held, which blocks commits (but not reads) until it's done.
+    */
+    void snapshotLocked()
+    {
+        // Fold everything into one set of rows per matrix
+        optimizeLocked();
+
+        auto matrices = snapshotMatrices();
+
+        std::vector<SparseMatrixStore::MatrixContents> contents;
+        for (auto & m: matrices) {
+            auto repr = m->repr.load();
+            contents.push_back({ repr->rows.segment, repr->rows.entries });
+        }
+
+        auto segments = store->snapshot(contents);
+
+        for (size_t i = 0;  i < matrices.size();  ++i)
+            matrices[i]->replaceBySegment(segments[i]);
+
+        auto result = std::make_shared<ReadTransaction>();
+        result->matrix = matrix->startReadTransaction();
+        result->inverse = inverse->startReadTransaction();
+        result->values = values->startReadTransaction();
+        result->epoch = epoch;
+
+        setDefaultTransaction(std::move(result));
+    }
+
+    virtual void commitWrites(WriteTransaction & trans) override
+    {
+        if (!persistent) {
+            SparseMatrixDataset::Itl::commitWrites(trans);
+            return;
+        }
+
+        // Encoding is done outside of the lock so that commits from
+        // several threads can do it at the same time
+        std::string record = encodeWrites(trans);
+
+        // The record is appended under the lock so that a snapshot always
+        // includes everything in the logs it replaces
+        std::unique_lock<RootLock> guard(rootLock);
+        store->append(record);
+        applyWrites(trans);
+
+        if (store->bytesSinceSnapshot() >= snapshotLogBytes)
+            snapshotLocked();
+    }
+
+    virtual void optimize() override
+    {
+        if (!persistent) {
+            SparseMatrixDataset::Itl::optimize();
+            return;
+        }
+
+        std::unique_lock<RootLock> guard(rootLock);
+        if (store->bytesSinceSnapshot() >= snapshotLogBytes)
+            snapshotLocked();
+        else optimizeLocked();
+
+        // Once committed, writes survive the machine going down
+        store->sync();
     }
 
     /** This is a recorder that is designed to have each thread record
@@ -1887,7 +2127,9 @@ MutableSparseMatrixDataset(MldbServer * owner,
     : SparseMatrixDataset(owner)
 {
     auto params = config.params.convert<MutableSparseMatrixDatasetConfig>();
-    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel, params.favor));
+    itl.reset(new Itl(params.timeQuantumSeconds, params.consistencyLevel,
+                      params.favor, params.dataDirectory,
+                      params.snapshotLogBytes));
 }
 
 Dataset::MultiChunkRecorder
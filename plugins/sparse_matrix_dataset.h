@@ -105,6 +105,13 @@ struct MutableSparseMatrixDatasetConfig
 
     /// Transaction favor.  When reads and writes are mixed, which do we favor?
     TransactionFavor favor;
+
+    /// Directory (must be file://) holding the log and snapshots; if empty
+    /// the dataset is only in memory
+    Url dataDirectory;
+
+    /// Bytes of log after which a new snapshot is written
+    uint64_t snapshotLogBytes;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(MutableSparseMatrixDatasetConfig);
@@ -0,0 +1,845 @@
+/** sparse_matrix_storage.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    On-disk storage for the sparse matrices of the sparse.mutable dataset.
+*/
+
+#include "sparse_matrix_storage.h"
+#include "mldb/arch/exception.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/format.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <cstring>
+#include <limits>
+#include <fstream>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <libgen.h>
+
+
+using namespace std;
+
+namespace fs = boost::filesystem;
+
+
+namespace MLDB {
+
+namespace {
+
+/// A file mapped read-only into memory
+struct MappedFile {
+    MappedFile(const std::string & path)
+        : path(path), data(nullptr), size(0)
+    {
+        int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "opening " + path);
+
+        struct stat st;
+        if (fstat(fd, &st) == -1) {
+            int err = errno;
+            close(fd);
+            throw MLDB::Exception(err, "stat of " + path);
+        }
+
+        size = st.st_size;
+        if (size > 0) {
+            void * addr = mmap(nullptr, size, PROT_READ, MAP_SHARED, fd, 0);
+            if (addr == MAP_FAILED) {
+                int err = errno;
+                close(fd);
+                throw MLDB::Exception(err, "mapping " + path);
+            }
+            data = (const char *)addr;
+        }
+
+        // The mapping keeps the file alive
+        close(fd);
+    }
+
+    ~MappedFile()
+    {
+        if (data)
+            munmap((void *)data, size);
+    }
+
+    MappedFile(const MappedFile & other) = delete;
+    void operator = (const MappedFile & other) = delete;
+
+    std::string path;
+    const char * data;
+    size_t size;
+};
+
+void writeAll(int fd, const char * data, size_t len, const std::string & path)
+{
+    while (len > 0) {
+        ssize_t res = ::write(fd, data, len);
+        if (res == -1 && errno == EINTR)
+            continue;
+        if (res == -1)
+            throw MLDB::Exception(errno, "writing to " + path);
+        data += res;
+        len -= res;
+    }
+}
+
+/// Sync the directory containing path, so that a rename or creation of
+/// the file is durable
+void syncDirectory(const std::string & path)
+{
+    std::string copy = path;
+    std::string dir = dirname(&copy[0]);
+    int fd = open(dir.c_str(), O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd == -1)
+        throw MLDB::Exception(errno, "opening directory " + dir);
+    int res = fsync(fd);
+    int err = errno;
+    close(fd);
+    if (res == -1)
+        throw MLDB::Exception(err, "syncing directory " + dir);
+}
+
+/// Buffered writer to a new file
+struct FileWriter {
+    FileWriter(const std::string & path)
+        : path(path)
+    {
+        fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (fd == -1)
+            throw MLDB::Exception(errno, "creating " + path);
+        buffer.reserve(BUFFER_SIZE);
+    }
+
+    ~FileWriter()
+    {
+        if (fd != -1)
+            ::close(fd);
+    }
+
+    void write(const void * data, size_t len)
+    {
+        if (buffer.size() + len > BUFFER_SIZE)
+            flush();
+        if (len > BUFFER_SIZE)
+            writeAll(fd, (const char *)data, len, path);
+        else buffer.append((const char *)data, len);
+    }
+
+    template<typename T>
+    void writePod(const T & val)
+    {
+        write(&val, sizeof(val));
+    }
+
+    void flush()
+    {
+        writeAll(fd, buffer.data(), buffer.size(), path);
+        buffer.clear();
+    }
+
+    /// Flush, sync to disk and close
+    void close()
+    {
+        flush();
+        if (fdatasync(fd) == -1)
+            throw MLDB::Exception(errno, "syncing " + path);
+        ::close(fd);
+        fd = -1;
+    }
+
+    static constexpr size_t BUFFER_SIZE = 1 << 20;
+
+    std::string path;
+    int fd;
+    std::string buffer;
+};
+
+/// Reads fixed size values from a buffer, detecting overruns
+struct BufferReader {
+    BufferReader(const char * p, const char * e)
+        : p(p), e(e)
+    {
+    }
+
+    template<typename T>
+    T readPod()
+    {
+        T result;
+        if (e - p < (ssize_t)sizeof(T))
+            throw MLDB::Exception("truncated sparse matrix log record");
+        memcpy(&result, p, sizeof(T));
+        p += sizeof(T);
+        return result;
+    }
+
+    std::string readString(size_t len)
+    {
+        if (e - p < (ssize_t)len)
+            throw MLDB::Exception("truncated sparse matrix log record");
+        std::string result(p, p + len);
+        p += len;
+        return result;
+    }
+
+    const char * p;
+    const char * e;
+};
+
+/*****************************************************************************/
+/* SEGMENT FORMAT                                                            */
+/*****************************************************************************/
+
+const char SEGMENT_MAGIC[8] = { 'M', 'L', 'D', 'B', 'S', 'M', 'S', 'G' };
+
+struct SegmentHeader {
+    char magic[8];
+    uint64_t version;
+    uint64_t numRows;
+    uint64_t numEntries;
+    uint64_t metadataBytes;
+    uint64_t reserved[3];
+};
+
+static_assert(sizeof(SegmentHeader) == 64, "unexpected segment header size");
+
+/// A row of a segment.  There are numRows + 1, the last one only holding
+/// the end of the entries of the last row.
+struct SegmentRow {
+    uint64_t row;
+    uint64_t firstEntry;
+};
+
+struct SegmentEntry {
+    uint64_t rowcol;
+    uint64_t timestamp;
+    uint64_t val;
+    uint32_t tag;
+    uint32_t numMetadata;
+    uint64_t metadataOffset;  ///< Each string is a 32 bit length then bytes
+};
+
+static_assert(sizeof(SegmentEntry) == 40, "unexpected segment entry size");
+
+/*****************************************************************************/
+/* LOG FORMAT                                                                */
+/*****************************************************************************/
+
+const uint32_t LOG_RECORD_MAGIC = 0x4c4d5053;  // "SPML"
+
+struct LogRecordHeader {
+    uint32_t magic;
+    uint32_t length;     ///< Of the payload after the header
+    uint64_t checksum;   ///< XXH64 of the payload
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX SEGMENT                                                     */
+/*****************************************************************************/
+
+struct SparseMatrixSegment::Itl {
+    Itl(const std::string & path)
+        : file(path)
+    {
+        if (file.size < sizeof(SegmentHeader))
+            throw MLDB::Exception("sparse matrix segment " + path
+                                  + " is truncated");
+        header = (const SegmentHeader *)file.data;
+        if (memcmp(header->magic, SEGMENT_MAGIC, 8) != 0
+            || header->version != 1)
+            throw MLDB::Exception("file " + path
+                                  + " is not a sparse matrix segment");
+
+        uint64_t expected = sizeof(SegmentHeader)
+            + (header->numRows + 1) * sizeof(SegmentRow)
+            + header->numEntries * sizeof(SegmentEntry)
+            + header->metadataBytes;
+        if (file.size != expected)
+            throw MLDB::Exception("sparse matrix segment " + path
+                                  + " has the wrong size");
+
+        rows = (const SegmentRow *)(header + 1);
+        entries = (const SegmentEntry *)(rows + header->numRows + 1);
+        metadata = (const char *)(entries + header->numEntries);
+    }
+
+    MappedFile file;
+    const SegmentHeader * header;
+    const SegmentRow * rows;
+    const SegmentEntry * entries;
+    const char * metadata;
+
+    const SegmentRow * findRow(uint64_t rowNum) const
+    {
+        const SegmentRow * end = rows + header->numRows;
+        const SegmentRow * it
+            = std::lower_bound(rows, end, rowNum,
+                               [] (const SegmentRow & r, uint64_t rowNum)
+                               {
+                                   return r.row < rowNum;
+                               });
+        if (it == end || it->row != rowNum)
+            return nullptr;
+        return it;
+    }
+
+    BaseEntry getEntry(uint64_t index) const
+    {
+        const SegmentEntry & e = entries[index];
+        BaseEntry result(e.rowcol, e.timestamp, e.val, e.tag);
+        const char * p = metadata + e.metadataOffset;
+        for (uint32_t i = 0;  i < e.numMetadata;  ++i) {
+            uint32_t len;
+            memcpy(&len, p, 4);
+            p += 4;
+            result.metadata.emplace_back(p, p + len);
+            p += len;
+        }
+        return result;
+    }
+};
+
+SparseMatrixSegment::
+SparseMatrixSegment(const std::string & path)
+    : itl(new Itl(path))
+{
+}
+
+SparseMatrixSegment::
+~SparseMatrixSegment()
+{
+}
+
+void
+SparseMatrixSegment::
+write(const std::string & path,
+      const SparseMatrixSegment * base,
+      const std::vector<std::shared_ptr<const SparseMatrixRows> > & rows)
+{
+    // Sorted row numbers, from the base (which is already sorted) and then
+    // the rows in memory
+    std::vector<uint64_t> allRows;
+    if (base) {
+        allRows.reserve(base->rowCount());
+        base->iterateRows([&] (uint64_t row)
+                          {
+                              allRows.push_back(row);
+                              return true;
+                          });
+    }
+    size_t numBaseRows = allRows.size();
+    for (auto & r: rows) {
+        for (auto & row: *r) {
+            if (!base || !base->knownRow(row.first))
+                allRows.push_back(row.first);
+        }
+    }
+    std::sort(allRows.begin() + numBaseRows, allRows.end());
+    std::inplace_merge(allRows.begin(), allRows.begin() + numBaseRows,
+                       allRows.end());
+    allRows.erase(std::unique(allRows.begin(), allRows.end()), allRows.end());
+
+    // Go through the entries of each row in order, base first
+    auto forEachEntry = [&] (uint64_t row,
+                             const std::function<void (const BaseEntry &)> & onEntry)
+        {
+            if (base) {
+                base->iterateRow(row, [&] (const BaseEntry & entry)
+                                 {
+                                     onEntry(entry);
+                                     return true;
+                                 });
+            }
+            for (auto & r: rows) {
+                auto it = r->find(row);
+                if (it == r->end())
+                    continue;
+                for (auto & entry: it->second)
+                    onEntry(entry);
+            }
+        };
+
+    // First pass: count the entries and metadata bytes
+    SegmentHeader header;
+    memset(&header, 0, sizeof(header));
+    memcpy(header.magic, SEGMENT_MAGIC, 8);
+    header.version = 1;
+    header.numRows = allRows.size();
+
+    std::vector<uint64_t> firstEntries;
+    firstEntries.reserve(allRows.size() + 1);
+    for (uint64_t row: allRows) {
+        firstEntries.push_back(header.numEntries);
+        forEachEntry(row, [&] (const BaseEntry & entry)
+                     {
+                         header.numEntries += 1;
+                         for (auto & m: entry.metadata)
+                             header.metadataBytes += 4 + m.size();
+                     });
+    }
+    firstEntries.push_back(header.numEntries);
+
+    std::string tmpPath = path + ".tmp";
+    FileWriter writer(tmpPath);
+    writer.writePod(header);
+
+    for (size_t i = 0;  i <= allRows.size();  ++i) {
+        SegmentRow row;
+        row.row = i < allRows.size() ? allRows[i] : 0;
+        row.firstEntry = firstEntries[i];
+        writer.writePod(row);
+    }
+
+    uint64_t metadataOffset = 0;
+    for (uint64_t row: allRows) {
+        forEachEntry(row, [&] (const BaseEntry & entry)
+                     {
+                         SegmentEntry e;
+                         e.rowcol = entry.rowcol;
+                         e.timestamp = entry.timestamp;
+                         e.val = entry.val;
+                         e.tag = entry.tag;
+                         e.numMetadata = entry.metadata.size();
+                         e.metadataOffset = metadataOffset;
+                         for (auto & m: entry.metadata)
+                             metadataOffset += 4 + m.size();
+                         writer.writePod(e);
+                     });
+    }
+
+    for (uint64_t row: allRows) {
+        forEachEntry(row, [&] (const BaseEntry & entry)
+                     {
+                         for (auto & m: entry.metadata) {
+                             uint32_t len = m.size();
+                             writer.writePod(len);
+                             writer.write(m.data(), m.size());
+                         }
+                     });
+    }
+
+    writer.close();
+
+    if (rename(tmpPath.c_str(), path.c_str()) == -1)
+        throw MLDB::Exception(errno, "renaming " + tmpPath + " to " + path);
+    syncDirectory(path);
+}
+
+bool
+SparseMatrixSegment::
+iterateRow(uint64_t rowNum,
+           const std::function<bool (const BaseEntry & entry)> & onEntry) const
+{
+    const SegmentRow * row = itl->findRow(rowNum);
+    if (!row)
+        return true;
+    for (uint64_t i = row[0].firstEntry;  i < row[1].firstEntry;  ++i) {
+        if (!onEntry(itl->getEntry(i)))
+            return false;
+    }
+    return true;
+}
+
+bool
+SparseMatrixSegment::
+iterateRows(const std::function<bool (uint64_t row)> & onRow) const
+{
+    for (uint64_t i = 0;  i < itl->header->numRows;  ++i) {
+        if (!onRow(itl->rows[i].row))
+            return false;
+    }
+    return true;
+}
+
+bool
+SparseMatrixSegment::
+knownRow(uint64_t rowNum) const
+{
+    return itl->findRow(rowNum) != nullptr;
+}
+
+size_t
+SparseMatrixSegment::
+rowCount() const
+{
+    return itl->header->numRows;
+}
+
+size_t
+SparseMatrixSegment::
+entryCount() const
+{
+    return itl->header->numEntries;
+}
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX LOG                                                         */
+/*****************************************************************************/
+
+SparseMatrixLog::
+SparseMatrixLog(const std::string & path)
+    : path_(path), size_(0)
+{
+    fd = open(path.c_str(), O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC,
+              0644);
+    if (fd == -1)
+        throw MLDB::Exception(errno, "creating sparse matrix log " + path);
+    syncDirectory(path);
+}
+
+SparseMatrixLog::
+~SparseMatrixLog()
+{
+    close(fd);
+}
+
+std::string
+SparseMatrixLog::
+encode(const std::vector<const SparseMatrixRows *> & matrices)
+{
+    size_t len = sizeof(LogRecordHeader) + 4;
+    for (auto * m: matrices) {
+        len += 8;
+        for (auto & row: *m) {
+            len += 12 + row.second.size() * 32;
+            for (auto & entry: row.second) {
+                for (auto & md: entry.metadata)
+                    len += 4 + md.size();
+            }
+        }
+    }
+
+    size_t payloadLength = len - sizeof(LogRecordHeader);
+    if (payloadLength > std::numeric_limits<uint32_t>::max())
+        throw MLDB::Exception("sparse matrix transaction is too large to log");
+
+    // This is on the path of every commit, so it's written directly into
+    // a buffer of the right size
+    std::string result(len, '\0');
+    char * p = &result[0] + sizeof(LogRecordHeader);
+
+    auto write = [&] (const void * data, size_t n)
+        {
+            memcpy(p, data, n);
+            p += n;
+        };
+
+    auto write32 = [&] (uint32_t val) { write(&val, 4); };
+    auto write64 = [&] (uint64_t val) { write(&val, 8); };
+
+    write32(matrices.size());
+    for (auto * m: matrices) {
+        write64(m->size());
+        for (auto & row: *m) {
+            write64(row.first);
+            write32(row.second.size());
+            for (auto & entry: row.second) {
+                write64(entry.rowcol);
+                write64(entry.timestamp);
+                write64(entry.val);
+                write32(entry.tag);
+                write32(entry.metadata.size());
+                for (auto & md: entry.metadata) {
+                    write32(md.size());
+                    write(md.data(), md.size());
+                }
+            }
+        }
+    }
+
+    ExcAssertEqual(p - result.data(), len);
+
+    LogRecordHeader header;
+    header.magic = LOG_RECORD_MAGIC;
+    header.length = payloadLength;
+    header.checksum = XXH64(result.data() + sizeof(LogRecordHeader),
+                            payloadLength, 0);
+    memcpy(&result[0], &header, sizeof(header));
+
+    return result;
+}
+
+void
+SparseMatrixLog::
+append(const std::string & record)
+{
+    writeAll(fd, record.data(), record.size(), path_);
+    size_ += record.size();
+}
+
+void
+SparseMatrixLog::
+sync()
+{
+    if (fdatasync(fd) == -1)
+        throw MLDB::Exception(errno, "syncing sparse matrix log " + path_);
+}
+
+uint64_t
+SparseMatrixLog::
+replay(const std::string & path,
+       const std::function<void (std::vector<SparseMatrixRows> & matrices)> & onRecord)
+{
+    MappedFile file(path);
+
+    const char * p = file.data;
+    const char * e = file.data + file.size;
+
+    while (e - p >= (ssize_t)sizeof(LogRecordHeader)) {
+        LogRecordHeader header;
+        memcpy(&header, p, sizeof(header));
+        const char * payload = p + sizeof(header);
+        if (header.magic != LOG_RECORD_MAGIC
+            || e - payload < header.length
+            || XXH64(payload, header.length, 0) != header.checksum)
+            break;
+
+        BufferReader reader(payload, payload + header.length);
+        std::vector<SparseMatrixRows> matrices(reader.readPod<uint32_t>());
+        for (auto & m: matrices) {
+            uint64_t numRows = reader.readPod<uint64_t>();
+            m.reserve(numRows);
+            for (uint64_t i = 0;  i < numRows;  ++i) {
+                auto & row = m[reader.readPod<uint64_t>()];
+                uint32_t numEntries = reader.readPod<uint32_t>();
+                for (uint32_t j = 0;  j < numEntries;  ++j) {
+                    BaseEntry entry;
+                    entry.rowcol = reader.readPod<uint64_t>();
+                    entry.timestamp = reader.readPod<uint64_t>();
+                    entry.val = reader.readPod<uint64_t>();
+                    entry.tag = reader.readPod<uint32_t>();
+                    uint32_t numMetadata = reader.readPod<uint32_t>();
+                    for (uint32_t k = 0;  k < numMetadata;  ++k) {
+                        uint32_t len = reader.readPod<uint32_t>();
+                        entry.metadata.emplace_back(reader.readString(len));
+                    }
+                    row.emplace_back(std::move(entry));
+                }
+            }
+        }
+
+        onRecord(matrices);
+        p = payload + header.length;
+    }
+
+    return p - file.data;
+}
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX STORE                                                       */
+/*****************************************************************************/
+
+namespace {
+
+/** Return the sequence number of the file called prefix-N.suffix, or -1
+    if the name isn't of that form. */
+int64_t fileSequence(const std::string & filename,
+                     const std::string & prefix,
+                     const std::string & suffix)
+{
+    if (filename.size() <= prefix.size() + suffix.size() + 1
+        || filename.compare(0, prefix.size(), prefix) != 0
+        || filename[prefix.size()] != '-'
+        || filename.compare(filename.size() - suffix.size(), suffix.size(),
+                            suffix) != 0)
+        return -1;
+
+    std::string number
+        = filename.substr(prefix.size() + 1,
+                          filename.size() - prefix.size() - suffix.size() - 1);
+    if (number.find_first_not_of("0123456789") != std::string::npos)
+        return -1;
+    return std::stoll(number);
+}
+
+} // file scope
+
+SparseMatrixStore::
+SparseMatrixStore(const std::string & directory,
+                  std::vector<std::string> matrixNames)
+    : directory(directory), matrixNames(std::move(matrixNames)),
+      snapshotSequence(0), logSequence(0), loggedBytes(0)
+{
+    fs::create_directories(directory);
+
+    std::ifstream current(directory + "/CURRENT");
+    if (current && !(current >> snapshotSequence))
+        throw MLDB::Exception("invalid CURRENT file in sparse matrix "
+                              "directory " + directory);
+}
+
+SparseMatrixStore::
+~SparseMatrixStore()
+{
+}
+
+std::string
+SparseMatrixStore::
+logPath(int64_t sequence) const
+{
+    return directory + MLDB::format("/log-%08lld.wal", (long long)sequence);
+}
+
+std::string
+SparseMatrixStore::
+segmentPath(const std::string & matrix, int64_t sequence) const
+{
+    return directory + MLDB::format("/%s-%08lld.seg", matrix.c_str(),
+                                    (long long)sequence);
+}
+
+std::vector<std::shared_ptr<const SparseMatrixSegment> >
+SparseMatrixStore::
+loadSnapshot() const
+{
+    std::vector<std::shared_ptr<const SparseMatrixSegment> > result;
+    if (snapshotSequence == 0)
+        return result;
+
+    for (auto & m: matrixNames) {
+        result.emplace_back(std::make_shared<SparseMatrixSegment>
+                            (segmentPath(m, snapshotSequence)));
+    }
+    return result;
+}
+
+void
+SparseMatrixStore::
+recover(const std::function<void (std::vector<SparseMatrixRows> & matrices)> & onRecord)
+{
+    ExcAssert(!log);
+
+    std::vector<int64_t> logs;
+    for (fs::directory_iterator it(directory), end;  it != end;  ++it) {
+        int64_t sequence = fileSequence(it->path().filename().string(),
+                                        "log", ".wal");
+        if (sequence != -1)
+            logs.push_back(sequence);
+    }
+    std::sort(logs.begin(), logs.end());
+
+    logSequence = snapshotSequence;
+    for (int64_t sequence: logs) {
+        logSequence = std::max(logSequence, sequence);
+        if (sequence < snapshotSequence)
+            continue;
+        // A record torn by a crash ends the log; nothing was appended
+        // after it, as a new log is started each time we recover
+        loggedBytes += SparseMatrixLog::replay(logPath(sequence), onRecord);
+    }
+
+    // The logs we replayed are kept until the next snapshot includes them
+    ++logSequence;
+    log.reset(new SparseMatrixLog(logPath(logSequence)));
+
+    removeOldFiles();
+}
+
+void
+SparseMatrixStore::
+append(const std::string & record)
+{
+    ExcAssert(log);
+    log->append(record);
+    loggedBytes += record.size();
+}
+
+void
+SparseMatrixStore::
+sync()
+{
+    ExcAssert(log);
+    log->sync();
+}
+
+std::vector<std::shared_ptr<const SparseMatrixSegment> >
+SparseMatrixStore::
+snapshot(const std::vector<MatrixContents> & matrices)
+{
+    ExcAssert(log);
+    ExcAssertEqual(matrices.size(), matrixNames.size());
+
+    // Everything that's in the current log goes into the snapshot
+    log->sync();
+    int64_t sequence = logSequence + 1;
+    log.reset(new SparseMatrixLog(logPath(sequence)));
+    logSequence = sequence;
+
+    std::vector<std::shared_ptr<const SparseMatrixSegment> > result;
+    for (size_t i = 0;  i < matrices.size();  ++i) {
+        std::string path = segmentPath(matrixNames[i], sequence);
+        SparseMatrixSegment::write(path, matrices[i].segment.get(),
+                                   matrices[i].rows);
+        result.emplace_back(std::make_shared<SparseMatrixSegment>(path));
+    }
+
+    // Switch over to the new snapshot
+    std::string currentPath = directory + "/CURRENT";
+    std::string tmpPath = currentPath + ".tmp";
+    {
+        FileWriter writer(tmpPath);
+        std::string contents = std::to_string(sequence) + "\n";
+        writer.write(contents.data(), contents.size());
+        writer.close();
+    }
+    if (rename(tmpPath.c_str(), currentPath.c_str()) == -1)
+        throw MLDB::Exception(errno, "renaming " + tmpPath + " to "
+                              + currentPath);
+    syncDirectory(currentPath);
+
+    snapshotSequence = sequence;
+    loggedBytes = 0;
+
+    removeOldFiles();
+
+    return result;
+}
+
+void
+SparseMatrixStore::
+removeOldFiles()
+{
+    std::vector<fs::path> toRemove;
+
+    for (fs::directory_iterator it(directory), end;  it != end;  ++it) {
+        std::string filename = it->path().filename().string();
+
+        // Left over by a crash while writing
+        if (fs::extension(filename) == ".tmp") {
+            toRemove.push_back(it->path());
+            continue;
+        }
+
+        int64_t sequence = fileSequence(filename, "log", ".wal");
+        if (sequence != -1 && sequence < snapshotSequence) {
+            toRemove.push_back(it->path());
+            continue;
+        }
+
+        for (auto & m: matrixNames) {
+            sequence = fileSequence(filename, m, ".seg");
+            if (sequence != -1 && sequence != snapshotSequence)
+                toRemove.push_back(it->path());
+        }
+    }
+
+    // Segments that are still mapped by readers stay readable until they
+    // are unmapped
+    for (auto & path: toRemove)
+        fs::remove(path);
+}
+
+} // namespace MLDB
@@ -0,0 +1,200 @@
+/** sparse_matrix_storage.h                                        -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    On-disk storage for the sparse matrices of the sparse.mutable dataset:
+    a write-ahead log of the committed transactions, and immutable segment
+    files holding a snapshot of a matrix that are read in place.
+*/
+
+#pragma once
+
+#include <unordered_map>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+#include "sparse_matrix.h"
+
+
+namespace MLDB {
+
+
+/// Rows of a sparse matrix, indexed by row number
+typedef std::unordered_map<uint64_t, compact_vector<BaseEntry, 1> >
+SparseMatrixRows;
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX SEGMENT                                                     */
+/*****************************************************************************/
+
+/** An immutable file holding the rows of a sparse matrix.  The file is
+    memory mapped and read in place: it holds the row numbers in sorted
+    order, each one with the range of its entries in a fixed width entry
+    table, followed by the metadata strings of the entries.  A row is found
+    with a binary search, and only the pages that are touched are read, so
+    a segment doesn't need to fit in memory.
+*/
+
+struct SparseMatrixSegment {
+    /** Open the segment file at the given path.  Throws if it can't be
+        read or isn't a valid segment. */
+    SparseMatrixSegment(const std::string & path);
+
+    ~SparseMatrixSegment();
+
+    /** Write a segment holding the rows of base (which may be null)
+        followed by those of each of the rows in turn.  It is written to a
+        temporary file and synced before being renamed into place, so that
+        a segment file is always complete.
+    */
+    static void
+    write(const std::string & path,
+          const SparseMatrixSegment * base,
+          const std::vector<std::shared_ptr<const SparseMatrixRows> > & rows);
+
+    bool iterateRow(uint64_t rowNum,
+                    const std::function<bool (const BaseEntry & entry)> & onEntry) const;
+
+    /** Call onRow for each row, in increasing order of row number. */
+    bool iterateRows(const std::function<bool (uint64_t row)> & onRow) const;
+
+    bool knownRow(uint64_t rowNum) const;
+
+    size_t rowCount() const;
+
+    size_t entryCount() const;
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX LOG                                                         */
+/*****************************************************************************/
+
+/** Write-ahead log of the transactions committed to a set of sparse
+    matrices.  Each record holds the rows that a transaction wrote to each
+    of the matrices, preceded by its length and a checksum, so that a
+    record torn by a crash is recognized and ignored on recovery.
+
+    Records are only written to the operating system by append(); sync()
+    needs to be called for them to survive the machine (and not only the
+    process) going down.
+*/
+
+struct SparseMatrixLog {
+    /** Create a new log file at the given path.  Throws if it exists. */
+    SparseMatrixLog(const std::string & path);
+
+    ~SparseMatrixLog();
+
+    /** Encode the rows written to each of the matrices into a record. */
+    static std::string
+    encode(const std::vector<const SparseMatrixRows *> & matrices);
+
+    /** Append a record returned by encode().  Not thread safe. */
+    void append(const std::string & record);
+
+    /** Flush the records appended so far to disk. */
+    void sync();
+
+    /** Number of bytes in the log. */
+    uint64_t size() const { return size_; }
+
+    const std::string & path() const { return path_; }
+
+    /** Call onRecord with the rows of each of the matrices for each of the
+        records in the log at the given path, in order.  Stops at the first
+        record that is incomplete or corrupt, as written by a crash, and
+        returns the number of bytes of valid records.
+    */
+    static uint64_t
+    replay(const std::string & path,
+           const std::function<void (std::vector<SparseMatrixRows> & matrices)> & onRecord);
+
+private:
+    std::string path_;
+    int fd;
+    uint64_t size_;
+};
+
+
+/*****************************************************************************/
+/* SPARSE MATRIX STORE                                                       */
+/*****************************************************************************/
+
+/** Directory holding the durable state of a set of sparse matrices.  It
+    contains a snapshot, made of a segment for each matrix, and the logs of
+    the transactions committed since the snapshot was made, so that
+    recovery only needs to replay those.
+
+    Files are numbered with a sequence: snapshot N is made of the files
+    <matrix>-N.seg, and holds everything in the logs numbered below N.
+    The CURRENT file names the snapshot in use; it's only updated once all
+    of the segments are on disk, after which the older files are removed.
+
+    Not thread safe; the caller needs to serialize the calls.
+*/
+
+struct SparseMatrixStore {
+    /** Open (creating it if needed) the store in the given directory for
+        the matrices with the given names. */
+    SparseMatrixStore(const std::string & directory,
+                      std::vector<std::string> matrixNames);
+
+    ~SparseMatrixStore();
+
+    /** Return the segments of the current snapshot, one per matrix, or an
+        empty vector if there is no snapshot yet. */
+    std::vector<std::shared_ptr<const SparseMatrixSegment> >
+    loadSnapshot() const;
+
+    /** Call onRecord for each of the records logged since the current
+        snapshot, and then start a new log.  Must be called once, before
+        anything is appended. */
+    void recover(const std::function<void (std::vector<SparseMatrixRows> & matrices)> & onRecord);
+
+    /** Append a record returned by SparseMatrixLog::encode(). */
+    void append(const std::string & record);
+
+    /** Flush the log to disk. */
+    void sync();
+
+    /** Number of bytes logged since the current snapshot. */
+    uint64_t bytesSinceSnapshot() const { return loggedBytes; }
+
+    /// The contents of a matrix to snapshot
+    struct MatrixContents {
+        std::shared_ptr<const SparseMatrixSegment> segment;
+        std::vector<std::shared_ptr<const SparseMatrixRows> > rows;
+    };
+
+    /** Write a new snapshot with the given contents for each matrix, which
+        must include everything that has been appended to the log, and
+        return its segments.  Following records go to a new log.
+    */
+    std::vector<std::shared_ptr<const SparseMatrixSegment> >
+    snapshot(const std::vector<MatrixContents> & matrices);
+
+private:
+    std::string directory;
+    std::vector<std::string> matrixNames;
+    int64_t snapshotSequence;     ///< Current snapshot; 0 if there is none
+    int64_t logSequence;          ///< Sequence of the log we append to
+    std::unique_ptr<SparseMatrixLog> log;
+    uint64_t loggedBytes;
+
+    std::string logPath(int64_t sequence) const;
+    std::string segmentPath(const std::string & matrix,
+                            int64_t sequence) const;
+
+    /// Remove the files that the current snapshot makes redundant
+    void removeOldFiles();
+};
+
+} // namespace MLDB
@@ -12,6 +12,7 @@
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/server/bound_queries.h"
 #include "mldb/sql/table_expression_operations.h"
 #include "mldb/sql/join_utils.h"
@@ -169,6 +170,9 @@ struct SqlQueryFunctionApplier: public FunctionApplier {
 
     ExpressionValue apply(const ExpressionValue & context) const
     {
+        JobGroupScope jobGroup
+            (getQueryJobGroup(function->functionConfig.query.stm->surface));
+
         // 1.  Run our generator, finding all rows
         BoundParameters params
             = [&] (const Utf8String & name) -> ExpressionValue
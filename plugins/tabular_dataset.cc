@@ -25,7 +25,21 @@
 #include "mldb/utils/atomic_shared_ptr.h"
 #include "mldb/jml/utils/floating_point.h"
 #include "mldb/utils/log.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/sql/sql_expression_operations.h"
+#include "mldb/sql/expression_value_batch.h"
+#include "mldb/sql/sql_utils.h"
+#include "mldb/server/dataset_context.h"
+#include "mldb/rest/cancellation_exception.h"
 #include <mutex>
+#include <map>
+#include <iterator>
+#include <cstring>
+#include <cstdio>
+#include <random>
+#include <fcntl.h>
+#include <unistd.h>
 
 using namespace std;
 
@@ -34,6 +48,39 @@ namespace MLDB {
 
 static constexpr size_t NUM_PARALLEL_CHUNKS=8;
 
+namespace {
+
+struct SortByRowHash {
+    bool operator () (const RowPath & row1, const RowPath & row2)
+    {
+        RowHash h1(row1), h2(row2);
+
+        return h1 < h2 || (h1 == h2 && row1 < row2);
+    }
+};
+
+/// Sync the given local file or directory to disk
+void syncLocalPath(const std::string & path, int flags)
+{
+    int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | flags);
+    if (fd == -1)
+        throw MLDB::Exception(errno, "opening " + path + " to sync it");
+    int res = fsync(fd);
+    int err = errno;
+    close(fd);
+    if (res == -1)
+        throw MLDB::Exception(err, "syncing " + path);
+}
+
+} // file scope
+
+/// Magic numbers at the start and end of a saved tabular dataset
+static const char TABULAR_FILE_MAGIC[8] = "MLDBTBL";
+static const char TABULAR_FILE_TRAILER[8] = "TBLDONE";
+
+/// Version of the saved format; incremented on incompatible changes
+static constexpr uint32_t TABULAR_FILE_VERSION = 3;
+
 
 /*****************************************************************************/
 /* TABULAR DATA STORE                                                        */
@@ -63,39 +110,153 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     TabularDataStore(TabularDatasetConfig config,
                      shared_ptr<spdlog::logger> logger)
-        : rowCount(0), config(std::move(config)),
+        : committed(std::make_shared<Snapshot>()),
+          loaded(false), fileId(0), numSavedSegments(0),
+          compactionActive(false),
+          config(std::move(config)),
           backgroundJobsActive(0), logger(logger)
     {
     }
 
+    ~TabularDataStore()
+    {
+        // Background freezes and compactions refer to us
+        while (backgroundJobsActive)
+            ThreadPool::instance().work();
+    }
+
+    static int getRowShard(RowHash rowHash)
+    {
+        return (rowHash.hash() >> 23) % ROW_INDEX_SHARDS;
+    }
+
+    /// Number of shards of the row index, which is built in parallel
+    static constexpr size_t ROW_INDEX_SHARDS=32;
+
+    struct ColumnEntry {
+        ColumnEntry()
+            : rowCount(0)
+        {
+        }
+
+        ColumnPath columnName;
+
+        /// The number of non-null values of this row
+        size_t rowCount;
+
+        /// The set of chunks that contain the column.  This may not be all
+        /// chunks for sparse columns.
+        std::vector<std::pair<uint32_t, std::shared_ptr<const FrozenColumn> > > chunks;
+    };
+
+    /** A set of frozen chunks that were committed, or compacted, together,
+        with an index of their rows.  Runs are immutable and shared between
+        successive snapshots: a commit adds a run holding the new rows, and
+        compaction replaces small runs with a bigger one.  This way only the
+        rows that were added or moved need to be indexed.
+    */
+    struct ChunkRun {
+        ChunkRun()
+            : rowCount(0)
+        {
+        }
+
+        std::vector<std::shared_ptr<const TabularDatasetChunk> > chunks;
+
+        uint64_t rowCount;
+
+        /// Index from rowHash to (chunk within the run, indexInChunk)
+        Lightweight_Hash<RowHash, std::pair<int, int> > rowIndex
+            [ROW_INDEX_SHARDS];
+
+        std::pair<int, int> tryLookupRow(RowHash rowHash) const
+        {
+            int shard = getRowShard(rowHash);
+            auto it = rowIndex[shard].find(rowHash);
+            if (it == rowIndex[shard].end())
+                return { -1, -1 };
+            return it->second;
+        }
+    };
+
+    /** The committed contents of the dataset, which is what queries see.
+        A snapshot is never modified once it's published, so it can be read
+        without locking while more rows are recorded and committed.
+    */
+    struct Snapshot {
+        Snapshot()
+            : rowCount(0)
+        {
+        }
+
+        std::vector<std::shared_ptr<const ChunkRun> > runs;
+
+        /// The chunks of all of the runs, in order
+        std::vector<const TabularDatasetChunk *> chunks;
+
+        /// Index in chunks of the first chunk of each run
+        std::vector<int> runFirstChunk;
+
+        int64_t rowCount;
+
+        /// List of all columns in the dataset
+        std::vector<ColumnEntry> columns;
+
+        /// This indexes column names to their index, using new (fast) hash
+        Lightweight_Hash<uint64_t, int> columnIndex;
+
+        /// Same index, but using the old (slow) hash.  Useful only for when
+        /// we are forced to lookup on ColumnHash.
+        Lightweight_Hash<ColumnHash, int> columnHashIndex;
+
+        /// Return the chunk and index in the chunk of the row, or -1, -1
+        std::pair<int, int> tryLookupRow(RowHash rowHash) const
+        {
+            for (size_t i = 0;  i < runs.size();  ++i) {
+                auto found = runs[i]->tryLookupRow(rowHash);
+                if (found.first != -1)
+                    return { runFirstChunk[i] + found.first, found.second };
+            }
+            return { -1, -1 };
+        }
+    };
+
     /** A stream of row names used to incrementally query available rows
-        without creating an entire list in memory.
+        without creating an entire list in memory.  It iterates over the
+        snapshot that was current when it was created.
     */
     struct TabularDataStoreRowStream : public RowStream {
 
-        TabularDataStoreRowStream(TabularDataStore * store)
-            : store(store)
+        TabularDataStoreRowStream(const TabularDataStore * store)
+            : store(store), snapshot(store->committed.load())
+        {
+        }
+
+        TabularDataStoreRowStream(const TabularDataStore * store,
+                                  std::shared_ptr<const Snapshot> snapshot)
+            : store(store), snapshot(std::move(snapshot))
         {
         }
 
         virtual std::shared_ptr<RowStream> clone() const override
         {
-            return std::make_shared<TabularDataStoreRowStream>(store);
+            return std::make_shared<TabularDataStoreRowStream>
+                (store, snapshot);
         }
 
         virtual void initAt(size_t start) override
         {
             size_t sum = 0;
-            chunkiter = store->chunks.begin();
-            while (chunkiter != store->chunks.end()
-                   && start >= sum + chunkiter->rowCount())  {
-                sum += chunkiter->rowCount();
+            chunkiter = snapshot->chunks.begin();
+            while (chunkiter != snapshot->chunks.end()
+                   && start >= sum + (*chunkiter)->rowCount())  {
+                sum += (*chunkiter)->rowCount();
                 ++chunkiter;
             }
 
-            if (chunkiter != store->chunks.end()) {
+            if (chunkiter != snapshot->chunks.end()) {
                 rowIndex = (start - sum);
-                rowCount = chunkiter->rowCount();
+                rowCount = (*chunkiter)->rowCount();
             }
         }
 
@@ -112,16 +273,17 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 streamOffsets->clear();
 
             ssize_t startAt = 0;
-            for (auto it = store->chunks.begin();  it != store->chunks.end();
-                 ++it) {
+            for (auto it = snapshot->chunks.begin();
+                 it != snapshot->chunks.end();  ++it) {
                 if (streamOffsets)
                     streamOffsets->push_back(startAt);
-                startAt += it->rowCount();
+                startAt += (*it)->rowCount();
 
-                auto stream = std::make_shared<TabularDataStoreRowStream>(store);
+                auto stream = std::make_shared<TabularDataStoreRowStream>
+                    (store, snapshot);
                 stream->chunkiter = it;
                 stream->rowIndex = 0;
-                stream->rowCount = it->rowCount();
+                stream->rowCount = (*it)->rowCount();
 
                 streams.emplace_back(stream);
             }
@@ -144,7 +306,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         virtual const RowPath & rowName(RowPath & storage) const override
         {
-            return chunkiter->getRowPath(rowIndex, storage);
+            return (*chunkiter)->getRowPath(rowIndex, storage);
         }
 
         virtual RowPath next() override
@@ -163,9 +325,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             rowIndex++;
             if (rowIndex == rowCount) {
                 ++chunkiter;
-                if (chunkiter != store->chunks.end()) {
+                if (chunkiter != snapshot->chunks.end()) {
                     rowIndex = 0;
-                    rowCount = chunkiter->rowCount();
+                    rowCount = (*chunkiter)->rowCount();
                     ExcAssertGreater(rowCount, 0);
                 }
             }
@@ -191,8 +353,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             std::vector<int> columnIndexes;
             columnIndexes.reserve(columnNames.size());
             for (auto & c: columnNames) {
-                auto it = store->columnIndex.find(c.oldHash());
-                if (it == store->columnIndex.end()) {
+                auto it = snapshot->columnIndex.find(c.oldHash());
+                if (it == snapshot->columnIndex.end()) {
                     columnIndexes.emplace_back(-1);
                 }
                 else {
@@ -207,7 +369,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 columns.reserve(columnNames.size());
                 for (size_t i = 0;  i < columnNames.size();  ++i) {
                     columns.push_back
-                        (chunkiter->maybeGetColumn(columnIndexes[i],
+                        ((*chunkiter)->maybeGetColumn(columnIndexes[i],
                                                    columnNames[i]));
                     if (!columns.back())
                         throw HttpReturnException
@@ -250,49 +412,39 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             return extractT<CellValue>(numValues, columnNames, output);
         }
 
-        TabularDataStore* store;
-        std::vector<TabularDatasetChunk>::const_iterator chunkiter;
+        const TabularDataStore * store;
+        std::shared_ptr<const Snapshot> snapshot;
+        std::vector<const TabularDatasetChunk *>::const_iterator chunkiter;
         size_t rowIndex;   ///< Number of row within this chunk
         size_t rowCount;   ///< Total number of rows within this chunk
     };
 
-    int64_t rowCount;
+    /// What has been committed so far
+    atomic_shared_ptr<const Snapshot> committed;
 
-    /// This indexes column names to their index, using new (fast) hash
-    Lightweight_Hash<uint64_t, int> columnIndex;
+    /// Serializes commits and compactions, which publish new snapshots
+    std::mutex commitMutex;
 
-    /// Same index, but using the old (slow) hash.  Useful only for when
-    /// we are forced to lookup on ColumnHash.
-    Lightweight_Hash<ColumnHash, int> columnHashIndex;
+    /// Was the dataset loaded from a file?  If so, it can't be recorded to
+    bool loaded;
 
-    struct ColumnEntry {
-        ColumnEntry()
-            : rowCount(0)
-        {
-        }
+    /// Random identifier written into each segment of our dataFileUrl, so
+    /// that segments left over from another dataset aren't loaded
+    uint64_t fileId;
 
-        ColumnPath columnName;
+    /// Number of segments written to our dataFileUrl; one per commit
+    uint64_t numSavedSegments;
 
-        /// The number of non-null values of this row
-        size_t rowCount;
-
-        /// The set of chunks that contain the column.  This may not be all
-        /// chunks for sparse columns.
-        std::vector<std::pair<uint32_t, std::shared_ptr<const FrozenColumn> > > chunks;
-    };
+    /// Is a compaction running?
+    std::atomic<bool> compactionActive;
 
-    /// List of all columns in the dataset
-    std::vector<ColumnEntry> columns;
-    
-    /// List of the names of the fixed columns in the dataset
+    /// List of the names of the fixed columns in the dataset.  These are
+    /// set by the first row recorded, and never change afterwards.
     std::vector<ColumnPath> fixedColumns;
 
     /// Index of just the fixed columns
     Lightweight_Hash<uint64_t, int> fixedColumnIndex;
 
-    /// List of all chunks in the dataset
-    std::vector<TabularDatasetChunk> chunks;
-
     /** This structure handles a list of chunks that allows for them to be
         recorded in parallel.  It's used for the old recordRow interface.
         Most datasets should instead use the chunk oriented interface, and
@@ -304,7 +456,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     struct ChunkList {
         ChunkList(size_t n)
             : chunks(new atomic_shared_ptr<MutableTabularDatasetChunk>[n]),
-              n(n)
+              n(n), pendingFreezes(0)
         {
         }
 
@@ -347,6 +499,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         
         atomic_shared_ptr<MutableTabularDatasetChunk> * chunks;
         size_t n;
+
+        /// Number of chunks rotated out of this list that are still
+        /// being frozen
+        std::atomic<size_t> pendingFreezes;
     };
 
     // Reading of this data structure is not protected by any lock
@@ -354,17 +510,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     atomic_shared_ptr<ChunkList> mutableChunks;
 
     // Everything below here is protected by the dataset lock
-    std::vector<TabularDatasetChunk> frozenChunks;
 
-    static int getRowShard(RowHash rowHash)
-    {
-        return (rowHash.hash() >> 23) % ROW_INDEX_SHARDS;
-    }
+    /// Chunks that have been frozen but not yet committed
+    std::vector<std::shared_ptr<const TabularDatasetChunk> > frozenChunks;
 
-    /// Index from rowHash to (chunk, indexInChunk) when line number not used for rowName
-    static constexpr size_t ROW_INDEX_SHARDS=32;
-    Lightweight_Hash<RowHash, std::pair<int, int> > rowIndex
-        [ROW_INDEX_SHARDS];
     std::string filename;
     Date earliestTs, latestTs;
 
@@ -375,8 +524,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     // Return the value of the column for all rows
     virtual MatrixColumn getColumn(const ColumnPath & column) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto snapshot = committed.load();
+        auto it = snapshot->columnIndex.find(column.oldHash());
+        if (it == snapshot->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnHash", column,
                                       "knownColumns", getColumnPaths());
@@ -385,8 +535,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         MatrixColumn result;
         result.columnHash = result.columnName = column;
 
-        for (auto & c: columns[it->second].chunks) {
-            chunks.at(c.first).addToColumn(it->second, column, result.rows,
+        for (auto & c: snapshot->columns[it->second].chunks) {
+            snapshot->chunks.at(c.first)->addToColumn(it->second, column, result.rows,
                                            false /* dense */);
         }
         
@@ -396,14 +546,15 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     virtual std::vector<CellValue>
     getColumnDense(const ColumnPath & column) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto snapshot = committed.load();
+        auto it = snapshot->columnIndex.find(column.oldHash());
+        if (it == snapshot->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given name",
                                       "columnName", column,
                                       "knownColumns", getColumnPaths());
         }
 
-        const ColumnEntry & entry = columns[it->second];
+        const ColumnEntry & entry = snapshot->columns[it->second];
 
         std::vector<CellValue> result;
         result.reserve(entry.rowCount);
@@ -426,8 +577,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     virtual std::tuple<BucketList, BucketDescriptions>
     getColumnBuckets(const ColumnPath & column, int maxNumBuckets) const override
     {
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto snapshot = committed.load();
+        auto it = snapshot->columnIndex.find(column.oldHash());
+        if (it == snapshot->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given name",
                                       "columnName", column,
                                       "knownColumns", getColumnPaths());
@@ -435,6 +587,8 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         std::atomic<size_t> totalRows(0);
 
+        auto & chunks = snapshot->chunks;
+
         std::vector<std::vector<double> > numerics(chunks.size());
         std::vector<std::vector<Utf8String> > strings(chunks.size());
         std::atomic<bool> hasNulls(false);
@@ -461,9 +615,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     return true;
                 };
 
-                chunks[i].columns[it->second]->forEachDistinctValue(onValue);
+                chunks[i]->columns[it->second]->forEachDistinctValue(onValue);
 
-                totalRows += chunks[i].rowCount();
+                totalRows += chunks[i]->rowCount();
             };
         
         parallelMap(0, chunks.size(), onChunk);
@@ -494,7 +648,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     return true;
                 };
                 
-                chunks[i].columns[it->second]->forEachDense(onRow);
+                chunks[i]->columns[it->second]->forEachDense(onRow);
             };
         
         for (size_t i = 0;  i < chunks.size();  ++i)
@@ -516,19 +670,20 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     virtual uint64_t getColumnRowCount(const ColumnPath & column) const override
     {
-        return rowCount;
+        return committed.load()->rowCount;
     }
 
     virtual bool knownColumn(const ColumnPath & column) const override
     {
-        return columnIndex.count(column.oldHash());
+        return committed.load()->columnIndex.count(column.oldHash());
     }
 
     virtual std::vector<ColumnPath> getColumnPaths() const override
     {
+        auto snapshot = committed.load();
         std::vector<ColumnPath> result;
-        result.reserve(columns.size());
-        for (auto & c: columns)
+        result.reserve(snapshot->columns.size());
+        for (auto & c: snapshot->columns)
             result.push_back(c.columnName);
         return result;
     }
@@ -536,8 +691,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     // TODO: we know more than this...
     virtual KnownColumn getKnownColumnInfo(const ColumnPath & columnName) const
     {
-        auto it = columnIndex.find(columnName.oldHash());
-        if (it == columnIndex.end()) {
+        auto snapshot = committed.load();
+        auto it = snapshot->columnIndex.find(columnName.oldHash());
+        if (it == snapshot->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnName", columnName,
                                       "knownColumns", getColumnPaths());
@@ -545,7 +701,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         ColumnTypes types;
 
-        const ColumnEntry & entry = columns.at(it->second);
+        const ColumnEntry & entry = snapshot->columns.at(it->second);
 
         // Go through each chunk with a non-null value
         for (auto & c: entry.chunks) {
@@ -570,15 +726,18 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     std::vector<T>
     getRowPathsT(ssize_t start, ssize_t limit) const
     {
+        auto snapshot = committed.load();
+        auto & chunks = snapshot->chunks;
+
         std::vector<T> result;
         if (limit == -1)
-            result.reserve(std::min<ssize_t>(0, rowCount - start));
+            result.reserve(std::min<ssize_t>(0, snapshot->rowCount - start));
         else result.reserve(limit);
 
         size_t n = 0;
         for (size_t chunk = 0;  chunk < chunks.size();
-             n += chunks[chunk++].rowCount()) {
-            const TabularDatasetChunk & c = chunks[chunk];
+             n += chunks[chunk++]->rowCount()) {
+            const TabularDatasetChunk & c = *chunks[chunk];
 
             if (limit != -1 && n >= start + limit)
                 break;
@@ -612,16 +771,13 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     std::pair<int, int> tryLookupRow(const RowPath & rowName) const
     {
-        int shard = getRowShard(rowName);
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end())
-            return { -1, -1 };
-        return it->second;
+        return committed.load()->tryLookupRow(rowName);
     }
     
-    std::pair<int, int> lookupRow(const RowPath & rowName) const
+    std::pair<int, int> lookupRow(const Snapshot & snapshot,
+                                  const RowPath & rowName) const
     {
-        auto result = tryLookupRow(rowName);
+        auto result = snapshot.tryLookupRow(rowName);
         if (result.first == -1)
             throw HttpReturnException
                 (400, "Row not found in tabular dataset: "
@@ -645,57 +801,44 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         result.rowHash = rowName;
         result.rowName = rowName;
 
-        int shard = getRowShard(result.rowHash);
-
-        auto it = rowIndex[shard].find(rowName);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
-        }
+        auto snapshot = committed.load();
+        auto found = lookupRow(*snapshot, rowName);
 
         result.columns
-            = chunks.at(it->second.first)
-            .getRow(it->second.second, fixedColumns);
+            = snapshot->chunks.at(found.first)
+            ->getRow(found.second, fixedColumns);
         return result;
     }
 
     virtual ExpressionValue getRowExpr(const RowPath & rowName) const
     {
-        RowHash rowHash(rowName);
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
-            throw HttpReturnException
-                (400, "Row not found in tabular dataset: "
-                 + rowName.toUtf8String(),
-                 "rowName", rowName);
-        }
+        auto snapshot = committed.load();
+        auto found = lookupRow(*snapshot, rowName);
 
-        return chunks.at(it->second.first)
-            .getRowExpr(it->second.second, fixedColumns);
+        return snapshot->chunks.at(found.first)
+            ->getRowExpr(found.second, fixedColumns);
     }
 
     virtual RowPath getRowPath(const RowHash & rowHash) const override
     {
-        int shard = getRowShard(rowHash);
-        auto it = rowIndex[shard].find(rowHash);
-        if (it == rowIndex[shard].end()) {
+        auto snapshot = committed.load();
+        auto found = snapshot->tryLookupRow(rowHash);
+        if (found.first == -1) {
             throw HttpReturnException(400, "Row not found in tabular dataset");
         }
 
-        return chunks.at(it->second.first).getRowPath(it->second.second);
+        return snapshot->chunks.at(found.first)->getRowPath(found.second);
     }
 
     virtual ColumnPath getColumnPath(ColumnHash column) const override
     {
-        auto it = columnHashIndex.find(column);
-        if (it == columnHashIndex.end())
+        auto snapshot = committed.load();
+        auto it = snapshot->columnHashIndex.find(column);
+        if (it == snapshot->columnHashIndex.end())
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnHash", column,
                                       "knownColumns", getColumnPaths());
-        return columns[it->second].columnName;
+        return snapshot->columns[it->second].columnName;
     }
 
     virtual const ColumnStats &
@@ -705,8 +848,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         // correctly record the row counts.  We should probably remove it
         // from the interface, since it's hard for any dataset to get it
         // right.
-        auto it = columnIndex.find(column.oldHash());
-        if (it == columnIndex.end()) {
+        auto snapshot = committed.load();
+        auto it = snapshot->columnIndex.find(column.oldHash());
+        if (it == snapshot->columnIndex.end()) {
             throw HttpReturnException(400, "Tabular dataset contains no column with given hash",
                                       "columnPath", column,
                                       "knownColumns", getColumnPaths());
@@ -716,7 +860,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
         bool isNumeric = true;
 
-        for (auto & c: columns.at(it->second).chunks) {
+        for (auto & c: snapshot->columns.at(it->second).chunks) {
 
             auto onValue = [&] (const CellValue & value)
                 {
@@ -729,19 +873,19 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             c.second->forEachDistinctValue(onValue);
         }
 
-        stats.isNumeric_ = isNumeric && !chunks.empty();
-        stats.rowCount_ = rowCount;
+        stats.isNumeric_ = isNumeric && !snapshot->chunks.empty();
+        stats.rowCount_ = snapshot->rowCount;
         return stats;
     }
 
     virtual size_t getRowCount() const override
     {
-        return rowCount;
+        return committed.load()->rowCount;
     }
 
     virtual size_t getColumnCount() const override
     {
-        return columns.size();
+        return committed.load()->columns.size();
     }
 
     virtual std::pair<Date, Date> getTimestampRange() const
@@ -749,63 +893,344 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         return { earliestTs, latestTs };
     }
 
+    /// A predicate that the where clause requires of a fixed column
+    struct PushedPredicate {
+        int columnIndex;
+        FrozenColumnPredicate predicate;
+    };
+
+    /** Add to pushed the conjuncts of the where expression that are
+        simple predicates on one of the fixed columns.  Returns true if
+        that's all there is, in other words if they are equivalent to the
+        whole expression.
+    */
+    bool getPushedPredicates(const Utf8String & alias,
+                             const SqlExpression & where,
+                             std::vector<PushedPredicate> & pushed) const
+    {
+        auto getColumn = [&] (const SqlExpression & expr) -> int
+            {
+                auto read = dynamic_cast<const ReadColumnExpression *>(&expr);
+                if (!read)
+                    return -1;
+                ColumnPath columnName
+                    = removeTableName(alias, read->columnName);
+                auto it = fixedColumnIndex.find(columnName.oldHash());
+                if (it == fixedColumnIndex.end())
+                    return -1;
+                return it->second;
+            };
+
+        auto getConstant = [] (const SqlExpression & expr,
+                               CellValue & val) -> bool
+            {
+                auto constant = dynamic_cast<const ConstantExpression *>(&expr);
+                if (!constant || !constant->constant.isAtom())
+                    return false;
+                val = constant->constant.getAtom();
+                return true;
+            };
+
+        if (auto boolean
+                = dynamic_cast<const BooleanOperatorExpression *>(&where)) {
+            if (boolean->op != "AND" || !boolean->lhs || !boolean->rhs)
+                return false;
+            bool lhsPushed = getPushedPredicates(alias, *boolean->lhs, pushed);
+            bool rhsPushed = getPushedPredicates(alias, *boolean->rhs, pushed);
+            return lhsPushed && rhsPushed;
+        }
+        else if (auto comparison
+                     = dynamic_cast<const ComparisonExpression *>(&where)) {
+            typedef FrozenColumnPredicate P;
+            P::Op op;
+            bool flip = false;
+            if (comparison->op == "=" || comparison->op == "==")
+                op = P::EQUAL;
+            else if (comparison->op == "<")
+                op = P::LESS;
+            else if (comparison->op == "<=")
+                op = P::LESS_EQUAL;
+            else if (comparison->op == ">")
+                op = P::GREATER;
+            else if (comparison->op == ">=")
+                op = P::GREATER_EQUAL;
+            else return false;
+
+            CellValue val;
+            int column = getColumn(*comparison->lhs);
+            if (column == -1 || !getConstant(*comparison->rhs, val)) {
+                column = getColumn(*comparison->rhs);
+                if (column == -1 || !getConstant(*comparison->lhs, val))
+                    return false;
+                flip = true;
+            }
+
+            if (flip) {
+                switch (op) {
+                case P::LESS:           op = P::GREATER;        break;
+                case P::LESS_EQUAL:     op = P::GREATER_EQUAL;  break;
+                case P::GREATER:        op = P::LESS;           break;
+                case P::GREATER_EQUAL:  op = P::LESS_EQUAL;     break;
+                default:                break;
+                }
+            }
+
+            // A comparison with null is null, which matches nothing
+            if (val.empty())
+                pushed.push_back({ column, P(P::EQUAL, {}) });
+            else pushed.push_back({ column, P(op, { std::move(val) }) });
+            return true;
+        }
+        else if (auto in = dynamic_cast<const InExpression *>(&where)) {
+            if (in->kind != InExpression::TUPLE || in->isNegative)
+                return false;
+            int column = getColumn(*in->expr);
+            if (column == -1)
+                return false;
+            std::vector<CellValue> values;
+            for (auto & clause: in->tuple->clauses) {
+                CellValue val;
+                if (!getConstant(*clause, val))
+                    return false;
+                if (!val.empty())  // nulls are never found
+                    values.emplace_back(std::move(val));
+            }
+            pushed.push_back({ column,
+                        FrozenColumnPredicate(FrozenColumnPredicate::EQUAL,
+                                              std::move(values)) });
+            return true;
+        }
+        else if (auto isType = dynamic_cast<const IsTypeExpression *>(&where)) {
+            if (isType->type != "null")
+                return false;
+            int column = getColumn(*isType->expr);
+            if (column == -1)
+                return false;
+            pushed.push_back({ column,
+                        FrozenColumnPredicate
+                            (isType->notType
+                             ? FrozenColumnPredicate::IS_NOT_NULL
+                             : FrozenColumnPredicate::IS_NULL) });
+            return true;
+        }
+
+        return false;
+    }
+
+    /** Generate the rows matching a where expression which has predicates
+        on the fixed columns.  The zone maps of each chunk are checked
+        first, so that chunks with no possible match are skipped without
+        reading any of their values.  In the other chunks, the predicates
+        are evaluated within the frozen columns (for a table column, on
+        the codes of the values rather than the values themselves), and
+        the rest of the where expression, if there is any, is evaluated
+        on the rows that remain.
+
+        The rows are those of the snapshot that is current when this is
+        called, so that a commit in the meantime doesn't move them.
+
+        Returns an empty function when there is nothing to push down, in
+        which case the generic implementation should be used.
+    */
     GenerateRowsWhereFunction
-    generateRowsWhere(const SqlBindingScope & context,
+    generateRowsWhere(const Dataset & dataset,
+                      const SqlBindingScope & context,
+                      const Utf8String & alias,
                       const SqlExpression & where,
                       ssize_t offset,
                       ssize_t limit) const
     {
-        GenerateRowsWhereFunction result;
-        return result;
-    }
+        // Small datasets gain nothing from this; leave them with the
+        // generic implementation.  Once there are rows, the fixed columns
+        // are set and won't change.
+        std::shared_ptr<const Snapshot> snapshot = committed.load();
+        if (snapshot->rowCount < 1000)
+            return GenerateRowsWhereFunction();
+
+        std::vector<PushedPredicate> pushed;
+        bool allPushed = getPushedPredicates(alias, where, pushed);
+        if (pushed.empty())
+            return GenerateRowsWhereFunction();
+
+        std::shared_ptr<SqlExpressionDatasetScope> dsScope;
+        std::shared_ptr<BoundSqlExpression> whereBound;
+        bool needsColumns = false;
+        if (!allPushed) {
+            dsScope = std::make_shared<SqlExpressionDatasetScope>
+                (dataset, alias);
+            whereBound = std::make_shared<BoundSqlExpression>
+                (where.bind(*dsScope));
+            needsColumns = where.getUnbound().needsRow();
+        }
+
+        auto exec = [=] (ssize_t numToGenerate, Any token,
+                         const BoundParameters & params,
+                         const ProgressFunc & onProgress)
+            -> std::pair<std::vector<RowPath>, Any>
+            {
+                ExcAssertNotEqual(numToGenerate, 0);
+
+                // As for a table scan, the token is the index of the
+                // next row to scan
+                int64_t start = 0;
+                if (!token.empty())
+                    start = token.convert<size_t>();
+                int64_t end = snapshot->rowCount;
+                if (numToGenerate != -1)
+                    end = std::min<int64_t>(end, start + numToGenerate);
+
+                auto & chunks = snapshot->chunks;
+                std::vector<int64_t> chunkStarts;
+                chunkStarts.reserve(chunks.size());
+                int64_t n = 0;
+                for (auto & c: chunks) {
+                    chunkStarts.push_back(n);
+                    n += c->rowCount();
+                }
 
-    void finalize(std::vector<TabularDatasetChunk> & inputChunks,
-                  uint64_t totalRows)
-    {
-        // NOTE: must be called with the lock held
+                std::vector<std::vector<RowPath> > chunkOutputs(chunks.size());
+                std::atomic<size_t> numScanned(0);
+                ProgressState progress(std::max<int64_t>(end - start, 0));
+
+                auto onChunk = [&] (size_t chunkNum)
+                    {
+                        const TabularDatasetChunk & chunk = *chunks[chunkNum];
+                        int64_t chunkStart = chunkStarts[chunkNum];
+                        int64_t begin
+                            = std::max<int64_t>(start - chunkStart, 0);
+                        int64_t stop
+                            = std::min<int64_t>(end - chunkStart,
+                                                chunk.rowCount());
+                        if (begin >= stop)
+                            return true;
+
+                        auto reportProgress = [&] () -> bool
+                            {
+                                size_t before = numScanned.fetch_add(stop - begin);
+                                if (onProgress) {
+                                    progress = before + stop - begin;
+                                    return onProgress(progress);
+                                }
+                                return true;
+                            };
+
+                        for (auto & p: pushed) {
+                            if (!p.predicate.mayMatch
+                                (chunk.zoneMaps.at(p.columnIndex),
+                                 chunk.rowCount()))
+                                return reportProgress();
+                        }
 
-        rowCount = totalRows;
-        
-        chunks.reserve(inputChunks.size());
+                        std::vector<uint8_t> keep(chunk.rowCount(), 0);
+                        std::fill(keep.begin() + begin, keep.begin() + stop, 1);
+                        for (auto & p: pushed) {
+                            chunk.columns.at(p.columnIndex)
+                                ->filter(p.predicate, keep);
+                        }
 
-        for (auto & c: inputChunks) {
-            chunks.emplace_back(std::move(c));
-        }
+                        std::vector<size_t> candidates;
+                        for (size_t i = begin;  i < stop;  ++i) {
+                            if (keep[i])
+                                candidates.push_back(i);
+                        }
 
-        columns.reserve(fixedColumns.size());
-        for (size_t i = 0;  i < fixedColumns.size();  ++i) {
-            const ColumnPath & c = fixedColumns[i];
-            ColumnEntry entry;
-            entry.columnName = c;
-            columns.emplace_back(entry);
-            columnIndex[c.oldHash()] = i;
-            columnHashIndex[c] = i;
-        }
-
-        // Create the column index.  This should be rapid, as there shouldn't
-        // be too many columns.
-        for (size_t i = 0;  i < chunks.size();  ++i) {
-            const TabularDatasetChunk & chunk = chunks[i];
-            ExcAssertEqual(fixedColumns.size(), chunk.columns.size());
-            for (size_t j = 0;  j < chunk.columns.size();  ++j) {
-                columns[j].chunks.emplace_back(i, chunk.columns[j]);
-            }
-            for (auto & c: chunk.sparseColumns) {
-                auto it = columnIndex.insert(make_pair(c.first.oldHash(),
-                                                       columns.size()))
-                    .first;
-                if (it->second == columns.size()) {
-                    ColumnEntry entry;
-                    entry.columnName = c.first;
-                    columns.emplace_back(entry);
-                    columnHashIndex[c.first] = it->second;
+                        std::vector<RowPath> & output = chunkOutputs[chunkNum];
+
+                        if (allPushed) {
+                            output.reserve(candidates.size());
+                            for (size_t i: candidates)
+                                output.emplace_back(chunk.getRowPath(i));
+                            return reportProgress();
+                        }
+
+                        // Evaluate the rest of the where expression, a block
+                        // of rows at a time like a table scan
+                        size_t blockSize
+                            = ExpressionValueBatch::DEFAULT_BATCH_SIZE;
+                        for (size_t b = 0;  b < candidates.size();
+                             b += blockSize) {
+                            size_t e = std::min(b + blockSize,
+                                                candidates.size());
+                            std::vector<MatrixNamedRow> rows(e - b);
+                            std::vector<SqlExpressionDatasetScope::RowScope>
+                                scopes;
+                            std::vector<const SqlRowScope *> scopePtrs;
+                            scopes.reserve(e - b);
+                            scopePtrs.reserve(e - b);
+                            for (size_t i = b;  i < e;  ++i) {
+                                MatrixNamedRow & row = rows[i - b];
+                                row.rowName = chunk.getRowPath(candidates[i]);
+                                row.rowHash = row.rowName;
+                                if (needsColumns)
+                                    row.columns = chunk.getRow(candidates[i],
+                                                               fixedColumns);
+                                scopes.emplace_back
+                                    (dsScope->getRowScope(row, &params));
+                                scopePtrs.push_back(&scopes.back());
+                            }
+
+                            ExpressionValueBatch keepRows;
+                            whereBound->execBatch(scopePtrs.data(), e - b,
+                                                  keepRows, GET_LATEST);
+                            for (size_t i = b;  i < e;  ++i) {
+                                if (keepRows.isTrue(i - b))
+                                    output.emplace_back
+                                        (std::move(rows[i - b].rowName));
+                            }
+                        }
+
+                        return reportProgress();
+                    };
+
+                if (!parallelMapHaltable(0, chunks.size(), onChunk))
+                    throw CancellationException
+                        ("row where generation was cancelled");
+
+                std::vector<RowPath> result;
+                size_t numRows = 0;
+                for (auto & o: chunkOutputs)
+                    numRows += o.size();
+                result.reserve(numRows);
+                for (auto & o: chunkOutputs) {
+                    result.insert(result.end(),
+                                  std::make_move_iterator(o.begin()),
+                                  std::make_move_iterator(o.end()));
                 }
-                columns[it->second].chunks.emplace_back(i, c.second);
-            }
-        }
 
-        ExcAssertEqual(columns.size(), columnIndex.size());
-        ExcAssertEqual(columns.size(), columnHashIndex.size());
+                // Same order as the table scan would give
+                if (end - start >= 1000)
+                    parallelQuickSortRecursive<RowPath, SortByRowHash>
+                        (result.begin(), result.end());
+
+                Any newToken;
+                if (numToGenerate != -1 && end - start == numToGenerate)
+                    newToken = (size_t)end;
+
+                return { std::move(result), std::move(newToken) };
+            };
+
+        Utf8String explain
+            = Utf8String("scan tabular dataset chunks using zone maps for ")
+            + where.print();
+        return { exec, explain,
+                 GenerateRowsWhereFunction::BETTER_THAN_TABLESCAN };
+    }
+
+    /** Create a run from the given chunks, indexing their rows.  Throws
+        if a row name occurs more than once within the chunks.
+    */
+    std::shared_ptr<ChunkRun>
+    makeRun(std::vector<std::shared_ptr<const TabularDatasetChunk> > inputChunks)
+        const
+    {
+        auto run = std::make_shared<ChunkRun>();
+
+        for (auto & c: inputChunks)
+            run->rowCount += c->rowCount();
+        run->chunks = std::move(inputChunks);
+
+        auto & chunks = run->chunks;
+        auto & rowIndex = run->rowIndex;
 
         // We create the row index in multiple chunks
 
@@ -819,10 +1244,10 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                     toInsert[ROW_INDEX_SHARDS];
                 
                 // First, extract and sort them
-                for (unsigned j = 0;  j < chunks[chunkNum].rowCount();  ++j) {
+                for (unsigned j = 0;  j < chunks[chunkNum]->rowCount();  ++j) {
                     RowPath rowNameStorage;
                     const RowPath & rowName
-                        = chunks[chunkNum].getRowPath(j, rowNameStorage);
+                        = chunks[chunkNum]->getRowPath(j, rowNameStorage);
                     RowHash rowHash = rowName;
                     
                     int shard = getRowShard(rowHash);
@@ -843,29 +1268,121 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                             throw HttpReturnException
                                 (400, "Duplicate row name in tabular dataset",
                                  "rowName",
-                                 chunks[chunkNum].getRowPath(indexInChunk));
+                                 chunks[chunkNum]->getRowPath(indexInChunk));
                         }
                     }
                 }
             };
         
         parallelMap(0, chunks.size(), indexChunk);
-        
-#if 0
-        rowIndex.reserve(4 * totalRows / 3);
-        for (unsigned i = 0;  i < chunks.size();  ++i) {
-            for (unsigned j = 0;  j < chunks[i].rowCount();  ++j) {
-                RowPath rowNameStorage;
-                if (!rowIndex.insert({ chunks[i].getRowPath(j, rowNameStorage),
-                                { i, j } }).second)
-                    throw HttpReturnException
-                        (400, "Duplicate row name in tabular dataset",
-                         "rowName", chunks[i].getRowPath(j));
+
+        INFO_MSG(logger) << "row index of " << run->rowCount << " rows took "
+                         << rowIndexTimer.elapsed();
+
+        return run;
+    }
+
+    /** Throw if any of the rows of the run are already in the snapshot. */
+    void checkNoDuplicates(const Snapshot & snapshot,
+                           const ChunkRun & run) const
+    {
+        if (snapshot.rowCount == 0)
+            return;
+
+        auto checkShard = [&] (int shard)
+            {
+                for (auto & e: run.rowIndex[shard]) {
+                    if (snapshot.tryLookupRow(e.first).first != -1) {
+                        throw HttpReturnException
+                            (400, "Duplicate row name in tabular dataset",
+                             "rowName",
+                             run.chunks.at(e.second.first)
+                             ->getRowPath(e.second.second));
+                    }
+                }
+            };
+
+        parallelMap(0, ROW_INDEX_SHARDS, checkShard);
+    }
+
+    /** Add the column entries for the chunk, which will be at index
+        chunkNum in the snapshot.
+    */
+    static void addChunkColumns(Snapshot & snapshot,
+                                const TabularDatasetChunk & chunk,
+                                uint32_t chunkNum)
+    {
+        ExcAssertGreaterEqual(snapshot.columns.size(), chunk.columns.size());
+        for (size_t j = 0;  j < chunk.columns.size();  ++j) {
+            snapshot.columns[j].chunks.emplace_back(chunkNum, chunk.columns[j]);
+        }
+        for (auto & c: chunk.sparseColumns) {
+            auto it = snapshot.columnIndex.insert
+                (make_pair(c.first.oldHash(), snapshot.columns.size()))
+                .first;
+            if (it->second == snapshot.columns.size()) {
+                ColumnEntry entry;
+                entry.columnName = c.first;
+                snapshot.columns.emplace_back(entry);
+                snapshot.columnHashIndex[c.first] = it->second;
+            }
+            snapshot.columns[it->second].chunks.emplace_back(chunkNum, c.second);
+        }
+    }
+
+    /** Create the snapshot made of the given runs.  When the runs start
+        with those of previous, which is the case for a commit, its chunk
+        list and column index are extended rather than being rebuilt.
+    */
+    std::shared_ptr<Snapshot>
+    makeSnapshot(const Snapshot & previous,
+                 std::vector<std::shared_ptr<const ChunkRun> > runs) const
+    {
+        auto result = std::make_shared<Snapshot>();
+        Snapshot & snapshot = *result;
+
+        size_t numKept = 0;
+        if (!previous.runs.empty() && previous.runs.size() <= runs.size()
+            && std::equal(previous.runs.begin(), previous.runs.end(),
+                          runs.begin())) {
+            snapshot.runs = previous.runs;
+            snapshot.chunks = previous.chunks;
+            snapshot.runFirstChunk = previous.runFirstChunk;
+            snapshot.rowCount = previous.rowCount;
+            snapshot.columns = previous.columns;
+            snapshot.columnIndex = previous.columnIndex;
+            snapshot.columnHashIndex = previous.columnHashIndex;
+            numKept = previous.runs.size();
+        }
+        else {
+            // Create the column index from scratch.  This should be rapid,
+            // as there shouldn't be too many columns.
+            snapshot.columns.reserve(fixedColumns.size());
+            for (size_t i = 0;  i < fixedColumns.size();  ++i) {
+                const ColumnPath & c = fixedColumns[i];
+                ColumnEntry entry;
+                entry.columnName = c;
+                snapshot.columns.emplace_back(entry);
+                snapshot.columnIndex[c.oldHash()] = i;
+                snapshot.columnHashIndex[c] = i;
             }
         }
-#endif
-        INFO_MSG(logger) << "row index took " << rowIndexTimer.elapsed();
 
+        for (size_t i = numKept;  i < runs.size();  ++i) {
+            snapshot.runs.emplace_back(runs[i]);
+            snapshot.runFirstChunk.push_back(snapshot.chunks.size());
+            snapshot.rowCount += runs[i]->rowCount;
+            for (auto & c: runs[i]->chunks) {
+                addChunkColumns(snapshot, *c, snapshot.chunks.size());
+                snapshot.chunks.push_back(c.get());
+            }
+        }
+
+        ExcAssertEqual(snapshot.columns.size(), snapshot.columnIndex.size());
+        ExcAssertEqual(snapshot.columns.size(),
+                       snapshot.columnHashIndex.size());
+
+        return result;
     }
 
     void initialize(vector<ColumnPath> columnNames)
@@ -1146,72 +1663,580 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
         }
     };
 
+    /** Commit the rows recorded so far.  They are frozen and published
+        as a new run in a new snapshot, so that only the new rows need to
+        be indexed; the dataset can continue to be recorded to afterwards.
+    */
     void commit()
     {
-        // No mutable chunks anymore.  Atomically swap out the old pointer.
-        auto oldMutableChunks = mutableChunks.exchange(nullptr);
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
 
+        // Atomically swap out the old pointer.  New rows go into the new
+        // chunks, and will be part of the next commit.
+        auto oldMutableChunks = mutableChunks.load();
         if (!oldMutableChunks)
-            return;  // a parallel commit beat us to it
+            return;  // nothing has been recorded
 
-        for (auto & c: *oldMutableChunks) {
-            // Wait for us to have the only reference to the chunk
-            auto p = c.load();
-            // We have one reference here
-            // There is one reference inside oldMutableChunks
-            while (p.use_count() != 2) ;
-
-            if (p->rowCount() != 0)
-                freezeChunkInBackground(p);
+        {
+            auto newChunks = std::make_shared<ChunkList>(NUM_PARALLEL_CHUNKS);
+            for (auto & c: *newChunks) {
+                c.store(std::make_shared<MutableTabularDatasetChunk>
+                        (fixedColumns.size(),
+                         chunkSizeForNumColumns(fixedColumns.size())));
+            }
+            mutableChunks.store(std::move(newChunks));
+        }
 
-            c.store(nullptr);
+        for (auto & c: *oldMutableChunks) {
+            auto p = c.exchange(nullptr);
+            // Wait for us to have the only reference to the chunk; any
+            // writer still holding it will see that it has gone and
+            // move on to the new chunks.
+            while (p.use_count() != 1) ;
+
+            if (p->rowCount() != 0) {
+                ++oldMutableChunks->pendingFreezes;
+                freezeChunkInBackground(p, oldMutableChunks);
+            }
         }
 
-        // Wait for the background freeze events to finish.  We do it by
-        // busy waiting while working in between, to ensure that we don't
-        // deadlock if there are no other threads available to do the
-        // work.
-        while (backgroundJobsActive)
+        // Wait for the background freeze events to finish, including any
+        // rotations that happened before we swapped the chunks out.  We
+        // do it by busy waiting while working in between, to ensure that
+        // we don't deadlock if there are no other threads available to do
+        // the work.
+        while (oldMutableChunks->pendingFreezes)
             ThreadPool::instance().work();
 
-        // We can only take the mutex here, as the background threads need
-        // to access it.
-        std::unique_lock<std::mutex> guard(datasetMutex);
+        std::vector<std::shared_ptr<const TabularDatasetChunk> > newChunks;
+        {
+            std::unique_lock<std::mutex> guard(datasetMutex);
+            newChunks.swap(frozenChunks);
+        }
 
-        // At this point, nobody can see oldMutableChunks or its contents
-        // apart from this thread.  So we can perform operations unlocked
-        // on it without any problem.
+        auto previous = committed.load();
 
-        // Freeze all of the uncommitted chunks
-        std::atomic<size_t> totalRows(0);
+        if (newChunks.empty())
+            return;
 
-        for (auto & c: frozenChunks)
-            totalRows += c.rowCount();
+        std::shared_ptr<ChunkRun> run;
+        std::shared_ptr<const Snapshot> snapshot;
+        try {
+            run = makeRun(newChunks);
+            checkNoDuplicates(*previous, *run);
+
+            auto runs = previous->runs;
+            runs.emplace_back(run);
+            snapshot = makeSnapshot(*previous, std::move(runs));
+
+            // Save before publishing, so that if it fails the commit fails
+            // and the files keep matching what was committed.  Only the
+            // new run is written, as a new segment.
+            if (!config.dataFileUrl.empty())
+                saveSegment(*run);
+        } catch (...) {
+            // Put the chunks back, ahead of any that were frozen since, so
+            // that a failed commit doesn't lose the rows recorded
+            std::unique_lock<std::mutex> guard(datasetMutex);
+            frozenChunks.insert(frozenChunks.begin(),
+                                newChunks.begin(), newChunks.end());
+            throw;
+        }
 
-        finalize(frozenChunks, totalRows);
+        committed.store(snapshot);
 
         size_t mem = 0;
-        for (auto & c: chunks) {
-            mem += c.memusage();
+        for (auto & c: snapshot->chunks) {
+            mem += c->memusage();
         }
 
         size_t columnMem = 0;
-        for (auto & c: columns) {
+        for (auto & c: snapshot->columns) {
             size_t bytesUsed = 0;
             for (auto & chunk: c.chunks) {
                 bytesUsed += chunk.second->memusage();
             }
             TRACE_MSG(logger) << "column " << c.columnName << " used "
                  << bytesUsed << " bytes at "
-                 << 1.0 * bytesUsed / totalRows << " per row";
+                 << 1.0 * bytesUsed / snapshot->rowCount << " per row";
             columnMem += bytesUsed;
         }
 
+        INFO_MSG(logger) << "committed " << run->rowCount << " rows in "
+             << run->chunks.size() << " chunks; " << snapshot->runs.size()
+             << " runs";
         INFO_MSG(logger) << "total mem usage is " << mem << " bytes" << " for "
-             << totalRows << " rows and " << columns.size() << " columns for "
-             << 1.0 * mem / rowCount << " bytes/row";
+             << snapshot->rowCount << " rows and " << snapshot->columns.size()
+             << " columns for "
+             << 1.0 * mem / snapshot->rowCount << " bytes/row";
         INFO_MSG(logger) << "column memory is " << columnMem;
 
+        maybeCompactInBackground(*snapshot);
+    }
+
+    /// Runs with fewer rows than this are candidates for compaction
+    size_t compactionRowThreshold() const
+    {
+        return chunkSizeForNumColumns(fixedColumns.size()) / 2;
+    }
+
+    /// Number of runs of the same size tier that triggers a compaction
+    static constexpr size_t COMPACTION_MIN_RUNS = 4;
+
+    /** Size tier of a run that is at least compactionRowThreshold() rows.
+        Each tier holds runs COMPACTION_MIN_RUNS times bigger than the one
+        below it.
+    */
+    int compactionTier(const ChunkRun & run) const
+    {
+        int tier = 0;
+        for (uint64_t n = run.rowCount / compactionRowThreshold();
+             n >= COMPACTION_MIN_RUNS;  n /= COMPACTION_MIN_RUNS)
+            ++tier;
+        return tier;
+    }
+
+    /** Each commit adds a run, which for a small commit is made of small
+        chunks, and every run is probed on a row lookup.  Runs are merged
+        in the background in the manner of a size-tiered log-structured
+        merge tree, so that there are O(log n) of them:
+
+        - once there are enough small runs, their rows are re-recorded into
+          a single run with full sized chunks;
+        - otherwise, once there are enough big runs of the same size tier,
+          they are replaced by a single run sharing their chunks, for which
+          only the row index is rebuilt.
+
+        Only one compaction runs at a time.
+    */
+    void maybeCompactInBackground(const Snapshot & snapshot)
+    {
+        std::vector<std::shared_ptr<const ChunkRun> > toCompact;
+        for (auto & r: snapshot.runs) {
+            if (r->rowCount < compactionRowThreshold())
+                toCompact.emplace_back(r);
+        }
+
+        bool rechunk = toCompact.size() >= COMPACTION_MIN_RUNS;
+
+        if (!rechunk) {
+            std::map<int, std::vector<std::shared_ptr<const ChunkRun> > > tiers;
+            for (auto & r: snapshot.runs) {
+                if (r->rowCount >= compactionRowThreshold())
+                    tiers[compactionTier(*r)].emplace_back(r);
+            }
+
+            toCompact.clear();
+            for (auto & t: tiers) {
+                if (t.second.size() >= COMPACTION_MIN_RUNS) {
+                    toCompact = std::move(t.second);
+                    break;
+                }
+            }
+
+            if (toCompact.empty())
+                return;
+        }
+
+        bool expected = false;
+        if (!compactionActive.compare_exchange_strong(expected, true))
+            return;
+
+        auto job = [=] ()
+            {
+                Scope_Exit(--this->backgroundJobsActive);
+                Scope_Exit(this->compactionActive = false);
+                try {
+                    if (rechunk)
+                        compact(toCompact);
+                    else concatenateRuns(toCompact);
+                } catch (const std::exception & exc) {
+                    // The runs stay as they are; nothing is lost
+                    ERROR_MSG(logger) << "error compacting tabular dataset: "
+                                      << exc.what();
+                }
+            };
+
+        ++backgroundJobsActive;
+        try {
+            ThreadPool::instance().add(std::move(job));
+        } catch (...) {
+            --backgroundJobsActive;
+            compactionActive = false;
+            throw;
+        }
+    }
+
+    /** Merge the given runs into one, by recording their rows into new
+        chunks, and publish a snapshot in which it replaces them.
+    */
+    void compact(const std::vector<std::shared_ptr<const ChunkRun> > & toCompact)
+    {
+        Timer timer;
+
+        size_t numColumns = fixedColumns.size();
+        ColumnFreezeParameters params;
+        std::vector<std::shared_ptr<const TabularDatasetChunk> > merged;
+
+        auto newChunk = [&] ()
+            {
+                return std::make_shared<MutableTabularDatasetChunk>
+                    (numColumns, chunkSizeForNumColumns(numColumns));
+            };
+
+        auto current = newChunk();
+        std::vector<CellValue> vals(numColumns);
+
+        for (auto & run: toCompact) {
+            for (auto & chunk: run->chunks) {
+                // Gather the sparse values of each row
+                std::vector<std::vector<std::pair<ColumnPath, CellValue> > >
+                    extras(chunk->rowCount());
+                for (auto & c: chunk->sparseColumns) {
+                    auto onValue = [&] (size_t rowNum, const CellValue & val)
+                        {
+                            if (!val.empty())
+                                extras.at(rowNum).emplace_back(c.first, val);
+                            return true;
+                        };
+                    c.second->forEach(onValue);
+                }
+
+                for (size_t i = 0;  i < chunk->rowCount();  ++i) {
+                    RowPath rowName = chunk->getRowPath(i);
+                    Date ts = chunk->timestamps->get(i).mustCoerceToTimestamp();
+                    for (size_t j = 0;  j < numColumns;  ++j)
+                        vals[j] = chunk->columns[j]->get(i);
+
+                    while (current->add(rowName, ts, vals.data(), numColumns,
+                                        extras[i])
+                           != MutableTabularDatasetChunk::ADD_SUCCEEDED) {
+                        merged.emplace_back
+                            (std::make_shared<TabularDatasetChunk>
+                             (current->freeze(params)));
+                        current = newChunk();
+                    }
+                }
+            }
+        }
+
+        if (current->rowCount() != 0)
+            merged.emplace_back
+                (std::make_shared<TabularDatasetChunk>
+                 (current->freeze(params)));
+
+        auto run = makeRun(std::move(merged));
+        replaceRuns(toCompact, run);
+
+        INFO_MSG(logger) << "compacted " << toCompact.size() << " runs with "
+                         << run->rowCount << " rows into "
+                         << run->chunks.size() << " chunks in "
+                         << timer.elapsed();
+    }
+
+    /** Merge the given runs, which are made of full sized chunks, into
+        one that shares their chunks.  Only the row index is rebuilt; the
+        runs are known to have no row in common.
+    */
+    void concatenateRuns
+        (const std::vector<std::shared_ptr<const ChunkRun> > & toMerge)
+    {
+        Timer timer;
+
+        auto run = std::make_shared<ChunkRun>();
+        std::vector<int> firstChunk;
+        for (auto & r: toMerge) {
+            firstChunk.push_back(run->chunks.size());
+            run->chunks.insert(run->chunks.end(),
+                               r->chunks.begin(), r->chunks.end());
+            run->rowCount += r->rowCount;
+        }
+
+        auto indexShard = [&] (int shard)
+            {
+                size_t numRows = 0;
+                for (auto & r: toMerge)
+                    numRows += r->rowIndex[shard].size();
+                auto & index = run->rowIndex[shard];
+                index.reserve(numRows);
+                for (size_t i = 0;  i < toMerge.size();  ++i) {
+                    for (auto & e: toMerge[i]->rowIndex[shard]) {
+                        index.insert({ e.first,
+                                       { firstChunk[i] + e.second.first,
+                                         e.second.second } });
+                    }
+                }
+            };
+
+        parallelMap(0, ROW_INDEX_SHARDS, indexShard);
+
+        replaceRuns(toMerge, run);
+
+        INFO_MSG(logger) << "merged " << toMerge.size() << " runs with "
+                         << run->rowCount << " rows in "
+                         << timer.elapsed();
+    }
+
+    /** Publish a snapshot in which run takes the place of the runs in
+        toReplace, at the position of the first of them.
+    */
+    void replaceRuns
+        (const std::vector<std::shared_ptr<const ChunkRun> > & toReplace,
+         std::shared_ptr<const ChunkRun> run)
+    {
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
+        auto previous = committed.load();
+
+        std::vector<std::shared_ptr<const ChunkRun> > runs;
+        for (auto & r: previous->runs) {
+            if (std::find(toReplace.begin(), toReplace.end(), r)
+                == toReplace.end())
+                runs.emplace_back(r);
+            else if (r == toReplace[0])
+                runs.emplace_back(run);
+        }
+
+        committed.store(makeSnapshot(*previous, std::move(runs)));
+    }
+
+    /** URL of the given segment of our dataFileUrl.  The first commit
+        is saved to the dataFileUrl itself, and each later one to a file
+        next to it with the segment number appended.
+    */
+    Url segmentUrl(uint64_t segment) const
+    {
+        if (segment == 0)
+            return config.dataFileUrl;
+        return Url(config.dataFileUrl.toDecodedString()
+                   + "." + std::to_string(segment));
+    }
+
+    /** Write the chunks of the given run as the next segment of our
+        dataFileUrl, in a format that can be memory mapped back in by
+        load().  Each commit only writes the rows it adds, so committing
+        doesn't get slower as the dataset grows.  The file is never
+        compressed, as that would stop it from being mapped.
+
+        Local files are written under a temporary name in the same
+        directory, synced and renamed into place, so that a process which
+        has an older file of the same name mapped keeps on seeing all of
+        it, and a save that fails part way leaves nothing behind.  Other
+        schemes are object stores, which only create the object once it's
+        uploaded.
+
+        Must be called with the commitMutex held.
+    */
+    void saveSegment(const ChunkRun & run)
+    {
+        Timer timer;
+
+        if (numSavedSegments == 0) {
+            std::random_device random;
+            fileId = (uint64_t(random()) << 32) | random();
+        }
+
+        uint64_t segment = numSavedSegments;
+        Url dataFileUrl = segmentUrl(segment);
+        std::string uri = dataFileUrl.toDecodedString();
+        bool local = dataFileUrl.scheme() == "file";
+        std::string writtenUri
+            = local ? uri + ".tmp-" + std::to_string(getpid()) : uri;
+
+        MLDB::makeUriDirectory(uri);
+        Scope_Failure(if (local) tryEraseUriObject(writtenUri));
+
+        filter_ostream stream(writtenUri, { { "compression", "none" } });
+
+        FrozenColumnSerializer serializer(stream);
+        serializer.writeBytes(TABULAR_FILE_MAGIC, sizeof(TABULAR_FILE_MAGIC));
+        serializer.writePod<uint32_t>(TABULAR_FILE_VERSION);
+        serializer.writePod<uint64_t>(fileId);
+        serializer.writePod<uint64_t>(segment);
+
+        serializer.writePod<uint64_t>(fixedColumns.size());
+        for (auto & c: fixedColumns)
+            serializer.writePath(c);
+
+        serializer.writePod<uint64_t>(run.chunks.size());
+        for (auto & c: run.chunks)
+            c->serialize(serializer);
+
+        serializer.writeBytes(TABULAR_FILE_TRAILER,
+                              sizeof(TABULAR_FILE_TRAILER), 8);
+        stream.close();
+
+        if (local) {
+            std::string path = dataFileUrl.path();
+            std::string writtenPath = Url(writtenUri).path();
+            syncLocalPath(writtenPath, 0);
+            if (rename(writtenPath.c_str(), path.c_str()) == -1)
+                throw MLDB::Exception(errno, "renaming " + writtenPath
+                                      + " to " + path);
+            syncLocalPath(dirName(path), O_DIRECTORY);
+        }
+
+        ++numSavedSegments;
+
+        INFO_MSG(logger) << "saved " << run.rowCount << " rows in "
+                         << run.chunks.size() << " chunks to "
+                         << uri
+                         << " (" << serializer.offset() << " bytes) in "
+                         << timer.elapsed();
+    }
+
+    /** Load a dataset written by saveSegment(), from our dataFileUrl and
+        the segments that follow it.  Local files are memory mapped and the
+        column data is used in place, so that the pages are shared with any
+        other process that maps the same files.  Other URLs are read into
+        memory first.
+
+        The row names and the row index are not mapped: the names are
+        decoded into each chunk and the index is rebuilt by makeRun(),
+        which is O(number of rows).  Counts read from the files are checked
+        against their size before anything is allocated for them, so that a
+        truncated or corrupt file gives an error rather than bad_alloc.
+
+        The dataset is committed once loaded, and can't be recorded to.
+    */
+    void load()
+    {
+        Timer timer;
+
+        vector<ColumnPath> columnNames;
+        std::vector<std::shared_ptr<const TabularDatasetChunk> > loadedChunks;
+        uint64_t totalRows = 0;
+        uint64_t segment = 0;
+
+        for (;;  ++segment) {
+            Url dataFileUrl = segmentUrl(segment);
+            if (segment != 0
+                && !tryGetUriObjectInfo(dataFileUrl.toDecodedString()))
+                break;
+            if (!loadSegment(dataFileUrl, segment, columnNames,
+                             loadedChunks, totalRows))
+                break;
+        }
+
+        std::unique_lock<std::mutex> commitGuard(commitMutex);
+        initialize(std::move(columnNames));
+        loaded = true;
+        auto run = makeRun(std::move(loadedChunks));
+        committed.store(makeSnapshot(*committed.load(), { run }));
+
+        INFO_MSG(logger) << "loaded " << totalRows << " rows in "
+                         << run->chunks.size() << " chunks from "
+                         << segment << " segments of "
+                         << config.dataFileUrl.toDecodedString()
+                         << " in " << timer.elapsed();
+    }
+
+    /** Load one segment written by saveSegment(), adding its chunks to
+        chunks.  The column names are read from the first segment, and
+        must be the same in the others.  Returns false without loading
+        anything if the segment was written for another dataset, which
+        means it was left over from before our dataFileUrl was rewritten.
+    */
+    bool loadSegment(const Url & dataFileUrl, uint64_t segment,
+                     vector<ColumnPath> & columnNames,
+                     std::vector<std::shared_ptr<const TabularDatasetChunk> >
+                         & chunks,
+                     uint64_t & totalRows)
+    {
+        auto stream = std::make_shared<filter_istream>
+            (dataFileUrl.toDecodedString(),
+             std::map<std::string, std::string>
+                 { { "mapped", "true" }, { "compression", "none" } });
+
+        const char * data;
+        size_t length;
+        std::tie(data, length) = stream->mapped();
+        std::shared_ptr<const void> handle = stream;
+
+        if (!data) {
+            // Not mapped; read it into a buffer which is aligned for the
+            // arrays in the file.
+            std::string contents((std::istreambuf_iterator<char>(*stream)),
+                                 std::istreambuf_iterator<char>());
+            auto buffer = std::make_shared<std::vector<uint64_t> >
+                ((contents.size() + 7) / 8);
+            std::copy(contents.begin(), contents.end(),
+                      (char *)buffer->data());
+            data = (const char *)buffer->data();
+            length = contents.size();
+            handle = buffer;
+        }
+
+        FrozenColumnReconstituter reconstituter(data, length, handle);
+
+        if (memcmp(reconstituter.readBytes(sizeof(TABULAR_FILE_MAGIC)),
+                   TABULAR_FILE_MAGIC, sizeof(TABULAR_FILE_MAGIC)) != 0) {
+            throw HttpReturnException
+                (400, "File is not a saved tabular dataset",
+                 "dataFileUrl", dataFileUrl);
+        }
+
+        uint32_t version = reconstituter.readPod<uint32_t>();
+        if (version != TABULAR_FILE_VERSION) {
+            throw HttpReturnException
+                (400, "Saved tabular dataset has unsupported version "
+                 + std::to_string(version),
+                 "dataFileUrl", dataFileUrl,
+                 "version", version,
+                 "supportedVersion", TABULAR_FILE_VERSION);
+        }
+
+        uint64_t id = reconstituter.readPod<uint64_t>();
+        uint64_t fileSegment = reconstituter.readPod<uint64_t>();
+        if (segment == 0)
+            fileId = id;
+        else if (id != fileId)
+            return false;
+
+        if (fileSegment != segment) {
+            throw HttpReturnException
+                (400, "Saved tabular dataset segment is out of place",
+                 "dataFileUrl", dataFileUrl,
+                 "segment", fileSegment,
+                 "expectedSegment", segment);
+        }
+
+        vector<ColumnPath> fileColumnNames
+            (reconstituter.readCount(sizeof(uint32_t) /* path length */));
+        for (auto & c: fileColumnNames)
+            c = reconstituter.readPath();
+
+        if (segment == 0)
+            columnNames = std::move(fileColumnNames);
+        else if (fileColumnNames != columnNames) {
+            throw HttpReturnException
+                (400, "Saved tabular dataset segment has different columns",
+                 "dataFileUrl", dataFileUrl,
+                 "columns", fileColumnNames,
+                 "expectedColumns", columnNames);
+        }
+
+        uint64_t numChunks
+            = reconstituter.readCount(sizeof(uint64_t) /* row count */);
+        std::vector<std::shared_ptr<const TabularDatasetChunk> > loadedChunks;
+        loadedChunks.reserve(numChunks);
+        uint64_t numRows = 0;
+        for (size_t i = 0;  i < numChunks;  ++i) {
+            loadedChunks.emplace_back
+                (std::make_shared<TabularDatasetChunk>(reconstituter));
+            numRows += loadedChunks.back()->rowCount();
+        }
+
+        if (memcmp(reconstituter.readBytes(sizeof(TABULAR_FILE_TRAILER), 8),
+                   TABULAR_FILE_TRAILER, sizeof(TABULAR_FILE_TRAILER)) != 0
+            || !reconstituter.eof()) {
+            throw HttpReturnException
+                (400, "Saved tabular dataset is corrupt",
+                 "dataFileUrl", dataFileUrl);
+        }
+
+        chunks.insert(chunks.end(), loadedChunks.begin(), loadedChunks.end());
+        totalRows += numRows;
+        return true;
     }
 
     /// The number of background jobs that we're currently waiting for
@@ -1220,16 +2245,19 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
 
     // freezes a new chunk in the background, and adds it to frozenChunks.
     // Updates the number of background jobs atomically so that we can know
-    // when everything is finished.
-    void freezeChunkInBackground(std::shared_ptr<MutableTabularDatasetChunk> chunk)
+    // when everything is finished.  The chunk must already be counted in
+    // the pendingFreezes of the list it was taken from, which is
+    // decremented once it has been added.
+    void freezeChunkInBackground(std::shared_ptr<MutableTabularDatasetChunk> chunk,
+                                 std::shared_ptr<ChunkList> list)
     {
-        if (chunk->rowCount() == 0)
-            return;
-
         ColumnFreezeParameters params;
         auto job = [=] ()
             {
                 Scope_Exit(--this->backgroundJobsActive);
+                Scope_Exit(--list->pendingFreezes);
+                if (chunk->rowCount() == 0)
+                    return;
                 auto frozen = chunk->freeze(params);
                 addFrozenChunk(std::move(frozen));
             };
@@ -1239,6 +2267,7 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             ThreadPool::instance().add(std::move(job));
         } catch (...) {
             --backgroundJobsActive;
+            --list->pendingFreezes;
             throw;
         }
     }
@@ -1246,8 +2275,9 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void addFrozenChunk(TabularDatasetChunk frozen)
     {
         ExcAssertNotEqual(frozen.rowCount(), 0);
+        auto chunk = std::make_shared<TabularDatasetChunk>(std::move(frozen));
         std::unique_lock<std::mutex> guard(datasetMutex);
-        frozenChunks.emplace_back(std::move(frozen));
+        frozenChunks.emplace_back(std::move(chunk));
     }
 
     std::shared_ptr<MutableTabularDatasetChunk>
@@ -1269,6 +2299,11 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void createFirstChunks(const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
     {
         // Must be done with the dataset lock held
+        if (loaded)
+            throw HttpReturnException
+                (400, "Tabular dataset was loaded from a file, "
+                 "cannot add more rows");
+
         if (!mutableChunks.load()) {
             //need to create the mutable chunk
             vector<ColumnPath> columnNames;
@@ -1350,19 +2385,11 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
     void recordRow(RowPath rowName,
                    Vals&& vals)
     {
-        if (rowCount > 0)
-            HttpReturnException(400, "Tabular dataset has already been committed, cannot add more rows");
-
-        auto mc = mutableChunks.load();
-
-        if (!mc) {
+        if (!mutableChunks.load()) {
             std::unique_lock<std::mutex> guard(datasetMutex);
             createFirstChunks(vals);
-            mc = mutableChunks.load();
         }
 
-        ExcAssert(mc);
-
         // Prepare what we need to record
         auto rowVals = prepareRow(vals);
 
@@ -1371,12 +2398,17 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
             = std::get<1>(rowVals);
         Date ts = std::get<2>(rowVals);
 
-        int chunkNum = (rowName.hash() >> 32) % mc->n;
+        uint64_t chunkHash = rowName.hash() >> 32;
 
         for (int written = MutableTabularDatasetChunk::ADD_PERFORM_ROTATION;
              written != MutableTabularDatasetChunk::ADD_SUCCEEDED;) {
+            // A commit may swap in a new list of chunks at any time
+            auto mc = mutableChunks.load();
+            ExcAssert(mc);
+            int chunkNum = chunkHash % mc->n;
             auto chunkPtr = mc->chunks[chunkNum].load();
-            ExcAssert(chunkPtr);
+            if (!chunkPtr)
+                continue;  // being committed; the new list is coming
             written = chunkPtr->add(rowName, ts,
                                     orderedVals.data(),
                                     orderedVals.size(),
@@ -1388,14 +2420,19 @@ struct TabularDataset::TabularDataStore: public ColumnIndex, public MatrixView {
                 // We need a rotation, and we've been selected to do it
                 auto newChunk = std::make_shared<MutableTabularDatasetChunk>
                     (fixedColumns.size(), chunkSizeForNumColumns(fixedColumns.size()));
+
+                // Count the freeze before the chunk leaves the list, so
+                // that a commit which swaps the list out waits for it
+                ++mc->pendingFreezes;
                 if (mc->chunks[chunkNum]
                     .compare_exchange_strong(chunkPtr, newChunk)) {
                     // Successful rotation.  First we background freeze
                     // the chunk.  Then the old one goes in the list of
                     // uncommitted chunks.
 
-                    freezeChunkInBackground(std::move(chunkPtr));
+                    freezeChunkInBackground(std::move(chunkPtr), mc);
                 }
+                else --mc->pendingFreezes;
             }
         }
     }
@@ -1407,9 +2444,15 @@ TabularDataset(MldbServer * owner,
                const ProgressFunc & onProgress)
     : Dataset(owner)
 {
+    auto params = config.params.convert<TabularDatasetConfig>();
     itl = make_shared<TabularDataStore>(
-            config.params.convert<TabularDatasetConfig>(),
+            params,
             MLDB::getMldbLog<TabularDataset>());
+
+    if (!params.dataFileUrl.empty()
+        && tryGetUriObjectInfo(params.dataFileUrl.toDecodedString())) {
+        itl->load();
+    }
 }
 
 TabularDataset::
@@ -1422,8 +2465,9 @@ TabularDataset::
 getStatus() const
 {
     Json::Value status;
-    status["rowCount"] = itl->rowCount;
-    status["columnCount"] = itl->columns.size();
+    auto snapshot = itl->committed.load();
+    status["rowCount"] = snapshot->rowCount;
+    status["columnCount"] = snapshot->columns.size();
     return status;
 }
 
@@ -1472,9 +2516,20 @@ generateRowsWhere(const SqlBindingScope & context,
                   ssize_t limit) const
 {
     GenerateRowsWhereFunction fn
-        = itl->generateRowsWhere(context, where, offset, limit);
-    if (!fn)
+        = itl->generateRowsWhere(*this, context, alias, where,
+                                 offset, limit);
+    if (!fn) {
         fn = Dataset::generateRowsWhere(context, alias, where, offset, limit);
+
+        // The row count and the row stream need to come from the same
+        // snapshot, as a commit could happen in between
+        if (fn.rowStream) {
+            auto stream = std::make_shared
+                <TabularDataStore::TabularDataStoreRowStream>(itl.get());
+            fn.rowStream = stream;
+            fn.rowStreamTotalRows = stream->snapshot->rowCount;
+        }
+    }
     return fn;
 }
 
@@ -1556,6 +2611,12 @@ TabularDatasetConfigDescription()
              "'error' (default), or 'add' which will allow an unlimited "
              "number of sparse columns to be added.",
              UC_ERROR);
+    addField("dataFileUrl", &TabularDatasetConfig::dataFileUrl,
+             "URL of a file holding the dataset.  If the file exists, the "
+             "dataset is loaded from it (memory mapping it for local "
+             "files) and can't be recorded to.  Otherwise, the dataset "
+             "is written to this file when it is committed, so that it "
+             "can be loaded from there later.");
 }
 
 namespace {
@@ -33,6 +33,7 @@ struct TabularDatasetConfig {
     TabularDatasetConfig();
 
     UnknownColumnAction unknownColumns;
+    Url dataFileUrl;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(TabularDatasetConfig);
@@ -14,6 +14,81 @@ namespace MLDB {
 /* TABULAR DATASET CHUNK                                                     */
 /*****************************************************************************/
 
+TabularDatasetChunk::
+TabularDatasetChunk(FrozenColumnReconstituter & reconstituter)
+    : logger(getMldbLog<TabularDataset>())
+{
+    // Each row name takes at least its length, and each integer name 8
+    uint64_t numRows = reconstituter.readCount(sizeof(uint32_t));
+    bool hasRowNames = reconstituter.readPod<uint8_t>();
+    if (hasRowNames) {
+        rowNames.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i)
+            rowNames.emplace_back(reconstituter.readPath());
+    }
+    else {
+        auto data = reconstituter.readArray<uint64_t>(numRows);
+        integerRowNames.assign(data.get(), data.get() + numRows);
+    }
+
+    timestamps = reconstituter.readColumn();
+
+    // Each column takes at least its format name's length
+    columns.resize(reconstituter.readCount(sizeof(uint64_t)));
+    for (auto & c: columns)
+        c = reconstituter.readColumn();
+
+    zoneMaps.resize(columns.size());
+    for (auto & z: zoneMaps) {
+        z.minValue = reconstituter.readCellValue();
+        z.maxValue = reconstituter.readCellValue();
+        z.numNulls = reconstituter.readPod<uint64_t>();
+    }
+
+    uint64_t numSparse
+        = reconstituter.readCount(sizeof(uint32_t) + sizeof(uint64_t));
+    sparseColumns.reserve(numSparse);
+    for (size_t i = 0;  i < numSparse;  ++i) {
+        Path columnName = reconstituter.readPath();
+        sparseColumns.emplace(std::move(columnName),
+                              reconstituter.readColumn());
+    }
+}
+
+void
+TabularDatasetChunk::
+serialize(FrozenColumnSerializer & serializer) const
+{
+    serializer.writePod<uint64_t>(rowCount());
+    serializer.writePod<uint8_t>(!rowNames.empty());
+    if (!rowNames.empty()) {
+        for (auto & r: rowNames)
+            serializer.writePath(r);
+    }
+    else {
+        serializer.writeArray(integerRowNames.data(), integerRowNames.size());
+    }
+
+    serializer.writeColumn(*timestamps);
+
+    serializer.writePod<uint64_t>(columns.size());
+    for (auto & c: columns)
+        serializer.writeColumn(*c);
+
+    ExcAssertEqual(zoneMaps.size(), columns.size());
+    for (auto & z: zoneMaps) {
+        serializer.writeCellValue(z.minValue);
+        serializer.writeCellValue(z.maxValue);
+        serializer.writePod<uint64_t>(z.numNulls);
+    }
+
+    serializer.writePod<uint64_t>(sparseColumns.size());
+    for (auto & c: sparseColumns) {
+        serializer.writePath(c.first);
+        serializer.writeColumn(*c.second);
+    }
+}
+
 size_t
 TabularDatasetChunk::
 memusage() const
@@ -217,10 +292,19 @@ freeze(const ColumnFreezeParameters & params)
 
     TabularDatasetChunk result;
     result.columns.resize(columns.size());
+    result.zoneMaps.resize(columns.size());
     result.sparseColumns.reserve(sparseColumns.size());
 
-    for (unsigned i = 0;  i < columns.size();  ++i)
+    for (unsigned i = 0;  i < columns.size();  ++i) {
+        // The distinct values are consumed by the freeze, so the zone map
+        // needs to be taken first
+        ColumnZoneMap & zoneMap = result.zoneMaps[i];
+        for (auto & v: columns[i].indexedVals)
+            zoneMap.update(v);
+        zoneMap.numNulls = rowCount_ - columns[i].sparseIndexes.size();
+
         result.columns[i] = columns[i].freeze(params);
+    }
     for (auto & c: sparseColumns)
         result.sparseColumns.emplace(c.first, c.second.freeze(params));
 
@@ -39,6 +39,9 @@ struct TabularDatasetChunk {
     {
     }
 
+    /// Reconstitute a chunk that was written with serialize()
+    TabularDatasetChunk(FrozenColumnReconstituter & reconstituter);
+
     TabularDatasetChunk(TabularDatasetChunk && other) noexcept
     {
         swap(other);
@@ -53,6 +56,7 @@ struct TabularDatasetChunk {
     void swap(TabularDatasetChunk & other) noexcept
     {
         columns.swap(other.columns);
+        zoneMaps.swap(other.zoneMaps);
         sparseColumns.swap(other.sparseColumns);
         rowNames.swap(other.rowNames);
         integerRowNames.swap(other.integerRowNames);
@@ -67,6 +71,9 @@ struct TabularDatasetChunk {
 
     size_t memusage() const;
 
+    /// Write the chunk so that it can be memory mapped back in
+    void serialize(FrozenColumnSerializer & serializer) const;
+
     const FrozenColumn *
     maybeGetColumn(size_t columnIndex, const PathElement & columnName) const;
 
@@ -80,6 +87,10 @@ struct TabularDatasetChunk {
     maybeGetColumn(size_t columnIndex, const Path & columnName) const;
 
     std::vector<std::shared_ptr<FrozenColumn> > columns;
+
+    /// Zone map of each of the dense columns, in the same order
+    std::vector<ColumnZoneMap> zoneMaps;
+
     std::unordered_map<Path, std::shared_ptr<FrozenColumn>, PathNewHasher> sparseColumns;
 private:
     std::vector<Path> rowNames;
@@ -139,4 +139,56 @@ expected = [["_rowName","a","b","c"],
 
 assert res == expected
 
+mldb.log("Bulk copy and streaming import")
+# Enough rows for several COPYs and several chunks on import, with values
+# that need to be escaped and missing columns
+bulk = mldb.create_dataset({'type': 'sparse.mutable', 'id': 'bulk'})
+for i in range(25000):
+    cols = [["k", i, now], ["s", "tab\tnew\nline\\ 'quoted' %d" % i, now]]
+    if i % 3 != 0:
+        cols.append(["v", i + 0.25, now])
+    bulk.record_row("row%d" % i, cols)
+bulk.commit()
+
+mldb.post('/v1/procedures', {
+    'type': 'transform',
+    'params': {
+        'inputData': 'SELECT k, s, v FROM bulk',
+        'outputDataset': {
+            'type' : 'postgresql.recorder',
+            'id' : 'postgresqlbulk',
+            'params': {
+                'createTable' : True,
+                'databaseName' : 'mldb',
+                'tableName' : 'bulktable',
+                'dropTableIfExist' : True,
+                'rowsPerCopy' : 7000
+            }
+        },
+        'runOnCreation': True
+    }
+})
+
+mldb.post('/v1/procedures', {
+    'type': 'postgresql.import',
+    'params': {
+        'databaseName' : 'mldb',
+        'postgresqlQuery' : 'select k, s, v from bulktable order by k',
+        'runOnCreation': True,
+        'outputDataset' : {
+            'id' : 'bulkout',
+            'type' : 'sparse.mutable'
+        }
+    }
+})
+
+res = mldb.query("select count(*), count(v) from bulkout")
+assert res[1][1:] == [25000, 16666], res
+
+res = mldb.query("select k, s, v from bulkout where rowName() = 'row_12345'")
+assert res[1][1:] == [12345, "tab\tnew\nline\\ 'quoted' 12345", None], res
+
+res = mldb.query("select k, v from bulkout where rowName() = 'row_24998'")
+assert res[1][1:] == [24998, 24998.25], res
+
 mldb.script.set_return("success")
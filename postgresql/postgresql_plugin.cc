@@ -10,10 +10,19 @@
 #include "mldb/soa/credentials/credentials.h"
 #include "mldb/types/structure_description.h"
 #include "mldb/types/any_impl.h"
+#include "mldb/types/basic_value_descriptions.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/utils/progress.h"
+#include "mldb/utils/log.h"
 
 #include <postgresql/libpq-fe.h>
 
 #include <unordered_set>
+#include <unordered_map>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
 
 using namespace std;
 
@@ -80,6 +89,32 @@ pg_conn* startPostgresqlConnection(const string& databaseName, const string& hos
     return conn;
 }
 
+/// Connection that is closed when it goes out of scope
+typedef std::unique_ptr<pg_conn, decltype(&PQfinish)> PostgresqlConnection;
+
+/// Append the value to a row of a text format COPY, escaping the
+/// characters that have a special meaning in that format
+void appendCopyValue(string & row, const CellValue & cell)
+{
+    if (cell.empty()) {
+        row += "\\N";
+        return;
+    }
+
+    string str = cell.isString()
+        ? cell.toUtf8String().rawString() : cell.toString();
+
+    for (char c: str) {
+        switch (c) {
+        case '\\': row += "\\\\"; break;
+        case '\n': row += "\\n"; break;
+        case '\r': row += "\\r"; break;
+        case '\t': row += "\\t"; break;
+        default:   row += c;
+        }
+    }
+}
+
 }
 
 /*****************************************************************************/
@@ -317,6 +352,7 @@ struct PostgresqlRecorderDatasetConfig {
     string tableName;
     bool createTable;
     bool dropTableIfExist;
+    int rowsPerCopy;
 
     PostgresqlRecorderDatasetConfig() {
         databaseName = "database";
@@ -325,6 +361,7 @@ struct PostgresqlRecorderDatasetConfig {
         tableName = "mytable";
         createTable = false;
         dropTableIfExist = false;
+        rowsPerCopy = 10000;
     }
 };
 
@@ -340,12 +377,27 @@ PostgresqlRecorderDatasetConfigDescription()
     addField("tableName", &PostgresqlRecorderDatasetConfig::tableName, "Name of the table to be recorded into");
     addField("createTable", &PostgresqlRecorderDatasetConfig::createTable, "Should we create the table when the dataset is created", false);
     addField("dropTableIfExist", &PostgresqlRecorderDatasetConfig::dropTableIfExist, "Should we drop an existing PostgreSQL table when creating it", false);
+    addField("rowsPerCopy", &PostgresqlRecorderDatasetConfig::rowsPerCopy,
+             "Number of recorded rows that are buffered and then sent to "
+             "PostgreSQL in a single COPY.  Rows that are still buffered "
+             "are sent when the dataset is committed.", 10000);
 }
 
 struct PostgresqlRecorderDataset: public Dataset {
 
+    typedef std::vector<std::tuple<ColumnPath, CellValue, Date> > RowValues;
+
     PostgresqlRecorderDatasetConfig config_;
+
+    /// Rows recorded but not yet copied to PostgreSQL
+    std::vector<RowValues> pendingRows;
+    std::mutex pendingRowsMutex;
+
+    /// Columns that were added to the table, protected by columnsMutex
     std::unordered_set<ColumnPath> insertedColumns;
+    std::mutex columnsMutex;
+
+    shared_ptr<spdlog::logger> logger;
 
     pg_conn* startConnection() 
     {
@@ -355,7 +407,8 @@ struct PostgresqlRecorderDataset: public Dataset {
     PostgresqlRecorderDataset(MldbServer * owner,
                  PolyConfig config,
                  const ProgressFunc & onProgress)
-        : Dataset(owner)
+        : Dataset(owner),
+          logger(MLDB::getMldbLog<PostgresqlRecorderDataset>())
     {
         config_ = config.params.convert<PostgresqlRecorderDatasetConfig>();
 
@@ -398,6 +451,13 @@ struct PostgresqlRecorderDataset: public Dataset {
     
     virtual ~PostgresqlRecorderDataset()
     {
+        // Don't lose the rows recorded since the last commit
+        try {
+            copyPendingRows();
+        } catch (const std::exception & exc) {
+            ERROR_MSG(logger) << "error copying rows to PostgreSQL table "
+                              << config_.tableName << ": " << exc.what();
+        }
     }
 
     virtual Any getStatus() const override
@@ -429,12 +489,16 @@ struct PostgresqlRecorderDataset: public Dataset {
         }
     }
 
-    void alterColumns(pg_conn* conn, const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals)
+    void alterColumns(pg_conn* conn, const RowValues & vals)
     {
+        std::unique_lock<std::mutex> guard(columnsMutex);
+
         for (auto& p : vals) {
+            // The type of the column is that of its first non-null value
+            if (std::get<1>(p).empty())
+                continue;
             ColumnPath column = std::get<0>(p);
             if (insertedColumns.count(column) == 0){
-                insertedColumns.insert(column);
                 string alterString = "ALTER TABLE " +
                                      config_.tableName +
                                      " ADD COLUMN " +
@@ -448,84 +512,166 @@ struct PostgresqlRecorderDataset: public Dataset {
                 if (PQresultStatus(res) != PGRES_COMMAND_OK) {
                     string errorMsg(PQresultErrorMessage(res));
                     PQclear(res);
-                    PQfinish(conn);
                     throw HttpReturnException(400, "Could not alter PostgreSQL table:  ", errorMsg);
                 }
 
                 PQclear(res);
+                insertedColumns.insert(column);
             }
         }
     }
 
-    void insertRowPostgresql(pg_conn* conn, const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) 
+    /** Send the rows to PostgreSQL with a single COPY, in text format so
+        that PostgreSQL converts each value to the type of its column like
+        it would for a literal in an INSERT.  Columns that a row doesn't
+        have are set to NULL.
+    */
+    void copyRows(const std::vector<RowValues> & rows)
     {
-        alterColumns(conn, vals);
+        if (rows.empty())
+            return;
+
+        PostgresqlConnection conn(startConnection(), &PQfinish);
+
+        // Columns of the COPY, in the order that they first appear.
+        // Those with only null values are left out.
+        std::unordered_map<ColumnPath, int> columnIndexes;
+        string copyString = "COPY " + config_.tableName + " (";
+
+        for (auto & vals: rows) {
+            alterColumns(conn.get(), vals);
+            for (auto & p: vals) {
+                const ColumnPath & column = std::get<0>(p);
+                if (std::get<1>(p).empty() || columnIndexes.count(column))
+                    continue;
+                if (!columnIndexes.empty())
+                    copyString += ",";
+                copyString += column.toUtf8String().rawString();
+                int index = columnIndexes.size();
+                columnIndexes[column] = index;
+            }
+        }
 
-        string insertString = "INSERT INTO " + config_.tableName + " (";
+        // Rows with only nulls have nothing to write
+        if (columnIndexes.empty())
+            return;
 
-        bool first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
-            }
-            first = false;
-            insertString += std::get<0>(p).toUtf8String().rawString();
+        copyString += ") FROM STDIN";
+
+        POSTGRESQL_VERBOSE(cerr << copyString << endl;)
+
+        auto res = PQexec(conn.get(), copyString.c_str());
+        if (PQresultStatus(res) != PGRES_COPY_IN) {
+            string errorMsg(PQresultErrorMessage(res));
+            PQclear(res);
+            throw HttpReturnException(400, "Could not copy data into PostgreSQL table:  ", errorMsg);
         }
+        PQclear(res);
+
+        // Send the data in blocks of around a megabyte
+        static constexpr size_t COPY_BLOCK_SIZE = 1024 * 1024;
+
+        auto sendData = [&] (const string & data)
+            {
+                if (PQputCopyData(conn.get(), data.data(), data.size()) != 1) {
+                    throw HttpReturnException(400, "Could not copy data into PostgreSQL table:  ",
+                                              string(PQerrorMessage(conn.get())));
+                }
+            };
+
+        string data;
+        std::vector<const CellValue *> rowCells(columnIndexes.size());
+        for (auto & vals: rows) {
+            std::fill(rowCells.begin(), rowCells.end(), nullptr);
+            for (auto & p: vals) {
+                auto it = columnIndexes.find(std::get<0>(p));
+                if (it != columnIndexes.end())
+                    rowCells[it->second] = &std::get<1>(p);
+            }
 
-        insertString += ") VALUES (";
+            for (size_t i = 0;  i < rowCells.size();  ++i) {
+                if (i != 0)
+                    data += '\t';
+                if (rowCells[i])
+                    appendCopyValue(data, *rowCells[i]);
+                else data += "\\N";
+            }
+            data += '\n';
 
-        first = true;
-        for (auto& p : vals) {                
-            if (!first) {
-                insertString += ",";                    
+            if (data.size() >= COPY_BLOCK_SIZE) {
+                sendData(data);
+                data.clear();
             }
-            first = false;
-            auto& cell = std::get<1>(p);
-            if (cell.isString())
-                insertString += "'" + cell.toString() + "'";
-            else
-                insertString += cell.toString();
         }
 
-        insertString += ")";
+        if (!data.empty())
+            sendData(data);
 
-        POSTGRESQL_VERBOSE(cerr << insertString << endl;)
+        if (PQputCopyEnd(conn.get(), nullptr) != 1) {
+            throw HttpReturnException(400, "Could not copy data into PostgreSQL table:  ",
+                                      string(PQerrorMessage(conn.get())));
+        }
 
-        auto res = PQexec(conn, insertString.c_str());
-        if (PQresultStatus(res) != PGRES_COMMAND_OK) {
-            string errorMsg(PQresultErrorMessage(res));
+        // Errors in the data are only reported once the copy is finished
+        string errorMsg;
+        while ((res = PQgetResult(conn.get()))) {
+            if (PQresultStatus(res) != PGRES_COMMAND_OK && errorMsg.empty())
+                errorMsg = PQresultErrorMessage(res);
             PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not insert data in PostgreSQL table:  ", errorMsg);
         }
 
-        PQclear(res);
+        if (!errorMsg.empty())
+            throw HttpReturnException(400, "Could not copy data into PostgreSQL table:  ", errorMsg);
+
+        POSTGRESQL_VERBOSE(cerr << rows.size() << " rows copied to " << config_.tableName << endl;)
     }
 
-    virtual void recordRowItl(const RowPath & rowName,
-                              const std::vector<std::tuple<ColumnPath, CellValue, Date> > & vals) override
+    /// Copy the rows that are buffered, if there are any
+    void copyPendingRows()
     {
-        auto conn = startConnection();
+        std::vector<RowValues> rows;
+        {
+            std::unique_lock<std::mutex> guard(pendingRowsMutex);
+            rows.swap(pendingRows);
+        }
 
-        insertRowPostgresql(conn, vals);
+        copyRows(rows);
+    }
 
-        PQfinish(conn);
+    virtual void recordRowItl(const RowPath & rowName,
+                              const RowValues & vals) override
+    {
+        std::vector<RowValues> rows;
+        {
+            std::unique_lock<std::mutex> guard(pendingRowsMutex);
+            pendingRows.emplace_back(vals);
+            if (pendingRows.size() < (size_t)config_.rowsPerCopy)
+                return;
+            rows.swap(pendingRows);
+        }
+
+        copyRows(rows);
     }
     
-    virtual void recordRows(const std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > & rows) override
+    virtual void recordRows(const std::vector<std::pair<RowPath, RowValues> > & rows) override
     {
-        auto conn = startConnection();
-
-        for (auto& vals : rows) {
-            insertRowPostgresql(conn, vals.second);
-        }        
+        std::vector<RowValues> toCopy;
+        {
+            std::unique_lock<std::mutex> guard(pendingRowsMutex);
+            for (auto & row: rows)
+                pendingRows.emplace_back(row.second);
+            if (pendingRows.size() < (size_t)config_.rowsPerCopy)
+                return;
+            toCopy.swap(pendingRows);
+        }
 
-        PQfinish(conn);
+        copyRows(toCopy);
     }
 
-    /** Commit changes to the database.  Default is a no-op. */
+    /** Copy the rows that haven't been sent to the database yet. */
     virtual void commit() override
     {
+        copyPendingRows();
     }
 
     virtual std::pair<Date, Date> getTimestampRange() const override
@@ -634,43 +780,169 @@ struct PostgresqlImportProcedure: public Procedure {
         auto runProcConf = applyRunConfOverProcConf(procedureConfig, run);
 
         // Connect to Postgresl database
-        auto conn = startConnection(runProcConf);
+        PostgresqlConnection conn(startConnection(runProcConf), &PQfinish);
 
         // Create the output
         std::shared_ptr<Dataset> output =
         createDataset(server, runProcConf.outputDataset, nullptr, true ); //overwrite
 
-        //query the rows
-        auto res = PQexec(conn, runProcConf.postgresqlQuery.c_str());
-        if (PQresultStatus(res) != PGRES_TUPLES_OK)
-        {
-            string errorMsg = PQresultErrorMessage(res);
-            PQclear(res);
-            PQfinish(conn);
-            throw HttpReturnException(400, "Could not query PostgreSQL database", errorMsg);
+        // Query the rows in single row mode, so that they are streamed
+        // from the server instead of all being buffered in libpq
+        if (!PQsendQuery(conn.get(), runProcConf.postgresqlQuery.c_str())
+            || !PQsetSingleRowMode(conn.get())) {
+            throw HttpReturnException(400, "Could not query PostgreSQL database",
+                                      string(PQerrorMessage(conn.get())));
         }
 
-        int nfields = PQnfields(res);
-        int ntuples = PQntuples(res);
+        Progress progress;
+        std::shared_ptr<Step> iterationStep = progress.steps({
+            make_pair("iterating", "rows"),
+        });
 
-        std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
-        for(int i = 0; i < ntuples; i++) {
-            std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
-            for(int j = 0; j < nfields; j++) {
-                cols.emplace_back(ColumnPath(PQfname(res, j)), getCellValueFromPostgres(res, i, j), Date::Date::notADate());
+        Dataset::MultiChunkRecorder recorder = output->getChunkRecorder();
+
+        // Chunks of rows are converted and recorded in parallel, while
+        // this thread keeps reading from the connection.  The reader waits
+        // once there are too many chunks in flight, so that a server that
+        // is faster than the recording can't fill up the memory with
+        // results.
+        static constexpr size_t ROWS_PER_CHUNK = 10000;
+        const size_t maxChunksInFlight = std::max(2, numCpus());
+
+        std::mutex inFlightMutex;
+        std::condition_variable inFlightChanged;
+        size_t chunksInFlight = 0;
+
+        std::vector<ColumnPath> columnNames;
+        std::mutex excMutex;
+        std::exception_ptr exc;
+
+        auto recordChunk = [&] (size_t chunkNumber, size_t firstRow,
+                                std::shared_ptr<std::vector<PGresult *> > chunk)
+            {
+                try {
+                    std::vector<std::pair<RowPath, std::vector<std::tuple<ColumnPath, CellValue, Date> > > > rows;
+                    rows.reserve(chunk->size());
+                    for (size_t i = 0;  i < chunk->size();  ++i) {
+                        PGresult * res = (*chunk)[i];
+                        std::vector<std::tuple<ColumnPath, CellValue, Date> > cols;
+                        for (size_t j = 0;  j < columnNames.size();  ++j) {
+                            cols.emplace_back(columnNames[j], getCellValueFromPostgres(res, 0, j), Date::Date::notADate());
+                        }
+                        rows.emplace_back(Path(string("row_" + std::to_string(firstRow + i))), std::move(cols));
+                    }
+
+                    auto chunkRecorder = recorder.newChunk(chunkNumber);
+                    chunkRecorder->recordRowsDestructive(std::move(rows));
+                    chunkRecorder->finishedChunk();
+                } catch (...) {
+                    std::unique_lock<std::mutex> guard(excMutex);
+                    if (!exc)
+                        exc = std::current_exception();
+                }
+
+                for (auto res: *chunk)
+                    PQclear(res);
+
+                std::unique_lock<std::mutex> guard(inFlightMutex);
+                --chunksInFlight;
+                inFlightChanged.notify_all();
+            };
+
+        ThreadPool tp;
+        auto chunk = std::make_shared<std::vector<PGresult *> >();
+        size_t numRows = 0;
+        size_t numChunks = 0;
+        bool failed = false;
+        string errorMsg;
+        bool cancelled = false;
+
+        auto submitChunk = [&] ()
+            {
+                if (chunk->empty())
+                    return;
+                size_t chunkNumber = numChunks++;
+                size_t firstRow = numRows - chunk->size();
+                auto toRecord = std::move(chunk);
+                chunk = std::make_shared<std::vector<PGresult *> >();
+
+                std::unique_lock<std::mutex> guard(inFlightMutex);
+                while (chunksInFlight >= maxChunksInFlight) {
+                    // Help record the chunks rather than only waiting
+                    guard.unlock();
+                    tp.work();
+                    guard.lock();
+                    if (chunksInFlight >= maxChunksInFlight)
+                        inFlightChanged.wait_for
+                            (guard, std::chrono::milliseconds(10));
+                }
+                ++chunksInFlight;
+                guard.unlock();
+
+                tp.add([=] () { recordChunk(chunkNumber, firstRow, toRecord); });
+            };
+
+        // All of the results need to be read, even after an error, to leave
+        // the connection in a usable state
+        while (PGresult * res = PQgetResult(conn.get())) {
+            ExecStatusType status = PQresultStatus(res);
+            if (status != PGRES_SINGLE_TUPLE || cancelled || failed) {
+                // The last result of a successful query is an empty one
+                if (status != PGRES_SINGLE_TUPLE && status != PGRES_TUPLES_OK
+                    && !failed) {
+                    failed = true;
+                    errorMsg = PQresultErrorMessage(res);
+                }
+                PQclear(res);
+                continue;
+            }
+
+            if (columnNames.empty()) {
+                for (int j = 0;  j < PQnfields(res);  ++j)
+                    columnNames.emplace_back(PQfname(res, j));
+            }
+
+            chunk->push_back(res);
+            ++numRows;
+
+            if (chunk->size() == ROWS_PER_CHUNK)
+                submitChunk();
+
+            if (numRows % PROGRESS_RATE_LOW == 0) {
+                iterationStep->value = numRows;
+                if (!onProgress(jsonEncode(iterationStep))) {
+                    // Ask the server to stop sending rows
+                    PGcancel * cancel = PQgetCancel(conn.get());
+                    char buf[256];
+                    PQcancel(cancel, buf, sizeof(buf));
+                    PQfreeCancel(cancel);
+                    cancelled = true;
+                }
             }
-            rows.emplace_back(Path(string("row_" + std::to_string(i))), std::move(cols));            
         }
 
-        output->recordRows(rows);
+        submitChunk();
+        tp.waitForAll();
+
+        if (cancelled) {
+            throw CancellationException(std::string(PostgresqlImportConfig::name)
+                                        + " procedure was cancelled");
+        }
+
+        if (failed)
+            throw HttpReturnException(400, "Could not query PostgreSQL database", errorMsg);
+
+        if (exc)
+            std::rethrow_exception(exc);
+
+        iterationStep->value = numRows;
+        onProgress(jsonEncode(iterationStep));
 
         // Save the dataset we created
-        output->commit();
+        recorder.commit();
 
         result = output->getStatus();
 
-        PQclear(res);
-        PQfinish(conn);
         return result;
     }
 };
@@ -13,6 +13,7 @@
 #include "mldb/io/tcp_acceptor.h"
 #include "http_rest_endpoint.h"
 #include "mldb/utils/log.h"
+#include "mldb/arch/format.h"
 #include <iomanip>
 
 using namespace std;
@@ -246,7 +247,13 @@ sendHttpChunk(std::string chunk,
               NextAction next,
               OnWriteFinished onWriteFinished)
 {
-    HttpLegacySocketHandler::send(std::move(chunk), next, onWriteFinished);
+    // Each chunk is preceded by its length in hex; an empty one (with no
+    // trailers) ends the payload
+    std::string framed = MLDB::format("%zx\r\n", chunk.size());
+    framed.reserve(framed.size() + chunk.size() + 2);
+    framed.append(chunk);
+    framed.append("\r\n");
+    HttpLegacySocketHandler::send(std::move(framed), next, onWriteFinished);
 }
 
 inline void
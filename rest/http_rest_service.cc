@@ -181,13 +181,61 @@ void
 HttpRestConnection::
 sendPayload(std::string payload)
 {
+    if (!pendingWrites)
+        pendingWrites = std::make_shared<PendingWrites>();
+
+    size_t bytes = payload.size();
+    {
+        std::unique_lock<std::mutex> guard(pendingWrites->mutex);
+        pendingWrites->bytes += bytes;
+    }
+
+    auto pending = pendingWrites;
+    auto onWritten = [pending, bytes] ()
+        {
+            std::unique_lock<std::mutex> guard(pending->mutex);
+            pending->bytes -= bytes;
+            pending->cv.notify_all();
+        };
+
     if (chunkedEncoding) {
         if (payload.empty()) {
             throw MLDB::Exception("Can't send empty chunk over a chunked connection");
         }
-        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE);
+        http->sendHttpChunk(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE,
+                            onWritten);
     }
-    else http->send(std::move(payload));
+    else http->send(std::move(payload), HttpLegacySocketHandler::NEXT_CONTINUE,
+                    onWritten);
+}
+
+bool
+HttpRestConnection::
+waitUntilSent(size_t maxBytesPending)
+{
+    if (!pendingWrites)
+        return isConnected();
+
+    std::unique_lock<std::mutex> guard(pendingWrites->mutex);
+    while (pendingWrites->bytes > maxBytesPending) {
+        if (!isConnected())
+            return false;
+        // Poll the connection, since a write callback isn't guaranteed
+        // to be called once it's been closed
+        pendingWrites->cv.wait_for(guard, std::chrono::milliseconds(100));
+    }
+
+    return isConnected();
+}
+
+void
+HttpRestConnection::
+abortResponse(int responseCode, const Json::Value & error)
+{
+    // Without the end of the payload (or the last chunk), the client sees
+    // a truncated response
+    http->send("", HttpLegacySocketHandler::NEXT_CLOSE);
+    responseSent_ = true;
 }
 
 void
@@ -11,6 +11,8 @@
 
 #include <memory>
 #include <string>
+#include <mutex>
+#include <condition_variable>
 
 #include "mldb/io/asio_thread_pool.h"
 #include "mldb/rest/http_rest_endpoint.h"
@@ -63,6 +65,16 @@ struct HttpRestConnection: public RestConnection {
     bool chunkedEncoding;
     bool keepAlive;
 
+    /// Number of payload bytes not yet written to the socket.  It's shared
+    /// with the write callbacks, which may run after we're destroyed.
+    struct PendingWrites {
+        std::mutex mutex;
+        std::condition_variable cv;
+        size_t bytes = 0;
+    };
+
+    std::shared_ptr<PendingWrites> pendingWrites;
+
     /** Data that is maintained with the connection.  This is where control
         data required for asynchronous or long-running connections can be
         put.
@@ -106,6 +118,11 @@ struct HttpRestConnection: public RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse();
 
+    virtual bool waitUntilSent(size_t maxBytesPending = 0);
+
+    /** Closes the connection without finishing the payload. */
+    virtual void abortResponse(int responseCode, const Json::Value & error);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
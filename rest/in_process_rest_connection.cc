@@ -92,6 +92,12 @@ finishResponse()
 {
 }
 
+void InProcessRestConnection::
+abortResponse(int responseCode, const Json::Value & error)
+{
+    sendErrorResponse(responseCode, error);
+}
+
 /** Send the given error string back on the connection. */
 void InProcessRestConnection::
 sendErrorResponse(int responseCode,
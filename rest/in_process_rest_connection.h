@@ -52,6 +52,9 @@ struct InProcessRestConnection: public HttpRestConnection {
 
     virtual void finishResponse();
 
+    /** Replaces what was sent of the response by the error. */
+    virtual void abortResponse(int responseCode, const Json::Value & error);
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -83,6 +83,26 @@ struct RestConnection {
     /** Finish the response, recycling or closing the connection. */
     virtual void finishResponse() = 0;
 
+    /** Wait until no more than maxBytesPending bytes of the payloads
+        passed to sendPayload() are still waiting to be written to the
+        connection.  This lets a response which is streamed go at the
+        speed of the client instead of being buffered in memory.  Returns
+        false if the connection was closed.
+    */
+    virtual bool waitUntilSent(size_t maxBytesPending = 0)
+    {
+        return isConnected();
+    }
+
+    /** Abandon a response whose header has already been sent, because of
+        an error in the middle of it.  The client must be able to tell that
+        the response is incomplete.
+    */
+    virtual void abortResponse(int responseCode, const Json::Value & error)
+    {
+        finishResponse();
+    }
+
     /** Send the given error string back on the connection. */
     virtual void sendErrorResponse(int responseCode,
                                    std::string error,
@@ -11,6 +11,7 @@
 #include "mldb/sql/sql_expression.h"
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/server/dataset_context.h"
@@ -392,6 +393,25 @@ queryWithoutDatasetExpr(const SelectStatement& stm, SqlBindingScope& scope)
             (vector<NamedRowValue>(), make_shared<EmptyValueInfo>());
 }
 
+std::shared_ptr<JobGroup>
+getQueryJobGroup(const Utf8String & query,
+                 const std::string & kind)
+{
+    auto current = JobGroup::current();
+    if (current)
+        return current;
+
+    std::string name = kind;
+    if (!query.empty()) {
+        name += ": ";
+        name += query.length() > 100
+            ? (Utf8String(query.begin(), std::next(query.begin(), 100))
+               + "...").rawString()
+            : query.rawString();
+    }
+    return JobGroup::create(std::move(name), JOB_PRIORITY_INTERACTIVE);
+}
+
 std::vector<MatrixNamedRow>
 queryFromStatement(const SelectStatement & stm,
                    SqlBindingScope & scope,
@@ -412,6 +432,8 @@ queryFromStatementExpr(const SelectStatement & stm,
                        BoundParameters params,
                        const ProgressFunc & onProgress)
 {
+    JobGroupScope jobGroup(getQueryJobGroup(stm.surface));
+
     /* The assumption is that both sides have the same number
        of items to process.  This is obviously not always the case
        so the progress may differ in speed when switching from the 
@@ -512,6 +534,8 @@ queryFromStatement(std::function<bool (Path &, ExpressionValue &)> & onRow,
                    BoundParameters params,
                    const ProgressFunc & onProgress)
 {
+    JobGroupScope jobGroup(getQueryJobGroup(stm.surface));
+
     BoundTableExpression table = stm.from->bind(scope, onProgress);
     
     if (table.dataset) {
@@ -23,6 +23,8 @@
 
 namespace MLDB {
 
+struct JobGroup;
+
 struct Dataset;
 struct SqlExpression;
 struct Function;
@@ -172,6 +174,17 @@ queryWithoutDataset(const SelectStatement& stm, SqlBindingScope& scope);
 std::tuple<std::vector<NamedRowValue>, std::shared_ptr<ExpressionValueInfo> >
 queryWithoutDatasetExpr(const SelectStatement& stm, SqlBindingScope& scope);
 
+/** Return the job group that the work for the given query should run in.
+    This is the group the calling thread is already in if it has one (for
+    example a procedure's background group, or the group of an enclosing
+    query), otherwise a new interactive group so that the query gets its
+    threads ahead of background work.  The new group is named after the
+    kind of work and the (truncated) text of the query.
+*/
+std::shared_ptr<JobGroup>
+getQueryJobGroup(const Utf8String & query,
+                 const std::string & kind = "query");
+
 /** Select from the given statement.  This will choose the most
     appropriate execution method based upon what is in the query.
 
@@ -0,0 +1,669 @@
+/** arrow_output.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Output of query results in the Apache Arrow IPC streaming format.
+
+    The format is a sequence of messages, each one a flatbuffer holding its
+    metadata (Schema, DictionaryBatch or RecordBatch) followed by a body
+    holding the column buffers.  See https://arrow.apache.org/docs/format/
+    for the specification; the field ids below come from Schema.fbs and
+    Message.fbs.
+*/
+
+#include "mldb/server/arrow_output.h"
+#include "mldb/jml/utils/lightweight_hash.h"
+#include "mldb/http/http_exception.h"
+#include "mldb/base/exc_assert.h"
+#include <unordered_map>
+#include <algorithm>
+#include <memory>
+#include <limits>
+#include <cstring>
+#include <cmath>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+const std::string ARROW_STREAM_CONTENT_TYPE
+    = "application/vnd.apache.arrow.stream";
+
+namespace {
+
+
+/*****************************************************************************/
+/* FLATBUFFER WRITER                                                         */
+/*****************************************************************************/
+
+/** Minimal writer for the flatbuffers that hold the Arrow metadata.
+
+    Unlike the flatbuffers library, it writes front to back: an object is
+    written before the objects that it refers to, and the offsets to them
+    (which must point forward) are filled in once they have been written.
+    A table's vtable goes just before it.  All scalars are little endian.
+*/
+
+struct FlatBuffer {
+    std::string data;
+
+    void align(size_t n)
+    {
+        data.resize((data.size() + n - 1) / n * n, 0);
+    }
+
+    template<typename T>
+    size_t append(T val)
+    {
+        size_t pos = data.size();
+        data.append((const char *)&val, sizeof(val));
+        return pos;
+    }
+
+    /// Fill in an offset at pos that points to the object at target
+    void patchOffset(size_t pos, size_t target)
+    {
+        ExcAssertGreater(target, pos);
+        uint32_t offset = target - pos;
+        memcpy(&data[pos], &offset, sizeof(offset));
+    }
+};
+
+struct FbObject {
+    virtual ~FbObject()
+    {
+    }
+
+    /// Write the object, and return the position that offsets point to
+    virtual size_t write(FlatBuffer & buf) const = 0;
+};
+
+typedef std::shared_ptr<FbObject> FbPtr;
+
+struct FbTable: public FbObject {
+    struct Field {
+        int id;
+        int size;
+        uint64_t value;   ///< Bits of a scalar field
+        FbPtr child;      ///< Object pointed to by an offset field
+    };
+
+    std::vector<Field> fields;
+
+    template<typename T>
+    void scalar(int id, T value)
+    {
+        uint64_t bits = 0;
+        memcpy(&bits, &value, sizeof(value));
+        fields.push_back({ id, (int)sizeof(value), bits, nullptr });
+    }
+
+    void offset(int id, FbPtr child)
+    {
+        fields.push_back({ id, 4, 0, std::move(child) });
+    }
+
+    virtual size_t write(FlatBuffer & buf) const
+    {
+        // Lay out the biggest fields first, so that they are all aligned
+        // without padding
+        std::vector<const Field *> sorted;
+        for (auto & f: fields)
+            sorted.push_back(&f);
+        std::stable_sort(sorted.begin(), sorted.end(),
+                         [] (const Field * f1, const Field * f2)
+                         {
+                             return f1->size > f2->size;
+                         });
+
+        int numSlots = 0;
+        for (auto & f: fields)
+            numSlots = std::max(numSlots, f.id + 1);
+
+        // The table starts with the offset to its vtable
+        std::vector<uint16_t> slots(numSlots, 0);
+        std::vector<size_t> fieldOffsets;
+        size_t tableSize = 4;
+        for (auto f: sorted) {
+            tableSize = (tableSize + f->size - 1) / f->size * f->size;
+            slots[f->id] = tableSize;
+            fieldOffsets.push_back(tableSize);
+            tableSize += f->size;
+        }
+
+        buf.align(2);
+        size_t vtable = buf.append<uint16_t>(4 + 2 * numSlots);
+        buf.append<uint16_t>(tableSize);
+        for (auto s: slots)
+            buf.append<uint16_t>(s);
+
+        buf.align(8);
+        size_t table = buf.append<int32_t>(buf.data.size() - vtable);
+        buf.data.resize(table + tableSize, 0);
+
+        for (size_t i = 0;  i < sorted.size();  ++i) {
+            if (!sorted[i]->child)
+                memcpy(&buf.data[table + fieldOffsets[i]], &sorted[i]->value,
+                       sorted[i]->size);
+        }
+
+        for (size_t i = 0;  i < sorted.size();  ++i) {
+            if (sorted[i]->child) {
+                size_t pos = table + fieldOffsets[i];
+                buf.patchOffset(pos, sorted[i]->child->write(buf));
+            }
+        }
+
+        return table;
+    }
+};
+
+/// Vector of structs made of two int64s, which is all Arrow needs
+struct FbStructVector: public FbObject {
+    std::vector<std::pair<int64_t, int64_t> > elements;
+
+    virtual size_t write(FlatBuffer & buf) const
+    {
+        // The elements after the length need to be 8 byte aligned
+        buf.align(8);
+        buf.append<uint32_t>(0);
+        size_t pos = buf.append<uint32_t>(elements.size());
+        for (auto & e: elements) {
+            buf.append<int64_t>(e.first);
+            buf.append<int64_t>(e.second);
+        }
+        return pos;
+    }
+};
+
+struct FbTableVector: public FbObject {
+    std::vector<FbPtr> elements;
+
+    virtual size_t write(FlatBuffer & buf) const
+    {
+        buf.align(4);
+        size_t pos = buf.append<uint32_t>(elements.size());
+        std::vector<size_t> offsets;
+        for (size_t i = 0;  i < elements.size();  ++i)
+            offsets.push_back(buf.append<uint32_t>(0));
+        for (size_t i = 0;  i < elements.size();  ++i)
+            buf.patchOffset(offsets[i], elements[i]->write(buf));
+        return pos;
+    }
+};
+
+struct FbString: public FbObject {
+    FbString(std::string str)
+        : str(std::move(str))
+    {
+    }
+
+    std::string str;
+
+    virtual size_t write(FlatBuffer & buf) const
+    {
+        buf.align(4);
+        size_t pos = buf.append<uint32_t>(str.size());
+        buf.data += str;
+        buf.data.push_back(0);
+        return pos;
+    }
+};
+
+std::string fbFinish(const FbObject & root)
+{
+    FlatBuffer buf;
+    size_t rootOffset = buf.append<uint32_t>(0);
+    buf.patchOffset(rootOffset, root.write(buf));
+    return std::move(buf.data);
+}
+
+
+/*****************************************************************************/
+/* ARROW MESSAGES                                                            */
+/*****************************************************************************/
+
+/// Values of the MessageHeader union
+enum ArrowMessageType: uint8_t {
+    ARROW_SCHEMA = 1,
+    ARROW_DICTIONARY_BATCH = 2,
+    ARROW_RECORD_BATCH = 3
+};
+
+/// Values of the Type union that we use
+enum ArrowTypeId: uint8_t {
+    ARROW_INT = 2,
+    ARROW_FLOATING_POINT = 3,
+    ARROW_BINARY = 4,
+    ARROW_UTF8 = 5,
+    ARROW_TIMESTAMP = 10
+};
+
+/// Number of rows in each record batch
+static constexpr size_t ARROW_BATCH_ROWS = 65536;
+
+/// Body of a batch: the buffers of each column, one after the other
+struct ArrowBody {
+    std::string data;
+    std::vector<std::pair<int64_t, int64_t> > nodes;    ///< length, nulls
+    std::vector<std::pair<int64_t, int64_t> > buffers;  ///< offset, length
+
+    void addBuffer(const void * mem, size_t length)
+    {
+        buffers.emplace_back(data.size(), length);
+        if (length)
+            data.append((const char *)mem, length);
+        data.resize((data.size() + 7) / 8 * 8, 0);
+    }
+
+    template<typename T>
+    void addBuffer(const std::vector<T> & values)
+    {
+        addBuffer(values.data(), values.size() * sizeof(T));
+    }
+
+    /** Add the offsets and characters of n strings, obtained by calling
+        getString(i, output) to append the i-th string to output.
+    */
+    template<typename GetString>
+    void addStrings(size_t n, const GetString & getString)
+    {
+        std::vector<int32_t> offsets(1, 0);
+        offsets.reserve(n + 1);
+        std::string chars;
+        for (size_t i = 0;  i < n;  ++i) {
+            getString(i, chars);
+            if (chars.size() > std::numeric_limits<int32_t>::max())
+                throw HttpReturnException
+                    (400, "Too much string data in an Arrow batch; try to "
+                     "return fewer or smaller string values");
+            offsets.push_back(chars.size());
+        }
+        addBuffer(offsets);
+        addBuffer(chars.data(), chars.size());
+    }
+};
+
+FbPtr recordBatchHeader(int64_t length, const ArrowBody & body)
+{
+    auto nodes = std::make_shared<FbStructVector>();
+    nodes->elements = body.nodes;
+    auto buffers = std::make_shared<FbStructVector>();
+    buffers->elements = body.buffers;
+
+    auto result = std::make_shared<FbTable>();
+    result->scalar<int64_t>(0, length);
+    result->offset(1, nodes);
+    result->offset(2, buffers);
+    return result;
+}
+
+void appendMessage(std::string & stream, ArrowMessageType headerType,
+                   FbPtr header, const std::string & body)
+{
+    auto message = std::make_shared<FbTable>();
+    // V4 rather than V5, so that pyarrow releases that still run on
+    // Python 2 (up to 0.16) can read it; we use no type whose layout
+    // differs between the two.
+    message->scalar<int16_t>(0, 3 /* MetadataVersion V4 */);
+    message->scalar<uint8_t>(1, headerType);
+    message->offset(2, std::move(header));
+    message->scalar<int64_t>(3, body.size());
+
+    std::string metadata = fbFinish(*message);
+    metadata.resize((metadata.size() + 7) / 8 * 8, 0);
+
+    uint32_t continuation = 0xffffffff;
+    int32_t length = metadata.size();
+    stream.append((const char *)&continuation, sizeof(continuation));
+    stream.append((const char *)&length, sizeof(length));
+    stream += metadata;
+    stream += body;
+}
+
+
+/*****************************************************************************/
+/* OUTPUT COLUMN                                                             */
+/*****************************************************************************/
+
+enum OutputColumnType {
+    INT64,
+    FLOAT64,
+    TIMESTAMP,
+    STRING,
+    BINARY
+};
+
+struct OutputColumn {
+    OutputColumn(Utf8String name, size_t numRows)
+        : name(std::move(name)), type(FLOAT64), dictionaryId(-1),
+          values(numRows)
+    {
+    }
+
+    Utf8String name;
+    OutputColumnType type;
+    int64_t dictionaryId;  ///< -1 if it's not dictionary encoded
+
+    /// Value of the column for each row, or null if it's missing
+    std::vector<const CellValue *> values;
+
+    /// Entry in the dictionary for each row (if dictionary encoded)
+    std::vector<int32_t> indexes;
+    std::vector<std::string> dictionary;
+
+    bool isNull(size_t row) const
+    {
+        const CellValue * val = values[row];
+        if (!val || val->empty())
+            return true;
+        if (type == TIMESTAMP)
+            return !std::isfinite(val->toTimestamp().secondsSinceEpoch());
+        return false;
+    }
+
+    static void appendBytes(const CellValue & val, std::string & output)
+    {
+        if (val.isBlob())
+            output.append((const char *)val.blobData(), val.blobLength());
+        else if (val.isPath())
+            output += val.coerceToPath().toUtf8String().rawString();
+        else output += val.toUtf8String().rawString();
+    }
+
+    void inferType()
+    {
+        bool allIntegers = true, allNumbers = true, allTimestamps = true;
+        bool anyBlob = false, anyValue = false;
+
+        for (auto val: values) {
+            if (!val || val->empty())
+                continue;
+            anyValue = true;
+            allIntegers = allIntegers
+                && (val->isInt64()
+                    || (val->isUnsignedInteger()
+                        && val->toUInt()
+                           <= std::numeric_limits<int64_t>::max()));
+            allNumbers = allNumbers && val->isNumber();
+            allTimestamps = allTimestamps && val->isTimestamp();
+            anyBlob = anyBlob || val->isBlob();
+        }
+
+        // A column with only nulls is float64, which pandas handles best
+        if (!anyValue || allNumbers)
+            type = allIntegers && anyValue ? INT64 : FLOAT64;
+        else if (allTimestamps)
+            type = TIMESTAMP;
+        else if (anyBlob)
+            type = BINARY;
+        else type = STRING;
+    }
+
+    void createDictionary(int64_t id)
+    {
+        dictionaryId = id;
+        indexes.resize(values.size(), -1);
+
+        std::unordered_map<std::string, int32_t> entries;
+        std::string str;
+        for (size_t i = 0;  i < values.size();  ++i) {
+            if (isNull(i))
+                continue;
+            str.clear();
+            appendBytes(*values[i], str);
+            auto it = entries.insert({ str, dictionary.size() }).first;
+            if (it->second == dictionary.size())
+                dictionary.push_back(str);
+            indexes[i] = it->second;
+        }
+    }
+
+    FbPtr field() const
+    {
+        auto result = std::make_shared<FbTable>();
+        result->offset(0, std::make_shared<FbString>(name.rawString()));
+        result->scalar<uint8_t>(1, true /* nullable */);
+
+        auto typeTable = std::make_shared<FbTable>();
+        switch (type) {
+        case INT64:
+            result->scalar<uint8_t>(2, ARROW_INT);
+            typeTable->scalar<int32_t>(0, 64);  // bitWidth
+            typeTable->scalar<uint8_t>(1, true);  // is_signed
+            break;
+        case FLOAT64:
+            result->scalar<uint8_t>(2, ARROW_FLOATING_POINT);
+            typeTable->scalar<int16_t>(0, 2 /* DOUBLE */);
+            break;
+        case TIMESTAMP:
+            result->scalar<uint8_t>(2, ARROW_TIMESTAMP);
+            typeTable->scalar<int16_t>(0, 2 /* MICROSECOND */);
+            typeTable->offset(1, std::make_shared<FbString>("UTC"));
+            break;
+        case STRING:
+            result->scalar<uint8_t>(2, ARROW_UTF8);
+            break;
+        case BINARY:
+            result->scalar<uint8_t>(2, ARROW_BINARY);
+            break;
+        }
+        result->offset(3, typeTable);
+
+        if (dictionaryId != -1) {
+            auto indexType = std::make_shared<FbTable>();
+            indexType->scalar<int32_t>(0, 32);
+            indexType->scalar<uint8_t>(1, true);
+
+            auto encoding = std::make_shared<FbTable>();
+            encoding->scalar<int64_t>(0, dictionaryId);
+            encoding->offset(1, indexType);
+            result->offset(4, encoding);
+        }
+
+        // Readers require the children, even if there are none
+        result->offset(5, std::make_shared<FbTableVector>());
+
+        return result;
+    }
+
+    /// Add the buffers for rows begin to end - 1 to the body
+    void encode(ArrowBody & body, size_t begin, size_t end) const
+    {
+        size_t n = end - begin;
+
+        size_t numNulls = 0;
+        std::vector<uint8_t> validity((n + 7) / 8, 0);
+        for (size_t i = 0;  i < n;  ++i) {
+            if (isNull(begin + i))
+                ++numNulls;
+            else validity[i / 8] |= 1 << (i % 8);
+        }
+
+        body.nodes.emplace_back(n, numNulls);
+
+        // The validity bitmap can be left out if there are no nulls
+        if (numNulls == 0)
+            body.addBuffer(nullptr, 0);
+        else body.addBuffer(validity);
+
+        if (dictionaryId != -1) {
+            std::vector<int32_t> output(indexes.begin() + begin,
+                                        indexes.begin() + end);
+            for (auto & i: output)
+                i = std::max(i, 0);
+            body.addBuffer(output);
+            return;
+        }
+
+        switch (type) {
+        case INT64: {
+            std::vector<int64_t> output(n, 0);
+            for (size_t i = 0;  i < n;  ++i) {
+                if (!isNull(begin + i))
+                    output[i] = values[begin + i]->toInt();
+            }
+            body.addBuffer(output);
+            break;
+        }
+        case FLOAT64: {
+            std::vector<double> output(n, 0.0);
+            for (size_t i = 0;  i < n;  ++i) {
+                if (!isNull(begin + i))
+                    output[i] = values[begin + i]->toDouble();
+            }
+            body.addBuffer(output);
+            break;
+        }
+        case TIMESTAMP: {
+            std::vector<int64_t> output(n, 0);
+            for (size_t i = 0;  i < n;  ++i) {
+                if (!isNull(begin + i))
+                    output[i] = std::llround
+                        (values[begin + i]->toTimestamp().secondsSinceEpoch()
+                         * 1000000.0);
+            }
+            body.addBuffer(output);
+            break;
+        }
+        case STRING:
+        case BINARY: {
+            auto getString = [&] (size_t i, std::string & output)
+                {
+                    if (!isNull(begin + i))
+                        appendBytes(*values[begin + i], output);
+                };
+            body.addStrings(n, getString);
+            break;
+        }
+        }
+    }
+
+    /// Body of the dictionary batch, which is a single non-null column
+    ArrowBody encodeDictionary() const
+    {
+        ArrowBody result;
+        result.nodes.emplace_back(dictionary.size(), 0);
+        result.addBuffer(nullptr, 0);
+        result.addStrings(dictionary.size(),
+                          [&] (size_t i, std::string & output)
+                          {
+                              output += dictionary[i];
+                          });
+        return result;
+    }
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* ARROW OUTPUT                                                              */
+/*****************************************************************************/
+
+std::string encodeArrowStream(const std::vector<MatrixNamedRow> & rows,
+                              bool rowNames,
+                              bool rowHashes,
+                              bool sortColumns)
+{
+    size_t numRows = rows.size();
+
+    // Row names and hashes are plain strings, since they are nearly all
+    // different
+    std::vector<CellValue> rowNameValues, rowHashValues;
+    std::vector<OutputColumn> columns;
+
+    if (rowNames) {
+        columns.emplace_back(Utf8String("_rowName"), numRows);
+        rowNameValues.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            rowNameValues.emplace_back(rows[i].rowName.toUtf8String());
+            columns.back().values[i] = &rowNameValues.back();
+        }
+        columns.back().type = STRING;
+    }
+
+    if (rowHashes) {
+        columns.emplace_back(Utf8String("_rowHash"), numRows);
+        rowHashValues.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            rowHashValues.emplace_back(rows[i].rowHash.toString());
+            columns.back().values[i] = &rowHashValues.back();
+        }
+        columns.back().type = STRING;
+    }
+
+    // Find all columns, in the same order as the table format
+    std::vector<ColumnPath> columnNames;
+    Lightweight_Hash<ColumnHash, int> columnIndex;
+    for (auto & r: rows) {
+        for (auto & c: r.columns) {
+            auto & columnName = std::get<0>(c);
+            if (columnIndex.insert({columnName, columnNames.size()}).second)
+                columnNames.push_back(columnName);
+        }
+    }
+
+    if (sortColumns) {
+        std::sort(columnNames.begin(), columnNames.end());
+        for (size_t i = 0;  i < columnNames.size();  ++i)
+            columnIndex[columnNames[i]] = i;
+    }
+
+    size_t firstValueColumn = columns.size();
+    for (auto & c: columnNames)
+        columns.emplace_back(c.toUtf8String(), numRows);
+
+    for (size_t i = 0;  i < numRows;  ++i) {
+        for (auto & c: rows[i].columns) {
+            columns[firstValueColumn + columnIndex[std::get<0>(c)]]
+                .values[i] = &std::get<1>(c);
+        }
+    }
+
+    int64_t numDictionaries = 0;
+    for (size_t i = firstValueColumn;  i < columns.size();  ++i) {
+        columns[i].inferType();
+        if (columns[i].type == STRING)
+            columns[i].createDictionary(numDictionaries++);
+    }
+
+    std::string result;
+
+    auto fields = std::make_shared<FbTableVector>();
+    for (auto & c: columns)
+        fields->elements.push_back(c.field());
+    auto schema = std::make_shared<FbTable>();
+    schema->offset(1, fields);
+    appendMessage(result, ARROW_SCHEMA, schema, "");
+
+    for (auto & c: columns) {
+        if (c.dictionaryId == -1)
+            continue;
+        ArrowBody body = c.encodeDictionary();
+        auto batch = std::make_shared<FbTable>();
+        batch->scalar<int64_t>(0, c.dictionaryId);
+        batch->offset(1, recordBatchHeader(c.dictionary.size(), body));
+        appendMessage(result, ARROW_DICTIONARY_BATCH, batch, body.data);
+    }
+
+    for (size_t begin = 0;  begin < numRows;  begin += ARROW_BATCH_ROWS) {
+        size_t end = std::min(numRows, begin + ARROW_BATCH_ROWS);
+        ArrowBody body;
+        for (auto & c: columns)
+            c.encode(body, begin, end);
+        appendMessage(result, ARROW_RECORD_BATCH,
+                      recordBatchHeader(end - begin, body), body.data);
+    }
+
+    // End of stream marker
+    uint32_t endOfStream[2] = { 0xffffffff, 0 };
+    result.append((const char *)endOfStream, sizeof(endOfStream));
+
+    return result;
+}
+
+} // namespace MLDB
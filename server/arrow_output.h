@@ -0,0 +1,43 @@
+/** arrow_output.h                                                  -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Output of query results in the Apache Arrow IPC streaming format.
+*/
+
+#pragma once
+
+#include "mldb/sql/dataset_types.h"
+#include <string>
+#include <vector>
+
+
+namespace MLDB {
+
+
+/// MIME type of an Arrow IPC stream
+extern const std::string ARROW_STREAM_CONTENT_TYPE;
+
+/** Encode the rows of a query result as an Arrow IPC stream, which can be
+    read without copying by pyarrow (pyarrow.ipc.open_stream()), pandas
+    and Spark.
+
+    Each column gets a type from the values it contains: int64 if they are
+    all integers, float64 if they are all numbers, a UTC timestamp (in
+    microseconds) if they are all timestamps, binary if any is a blob, and
+    otherwise dictionary encoded utf8 strings, with other values converted
+    to strings.  Missing values are nulls.  As for the table format, the
+    latest value of a cell is used if it has several.
+
+    The columns are in the order in which they are first seen, or sorted
+    if sortColumns is true, after the '_rowName' and '_rowHash' columns
+    if rowNames and rowHashes are set.  Rows are split into record batches
+    of a fixed number of rows.
+*/
+std::string encodeArrowStream(const std::vector<MatrixNamedRow> & rows,
+                              bool rowNames,
+                              bool rowHashes,
+                              bool sortColumns);
+
+} // namespace MLDB
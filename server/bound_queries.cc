@@ -12,6 +12,7 @@
 #include "mldb/base/parallel.h"
 #include "mldb/server/per_thread_accumulator.h"
 #include "mldb/server/parallel_merge_sort.h"
+#include "mldb/server/group_by_table.h"
 #include "mldb/arch/timers.h"
 #include "mldb/types/basic_value_descriptions.h"
 #include "mldb/sql/sql_expression_operations.h"
@@ -21,8 +22,10 @@
 #include "mldb/arch/demangle.h"
 
 #include <boost/algorithm/string.hpp>
+#include <numeric>
 
 #include "mldb/jml/utils/profile.h"
+#include "mldb/jml/utils/environment.h"
 
 
 using namespace std;
@@ -39,6 +42,9 @@ namespace MLDB {
 const int MIN_ROW_PER_TASK = 32;
 const int TASK_PER_THREAD = 8;
 
+/// Number of rows calculated at once when they must be output in order
+const int SEQUENTIAL_BLOCK_SIZE = 16384;
+
 __thread int QueryThreadTracker::depth = 0;
 
 
@@ -243,14 +249,18 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                     return parallelMapHaltable(offset, upper, doRow);
                 }
                 else {
-                    // TODO: to reduce memory usage, we should fill blocks of
-                    // output on worker threads
-                    // in order as much as possible
-                    // while calling the aggregator on the caller thread.
+                    // The rows are calculated on worker threads a block
+                    // at a time, and passed to the processor in order on
+                    // this thread.  This bounds the memory used by the
+                    // output, and the processor gets the first rows
+                    // without waiting for all of them.
                     ExcAssert(offset >= 0 && offset <= upper);
                     std::vector<std::tuple<Path, ExpressionValue, std::vector<ExpressionValue> > >
-                        output(upper-offset);
+                        output(std::min<size_t>(upper - offset,
+                                                SEQUENTIAL_BLOCK_SIZE));
                 
+                    size_t blockStart = offset;
+
                     ProgressState progress(upper-offset);
                     auto copyRow = [&] (int rowNum) -> bool
                         {
@@ -266,19 +276,25 @@ struct UnorderedExecutor: public BoundSelectQuery::Executor {
                             auto row = dataset.getRowExpr(rows[rowNum]);
                             auto outputRow = processRow(rows[rowNum], row, rowNum,
                                                         numPerBucket, selectStar);
-                            output[rowNum-offset] = std::move(outputRow);
+                            output[rowNum - blockStart] = std::move(outputRow);
                             return true;
                         };
 
                     DEBUG_MSG(logger) << "iterating rows sequentially";
-                    if (!parallelMapHaltable(offset, upper, copyRow))
-                        return false;
+                    for (;  blockStart < upper;
+                         blockStart += SEQUENTIAL_BLOCK_SIZE) {
+                        size_t blockEnd = std::min<size_t>
+                            (upper, blockStart + SEQUENTIAL_BLOCK_SIZE);
 
-                    for (size_t i = offset; i < upper; ++i) {
-                        auto& outputRow = output[i-offset];
-                        if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
-                                       std::get<2>(outputRow), -1))
+                        if (!parallelMapHaltable(blockStart, blockEnd, copyRow))
                             return false;
+
+                        for (size_t i = blockStart; i < blockEnd; ++i) {
+                            auto& outputRow = output[i - blockStart];
+                            if (!processor(std::get<0>(outputRow), std::get<1>(outputRow),
+                                           std::get<2>(outputRow), -1))
+                                return false;
+                        }
                     }
                 }
             }
@@ -1699,6 +1715,42 @@ BoundGroupByQuery(const SelectExpression & select,
 
 }
 
+/// Estimated amount of memory for the groups of a GROUP BY query above
+/// which new groups are spilled to disk.
+EnvOption<size_t> MLDB_GROUP_BY_MEMORY_BUDGET
+("MLDB_GROUP_BY_MEMORY_BUDGET", 4ULL * 1024 * 1024 * 1024);
+
+/// Directory in which GROUP BY spill files are created.  Empty means the
+/// system temporary directory.
+EnvOption<std::string> MLDB_GROUP_BY_SPILL_DIRECTORY
+("MLDB_GROUP_BY_SPILL_DIRECTORY", "");
+
+/// Number of partitions (by group key hash) of spilled GROUP BY rows.  Each
+/// is aggregated on its own once the input has been read.
+static constexpr size_t GROUP_BY_SPILL_PARTITIONS = 64;
+
+/// Number of output rows per chunk of the final parallel sort
+static constexpr size_t GROUP_BY_SORT_CHUNK_SIZE = 16384;
+
+/// Rough estimate of the memory used by a group, used to decide when to
+/// spill.  Aggregator states are opaque so we use a fixed size for them.
+static size_t
+estimateGroupMemory(const std::vector<ExpressionValue> & key,
+                    size_t numAggregators)
+{
+    size_t result = sizeof(key) + 32 /* hash and index */
+        + sizeof(GroupMapValue) + numAggregators * 64;
+
+    for (auto & k: key) {
+        result += sizeof(ExpressionValue);
+        if (k.isAtom())
+            result += k.getAtom().memusage();
+        else result += 256;
+    }
+
+    return result;
+}
+
 std::pair<bool, std::shared_ptr<ExpressionValueInfo> >
 BoundGroupByQuery::
 execute(RowProcessor processor,
@@ -1708,17 +1760,17 @@ execute(RowProcessor processor,
 {
     //STACK_PROFILE(BoundGroupByQuery);
 
-    typedef std::tuple<std::vector<ExpressionValue>,
-                       NamedRowValue,
-                       std::vector<ExpressionValue> >
-        SortedRow;
+    typedef std::vector<ExpressionValue> RowKey;
+    typedef GroupByHashTable<GroupMapValue> GroupByTableType;
 
-    std::vector<SortedRow> rowsSorted;
-    std::atomic<ssize_t> groupsDone(0);
+    // An output row, with the key of its group
+    struct SortedRow {
+        RowKey key;
+        std::vector<ExpressionValue> sortFields;
+        NamedRowValue row;
+    };
 
-    typedef std::vector<ExpressionValue> RowKey;
-    typedef std::map<RowKey, GroupMapValue> GroupByMapType;
-    std::vector<GroupByMapType> accum(numBuckets);
+    std::vector<GroupByTableType> accum(numBuckets);
 
     for (const auto & c: select.clauses) {
         if (c->isWildcard()) {
@@ -1743,65 +1795,121 @@ execute(RowProcessor processor,
     //we placed the orderby aggregators after the having aggregator in the list
     boundOrderBy = orderBy.bindAll(*groupContext);
 
+    // Groups are accumulated in memory until their estimated size goes
+    // over the budget.  From then on, rows of groups which are already in
+    // memory are still aggregated there, but rows of new groups are written
+    // to disk, partitioned by key hash, and aggregated afterwards one
+    // partition at a time.
+    size_t memoryBudget = MLDB_GROUP_BY_MEMORY_BUDGET;
+    std::atomic<size_t> memoryUsed(0);
+    std::unique_ptr<GroupBySpill> spillStorage;
+    std::atomic<GroupBySpill *> spill(nullptr);
+    std::mutex spillMutex;
+    size_t numAggregators = groupContext->outputAgg.size();
+
+    auto startSpilling = [&] ()
+        {
+            std::unique_lock<std::mutex> guard(spillMutex);
+            if (spill)
+                return;
+            INFO_MSG(logger) << "GROUP BY groups went over the memory budget of "
+                             << memoryBudget << " bytes; spilling to disk";
+            spillStorage.reset(new GroupBySpill(MLDB_GROUP_BY_SPILL_DIRECTORY,
+                                                numBuckets,
+                                                GROUP_BY_SPILL_PARTITIONS));
+            spill = spillStorage.get();
+        };
+
     // When we get a row, we record it under the group key
     auto onRow = [&] (NamedRowValue & row,
                       const std::vector<ExpressionValue> & calc,
                       int groupNum)
     {
-       GroupByMapType & map = accum[groupNum];
+       GroupByTableType & table = accum[groupNum];
        RowKey rowKey(calc.begin(), calc.begin() + groupBy.clauses.size());
+       uint64_t hash = GroupByTableType::hashKey(rowKey);
+
+       GroupBySpill * spillTo = spill;
+       if (spillTo) {
+           ssize_t entry = table.find(rowKey, hash);
+           if (entry == -1) {
+               spillTo->add(groupNum, spillTo->partitionForHash(hash), calc);
+               return true;
+           }
+           groupContext->aggregateRow(table.values[entry], calc);
+           return true;
+       }
 
-       auto pair = map.insert({rowKey, GroupMapValue()});
-       auto & iter = pair.first;
-       if (pair.second)
+       auto inserted = table.insert(rowKey, hash);
+       GroupMapValue & value = table.values[inserted.first];
+       if (inserted.second)
        {
           //initialize aggregator data
-          groupContext->initializePerThreadAggregators(iter->second);
+          groupContext->initializePerThreadAggregators(value);
+
+          size_t used = memoryUsed.fetch_add
+              (estimateGroupMemory(rowKey, numAggregators));
+          if (used > memoryBudget)
+              startSpilling();
        }
 
-       groupContext->aggregateRow(iter->second, calc);
+       groupContext->aggregateRow(value, calc);
 
        return true;
     };  
             
     subSelect->execute(onRow, true /*processInParallel*/, 0, -1, onProgress);
-  
-    //merge the maps in fixed order
-    GroupByMapType destMap;
-    std::vector<GroupByMapType>& threads = accum;
-    if (threads.size() > 0)
-    {
-//        STACK_PROFILE(MergingBuckets);
-        for (auto & srcMap : threads)
-        {
-            for (auto it = srcMap.begin(); it != srcMap.end(); ++it)
-            {
-                auto pair = destMap.insert({it->first, GroupMapValue()});
-                auto destiter = pair.first;
-                if (pair.second)
-                {
-                    //initialize aggregator data
-                    groupContext->initializePerThreadAggregators(destiter->second);
-                }
 
-                groupContext->mergeThreadMap(destiter->second, it->second);
-            }
-        }
+    GroupBySpill * spilled = spill;
+    if (spilled) {
+        spilled->flush();
+        INFO_MSG(logger) << "GROUP BY spilled " << spilled->numRows()
+                         << " rows to disk";
     }
 
-    if (destMap.empty() && groupContext->evaluateEmptyGroups
-        && groupBy.clauses.empty())
-    {
-        auto pair = destMap.emplace(RowKey(), GroupMapValue());
-        groupContext->initializePerThreadAggregators(pair.first->second);
-    }
+    // Sort order of output rows.  Groups are ordered by key, unless there
+    // is an ORDER BY in which case the key breaks ties.
+    auto compareRows = [&] (const SortedRow & row1,
+                            const SortedRow & row2)
+        {
+            if (!boundOrderBy.empty()) {
+                if (boundOrderBy.less(row1.sortFields, row2.sortFields))
+                    return true;
+                if (boundOrderBy.less(row2.sortFields, row1.sortFields))
+                    return false;
+            }
+            return row1.key < row2.key;
+        };
+
+    ExcAssertGreaterEqual(offset, 0);
+
+    // With an ORDER BY, rows are collected here and sorted at the end.
+    // Unless there is a DISTINCT ON, only the first offset + limit of them
+    // can be output, so we never keep many more than that.
+    std::vector<SortedRow> rowsSorted;
+    size_t keepRows = -1;
+    if (limit != -1 && select.distinctExpr.empty())
+        keepRows = offset + limit;
 
-    //output rows
-    //each entry in the final map should be an output row for us   
-    for (auto it = destMap.begin(); it != destMap.end(); ++it)
+    auto pruneRows = [&] ()
+        {
+            std::nth_element(rowsSorted.begin(), rowsSorted.begin() + keepRows,
+                             rowsSorted.end(), compareRows);
+            rowsSorted.erase(rowsSorted.begin() + keepRows, rowsSorted.end());
+        };
+
+    // Without an ORDER BY, rows are passed to the processor as soon as
+    // their group is done, and we stop once the limit is reached.
+    ssize_t numOutput = 0;
+    bool processorOk = true;
+    bool stopped = boundOrderBy.empty() && limit == 0;
+    size_t numGroups = 0;
+
+    // Evaluate the output row for a group, and output or collect it
+    auto outputGroup = [&] (const RowKey & rowKey,
+                            const GroupMapValue & value)
     {
-        RowKey rowKey = it->first;
-        groupContext->aggData = it->second;
+        groupContext->aggData = value;
 
          // Create the context to evaluate the row name and order by
         NamedRowValue outputRow;
@@ -1812,7 +1920,12 @@ execute(RowProcessor processor,
         ExpressionValue havingResult = boundHaving(rowContext, GET_LATEST);
 
         if (!havingResult.isTrue())
-            continue;
+            return;
+
+        if (boundOrderBy.empty() && numOutput < offset) {
+            ++numOutput;
+            return;
+        }
 
         outputRow.rowName = boundRowName(rowContext, GET_LATEST).coerceToPath();
         outputRow.rowHash = outputRow.rowName;        
@@ -1821,48 +1934,163 @@ execute(RowProcessor processor,
         ExpressionValue result = boundSelect(rowContext, GET_ALL);
         result.mergeToRowDestructive(outputRow.columns);
 
-        //In case of no output ordering, we can early exit
         if (boundOrderBy.empty()) {
-            ssize_t n = groupsDone.fetch_add(1);
-            if (limit != -1 && n >= limit)
-               break;
+            ++numOutput;
+            if (!processor(outputRow)) {
+                processorOk = false;
+                stopped = true;
+            }
+            else if (limit != -1 && numOutput - offset >= limit)
+                stopped = true;
+            return;
+        }
 
-            processor(outputRow);
+        rowsSorted.push_back({ rowKey, boundOrderBy.apply(rowContext),
+                               std::move(outputRow) });
+
+        if (keepRows != (size_t)-1
+            && rowsSorted.size() >= 2 * keepRows + GROUP_BY_SORT_CHUNK_SIZE)
+            pruneRows();
+    };
+
+    // Merge the groups one partition of the key space at a time.  Without
+    // spilling, there is a single partition.  The in-memory tables are
+    // scanned once to find the entries of each partition.
+    size_t numPartitions = spilled ? spilled->numPartitions() : 1;
+
+    std::vector<std::vector<std::pair<uint32_t, uint32_t> > >
+        partitionEntries(numPartitions);
+    for (size_t b = 0;  b < numBuckets;  ++b) {
+        const GroupByTableType & srcMap = accum[b];
+        for (size_t i = 0;  i < srcMap.size();  ++i) {
+            size_t p = spilled ? spilled->partitionForHash(srcMap.hashes[i]) : 0;
+            partitionEntries[p].emplace_back(b, i);
         }
-        else
+    }
+
+    for (size_t p = 0;  p < numPartitions && !stopped;  ++p) {
+        GroupByTableType destMap;
+
+        auto mergeEntry = [&] (const RowKey & key, uint64_t hash,
+                               const GroupMapValue & value)
         {
-             //Else we add the result to the output rows
-            std::vector<ExpressionValue> sortFields
-            = boundOrderBy.apply(rowContext);
+            auto pair = destMap.insert(key, hash);
+            if (pair.second)
+            {
+                //initialize aggregator data
+                groupContext->initializePerThreadAggregators
+                    (destMap.values[pair.first]);
+            }
 
-            std::vector<ExpressionValue> calcd;
-                
-            rowsSorted.emplace_back(std::move(sortFields),
-                                    std::move(outputRow),
-                                    std::move(calcd));
-        }           
+            groupContext->mergeThreadMap(destMap.values[pair.first], value);
+        };
+
+        // Entries are merged in fixed (bucket, then insertion) order.  Each
+        // is only needed once, so we free it as we go.
+        for (auto & e: partitionEntries[p]) {
+            GroupByTableType & srcMap = accum[e.first];
+            mergeEntry(srcMap.keys[e.second], srcMap.hashes[e.second],
+                       srcMap.values[e.second]);
+            srcMap.keys[e.second] = RowKey();
+            srcMap.values[e.second] = GroupMapValue();
+        }
+        partitionEntries[p] = {};
+
+        if (spilled) {
+            for (size_t b = 0;  b < numBuckets;  ++b) {
+                GroupByTableType spilledMap;
+                auto onSpilledRow = [&] (std::vector<ExpressionValue> & calc)
+                {
+                    RowKey rowKey(calc.begin(),
+                                  calc.begin() + groupBy.clauses.size());
+                    auto pair = spilledMap.insert
+                        (rowKey, GroupByTableType::hashKey(rowKey));
+                    GroupMapValue & value = spilledMap.values[pair.first];
+                    if (pair.second)
+                        groupContext->initializePerThreadAggregators(value);
+                    groupContext->aggregateRow(value, calc);
+                };
+
+                spilled->forEachRow(b, p, onSpilledRow);
+
+                for (size_t i = 0;  i < spilledMap.size();  ++i)
+                    mergeEntry(spilledMap.keys[i], spilledMap.hashes[i],
+                               spilledMap.values[i]);
+            }
+        }
+
+        numGroups += destMap.size();
+
+        // Without an ORDER BY, the groups of the partition are output in
+        // key order.  With a single partition, that's the order of all of
+        // the output; when spilling, it's only within each partition.
+        std::vector<uint32_t> order(destMap.size());
+        std::iota(order.begin(), order.end(), 0);
+
+        if (boundOrderBy.empty()) {
+            auto compareKeys = [&] (uint32_t i1, uint32_t i2)
+                {
+                    return destMap.keys[i1] < destMap.keys[i2];
+                };
+
+            if (order.size() > GROUP_BY_SORT_CHUNK_SIZE) {
+                std::vector<std::vector<uint32_t> > chunks;
+                for (size_t i = 0;  i < order.size();
+                     i += GROUP_BY_SORT_CHUNK_SIZE) {
+                    auto first = order.begin() + i;
+                    auto last = order.begin()
+                        + std::min(i + GROUP_BY_SORT_CHUNK_SIZE, order.size());
+                    chunks.emplace_back(first, last);
+                }
+                order = parallelMergeSort(chunks, compareKeys);
+            }
+            else {
+                std::sort(order.begin(), order.end(), compareKeys);
+            }
+        }
+
+        for (uint32_t i: order) {
+            if (stopped)
+                break;
+            outputGroup(destMap.keys[i], destMap.values[i]);
+        }
+    }
+
+    if (numGroups == 0 && !stopped && groupContext->evaluateEmptyGroups
+        && groupBy.clauses.empty())
+    {
+        GroupMapValue value;
+        groupContext->initializePerThreadAggregators(value);
+        outputGroup(RowKey(), value);
     }
 
     if (boundOrderBy.empty())
-        return {true, selectInfo};
+        return {processorOk, selectInfo};
 
-    // Compare two rows according to the sort criteria
-    auto compareRows = [&] (const SortedRow & row1,
-                            const SortedRow & row2)
-        {
-            return boundOrderBy.less(std::get<0>(row1),
-                                     std::get<0>(row2));
-        };
+    if (keepRows != (size_t)-1 && rowsSorted.size() > keepRows)
+        pruneRows();
 
     // Sort our output rows
-    std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    if (rowsSorted.size() > GROUP_BY_SORT_CHUNK_SIZE) {
+        std::vector<std::vector<SortedRow> > chunks;
+        for (size_t i = 0;  i < rowsSorted.size();
+             i += GROUP_BY_SORT_CHUNK_SIZE) {
+            auto first = rowsSorted.begin() + i;
+            auto last = rowsSorted.begin()
+                + std::min(i + GROUP_BY_SORT_CHUNK_SIZE, rowsSorted.size());
+            chunks.emplace_back(std::make_move_iterator(first),
+                                std::make_move_iterator(last));
+        }
+        rowsSorted = parallelMergeSort(chunks, compareRows);
+    }
+    else {
+        std::sort(rowsSorted.begin(), rowsSorted.end(), compareRows);
+    }
 
     // Now select only the required subset of sorted rows
     if (limit == -1)
         limit = rowsSorted.size();
 
-    ExcAssertGreaterEqual(offset, 0);
-
     if (select.distinctExpr.size() > 0) {
 
         std::vector<ExpressionValue> reference;
@@ -1872,7 +2100,7 @@ execute(RowProcessor processor,
 
         for (unsigned i = 0;  i < rowsSorted.size();  ++i) {
 
-            std::vector<ExpressionValue> & mark = std::get<0>(rowsSorted[i]);
+            std::vector<ExpressionValue> & mark = rowsSorted[i].sortFields;
 
             if (i == 0) {
                 std::copy_n(mark.begin(), numDistinctOnClauses, reference.begin());
@@ -1897,7 +2125,7 @@ execute(RowProcessor processor,
             if (count <= offset)
                 continue;
 
-            auto & row = std::get<1>(rowsSorted[i]);
+            auto & row = rowsSorted[i].row;
 
             /* Finally, pass to the terminator to continue. */
             if (!processor(row))
@@ -1914,7 +2142,7 @@ execute(RowProcessor processor,
         ssize_t end = std::min<ssize_t>(offset + limit, rowsSorted.size());
 
         for (unsigned i = begin;  i < end;  ++i) {
-            auto & row = std::get<1>(rowsSorted[i]);
+            auto & row = rowsSorted[i].row;
 
             /* Finally, pass to the terminator to continue. */
             if (!processor(row))
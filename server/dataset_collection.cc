@@ -18,6 +18,8 @@
 #include "mldb/types/vector_description.h"
 #include "mldb/types/pointer_description.h"
 #include "mldb/types/tuple_description.h"
+#include "mldb/rest/rest_request_router.h"
+#include "mldb/server/arrow_output.h"
 
 using namespace std;
 
@@ -66,6 +68,66 @@ registerDatasetType(const Package & package,
                                            docRoute, customRoute, config, registryFlags);
 }
 
+typedef std::vector<std::pair<ColumnPath, CellValue> > SparseRow;
+
+static SparseRow
+toSparseRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    SparseRow rowOut;
+    rowOut.reserve(row.columns.size() + rowNames + rowHashes);
+
+    if (rowNames)
+        rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
+    if (rowHashes)
+        rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
+
+    for (auto & c: row.columns) {
+        rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
+    }
+
+    std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
+
+    return rowOut;
+}
+
+static std::map<ColumnPath, CellValue>
+toAosRow(const MatrixNamedRow & row, bool rowNames, bool rowHashes)
+{
+    std::map<ColumnPath, CellValue> result;
+
+    if (rowNames)
+        result[ColumnPath("_rowName")] = row.rowName.toUtf8String();
+    if (rowHashes)
+        result[ColumnPath("_rowHash")] = row.rowHash.toString();
+
+    for (auto & c: row.columns) {
+        const ColumnPath & col = std::get<0>(c);
+        const CellValue & val = std::get<1>(c);
+        result[col] = val;
+    }
+
+    return result;
+}
+
+/// Same as the flattening done by queryFromStatement()
+static MatrixNamedRow
+toMatrixNamedRow(Path & rowName, ExpressionValue & row, bool sortColumns)
+{
+    MatrixNamedRow result;
+    result.rowHash = rowName;
+    result.rowName = std::move(rowName);
+
+    if (row.isRow()) {
+        ColumnPath prefix;
+        row.appendToRowDestructive(prefix, result.columns);
+    }
+
+    if (sortColumns)
+        std::sort(result.columns.begin(), result.columns.end());
+
+    return result;
+}
+
 void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   RestConnection & connection,
                   const std::string & format,
@@ -87,26 +149,11 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                                 "application/json");
     }
     else if (format == "sparse") {
-        std::vector<std::vector<std::pair<ColumnPath, CellValue> > > output;
+        std::vector<SparseRow> output;
         output.reserve(sparseOutput.size());
 
         for (auto & row: sparseOutput) {
-
-            std::vector<std::pair<ColumnPath, CellValue> > rowOut;
-            rowOut.reserve(row.columns.size() + rowNames + rowHashes);
-
-            if (rowNames)
-                rowOut.emplace_back(ColumnPath("_rowName"), row.rowName.toUtf8String());
-            if (rowHashes)
-                rowOut.emplace_back(ColumnPath("_rowHash"), row.rowHash.toString());
-
-            for (auto & c: row.columns) {
-                rowOut.emplace_back(std::get<0>(c), std::get<1>(c));
-            }
-
-            std::sort(rowOut.begin() + rowNames + rowHashes, rowOut.end());
-
-            output.emplace_back(std::move(rowOut));
+            output.emplace_back(toSparseRow(row, rowNames, rowHashes));
         }
 
         connection.sendResponse(200, jsonEncodeStr(output),
@@ -140,21 +187,7 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         // Array of structures; one structure per row
         std::vector<std::map<ColumnPath, CellValue> > output;
         for (unsigned i = 0;  i < sparseOutput.size();  ++i) {
-
-            std::map<ColumnPath, CellValue> row;
-
-            if (rowNames)
-                row[ColumnPath("_rowName")] = sparseOutput[i].rowName.toUtf8String();
-            if (rowHashes)
-                row[ColumnPath("_rowHash")] = sparseOutput[i].rowHash.toString();
-
-            for (auto & c: sparseOutput[i].columns) {
-                const ColumnPath & col = std::get<0>(c);
-                const CellValue & val = std::get<1>(c);
-                row[col] = val;
-            }
-
-            output.emplace_back(std::move(row));
+            output.emplace_back(toAosRow(sparseOutput[i], rowNames, rowHashes));
         }
         connection.sendResponse(200, jsonEncodeStr(output),
                                 "application/json");
@@ -278,11 +311,142 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
         connection.sendResponse(200, jsonEncodeStr(val),
                                 "application/json"); 
     }
+    else if (format == "arrow") {
+        connection.sendResponse(200,
+                                encodeArrowStream(sparseOutput, rowNames,
+                                                  rowHashes, sortColumns),
+                                ARROW_STREAM_CONTENT_TYPE);
+    }
     else {
         connection.sendErrorResponse(400, "Unknown output format '" + format + "'");
     }
 }
 
+namespace {
+
+/// Rows are sent in batches of about this many bytes
+static constexpr size_t STREAMING_BATCH_BYTES = 1024 * 1024;
+
+/** Sends a JSON array in batches of elements, using chunked encoding.
+    Only one batch is written to the connection at a time; the next one is
+    encoded while it's being written, and waits for it to be done.
+*/
+struct JsonArrayStream {
+    JsonArrayStream(RestConnection & connection)
+        : connection(connection), started(false), numElements(0)
+    {
+        buffer = "[";
+    }
+
+    RestConnection & connection;
+    std::string buffer;
+    bool started;
+    size_t numElements;
+
+    /// Add an encoded element.  Returns false if the client went away.
+    bool add(const std::string & element)
+    {
+        if (numElements++ != 0)
+            buffer += ',';
+        buffer += element;
+
+        if (buffer.size() < STREAMING_BATCH_BYTES)
+            return true;
+
+        if (!started) {
+            connection.sendHttpResponseHeader(200, "application/json",
+                                              RestConnection::CHUNKED_ENCODING);
+            started = true;
+        }
+
+        if (!connection.waitUntilSent(0 /* maxBytesPending */))
+            return false;
+
+        connection.sendPayload(std::move(buffer));
+        buffer.clear();
+        return true;
+    }
+
+    void finish()
+    {
+        buffer += ']';
+        if (!started) {
+            connection.sendResponse(200, std::move(buffer), "application/json");
+            return;
+        }
+        if (connection.waitUntilSent(0 /* maxBytesPending */)) {
+            connection.sendPayload(std::move(buffer));
+            connection.finishResponse();
+        }
+    }
+};
+
+} // file scope
+
+void runHttpQueryIncremental(std::function<bool (OnQueryRow & onRow)> runQuery,
+                             RestConnection & connection,
+                             const std::string & format,
+                             bool createHeaders,
+                             bool rowNames,
+                             bool rowHashes,
+                             bool sortColumns)
+{
+    if (format != "full" && format != "" && format != "sparse"
+        && format != "aos") {
+        // We need all of the rows before we can send anything
+        auto runAllRows = [&] ()
+            {
+                std::vector<MatrixNamedRow> rows;
+                OnQueryRow onRow = [&] (Path & rowName, ExpressionValue & row)
+                    {
+                        rows.emplace_back(toMatrixNamedRow(rowName, row,
+                                                           false /* sort */));
+                        return true;
+                    };
+                runQuery(onRow);
+                return rows;
+            };
+
+        runHttpQuery(runAllRows, connection, format, createHeaders,
+                     rowNames, rowHashes, sortColumns);
+        return;
+    }
+
+    JsonArrayStream stream(connection);
+
+    OnQueryRow onRow = [&] (Path & rowName, ExpressionValue & row)
+        {
+            MatrixNamedRow output = toMatrixNamedRow(rowName, row, sortColumns);
+
+            if (format == "sparse")
+                return stream.add(jsonEncodeStr(toSparseRow(output, rowNames,
+                                                            rowHashes)));
+            else if (format == "aos")
+                return stream.add(jsonEncodeStr(toAosRow(output, rowNames,
+                                                         rowHashes)));
+            else return stream.add(jsonEncodeStr(output));
+        };
+
+    try {
+        if (!runQuery(onRow)) {
+            // The client went away; there is nobody left to respond to
+            return;
+        }
+    } catch (const std::exception & exc) {
+        // Until the header is sent, the error is returned as usual
+        if (!stream.started)
+            throw;
+
+        // Otherwise it's too late to change the response code; we make
+        // sure that the client sees that the response is incomplete.
+        Json::Value error = extractException(exc, 500);
+        connection.abortResponse(error.get("httpCode", 500).asInt(), error);
+        return;
+    }
+
+    stream.finish();
+}
+
 
 /*****************************************************************************/
 /* DATASET COLLECTION                                                         */
@@ -594,14 +758,15 @@ queryStructured(const Dataset * dataset,
     //cerr << "limit = " << limit << endl;
     //cerr << "offset = " << offset << endl;
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (OnQueryRow & onRow)
         {
-            return dataset->queryStructured
-                (selectParsed, whenParsed, *whereParsed, orderByParsed,
+            return dataset->queryStructuredIncremental
+                (onRow, selectParsed, whenParsed, *whereParsed, orderByParsed,
                  groupByParsed,havingParsed, rowNameParsed, offset, limit);
         };
 
-    runHttpQuery(runQuery, connection, format, createHeaders,rowNames, rowHashes, sortColumns);
+    runHttpQueryIncremental(runQuery, connection, format, createHeaders,
+                            rowNames, rowHashes, sortColumns);
 }
 
 template class PolyCollection<Dataset>;
@@ -34,6 +34,30 @@ void runHttpQuery(std::function<std::vector<MatrixNamedRow> ()> runQuery,
                   bool rowNames,
                   bool rowHashes,
                   bool sortColumns);
+
+/** Function called with each row of an incremental query, in order.  It
+    returns false to stop the query.
+*/
+typedef std::function<bool (Path & rowName, ExpressionValue & row)> OnQueryRow;
+
+/** Same as runHttpQuery(), but the query passes its rows one by one to the
+    given function (it's typically queryStructuredIncremental() or the
+    incremental queryFromStatement()), and returns false if it was stopped.
+
+    The full, sparse and aos formats, which have one element per row, are
+    streamed: the rows are encoded as they come and sent in batches with
+    chunked encoding, waiting for the client to receive each batch.  This
+    avoids having the whole result in memory, and the first rows are sent
+    before the query is finished.  A response which fits in one batch is
+    sent as usual.  The other formats need all of the rows first.
+*/
+void runHttpQueryIncremental(std::function<bool (OnQueryRow & onRow)> runQuery,
+                             RestConnection & connection,
+                             const std::string & format,
+                             bool createHeaders,
+                             bool rowNames,
+                             bool rowHashes,
+                             bool sortColumns);
                       
 
 /*****************************************************************************/
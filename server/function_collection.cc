@@ -15,6 +15,12 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/server/dataset_context.h"
 #include "mldb/types/map_description.h"
+#include "mldb/arch/timers.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/server/analytics.h"
+#include <mutex>
+#include <atomic>
 
 
 
@@ -71,65 +77,159 @@ registerFunctionType(const Package & package,
 /* FUNCTION                                                                  */
 /*****************************************************************************/
 
-ExpressionValue
+/** Cache of the applier used by Function::call().  The applier is bound
+    against the function's declared input, so there is only ever one per
+    function.  It may hold on to other entities (datasets, functions, ...)
+    that were resolved when it was bound, so it's dropped as soon as any
+    entity on the server changes; otherwise a deleted entity would be kept
+    alive, or two functions that call each other would keep each other
+    alive through their caches.
+*/
+struct Function::ApplierCache {
+    ApplierCache(MldbServer * server)
+        : server(server), generation(0), hits(0), misses(0),
+          bindTimeSeconds(0.0)
+    {
+    }
+
+    /// Keeps the scope alive alongside the applier that was bound in it
+    struct Bound {
+        std::shared_ptr<SqlExpressionMldbScope> scope;
+        std::unique_ptr<FunctionApplier> applier;
+    };
+
+    MldbServer * server;
+    std::mutex mutex;
+    std::shared_ptr<const FunctionApplier> applier;
+    uint64_t generation;
+    std::atomic<uint64_t> hits;
+    std::atomic<uint64_t> misses;
+    double bindTimeSeconds;
+
+    /// Every cache, so that dropCachedAppliers() can find them.  These are
+    /// weak so that a function's cache goes away with the function.
+    static std::mutex registryMutex;
+    static std::vector<std::weak_ptr<ApplierCache> > registry;
+};
+
+std::mutex Function::ApplierCache::registryMutex;
+std::vector<std::weak_ptr<Function::ApplierCache> >
+Function::ApplierCache::registry;
+
+std::shared_ptr<Function::ApplierCache>
 Function::
-call(const ExpressionValue & input) const
+getApplierCache() const
 {
-    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
-    
-    auto info = this->getFunctionInfo();
-
-#if 0
-    //cerr << "function info is " << jsonEncode(info) << endl;
-
-    ExpressionValue inputContext;
-
-    auto onColumn = [&] (const PathElement & columnName,
-                         const Path & prefix,
-                         const ExpressionValue & val)
-        {
-            const Utf8String & name(p.first);
-            const ExpressionValue & v(p.second);
-            const ExpressionValueInfo * valueInfo = nullptr;
-        
-            auto it = info.input.values.find(name);
+    auto result = std::atomic_load(&applierCache);
+    if (result)
+        return result;
+
+    auto newCache = std::make_shared<ApplierCache>
+        (MldbEntity::getOwner(this->server));
+    if (!std::atomic_compare_exchange_strong(&applierCache, &result, newCache))
+        return result;  // Someone else got there first; result is theirs
+
+    std::unique_lock<std::mutex> guard(ApplierCache::registryMutex);
+    ApplierCache::registry.emplace_back(newCache);
+    return newCache;
+}
 
-            try {
-                MLDB_TRACE_EXCEPTIONS(false);
+std::shared_ptr<const FunctionApplier>
+Function::
+getCachedApplier() const
+{
+    MldbServer * owner = MldbEntity::getOwner(this->server);
+    auto cache = getApplierCache();
+
+    // Read the generation before binding, so that an entity changing
+    // while we bind stops us from caching what we bound.
+    uint64_t generation = owner->entityGeneration;
+
+    std::shared_ptr<const FunctionApplier> stale;
+    {
+        std::unique_lock<std::mutex> guard(cache->mutex);
+        if (cache->applier && cache->generation == generation) {
+            ++cache->hits;
+            return cache->applier;
+        }
+        stale = std::move(cache->applier);
+    }
 
-                // skip unknown values
-                if (it == info.input.values.end())
-                    continue;
+    // Let go of the entities the old applier refers to before binding
+    // a new one, rather than having both alive at once
+    stale.reset();
+
+    ++cache->misses;
+
+    // Bind outside of the lock, as binding may call other functions
+    Timer timer;
+    auto bound = std::make_shared<ApplierCache::Bound>();
+    bound->scope = std::make_shared<SqlExpressionMldbScope>(owner);
+    bound->applier = this->bind(*bound->scope, getFunctionInfo().input);
+    std::shared_ptr<const FunctionApplier> result(bound, bound->applier.get());
+    double elapsed = timer.elapsed_wall();
+
+    std::unique_lock<std::mutex> guard(cache->mutex);
+    cache->bindTimeSeconds += elapsed;
+
+    // The generation is incremented before caches are dropped, so checking
+    // it under the lock means we can't cache an applier that has already
+    // missed being dropped.
+    if (owner->entityGeneration == generation) {
+        cache->applier = result;
+        cache->generation = generation;
+    }
+    return result;
+}
 
-                // Save the expected value type to put it in an error message later
-                valueInfo = it->second.valueInfo.get();
-        
-                inputContext.set(name, v);
-            } catch (const std::exception & exc) {
-                Json::Value details;
-                details["valueName"] = name;
-                details["value"] = jsonEncode(v);
-                details["functionName"] = this->config_->id;
-                details["functionType"] = this->type_;
-                if (valueInfo)
-                    details["valueExpectedType"] = jsonEncode(it->second.valueInfo);
-
-                rethrowHttpException(400, "Parsing value '" + name + "' with value '"
-                                     + jsonEncodeStr(v) + "' for function '"
-                                     + this->config_->id + "': " + exc.what(),
-                                     details);
+void
+Function::
+dropCachedAppliers(MldbServer * server)
+{
+    std::vector<std::shared_ptr<ApplierCache> > caches;
+    {
+        std::unique_lock<std::mutex> guard(ApplierCache::registryMutex);
+        auto & registry = ApplierCache::registry;
+        for (auto it = registry.begin();  it != registry.end();) {
+            auto cache = it->lock();
+            if (!cache) {
+                it = registry.erase(it);
+                continue;
             }
-        };
+            if (cache->server == server)
+                caches.emplace_back(std::move(cache));
+            ++it;
+        }
+    }
 
-    for (auto & p: input) {
+    for (auto & cache: caches) {
+        // Destroyed outside of the lock, as that may destroy the entities
+        // that the applier refers to
+        std::shared_ptr<const FunctionApplier> dropped;
+        std::unique_lock<std::mutex> guard(cache->mutex);
+        dropped = std::move(cache->applier);
+        guard.unlock();
     }
-#endif
+}
 
-    //cerr << "inputContext = " << jsonEncode(inputContext) << endl;
+FunctionApplierCacheStats
+Function::
+getApplierCacheStats() const
+{
+    auto cache = getApplierCache();
+    std::unique_lock<std::mutex> guard(cache->mutex);
+    FunctionApplierCacheStats result;
+    result.hits = cache->hits;
+    result.misses = cache->misses;
+    result.bindTimeSeconds = cache->bindTimeSeconds;
+    return result;
+}
 
-    auto applier = this->bind(outerContext, info.input);
-    
-    return applier->apply(input);
+ExpressionValue
+Function::
+call(const ExpressionValue & input) const
+{
+    return getCachedApplier()->apply(input);
 }
 
 /*****************************************************************************/
@@ -150,6 +250,9 @@ applyFunction(const Function * function,
               const std::string & outputFormat,
               RestConnection & connection) const
 {
+    JobGroupScope jobGroup
+        (getQueryJobGroup(Utf8String(), "function application"));
+
     StructValue inputExpr;
     inputExpr.reserve(input.size());
     for (auto & i: input) {
@@ -211,6 +314,200 @@ applyFunction(const Function * function,
     }
 }
 
+namespace {
+
+/// Number of inputs in each parallel task of a batch apply
+static constexpr size_t BATCH_CHUNK_SIZE = 64;
+
+/** Apply the function to numInputs inputs in parallel, returning the
+    outputs in the same order as the inputs.  getInput(i) must return the
+    i-th input, and is called from the worker threads.
+*/
+std::vector<ExpressionValue>
+applyInParallel(const FunctionApplier & applier,
+                size_t numInputs,
+                const std::function<ExpressionValue (size_t)> & getInput)
+{
+    std::vector<ExpressionValue> result(numInputs);
+    if (numInputs == 0)
+        return result;
+
+    auto doChunk = [&] (size_t first, size_t last)
+        {
+            for (size_t i = first;  i < last;  ++i)
+                result[i] = applier.apply(getInput(i));
+        };
+
+    parallelMapChunked(0, numInputs, BATCH_CHUNK_SIZE, doChunk);
+    return result;
+}
+
+/** Reader and writer for the dense binary batch format:
+
+    - uint32_t number of rows;
+    - uint32_t number of columns;
+    - for each column, a uint32_t length followed by that many bytes of
+      the UTF-8 encoded column name (parsed as a path, so "features.x"
+      is the column x of the input value features);
+    - number of rows x number of columns float32 values, row major.
+
+    All integers and floats are little endian.
+*/
+struct DenseBatch {
+    std::vector<ColumnPath> columns;
+    size_t numRows = 0;
+    const char * values = nullptr;  // may not be aligned
+
+    float value(size_t row, size_t col) const
+    {
+        float result;
+        memcpy(&result, values + (row * columns.size() + col) * sizeof(float),
+               sizeof(float));
+        return result;
+    }
+
+    static DenseBatch parse(const std::string & payload)
+    {
+        DenseBatch result;
+        const char * p = payload.data();
+        const char * e = p + payload.size();
+
+        auto readBytes = [&] (size_t n) -> const char *
+            {
+                if ((size_t)(e - p) < n)
+                    throw HttpReturnException
+                        (400, "Dense batch input is truncated",
+                         "payloadLength", payload.size());
+                const char * result = p;
+                p += n;
+                return result;
+            };
+
+        auto readUInt32 = [&] () -> uint32_t
+            {
+                uint32_t result;
+                memcpy(&result, readBytes(sizeof(result)), sizeof(result));
+                return result;
+            };
+
+        result.numRows = readUInt32();
+        uint32_t numColumns = readUInt32();
+        for (uint32_t i = 0;  i < numColumns;  ++i) {
+            uint32_t length = readUInt32();
+            const char * name = readBytes(length);
+            result.columns.emplace_back
+                (ColumnPath::parse(Utf8String(std::string(name, name + length))));
+        }
+
+        size_t numValues = result.numRows * numColumns;
+        result.values = readBytes(numValues * sizeof(float));
+        if (p != e)
+            throw HttpReturnException
+                (400, "Dense batch input has extra data after the values",
+                 "payloadLength", payload.size(),
+                 "extraBytes", e - p);
+        return result;
+    }
+
+    /// Append the header for the given dimensions to the output
+    static void writeHeader(std::string & out,
+                            uint32_t numRows,
+                            const std::vector<ColumnPath> & columns)
+    {
+        uint32_t numColumns = columns.size();
+        out.append((const char *)&numRows, sizeof(numRows));
+        out.append((const char *)&numColumns, sizeof(numColumns));
+        for (auto & c: columns) {
+            std::string name = c.toUtf8String().rawString();
+            uint32_t length = name.size();
+            out.append((const char *)&length, sizeof(length));
+            out.append(name);
+        }
+    }
+};
+
+/** Builds the function inputs for rows of a dense batch.  Columns are
+    grouped by the first element of their path; a column with a single
+    element is passed as a number, and the others become a row of
+    numbers sharing its column names between all inputs.
+*/
+struct DenseInputBuilder {
+    DenseInputBuilder(const DenseBatch & batch, Date ts)
+        : batch(batch), ts(ts)
+    {
+        std::map<PathElement, size_t> groupIndex;
+
+        for (size_t i = 0;  i < batch.columns.size();  ++i) {
+            const ColumnPath & col = batch.columns[i];
+            if (col.empty())
+                throw HttpReturnException
+                    (400, "Dense batch input has an empty column name");
+
+            auto it = groupIndex.insert({ col.head(), groups.size() }).first;
+            if (it->second == groups.size()) {
+                groups.emplace_back();
+                groups.back().name = col.head();
+            }
+
+            Group & group = groups[it->second];
+            bool isAtom = col.size() == 1;
+            if (!group.columns.empty() && isAtom != (group.names == nullptr))
+                throw HttpReturnException
+                    (400, "Dense batch input column '" + col.toUtf8String()
+                     + "' is both a value and a row",
+                     "column", col);
+
+            if (!isAtom) {
+                if (!group.names)
+                    group.names = std::make_shared<std::vector<ColumnPath> >();
+                group.names->emplace_back(col.tail());
+            }
+            else if (!group.columns.empty())
+                throw HttpReturnException
+                    (400, "Dense batch input column '" + col.toUtf8String()
+                     + "' is repeated",
+                     "column", col);
+            group.columns.push_back(i);
+        }
+    }
+
+    ExpressionValue operator () (size_t row) const
+    {
+        StructValue result;
+        result.reserve(groups.size());
+
+        for (auto & g: groups) {
+            if (!g.names) {
+                result.emplace_back
+                    (g.name,
+                     ExpressionValue((double)batch.value(row, g.columns[0]), ts));
+                continue;
+            }
+
+            std::vector<double> values;
+            values.reserve(g.columns.size());
+            for (auto & c: g.columns)
+                values.push_back(batch.value(row, c));
+            result.emplace_back(g.name, ExpressionValue(values, g.names, ts));
+        }
+
+        return std::move(result);
+    }
+
+private:
+    struct Group {
+        PathElement name;
+        std::shared_ptr<std::vector<ColumnPath> > names;  // null for an atom
+        std::vector<size_t> columns;
+    };
+
+    const DenseBatch & batch;
+    Date ts;
+    std::vector<Group> groups;
+};
+
+} // file scope
+
 void
 FunctionCollection::
 applyBatch(const Function * function,
@@ -219,66 +516,174 @@ applyBatch(const Function * function,
            const std::string & outputFormat,
            RestConnection & connection) const
 {
+    JobGroupScope jobGroup
+        (getQueryJobGroup(Utf8String(), "function application"));
+
     if (inputFormat != "json") {
         throw HttpReturnException
             (400, "batch apply only accepts 'json' input format currently; got '"
-             + inputFormat + "'");
+             + inputFormat + "'.  Use the batchDense route for binary input.");
     }
     if (outputFormat != "json") {
         throw HttpReturnException
             (400, "batch apply only accepts 'json' output format currently; got '"
-             + inputFormat + "'");
+             + outputFormat + "'");
     }
 
-    Utf8String str;
-    Utf8StringJsonPrintingContext printingContext(str);
+    if (inputs.isNull()) {
+        connection.sendResponse(200, inputs, "application/json");
+        return;
+    }
 
-    SqlExpressionMldbScope outerContext(MldbEntity::getOwner(this->server));
-    
-    auto info = function->getFunctionInfo();
-    auto applier = function->bind(outerContext, info.input);
+    auto applier = function->getCachedApplier();
     
     Date ts = Date::now();
 
-    auto doInput = [&] (const Json::Value & val)
+    // Collect the inputs so that they can be parsed and applied in
+    // parallel; the output is written in order afterwards.
+    std::vector<const Json::Value *> elements;
+    if (inputs.isArray() || inputs.isObject()) {
+        elements.reserve(inputs.size());
+        for (auto it = inputs.begin(), end = inputs.end();
+             it != end;  ++it) {
+            elements.push_back(&*it);
+        }
+    }
+    else {
+        elements.push_back(&inputs);
+    }
+
+    auto getInput = [&] (size_t i)
         {
-            StructuredJsonParsingContext context(val);
-            ExpressionValue inputExpr
-                = ExpressionValue::parseJson(context, ts);
-            ExpressionValue output
-                = function->apply(*applier, std::move(inputExpr));
-            output.extractJson(printingContext);
+            StructuredJsonParsingContext context(*elements[i]);
+            return ExpressionValue::parseJson(context, ts);
         };
 
-    if (inputs.isNull()) {
-        connection.sendResponse(200, inputs, "application/json");
-        return;
-    }
-    else if (inputs.isArray()) {
+    std::vector<ExpressionValue> outputs
+        = applyInParallel(*applier, elements.size(), getInput);
+
+    Utf8String str;
+    Utf8StringJsonPrintingContext printingContext(str);
+
+    if (inputs.isArray()) {
         printingContext.startArray(inputs.size());
-        for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
+        for (auto & output: outputs) {
             printingContext.newArrayElement();
-            doInput(*it);
+            output.extractJson(printingContext);
         }
         printingContext.endArray();
     }
     else if (inputs.isObject()) {
         printingContext.startObject();
+        size_t i = 0;
         for (auto it = inputs.begin(), end = inputs.end();
-             it != end;  ++it) {
+             it != end;  ++it, ++i) {
             printingContext.startMember(it.memberName());
-            doInput(*it);
+            outputs[i].extractJson(printingContext);
         }
         printingContext.endObject();
     }
     else {
-        doInput(inputs);
+        outputs.at(0).extractJson(printingContext);
     }
 
     connection.sendResponse(200, str.stealRawString(), "application/json");
 }
 
+void
+FunctionCollection::
+applyBatchDense(const Function * function,
+                const std::string & payload,
+                const std::string & outputFormat,
+                RestConnection & connection) const
+{
+    JobGroupScope jobGroup
+        (getQueryJobGroup(Utf8String(), "function application"));
+
+    if (outputFormat != "dense" && outputFormat != "json") {
+        throw HttpReturnException
+            (400, "dense batch apply accepts 'dense' or 'json' output format; "
+             "got '" + outputFormat + "'");
+    }
+
+    DenseBatch batch = DenseBatch::parse(payload);
+
+    auto applier = function->getCachedApplier();
+
+    DenseInputBuilder getInput(batch, Date::now());
+
+    std::vector<ExpressionValue> outputs
+        = applyInParallel(*applier, batch.numRows, getInput);
+
+    if (outputFormat == "json") {
+        Utf8String str;
+        Utf8StringJsonPrintingContext printingContext(str);
+        printingContext.startArray(outputs.size());
+        for (auto & output: outputs) {
+            printingContext.newArrayElement();
+            output.extractJson(printingContext);
+        }
+        printingContext.endArray();
+        connection.sendResponse(200, str.stealRawString(), "application/json");
+        return;
+    }
+
+    // Dense output: the columns are the flattened columns of the first
+    // output, and every other output needs to have the same ones.
+    std::vector<ColumnPath> columns;
+    if (!outputs.empty()) {
+        auto onAtom = [&] (const Path & columnName, const Path & prefix,
+                           const CellValue & val, Date ts)
+            {
+                columns.emplace_back(prefix + columnName);
+                return true;
+            };
+        outputs[0].forEachAtom(onAtom);
+    }
+
+    std::string result;
+    result.reserve(2 * sizeof(uint32_t) + 16 * columns.size()
+                   + outputs.size() * columns.size() * sizeof(float));
+    DenseBatch::writeHeader(result, outputs.size(), columns);
+
+    for (size_t i = 0;  i < outputs.size();  ++i) {
+        size_t n = 0;
+        auto onAtom = [&] (const Path & columnName, const Path & prefix,
+                           const CellValue & val, Date ts)
+            {
+                if (n >= columns.size() || columns[n] != prefix + columnName)
+                    throw HttpReturnException
+                        (400, "Output " + std::to_string(i) + " of dense "
+                         "batch apply has different columns to the first "
+                         "output; use 'json' output format instead",
+                         "row", i,
+                         "column", prefix + columnName);
+                if (!val.empty() && !val.isNumber())
+                    throw HttpReturnException
+                        (400, "Output column '" + (prefix + columnName).toUtf8String()
+                         + "' of dense batch apply is not a number; "
+                         "use 'json' output format instead",
+                         "row", i,
+                         "value", val);
+                float f = val.empty() ? std::numeric_limits<float>::quiet_NaN()
+                    : val.toDouble();
+                result.append((const char *)&f, sizeof(f));
+                ++n;
+                return true;
+            };
+        outputs[i].forEachAtom(onAtom);
+
+        if (n != columns.size())
+            throw HttpReturnException
+                (400, "Output " + std::to_string(i) + " of dense batch apply "
+                 "has fewer columns than the first output; use 'json' "
+                 "output format instead",
+                 "row", i);
+    }
+
+    connection.sendResponse(200, std::move(result), "application/octet-stream");
+}
+
 void
 FunctionCollection::
 initRoutes(RouteManager & manager)
@@ -348,6 +753,27 @@ initRoutes(RouteManager & manager)
                   PassConnectionId()
                   );
 
+    const char * outputFormatDefStr3 = "String describing output format: "
+        "'dense' (the default) returns the flattened numeric outputs in the "
+        "same binary format as the input, with the columns of the first "
+        "output; 'json' returns a JSON array with one output per row.";
+
+    addRouteAsync(*manager.valueNode, "/batchDense", { "POST" },
+                  "Apply a function to each row of a dense binary float32 "
+                  "matrix and return the outputs in the same order",
+                  &FunctionCollection::applyBatchDense,
+                  manager.getCollection,
+                  getFunction,
+                  StringPayload("Binary matrix: uint32 number of rows, "
+                                "uint32 number of columns, for each column "
+                                "a uint32 length and UTF-8 name, then the "
+                                "float32 values in row major order; all "
+                                "little endian"),
+                  RestParamDefault<std::string>
+                      ("outputFormat", outputFormatDefStr3, "dense"),
+                  PassConnectionId()
+                  );
+
     addRouteSyncJsonReturn(*manager.valueNode, "/info", { "GET" },
                            "Return information about the values and metadata of the function",
                            "Function information structure",
@@ -360,6 +786,13 @@ initRoutes(RouteManager & manager)
                            &Function::getDetails,
                            getFunction);
 
+    addRouteSyncJsonReturn(*manager.valueNode, "/applierCache", { "GET" },
+                           "Return the counters of the cached applier used "
+                           "to call the function directly",
+                           "Applier cache statistics",
+                           &Function::getApplierCacheStats,
+                           getFunction);
+
     // Make the plugin handle a route
     RestRequestRouter::OnProcessRequest handlePluginRoute
         = [=] (RestConnection & connection,
@@ -41,6 +41,16 @@ struct FunctionCollection: public PolyCollection<Function> {
                     const std::string & inputFormat,
                     const std::string & outputFormat,
                     RestConnection & connection) const;
+
+    /** Apply the function to each row of a dense float32 matrix passed in
+        a binary payload, which avoids the cost of parsing and printing
+        JSON for large batches of numeric features.  See the batchDense
+        route for the format.
+    */
+    void applyBatchDense(const Function * function,
+                         const std::string & payload,
+                         const std::string & outputFormat,
+                         RestConnection & connection) const;
     
     static ExpressionValue call(MldbServer * server,
                                const Function * function,
@@ -0,0 +1,230 @@
+/** group_by_table.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Structures to hold the groups of a GROUP BY query.
+*/
+
+#include "mldb/server/group_by_table.h"
+#include "mldb/plugins/frozen_column.h"
+#include "mldb/types/vector_description.h"
+#include "mldb/http/http_exception.h"
+#include <unistd.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GROUP BY SPILL                                                            */
+/*****************************************************************************/
+
+/// Amount of data buffered per bucket before it's written out
+static constexpr size_t SPILL_BUFFER_SIZE = 4 * 1024 * 1024;
+
+GroupBySpill::
+GroupBySpill(const std::string & directory_,
+             size_t numBuckets,
+             size_t numPartitions)
+    : directory(directory_), numPartitions_(numPartitions),
+      buckets(numBuckets)
+{
+    ExcAssertGreater(numPartitions, 0);
+
+    if (directory.empty()) {
+        const char * tmp = getenv("TMPDIR");
+        directory = tmp && *tmp ? tmp : "/tmp";
+    }
+
+    for (auto & b: buckets) {
+        std::string name = directory + "/mldb-group-by-XXXXXX";
+        std::vector<char> path(name.begin(), name.end());
+        path.push_back(0);
+
+        b.fd = mkstemp(path.data());
+        if (b.fd == -1)
+            throw HttpReturnException
+                (500, "Couldn't create GROUP BY spill file in '"
+                 + directory + "': " + strerror(errno),
+                 "directory", directory);
+
+        // We never need to open it again, so it can be removed right away
+        unlink(path.data());
+
+        b.buffers.resize(numPartitions);
+    }
+}
+
+GroupBySpill::
+~GroupBySpill()
+{
+    for (auto & b: buckets) {
+        if (b.fd != -1)
+            close(b.fd);
+    }
+}
+
+namespace {
+
+enum SpilledValueType : uint8_t {
+    SPILLED_ATOM = 0,   ///< Cell value and timestamp
+    SPILLED_JSON = 1    ///< Anything else, as JSON
+};
+
+void writeSpilledRow(FrozenColumnSerializer & serializer,
+                     const std::vector<ExpressionValue> & row)
+{
+    serializer.writePod<uint32_t>(row.size());
+    for (auto & v: row) {
+        if (v.isAtom()) {
+            serializer.writePod<uint8_t>(SPILLED_ATOM);
+            serializer.writeCellValue(v.getAtom());
+            serializer.writePod<double>
+                (v.getEffectiveTimestamp().secondsSinceEpoch());
+        }
+        else {
+            serializer.writePod<uint8_t>(SPILLED_JSON);
+            serializer.writeString(jsonEncodeStr(v));
+        }
+    }
+}
+
+void readSpilledRow(FrozenColumnReconstituter & reconstituter,
+                    std::vector<ExpressionValue> & row)
+{
+    uint32_t size = reconstituter.readPod<uint32_t>();
+    row.clear();
+    row.reserve(size);
+    for (uint32_t i = 0;  i < size;  ++i) {
+        uint8_t type = reconstituter.readPod<uint8_t>();
+        if (type == SPILLED_ATOM) {
+            CellValue atom = reconstituter.readCellValue();
+            Date ts = Date::fromSecondsSinceEpoch
+                (reconstituter.readPod<double>());
+            row.emplace_back(std::move(atom), ts);
+        }
+        else if (type == SPILLED_JSON) {
+            row.emplace_back
+                (jsonDecodeStr<ExpressionValue>(reconstituter.readString()));
+        }
+        else throw HttpReturnException
+                 (500, "Corrupt GROUP BY spill file: unknown value type",
+                  "type", (int)type);
+    }
+}
+
+} // file scope
+
+void
+GroupBySpill::
+add(size_t bucket, size_t partition,
+    const std::vector<ExpressionValue> & row)
+{
+    Bucket & b = buckets.at(bucket);
+    FrozenColumnSerializer serializer(b.buffers.at(partition));
+    writeSpilledRow(serializer, row);
+
+    b.buffered += serializer.offset();
+    b.rows += 1;
+
+    if (b.buffered >= SPILL_BUFFER_SIZE)
+        flushBucket(b);
+}
+
+void
+GroupBySpill::
+flushBucket(Bucket & b)
+{
+    for (size_t p = 0;  p < numPartitions_;  ++p) {
+        std::string buffer = b.buffers[p].str();
+        if (buffer.empty())
+            continue;
+
+        size_t done = 0;
+        while (done < buffer.size()) {
+            ssize_t res = pwrite(b.fd, buffer.data() + done,
+                                 buffer.size() - done, b.written + done);
+            if (res == -1) {
+                if (errno == EINTR)
+                    continue;
+                throw HttpReturnException
+                    (500, "Error writing GROUP BY spill file: "
+                     + string(strerror(errno)),
+                     "directory", directory);
+            }
+            done += res;
+        }
+
+        b.chunks.push_back({ p, b.written, buffer.size() });
+        b.written += buffer.size();
+        b.buffers[p].str(std::string());
+    }
+
+    b.buffered = 0;
+}
+
+void
+GroupBySpill::
+flush()
+{
+    for (auto & b: buckets)
+        flushBucket(b);
+}
+
+void
+GroupBySpill::
+forEachRow(size_t bucket, size_t partition,
+           const std::function<void (std::vector<ExpressionValue> & row)> & onRow) const
+{
+    const Bucket & b = buckets.at(bucket);
+    ExcAssertEqual(b.buffered, 0);
+
+    std::string data;
+    for (auto & c: b.chunks) {
+        if (c.partition != partition)
+            continue;
+
+        data.resize(c.length);
+        size_t done = 0;
+        while (done < c.length) {
+            ssize_t res = pread(b.fd, &data[done], c.length - done,
+                                c.offset + done);
+            if (res == -1 && errno == EINTR)
+                continue;
+            if (res <= 0)
+                throw HttpReturnException
+                    (500, "Error reading GROUP BY spill file: "
+                     + string(res == 0 ? "unexpected end of file"
+                              : strerror(errno)),
+                     "directory", directory);
+            done += res;
+        }
+
+        FrozenColumnReconstituter reconstituter(data.data(), data.size(),
+                                                nullptr);
+        std::vector<ExpressionValue> row;
+        while (!reconstituter.eof()) {
+            readSpilledRow(reconstituter, row);
+            onRow(row);
+        }
+    }
+}
+
+size_t
+GroupBySpill::
+numRows() const
+{
+    size_t result = 0;
+    for (auto & b: buckets)
+        result += b.rows;
+    return result;
+}
+
+} // namespace MLDB
@@ -0,0 +1,246 @@
+/** group_by_table.h                                               -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Structures to hold the groups of a GROUP BY query: a flat hash table
+    keyed on the group key, and an on-disk store for the rows of groups
+    that don't fit in memory.
+*/
+
+#pragma once
+
+#include "mldb/sql/expression_value.h"
+#include "mldb/base/exc_assert.h"
+#include <vector>
+#include <string>
+#include <sstream>
+#include <functional>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* GROUP BY HASH TABLE                                                       */
+/*****************************************************************************/
+
+/** Hash table from a group key (the values of the GROUP BY clauses) to a
+    value.
+
+    Entries are stored in insertion order in flat arrays, and found via an
+    open addressing index (linear probing) that stores the entry number
+    alongside its hash.  This avoids a node allocation per group, and
+    lookups usually touch a single cache line of the index before the
+    key comparison.
+
+    Two keys are the same group if neither is less than the other, which
+    is the same equivalence as for a std::map<Key, Value>.
+*/
+
+template<typename Value>
+struct GroupByHashTable {
+
+    typedef std::vector<ExpressionValue> Key;
+
+    GroupByHashTable()
+        : numEntries(0)
+    {
+    }
+
+    /// Hash of a key; consistent with the equivalence of keys
+    static uint64_t hashKey(const Key & key)
+    {
+        uint64_t result = key.size();
+        for (auto & v: key) {
+            result = (result ^ v.hash()) * 0x9e3779b97f4a7c15ULL;
+            result ^= result >> 29;
+        }
+        return result;
+    }
+
+    static bool keysEqual(const Key & key1, const Key & key2)
+    {
+        if (key1.size() != key2.size())
+            return false;
+        for (size_t i = 0;  i < key1.size();  ++i) {
+            if (key1[i] < key2[i] || key2[i] < key1[i])
+                return false;
+        }
+        return true;
+    }
+
+    /** Find the entry with the given key, or insert one with a default
+        constructed value.  Returns the entry number and whether it was
+        inserted.  The hash must be hashKey(key).
+    */
+    std::pair<size_t, bool> insert(const Key & key, uint64_t hash)
+    {
+        if ((numEntries + 1) * 4 > index.size() * 3)
+            grow();
+
+        size_t mask = index.size() - 1;
+        for (size_t slot = hash & mask;  ;  slot = (slot + 1) & mask) {
+            Slot & s = index[slot];
+            if (s.entry == 0) {
+                s.entry = numEntries + 1;
+                s.hash = hash;
+                keys.push_back(key);
+                hashes.push_back(hash);
+                values.emplace_back();
+                ++numEntries;
+                return { numEntries - 1, true };
+            }
+            if (s.hash == hash && keysEqual(keys[s.entry - 1], key))
+                return { s.entry - 1, false };
+        }
+    }
+
+    /// Find the entry number for the given key, or -1 if it's not there
+    ssize_t find(const Key & key, uint64_t hash) const
+    {
+        if (index.empty())
+            return -1;
+        size_t mask = index.size() - 1;
+        for (size_t slot = hash & mask;  ;  slot = (slot + 1) & mask) {
+            const Slot & s = index[slot];
+            if (s.entry == 0)
+                return -1;
+            if (s.hash == hash && keysEqual(keys[s.entry - 1], key))
+                return s.entry - 1;
+        }
+    }
+
+    size_t size() const { return numEntries; }
+
+    bool empty() const { return numEntries == 0; }
+
+    void clear()
+    {
+        keys.clear();
+        hashes.clear();
+        values.clear();
+        index.clear();
+        numEntries = 0;
+    }
+
+    /// Entries, in insertion order
+    std::vector<Key> keys;
+    std::vector<uint64_t> hashes;
+    std::vector<Value> values;
+
+private:
+    struct Slot {
+        Slot()
+            : hash(0), entry(0)
+        {
+        }
+
+        uint64_t hash;
+        uint64_t entry;   ///< Entry number + 1, or 0 if the slot is empty
+    };
+
+    std::vector<Slot> index;
+    size_t numEntries;
+
+    void grow()
+    {
+        size_t newSize = index.empty() ? 16 : index.size() * 2;
+        std::vector<Slot> newIndex(newSize);
+        size_t mask = newSize - 1;
+
+        for (size_t i = 0;  i < numEntries;  ++i) {
+            size_t slot = hashes[i] & mask;
+            while (newIndex[slot].entry != 0)
+                slot = (slot + 1) & mask;
+            newIndex[slot].hash = hashes[i];
+            newIndex[slot].entry = i + 1;
+        }
+
+        index.swap(newIndex);
+    }
+};
+
+
+/*****************************************************************************/
+/* GROUP BY SPILL                                                            */
+/*****************************************************************************/
+
+/** Stores rows of a GROUP BY on local disk, partitioned by the hash of
+    their group key, so that the groups can be aggregated one partition at
+    a time once the input has been read.
+
+    Each bucket (the unit of parallelism of the query) has its own file,
+    and must only be written to by one thread at a time.  Rows are
+    buffered in memory per partition and written as chunks; reading back a
+    partition returns the rows of each bucket in the order they were
+    added.
+
+    Rows are written in the binary format of the frozen column serializer;
+    atoms (the usual case for group keys and aggregator arguments) are
+    written directly, and only structured values fall back to JSON.
+
+    The files are created in the given directory (or the system temporary
+    directory if it's empty) and are unlinked as soon as they are created,
+    so they disappear with the process.
+*/
+
+struct GroupBySpill {
+    GroupBySpill(const std::string & directory,
+                 size_t numBuckets,
+                 size_t numPartitions);
+
+    ~GroupBySpill();
+
+    /// Add a row to the given bucket and partition
+    void add(size_t bucket, size_t partition,
+             const std::vector<ExpressionValue> & row);
+
+    /// Write everything which is still buffered.  Must be called before
+    /// reading.
+    void flush();
+
+    /// Call the function on each row in the given bucket and partition
+    void forEachRow(size_t bucket, size_t partition,
+                    const std::function<void (std::vector<ExpressionValue> & row)> & onRow) const;
+
+    /// Number of rows added
+    size_t numRows() const;
+
+    size_t numPartitions() const { return numPartitions_; }
+
+    /// Partition for the given key hash
+    size_t partitionForHash(uint64_t hash) const
+    {
+        return (hash >> 32) % numPartitions_;
+    }
+
+private:
+    struct Chunk {
+        size_t partition;
+        uint64_t offset;
+        uint64_t length;
+    };
+
+    struct Bucket {
+        Bucket()
+            : fd(-1), written(0), buffered(0), rows(0)
+        {
+        }
+
+        int fd;
+        uint64_t written;
+        size_t buffered;
+        size_t rows;
+        std::vector<std::ostringstream> buffers;  // one per partition
+        std::vector<Chunk> chunks;
+    };
+
+    void flushBucket(Bucket & bucket);
+
+    std::string directory;
+    size_t numPartitions_;
+    std::vector<Bucket> buckets;
+};
+
+} // namespace MLDB
@@ -13,6 +13,7 @@
 #include "mldb/http/http_rest_proxy.h"
 #include "mldb/server/credential_collection.h"
 #include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/uri_cache.h"
 #include "mldb/utils/config.h"
 #include "mldb/soa/credentials/credential_provider.h"
 #include "mldb/soa/credentials/credentials.h"
@@ -92,6 +93,7 @@ int main(int argc, char ** argv)
     bool dontExitAfterScript = false;
 
     string cacheDir;
+    size_t uriCacheSizeMb = 10240;
     string httpBaseUrl = "";
 
 #if 0
@@ -143,6 +145,9 @@ int main(int argc, char ** argv)
          "directory to serve documentation from")
         ("cache-dir", value(&cacheDir),
          "Cache directory to memory map large files and store downloads")
+        ("uri-cache-size-mb",
+         value(&uriCacheSizeMb)->default_value(uriCacheSizeMb),
+         "Maximum size in MB of the downloads kept in the cache directory")
 
 #if 0
         ("peer-listen-port,l",
@@ -325,6 +330,8 @@ int main(int argc, char ** argv)
         // Set up the SSD cache, if configured
         if (!cacheDir.empty()) {
             server.setCacheDirectory(cacheDir);
+            setUriCacheDirectory(cacheDir + "/uris",
+                                 uriCacheSizeMb * 1024 * 1024);
         }
 
         // Scan each of our plugin directories
@@ -35,6 +35,10 @@
 #include "mldb/types/meta_value_description.h"
 #include "mldb/arch/simd.h"
 #include "mldb/utils/log.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/types/structure_description.h"
+#include "mldb/types/enum_description.h"
+#include "mldb/types/vector_description.h"
 
 
 using namespace std;
@@ -52,6 +56,69 @@ bool supportsSystemRequirements() {
 }
 } // file scope
 
+DECLARE_ENUM_DESCRIPTION(JobPriority);
+DECLARE_STRUCTURE_DESCRIPTION(JobGroupStatus);
+DECLARE_STRUCTURE_DESCRIPTION(ThreadPoolStatus);
+
+DEFINE_ENUM_DESCRIPTION(JobPriority);
+
+JobPriorityDescription::
+JobPriorityDescription()
+{
+    addValue("background", JOB_PRIORITY_BACKGROUND,
+             "Long running work, such as procedure runs");
+    addValue("normal", JOB_PRIORITY_NORMAL, "Normal priority");
+    addValue("interactive", JOB_PRIORITY_INTERACTIVE,
+             "Latency sensitive work, such as queries");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(JobGroupStatus);
+
+JobGroupStatusDescription::
+JobGroupStatusDescription()
+{
+    addField("name", &JobGroupStatus::name,
+             "Name of the group, which says what the work is");
+    addField("priority", &JobGroupStatus::priority,
+             "Priority of the group");
+    addField("maxShare", &JobGroupStatus::maxShare,
+             "Proportion of the threads that the group may use");
+    addField("maxThreads", &JobGroupStatus::maxThreads,
+             "Number of threads that the group may use right now; this is "
+             "lower while work of higher priority is running");
+    addField("threadsRunning", &JobGroupStatus::threadsRunning,
+             "Number of threads working for the group");
+    addField("threadsYielded", &JobGroupStatus::threadsYielded,
+             "Number of times a thread was given back to more urgent work");
+    addField("cancelled", &JobGroupStatus::cancelled,
+             "Was the work of the group cancelled?");
+}
+
+DEFINE_STRUCTURE_DESCRIPTION(ThreadPoolStatus);
+
+ThreadPoolStatusDescription::
+ThreadPoolStatusDescription()
+{
+    addField("numThreads", &ThreadPoolStatus::numThreads,
+             "Number of threads in the pool");
+    addField("jobsRunning", &ThreadPoolStatus::jobsRunning,
+             "Number of jobs queued or running");
+    addField("jobsSubmitted", &ThreadPoolStatus::jobsSubmitted,
+             "Number of jobs ever submitted");
+    addField("jobsFinished", &ThreadPoolStatus::jobsFinished,
+             "Number of jobs ever finished");
+    addField("jobsStolen", &ThreadPoolStatus::jobsStolen,
+             "Number of jobs run by a thread other than the one which "
+             "submitted them");
+    addField("jobsWithFullQueue", &ThreadPoolStatus::jobsWithFullQueue,
+             "Number of jobs run directly because the queue was full");
+    addField("jobsRunLocally", &ThreadPoolStatus::jobsRunLocally,
+             "Number of jobs run by the thread which submitted them");
+    addField("jobGroups", &ThreadPoolStatus::jobGroups,
+             "Queries, procedure runs and other work currently using the "
+             "pool");
+}
+
 
 // Creation functions exposed elsewhere
 std::shared_ptr<PluginCollection>
@@ -86,6 +153,7 @@ MldbServer(const std::string & serviceName,
            const std::string & httpBaseUrl)
     : ServicePeer(serviceName, "MLDB", "global", enableAccessLog),
       EventRecorder(serviceName, std::make_shared<NullEventService>()),
+      entityGeneration(0),
       httpBaseUrl(httpBaseUrl), versionNode(nullptr),
       logger(getMldbLog<MldbServer>())
 {
@@ -187,6 +255,12 @@ initRoutes()
                            this,
                            RestParam<std::string>("type", "The type to look up"));
 
+    addRouteSyncJsonReturn(versionNode, "/threadPool", {"GET"},
+                           "Get the status of the thread pool",
+                           "Counters of the pool and the work using it",
+                           &MldbServer::getThreadPoolStatus,
+                           this);
+
     versionNode.addRoute("/shutdown", "POST", "Shutdown the service",
                          handleShutdown,
                          Json::Value());
@@ -263,14 +337,17 @@ runHttpQuery(const Utf8String& query,
     auto stm = SelectStatement::parse(query.rawString());
     SqlExpressionMldbScope mldbContext(this);
 
-    auto runQuery = [&] ()
+    auto runQuery = [&] (OnQueryRow & onRow)
         {
-            return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
+            return queryFromStatement(onRow, stm, mldbContext);
         };
 
-    MLDB::runHttpQuery(runQuery,
-                       connection, format, createHeaders,
-                       rowNames, rowHashes, sortColumns);
+    // Queries get their threads ahead of background work like procedures
+    JobGroupScope jobGroup(getQueryJobGroup(query));
+
+    MLDB::runHttpQueryIncremental(runQuery,
+                                  connection, format, createHeaders,
+                                  rowNames, rowHashes, sortColumns);
 }
 
 void
@@ -311,6 +388,13 @@ query(const Utf8String& query) const
     return queryFromStatement(stm, mldbContext, nullptr /*onProgress*/);
 }
 
+ThreadPoolStatus
+MldbServer::
+getThreadPoolStatus() const
+{
+    return ThreadPool::instance().getStatus();
+}
+
 Json::Value
 MldbServer::
 getTypeInfo(const std::string & typeName)
@@ -365,6 +449,18 @@ initCollections(std::string credentialsPath,
     credentials = createCredentialCollection(this, *routeManager, makeCredentialStore());
     types = createTypeClassCollection(this, *routeManager);
 
+    auto onEntityChange = [this] (const Any &)
+        {
+            ++entityGeneration;
+            Function::dropCachedAppliers(this);
+        };
+    entityWatches.emplace_back(plugins->watchElements("*", false, string("mldb")));
+    entityWatches.emplace_back(datasets->watchElements("*", false, string("mldb")));
+    entityWatches.emplace_back(procedures->watchElements("*", false, string("mldb")));
+    entityWatches.emplace_back(functions->watchElements("*", false, string("mldb")));
+    for (auto & w: entityWatches)
+        w.bindGeneric(onEntityChange);
+
     plugins->loadConfig();
     datasets->loadConfig();
     procedures->loadConfig();
@@ -415,6 +511,8 @@ shutdown()
 
     ServicePeer::shutdown();
 
+    entityWatches.clear();
+
     datasets.reset();
     procedures.reset();
     functions.reset();
@@ -14,6 +14,8 @@
 #include "mldb/types/string.h"
 #include "mldb/soa/service/event_service.h"
 #include "mldb/utils/log_fwd.h"
+#include "mldb/watch/watch.h"
+#include <atomic>
 
 
 namespace MLDB {
@@ -21,6 +23,7 @@ namespace MLDB {
 struct PolyConfig;
 struct Utf8String;
 struct Package;
+struct ThreadPoolStatus;
 
 
 struct PluginCollection;
@@ -107,6 +110,13 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     std::shared_ptr<CredentialRuleCollection> credentials;
     std::shared_ptr<TypeClassCollection> types;
 
+    /** Incremented whenever a plugin, dataset, procedure or function is
+        created, replaced or deleted.  Anything that caches objects bound
+        against other entities (for example the applier cached by a
+        function) can compare it to know when to throw them away.
+    */
+    std::atomic<uint64_t> entityGeneration;
+
     /** Parse and perform an SQL query. */
     std::vector<MatrixNamedRow> query(const Utf8String& query) const;
 
@@ -133,6 +143,9 @@ struct MldbServer: public ServicePeer, public EventRecorder {
     Json::Value
     getTypeInfo(const std::string & typeName);
 
+    /** Get the status of the thread pool and the work using it. */
+    ThreadPoolStatus getThreadPoolStatus() const;
+
     /** Get the documentation path for the given package.  This will look
         at the working directory of the package that loaded it.
     */
@@ -181,6 +194,7 @@ private:
                          bool hideInternalEntities);
     RestRequestRouter * versionNode;
     std::string cacheDirectory_;
+    std::vector<Watch> entityWatches;
     std::shared_ptr<spdlog::logger> logger;
 };
 
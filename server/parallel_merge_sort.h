@@ -76,7 +76,7 @@ parallelMergeSort(std::vector<std::vector<T> > & range,
     if (range.empty())
         return {};
 
-    auto sort = [&] (const std::vector<T> & v)
+    auto sort = [&] (std::vector<T> & v)
         {
             std::sort(v.begin(), v.end(), cmp);
         };
@@ -13,6 +13,8 @@
 #include "mldb/utils/json_utils.h"
 #include "mldb/rest/rest_request_binding.h"
 #include "mldb/server/procedure_collection.h"
+#include "mldb/rest/cancellation_exception.h"
+#include "mldb/base/thread_pool.h"
 
 
 using namespace std;
@@ -262,6 +264,32 @@ construct(ProcedureRunConfig config, const OnProgress & onProgress) const
     return std::make_shared<ProcedureRun>(procedure, config, onProgress);
 }
 
+std::shared_ptr<ProcedureRun>
+ProcedureRunCollection::
+constructCancellable(ProcedureRunConfig config,
+                     const OnProgress & onProgress,
+                     WatchT<bool> cancelled) const
+{
+    auto group = JobGroup::create("procedure run " + config.id.rawString(),
+                                  JOB_PRIORITY_BACKGROUND);
+    if (cancelled.attached())
+        cancelled.bind([group] (const bool &) { group->cancel(); });
+
+    JobGroupScope scope(group);
+
+    std::shared_ptr<ProcedureRun> result;
+    try {
+        result = construct(std::move(config), onProgress);
+    } catch (const JobGroupCancelled & exc) {
+        throw CancellationException("Procedure run was cancelled");
+    }
+
+    if (group->cancelled())
+        throw CancellationException("Procedure run was cancelled");
+
+    return result;
+}
+
 DEFINE_REST_COLLECTION_INSTANTIATIONS(Utf8String, ProcedureRun,
                                       ProcedureRunConfig,
                                       ProcedureRunStatus);
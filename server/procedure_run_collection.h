@@ -50,6 +50,14 @@ struct ProcedureRunCollection
 
     virtual std::shared_ptr<ProcedureRun>
     construct(ProcedureRunConfig config, const OnProgress & onProgress) const;
+
+    /** Runs the procedure in its own job group, so that it gives way to
+        queries and so that cancelling the run stops its parallel work.
+    */
+    virtual std::shared_ptr<ProcedureRun>
+    constructCancellable(ProcedureRunConfig config,
+                         const OnProgress & onProgress,
+                         WatchT<bool> cancelled) const;
 };
 
 //extern template class PolyCollection<MLDB::ProcedureRun>;
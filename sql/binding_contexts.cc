@@ -86,6 +86,24 @@ rebind(BoundSqlExpression expr)
             auto & row = static_cast<const RowScope &>(scope);		
             return outerExec(row.outer, storage, filter);		
         };		
+
+    if (expr.batchExec) {
+        auto outerBatchExec = expr.batchExec;
+
+        // Same thing for batches: pivot each of the row scopes
+        expr.batchExec = [=] (const SqlRowScope * const * rows,
+                              size_t numRows,
+                              ExpressionValueBatch & output,
+                              const VariableFilter & filter)
+            {
+                std::vector<const SqlRowScope *> outerRows(numRows);
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    auto & row = static_cast<const RowScope &>(*rows[i]);
+                    outerRows[i] = &row.outer;
+                }
+                outerBatchExec(outerRows.data(), numRows, output, filter);
+            };
+    }
 		
     return expr;		
 }
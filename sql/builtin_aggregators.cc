@@ -842,6 +842,344 @@ struct DistinctAccum {
 
 static RegisterAggregatorT<DistinctAccum> registerDistinct("count_distinct");
 
+/** Approximate count of distinct values using a HyperLogLog sketch.  Up
+    to MAX_SPARSE distinct values the hashes are kept as-is, which gives
+    an exact count (modulo hash collisions) with little memory for small
+    groups; past that it switches to 2^PRECISION one byte registers, for
+    a relative standard error of 1.04 / sqrt(2^PRECISION), ie 0.8%.
+*/
+struct ApproxDistinctAccum {
+    static constexpr int nargs = 1;
+    static constexpr int maxArgs = nargs;
+    enum {
+        PRECISION = 14,
+        NUM_REGISTERS = 1 << PRECISION,
+        MAX_SPARSE = 1024
+    };
+
+    ApproxDistinctAccum()
+        : ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<IntegerValueInfo>();
+    }
+
+    void process (const ExpressionValue * args,
+                  size_t nargs)
+    {
+        checkArgsSize(nargs, 1);
+        const ExpressionValue & val = args[0];
+        if (val.empty())
+            return;
+
+        addHash(val.getAtom().hash());
+        ts.setMax(val.getEffectiveTimestamp());
+    };
+
+    ExpressionValue extract()
+    {
+        if (registers.empty()) {
+            compactSparse();
+            return ExpressionValue(hashes.size(), ts);
+        }
+
+        double sum = 0.0;
+        size_t numZero = 0;
+        for (uint8_t r: registers) {
+            sum += std::ldexp(1.0, -r);
+            numZero += (r == 0);
+        }
+
+        double m = NUM_REGISTERS;
+        double alpha = 0.7213 / (1.0 + 1.079 / m);
+        double estimate = alpha * m * m / sum;
+
+        // Small range correction: linear counting is more accurate
+        if (estimate <= 2.5 * m && numZero > 0)
+            estimate = m * std::log(m / numZero);
+
+        return ExpressionValue((uint64_t)std::round(estimate), ts);
+    }
+
+    void merge(ApproxDistinctAccum* src)
+    {
+        ts.setMax(src->ts);
+
+        if (!src->registers.empty()) {
+            makeDense();
+            for (size_t i = 0;  i < NUM_REGISTERS;  ++i)
+                registers[i] = std::max(registers[i], src->registers[i]);
+        }
+        else {
+            for (uint64_t h: src->hashes)
+                addHash(h);
+        }
+    }
+
+    void addHash(uint64_t h)
+    {
+        if (!registers.empty()) {
+            addToRegisters(h);
+            return;
+        }
+
+        hashes.push_back(h);
+        if (hashes.size() >= 2 * MAX_SPARSE) {
+            compactSparse();
+            if (hashes.size() > MAX_SPARSE)
+                makeDense();
+        }
+    }
+
+    void addToRegisters(uint64_t h)
+    {
+        // The first PRECISION bits select the register, and the position
+        // of the first set bit in the rest is the rank
+        size_t index = h >> (64 - PRECISION);
+        uint64_t rest = (h << PRECISION) | (1ULL << (PRECISION - 1));
+        uint8_t rank = __builtin_clzll(rest) + 1;
+        registers[index] = std::max(registers[index], rank);
+    }
+
+    void compactSparse()
+    {
+        std::sort(hashes.begin(), hashes.end());
+        hashes.erase(std::unique(hashes.begin(), hashes.end()), hashes.end());
+    }
+
+    void makeDense()
+    {
+        if (!registers.empty())
+            return;
+        registers.resize(NUM_REGISTERS);
+        for (uint64_t h: hashes)
+            addToRegisters(h);
+        std::vector<uint64_t>().swap(hashes);
+    }
+
+    std::vector<uint64_t> hashes;    ///< Sparse representation; hashes seen
+    std::vector<uint8_t> registers;  ///< Dense representation; empty if sparse
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxDistinctAccum>
+registerApproxDistinct("approx_count_distinct");
+
+/** t-digest (Dunning and Ertl) used to approximate quantiles in constant
+    memory.  Values are buffered and periodically merged into a sorted
+    list of centroids, whose size is limited by the k1 scale function so
+    that they are smaller (and more accurate) near the tails.  With a
+    compression of 100 there are never more than a few hundred centroids.
+*/
+struct TDigest {
+    enum {
+        COMPRESSION = 100,
+        BUFFER_SIZE = 500
+    };
+
+    struct Centroid {
+        double mean;
+        double weight;
+        bool operator < (const Centroid & other) const
+        {
+            return mean < other.mean;
+        }
+    };
+
+    std::vector<Centroid> centroids;  ///< Merged and sorted
+    std::vector<Centroid> buffer;     ///< Not yet merged
+    double totalWeight = 0;
+    double min = INFINITY;
+    double max = -INFINITY;
+
+    void add(double value, double weight = 1.0)
+    {
+        if (std::isnan(value))
+            return;
+        buffer.push_back({ value, weight });
+        totalWeight += weight;
+        min = std::min(min, value);
+        max = std::max(max, value);
+        if (buffer.size() >= BUFFER_SIZE)
+            compress();
+    }
+
+    void merge(const TDigest & other)
+    {
+        for (auto & c: other.centroids)
+            buffer.push_back(c);
+        for (auto & c: other.buffer)
+            buffer.push_back(c);
+        totalWeight += other.totalWeight;
+        min = std::min(min, other.min);
+        max = std::max(max, other.max);
+        compress();
+    }
+
+    static double kFromQ(double q)
+    {
+        return (double)COMPRESSION / (2 * M_PI) * std::asin(2 * q - 1);
+    }
+
+    static double qFromK(double k)
+    {
+        return (std::sin(k * 2 * M_PI / COMPRESSION) + 1) / 2;
+    }
+
+    void compress()
+    {
+        if (buffer.empty())
+            return;
+
+        buffer.insert(buffer.end(), centroids.begin(), centroids.end());
+        std::sort(buffer.begin(), buffer.end());
+        centroids.clear();
+
+        Centroid current = buffer[0];
+        double weightSoFar = 0;
+        double qLimit = qFromK(kFromQ(0) + 1);
+
+        for (size_t i = 1;  i < buffer.size();  ++i) {
+            const Centroid & next = buffer[i];
+            double q = (weightSoFar + current.weight + next.weight)
+                / totalWeight;
+            if (q <= qLimit) {
+                current.weight += next.weight;
+                current.mean += (next.mean - current.mean) * next.weight
+                    / current.weight;
+            }
+            else {
+                weightSoFar += current.weight;
+                centroids.push_back(current);
+                qLimit = qFromK(kFromQ(weightSoFar / totalWeight) + 1);
+                current = next;
+            }
+        }
+        centroids.push_back(current);
+        buffer.clear();
+    }
+
+    /** Return the approximate value at quantile q (between 0 and 1), by
+        interpolating between the centers of the centroids.  Returns NaN
+        if there are no values.
+    */
+    double quantile(double q)
+    {
+        compress();
+
+        if (centroids.empty())
+            return std::nan("");
+        if (centroids.size() == 1)
+            return centroids[0].mean;
+
+        double target = q * totalWeight;
+
+        // Before the center of the first centroid or after the last, we
+        // interpolate with the exact min and max
+        if (target < centroids.front().weight / 2) {
+            return min + (centroids.front().mean - min) * target
+                / (centroids.front().weight / 2);
+        }
+        if (target > totalWeight - centroids.back().weight / 2) {
+            double fromEnd = totalWeight - target;
+            return max - (max - centroids.back().mean) * fromEnd
+                / (centroids.back().weight / 2);
+        }
+
+        double center = centroids[0].weight / 2;
+        for (size_t i = 0;  i + 1 < centroids.size();  ++i) {
+            double gap = (centroids[i].weight + centroids[i + 1].weight) / 2;
+            if (target <= center + gap) {
+                return centroids[i].mean
+                    + (centroids[i + 1].mean - centroids[i].mean)
+                    * (target - center) / gap;
+            }
+            center += gap;
+        }
+        return centroids.back().mean;
+    }
+};
+
+/** Approximate quantile of a numeric value, using a t-digest.  The
+    quantile is either fixed (approx_median) or given as the second
+    argument, which must be a constant between 0 and 1.
+*/
+template<bool IsMedian>
+struct ApproxQuantileAccum {
+    static constexpr int nargs = IsMedian ? 1 : 2;
+    static constexpr int maxArgs = nargs;
+
+    ApproxQuantileAccum()
+        : quantile(IsMedian ? 0.5 : -1.0), ts(Date::negativeInfinity())
+    {
+    }
+
+    static std::shared_ptr<ExpressionValueInfo>
+    info(const std::vector<BoundSqlExpression> & args)
+    {
+        return std::make_shared<Float64ValueInfo>();
+    }
+
+    void process(const ExpressionValue * args, size_t nargs)
+    {
+        checkArgsSize(nargs, IsMedian ? 1 : 2);
+        const ExpressionValue & val = args[0];
+
+        if (!IsMedian && quantile < 0)
+            setQuantile(args[1]);
+
+        if (val.empty())
+            return;
+
+        digest.add(val.toDouble());
+        ts.setMax(val.getEffectiveTimestamp());
+    }
+
+    void setQuantile(const ExpressionValue & q)
+    {
+        if (q.empty() || !q.isNumber())
+            throw HttpReturnException(400, "approx_quantile requires the "
+                                      "quantile as a number between 0 "
+                                      "and 1 in its second argument",
+                                      "quantile", q);
+        double value = q.toDouble();
+        if (!(value >= 0.0 && value <= 1.0))
+            throw HttpReturnException(400, "approx_quantile requires the "
+                                      "quantile as a number between 0 "
+                                      "and 1 in its second argument",
+                                      "quantile", value);
+        quantile = value;
+    }
+
+    ExpressionValue extract()
+    {
+        if (digest.totalWeight == 0)
+            return ExpressionValue::null(ts);
+        return ExpressionValue(digest.quantile(quantile), ts);
+    }
+
+    void merge(ApproxQuantileAccum* src)
+    {
+        if (quantile < 0)
+            quantile = src->quantile;
+        digest.merge(src->digest);
+        ts.setMax(src->ts);
+    }
+
+    double quantile;  ///< Negative until we've seen the second argument
+    TDigest digest;
+    Date ts;
+};
+
+static RegisterAggregatorT<ApproxQuantileAccum<false> >
+registerApproxQuantile("approx_quantile");
+static RegisterAggregatorT<ApproxQuantileAccum<true> >
+registerApproxMedian("approx_median");
+
 struct LikelihoodRatioAccum {
     LikelihoodRatioAccum()
         : ts(Date::negativeInfinity())
@@ -7,6 +7,7 @@
 
 #include "mldb/sql/builtin_functions.h"
 #include "sql_expression.h"
+#include "expression_value_batch.h"
 #include "tokenize.h"
 #include "regex_helper.h"
 #include "mldb/http/http_exception.h"
@@ -61,6 +62,10 @@ namespace Builtins {
 
 typedef CellValue (*UnaryScalarFunction) (const CellValue & arg);
 
+/// Same function as a UnaryScalarFunction, restricted to non-null numbers.
+/// Used to evaluate batches of numbers without boxing them in CellValues.
+typedef double (*UnaryNumericKernel) (double arg);
+
 /// Register a builtin function that operates on unary scalars with a
 /// signature (Atom) -> Atom, to work on scalars, rows or
 /// embeddings.
@@ -71,10 +76,18 @@ struct RegisterBuiltinUnaryScalar {
                                std::shared_ptr<ExpressionValueInfo> info,
                                Names&&... names)
     {
-        doRegister(function, std::move(info), std::forward<Names>(names)...);
+        doRegister(function, nullptr, std::move(info),
+                   std::forward<Names>(names)...);
+    }
+
+protected:
+    RegisterBuiltinUnaryScalar()
+    {
     }
 
-    void doRegister(const UnaryScalarFunction & function)
+public:
+    void doRegister(const UnaryScalarFunction & function,
+                    UnaryNumericKernel kernel)
     {
     }
 
@@ -115,6 +128,29 @@ struct RegisterBuiltinUnaryScalar {
                                args[0].getEffectiveTimestamp());
     }
 
+    static void
+    applyScalarBatch(UnaryScalarFunction fn,
+                     UnaryNumericKernel kernel,
+                     const ExpressionValueBatch & arg,
+                     ExpressionValueBatch & output)
+    {
+        if (kernel && arg.isNumeric()) {
+            output.reset(ExpressionValueBatch::DOUBLE, arg.size);
+            for (size_t i = 0;  i < arg.size;  ++i) {
+                if (arg.isNull(i))
+                    output.setNull(i, arg.ts[i]);
+                else output.setDouble(i, kernel(arg.getDouble(i)), arg.ts[i]);
+            }
+            return;
+        }
+
+        output.reset(ExpressionValueBatch::EMPTY, arg.size);
+        for (size_t i = 0;  i < arg.size;  ++i) {
+            output.set(i, ExpressionValue(fn(arg.getAtom(i)),
+                                          arg.getEffectiveTimestamp(i)));
+        }
+    }
+
     static ExpressionValue
     applyEmbedding(UnaryScalarFunction fn,
                    const std::vector<ExpressionValue> & args,
@@ -169,11 +205,26 @@ struct RegisterBuiltinUnaryScalar {
     static BoundFunction
     bindScalar(const Utf8String & functionName,
                UnaryScalarFunction fn,
+               UnaryNumericKernel kernel,
                std::shared_ptr<ExpressionValueInfo> info,
                const std::vector<BoundSqlExpression> & args,
                const SqlBindingScope & scope)
     {
-        return wrap(functionName, fn, std::move(info), applyScalar);
+        BoundFunction result
+            = wrap(functionName, fn, std::move(info), applyScalar);
+        result.execBatch = [=] (const std::vector<ExpressionValueBatch> & args,
+                                ExpressionValueBatch & output)
+            {
+                try {
+                    applyScalarBatch(fn, kernel, args[0], output);
+                } MLDB_CATCH_ALL {
+                    rethrowHttpException(-1, "Executing builtin function "
+                                         + functionName
+                                         + ": " + getExceptionString(),
+                                         "functionName", functionName);
+                }
+            };
+        return result;
     }
 
     static BoundFunction
@@ -219,6 +270,7 @@ struct RegisterBuiltinUnaryScalar {
 
     template<typename... Names>
     void doRegister(const UnaryScalarFunction & function,
+                    UnaryNumericKernel kernel,
                     std::shared_ptr<ExpressionValueInfo> info,
                     std::string name,
                     Names&&... names)
@@ -231,7 +283,7 @@ struct RegisterBuiltinUnaryScalar {
                 try {
                     checkArgsSize(args.size(), 1);
                     if (args[0].info->isScalar())
-                        return bindScalar(functionName, function,
+                        return bindScalar(functionName, function, kernel,
                                           std::move(info), args,
                                           scope);
                     else if (args[0].info->isEmbedding()) {
@@ -260,7 +312,7 @@ struct RegisterBuiltinUnaryScalar {
                 ExcAssert(false); // silence bad compiler escape analysis
             };
         handles.push_back(registerFunction(Utf8String(name), fn));
-        doRegister(function, std::forward<Names>(names)...);
+        doRegister(function, kernel, std::forward<Names>(names)...);
     }
 
     std::vector<std::shared_ptr<void> > handles;
@@ -283,10 +335,9 @@ struct RegisterBuiltinUnaryNumericScalar: public RegisterBuiltinUnaryScalar {
 
     template<typename... Names>
     RegisterBuiltinUnaryNumericScalar(Names&&... names)
-        : RegisterBuiltinUnaryScalar(&call,
-                                     std::make_shared<Float64ValueInfo>(),
-                                     std::forward<Names>(names)...)
     {
+        doRegister(&call, &Op::call, std::make_shared<Float64ValueInfo>(),
+                   std::forward<Names>(names)...);
     }
 };
 
@@ -17,6 +17,8 @@
 #include "mldb/sql/sql_expression_operations.h"
 #include "mldb/types/vector_description.h"
 #include "mldb/base/scope.h"
+#include "mldb/base/parallel.h"
+#include "mldb/base/optimized_path.h"
 #include "mldb/utils/log.h"
 
 using namespace std;
@@ -868,6 +870,38 @@ JoinElement(std::shared_ptr<PipelineElement> root,
     fixOuterSide(leftCondition, condition.left, leftclauses);      
     fixOuterSide(rightCondition, condition.right, rightclauses);      
 
+    // For an equijoin, the strategy depends upon the size of each side,
+    // so we bind the datasets now (the from element would otherwise do it
+    // later) in order to know how many rows they have.
+    OrderByExpression leftOrderBy = condition.left.orderBy;
+    OrderByExpression rightOrderBy = condition.right.orderBy;
+    equiJoinStrategy = MERGE_JOIN;
+
+    if (condition.style == AnnotatedJoinCondition::EQUIJOIN) {
+        auto getRowCount = [&] (const std::shared_ptr<TableExpression> & table,
+                                BoundTableExpression & bound) -> ssize_t
+            {
+                if (!bound && table->getType() == "dataset") {
+                    auto scope = root->bind()->outputScope();
+                    bound = table->bind(*scope, nullptr /*onProgress*/);
+                }
+                if (!!bound && bound.table.getRowCount)
+                    return bound.table.getRowCount();
+                return -1;
+            };
+
+        ssize_t leftRows = getRowCount(left, this->boundLeft);
+        ssize_t rightRows = getRowCount(right, this->boundRight);
+
+        equiJoinStrategy = chooseEquiJoinStrategy(leftRows, rightRows);
+
+        // A hash join doesn't need the sides to be sorted
+        if (equiJoinStrategy != MERGE_JOIN) {
+            leftOrderBy = ORDER_BY_NOTHING;
+            rightOrderBy = ORDER_BY_NOTHING;
+        }
+    }
+
     if (outerLeft || outerRight)
         constantWhere = SqlExpression::TRUE;
 
@@ -878,17 +912,61 @@ JoinElement(std::shared_ptr<PipelineElement> root,
 
     leftImpl= root
         ->where(constantWhere)
-        ->from(left, boundLeft, when, selectAll, leftCondition,
-               condition.left.orderBy)
+        ->from(left, this->boundLeft, when, selectAll, leftCondition,
+               leftOrderBy)
         ->select(leftEmbedding);
 
     rightImpl = root
         ->where(constantWhere)
-        ->from(right, boundRight, when, selectAll, rightCondition,
-               condition.right.orderBy)
+        ->from(right, this->boundRight, when, selectAll, rightCondition,
+               rightOrderBy)
         ->select(rightEmbedding);
 }
 
+/// Allows tests to force equijoins onto the merge join, to compare results
+static OptimizedPath optimizeHashJoin("mldb.sql.hashJoin");
+
+/// Number of equijoins started with each EquiJoinStrategy
+static std::atomic<uint64_t> equiJoinsStarted[3];
+
+/// Biggest build side for a hash join.  The build side is held in memory.
+static constexpr ssize_t HASH_JOIN_MAX_BUILD_ROWS = 1000000;
+
+/// Smallest probe side for a hash join.  Below this, sorting is cheap
+/// enough that the merge join is used, which keeps its output ordering.
+static constexpr ssize_t HASH_JOIN_MIN_PROBE_ROWS = 10000;
+
+/// How many times bigger the probe side must be than the build side for
+/// a hash join to be used.
+static constexpr ssize_t HASH_JOIN_MIN_SIZE_RATIO = 8;
+
+JoinElement::EquiJoinStrategy
+JoinElement::
+chooseEquiJoinStrategy(ssize_t leftRows, ssize_t rightRows)
+{
+    if (leftRows < 0 || rightRows < 0)
+        return MERGE_JOIN;
+
+    bool buildLeft = leftRows <= rightRows;
+    ssize_t buildRows = buildLeft ? leftRows : rightRows;
+    ssize_t probeRows = buildLeft ? rightRows : leftRows;
+
+    if (buildRows > HASH_JOIN_MAX_BUILD_ROWS
+        || probeRows < HASH_JOIN_MIN_PROBE_ROWS
+        || probeRows < buildRows * HASH_JOIN_MIN_SIZE_RATIO
+        || !optimizeHashJoin())
+        return MERGE_JOIN;
+
+    return buildLeft ? HASH_BUILD_LEFT : HASH_BUILD_RIGHT;
+}
+
+uint64_t
+JoinElement::
+numEquiJoinsStarted(EquiJoinStrategy strategy)
+{
+    return equiJoinsStarted[strategy].load();
+}
+
 std::shared_ptr<BoundPipelineElement>
 JoinElement::
 bind() const
@@ -897,7 +975,8 @@ bind() const
                                    leftImpl->bind(),
                                    rightImpl->bind(),
                                    condition,
-                                   joinQualification);
+                                   joinQualification,
+                                   equiJoinStrategy);
 }
 
 
@@ -1573,6 +1652,247 @@ restart()
 }
 
 
+/*****************************************************************************/
+/* HASH JOIN EXECUTOR                                                        */
+/* For hash joins, the whole build side is buffered and indexed on its       */
+/* pivot, so we keep track of whether each build row was ever matched and   */
+/* output the unmatched ones once the probe side is exhausted.  Unmatched    */
+/* probe rows are output as soon as they have been looked up.                */
+/*****************************************************************************/
+
+/// Number of probe rows which are read and matched together
+static constexpr size_t HASH_JOIN_PROBE_CHUNK_SIZE = 4096;
+
+/// Below this number of probe rows in a chunk, matching is done serially
+static constexpr size_t HASH_JOIN_MIN_PARALLEL_ROWS = 256;
+
+JoinElement::HashJoinExecutor::
+HashJoinExecutor(const Bound * parent,
+                 std::shared_ptr<ElementExecutor> root,
+                 std::shared_ptr<ElementExecutor> left,
+                 std::shared_ptr<ElementExecutor> right,
+                 size_t leftAdded,
+                 size_t rightAdded,
+                 bool buildLeft)
+    : parent(parent),
+      root(std::move(root)),
+      left(std::move(left)),
+      right(std::move(right)),
+      buildLeft(buildLeft),
+      probeDone(false),
+      nextUnmatched(0),
+      leftAdded(leftAdded),
+      rightAdded(rightAdded)
+{
+    ExcAssert(parent && this->root && this->left && this->right);
+    build();
+}
+
+void
+JoinElement::HashJoinExecutor::
+build()
+{
+    auto & buildSide = buildLeft ? left : right;
+
+    buildRows.clear();
+    buildIndex.clear();
+
+    while (auto row = buildSide->take()) {
+        buildRows.emplace_back(std::move(row));
+    }
+
+    buildMatched.reset(new std::atomic<bool>[buildRows.size()]);
+
+    for (size_t i = 0;  i < buildRows.size();  ++i) {
+        buildMatched[i] = false;
+
+        // Rows for which the side condition is false can never match, so
+        // they are not indexed (but may still be output for an outer join)
+        const ExpressionValue & embedding = buildRows[i]->values.back();
+        if (!embedding.getColumn(1, GET_ALL).isTrue())
+            continue;
+
+        buildIndex[embedding.getColumn(0, GET_ALL)].push_back(i);
+    }
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+joinRows(const PipelineResults & l, const PipelineResults & r) const
+{
+    auto result = std::make_shared<PipelineResults>(l);
+
+    // Pop the selected join conditions from left
+    result->values.pop_back();
+
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.push_back(r.values[i]);
+
+    return result;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+outerLeftRow(const PipelineResults & l) const
+{
+    auto result = std::make_shared<PipelineResults>(l);
+
+    // Pop the selected join conditions from left
+    result->values.pop_back();
+
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.push_back(ExpressionValue());
+
+    return result;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+outerRightRow(const PipelineResults & r) const
+{
+    auto result = std::make_shared<PipelineResults>(r);
+
+    result->values.clear();
+    for (size_t i = 0;  i < leftAdded;  ++i)
+        result->values.emplace_back(ExpressionValue::null(Date::notADate()));
+
+    for (size_t i = 0;  i < rightAdded;  ++i)
+        result->values.push_back(r.values[i]);
+
+    return result;
+}
+
+bool
+JoinElement::HashJoinExecutor::
+probeChunk()
+{
+    auto & probeSide = buildLeft ? right : left;
+
+    std::vector<std::shared_ptr<PipelineResults> > chunk;
+    chunk.reserve(HASH_JOIN_PROBE_CHUNK_SIZE);
+
+    while (chunk.size() < HASH_JOIN_PROBE_CHUNK_SIZE) {
+        auto row = probeSide->take();
+        if (!row)
+            break;
+        chunk.emplace_back(std::move(row));
+    }
+
+    if (chunk.empty())
+        return false;
+
+    bool outerProbe = buildLeft
+        ? (parent->joinQualification_ == JOIN_RIGHT
+           || parent->joinQualification_ == JOIN_FULL)
+        : (parent->joinQualification_ == JOIN_LEFT
+           || parent->joinQualification_ == JOIN_FULL);
+
+    // Output rows for each of the probe rows, so that they can be returned
+    // in order once the chunk has been matched in parallel
+    std::vector<std::vector<std::shared_ptr<PipelineResults> > >
+        output(chunk.size());
+
+    auto onProbeRow = [&] (size_t n)
+        {
+            const PipelineResults & probeRow = *chunk[n];
+            const ExpressionValue & embedding = probeRow.values.back();
+            bool matched = false;
+
+            if (embedding.getColumn(1, GET_ALL).isTrue()) {
+                auto it = buildIndex.find(embedding.getColumn(0, GET_ALL));
+                if (it != buildIndex.end()) {
+                    for (size_t b: it->second) {
+                        const PipelineResults & buildRow = *buildRows[b];
+                        auto result = buildLeft
+                            ? joinRows(buildRow, probeRow)
+                            : joinRows(probeRow, buildRow);
+
+                        ExpressionValue storage;
+                        if (!parent->crossWhere_(*result, storage, GET_LATEST)
+                            .isTrue())
+                            continue;
+
+                        buildMatched[b] = true;
+                        matched = true;
+                        output[n].emplace_back(std::move(result));
+                    }
+                }
+            }
+
+            if (!matched && outerProbe) {
+                output[n].emplace_back(buildLeft
+                                       ? outerRightRow(probeRow)
+                                       : outerLeftRow(probeRow));
+            }
+        };
+
+    if (chunk.size() >= HASH_JOIN_MIN_PARALLEL_ROWS)
+        parallelMap(0, chunk.size(), onProbeRow);
+    else {
+        for (size_t i = 0;  i < chunk.size();  ++i)
+            onProbeRow(i);
+    }
+
+    for (auto & rows: output) {
+        for (auto & r: rows)
+            pending.emplace_back(std::move(r));
+    }
+
+    return true;
+}
+
+std::shared_ptr<PipelineResults>
+JoinElement::HashJoinExecutor::
+take()
+{
+    while (pending.empty() && !probeDone) {
+        if (!probeChunk())
+            probeDone = true;
+    }
+
+    if (!pending.empty()) {
+        auto result = std::move(pending.front());
+        pending.pop_front();
+        return result;
+    }
+
+    // The probe side is exhausted; return the build rows that were never
+    // matched if we have an outer join on the build side
+    bool outerBuild = buildLeft
+        ? (parent->joinQualification_ == JOIN_LEFT
+           || parent->joinQualification_ == JOIN_FULL)
+        : (parent->joinQualification_ == JOIN_RIGHT
+           || parent->joinQualification_ == JOIN_FULL);
+
+    if (!outerBuild)
+        return nullptr;
+
+    while (nextUnmatched < buildRows.size()) {
+        size_t i = nextUnmatched++;
+        if (buildMatched[i])
+            continue;
+        return buildLeft
+            ? outerLeftRow(*buildRows[i])
+            : outerRightRow(*buildRows[i]);
+    }
+
+    // Nothing more found
+    return nullptr;
+}
+
+void
+JoinElement::HashJoinExecutor::
+restart()
+{
+    left->restart();
+    right->restart();
+    pending.clear();
+    probeDone = false;
+    nextUnmatched = 0;
+    build();
+}
+
+
 /*****************************************************************************/
 /* BOUND JOIN EXECUTOR                                                       */
 /*****************************************************************************/
@@ -1582,14 +1902,16 @@ Bound(std::shared_ptr<BoundPipelineElement> root,
       std::shared_ptr<BoundPipelineElement> left,
       std::shared_ptr<BoundPipelineElement> right,
       AnnotatedJoinCondition condition,
-      JoinQualification joinQualification)
+      JoinQualification joinQualification,
+      EquiJoinStrategy equiJoinStrategy)
     : root_(std::move(root)),
       left_(std::move(left)),
       right_(std::move(right)),
       outputScope_(createOutputScope()),
       crossWhere_(condition.crossWhere->bind(*outputScope_)),
       condition_(std::move(condition)),
-      joinQualification_(joinQualification)
+      joinQualification_(joinQualification),
+      equiJoinStrategy_(equiJoinStrategy)
 {
 }
 
@@ -1657,6 +1979,19 @@ start(const BoundParameters & getParam) const
     }
 
     case AnnotatedJoinCondition::EQUIJOIN:
+        ++equiJoinsStarted[equiJoinStrategy_];
+
+        if (equiJoinStrategy_ != MERGE_JOIN) {
+            return std::make_shared<HashJoinExecutor>
+                (this,
+                 root_->start(getParam),
+                 left_->start(getParam),
+                 right_->start(getParam),
+                 leftAdded,
+                 rightAdded,
+                 equiJoinStrategy_ == HASH_BUILD_LEFT);
+        }
+
         return std::make_shared<EquiJoinExecutor>
             (this,
              root_->start(getParam),
@@ -11,6 +11,9 @@
 #include "join_utils.h"
 #include "mldb/utils/log_fwd.h"
 #include <list>
+#include <deque>
+#include <atomic>
+#include <unordered_map>
 
 
 namespace MLDB {
@@ -298,7 +301,8 @@ struct JoinLexicalScope: public LexicalScope {
 
 /** An element that joins two tables together.  This is typically implemented
     by generating both sides sorted on the join key, and then iterating
-    through matching rows.
+    through matching rows, or for a small table joined with a big one by
+    hashing the small one and looking up the rows of the big one.
 */
 
 struct JoinElement: public PipelineElement {
@@ -329,6 +333,29 @@ struct JoinElement: public PipelineElement {
     std::shared_ptr<PipelineElement> leftImpl;
     std::shared_ptr<PipelineElement> rightImpl;
 
+    /// How an equijoin is executed
+    enum EquiJoinStrategy {
+        MERGE_JOIN,        ///< Sort both sides on the pivot and merge them
+        HASH_BUILD_LEFT,   ///< Hash the left side, stream the right side
+        HASH_BUILD_RIGHT   ///< Hash the right side, stream the left side
+    };
+
+    EquiJoinStrategy equiJoinStrategy;
+
+    /** Choose how to execute an equijoin from the number of rows on each
+        side (-1 if unknown).  A hash join is used when one side is small
+        enough to be held in memory and much smaller than the other, in
+        which case sorting the large side would be wasted work.
+    */
+    static EquiJoinStrategy
+    chooseEquiJoinStrategy(ssize_t leftRows, ssize_t rightRows);
+
+    /** Number of equijoins that were started with the given strategy
+        since the program started.  This allows tests to check which
+        strategy a query was given.
+    */
+    static uint64_t numEquiJoinsStarted(EquiJoinStrategy strategy);
+
     struct Bound;
 
     /** Execution runs over all left rows for each right row.  The complexity is
@@ -424,6 +451,75 @@ struct JoinElement: public PipelineElement {
         virtual void restart();
     };
 
+    /** Execution builds a hash table on the pivot of the smaller side (the
+        build side), and then streams the larger side (the probe side)
+        through it, looking up the matching rows.  The probe side is
+        consumed in chunks which are matched in parallel; rows are output
+        in the order of the probe side.  Unlike the EquiJoinExecutor, the
+        sides don't need to be sorted, which makes the complexity
+        O(left rows + right rows + output rows).  The canonical example is
+        a small dimension table joined with a big fact table.
+    */
+    struct HashJoinExecutor: public ElementExecutor {
+        HashJoinExecutor(const Bound * parent,
+                         std::shared_ptr<ElementExecutor> root,
+                         std::shared_ptr<ElementExecutor> left,
+                         std::shared_ptr<ElementExecutor> right,
+                         size_t leftAdded,
+                         size_t rightAdded,
+                         bool buildLeft);
+
+        const Bound * parent;
+        std::shared_ptr<ElementExecutor> root, left, right;
+
+        /// True if the left side is the build side
+        const bool buildLeft;
+
+        /// Rows of the build side, in the order they were produced
+        std::vector<std::shared_ptr<PipelineResults> > buildRows;
+
+        /// Was each build row ever part of an output row?  Written from
+        /// the probe threads.
+        std::unique_ptr<std::atomic<bool>[]> buildMatched;
+
+        /// Index of build rows by their pivot value
+        std::unordered_map<ExpressionValue, std::vector<size_t> > buildIndex;
+
+        /// Output rows which were produced but not yet taken
+        std::deque<std::shared_ptr<PipelineResults> > pending;
+
+        /// Have we read everything on the probe side?
+        bool probeDone;
+
+        /// Next build row to check for an outer output once probing is done
+        size_t nextUnmatched;
+
+        const size_t leftAdded, rightAdded;
+
+        virtual std::shared_ptr<PipelineResults> take();
+
+        virtual void restart();
+
+    private:
+        /// Read the build side and index it
+        void build();
+
+        /// Read and match a chunk of the probe side.  Returns false when
+        /// the probe side is exhausted.
+        bool probeChunk();
+
+        /// Output row for the given left and right rows (with their pivot
+        /// embeddings at the end)
+        std::shared_ptr<PipelineResults>
+        joinRows(const PipelineResults & l, const PipelineResults & r) const;
+
+        /// Output row for an unmatched left or right row
+        std::shared_ptr<PipelineResults>
+        outerLeftRow(const PipelineResults & l) const;
+        std::shared_ptr<PipelineResults>
+        outerRightRow(const PipelineResults & r) const;
+    };
+
     struct Bound: public BoundPipelineElement {
 
         /** Bind this in.  The main difficulty is with the output scope, which
@@ -434,7 +530,8 @@ struct JoinElement: public PipelineElement {
               std::shared_ptr<BoundPipelineElement> left,
               std::shared_ptr<BoundPipelineElement> right,
               AnnotatedJoinCondition condition,
-              JoinQualification joinQualification);
+              JoinQualification joinQualification,
+              EquiJoinStrategy equiJoinStrategy);
 
         std::shared_ptr<BoundPipelineElement> root_;
         std::shared_ptr<BoundPipelineElement> left_;
@@ -443,6 +540,7 @@ struct JoinElement: public PipelineElement {
         BoundSqlExpression crossWhere_;
         AnnotatedJoinCondition condition_;
         JoinQualification joinQualification_;
+        EquiJoinStrategy equiJoinStrategy_;
 
         /** Our output scope has:
             - The left and right tables
@@ -0,0 +1,397 @@
+/** expression_value_batch.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Column-oriented batch of expression values.
+*/
+
+#include "expression_value_batch.h"
+#include "mldb/http/http_exception.h"
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* EXPRESSION VALUE BATCH                                                    */
+/*****************************************************************************/
+
+// Integers with a magnitude above this can't round-trip through a double,
+// so they prevent a batch from being stored as DOUBLE.
+static constexpr int64_t MAX_EXACT_DOUBLE_INT = 1LL << 53;
+
+void
+ExpressionValueBatch::
+reset(Type newType, size_t newSize)
+{
+    type = newType;
+    size = newSize;
+
+    ints.clear();
+    doubles.clear();
+    atoms.clear();
+    values.clear();
+    notNull.clear();
+    ts.clear();
+
+    switch (type) {
+    case EMPTY:
+        break;
+    case INTEGER:
+        ints.resize(size);
+        break;
+    case DOUBLE:
+        doubles.resize(size);
+        break;
+    case ATOM:
+        atoms.resize(size);
+        break;
+    case VALUE:
+        values.resize(size, ExpressionValue::null(Date::negativeInfinity()));
+        return;
+    }
+
+    notNull.resize((size + 63) / 64, 0);
+    ts.resize(size, Date::negativeInfinity());
+}
+
+void
+ExpressionValueBatch::
+promote(Type newType)
+{
+    if (newType == type || newType == EMPTY)
+        return;
+
+    if (type == VALUE)
+        return;  // already the most general
+
+    if (type == EMPTY) {
+        // No values to convert; just allocate storage for the new type
+        // keeping the timestamps of the nulls.
+        switch (newType) {
+        case INTEGER: ints.resize(size);  break;
+        case DOUBLE:  doubles.resize(size);  break;
+        case ATOM:    atoms.resize(size);  break;
+        case VALUE: {
+            values.reserve(size);
+            for (size_t i = 0;  i < size;  ++i)
+                values.emplace_back(ExpressionValue::null(ts[i]));
+            notNull.clear();
+            ts.clear();
+            break;
+        }
+        case EMPTY:
+            break;
+        }
+        type = newType;
+        return;
+    }
+
+    if (newType == VALUE) {
+        values.reserve(size);
+        for (size_t i = 0;  i < size;  ++i)
+            values.emplace_back(get(i));
+        ints.clear();
+        doubles.clear();
+        atoms.clear();
+        notNull.clear();
+        ts.clear();
+        type = VALUE;
+        return;
+    }
+
+    if (type == ATOM)
+        return;  // ATOM holds any atomic value
+
+    // INTEGER <-> DOUBLE, or either of them to ATOM.  Mixed integers and
+    // doubles go through ATOM so that large integers keep their precision.
+    atoms.resize(size);
+    for (size_t i = 0;  i < size;  ++i) {
+        if (!isNull(i))
+            atoms[i] = getAtom(i);
+    }
+    ints.clear();
+    doubles.clear();
+    type = ATOM;
+}
+
+CellValue
+ExpressionValueBatch::
+getAtom(size_t i) const
+{
+    switch (type) {
+    case EMPTY:
+        return CellValue();
+    case INTEGER:
+        return isNull(i) ? CellValue() : CellValue(ints[i]);
+    case DOUBLE:
+        return isNull(i) ? CellValue() : CellValue(doubles[i]);
+    case ATOM:
+        return isNull(i) ? CellValue() : atoms[i];
+    case VALUE:
+        return values[i].getAtom();
+    }
+    throw HttpReturnException(500, "Unknown expression value batch type");
+}
+
+ExpressionValue
+ExpressionValueBatch::
+get(size_t i) const
+{
+    if (type == VALUE)
+        return values[i];
+    if (isNull(i))
+        return ExpressionValue::null(ts[i]);
+    switch (type) {
+    case INTEGER:
+        return ExpressionValue(ints[i], ts[i]);
+    case DOUBLE:
+        return ExpressionValue(doubles[i], ts[i]);
+    case ATOM:
+        return ExpressionValue(atoms[i], ts[i]);
+    default:
+        break;
+    }
+    throw HttpReturnException(500, "Unknown expression value batch type");
+}
+
+bool
+ExpressionValueBatch::
+isTrue(size_t i) const
+{
+    switch (type) {
+    case EMPTY:
+        return false;
+    case INTEGER:
+        return !isNull(i) && ints[i];
+    case DOUBLE:
+        return !isNull(i) && doubles[i];
+    case ATOM:
+        return !isNull(i) && atoms[i].isTrue();
+    case VALUE:
+        return values[i].isTrue();
+    }
+    throw HttpReturnException(500, "Unknown expression value batch type");
+}
+
+bool
+ExpressionValueBatch::
+isFalse(size_t i) const
+{
+    switch (type) {
+    case EMPTY:
+        return false;
+    case INTEGER:
+        return !isNull(i) && !ints[i];
+    case DOUBLE:
+        return !isNull(i) && !doubles[i];
+    case ATOM:
+        return !isNull(i) && atoms[i].isFalse();
+    case VALUE:
+        return values[i].isFalse();
+    }
+    throw HttpReturnException(500, "Unknown expression value batch type");
+}
+
+void
+ExpressionValueBatch::
+setAtom(size_t i, CellValue val, Date tsIn)
+{
+    if (val.empty()) {
+        setNull(i, tsIn);
+        return;
+    }
+    atoms[i] = std::move(val);
+    setNotNull(i, tsIn);
+}
+
+void
+ExpressionValueBatch::
+set(size_t i, ExpressionValue val)
+{
+    if (type == VALUE) {
+        values[i] = std::move(val);
+        return;
+    }
+
+    if (val.empty()) {
+        setNull(i, val.getEffectiveTimestamp());
+        return;
+    }
+
+    if (!val.isAtom()) {
+        promote(VALUE);
+        values[i] = std::move(val);
+        return;
+    }
+
+    Date valTs = val.getEffectiveTimestamp();
+    const CellValue & atom = val.getAtom();
+
+    if (type == EMPTY || type == INTEGER) {
+        if (atom.isInt64()) {
+            promote(INTEGER);
+            setInt(i, atom.toInt(), valTs);
+            return;
+        }
+    }
+
+    if (type == DOUBLE) {
+        if (atom.isDouble()) {
+            setDouble(i, atom.toDouble(), valTs);
+            return;
+        }
+        if (atom.isInt64() && atom.toInt() <= MAX_EXACT_DOUBLE_INT
+            && atom.toInt() >= -MAX_EXACT_DOUBLE_INT) {
+            setDouble(i, atom.toInt(), valTs);
+            return;
+        }
+    }
+
+    promote(ATOM);
+    setAtom(i, atom, valTs);
+}
+
+void
+ExpressionValueBatch::
+set(size_t i, const ExpressionValueBatch & other, size_t j)
+{
+    if (other.isNull(j)) {
+        setNull(i, other.getEffectiveTimestamp(j));
+        return;
+    }
+
+    if (type == EMPTY)
+        promote(other.type);
+
+    if (type == other.type) {
+        switch (type) {
+        case INTEGER:
+            setInt(i, other.ints[j], other.ts[j]);
+            return;
+        case DOUBLE:
+            setDouble(i, other.doubles[j], other.ts[j]);
+            return;
+        case ATOM:
+            setAtom(i, other.atoms[j], other.ts[j]);
+            return;
+        case VALUE:
+            values[i] = other.values[j];
+            return;
+        case EMPTY:
+            break;
+        }
+    }
+
+    set(i, other.get(j));
+}
+
+void
+ExpressionValueBatch::
+fill(const ExpressionValue & val, size_t newSize)
+{
+    if (val.empty()) {
+        reset(EMPTY, newSize);
+        std::fill(ts.begin(), ts.end(), val.getEffectiveTimestamp());
+        return;
+    }
+
+    if (!val.isAtom()) {
+        reset(VALUE, newSize);
+        std::fill(values.begin(), values.end(), val);
+        return;
+    }
+
+    const CellValue & atom = val.getAtom();
+    if (atom.isInt64()) {
+        reset(INTEGER, newSize);
+        std::fill(ints.begin(), ints.end(), atom.toInt());
+    }
+    else if (atom.isDouble()) {
+        reset(DOUBLE, newSize);
+        std::fill(doubles.begin(), doubles.end(), atom.toDouble());
+    }
+    else {
+        reset(ATOM, newSize);
+        std::fill(atoms.begin(), atoms.end(), atom);
+    }
+
+    std::fill(notNull.begin(), notNull.end(), ~0ULL);
+    std::fill(ts.begin(), ts.end(), val.getEffectiveTimestamp());
+}
+
+void
+ExpressionValueBatch::
+fromValues(std::vector<ExpressionValue> vals)
+{
+    // Find the most specific representation that can hold everything
+    bool allNull = true, allInt = true, allNumeric = true, allAtoms = true;
+
+    for (auto & v: vals) {
+        if (v.empty())
+            continue;
+        allNull = false;
+        if (!v.isAtom()) {
+            allAtoms = false;
+            break;
+        }
+        const CellValue & atom = v.getAtom();
+        if (atom.isInt64()) {
+            int64_t i = atom.toInt();
+            if (i > MAX_EXACT_DOUBLE_INT || i < -MAX_EXACT_DOUBLE_INT)
+                allNumeric = false;
+        }
+        else {
+            allInt = false;
+            if (!atom.isDouble())
+                allNumeric = false;
+        }
+    }
+
+    if (!allAtoms) {
+        type = VALUE;
+        size = vals.size();
+        ints.clear();
+        doubles.clear();
+        atoms.clear();
+        notNull.clear();
+        ts.clear();
+        values = std::move(vals);
+        return;
+    }
+
+    Type newType = allNull ? EMPTY
+        : allInt ? INTEGER
+        : allNumeric ? DOUBLE
+        : ATOM;
+
+    reset(newType, vals.size());
+
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        const ExpressionValue & v = vals[i];
+        Date valTs = v.getEffectiveTimestamp();
+        if (v.empty()) {
+            ts[i] = valTs;
+            continue;
+        }
+        switch (newType) {
+        case INTEGER:
+            setInt(i, v.getAtom().toInt(), valTs);
+            break;
+        case DOUBLE:
+            setDouble(i, v.getAtom().toDouble(), valTs);
+            break;
+        case ATOM:
+            setAtom(i, v.getAtom(), valTs);
+            break;
+        default:
+            break;
+        }
+    }
+}
+
+} // namespace MLDB
@@ -0,0 +1,183 @@
+/** expression_value_batch.h                                      -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Column-oriented batch of expression values, used to evaluate a bound
+    SQL expression over many rows in a single call.
+*/
+
+#pragma once
+
+#include "expression_value.h"
+#include <vector>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* EXPRESSION VALUE BATCH                                                    */
+/*****************************************************************************/
+
+/** A batch of values, one per input row, as produced by the batch
+    evaluation mode of a BoundSqlExpression.
+
+    Values are stored column-wise with the most specific representation
+    that can hold all of them: plain integers or doubles when every non-null
+    value is numeric, CellValues for arbitrary atoms, and full
+    ExpressionValues (rows, embeddings) otherwise.  For the atomic
+    representations, nulls are tracked in a bitmap and the effective
+    timestamp of each value is held in a parallel vector, which lets the
+    kernels for arithmetic, comparisons and boolean operators run as tight
+    loops without materializing an ExpressionValue per row.
+
+    Materializing element i with get(i) gives exactly the ExpressionValue
+    that the row-by-row evaluation would have returned.
+*/
+
+struct ExpressionValueBatch {
+
+    enum Type : uint8_t {
+        EMPTY,    ///< Every value is null; only timestamps are stored
+        INTEGER,  ///< Non-null values are 64 bit signed integers in ints
+        DOUBLE,   ///< Non-null values are numbers in doubles
+        ATOM,     ///< Non-null values are arbitrary atoms in atoms
+        VALUE     ///< Arbitrary values in values; no bitmap or timestamps
+    };
+
+    /// Default number of rows in a batch.  Small enough to stay in cache,
+    /// large enough to amortize the per-batch overhead.
+    static constexpr size_t DEFAULT_BATCH_SIZE = 1024;
+
+    ExpressionValueBatch()
+        : type(EMPTY), size(0)
+    {
+    }
+
+    Type type;
+    size_t size;
+
+    std::vector<int64_t> ints;
+    std::vector<double> doubles;
+    std::vector<CellValue> atoms;
+    std::vector<ExpressionValue> values;
+
+    /// One bit per value, set when the value is not null.  Unused for VALUE.
+    std::vector<uint64_t> notNull;
+
+    /// Effective timestamp of each value.  Unused for VALUE.
+    std::vector<Date> ts;
+
+    /** Reset to the given type and size, with every value null and with a
+        timestamp of negative infinity.
+    */
+    void reset(Type newType, size_t newSize);
+
+    /** Convert the storage to a more general type, so that values of that
+        type can be assigned.  Does nothing if the type is already at least
+        as general as the one asked for.
+    */
+    void promote(Type newType);
+
+    /// Is this a representation where every value is an atom or null?
+    bool isAtomic() const { return type != VALUE; }
+
+    /// Is this a representation where every value is a number or null?
+    bool isNumeric() const
+    {
+        return type == EMPTY || type == INTEGER || type == DOUBLE;
+    }
+
+    bool isNull(size_t i) const
+    {
+        if (MLDB_UNLIKELY(type == VALUE))
+            return values[i].empty();
+        return !(notNull[i / 64] & (1ULL << (i % 64)));
+    }
+
+    Date getEffectiveTimestamp(size_t i) const
+    {
+        if (MLDB_UNLIKELY(type == VALUE))
+            return values[i].getEffectiveTimestamp();
+        return ts[i];
+    }
+
+    /** Return a non-null numeric value as a double.  Only valid for the
+        INTEGER and DOUBLE types.
+    */
+    double getDouble(size_t i) const
+    {
+        return type == INTEGER ? (double)ints[i] : doubles[i];
+    }
+
+    /// Return the value at i as an atom.  Not valid for VALUE.
+    CellValue getAtom(size_t i) const;
+
+    /// Materialize the value at i.
+    ExpressionValue get(size_t i) const;
+
+    /// Same semantics as ExpressionValue::isTrue() on get(i)
+    bool isTrue(size_t i) const;
+
+    /// Same semantics as ExpressionValue::isFalse() on get(i)
+    bool isFalse(size_t i) const;
+
+    /** Setters for individual values.  The batch must already have a type
+        that can hold the value.
+    */
+    void setNull(size_t i, Date tsIn)
+    {
+        if (MLDB_UNLIKELY(type == VALUE)) {
+            values[i] = ExpressionValue::null(tsIn);
+            return;
+        }
+        notNull[i / 64] &= ~(1ULL << (i % 64));
+        ts[i] = tsIn;
+    }
+
+    void setInt(size_t i, int64_t val, Date tsIn)
+    {
+        ints[i] = val;
+        setNotNull(i, tsIn);
+    }
+
+    void setDouble(size_t i, double val, Date tsIn)
+    {
+        doubles[i] = val;
+        setNotNull(i, tsIn);
+    }
+
+    /// Set an atom; the type must be ATOM.  Empty atoms are set to null.
+    void setAtom(size_t i, CellValue val, Date tsIn);
+
+    /** Set the value at i, promoting the representation if needed to hold
+        it.
+    */
+    void set(size_t i, ExpressionValue val);
+
+    /** Set the value at i from value j of another batch, promoting the
+        representation if needed.
+    */
+    void set(size_t i, const ExpressionValueBatch & other, size_t j);
+
+    /** Fill the batch with size copies of the same value.  Used to
+        broadcast constants.
+    */
+    void fill(const ExpressionValue & val, size_t newSize);
+
+    /** Initialize from a vector of values, one per row, choosing the most
+        specific representation that can hold all of them.  This is the
+        fallback for expressions that don't implement batch evaluation.
+    */
+    void fromValues(std::vector<ExpressionValue> vals);
+
+private:
+    void setNotNull(size_t i, Date tsIn)
+    {
+        notNull[i / 64] |= (1ULL << (i % 64));
+        ts[i] = tsIn;
+    }
+};
+
+} // namespace MLDB
@@ -164,6 +164,65 @@ apply(const std::vector<ExpressionValue> & args,
 }
 
 
+/*****************************************************************************/
+/* LIKE PATTERN                                                              */
+/*****************************************************************************/
+
+LikePattern::
+LikePattern(const Utf8String & pattern)
+    : kind(REGEX)
+{
+    const std::string & str = pattern.rawString();
+
+    bool leading = !str.empty() && str[0] == '%';
+    bool trailing = str.size() > leading && str[str.size() - 1] == '%';
+
+    literal = str.substr(leading, str.size() - leading - trailing);
+
+    // Anything else with a special meaning needs a regex.  This includes
+    // the characters that likeToRegex() passes through to the regex
+    // unescaped, so that both give the same results.
+    if (literal.find_first_of("%_\\+?{}") != std::string::npos) {
+        literal.clear();
+        return;
+    }
+
+    if (leading && trailing)
+        kind = CONTAINS;
+    else if (leading)
+        kind = SUFFIX;
+    else if (trailing)
+        kind = PREFIX;
+    else kind = EXACT;
+}
+
+bool
+LikePattern::
+matches(const Utf8String & val) const
+{
+    // Comparing the UTF-8 bytes is enough, as a valid UTF-8 literal can
+    // only be found at a character boundary of a valid UTF-8 string.
+    const std::string & str = val.rawString();
+
+    switch (kind) {
+    case EXACT:
+        return str == literal;
+    case PREFIX:
+        return str.compare(0, literal.size(), literal) == 0;
+    case SUFFIX:
+        return str.size() >= literal.size()
+            && str.compare(str.size() - literal.size(), literal.size(),
+                           literal) == 0;
+    case CONTAINS:
+        return str.find(literal) != std::string::npos;
+    case REGEX:
+        break;
+    }
+
+    throw HttpReturnException(500, "LIKE pattern needs to be a regex");
+}
+
+
 /*****************************************************************************/
 /* APPLY LIKE                                                                */
 /*****************************************************************************/
@@ -173,6 +232,9 @@ ApplyLike(BoundSqlExpression e, bool isNegative)
     : isNegative(isNegative)
 {
     init(std::move(e), 1 /* argNumber */);
+
+    if (isPrecompiled && expr.constantValue().isString())
+        precompiledPattern = LikePattern(expr.constantValue().toUtf8String());
 }
 
 /// Return the regex string that matches the same values as the given LIKE
@@ -249,6 +311,27 @@ compile(const ExpressionValue & val) const
     return RegexHelper::compile(regexVal);
 }
 
+template<typename Fn>
+ExpressionValue
+ApplyLike::
+applyMatch(const ExpressionValue & val, const Fn & matches) const
+{
+    if (val.empty())
+        return val;
+
+    if (!val.isString()) {
+        throw HttpReturnException
+            (400, "LIKE expression must have string on left side");
+    }
+    
+    bool result = matches(val.toUtf8String());
+
+    if (isNegative)
+        result = !result;
+
+    return ExpressionValue(result, val.getEffectiveTimestamp());
+}
+
 ExpressionValue
 ApplyLike::
 apply(const std::vector<ExpressionValue> & args,
@@ -261,20 +344,33 @@ apply(const std::vector<ExpressionValue> & args,
         return ExpressionValue::null(Date::negativeInfinity());
     }
 
-    if (args[0].empty())
-        return args[0];
+    return applyMatch(args[0], [&] (const Utf8String & str)
+                      {
+                          return regex_match(str, regex);
+                      });
+}
 
-    if (!args[0].isString()) {
-        throw HttpReturnException
-            (400, "LIKE expression must have string on left side");
-    }
-    
-    bool result = regex_match(args[0].toUtf8String(), regex);
+ExpressionValue
+ApplyLike::
+operator () (const std::vector<ExpressionValue> & args,
+             const SqlRowScope & scope)
+{
+    checkArgsSize(args.size(), 2);
 
-    if (isNegative)
-        result = !result;
+    LikePattern dynamicPattern;
+    if (!isPrecompiled && args[1].isString())
+        dynamicPattern = LikePattern(args[1].toUtf8String());
+
+    const LikePattern & pattern
+        = isPrecompiled ? precompiledPattern : dynamicPattern;
+
+    if (pattern.kind == LikePattern::REGEX)
+        return RegexHelper::operator () (args, scope);
 
-    return ExpressionValue(result, args[0].getEffectiveTimestamp());
+    return applyMatch(args[0], [&] (const Utf8String & str)
+                      {
+                          return pattern.matches(str);
+                      });
 }
 
 } // namespace MLDB
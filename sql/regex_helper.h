@@ -50,8 +50,9 @@ struct RegexHelper {
                                   const SqlRowScope & scope,
                                   const Regex & regex) const = 0;
 
-    ExpressionValue operator () (const std::vector<ExpressionValue> & args,
-                                 const SqlRowScope & scope);
+    virtual ExpressionValue
+    operator () (const std::vector<ExpressionValue> & args,
+                 const SqlRowScope & scope);
 };
 
 
@@ -94,6 +95,41 @@ struct ApplyRegexSearch: public RegexHelper {
 };
 
 
+/*****************************************************************************/
+/* LIKE PATTERN                                                              */
+/*****************************************************************************/
+
+/** A LIKE pattern, analyzed to see if it can be matched by comparing
+    strings instead of running a regex.  This is the case for the common
+    patterns made of a literal with a % at the start, the end or both.
+*/
+
+struct LikePattern {
+    enum Kind {
+        REGEX,      ///< Needs to be compiled into a regex
+        EXACT,      ///< 'literal'
+        PREFIX,     ///< 'literal%'
+        SUFFIX,     ///< '%literal'
+        CONTAINS    ///< '%literal%', or '%' with an empty literal
+    };
+
+    LikePattern()
+        : kind(REGEX)
+    {
+    }
+
+    LikePattern(const Utf8String & pattern);
+
+    Kind kind;
+
+    /// UTF-8 encoded literal that is compared; empty for REGEX
+    std::string literal;
+
+    /// Does the string match?  Must not be called for REGEX.
+    bool matches(const Utf8String & str) const;
+};
+
+
 /*****************************************************************************/
 /* APPLY LIKE                                                                */
 /*****************************************************************************/
@@ -111,8 +147,22 @@ struct ApplyLike: public RegexHelper {
                                   const SqlRowScope & scope,
                                   const Regex & regex) const;
 
+    /// Matches literal patterns without compiling them into a regex
+    virtual ExpressionValue
+    operator () (const std::vector<ExpressionValue> & args,
+                 const SqlRowScope & scope);
+
     /// This inverts it, ie turns LIKE into NOT LIKE
     bool isNegative;
+
+    /// Analyzed version of the pattern, when it's constant
+    LikePattern precompiledPattern;
+
+private:
+    /// Apply the match function to the string on the left of the LIKE
+    template<typename Fn>
+    ExpressionValue applyMatch(const ExpressionValue & val,
+                               const Fn & matches) const;
 };
 
 
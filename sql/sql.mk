@@ -15,6 +15,7 @@ SQL_EXPRESSION_SOURCES := \
 	cell_value.cc \
 	sql_expression.cc \
 	expression_value.cc \
+	expression_value_batch.cc \
 	table_expression_operations.cc \
 	binding_contexts.cc \
 	builtin_functions.cc \
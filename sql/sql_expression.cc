@@ -18,6 +18,7 @@
 #include "mldb/types/tuple_description.h"
 #include "mldb/jml/utils/environment.h"
 #include "sql_expression_operations.h"
+#include "expression_value_batch.h"
 #include "table_expression_operations.h"
 #include "interval.h"
 #include "tokenize.h"
@@ -124,6 +125,16 @@ BoundSqlExpression(ExecFunction exec,
     }
 }
 
+BoundSqlExpression::
+BoundSqlExpression(ExecFunction exec,
+                   BatchExecFunction batchExec,
+                   const SqlExpression * expr,
+                   std::shared_ptr<ExpressionValueInfo> info)
+    : BoundSqlExpression(std::move(exec), expr, std::move(info))
+{
+    this->batchExec = std::move(batchExec);
+}
+
 ExpressionValue
 BoundSqlExpression::
 constantValue() const
@@ -133,6 +144,38 @@ constantValue() const
     return this->exec(noRow, storage, GET_LATEST);
 }
 
+void
+BoundSqlExpression::
+execBatch(const SqlRowScope * const * rows,
+          size_t numRows,
+          ExpressionValueBatch & output,
+          const VariableFilter & filter) const
+{
+    if (info && info->isConst()) {
+        output.fill(constantValue(), numRows);
+        return;
+    }
+
+    if (batchExec) {
+        batchExec(rows, numRows, output, filter);
+        ExcAssertEqual(output.size, numRows);
+        return;
+    }
+
+    // No batch implementation; evaluate row by row
+    std::vector<ExpressionValue> values;
+    values.reserve(numRows);
+    for (size_t i = 0;  i < numRows;  ++i) {
+        ExpressionValue storage;
+        const ExpressionValue & val = exec(*rows[i], storage, filter);
+        if (&val == &storage)
+            values.emplace_back(std::move(storage));
+        else values.emplace_back(val);
+    }
+
+    output.fromValues(std::move(values));
+}
+
 DEFINE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
 
 BoundSqlExpressionDescription::
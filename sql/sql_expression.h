@@ -78,6 +78,7 @@ struct WhenExpression;
 struct SqlExpressionDatasetScope;
 struct TableOperations;
 struct RowStream;
+struct ExpressionValueBatch;
 
 extern const OrderByExpression ORDER_BY_NOTHING;
 
@@ -124,6 +125,17 @@ struct BoundSqlExpression {
                                                    ExpressionValue & storage,
                                                    const VariableFilter & filter)> ExecFunction;
 
+    /** Function type to execute the expression over a batch of rows in a
+        single call, writing one value per row into output.  This is
+        optional; expressions that don't provide one are evaluated row by
+        row by execBatch().  It must return exactly what exec would return
+        for each row.
+    */
+    typedef std::function<void (const SqlRowScope * const * rows,
+                                size_t numRows,
+                                ExpressionValueBatch & output,
+                                const VariableFilter & filter)> BatchExecFunction;
+
     BoundSqlExpression()
     {
     }
@@ -131,10 +143,18 @@ struct BoundSqlExpression {
     BoundSqlExpression(ExecFunction exec,
                        const SqlExpression * expr,
                        std::shared_ptr<ExpressionValueInfo> info);
+
+    BoundSqlExpression(ExecFunction exec,
+                       BatchExecFunction batchExec,
+                       const SqlExpression * expr,
+                       std::shared_ptr<ExpressionValueInfo> info);
     
     operator bool () const { return !!exec; };
 
     ExecFunction exec;
+
+    /// Batch version of exec; may be empty.
+    BatchExecFunction batchExec;
     std::shared_ptr<const SqlExpression> expr;
 
     /// What kind of value does this return?
@@ -164,6 +184,14 @@ struct BoundSqlExpression {
         return res;
     }
 
+    /** Evaluate the expression over numRows rows at once.  Uses batchExec
+        if it is defined, and otherwise falls back to calling exec once
+        per row.
+    */
+    void execBatch(const SqlRowScope * const * rows,
+                   size_t numRows,
+                   ExpressionValueBatch & output,
+                   const VariableFilter & filter /*= GET_ALL*/) const;
 };
 
 DECLARE_STRUCTURE_DESCRIPTION(BoundSqlExpression);
@@ -203,6 +231,11 @@ struct TableOperations {
     /// Normally used in a join
     std::function<std::vector<Utf8String> () > getChildAliases;
 
+    /// How many rows does the table contain?  Optional; it's used to choose
+    /// between execution strategies (for example for joins), and returns
+    /// -1 if the number of rows is not known without running a query.
+    std::function<ssize_t () > getRowCount;
+
     bool operator ! () const
     {
         return !getRowInfo && !getFunction && !runQuery
@@ -275,6 +308,13 @@ struct ColumnGetter {
 struct BoundFunction {
     typedef std::function<ExpressionValue (const std::vector<ExpressionValue> &,
                           const SqlRowScope & context) > Exec;
+
+    /** Batch version of Exec, for functions whose result depends only on
+        the values of their arguments.  Each argument is a batch with one
+        value per row.
+    */
+    typedef std::function<void (const std::vector<ExpressionValueBatch> & args,
+                                ExpressionValueBatch & output)> ExecBatch;
     typedef std::function<
         BoundSqlExpression (SqlBindingScope & scope,
                             std::vector<BoundSqlExpression>& boundArgs,
@@ -315,6 +355,10 @@ struct BoundFunction {
     operator bool () const { return !!exec; }
 
     Exec exec;
+
+    /// If defined, evaluates the function over a batch of arguments
+    ExecBatch execBatch;
+
     std::shared_ptr<ExpressionValueInfo> resultInfo;
     VariableFilter filter; // allows function to filter variable as they need
 
@@ -6,6 +6,7 @@
 */
 
 #include "sql_expression_operations.h"
+#include "expression_value_batch.h"
 #include "mldb/http/http_exception.h"
 #include <boost/algorithm/string.hpp>
 #include "mldb/types/structure_description.h"
@@ -54,26 +55,104 @@ static Date calcTs(const ExpressionValue & v1,
                     v2.getEffectiveTimestamp());
 }
 
+// Integers above this magnitude don't convert exactly to double, so
+// comparing them numerically against a double may not give the same
+// result as comparing the CellValues.
+static constexpr int64_t MAX_EXACT_DOUBLE_INT = 1LL << 53;
+
+// Applies a standard comparison to either integers or doubles, without
+// converting integers to doubles.
+template<template<typename> class Compare>
+struct NumericCompare {
+    bool operator () (int64_t l, int64_t r) const
+    {
+        return Compare<int64_t>()(l, r);
+    }
+
+    bool operator () (double l, double r) const
+    {
+        return Compare<double>()(l, r);
+    }
+};
+
+template<typename NumericOp>
 BoundSqlExpression
 doComparison(const SqlExpression * expr,
              const BoundSqlExpression & boundLhs,
              const BoundSqlExpression & boundRhs,
-             bool (ExpressionValue::* op)(const ExpressionValue &) const)
+             bool (ExpressionValue::* op)(const ExpressionValue &) const,
+             NumericOp numericOp)
 {
-    return {[=] (const SqlRowScope & row, ExpressionValue & storage,
-                 const VariableFilter & filter)
-            -> const ExpressionValue &
-            {
-                ExpressionValue lstorage, rstorage;
-                const ExpressionValue & l = boundLhs(row, lstorage, GET_LATEST);
-                const ExpressionValue & r = boundRhs(row, rstorage, GET_LATEST);
-                // cerr << "left " << l << " " << "right " << r << endl;
-                Date ts = calcTs(l, r);
-                if (l.empty() || r.empty())
-                    return storage = ExpressionValue::null(ts);
+    auto exec = [=] (const SqlRowScope & row, ExpressionValue & storage,
+                     const VariableFilter & filter)
+        -> const ExpressionValue &
+        {
+            ExpressionValue lstorage, rstorage;
+            const ExpressionValue & l = boundLhs(row, lstorage, GET_LATEST);
+            const ExpressionValue & r = boundRhs(row, rstorage, GET_LATEST);
+            // cerr << "left " << l << " " << "right " << r << endl;
+            Date ts = calcTs(l, r);
+            if (l.empty() || r.empty())
+                return storage = ExpressionValue::null(ts);
  
-                return storage = ExpressionValue((l .* op)(r), ts);
-            },
+            return storage = ExpressionValue((l .* op)(r), ts);
+        };
+
+    auto batchExec = [=] (const SqlRowScope * const * rows, size_t numRows,
+                          ExpressionValueBatch & output,
+                          const VariableFilter & filter)
+        {
+            ExpressionValueBatch l, r;
+            boundLhs.execBatch(rows, numRows, l, GET_LATEST);
+            boundRhs.execBatch(rows, numRows, r, GET_LATEST);
+
+            output.reset(ExpressionValueBatch::INTEGER, numRows);
+
+            // Compare element i the same way as the row by row version
+            auto compareGeneric = [&] (size_t i, Date ts)
+                {
+                    ExpressionValue lv = l.get(i), rv = r.get(i);
+                    output.setInt(i, (lv .* op)(rv), ts);
+                };
+
+            if (l.type == ExpressionValueBatch::INTEGER
+                && r.type == ExpressionValueBatch::INTEGER) {
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    Date ts = std::max(l.ts[i], r.ts[i]);
+                    if (l.isNull(i) || r.isNull(i))
+                        output.setNull(i, ts);
+                    else output.setInt(i, numericOp(l.ints[i], r.ints[i]), ts);
+                }
+            }
+            else if (l.isNumeric() && r.isNumeric()) {
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    Date ts = std::max(l.ts[i], r.ts[i]);
+                    if (l.isNull(i) || r.isNull(i)) {
+                        output.setNull(i, ts);
+                        continue;
+                    }
+                    double lv = l.getDouble(i), rv = r.getDouble(i);
+                    // NaN and inexact integers have special ordering
+                    // rules in CellValue; leave them to the generic path
+                    if (MLDB_UNLIKELY(std::isnan(lv) || std::isnan(rv)
+                                      || std::abs(lv) > MAX_EXACT_DOUBLE_INT
+                                      || std::abs(rv) > MAX_EXACT_DOUBLE_INT))
+                        compareGeneric(i, ts);
+                    else output.setInt(i, numericOp(lv, rv), ts);
+                }
+            }
+            else {
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    Date ts = std::max(l.getEffectiveTimestamp(i),
+                                       r.getEffectiveTimestamp(i));
+                    if (l.isNull(i) || r.isNull(i))
+                        output.setNull(i, ts);
+                    else compareGeneric(i, ts);
+                }
+            }
+        };
+
+    return {exec, batchExec,
             expr,
             std::make_shared<BooleanValueInfo>(boundLhs.info->isConst() && boundRhs.info->isConst())};
 }
@@ -87,27 +166,33 @@ bind(SqlBindingScope & scope) const
 
     if (op == "=" || op == "==") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator ==);
+                            &ExpressionValue::operator ==,
+                            NumericCompare<std::equal_to>());
     }
     else if (op == "!=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator !=);
+                            &ExpressionValue::operator !=,
+                            NumericCompare<std::not_equal_to>());
     }
     else if (op == ">") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator > );
+                            &ExpressionValue::operator >,
+                            NumericCompare<std::greater>());
     }
     else if (op == "<") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator < );
+                            &ExpressionValue::operator <,
+                            NumericCompare<std::less>());
     }
     else if (op == ">=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator >=);
+                            &ExpressionValue::operator >=,
+                            NumericCompare<std::greater_equal>());
     }
     else if (op == "<=") {
         return doComparison(this, boundLhs, boundRhs,
-                            &ExpressionValue::operator <=);
+                            &ExpressionValue::operator <=,
+                            NumericCompare<std::less_equal>());
     }
     else throw HttpReturnException(400, "Unknown comparison op " + op);
 }
@@ -277,6 +362,9 @@ struct BinaryOpHelper {
         {
         }
 
+        /// Atom values bound here are applied as scalars
+        static constexpr bool atomsAreScalar = true;
+
         BoundSqlExpression bound;
 
         const ExpressionValue &
@@ -396,6 +484,9 @@ struct BinaryOpHelper {
         {
         }
 
+        /// Atom values bound here are applied as scalars
+        static constexpr bool atomsAreScalar = false;
+
         BoundSqlExpression bound;
         ExpressionValueInfo::GetCompatibleDoubleEmbeddingsFn extract;
         ExpressionValueInfo::ReconstituteFromDoubleEmbeddingFn reconst;
@@ -523,6 +614,9 @@ struct BinaryOpHelper {
         {
         }
 
+        /// Atom values bound here are applied as scalars
+        static constexpr bool atomsAreScalar = false;
+
         BoundSqlExpression bound;
         ExpressionValueInfo::GetCompatibleDoubleEmbeddingsFn extract;
         ExpressionValueInfo::ReconstituteFromDoubleEmbeddingFn reconst;
@@ -634,6 +728,9 @@ struct BinaryOpHelper {
         {
         }
 
+        /// Atom values bound here are applied as scalars
+        static constexpr bool atomsAreScalar = true;
+
         BoundSqlExpression bound;
 
         const ExpressionValue &
@@ -802,6 +899,62 @@ struct BinaryOpHelper {
         return lhsContext.applyLhs(rhsContext, lhs, rhs, storage);
     }
     
+    template<class LhsContext, class RhsContext>
+    static void
+    applyBatch(const LhsContext & lhsContext,
+               const RhsContext & rhsContext,
+               const SqlRowScope * const * rows,
+               size_t numRows,
+               ExpressionValueBatch & output,
+               const VariableFilter & filter)
+    {
+        ExpressionValueBatch lhs, rhs;
+        lhsContext.bound.execBatch(rows, numRows, lhs, filter);
+        rhsContext.bound.execBatch(rows, numRows, rhs, filter);
+
+        if (LhsContext::atomsAreScalar && RhsContext::atomsAreScalar
+            && lhs.isAtomic() && rhs.isAtomic()) {
+
+            if (Op::hasNumericKernel && lhs.isNumeric() && rhs.isNumeric()) {
+                // Tight loop over unboxed numbers
+                output.reset(ExpressionValueBatch::DOUBLE, numRows);
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    Date ts = std::max(lhs.ts[i], rhs.ts[i]);
+                    if (lhs.isNull(i) || rhs.isNull(i))
+                        output.setNull(i, ts);
+                    else output.setDouble(i, Op::applyNumeric(lhs.getDouble(i),
+                                                              rhs.getDouble(i)),
+                                          ts);
+                }
+                return;
+            }
+
+            // scalar * scalar on each element
+            output.reset(ExpressionValueBatch::EMPTY, numRows);
+            for (size_t i = 0;  i < numRows;  ++i) {
+                Date ts = std::max(lhs.ts[i], rhs.ts[i]);
+                output.set(i, ExpressionValue(Op::apply(lhs.getAtom(i),
+                                                        rhs.getAtom(i)),
+                                              ts));
+            }
+            return;
+        }
+
+        // Generic case; dispatch each element like the row by row version
+        std::vector<ExpressionValue> values;
+        values.reserve(numRows);
+        for (size_t i = 0;  i < numRows;  ++i) {
+            ExpressionValue l = lhs.get(i), r = rhs.get(i);
+            ExpressionValue storage;
+            const ExpressionValue & res
+                = lhsContext.applyLhs(rhsContext, l, r, storage);
+            if (&res == &storage)
+                values.emplace_back(std::move(storage));
+            else values.emplace_back(res);
+        }
+        output.fromValues(std::move(values));
+    }
+
     template<class LhsContext, class RhsContext>
     static BoundSqlExpression
     bindAll(LhsContext lhsContext,
@@ -817,6 +970,13 @@ struct BinaryOpHelper {
                                 std::placeholders::_1,
                                 std::placeholders::_2,
                                 GET_LATEST);
+        result.batchExec = std::bind(applyBatch<LhsContext, RhsContext>,
+                                     lhsContext,
+                                     rhsContext,
+                                     std::placeholders::_1,
+                                     std::placeholders::_2,
+                                     std::placeholders::_3,
+                                     GET_LATEST);
         result.expr = expr->shared_from_this();
         result.info = result.info->getConst(isConstant);
 
@@ -929,6 +1089,20 @@ doUnaryArithmetic(const SqlExpression * expr,
                     = ExpressionValue(std::move(op(r.getAtom())),
                                       r.getEffectiveTimestamp());
             },
+            [=] (const SqlRowScope * const * rows, size_t numRows,
+                 ExpressionValueBatch & output,
+                 const VariableFilter & filter)
+            {
+                ExpressionValueBatch rhs;
+                boundRhs.execBatch(rows, numRows, rhs, filter);
+                output.reset(ExpressionValueBatch::EMPTY, numRows);
+                for (size_t i = 0;  i < numRows;  ++i) {
+                    Date ts = rhs.getEffectiveTimestamp(i);
+                    if (rhs.isNull(i))
+                        output.setNull(i, ts);
+                    else output.set(i, ExpressionValue(op(rhs.getAtom(i)), ts));
+                }
+            },
             expr,
             std::make_shared<ReturnInfo>(boundRhs.info->isConst())};
 }
@@ -1182,6 +1356,13 @@ struct BinaryPlusOp {
         return binaryPlus(l, r);
     }
 
+    // Same as apply() for two non-null numbers
+    static constexpr bool hasNumericKernel = true;
+    static double applyNumeric(double l, double r)
+    {
+        return l + r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1199,6 +1380,13 @@ struct BinaryMinusOp {
         return binaryMinus(l, r);
     }
 
+    // Same as apply() for two non-null numbers
+    static constexpr bool hasNumericKernel = true;
+    static double applyNumeric(double l, double r)
+    {
+        return l - r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1216,6 +1404,13 @@ struct BinaryMultiplicationOp {
         return binaryMultiplication(l, r);
     }
 
+    // Same as apply() for two non-null numbers
+    static constexpr bool hasNumericKernel = true;
+    static double applyNumeric(double l, double r)
+    {
+        return l * r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1233,6 +1428,13 @@ struct BinaryDivisionOp {
         return binaryDivision(l, r);
     }
 
+    // Same as apply() for two non-null numbers
+    static constexpr bool hasNumericKernel = true;
+    static double applyNumeric(double l, double r)
+    {
+        return l / r;
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -1250,6 +1452,14 @@ struct BinaryModulusOp {
         return binaryModulus(l, r);
     }
 
+    // Integer modulus depends upon the signedness of the operands, so
+    // there is no unboxed numeric version.
+    static constexpr bool hasNumericKernel = false;
+    static double applyNumeric(double l, double r)
+    {
+        throw HttpReturnException(500, "No numeric kernel for modulus");
+    }
+
     static std::shared_ptr<ExpressionValueInfo>
     getInfo(const std::shared_ptr<ExpressionValueInfo> & lhs,
             const std::shared_ptr<ExpressionValueInfo> & rhs)
@@ -2007,6 +2217,34 @@ bind(SqlBindingScope & scope) const
                                        r.getEffectiveTimestamp());
                     return storage = ExpressionValue(true, ts);
                 },
+                [=] (const SqlRowScope * const * rows, size_t numRows,
+                     ExpressionValueBatch & output,
+                     const VariableFilter & filter)
+                {
+                    ExpressionValueBatch l, r;
+                    boundLhs.execBatch(rows, numRows, l, filter);
+                    boundRhs.execBatch(rows, numRows, r, filter);
+                    output.reset(ExpressionValueBatch::INTEGER, numRows);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        bool lf = l.isFalse(i), rf = r.isFalse(i);
+                        bool ln = l.isNull(i), rn = r.isNull(i);
+                        Date lts = l.getEffectiveTimestamp(i);
+                        Date rts = r.getEffectiveTimestamp(i);
+                        if (lf && rf)
+                            output.setInt(i, false, std::min(lts, rts));
+                        else if (lf)
+                            output.setInt(i, false, lts);
+                        else if (rf)
+                            output.setInt(i, false, rts);
+                        else if (ln && rn)
+                            output.setNull(i, std::min(lts, rts));
+                        else if (ln)
+                            output.setNull(i, lts);
+                        else if (rn)
+                            output.setNull(i, rts);
+                        else output.setInt(i, true, std::max(lts, rts));
+                    }
+                },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
     }
@@ -2059,6 +2297,34 @@ bind(SqlBindingScope & scope) const
                                        r.getEffectiveTimestamp());
                     return storage = ExpressionValue(false, ts);
                 },
+                [=] (const SqlRowScope * const * rows, size_t numRows,
+                     ExpressionValueBatch & output,
+                     const VariableFilter & filter)
+                {
+                    ExpressionValueBatch l, r;
+                    boundLhs.execBatch(rows, numRows, l, filter);
+                    boundRhs.execBatch(rows, numRows, r, filter);
+                    output.reset(ExpressionValueBatch::INTEGER, numRows);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        bool lt = l.isTrue(i), rt = r.isTrue(i);
+                        bool ln = l.isNull(i), rn = r.isNull(i);
+                        Date lts = l.getEffectiveTimestamp(i);
+                        Date rts = r.getEffectiveTimestamp(i);
+                        if (lt && rt)
+                            output.setInt(i, true, std::max(lts, rts));
+                        else if (lt)
+                            output.setInt(i, true, lts);
+                        else if (rt)
+                            output.setInt(i, true, rts);
+                        else if (ln && rn)
+                            output.setNull(i, std::max(lts, rts));
+                        else if (ln)
+                            output.setNull(i, lts);
+                        else if (rn)
+                            output.setNull(i, rts);
+                        else output.setInt(i, false, std::min(lts, rts));
+                    }
+                },
                 this,
                 std::make_shared<BooleanValueInfo>(constant)};
     }
@@ -2075,6 +2341,20 @@ bind(SqlBindingScope & scope) const
                         return storage = std::move(r);
                     return storage = ExpressionValue(!r.isTrue(), r.getEffectiveTimestamp());
                 },
+                [=] (const SqlRowScope * const * rows, size_t numRows,
+                     ExpressionValueBatch & output,
+                     const VariableFilter & filter)
+                {
+                    ExpressionValueBatch r;
+                    boundRhs.execBatch(rows, numRows, r, filter);
+                    output.reset(ExpressionValueBatch::INTEGER, numRows);
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        Date ts = r.getEffectiveTimestamp(i);
+                        if (r.isNull(i))
+                            output.setNull(i, ts);
+                        else output.setInt(i, !r.isTrue(i), ts);
+                    }
+                },
                 this,
                 std::make_shared<BooleanValueInfo>(boundRhs.info->isConst())};
     }
@@ -2330,6 +2610,20 @@ bindBuiltinFunction(SqlBindingScope & scope,
                 fn.resultInfo};
     }
     else {
+        BoundSqlExpression::BatchExecFunction batchExec;
+        if (fn.execBatch) {
+            batchExec = [=] (const SqlRowScope * const * rows, size_t numRows,
+                             ExpressionValueBatch & output,
+                             const VariableFilter & filter)
+                {
+                    std::vector<ExpressionValueBatch> evaluatedArgs(boundArgs.size());
+                    for (size_t i = 0;  i < boundArgs.size();  ++i)
+                        boundArgs[i].execBatch(rows, numRows, evaluatedArgs[i],
+                                               fn.filter);
+                    fn.execBatch(evaluatedArgs, output);
+                };
+        }
+
         return {[=] (const SqlRowScope & row,
                      ExpressionValue & storage,
                      const VariableFilter & filter) -> const ExpressionValue &
@@ -2341,6 +2635,7 @@ bindBuiltinFunction(SqlBindingScope & scope,
 
                     return storage = fn(evaluatedArgs, row);
                 },
+                batchExec,
                 this,
                 fn.resultInfo};
     }
@@ -2584,6 +2879,18 @@ CaseExpression(std::shared_ptr<SqlExpression> expr,
 {
 }
 
+// Select the given subset of a batch of rows
+static std::vector<const SqlRowScope *>
+gatherRows(const SqlRowScope * const * rows,
+           const std::vector<size_t> & indexes)
+{
+    std::vector<const SqlRowScope *> result;
+    result.reserve(indexes.size());
+    for (size_t i: indexes)
+        result.push_back(rows[i]);
+    return result;
+}
+
 BoundSqlExpression
 CaseExpression::
 bind(SqlBindingScope & scope) const
@@ -2651,6 +2958,67 @@ bind(SqlBindingScope & scope) const
                     // default else returns an empty value
                     return storage = ExpressionValue();
                 },
+                [=] (const SqlRowScope * const * rows, size_t numRows,
+                     ExpressionValueBatch & output,
+                     const VariableFilter & filter)
+                {
+                    output.reset(ExpressionValueBatch::EMPTY, numRows);
+
+                    ExpressionValueBatch v;
+                    boundExpr.execBatch(rows, numRows, v, filter);
+
+                    // Rows that haven't matched a WHEN clause yet
+                    std::vector<size_t> remaining, unmatched;
+                    for (size_t i = 0;  i < numRows;  ++i) {
+                        if (v.isNull(i))
+                            unmatched.push_back(i);
+                        else remaining.push_back(i);
+                    }
+
+                    ExpressionValueBatch v2, val;
+                    for (auto & w: boundWhen) {
+                        if (remaining.empty())
+                            break;
+                        auto subRows = gatherRows(rows, remaining);
+                        w.first.execBatch(subRows.data(), subRows.size(),
+                                          v2, filter);
+
+                        std::vector<size_t> matched, notMatched;
+                        for (size_t k = 0;  k < remaining.size();  ++k) {
+                            if (!v2.isNull(k) && v2.get(k) == v.get(remaining[k]))
+                                matched.push_back(remaining[k]);
+                            else notMatched.push_back(remaining[k]);
+                        }
+
+                        if (!matched.empty()) {
+                            subRows = gatherRows(rows, matched);
+                            w.second.execBatch(subRows.data(), subRows.size(),
+                                               val, filter);
+                            for (size_t k = 0;  k < matched.size();  ++k)
+                                output.set(matched[k], val, k);
+                        }
+
+                        remaining.swap(notMatched);
+                    }
+
+                    unmatched.insert(unmatched.end(),
+                                     remaining.begin(), remaining.end());
+                    if (unmatched.empty())
+                        return;
+
+                    if (elseExpr) {
+                        auto subRows = gatherRows(rows, unmatched);
+                        boundElse.execBatch(subRows.data(), subRows.size(),
+                                            val, filter);
+                        for (size_t k = 0;  k < unmatched.size();  ++k)
+                            output.set(unmatched[k], val, k);
+                    }
+                    else if (boundWhen.size() > 0
+                             && boundWhen[0].second.info->isRow()) {
+                        for (size_t i: unmatched)
+                            output.set(i, ExpressionValue(RowValue()));
+                    }
+                },
                 this,
                 outputInfo};
     }
@@ -2675,6 +3043,52 @@ bind(SqlBindingScope & scope) const
                         return boundElse(row, storage, filter);
                     else return storage = ExpressionValue();
                 },
+                [=] (const SqlRowScope * const * rows, size_t numRows,
+                     ExpressionValueBatch & output,
+                     const VariableFilter & filter)
+                {
+                    output.reset(ExpressionValueBatch::EMPTY, numRows);
+
+                    // Each WHEN is only evaluated on the rows that didn't
+                    // match an earlier one, like in the row by row version
+                    std::vector<size_t> remaining(numRows);
+                    for (size_t i = 0;  i < numRows;  ++i)
+                        remaining[i] = i;
+
+                    ExpressionValueBatch cond, val;
+                    for (auto & w: boundWhen) {
+                        if (remaining.empty())
+                            return;
+                        auto subRows = gatherRows(rows, remaining);
+                        w.first.execBatch(subRows.data(), subRows.size(),
+                                          cond, filter);
+
+                        std::vector<size_t> matched, notMatched;
+                        for (size_t k = 0;  k < remaining.size();  ++k) {
+                            if (cond.isTrue(k))
+                                matched.push_back(remaining[k]);
+                            else notMatched.push_back(remaining[k]);
+                        }
+
+                        if (!matched.empty()) {
+                            subRows = gatherRows(rows, matched);
+                            w.second.execBatch(subRows.data(), subRows.size(),
+                                               val, filter);
+                            for (size_t k = 0;  k < matched.size();  ++k)
+                                output.set(matched[k], val, k);
+                        }
+
+                        remaining.swap(notMatched);
+                    }
+
+                    if (elseExpr && !remaining.empty()) {
+                        auto subRows = gatherRows(rows, remaining);
+                        boundElse.execBatch(subRows.data(), subRows.size(),
+                                            val, filter);
+                        for (size_t k = 0;  k < remaining.size();  ++k)
+                            output.set(remaining[k], val, k);
+                    }
+                },
                 this,
                 outputInfo};
     }
@@ -61,6 +61,11 @@ bindDataset(std::shared_ptr<Dataset> dataset, Utf8String asName)
             return aliases;
         };
 
+    result.table.getRowCount = [=] () -> ssize_t
+        {
+            return dataset->getRowCount();
+        };
+
     return result;
 }
 
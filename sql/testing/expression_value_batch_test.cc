@@ -0,0 +1,181 @@
+/** expression_value_batch_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that batch evaluation of SQL expressions gives exactly the same
+    results as evaluating them one row at a time.
+*/
+
+#include "mldb/sql/sql_expression.h"
+#include "mldb/sql/expression_value_batch.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <cmath>
+#include <iostream>
+#include <limits>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+struct TestRowScope: public SqlRowScope {
+    std::map<ColumnPath, ExpressionValue> vars;
+};
+
+struct TestBindingScope: public SqlBindingScope {
+    ColumnGetter doGetColumn(const Utf8String & tableName,
+                             const ColumnPath & columnName)
+    {
+        return {[=] (const SqlRowScope & scope,
+                     ExpressionValue & storage,
+                     const VariableFilter & filter) -> const ExpressionValue &
+                {
+                    auto & row = static_cast<const TestRowScope &>(scope);
+                    auto it = row.vars.find(columnName);
+                    if (it == row.vars.end())
+                        return storage = ExpressionValue();
+                    return it->second;
+                },
+                std::make_shared<AtomValueInfo>()};
+    }
+};
+
+static std::vector<TestRowScope>
+createRows()
+{
+    std::vector<CellValue> xs = {
+        1, 2, -3, 0, 2.5, -0.5, 1000000,
+        std::numeric_limits<double>::quiet_NaN(),
+        std::numeric_limits<double>::infinity(),
+        (int64_t)((1ULL << 62) + 1),
+        CellValue()
+    };
+
+    std::vector<CellValue> ys = { 2, 0, -1.5, CellValue(), 3 };
+
+    std::vector<CellValue> ss = { "hello", "", "abc", 3, CellValue() };
+
+    std::vector<TestRowScope> result;
+    for (size_t i = 0;  i < 300;  ++i) {
+        TestRowScope row;
+        Date ts = Date::fromSecondsSinceEpoch(i % 7);
+        row.vars[PathElement("x")]
+            = ExpressionValue(xs[i % xs.size()], ts);
+        row.vars[PathElement("y")]
+            = ExpressionValue(ys[i % ys.size()], ts.plusSeconds(i % 3));
+        row.vars[PathElement("s")]
+            = ExpressionValue(ss[i % ss.size()], ts);
+        row.vars[PathElement("i")]
+            = ExpressionValue(i, Date::fromSecondsSinceEpoch(i % 5));
+        if (i % 11 == 0)
+            row.vars.erase(PathElement("x"));
+        result.emplace_back(std::move(row));
+    }
+    return result;
+}
+
+static void
+checkBatchMatchesRows(const std::string & expression)
+{
+    cerr << "checking " << expression << endl;
+
+    auto rows = createRows();
+    std::vector<const SqlRowScope *> rowPtrs;
+    for (auto & r: rows)
+        rowPtrs.push_back(&r);
+
+    TestBindingScope scope;
+    auto parsed = SqlExpression::parse(expression);
+    auto bound = parsed->bind(scope);
+
+    // Evaluate some sizes which are not a multiple of 64 to check the
+    // handling of the null bitmap.
+    for (size_t n: { (size_t)0, (size_t)1, (size_t)63, rows.size() }) {
+        ExpressionValueBatch batch;
+        bound.execBatch(rowPtrs.data(), n, batch, GET_LATEST);
+        BOOST_REQUIRE_EQUAL(batch.size, n);
+
+        for (size_t i = 0;  i < n;  ++i) {
+            ExpressionValue expected = bound(rows[i], GET_LATEST);
+            ExpressionValue actual = batch.get(i);
+
+            BOOST_CHECK_EQUAL(actual, expected);
+            BOOST_CHECK_EQUAL(actual.getEffectiveTimestamp(),
+                              expected.getEffectiveTimestamp());
+            BOOST_CHECK_EQUAL(batch.isTrue(i), expected.isTrue());
+            BOOST_CHECK_EQUAL(batch.isFalse(i), expected.isFalse());
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_constants)
+{
+    checkBatchMatchesRows("1");
+    checkBatchMatchesRows("1.5");
+    checkBatchMatchesRows("'hello'");
+    checkBatchMatchesRows("NULL");
+    checkBatchMatchesRows("[1, 2]");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_arithmetic)
+{
+    checkBatchMatchesRows("i + 1");
+    checkBatchMatchesRows("i * 2 - 3");
+    checkBatchMatchesRows("i / 4");
+    checkBatchMatchesRows("i % 7");
+    checkBatchMatchesRows("-i");
+    checkBatchMatchesRows("x + y");
+    checkBatchMatchesRows("x - y");
+    checkBatchMatchesRows("x * y");
+    checkBatchMatchesRows("i / y");
+    checkBatchMatchesRows("s + x");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_comparisons)
+{
+    checkBatchMatchesRows("i > 100");
+    checkBatchMatchesRows("i = 17");
+    checkBatchMatchesRows("x < y");
+    checkBatchMatchesRows("x >= y");
+    checkBatchMatchesRows("x = y");
+    checkBatchMatchesRows("x != 2");
+    checkBatchMatchesRows("x <= 2.5");
+    checkBatchMatchesRows("s = 'abc'");
+    checkBatchMatchesRows("s < x");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_boolean)
+{
+    checkBatchMatchesRows("i > 10 AND i < 200");
+    checkBatchMatchesRows("x > 0 OR y > 0");
+    checkBatchMatchesRows("x AND y");
+    checkBatchMatchesRows("x OR y");
+    checkBatchMatchesRows("s AND i > 100");
+    checkBatchMatchesRows("NOT x");
+    checkBatchMatchesRows("NOT (i % 3 = 0)");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_case)
+{
+    checkBatchMatchesRows("CASE WHEN x > 0 THEN 'pos' WHEN x < 0 THEN 'neg' END");
+    checkBatchMatchesRows("CASE WHEN i % 2 = 0 THEN i ELSE x END");
+    checkBatchMatchesRows("CASE i % 3 WHEN 0 THEN 'zero' WHEN 1 THEN y ELSE 2.5 END");
+    checkBatchMatchesRows("CASE x WHEN 1 THEN 1 END");
+    checkBatchMatchesRows("CASE s WHEN 'abc' THEN x WHEN 3 THEN s END");
+}
+
+BOOST_AUTO_TEST_CASE(test_batch_functions)
+{
+    checkBatchMatchesRows("abs(i - 150)");
+    checkBatchMatchesRows("sqrt(i)");
+    checkBatchMatchesRows("floor(i / 3)");
+    checkBatchMatchesRows("ln(x)");
+    checkBatchMatchesRows("isnan(y)");
+    checkBatchMatchesRows("exp(y) + 1");
+}
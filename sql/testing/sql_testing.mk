@@ -6,3 +6,4 @@ $(eval $(call test,path_test,sql_types,boost valgrind))
 $(eval $(call test,path_order_test,sql_types,boost))
 $(eval $(call test,path_benchmark,sql_types,boost))
 $(eval $(call test,eval_sql_test,sql_expression,boost))
+$(eval $(call test,expression_value_batch_test,sql_expression,boost))
@@ -13,6 +13,7 @@
 #include "mldb/plugins/tabular_dataset_column.h"
 #include "mldb/server/mldb_server.h"
 #include "mldb/arch/timers.h"
+#include <sstream>
 
 using namespace std;
 
@@ -118,6 +119,34 @@ freezeAndTest(const std::vector<CellValue> & cells)
     
     BOOST_REQUIRE_EQUAL(frozen->size(), cells.size());
 
+    {
+        // Check that it survives being serialized and reconstituted
+        std::ostringstream stream;
+        FrozenColumnSerializer serializer(stream);
+        serializer.writeColumn(*frozen);
+        std::string serialized = stream.str();
+        BOOST_CHECK_EQUAL(serializer.offset(), serialized.size());
+
+        auto buffer = std::make_shared<std::vector<uint64_t> >
+            ((serialized.size() + 7) / 8);
+        std::copy(serialized.begin(), serialized.end(),
+                  (char *)buffer->data());
+
+        FrozenColumnReconstituter reconstituter
+            ((const char *)buffer->data(), serialized.size(), buffer);
+        auto reconstituted = reconstituter.readColumn();
+        BOOST_CHECK(reconstituter.eof());
+
+        BOOST_CHECK_EQUAL(MLDB::type_name(*reconstituted),
+                          MLDB::type_name(*frozen));
+        BOOST_REQUIRE_EQUAL(reconstituted->size(), frozen->size());
+        for (size_t i = 0;  i < cells.size();  ++i) {
+            BOOST_REQUIRE_EQUAL(reconstituted->get(i), cells[i]);
+            BOOST_REQUIRE_EQUAL(reconstituted->get(i).cellType(),
+                                frozen->get(i).cellType());
+        }
+    }
+
     return frozen;
 }
 
@@ -131,8 +160,8 @@ BOOST_AUTO_TEST_CASE( test_frozen_ints_only )
 
     auto frozen = freezeAndTest(vals);
 
-    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
-                      "MLDB::IntegerFrozenColumn");
+    // Consecutive values are stored as their (constant) differences
+    BOOST_CHECK_EQUAL(frozen->format(), "Delta");
 }
 
 // Simple positive and null integers
@@ -146,8 +175,8 @@ BOOST_AUTO_TEST_CASE( test_frozen_ints_and_nulls_only )
 
     auto frozen = freezeAndTest(vals);
 
-    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
-                      "MLDB::IntegerFrozenColumn");
+    // Each block of values needs fewer bits than the whole range
+    BOOST_CHECK_EQUAL(frozen->format(), "FrameOfReference");
 }
 
 // Simple negative, positive and null integers
@@ -192,8 +221,7 @@ BOOST_AUTO_TEST_CASE( test_frozen_neg_only_ints_and_nulls )
 
     auto frozen = freezeAndTest(vals);
 
-    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
-                   "MLDB::IntegerFrozenColumn");
+    BOOST_CHECK_EQUAL(frozen->format(), "FrameOfReference");
 }
 
 // Simple negative, positive and null integers
@@ -367,3 +395,111 @@ BOOST_AUTO_TEST_CASE( test_timestamp_basics_null )
     BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
                       "MLDB::TimestampFrozenColumn");
 }
+
+BOOST_AUTO_TEST_CASE( test_table_mixed_values )
+{
+    std::vector<CellValue> vals;
+
+    for (int64_t i = 0;  i < 100;  ++i) {
+        vals.emplace_back("hello " + std::to_string(i % 7));
+        vals.emplace_back(Utf8String("caf\xc3\xa9 " + std::to_string(i % 3)));
+        vals.emplace_back(i * 0.5);
+        vals.emplace_back();
+        vals.emplace_back(CellValue::blob("blob " + std::to_string(i % 5)));
+        vals.emplace_back(CellValue::fromMonthDaySecond(i % 4, 2, -1.5));
+        vals.emplace_back(Path({ PathElement("x"),
+                                 PathElement(std::to_string(i % 2)) }));
+        vals.emplace_back(Date::fromSecondsSinceEpoch(i));
+        vals.emplace_back((uint64_t)std::numeric_limits<int64_t>::max() + i);
+    }
+
+    freezeAndTest(vals);
+}
+
+BOOST_AUTO_TEST_CASE( test_run_length )
+{
+    // Long runs of a few values, including runs of nulls
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 10000;  ++i) {
+        if (i / 1000 == 3)
+            vals.emplace_back();
+        else vals.emplace_back("status " + std::to_string(i / 1000 % 4));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(frozen->format(), "RunLength");
+    BOOST_CHECK_LT(frozen->memusage(), 1000);
+
+    // Filtering is done a run at a time
+    std::vector<uint8_t> keep(vals.size(), 1);
+    frozen->filter(FrozenColumnPredicate(FrozenColumnPredicate::EQUAL,
+                                         { CellValue("status 1") }),
+                   keep);
+    for (size_t i = 0;  i < vals.size();  ++i)
+        BOOST_REQUIRE_EQUAL(keep[i], vals[i] == CellValue("status 1"));
+}
+
+BOOST_AUTO_TEST_CASE( test_delta_sorted_timestamps )
+{
+    // Whole second timestamps are stored as integers, and when sorted
+    // they need very few bits per row
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 10000;  ++i) {
+        vals.emplace_back(Date::fromSecondsSinceEpoch(1500000000 + i * 60
+                                                      + (i % 3)));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(MLDB::type_name(*frozen),
+                      "MLDB::TimestampFrozenColumn");
+
+    // As doubles, it would need 80,000 bytes
+    BOOST_CHECK_LT(frozen->memusage(), 10000);
+}
+
+BOOST_AUTO_TEST_CASE( test_frame_of_reference_outliers )
+{
+    // A few outliers only cost extra bits within their block
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 10000;  ++i) {
+        if (i % 2000 == 1000)
+            vals.emplace_back(1000000000000000LL + i);
+        else vals.emplace_back(i * 7919 % 1000);
+    }
+    vals.emplace_back();
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(frozen->format(), "FrameOfReference");
+}
+
+BOOST_AUTO_TEST_CASE( test_front_coded_strings )
+{
+    // Long strings with common prefixes
+    std::vector<CellValue> vals;
+    for (int64_t i = 0;  i < 10000;  ++i) {
+        if (i % 10 == 0)
+            vals.emplace_back();
+        else if (i % 10 == 1)
+            vals.emplace_back(Utf8String("https://example.com/caf\xc3\xa9/"
+                                         + std::to_string(i)));
+        else vals.emplace_back("https://example.com/products/item/"
+                               + std::to_string(i * 7919 % 100000));
+    }
+
+    auto frozen = freezeAndTest(vals);
+    BOOST_CHECK_EQUAL(frozen->format(), "FrontCoded");
+
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(frozen->get(i).cellType(), vals[i].cellType());
+    }
+
+    std::vector<uint8_t> keep(vals.size(), 1);
+    frozen->filter(FrozenColumnPredicate(FrozenColumnPredicate::LESS,
+                                         { CellValue("https://example.com/p") }),
+                   keep);
+    for (size_t i = 0;  i < vals.size();  ++i) {
+        BOOST_REQUIRE_EQUAL(keep[i],
+                            !vals[i].empty()
+                            && vals[i] < CellValue("https://example.com/p"));
+    }
+}
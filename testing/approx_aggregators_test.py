@@ -0,0 +1,100 @@
+#
+# approx_aggregators_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Sketch based aggregators: approx_count_distinct, approx_quantile and
+# approx_median.
+#
+import unittest
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 50000
+
+class ApproxAggregatorsTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            row = [['x', i, 0], ['label', 'label%d' % (i % 5), 0],
+                   ['small', i % 10, 0]]
+            ds.record_row('row%05d' % i, row)
+        ds.commit()
+
+    def test_count_distinct(self):
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_count_distinct(x) AS x,
+                   approx_count_distinct(small) AS small,
+                   approx_count_distinct(label) AS label
+            FROM ds
+        """, format='aos').json()
+        # Small cardinalities are exact
+        self.assertEqual(res[0]['small'], 10)
+        self.assertEqual(res[0]['label'], 5)
+        self.assertAlmostEqual(res[0]['x'], NUM_ROWS, delta=NUM_ROWS * 0.03)
+
+    def test_count_distinct_group_by(self):
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_count_distinct(x) AS approx,
+                   count_distinct(x) AS exact
+            FROM ds GROUP BY label ORDER BY label
+        """, format='aos').json()
+        self.assertEqual(len(res), 5)
+        for r in res:
+            self.assertAlmostEqual(r['approx'], r['exact'],
+                                   delta=r['exact'] * 0.03)
+
+    def test_count_distinct_row(self):
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_count_distinct({small, label}) AS v FROM ds
+        """, format='aos').json()
+        self.assertEqual(res[0]['v.small'], 10)
+        self.assertEqual(res[0]['v.label'], 5)
+
+    def test_quantiles(self):
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_median(x) AS median,
+                   approx_quantile(x, 0) AS min,
+                   approx_quantile(x, 0.1) AS p10,
+                   approx_quantile(x, 0.99) AS p99,
+                   approx_quantile(x, 1) AS max
+            FROM ds
+        """, format='aos').json()[0]
+        self.assertEqual(res['min'], 0)
+        self.assertEqual(res['max'], NUM_ROWS - 1)
+        self.assertAlmostEqual(res['median'], NUM_ROWS * 0.5,
+                               delta=NUM_ROWS * 0.01)
+        self.assertAlmostEqual(res['p10'], NUM_ROWS * 0.1,
+                               delta=NUM_ROWS * 0.01)
+        self.assertAlmostEqual(res['p99'], NUM_ROWS * 0.99,
+                               delta=NUM_ROWS * 0.005)
+
+    def test_quantiles_group_by(self):
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_median(small) AS median
+            FROM ds GROUP BY small % 2 ORDER BY small % 2
+        """, format='aos').json()
+        # 0, 2, 4, 6, 8 and 1, 3, 5, 7, 9, each equally often
+        self.assertAlmostEqual(res[0]['median'], 4, delta=0.5)
+        self.assertAlmostEqual(res[1]['median'], 5, delta=0.5)
+
+    def test_small(self):
+        # Few values are kept exactly
+        res = mldb.get('/v1/query', q="""
+            SELECT approx_median(x) AS median,
+                   approx_count_distinct(x) AS n
+            FROM ds WHERE x < 4
+        """, format='aos').json()[0]
+        self.assertEqual(res['n'], 4)
+        self.assertEqual(res['median'], 1.5)
+
+    def test_bad_quantile(self):
+        msg = "approx_quantile requires the quantile"
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.query("SELECT approx_quantile(x, 2) FROM ds")
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException, msg):
+            mldb.query("SELECT approx_quantile(x, 'half') FROM ds")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,171 @@
+/** csv_scanner_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the vectorized CSV structural character scanner.  Also reports
+    the tokenizing speed of each version on quoted and unquoted CSV data.
+*/
+
+#include "mldb/plugins/csv_scanner.h"
+#include "mldb/arch/timers.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <random>
+#include <iostream>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+
+typedef const char * (*FindFn) (const char *, const char *, char, char, bool &);
+
+static std::vector<std::pair<std::string, FindFn> >
+versions()
+{
+    std::vector<std::pair<std::string, FindFn> > result;
+    result.emplace_back("scalar", &findCsvSpecialScalar);
+#if MLDB_INTEL_ISA
+    result.emplace_back("sse2", &findCsvSpecialSse2);
+    if (csvScannerHasAvx2())
+        result.emplace_back("avx2", &findCsvSpecialAvx2);
+#endif
+    result.emplace_back("dispatched", &findCsvSpecial);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_versions_agree)
+{
+    std::mt19937 rng(1);
+    const char chars[] = { 'a', 'b', ',', '"', '\xc3', '\xa9', ' ', '0' };
+
+    for (int iter = 0;  iter < 2000;  ++iter) {
+        std::string str(rng() % 100, 'x');
+        // Mostly plain characters, so that there are long runs
+        for (auto & c: str) {
+            if (rng() % 8 == 0)
+                c = chars[rng() % sizeof(chars)];
+        }
+
+        const char * end = str.data() + str.size();
+
+        for (size_t start = 0;  start <= str.size();  ++start) {
+            const char * p = str.data() + start;
+            bool expectedEightBit = false;
+            const char * expected
+                = findCsvSpecialScalar(p, end, ',', '"', expectedEightBit);
+
+            for (auto & v: versions()) {
+                bool eightBit = false;
+                const char * found = v.second(p, end, ',', '"', eightBit);
+                BOOST_REQUIRE_MESSAGE(found == expected,
+                                      v.first << " on '" << str
+                                      << "' from " << start);
+                BOOST_REQUIRE_EQUAL(eightBit, expectedEightBit);
+
+                // eightBit is never reset
+                eightBit = true;
+                v.second(p, end, ',', '"', eightBit);
+                BOOST_CHECK(eightBit);
+            }
+
+            bool anyEightBit = false;
+            findCsvSpecialScalar(p, end, 0, 0, anyEightBit);
+            BOOST_CHECK_EQUAL(hasEightBitChars(p, end), anyEightBit);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(test_same_character)
+{
+    std::string str(100, 'a');
+    str[70] = ',';
+    bool eightBit = false;
+    for (auto & v: versions()) {
+        BOOST_CHECK_EQUAL(v.second(str.data(), str.data() + str.size(),
+                                   ',', ',', eightBit) - str.data(), 70);
+        BOOST_CHECK_EQUAL(v.second(str.data(), str.data() + 70,
+                                   ',', ',', eightBit) - str.data(), 70);
+    }
+    BOOST_CHECK(!eightBit);
+}
+
+/// Split CSV data into fields in the same way as import.text, and return
+/// the number of fields
+static size_t tokenize(const std::string & data, FindFn find)
+{
+    size_t numFields = 0;
+    const char * p = data.data();
+    const char * e = p + data.size();
+    bool eightBit = false;
+
+    while (p < e) {
+        const char * lineEnd = find(p, e, '\n', '\n', eightBit);
+        while (p < lineEnd) {
+            if (*p == '"') {
+                for (++p;  p < lineEnd;  ) {
+                    p = find(p, lineEnd, '"', '"', eightBit) + 1;
+                    if (p >= lineEnd || *p != '"')
+                        break;
+                    ++p;  // doubled quote
+                }
+            }
+            else p = find(p, lineEnd, ',', ',', eightBit);
+            ++numFields;
+            if (p < lineEnd)
+                ++p;  // separator
+        }
+        p = lineEnd + 1;
+    }
+
+    return numFields;
+}
+
+BOOST_AUTO_TEST_CASE(benchmark_tokenize)
+{
+    std::mt19937 rng(2);
+    const char * words[] = { "apple", "banana", "Montréal", "kiwi",
+                             "a somewhat longer value with some words" };
+
+    // Unquoted: numbers and short strings
+    std::string unquoted;
+    // Quoted: text values with separators and doubled quotes inside
+    std::string quoted;
+
+    size_t numRows = 200000;
+    for (size_t i = 0;  i < numRows;  ++i) {
+        unquoted += std::to_string(i) + "," + std::to_string(rng() % 1000)
+            + "," + std::to_string((rng() % 100000) / 100.0) + ","
+            + words[rng() % 5] + "," + words[rng() % 5] + "\n";
+
+        quoted += std::to_string(i) + ",\"" + words[rng() % 5]
+            + ", which is a fruit\",\"she said \"\"hello\"\" to "
+            + words[rng() % 5] + "\",\"" + std::string(rng() % 200, 'x')
+            + "\"\n";
+    }
+
+    for (auto * data: { &unquoted, &quoted }) {
+        size_t expectedFields = 0;
+        for (auto & v: versions()) {
+            Timer timer;
+            size_t numFields = 0;
+            for (int i = 0;  i < 5;  ++i)
+                numFields = tokenize(*data, v.second);
+            double elapsed = timer.elapsed_wall() / 5;
+
+            cerr << (data == &quoted ? "quoted  " : "unquoted") << " "
+                 << v.first << ": " << data->size() / elapsed / 1000000.0
+                 << "MB/s" << endl;
+
+            if (expectedFields == 0)
+                expectedFields = numFields;
+            BOOST_CHECK_EQUAL(numFields, expectedFields);
+        }
+        BOOST_CHECK_EQUAL(expectedFields, numRows * (data == &quoted ? 4 : 5));
+    }
+}
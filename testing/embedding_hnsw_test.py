@@ -0,0 +1,103 @@
+#
+# embedding_hnsw_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Embedding dataset with an approximate (hnsw) neighbors index.
+#
+import math
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_ROWS = 2000
+NUM_DIMS = 16
+
+class EmbeddingHnswTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(42)
+        cls.points = {}
+        ds = mldb.create_dataset({
+            'id' : 'emb',
+            'type' : 'embedding',
+            'params' : {
+                'index' : 'hnsw',
+                'hnswM' : 8,
+                'hnswEfSearch' : 50
+            }
+        })
+
+        for i in range(NUM_ROWS):
+            name = 'r{}'.format(i)
+            coords = [random.gauss(0, 1) for d in range(NUM_DIMS)]
+            cls.points[name] = coords
+            ds.record_row(name, [['x{}'.format(d), c, 0]
+                                 for d, c in enumerate(coords)])
+        ds.commit()
+
+        mldb.put('/v1/functions/nn', {
+            'type' : 'embedding.neighbors',
+            'params' : {
+                'dataset' : 'emb',
+                'defaultNumNeighbors' : 10
+            }
+        })
+
+    def expected(self, coords, n):
+        dists = []
+        for name, p in self.points.items():
+            d = math.sqrt(sum((a - b) ** 2 for a, b in zip(coords, p)))
+            dists.append((d, name))
+        dists.sort()
+        return dists[:n]
+
+    def neighbors(self, coords, ef=None):
+        args = ', '.join('x{}: {}'.format(d, c) for d, c in enumerate(coords))
+        ef = '' if ef is None else ', efSearch: {}'.format(ef)
+        res = mldb.query("SELECT nn({{coords: {{{}}}{}}})[distances] AS *"
+                         .format(args, ef))
+        return dict(zip(res[0][1:], res[1][1:]))
+
+    def test_status(self):
+        status = mldb.get('/v1/datasets/emb').json()['status']
+        self.assertEqual(status['rowCount'], NUM_ROWS)
+        self.assertEqual(status['indexedRowCount'], NUM_ROWS)
+        self.assertEqual(status['index'], 'hnsw')
+
+    def test_recall(self):
+        random.seed(7)
+        found_total = 0
+        for i in range(50):
+            coords = [random.gauss(0, 1) for d in range(NUM_DIMS)]
+            found = self.neighbors(coords, 200)
+            expected = self.expected(coords, 10)
+            self.assertEqual(len(found), 10)
+            for d, name in expected:
+                if name in found:
+                    found_total += 1
+                    self.assertAlmostEqual(found[name], d, 4)
+        self.assertGreaterEqual(found_total / 500.0, 0.9)
+
+    def test_row_is_its_own_neighbor(self):
+        res = mldb.query("SELECT nn({coords: 'r123'})[distances] AS *")
+        found = dict(zip(res[0][1:], res[1][1:]))
+        self.assertEqual(found['r123'], 0)
+
+    def test_ef_search_override(self):
+        coords = self.points['r5']
+        found = self.neighbors(coords, 1)
+        self.assertEqual(len(found), 10)
+        found = self.neighbors(coords, 500)
+        self.assertEqual(found['r5'], 0)
+
+    def test_bad_params(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id' : 'bad',
+                'type' : 'embedding',
+                'params' : { 'index' : 'hnsw', 'hnswM' : 1 }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,88 @@
+#
+# embedding_incremental_index_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Rows committed to an embedding dataset after its neighbors index was
+# built are searched alongside it; check that the neighbors are still
+# exact.
+#
+import math
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_INITIAL = 300
+NUM_BATCHES = 5
+BATCH_SIZE = 20
+
+class EmbeddingIncrementalIndexTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(42)
+        cls.points = {}
+        ds = mldb.create_dataset({'id' : 'emb', 'type' : 'embedding'})
+
+        def add_rows(n):
+            for i in range(n):
+                name = 'r{}'.format(len(cls.points))
+                coords = [random.random(), random.random(), random.random()]
+                cls.points[name] = coords
+                ds.record_row(name, [['x', coords[0], 0],
+                                     ['y', coords[1], 0],
+                                     ['z', coords[2], 0]])
+            ds.commit()
+
+        add_rows(NUM_INITIAL)
+        for b in range(NUM_BATCHES):
+            add_rows(BATCH_SIZE)
+
+        mldb.put('/v1/functions/nn', {
+            'type' : 'embedding.neighbors',
+            'params' : {
+                'dataset' : 'emb',
+                'defaultNumNeighbors' : 10
+            }
+        })
+
+    def expected(self, coords, n):
+        dists = []
+        for name, p in self.points.items():
+            d = math.sqrt(sum((a - b) ** 2 for a, b in zip(coords, p)))
+            dists.append((d, name))
+        dists.sort()
+        return dists[:n]
+
+    def test_status(self):
+        status = mldb.get('/v1/datasets/emb').json()['status']
+        self.assertEqual(status['rowCount'],
+                         NUM_INITIAL + NUM_BATCHES * BATCH_SIZE)
+        # The small batches are below the threshold to rebuild the index
+        self.assertEqual(status['indexedRowCount'], NUM_INITIAL)
+
+    def test_neighbors_are_exact(self):
+        random.seed(7)
+        for i in range(20):
+            coords = [random.random(), random.random(), random.random()]
+            res = mldb.query("""
+                SELECT nn({{coords: {{x: {}, y: {}, z: {}}}}})[distances] AS *
+            """.format(*coords))
+            found = dict(zip(res[0][1:], res[1][1:]))
+            expected = self.expected(coords, 10)
+            self.assertEqual(sorted(found.keys()),
+                             sorted(name for d, name in expected))
+            for d, name in expected:
+                self.assertAlmostEqual(found[name], d, 5)
+
+    def test_neighbors_of_new_row(self):
+        name = 'r{}'.format(NUM_INITIAL + BATCH_SIZE + 3)
+        res = mldb.query("SELECT nn({{coords: '{}'}})[distances] AS *"
+                         .format(name))
+        found = dict(zip(res[0][1:], res[1][1:]))
+        expected = self.expected(self.points[name], 10)
+        self.assertEqual(sorted(found.keys()),
+                         sorted(n for d, n in expected))
+        self.assertEqual(found[name], 0)
+
+if __name__ == '__main__':
+    mldb.run_tests()
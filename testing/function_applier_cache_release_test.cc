@@ -0,0 +1,89 @@
+/** function_applier_cache_release_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test that the applier cached by a function doesn't keep the entities
+    it was bound against alive once they are deleted.
+*/
+
+#include "mldb/server/mldb_server.h"
+#include "mldb/server/dataset_collection.h"
+#include "mldb/server/function_collection.h"
+#include "mldb/core/dataset.h"
+#include "mldb/core/function.h"
+#include "mldb/http/http_rest_proxy.h"
+#include <thread>
+#include <chrono>
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+BOOST_AUTO_TEST_CASE( test_deleted_dataset_is_freed )
+{
+    MldbServer server;
+
+    server.init();
+
+    string httpBoundAddress = server.bindTcp(PortRange(17000,18000), "127.0.0.1");
+
+    cerr << "http listening on " << httpBoundAddress << endl;
+
+    server.start();
+
+    HttpRestProxy proxy(httpBoundAddress);
+
+    PolyConfig datasetConfig;
+    datasetConfig.type = "sparse.mutable";
+
+    auto res = proxy.put("/v1/datasets/ds", jsonEncode(datasetConfig));
+    BOOST_REQUIRE_EQUAL(res.code(), 201);
+
+    MatrixNamedRow row;
+    row.rowName = RowPath("r1");
+    row.columns.emplace_back(ColumnPath("x"), 1, Date());
+    proxy.post("/v1/datasets/ds/rows", jsonEncode(row));
+    proxy.post("/v1/datasets/ds/commit");
+
+    Json::Value functionConfig;
+    functionConfig["type"] = "sql.query";
+    functionConfig["params"]["query"] = "SELECT x + $y AS z FROM ds";
+
+    res = proxy.put("/v1/functions/fn", functionConfig);
+    BOOST_REQUIRE_EQUAL(res.code(), 201);
+
+    std::weak_ptr<Dataset> dataset
+        = server.datasets->getExistingEntity("ds");
+    auto function = server.functions->getExistingEntity("fn");
+
+    // Call it twice, so that the second call uses the cached applier
+    for (unsigned i = 0;  i < 2;  ++i) {
+        res = proxy.get("/v1/functions/fn/application",
+                        { { "input", "{\"y\":10}" } });
+        BOOST_REQUIRE_EQUAL(res.code(), 200);
+        BOOST_CHECK_EQUAL(res.jsonBody()["output"]["z"].asInt(), 11);
+    }
+
+    BOOST_CHECK_EQUAL(function->getApplierCacheStats().hits, 1);
+    BOOST_CHECK(!dataset.expired());
+
+    res = proxy.perform("DELETE", "/v1/datasets/ds");
+    BOOST_CHECK_EQUAL(res.code(), 204);
+
+    // The function is still there, but its cache must no longer hold on
+    // to the dataset.  Deletion may finish in the background, so we give
+    // it a little time.
+    for (unsigned i = 0;  i < 100 && !dataset.expired();  ++i)
+        std::this_thread::sleep_for(std::chrono::milliseconds(50));
+
+    BOOST_CHECK(dataset.expired());
+
+    server.shutdown();
+}
@@ -0,0 +1,72 @@
+#
+# function_applier_cache_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Calling a function directly re-uses the applier it was bound to; check
+# that the cache is hit, and that it is dropped when entities change.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class FunctionApplierCacheTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.create_dataset(1)
+
+    @staticmethod
+    def create_dataset(value):
+        ds = mldb.create_dataset({'id' : 'cache_ds', 'type' : 'sparse.mutable'})
+        ds.record_row('r1', [['x', value, 0]])
+        ds.commit()
+
+    @staticmethod
+    def create_function():
+        mldb.put('/v1/functions/cache_fn', {
+            'type' : 'sql.query',
+            'params' : {
+                'query' : 'SELECT x + $y AS z FROM cache_ds'
+            }
+        })
+
+    def apply(self):
+        res = mldb.get('/v1/functions/cache_fn/application',
+                       input={'y' : 10})
+        return res.json()['output']['z']
+
+    def stats(self):
+        return mldb.get('/v1/functions/cache_fn/applierCache').json()
+
+    def test_hits(self):
+        self.create_function()
+        self.assertEqual(self.stats()['misses'], 0)
+
+        for i in range(5):
+            self.assertEqual(self.apply(), 11)
+
+        stats = self.stats()
+        self.assertEqual(stats['misses'], 1)
+        self.assertEqual(stats['hits'], 4)
+
+        # Replacing the function starts with an empty cache
+        self.create_function()
+        stats = self.stats()
+        self.assertEqual(stats['hits'], 0)
+        self.assertEqual(stats['misses'], 0)
+
+    def test_invalidated_by_dataset(self):
+        self.create_function()
+        self.assertEqual(self.apply(), 11)
+        self.assertEqual(self.apply(), 11)
+
+        mldb.delete('/v1/datasets/cache_ds')
+        self.create_dataset(5)
+
+        # The applier was bound to the old dataset, so it must be re-bound
+        self.assertEqual(self.apply(), 15)
+        stats = self.stats()
+        self.assertEqual(stats['misses'], 2)
+        self.assertEqual(stats['hits'], 1)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,110 @@
+#
+# function_batch_apply_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Batch application of functions, with JSON and dense binary input; the
+# outputs must come back in the order of the inputs.
+#
+import requests
+import struct
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+NUM_ROWS = 1000
+
+def encode_dense(columns, rows):
+    result = struct.pack('<II', len(rows), len(columns))
+    for c in columns:
+        name = c.encode('utf-8')
+        result += struct.pack('<I', len(name)) + name
+    for row in rows:
+        result += struct.pack('<' + 'f' * len(row), *row)
+    return result
+
+def decode_dense(data):
+    num_rows, num_columns = struct.unpack_from('<II', data, 0)
+    offset = 8
+    columns = []
+    for i in range(num_columns):
+        length, = struct.unpack_from('<I', data, offset)
+        offset += 4
+        columns.append(data[offset:offset + length].decode('utf-8'))
+        offset += length
+    rows = []
+    for i in range(num_rows):
+        rows.append(list(struct.unpack_from('<' + 'f' * num_columns,
+                                            data, offset)))
+        offset += 4 * num_columns
+    assert offset == len(data)
+    return columns, rows
+
+class FunctionBatchApplyTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        mldb.put('/v1/functions/batch_fn', {
+            'type' : 'sql.expression',
+            'params' : {
+                'expression' : 'x * 2 AS y, features.a + features.b AS s'
+            }
+        })
+
+    def test_json_keeps_order(self):
+        inputs = [{'x' : i, 'features' : {'a' : i, 'b' : 1}}
+                  for i in range(NUM_ROWS)]
+        res = mldb.get('/v1/functions/batch_fn/batch', input=inputs).json()
+        self.assertEqual(len(res), NUM_ROWS)
+        for i, r in enumerate(res):
+            self.assertEqual(r, {'y' : i * 2, 's' : i + 1})
+
+    def test_json_object(self):
+        inputs = {'r{}'.format(i) : {'x' : i} for i in range(100)}
+        res = mldb.get('/v1/functions/batch_fn/batch', input=inputs).json()
+        self.assertEqual(len(res), 100)
+        for i in range(100):
+            self.assertEqual(res['r{}'.format(i)]['y'], i * 2)
+
+    def test_dense(self):
+        rows = [[i, i * 0.5, -1] for i in range(NUM_ROWS)]
+        payload = encode_dense(['x', 'features.a', 'features.b'], rows)
+        r = requests.post(url + '/v1/functions/batch_fn/batchDense',
+                          data=payload)
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.headers['content-type'], 'application/octet-stream')
+
+        columns, out = decode_dense(r.content)
+        self.assertEqual(columns, ['y', 's'])
+        self.assertEqual(len(out), NUM_ROWS)
+        for i, row in enumerate(out):
+            self.assertAlmostEqual(row[0], i * 2, places=3)
+            self.assertAlmostEqual(row[1], i * 0.5 - 1, places=3)
+
+    def test_dense_json_output(self):
+        payload = encode_dense(['x'], [[i] for i in range(10)])
+        r = requests.post(url + '/v1/functions/batch_fn/batchDense',
+                          params={'outputFormat' : 'json'}, data=payload)
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual([row['y'] for row in r.json()],
+                         [i * 2 for i in range(10)])
+
+    def test_dense_errors(self):
+        payload = encode_dense(['x'], [[1], [2]])
+        r = requests.post(url + '/v1/functions/batch_fn/batchDense',
+                          data=payload[:-2])
+        self.assertEqual(r.status_code, 400, r.text)
+        self.assertIn('truncated', r.text)
+
+        payload = encode_dense(['features', 'features.a'], [[1, 2]])
+        r = requests.post(url + '/v1/functions/batch_fn/batchDense',
+                          data=payload)
+        self.assertEqual(r.status_code, 400, r.text)
+
+        payload = encode_dense([], [])
+        r = requests.post(url + '/v1/functions/batch_fn/batchDense',
+                          data=payload)
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(decode_dense(r.content), ([], []))
+
+if __name__ == '__main__':
+    mldb.run_tests()
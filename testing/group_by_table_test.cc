@@ -0,0 +1,118 @@
+/** group_by_table_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the hash table and spill storage used by GROUP BY.
+*/
+
+#include "mldb/server/group_by_table.h"
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <map>
+
+
+using namespace std;
+
+using namespace MLDB;
+
+typedef std::vector<ExpressionValue> Key;
+
+static Key makeKey(int i)
+{
+    Date ts = Date::fromSecondsSinceEpoch(i % 17);
+    Key result;
+    result.emplace_back(i % 1000, ts);
+    if (i % 3 == 0)
+        result.emplace_back(ExpressionValue::null(ts));
+    else result.emplace_back("group " + std::to_string(i % 7), ts);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_table_matches_map)
+{
+    GroupByHashTable<int> table;
+    std::map<Key, int> expected;
+
+    for (int i = 0;  i < 100000;  ++i) {
+        Key key = makeKey(i);
+        uint64_t hash = GroupByHashTable<int>::hashKey(key);
+        auto res = table.insert(key, hash);
+        auto res2 = expected.insert({ key, 0 });
+        BOOST_CHECK_EQUAL(res.second, res2.second);
+        table.values[res.first] += 1;
+        res2.first->second += 1;
+    }
+
+    BOOST_CHECK_EQUAL(table.size(), expected.size());
+
+    for (auto & e: expected) {
+        ssize_t entry = table.find(e.first, GroupByHashTable<int>::hashKey(e.first));
+        BOOST_REQUIRE_NE(entry, -1);
+        BOOST_CHECK_EQUAL(table.values[entry], e.second);
+    }
+
+    Key missing = { ExpressionValue("not there", Date()) };
+    BOOST_CHECK_EQUAL(table.find(missing, GroupByHashTable<int>::hashKey(missing)), -1);
+}
+
+BOOST_AUTO_TEST_CASE(test_hash_ignores_timestamps)
+{
+    Key key1 = { ExpressionValue(1, Date::fromSecondsSinceEpoch(1)) };
+    Key key2 = { ExpressionValue(1, Date::fromSecondsSinceEpoch(2)) };
+
+    BOOST_CHECK_EQUAL(GroupByHashTable<int>::hashKey(key1),
+                      GroupByHashTable<int>::hashKey(key2));
+    BOOST_CHECK(GroupByHashTable<int>::keysEqual(key1, key2));
+}
+
+BOOST_AUTO_TEST_CASE(test_spill_round_trip)
+{
+    size_t numBuckets = 3, numPartitions = 5;
+    GroupBySpill spill("", numBuckets, numPartitions);
+
+    std::vector<std::vector<std::vector<Key> > > expected
+        (numBuckets, std::vector<std::vector<Key> >(numPartitions));
+
+    for (int i = 0;  i < 200000;  ++i) {
+        Key row = makeKey(i);
+        row.emplace_back(i * 0.5, Date::fromSecondsSinceEpoch(i));
+        // Structured values take a different path than atoms
+        if (i % 11 == 0) {
+            RowValue structured;
+            structured.emplace_back(ColumnPath("x"), i,
+                                    Date::fromSecondsSinceEpoch(i));
+            row.emplace_back(std::move(structured));
+        }
+        size_t bucket = i % numBuckets;
+        size_t partition
+            = spill.partitionForHash(GroupByHashTable<int>::hashKey(row));
+        spill.add(bucket, partition, row);
+        expected[bucket][partition].push_back(row);
+    }
+
+    spill.flush();
+    BOOST_CHECK_EQUAL(spill.numRows(), 200000);
+
+    for (size_t b = 0;  b < numBuckets;  ++b) {
+        for (size_t p = 0;  p < numPartitions;  ++p) {
+            size_t n = 0;
+            auto onRow = [&] (Key & row)
+                {
+                    BOOST_REQUIRE_LT(n, expected[b][p].size());
+                    const Key & e = expected[b][p][n++];
+                    BOOST_REQUIRE_EQUAL(row.size(), e.size());
+                    for (size_t i = 0;  i < row.size();  ++i) {
+                        BOOST_CHECK_EQUAL(row[i], e[i]);
+                        BOOST_CHECK_EQUAL(row[i].getEffectiveTimestamp(),
+                                          e[i].getEffectiveTimestamp());
+                    }
+                };
+            spill.forEachRow(b, p, onRow);
+            BOOST_CHECK_EQUAL(n, expected[b][p].size());
+        }
+    }
+}
@@ -0,0 +1,134 @@
+#
+# hash_join_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Equijoins of a small table with a big one are executed with a hash join;
+# check that they are and that they give the same results as the merge join.
+#
+
+_mldb = mldb  # noqa
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+NUM_FACTS = 20000
+NUM_DIMS = 150
+
+class HashJoinTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        # Keys are repeated over the facts, and missing for some of them
+        ds = mldb.create_dataset({'id' : 'facts', 'type' : 'sparse.mutable'})
+        for i in range(NUM_FACTS):
+            cols = [['v', i % 7, 0]]
+            if i % 13 != 0:
+                cols.append(['k', i % 200, 0])
+            ds.record_row('f{}'.format(i), cols)
+        ds.commit()
+
+        # Some keys are also repeated or missing in the dimensions
+        ds = mldb.create_dataset({'id' : 'dims', 'type' : 'sparse.mutable'})
+        for i in range(NUM_DIMS):
+            cols = [['t', i % 5, 0]]
+            if i % 31 != 0:
+                cols.append(['k', i % 120, 0])
+            ds.record_row('d{}'.format(i), cols)
+        ds.commit()
+
+    def expected_count(self, qualification):
+        # rows of facts that match each row of dims, with the cross condition
+        # facts.v >= dims.t
+        dims = {}
+        for j in range(NUM_DIMS):
+            if j % 31 != 0:
+                dims.setdefault(j % 120, []).append(j)
+
+        matched_facts = set()
+        matched_dims = set()
+        count = 0
+        for i in range(NUM_FACTS):
+            if i % 13 == 0:
+                continue
+            for j in dims.get(i % 200, []):
+                if i % 7 >= j % 5:
+                    count += 1
+                    matched_facts.add(i)
+                    matched_dims.add(j)
+
+        if qualification in ('LEFT', 'FULL'):
+            count += NUM_FACTS - len(matched_facts)
+        if qualification in ('RIGHT', 'FULL'):
+            count += NUM_DIMS - len(matched_dims)
+        return count
+
+    def join_query(self, qualification, big_on_left):
+        if big_on_left:
+            tables = 'facts {} JOIN dims'.format(qualification)
+        else:
+            tables = 'dims {} JOIN facts'.format(qualification)
+
+        return """
+            SELECT facts.k AS fk, facts.v AS fv, dims.k AS dk, dims.t AS dt
+            FROM {}
+            ON facts.k = dims.k AND facts.v >= dims.t
+        """.format(tables)
+
+    def run_join(self, qualification, big_on_left):
+        query = self.join_query(qualification, big_on_left)
+
+        # The small side is the one that is hashed
+        strategy = 'hashBuildRight' if big_on_left else 'hashBuildLeft'
+        before = _mldb.debugGetEquiJoinCounts()
+        hashed = mldb.query(query)
+        after = _mldb.debugGetEquiJoinCounts()
+        self.assertEqual(after[strategy], before[strategy] + 1)
+        self.assertEqual(after['merge'], before['merge'])
+
+        _mldb.debugSetPathOptimizationLevel('never')
+        try:
+            before = _mldb.debugGetEquiJoinCounts()
+            merged = mldb.query(query)
+            after = _mldb.debugGetEquiJoinCounts()
+        finally:
+            _mldb.debugSetPathOptimizationLevel('always')
+        self.assertEqual(after['merge'], before['merge'] + 1)
+
+        # Same header, and same rows, including the outer ones, although
+        # not in the same order
+        self.assertEqual(hashed[0], merged[0])
+        self.assertEqual(sorted(hashed[1:]), sorted(merged[1:]))
+
+        if not big_on_left:
+            qualification = {'LEFT': 'RIGHT',
+                             'RIGHT': 'LEFT'}.get(qualification,
+                                                  qualification)
+        self.assertEqual(len(hashed) - 1, self.expected_count(qualification))
+
+    def test_inner(self):
+        self.run_join('', True)
+        self.run_join('', False)
+
+    def test_left(self):
+        self.run_join('LEFT', True)
+        self.run_join('LEFT', False)
+
+    def test_right(self):
+        self.run_join('RIGHT', True)
+        self.run_join('RIGHT', False)
+
+    def test_full(self):
+        self.run_join('FULL', True)
+        self.run_join('FULL', False)
+
+    def test_values(self):
+        res = mldb.query("""
+            SELECT facts.v, dims.t FROM facts JOIN dims
+            ON facts.k = dims.k AND facts.v >= dims.t
+            WHERE dims.k = 42
+            ORDER BY rowName()
+        """)
+        for row in res[1:]:
+            self.assertGreaterEqual(row[1], row[2])
+            self.assertEqual(row[2], 2)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,98 @@
+#
+# python_worker_pool_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# script.apply functions run in Python worker processes (numWorkers).
+#
+import unittest
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+SOURCE = """
+import os
+results = []
+for colName, cellValue in mldb.script.args[0]:
+    results.append([colName, cellValue[0] * 2, cellValue[1]])
+results.append(['pid', os.getpid(), '2017-01-01T00:00:00Z'])
+mldb.script.set_return(results)
+"""
+
+def create_function(id, source, **params):
+    params.update({
+        'language': 'python',
+        'scriptConfig': { 'source': source }
+    })
+    return mldb.put('/v1/functions/' + id, {
+        'type': 'script.apply',
+        'params': params
+    })
+
+class PythonWorkerPoolTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(500):
+            ds.record_row('row%03d' % i, [['x', i, 0], ['y', i * 0.5, 0]])
+        ds.commit()
+
+        create_function('inServer', SOURCE)
+        create_function('inWorkers', SOURCE, numWorkers=4, maxBatchSize=16)
+
+    def test_same_results(self):
+        query = """
+            SELECT {fn}({{ {{x, y}} AS args }})[return] AS *
+            FROM ds ORDER BY rowName()
+        """
+        in_server = mldb.get('/v1/query', q=query.format(fn='inServer'),
+                             format='aos').json()
+        in_workers = mldb.get('/v1/query', q=query.format(fn='inWorkers'),
+                              format='aos').json()
+        self.assertEqual(len(in_workers), 500)
+        for r1, r2 in zip(in_server, in_workers):
+            self.assertEqual(r1['x'], r2['x'])
+            self.assertEqual(r1['y'], r2['y'])
+
+        # The calls were spread over several processes, none of which is
+        # the server
+        pids = set(r['pid'] for r in in_workers)
+        self.assertGreater(len(pids), 1)
+        self.assertLessEqual(len(pids), 4)
+        self.assertNotIn(in_server[0]['pid'], pids)
+
+    def test_script_error(self):
+        create_function('failing', "raise ValueError('bad value')",
+                        numWorkers=2)
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'ValueError: bad value'):
+            mldb.query("SELECT failing({{x} AS args}) FROM ds")
+
+        # The workers are still usable afterwards
+        mldb.query("SELECT inWorkers({{x} AS args}) FROM ds")
+
+    def test_compile_error(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'SyntaxError'):
+            create_function('badSyntax', 'def (:', numWorkers=2)
+
+    def test_no_callbacks(self):
+        create_function('callsBack', "mldb.perform('GET', '/v1/datasets')",
+                        numWorkers=1)
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'not available in a Python worker'):
+            mldb.query("SELECT callsBack({{x} AS args}) FROM ds")
+
+    def test_javascript_unsupported(self):
+        with self.assertRaisesRegexp(mldb_wrapper.ResponseException,
+                                     'only supported for Python'):
+            mldb.put('/v1/functions/js', {
+                'type': 'script.apply',
+                'params': {
+                    'language': 'javascript',
+                    'scriptConfig': { 'source': 'return 1;' },
+                    'numWorkers': 2
+                }
+            })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,115 @@
+#
+# query_arrow_output_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Query output in the Arrow IPC streaming format (format=arrow).
+#
+import requests
+import struct
+import unittest
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+NUM_ROWS = 70000
+
+def message_types(data):
+    """Return the header type of each message of the stream, by reading the
+    Message flatbuffer just enough to find it."""
+    result = []
+    offset = 0
+    while True:
+        continuation, length = struct.unpack_from('<Ii', data, offset)
+        assert continuation == 0xffffffff
+        offset += 8
+        if length == 0:
+            break
+        meta = data[offset:offset + length]
+        table, = struct.unpack_from('<I', meta, 0)
+        vtable = table - struct.unpack_from('<i', meta, table)[0]
+        header_type_field, = struct.unpack_from('<H', meta, vtable + 6)
+        body_length_field, = struct.unpack_from('<H', meta, vtable + 10)
+        header_type, = struct.unpack_from('<B', meta, table + header_type_field)
+        body_length, = struct.unpack_from('<q', meta, table + body_length_field)
+        result.append(header_type)
+        offset += length + body_length
+    assert offset == len(data)
+    return result
+
+class QueryArrowOutputTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'sparse.mutable'})
+        for i in range(NUM_ROWS):
+            row = [['x', i, 0], ['label', 'label%d' % (i % 7), 0]]
+            if i % 3:
+                row.append(['y', i * 0.5, 0])
+            ds.record_row('row%05d' % i, row)
+        ds.commit()
+
+    def test_http(self):
+        r = requests.get(url + '/v1/query',
+                         params={'q' : 'SELECT * FROM ds ORDER BY x',
+                                 'format' : 'arrow'})
+        self.assertEqual(r.status_code, 200)
+        self.assertEqual(r.headers['content-type'],
+                         'application/vnd.apache.arrow.stream')
+
+        # schema, one dictionary for label, then two record batches
+        self.assertEqual(message_types(r.content), [1, 2, 3, 3])
+
+    def test_python_wrapper(self):
+        data = mldb.query('SELECT x, y FROM ds ORDER BY x LIMIT 10',
+                          format='arrow')
+        self.assertEqual(message_types(data), [1, 3])
+
+        # the default format is unchanged
+        res = mldb.query('SELECT x FROM ds ORDER BY x LIMIT 2')
+        self.assertEqual(res, [['_rowName', 'x'], ['row00000', 0],
+                               ['row00001', 1]])
+
+    def test_empty_result(self):
+        data = mldb.query('SELECT x FROM ds WHERE x < 0', format='arrow')
+        self.assertEqual(message_types(data), [1])
+
+    def test_contents(self):
+        try:
+            import pyarrow
+        except ImportError:
+            raise unittest.SkipTest('pyarrow is not installed')
+
+        data = mldb.query("SELECT x, y, label, x = 3 AS three, "
+                          "TIMESTAMP '2017-01-01T00:00:00Z' AS ts, "
+                          "CASE WHEN x % 2 THEN 'odd' ELSE x END AS mixed "
+                          "FROM ds ORDER BY x", format='arrow')
+        table = pyarrow.ipc.open_stream(data).read_all()
+        self.assertEqual(table.num_rows, NUM_ROWS)
+
+        types = { f.name : str(f.type) for f in table.schema }
+        self.assertEqual(types['_rowName'], 'string')
+        self.assertEqual(types['x'], 'int64')
+        self.assertEqual(types['y'], 'double')
+        self.assertEqual(types['three'], 'int64')
+        self.assertEqual(types['ts'], 'timestamp[us, tz=UTC]')
+        self.assertTrue(types['label'].startswith('dictionary'))
+        self.assertTrue(types['mixed'].startswith('dictionary'))
+
+        self.assertEqual(table.column('x').to_pylist(), range(NUM_ROWS))
+        y = table.column('y').to_pylist()
+        self.assertEqual(y[:4], [None, 0.5, 1.0, None])
+        self.assertEqual(table.column('label').to_pylist()[:2],
+                         ['label0', 'label1'])
+        self.assertEqual(table.column('mixed').to_pylist()[:2], ['0', 'odd'])
+
+        # Same values as the JSON output
+        expected = mldb.query('SELECT x, y FROM ds ORDER BY x LIMIT 100')
+        self.assertEqual(
+            [[r, x, y] for r, x, y in zip(
+                table.column('_rowName').to_pylist()[:100],
+                table.column('x').to_pylist()[:100],
+                y[:100])],
+            expected[1:])
+
+if __name__ == '__main__':
+    mldb.run_tests()
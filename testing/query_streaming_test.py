@@ -0,0 +1,70 @@
+#
+# query_streaming_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Large /v1/query results are streamed in chunks; they must be identical to
+# what the in-process connection returns, in the same order.
+#
+import requests
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+url = 'http://localhost:' + mldb.get_http_bound_address().split(':')[-1]
+
+NUM_ROWS = 50000
+
+class QueryStreamingTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id' : 'ds', 'type' : 'tabular'})
+        for i in range(NUM_ROWS):
+            ds.record_row('row%05d' % i,
+                          [['x', i, 0], ['y', 'value %d' % (i % 13), 0]])
+        ds.commit()
+
+    def check_format(self, fmt, query):
+        params = {'q' : query, 'format' : fmt}
+        expected = mldb.get('/v1/query', **params).json()
+        r = requests.get(url + '/v1/query', params=params, stream=True)
+        self.assertEqual(r.status_code, 200, r.text)
+        self.assertEqual(r.json(), expected)
+        return expected
+
+    def test_full(self):
+        res = self.check_format('full', 'SELECT * FROM ds ORDER BY x')
+        self.assertEqual(len(res), NUM_ROWS)
+        self.assertEqual([r['rowName'] for r in res],
+                         ['row%05d' % i for i in range(NUM_ROWS)])
+
+    def test_sparse(self):
+        res = self.check_format('sparse',
+                                'SELECT x, y FROM ds ORDER BY x DESC')
+        self.assertEqual(len(res), NUM_ROWS)
+        self.assertEqual(res[0][0], ['_rowName', 'row%05d' % (NUM_ROWS - 1)])
+
+    def test_aos(self):
+        res = self.check_format('aos', 'SELECT x * 2 AS x2 FROM ds ORDER BY x')
+        self.assertEqual([r['x2'] for r in res],
+                         [i * 2 for i in range(NUM_ROWS)])
+
+    def test_grouped(self):
+        res = self.check_format('full', 'SELECT count(*) AS n FROM ds '
+                                'GROUP BY y ORDER BY y')
+        self.assertEqual(len(res), 13)
+
+    def test_small_result(self):
+        res = self.check_format('full', 'SELECT x FROM ds ORDER BY x LIMIT 3')
+        self.assertEqual(len(res), 3)
+
+    def test_non_streamed_format(self):
+        res = self.check_format('table', 'SELECT x FROM ds ORDER BY x')
+        self.assertEqual(len(res), NUM_ROWS + 1)
+
+    def test_error_before_streaming(self):
+        r = requests.get(url + '/v1/query',
+                         params={'q' : 'SELECT * FROM nonexistent'})
+        self.assertGreaterEqual(r.status_code, 400, r.text)
+        self.assertIn('error', r.json())
+
+if __name__ == '__main__':
+    mldb.run_tests()
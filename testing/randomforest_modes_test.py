@@ -0,0 +1,87 @@
+#
+# randomforest_modes_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Categorical and regression modes of the randomforest.binary.train
+# procedure.
+#
+import random
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class RandomForestModesTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        random.seed(1)
+        ds = mldb.create_dataset({'id' : 'rf_data', 'type' : 'tabular'})
+        for i in xrange(3000):
+            x = random.random()
+            y = random.random()
+            label = 'a' if x < 0.33 else ('b' if y < 0.5 else 'c')
+            target = 100 + 10 * x + 3 * y
+            ds.record_row('r%d' % i, [['x', x, 0], ['y', y, 0],
+                                      ['cls', label, 0],
+                                      ['target', target, 0]])
+        ds.commit()
+
+    def train(self, name, label, mode):
+        mldb.put('/v1/procedures/' + name, {
+            'type' : 'randomforest.binary.train',
+            'params' : {
+                'trainingData' : """
+                    SELECT {x, y} AS features, %s AS label FROM rf_data
+                """ % label,
+                'mode' : mode,
+                'modelFileUrl' : 'file://tmp/%s.cls' % name,
+                'functionName' : name,
+                'featureVectorSamplings' : 2,
+                'featureSamplings' : 3,
+                'featureVectorSamplingProp' : 1,
+                'maxDepth' : 8,
+                'runOnCreation' : True
+            }
+        })
+
+    def test_categorical(self):
+        self.train('rf_categorical', 'cls', 'categorical')
+        res = mldb.query("""
+            SELECT rf_categorical({features: {x, y}})[scores] AS *, cls
+            FROM rf_data LIMIT 500
+        """)
+        header = res[0]
+        label_col = header.index('cls')
+        score_cols = [i for i in range(1, len(header)) if i != label_col]
+        labels = [header[i].strip('"') for i in score_cols]
+        self.assertEqual(sorted(labels), ['a', 'b', 'c'])
+
+        correct = 0
+        for row in res[1:]:
+            scores = [row[i] for i in score_cols]
+            self.assertAlmostEqual(sum(scores), 1.0, places=4)
+            if labels[scores.index(max(scores))] == row[label_col]:
+                correct += 1
+        self.assertGreater(correct, 0.95 * (len(res) - 1))
+
+    def test_regression(self):
+        self.train('rf_regression', 'target', 'regression')
+        res = mldb.query("""
+            SELECT rf_regression({features: {x, y}})[score] AS score, target
+            FROM rf_data LIMIT 500
+        """)
+        score_col = res[0].index('score')
+        target_col = res[0].index('target')
+        error = 0.0
+        for row in res[1:]:
+            score, target = row[score_col], row[target_col]
+            self.assertGreaterEqual(score, 100)
+            self.assertLessEqual(score, 113)
+            error += abs(score - target)
+        self.assertLess(error / (len(res) - 1), 0.5)
+
+    def test_multilabel_is_rejected(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.train('rf_multilabel', '{cls}', 'multilabel')
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,102 @@
+#
+# regex_engine_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Regexes are run with RE2 when it supports them and with boost otherwise,
+# and LIKE patterns made of a literal are matched without a regex.  Both
+# must give the same results as before.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class RegexEngineTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        ds = mldb.create_dataset({'id': 'words', 'type': 'sparse.mutable'})
+        words = ['apple', 'application', 'snapple', 'grape', 'a+b', 'a_b',
+                 'line1\nline2', 'héllo wörld', '']
+        for i, w in enumerate(words):
+            ds.record_row('row{}'.format(i), [['w', w, 0], ['p', 'app%', 0]])
+        ds.commit()
+
+    def value(self, expr):
+        return mldb.query('SELECT ' + expr + ' AS v')[1][1]
+
+    def matching(self, where):
+        res = mldb.query('SELECT w FROM words WHERE ' + where
+                         + ' ORDER BY w')
+        return [r[1] for r in res[1:]]
+
+    def test_like_literals(self):
+        self.assertEqual(self.matching("w LIKE 'apple'"), ['apple'])
+        self.assertEqual(self.matching("w LIKE 'app%'"),
+                         ['apple', 'application'])
+        self.assertEqual(self.matching("w LIKE '%ple'"),
+                         ['apple', 'snapple'])
+        self.assertEqual(self.matching("w LIKE '%pp%'"),
+                         ['apple', 'application', 'snapple'])
+        self.assertEqual(self.matching("w NOT LIKE '%a%'"),
+                         ['', 'héllo wörld', 'line1\nline2'])
+        self.assertEqual(self.matching("w LIKE '%'"), self.matching('true'))
+        self.assertEqual(self.matching("w LIKE ''"), [''])
+        self.assertEqual(self.matching("w LIKE '%ör%'"),
+                         ['héllo wörld'])
+        self.assertEqual(self.matching("w LIKE 'line1%'"), ['line1\nline2'])
+
+    def test_like_wildcards(self):
+        # These still need a regex
+        self.assertEqual(self.matching("w LIKE 'a_b'"), ['a+b', 'a_b'])
+        self.assertEqual(self.matching("w LIKE 'g%e'"), ['grape'])
+        self.assertEqual(self.matching("w LIKE '_pple'"), ['apple'])
+        self.assertEqual(self.matching("w LIKE 'h_llo%'"),
+                         ['héllo wörld'])
+
+    def test_like_non_constant(self):
+        self.assertEqual(self.matching('w LIKE p'), ['apple', 'application'])
+        self.assertEqual(self.matching("w LIKE p + 'i%'"), ['application'])
+
+    def test_regex_re2(self):
+        self.assertEqual(self.value("regex_match('apple', 'a.*e')"), True)
+        self.assertEqual(self.value("regex_match('apple', 'pp')"), False)
+        self.assertEqual(self.value("regex_search('apple', 'pp')"), True)
+        self.assertEqual(self.value("regex_search('APPLE', 'pp')"), False)
+        self.assertEqual(
+            self.matching("regex_search(w, '^line2$')"), ['line1\nline2'])
+        self.assertEqual(self.matching("regex_match(w, 'line1.line2')"),
+                         ['line1\nline2'])
+        self.assertEqual(self.value("regex_replace('apple', 'p+', 'b')"),
+                         'able')
+        self.assertEqual(self.value("regex_replace('abc', 'x*', '-')"),
+                         '-a-b-c-')
+        self.assertEqual(
+            self.value("regex_replace('héllo', 'é', 'e')"), 'hello')
+
+    def test_regex_boost_fallback(self):
+        # Back-references, lookahead and replacements referring to groups
+        # aren't supported by RE2
+        self.assertEqual(self.value(r"regex_match('abab', '(ab)\1')"), True)
+        self.assertEqual(self.value(r"regex_match('abac', '(ab)\1')"), False)
+        self.assertEqual(self.value("regex_search('ab', 'a(?=b)')"), True)
+        self.assertEqual(self.value("regex_search('ac', 'a(?=b)')"), False)
+        self.assertEqual(
+            self.value("regex_replace('apple', '(p+)', '[$1]')"), 'a[pp]le')
+
+        # Unicode aware character classes
+        self.assertEqual(
+            self.value(r"regex_match('héllo', '\w+')"), True)
+
+    def test_catastrophic_pattern(self):
+        # Exponential with a backtracking engine; linear with RE2
+        self.assertEqual(
+            self.value("regex_match('" + 'a' * 5000 + "', '(a+)+b')"), False)
+        self.assertEqual(
+            self.value("regex_search('" + 'a' * 5000 + "', '(a|aa)+c')"),
+            False)
+
+    def test_invalid_regex(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            self.value("regex_match('a', '(a')")
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,235 @@
+/** sparse_matrix_storage_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the segments, log and store used to persist sparse.mutable
+    datasets.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+#include "mldb/plugins/sparse_matrix_storage.h"
+#include <fstream>
+#include <map>
+
+using namespace std;
+using namespace MLDB;
+
+namespace fs = boost::filesystem;
+
+
+struct TemporaryDirectory {
+    TemporaryDirectory()
+        : path(fs::unique_path("tmp/sparse_matrix_storage_test-%%%%-%%%%")
+               .string())
+    {
+        fs::create_directories(path);
+    }
+
+    ~TemporaryDirectory()
+    {
+        fs::remove_all(path);
+    }
+
+    std::string path;
+};
+
+SparseMatrixRows randomRows(int numRows, int seed)
+{
+    SparseMatrixRows result;
+    for (int i = 0;  i < numRows;  ++i) {
+        uint64_t row = (i * 7919 + seed * 104729) % 100000;
+        auto & entries = result[row];
+        for (int j = 0;  j <= i % 4;  ++j) {
+            BaseEntry entry(j * 31 + seed, i, i * j, j);
+            if (j % 2)
+                entry.metadata.push_back("metadata " + std::to_string(i));
+            entries.emplace_back(std::move(entry));
+        }
+    }
+    return result;
+}
+
+/// Everything in the matrix, as a sorted map
+typedef std::map<uint64_t, std::vector<std::string> > Contents;
+
+std::string print(const BaseEntry & entry)
+{
+    std::string result = std::to_string(entry.rowcol) + ","
+        + std::to_string(entry.timestamp) + "," + std::to_string(entry.val)
+        + "," + std::to_string(entry.tag);
+    for (auto & m: entry.metadata)
+        result += "," + m;
+    return result;
+}
+
+void addContents(Contents & contents, const SparseMatrixRows & rows)
+{
+    for (auto & r: rows) {
+        for (auto & e: r.second)
+            contents[r.first].push_back(print(e));
+    }
+}
+
+Contents getContents(const SparseMatrixSegment & segment)
+{
+    Contents result;
+    uint64_t lastRow = 0;
+    bool first = true;
+    segment.iterateRows([&] (uint64_t row)
+        {
+            BOOST_CHECK(first || row > lastRow);
+            first = false;
+            lastRow = row;
+            BOOST_CHECK(segment.knownRow(row));
+            segment.iterateRow(row, [&] (const BaseEntry & entry)
+                               {
+                                   result[row].push_back(print(entry));
+                                   return true;
+                               });
+            return true;
+        });
+    BOOST_CHECK_EQUAL(result.size(), segment.rowCount());
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_segment )
+{
+    TemporaryDirectory dir;
+
+    auto rows1 = std::make_shared<SparseMatrixRows>(randomRows(1000, 1));
+    auto rows2 = std::make_shared<SparseMatrixRows>(randomRows(500, 2));
+
+    SparseMatrixSegment::write(dir.path + "/1.seg", nullptr, { rows1 });
+    SparseMatrixSegment segment1(dir.path + "/1.seg");
+
+    Contents expected;
+    addContents(expected, *rows1);
+    BOOST_CHECK(getContents(segment1) == expected);
+    BOOST_CHECK(!segment1.knownRow(100001));
+
+    // A segment built from another one and rows in memory
+    SparseMatrixSegment::write(dir.path + "/2.seg", &segment1, { rows2 });
+    SparseMatrixSegment segment2(dir.path + "/2.seg");
+    addContents(expected, *rows2);
+    BOOST_CHECK(getContents(segment2) == expected);
+
+    // Empty segment
+    SparseMatrixSegment::write(dir.path + "/3.seg", nullptr, {});
+    SparseMatrixSegment segment3(dir.path + "/3.seg");
+    BOOST_CHECK_EQUAL(segment3.rowCount(), 0);
+    BOOST_CHECK(!segment3.knownRow(0));
+
+    {
+        std::ofstream stream(dir.path + "/bad.seg");
+        stream << "not a segment";
+    }
+    BOOST_CHECK_THROW(SparseMatrixSegment(dir.path + "/bad.seg"),
+                      std::exception);
+}
+
+BOOST_AUTO_TEST_CASE( test_log_torn_record )
+{
+    TemporaryDirectory dir;
+    std::string path = dir.path + "/test.wal";
+
+    auto rows1 = randomRows(100, 1);
+    auto rows2 = randomRows(100, 2);
+
+    uint64_t validBytes;
+    {
+        SparseMatrixLog log(path);
+        log.append(SparseMatrixLog::encode({ &rows1, &rows2 }));
+        log.append(SparseMatrixLog::encode({ &rows2, &rows1 }));
+        validBytes = log.size();
+        log.sync();
+    }
+
+    // Simulate a crash in the middle of writing a third record
+    std::string third = SparseMatrixLog::encode({ &rows1, &rows1 });
+    {
+        std::ofstream stream(path, std::ios::app | std::ios::binary);
+        stream.write(third.data(), third.size() / 2);
+    }
+
+    int numRecords = 0;
+    uint64_t replayed = SparseMatrixLog::replay
+        (path, [&] (std::vector<SparseMatrixRows> & matrices)
+         {
+             BOOST_REQUIRE_EQUAL(matrices.size(), 2);
+             Contents expected, found;
+             addContents(expected, numRecords == 0 ? rows1 : rows2);
+             addContents(found, matrices[0]);
+             BOOST_CHECK(found == expected);
+             ++numRecords;
+         });
+
+    BOOST_CHECK_EQUAL(numRecords, 2);
+    BOOST_CHECK_EQUAL(replayed, validBytes);
+}
+
+BOOST_AUTO_TEST_CASE( test_store_recovery )
+{
+    TemporaryDirectory dir;
+
+    auto rows1 = randomRows(300, 1);
+    auto rows2 = randomRows(300, 2);
+    auto rows3 = randomRows(300, 3);
+
+    std::vector<std::shared_ptr<const SparseMatrixSegment> > segments;
+
+    {
+        SparseMatrixStore store(dir.path, { "matrix" });
+        BOOST_CHECK(store.loadSnapshot().empty());
+        store.recover([] (std::vector<SparseMatrixRows> &)
+                      {
+                          BOOST_ERROR("nothing to recover");
+                      });
+
+        store.append(SparseMatrixLog::encode({ &rows1 }));
+        store.append(SparseMatrixLog::encode({ &rows2 }));
+        BOOST_CHECK_GT(store.bytesSinceSnapshot(), 0);
+
+        SparseMatrixStore::MatrixContents contents;
+        contents.rows = { std::make_shared<SparseMatrixRows>(rows1),
+                          std::make_shared<SparseMatrixRows>(rows2) };
+        segments = store.snapshot({ contents });
+        BOOST_CHECK_EQUAL(store.bytesSinceSnapshot(), 0);
+
+        // Only this one needs to be replayed
+        store.append(SparseMatrixLog::encode({ &rows3 }));
+    }
+
+    SparseMatrixStore store(dir.path, { "matrix" });
+    auto loaded = store.loadSnapshot();
+    BOOST_REQUIRE_EQUAL(loaded.size(), 1);
+
+    Contents expected;
+    addContents(expected, rows1);
+    addContents(expected, rows2);
+    BOOST_CHECK(getContents(*loaded[0]) == expected);
+
+    int numRecords = 0;
+    store.recover([&] (std::vector<SparseMatrixRows> & matrices)
+                  {
+                      Contents expected, found;
+                      addContents(expected, rows3);
+                      addContents(found, matrices.at(0));
+                      BOOST_CHECK(found == expected);
+                      ++numRecords;
+                  });
+    BOOST_CHECK_EQUAL(numRecords, 1);
+
+    // The logs before the snapshot have been removed
+    int numLogs = 0, numSegments = 0;
+    for (fs::directory_iterator it(dir.path), end;  it != end;  ++it) {
+        numLogs += it->path().extension() == ".wal";
+        numSegments += it->path().extension() == ".seg";
+    }
+    BOOST_CHECK_EQUAL(numLogs, 2);  // the replayed one and the new one
+    BOOST_CHECK_EQUAL(numSegments, 1);
+}
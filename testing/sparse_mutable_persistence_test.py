@@ -0,0 +1,105 @@
+#
+# sparse_mutable_persistence_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# sparse.mutable datasets with a dataDirectory survive being recreated.
+#
+import os
+import shutil
+import unittest
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class SparseMutablePersistenceTest(MldbUnitTest):  # noqa
+
+    def create(self, directory, **params):
+        params['dataDirectory'] = 'file://' + directory
+        return mldb.create_dataset({
+            'id': 'persisted',
+            'type': 'sparse.mutable',
+            'params': params
+        })
+
+    def recreate(self, directory, **params):
+        mldb.delete('/v1/datasets/persisted')
+        return self.create(directory, **params)
+
+    def query(self):
+        return mldb.query(
+            'SELECT x, y, z FROM persisted ORDER BY rowName() ASC')
+
+    def setUp(self):
+        self.directory = 'tmp/sparse_mutable_persistence_%s' \
+            % self._testMethodName
+        if os.path.exists(self.directory):
+            shutil.rmtree(self.directory)
+
+    def tearDown(self):
+        mldb.delete('/v1/datasets/persisted')
+        shutil.rmtree(self.directory, ignore_errors=True)
+
+    def test_recover_from_log(self):
+        ds = self.create(self.directory)
+        ds.record_row('row1', [['x', 1, 0], ['y', 'hello world', 0]])
+        ds.record_row('row2', [['x', 2, 0], ['z', 'a', 0]])
+        ds.commit()
+        expected = self.query()
+
+        # Nothing has been snapshotted yet, so it all comes from the log
+        self.assertEqual(
+            [f for f in os.listdir(self.directory) if f.endswith('.seg')], [])
+
+        self.recreate(self.directory)
+        self.assertEqual(self.query(), expected)
+
+    def test_recover_uncommitted(self):
+        # Writes are logged before they are applied, even without a commit
+        ds = self.create(self.directory,
+                         consistencyLevel='consistentAfterWrite')
+        ds.record_row('row1', [['x', 1, 0]])
+        ds.record_row('row2', [['x', 2, 0]])
+        expected = self.query()
+
+        self.recreate(self.directory)
+        self.assertEqual(self.query(), expected)
+
+    def test_snapshot_and_log_tail(self):
+        # A tiny snapshotLogBytes makes each commit write a snapshot
+        ds = self.create(self.directory, snapshotLogBytes=1)
+        for i in range(100):
+            ds.record_row('row%d' % i, [['x', i, 0], ['y', 'str%d' % i, 0]])
+        ds.commit()
+        self.assertEqual(
+            len([f for f in os.listdir(self.directory)
+                 if f.endswith('.seg')]), 3)
+
+        # This one is only in the log after the snapshot
+        ds = self.recreate(self.directory)
+        ds.record_row('row100', [['x', 100, 0], ['z', 'last', 0]])
+        expected = self.query()
+        self.assertEqual(len(expected), 102)
+
+        self.recreate(self.directory)
+        self.assertEqual(self.query(), expected)
+        self.assertEqual(
+            mldb.query('SELECT x FROM persisted WHERE rowName() = $r',
+                       r='row42')[1][1], 42)
+
+        # Recording on top of a snapshot
+        ds = self.recreate(self.directory)
+        ds.record_row('row101', [['x', 101, 0]])
+        ds.commit()
+        self.assertEqual(
+            mldb.query('SELECT count(*) FROM persisted')[1][1], 102)
+
+    def test_non_file_url(self):
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.create_dataset({
+                'id': 'persisted',
+                'type': 'sparse.mutable',
+                'params': { 'dataDirectory': 's3://bucket/dir' }
+            })
+        mldb.put('/v1/datasets/persisted', { 'type': 'sparse.mutable' })
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,100 @@
+#
+# tabular_append_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Tabular datasets can be recorded to and committed more than once.
+#
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularAppendTest(MldbUnitTest):  # noqa
+
+    def count(self, dataset, where='true'):
+        return mldb.query('SELECT count(*) FROM {} WHERE {}'
+                          .format(dataset, where))[1][1]
+
+    def test_append(self):
+        ds = mldb.create_dataset({
+            'id' : 'append',
+            'type' : 'tabular',
+            'params' : { 'unknownColumns' : 'add' }
+        })
+        for i in range(100):
+            ds.record_row('row{}'.format(i), [['x', i, 0]])
+        ds.commit()
+        self.assertEqual(self.count('append'), 100)
+
+        # Not visible until committed
+        for i in range(100, 150):
+            ds.record_row('row{}'.format(i), [['x', i, 0], ['y', 'new', 0]])
+        self.assertEqual(self.count('append'), 100)
+        ds.commit()
+
+        self.assertEqual(self.count('append'), 150)
+        self.assertEqual(self.count('append', "y = 'new'"), 50)
+        self.assertEqual(
+            mldb.query("SELECT x FROM append WHERE rowName() = 'row120'")[1][1],
+            120)
+        self.assertEqual(
+            mldb.query("SELECT x FROM append WHERE rowName() = 'row20'")[1][1],
+            20)
+
+        # A commit with nothing new changes nothing
+        ds.commit()
+        self.assertEqual(self.count('append'), 150)
+
+    def test_duplicate_across_commits(self):
+        ds = mldb.create_dataset({
+            'id' : 'append_dup',
+            'type' : 'tabular'
+        })
+        ds.record_row('a', [['x', 1, 0]])
+        ds.commit()
+        ds.record_row('a', [['x', 2, 0]])
+        with self.assertMldbRaises(status_code=400):
+            ds.commit()
+        self.assertEqual(
+            mldb.query("SELECT x FROM append_dup WHERE rowName() = 'a'")[1][1],
+            1)
+
+    def test_failed_commit_keeps_rows(self):
+        ds = mldb.create_dataset({
+            'id' : 'append_failed',
+            'type' : 'tabular'
+        })
+        ds.record_row('a', [['x', 1, 0]])
+        ds.commit()
+
+        ds.record_row('b', [['x', 2, 0]])
+        ds.record_row('a', [['x', 3, 0]])
+        with self.assertMldbRaises(status_code=400):
+            ds.commit()
+
+        # The failed batch is still pending rather than dropped, so the
+        # next commit runs into the same duplicate
+        ds.record_row('c', [['x', 4, 0]])
+        with self.assertMldbRaises(status_code=400):
+            ds.commit()
+        self.assertEqual(self.count('append_failed'), 1)
+
+    def test_many_small_commits(self):
+        # Enough small commits to be compacted in the background; the
+        # contents must be the same whether or not that has happened
+        ds = mldb.create_dataset({
+            'id' : 'append_many',
+            'type' : 'tabular'
+        })
+        for c in range(20):
+            for i in range(10):
+                n = c * 10 + i
+                ds.record_row('row{}'.format(n), [['x', n, 0]])
+            ds.commit()
+            self.assertEqual(self.count('append_many'), (c + 1) * 10)
+
+        self.assertEqual(
+            mldb.query('SELECT sum(x) FROM append_many')[1][1],
+            sum(range(200)))
+        self.assertEqual(self.count('append_many', 'x < 50'), 50)
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -0,0 +1,204 @@
+#
+# tabular_dataset_persistence_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# A tabular dataset with a dataFileUrl is saved on commit and can be loaded
+# back from the file, along with the segments written by later commits.
+#
+
+import tempfile
+import shutil
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularDatasetPersistenceTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.path = os.path.join(cls.tmpdir, 'saved.mldbtbl')
+
+        ds = mldb.create_dataset({
+            'id' : 'saved',
+            'type' : 'tabular',
+            'params' : {
+                'unknownColumns' : 'add',
+                'dataFileUrl' : 'file://' + cls.path
+            }
+        })
+        for i in range(5000):
+            cols = [['int', i, 0],
+                    ['float', i * 0.25, 0],
+                    ['str', 'str {}'.format(i % 13), 0],
+                    ['ts', '2017-01-01T00:00:0{}Z'.format(i % 10), 0]]
+            if i % 3 == 0:
+                cols.append(['sparse', 'x' * (i % 5), 0])
+            ds.record_row('row{}'.format(i), cols)
+        ds.commit()
+
+    query = """
+        SELECT * FROM {}
+        ORDER BY rowName()
+    """
+
+    def test_file_written(self):
+        self.assertTrue(os.path.exists(self.path))
+
+        # The file is written under a temporary name and renamed into place
+        self.assertEqual([f for f in os.listdir(self.tmpdir) if '.tmp-' in f],
+                         [])
+
+    def test_failed_save_fails_commit(self):
+        # The file can't be written while its directory is a plain file
+        blocked = os.path.join(self.tmpdir, 'blocked')
+        with open(blocked, 'w') as f:
+            f.write('not a directory')
+        path = os.path.join(blocked, 'saved.mldbtbl')
+
+        ds = mldb.create_dataset({
+            'id' : 'failed_save',
+            'type' : 'tabular',
+            'params' : {
+                'unknownColumns' : 'add',
+                'dataFileUrl' : 'file://' + path
+            }
+        })
+        ds.record_row('row1', [['x', 1, 0]])
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            ds.commit()
+
+        # Nothing was published, but the rows are kept for the next commit
+        res = mldb.query('SELECT count(*) FROM failed_save')
+        self.assertEqual(res[1][1], 0)
+
+        os.remove(blocked)
+        os.mkdir(blocked)
+        ds.commit()
+
+        mldb.put('/v1/datasets/failed_save_loaded', {
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + path
+            }
+        })
+        self.assertEqual(mldb.query(self.query.format('failed_save_loaded')),
+                         mldb.query(self.query.format('failed_save')))
+
+    def test_load(self):
+        mldb.put('/v1/datasets/loaded', {
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + self.path
+            }
+        })
+
+        self.assertEqual(mldb.query(self.query.format('loaded')),
+                         mldb.query(self.query.format('saved')))
+
+        self.assertEqual(
+            mldb.get('/v1/datasets/loaded').json()['status'],
+            mldb.get('/v1/datasets/saved').json()['status'])
+
+        res = mldb.query("""
+            SELECT sum(int), count(sparse), max(ts) FROM loaded
+        """)
+        self.assertEqual(res[1][1:],
+                         [sum(range(5000)), 1667, '2017-01-01T00:00:09Z'])
+
+    def test_loaded_is_read_only(self):
+        ds = mldb.create_dataset({
+            'id' : 'read_only',
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + self.path
+            }
+        })
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            ds.record_row('new row', [['int', 1, 0]])
+
+    def test_corrupt_file(self):
+        path = os.path.join(self.tmpdir, 'corrupt.mldbtbl')
+        with open(self.path, 'rb') as f:
+            data = f.read()
+        with open(path, 'wb') as f:
+            f.write(data[:len(data) // 2])
+
+        with self.assertRaises(mldb_wrapper.ResponseException):
+            mldb.put('/v1/datasets/corrupt', {
+                'type' : 'tabular',
+                'params' : {
+                    'dataFileUrl' : 'file://' + path
+                }
+            })
+
+    def test_huge_count(self):
+        # A column count far bigger than the file must be rejected before
+        # anything is allocated for it
+        path = os.path.join(self.tmpdir, 'huge_count.mldbtbl')
+        with open(self.path, 'rb') as f:
+            data = f.read()
+        # magic (8 bytes), version (4 bytes), file id and segment number
+        # (8 bytes each) come before the count
+        with open(path, 'wb') as f:
+            f.write(data[:28] + b'\xff' * 8 + data[36:])
+
+        with self.assertRaises(mldb_wrapper.ResponseException) as exc:
+            mldb.put('/v1/datasets/huge_count', {
+                'type' : 'tabular',
+                'params' : {
+                    'dataFileUrl' : 'file://' + path
+                }
+            })
+        self.assertEqual(exc.exception.response.status_code, 400)
+
+    def create_appended(self, name, num_commits):
+        path = os.path.join(self.tmpdir, name + '.mldbtbl')
+        ds = mldb.create_dataset({
+            'id' : name,
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + path
+            }
+        })
+        for c in range(num_commits):
+            for i in range(100):
+                ds.record_row('row{}_{}'.format(c, i), [['x', c * 100 + i, 0]])
+            ds.commit()
+        return path
+
+    def test_commits_write_segments(self):
+        # Each commit writes only its own rows, to a new segment
+        path = self.create_appended('appended', 3)
+        self.assertTrue(os.path.exists(path))
+        self.assertTrue(os.path.exists(path + '.1'))
+        self.assertTrue(os.path.exists(path + '.2'))
+        self.assertFalse(os.path.exists(path + '.3'))
+
+        mldb.put('/v1/datasets/appended_loaded', {
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + path
+            }
+        })
+        self.assertEqual(mldb.query(self.query.format('appended_loaded')),
+                         mldb.query(self.query.format('appended')))
+
+    def test_stale_segment_ignored(self):
+        # A segment left over from another dataset isn't loaded
+        other = self.create_appended('other', 2)
+        path = self.create_appended('fresh', 1)
+        shutil.copy(other + '.1', path + '.1')
+
+        mldb.put('/v1/datasets/fresh_loaded', {
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + path
+            }
+        })
+        res = mldb.query('SELECT count(*) FROM fresh_loaded')
+        self.assertEqual(res[1][1], 100)
+
+if __name__ == '__main__':
+    mldb.run_tests()
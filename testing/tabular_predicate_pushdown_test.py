@@ -0,0 +1,109 @@
+#
+# tabular_predicate_pushdown_test.py
+# This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+#
+# Predicates on the columns of a tabular dataset are evaluated using the
+# zone maps of its chunks, and must give the same rows as a scan.
+#
+
+import tempfile
+import os
+
+mldb = mldb_wrapper.wrap(mldb)  # noqa
+
+class TabularPredicatePushdownTest(MldbUnitTest):  # noqa
+
+    @classmethod
+    def setUpClass(cls):
+        cls.tmpdir = tempfile.mkdtemp()
+        cls.path = os.path.join(cls.tmpdir, 'pushdown.mldbtbl')
+
+        tabular = mldb.create_dataset({
+            'id' : 'tabular',
+            'type' : 'tabular',
+            'params' : {
+                'unknownColumns' : 'add',
+                'dataFileUrl' : 'file://' + cls.path
+            }
+        })
+        reference = mldb.create_dataset({
+            'id' : 'reference',
+            'type' : 'sparse.mutable'
+        })
+
+        countries = ['CA', 'US', 'FR', 'DE', 'JP']
+        for i in range(5000):
+            cols = [['x', i, 0],
+                    ['country', countries[i % 5], 0],
+                    ['ts', '2017-01-{:02d}T00:00:00Z'.format(i % 28 + 1), 0]]
+            if i % 7 != 0:
+                cols.append(['maybe', i % 100, 0])
+            for ds in [tabular, reference]:
+                ds.record_row('row{}'.format(i), cols)
+        tabular.commit()
+        reference.commit()
+
+        mldb.put('/v1/datasets/loaded', {
+            'type' : 'tabular',
+            'params' : {
+                'dataFileUrl' : 'file://' + cls.path
+            }
+        })
+
+    def check_where(self, where, expected_count=None):
+        query = 'SELECT rowName() AS name FROM {} WHERE ' + where \
+            + ' ORDER BY rowName()'
+        expected = mldb.query(query.format('reference'))
+        self.assertEqual(mldb.query(query.format('tabular')), expected)
+        self.assertEqual(mldb.query(query.format('loaded')), expected)
+        if expected_count is not None:
+            self.assertEqual(len(expected) - 1, expected_count)
+
+    def test_equality(self):
+        self.check_where("country = 'CA'", 1000)
+        self.check_where("'CA' = country", 1000)
+        self.check_where("country = 'XX'", 0)
+        self.check_where("x = 1234", 1)
+        self.check_where("x = NULL", 0)
+
+    def test_in(self):
+        self.check_where("country IN ('CA', 'FR')", 2000)
+        self.check_where("country IN ('XX', NULL)", 0)
+        self.check_where("x IN (1, 2, 3, 100000)", 3)
+
+    def test_ranges(self):
+        self.check_where('x > 4990', 9)
+        self.check_where('x >= 4990', 10)
+        self.check_where('x < 10', 10)
+        self.check_where('x <= 10', 11)
+        self.check_where('10 > x', 10)
+        self.check_where('x > 100000', 0)
+        self.check_where("ts > TIMESTAMP '2017-01-27T00:00:00Z'")
+        self.check_where("ts <= TIMESTAMP '2017-01-02T00:00:00Z'")
+
+    def test_nulls(self):
+        self.check_where('maybe IS NULL', 715)
+        self.check_where('maybe IS NOT NULL', 4285)
+        self.check_where('maybe < 10')
+
+    def test_conjunctions(self):
+        self.check_where("x > 1000 AND country = 'CA'", 799)
+        self.check_where("x > 1000 AND x < 2000 AND country IN ('US', 'JP')")
+
+    def test_residual(self):
+        # Only part of the where clause can be pushed down; the rest is
+        # evaluated on the rows that remain
+        self.check_where("country = 'CA' AND x % 3 = 0")
+        self.check_where("x < 100 AND rowName() != 'row5'", 99)
+        self.check_where("country = 'CA' AND x % 3 = 0 OR x = 7")
+
+    def test_pagination(self):
+        query = """
+            SELECT rowName() AS name FROM {} WHERE country = 'DE'
+            ORDER BY rowName() OFFSET 10 LIMIT 20
+        """
+        self.assertEqual(mldb.query(query.format('tabular')),
+                         mldb.query(query.format('reference')))
+
+if __name__ == '__main__':
+    mldb.run_tests()
@@ -292,6 +292,7 @@ $(eval $(call mldb_unit_test,MLDB-1361_join_on_subselect.py))
 $(eval $(call mldb_unit_test,MLDB-1364_dataset_cant_be_overwritten.py))
 $(eval $(call mldb_unit_test,MLDB-1336-builtin-checks.py))
 $(eval $(call mldb_unit_test,MLDB-1433-random-forest.py))
+$(eval $(call mldb_unit_test,randomforest_modes_test.py))
 $(eval $(call mldb_unit_test,MLDB-1430-aggregate-bug.py))
 $(eval $(call mldb_unit_test,MLDB-1428-text-sparse-output.py))
 $(eval $(call mldb_unit_test,MLDB-1452-like-operator.py))
@@ -511,3 +512,21 @@ $(eval $(call mldb_unit_test,MLDB-2181_null_feature_model_test.py))
 $(eval $(call mldb_unit_test,MLDB-2186-empty-array.py))
 $(eval $(call mldb_unit_test,MLDB-2170-csv-excel-formulas.js))
 $(eval $(call mldb_unit_test,MLDB-2168-csv-import-skip-lines.js))
+$(eval $(call mldb_unit_test,hash_join_test.py))
+$(eval $(call test,group_by_table_test,mldb,boost))
+$(eval $(call test,csv_scanner_test,mldb,boost))
+$(eval $(call mldb_unit_test,tabular_dataset_persistence_test.py))
+$(eval $(call mldb_unit_test,function_applier_cache_test.py))
+$(eval $(call test,function_applier_cache_release_test,mldb,boost))
+$(eval $(call mldb_unit_test,function_batch_apply_test.py))
+$(eval $(call mldb_unit_test,embedding_incremental_index_test.py))
+$(eval $(call mldb_unit_test,embedding_hnsw_test.py))
+$(eval $(call mldb_unit_test,query_streaming_test.py))
+$(eval $(call mldb_unit_test,query_arrow_output_test.py))
+$(eval $(call mldb_unit_test,approx_aggregators_test.py))
+$(eval $(call mldb_unit_test,python_worker_pool_test.py))
+$(eval $(call test,sparse_matrix_storage_test,mldb_builtin_plugins,boost))
+$(eval $(call mldb_unit_test,sparse_mutable_persistence_test.py))
+$(eval $(call mldb_unit_test,tabular_predicate_pushdown_test.py))
+$(eval $(call mldb_unit_test,tabular_append_test.py))
+$(eval $(call mldb_unit_test,regex_engine_test.py))
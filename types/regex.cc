@@ -13,6 +13,9 @@
 #include "regex.h"
 #include "mldb/base/exc_assert.h"
 #include "mldb/types/value_description.h"
+#include "mldb/ext/re2/re2/re2.h"
+#include <mutex>
+#include <map>
 
 
 // NOTE: boost::regex is used due to issues with std::regex in GCC 4.6
@@ -191,6 +194,48 @@ suffix() const
 /* REGEX                                                                     */
 /*****************************************************************************/
 
+/** Can the given regex be run by RE2 with the same results as boost?
+
+    RE2 runs in time linear in the length of the input, which protects
+    us against catastrophic backtracking, and is much faster on long
+    strings.  It can't deal with back-references or lookaround, which
+    make it fail to compile, and its \w, \d, \s, \b and [[:alpha:]]
+    classes are ASCII only where boost's are Unicode, so patterns using
+    them stay with boost.
+*/
+static bool re2Compatible(const Utf8String & surface,
+                          std::regex::flag_type flags)
+{
+    auto grammar = flags & (std::regex_constants::ECMAScript
+                            | std::regex_constants::basic
+                            | std::regex_constants::extended
+                            | std::regex_constants::awk
+                            | std::regex_constants::grep
+                            | std::regex_constants::egrep);
+    if (grammar && grammar != std::regex_constants::ECMAScript)
+        return false;
+    if (flags & std::regex_constants::collate)
+        return false;
+
+    const std::string & str = surface.rawString();
+    for (size_t i = 0;  i < str.size();  ++i) {
+        if (str[i] == '\\' && i + 1 < str.size()) {
+            switch (str[++i]) {
+            case 'w': case 'W': case 'd': case 'D':
+            case 's': case 'S': case 'b': case 'B':
+                return false;
+            default:
+                break;
+            }
+        }
+        else if (str.compare(i, 2, "[:") == 0) {
+            return false;
+        }
+    }
+
+    return true;
+}
+
 struct Regex::Impl {
     Impl(const Utf8String & surface,
          std::regex::flag_type syntaxFlags)
@@ -198,6 +243,21 @@ struct Regex::Impl {
     {
         utf8 = boost::make_u32regex(surface.rawData(),
                                     syntaxFlagsToBoost(syntaxFlags));
+
+        if (re2Compatible(surface, syntaxFlags)) {
+            re2::RE2::Options options;
+            options.set_log_errors(false);
+            // boost's . matches a newline, and its ^ and $ match at the
+            // start and end of each line
+            options.set_dot_nl(true);
+            options.set_case_sensitive
+                (!(syntaxFlags & std::regex_constants::icase));
+            options.set_never_capture
+                (!!(syntaxFlags & std::regex_constants::nosubs));
+            fast.reset(new re2::RE2("(?m)" + surface.rawString(), options));
+            if (!fast->ok())
+                fast.reset();
+        }
     }
 
     std::regex::flag_type flags() const
@@ -224,11 +284,62 @@ struct Regex::Impl {
     /// Regex compiled to match UTF-8 data
     boost::u32regex utf8;
 
+    /// Same regex compiled by RE2, used when no match results are needed.
+    /// Null if RE2 can't run it with the same semantics as boost.
+    std::unique_ptr<re2::RE2> fast;
+
     /// Regex compiled to match ASCII data.  Only initialized if the
     /// regex string is pure ASCII.
     //std::unique_ptr<boost::regex> ascii;
 };
 
+namespace {
+
+/** Compiled regexes, shared between all of the Regex objects with the
+    same surface form and flags.  A query compiles the same pattern once
+    per binding, or once per row when the pattern isn't constant, so this
+    avoids paying for the compilation over and over.
+*/
+struct RegexCache {
+    /// Maximum number of entries; the cache is emptied when it fills up
+    static constexpr size_t MAX_ENTRIES = 1024;
+
+    std::shared_ptr<Regex::Impl>
+    get(const Utf8String & surface, std::regex::flag_type flags)
+    {
+        auto key = std::make_pair(surface.rawString(), (int)flags);
+        {
+            std::unique_lock<std::mutex> guard(mutex);
+            auto it = entries.find(key);
+            if (it != entries.end())
+                return it->second;
+        }
+
+        // Compile outside of the lock; a race simply compiles it twice
+        auto result = std::make_shared<Regex::Impl>(surface, flags);
+
+        std::unique_lock<std::mutex> guard(mutex);
+        if (entries.size() >= MAX_ENTRIES)
+            entries.clear();
+        entries.emplace(std::move(key), result);
+        return result;
+    }
+
+    std::mutex mutex;
+    std::map<std::pair<std::string, int>, std::shared_ptr<Regex::Impl> >
+        entries;
+};
+
+// Constructed on first use, as there are Regex objects initialized
+// statically in other files
+RegexCache & getRegexCache()
+{
+    static RegexCache cache;
+    return cache;
+}
+
+} // file scope
+
 Regex::
 Regex() noexcept
 {
@@ -285,7 +396,7 @@ Regex &
 Regex::
 assign(const Utf8String & r, std::regex::flag_type flags)
 {
-    impl.reset(new Impl(r, flags));
+    impl = getRegexCache().get(r, flags);
     return *this;
 }
 
@@ -293,7 +404,7 @@ Regex &
 Regex::
 assign(const std::string & r, std::regex::flag_type flags)
 {
-    impl.reset(new Impl(r, flags));
+    impl = getRegexCache().get(r, flags);
     return *this;
 }
 
@@ -301,7 +412,7 @@ Regex &
 Regex::
 assign(const char * r, std::regex::flag_type flags)
 {
-    impl.reset(new Impl(r, flags));
+    impl = getRegexCache().get(r, flags);
     return *this;
 }
 
@@ -309,7 +420,7 @@ Regex &
 Regex::
 assign(const wchar_t * r, std::regex::flag_type flags)
 {
-    impl.reset(new Impl(r, flags));
+    impl = getRegexCache().get(r, flags);
     return *this;
 }
 
@@ -395,6 +506,17 @@ Utf8String regex_replace(const Utf8String & str,
                          std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+
+    // RE2 uses a different syntax for references to the matched groups
+    // in the replacement, so it's only used for literal replacements
+    const re2::RE2 * fast = regex.impl->fast.get();
+    if (fast && flags == std::regex_constants::match_default
+        && format.rawString().find_first_of("$\\") == std::string::npos) {
+        std::string result = str.rawString();
+        re2::RE2::GlobalReplace(&result, *fast, format.rawString());
+        return Utf8String(std::move(result), false /* check */);
+    }
+
     std::basic_string<int32_t> matchStr(str.begin(), str.end());
     std::basic_string<int32_t> replacementStr(format.begin(), format.end());
 
@@ -409,11 +531,12 @@ bool regex_search(const Utf8String & str,
                   std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+    const re2::RE2 * fast = regex.impl->fast.get();
+    if (fast && flags == std::regex_constants::match_default)
+        return re2::RE2::PartialMatch(str.rawString(), *fast);
+
     return boost::u32regex_search(str.rawString(), regex.impl->utf8,
                                   matchFlagsToBoost(flags));
-    
-    // TODO: optimization for when both str and regex are ASCII only
-    
 }
 
 bool regex_search(const Utf8String & str,
@@ -440,6 +563,10 @@ bool regex_match(const Utf8String & str,
                  std::regex_constants::match_flag_type flags)
 {
     ExcAssert(regex.impl);
+    const re2::RE2 * fast = regex.impl->fast.get();
+    if (fast && flags == std::regex_constants::match_default)
+        return re2::RE2::FullMatch(str.rawString(), *fast);
+
     return boost::u32regex_match(str.rawString(), regex.impl->utf8,
                                  matchFlagsToBoost(flags));
 }
@@ -35,9 +35,10 @@ LIBTYPES_SOURCES := \
 	periodic_utils_value_descriptions.cc
 
 LIBTYPES_LINK := \
-	rt boost_locale boost_regex boost_date_time jsoncpp googleurl cityhash value_description
+	rt boost_locale boost_regex boost_date_time jsoncpp googleurl cityhash value_description re2
 
 $(eval $(call set_compile_option,localdate.cc,-DLIB=\"$(LIB)\"))
+$(eval $(call set_compile_option,regex.cc,-I$(RE2_INCLUDE_PATH)))
 
 ifneq ($(PREMAKE),1)
 $(LIB)/libtypes.so: $(LIB)/date_timezone_spec.csv
@@ -17,6 +17,10 @@
 #include "mldb/vfs/filter_streams.h"
 #include "mldb/vfs/filter_streams_registry.h"
 #include "compressor.h"
+#include "parallel_compressor.h"
+#include "parallel_decompressor.h"
+#include "uri_cache.h"
+#include "mldb/base/thread_pool.h"
 #include <fstream>
 #include <mutex>
 #include <boost/iostreams/filtering_stream.hpp>
@@ -325,10 +329,38 @@ void addCompression(streambuf & buf,
                     boost::iostreams::filtering_ostream & stream,
                     const std::string & resource,
                     const std::string & compression,
-                    int compressionLevel)
+                    int compressionLevel,
+                    int compressionThreads)
 {
     using namespace boost::iostreams;
 
+    if (compressionThreads < 0)
+        compressionThreads = numCpus();
+
+    if (compressionThreads > 1 && compression != "none") {
+        std::string parallelCompression = compression;
+        if (compression == "") {
+            if (ends_with(resource, ".gz") || ends_with(resource, ".gz~"))
+                parallelCompression = "gzip";
+            else if (ends_with(resource, ".lz4")
+                     || ends_with(resource, ".lz4~"))
+                parallelCompression = "lz4";
+            else if (ends_with(resource, ".xz")
+                     || ends_with(resource, ".xz~"))
+                parallelCompression = "xz";
+            else parallelCompression
+                     = Compressor::filenameToCompression(resource);
+        }
+
+        if (ParallelCompressor::supported(parallelCompression)) {
+            stream.push(BoostCompressor
+                        (new ParallelCompressor(parallelCompression,
+                                                compressionLevel,
+                                                compressionThreads)));
+            return;
+        }
+    }
+
     if (compression == "gz" || compression == "gzip"
         || (compression == ""
             && (ends_with(resource, ".gz") || ends_with(resource, ".gz~")))) {
@@ -395,8 +427,14 @@ void addCompression(streambuf & buf,
     it = options.find("compressionLevel");
     if (it != options.end())
         compressionLevel = boost::lexical_cast<int>(it->second);
+
+    int compressionThreads = -1;
+    it = options.find("compressionThreads");
+    if (it != options.end())
+        compressionThreads = boost::lexical_cast<int>(it->second);
     
-    addCompression(buf, stream, resource, compression, compressionLevel);
+    addCompression(buf, stream, resource, compression, compressionLevel,
+                   compressionThreads);
 }
 
 
@@ -760,6 +798,34 @@ operator = (filter_istream && other)
     return *this;
 }
 
+namespace {
+
+/** If the URI has a copy in the local cache (see uri_cache.h), return a
+    handler that reads it through the memory mapped file path.  Otherwise
+    returns a handler with a null buf.
+*/
+UriHandler
+getCachedUriHandler(const std::string & uri,
+                    const std::map<std::string, std::string> & options,
+                    const OnUriHandlerException & onException)
+{
+    FsObjectInfo info;
+    std::string path = getCachedUri(uri, options, info);
+    if (path.empty())
+        return UriHandler();
+
+    auto fileOptions = options;
+    fileOptions["mapped"] = "true";
+    UriHandler result = getUriHandler("file")("file", path, ios::in,
+                                              fileOptions, onException);
+
+    // Report what the remote object is, not the copy
+    result.info = std::make_shared<FsObjectInfo>(std::move(info));
+    return result;
+}
+
+} // file scope
+
 void
 filter_istream::
 open(const std::string & uri,
@@ -779,9 +845,12 @@ open(const std::string & uri,
         }
     };
     auto options = createOptions(mode, compression, -1);
-    UriHandler handler = handlerFactory(scheme, resource, mode,
-                                        options,
-                                        onException);
+    UriHandler handler;
+    if (mode & ios::in)
+        handler = getCachedUriHandler(uri, options, onException);
+    if (!handler.buf)
+        handler = handlerFactory(scheme, resource, mode, options,
+                                 onException);
     
     openFromHandler(handler, resource, options);
 }
@@ -812,7 +881,10 @@ open(const std::string & uri,
             this->deferredExcPtr = excPtr;
         }
     };
-    UriHandler handler = handlerFactory(scheme, resource, ios::in, options, onException);
+    UriHandler handler = getCachedUriHandler(uri, options, onException);
+    if (!handler.buf)
+        handler = handlerFactory(scheme, resource, ios::in, options,
+                                 onException);
     openFromHandler(handler, resource, options);
 }
 
@@ -835,13 +907,19 @@ openFromHandler(const UriHandler & handler,
     if (cmpIt != options.end())
         compression = cmpIt->second;
     
+    int decompressionThreads = -1;
+    auto threadsIt = options.find("decompressionThreads");
+    if (threadsIt != options.end())
+        decompressionThreads = std::stoi(threadsIt->second);
+
     this->handlerOptions = handler.options;
     this->info_ = handler.info;
     if (!this->info_)
         throw MLDB::Exception("Handler for resource '" + resource
                             + "' didn't set info");
     ExcAssert(this->info_);
-    openFromStreambuf(handler.buf, handler.bufOwnership, resource, compression);
+    openFromStreambuf(handler.buf, handler.bufOwnership, resource, compression,
+                      decompressionThreads);
 }
 
 void
@@ -849,7 +927,8 @@ filter_istream::
 openFromStreambuf(std::streambuf * buf,
                   std::shared_ptr<void> bufOwnership,
                   const std::string & resource,
-                  const std::string & compression)
+                  const std::string & compression,
+                  int decompressionThreads)
 {
     // TODO: exception safety for buf
 
@@ -876,6 +955,40 @@ openFromStreambuf(std::streambuf * buf,
                      && (ends_with(resource, ".lz4")
                          || ends_with(resource, ".lz4~"))));
 
+    if (decompressionThreads < 0)
+        decompressionThreads = numCpus();
+
+    if (decompressionThreads > 1) {
+        std::string parallelCompression = compression;
+        if (gzip)
+            parallelCompression = "gzip";
+        else if (lz4)
+            parallelCompression = "lz4";
+        else if (compression == "")
+            parallelCompression = Compressor::filenameToCompression(resource);
+
+        if (parallelDecompressionSupported(parallelCompression)) {
+            // Members are destroyed in reverse order, so the decompressor
+            // goes before the buffer that it reads from
+            struct Owner {
+                std::shared_ptr<void> bufOwnership;
+                std::unique_ptr<std::streambuf> decompressor;
+            };
+            auto owner = std::make_shared<Owner>();
+            owner->bufOwnership = std::move(bufOwnership);
+            owner->decompressor
+                = createParallelDecompressor(buf, parallelCompression,
+                                             decompressionThreads);
+
+            // See MLDB-1140 below
+            this->handlerOptions = UriHandlerOptions();
+            rdbuf(owner->decompressor.get());
+            this->sink = std::move(owner);
+            this->resource = resource;
+            return;
+        }
+    }
+
     if (gzip) new_stream->push(gzip_decompressor());
     else if (bzip2) new_stream->push(bzip2_decompressor());
     else if (lzma) new_stream->push(lzma_decompressor());
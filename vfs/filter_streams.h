@@ -156,6 +156,10 @@ public:
 
         mode = comma separated list of out,append,create
         compression = string (gz, bz2, xz, ...)
+        compressionLevel = level for the compressor
+        compressionThreads = maximum number of threads used to compress
+            gzip, zstd, lz4 and xz output (default one per CPU; 1 compresses
+            on the writing thread)
         resource = string to be used in error messages
     */
     void open(const std::string & uri,
@@ -216,6 +220,9 @@ public:
         - httpAbortOnSlowConnection: For http files, will timeout if the
           connexion is too slow. Refer to http_rest_proxy.cc for the
           specification of slow. (the parameter name is abortOnSlowConnection)
+        - "decompressionThreads": maximum number of threads used to
+          decompress zstd, lz4 and gzip (BGZF) files.  The default is one
+          per CPU; 1 decompresses on the reading thread.
     */
     filter_istream(const std::string & uri,
                    const std::map<std::string, std::string> & options);
@@ -247,10 +254,14 @@ public:
     void open(const Url & uri,
               const std::map<std::string, std::string> & options);
 
+    /** Open from a streambuf, decompressing if necessary.  If
+        decompressionThreads is -1, one thread per CPU is used.
+    */
     void openFromStreambuf(std::streambuf * buf,
                            std::shared_ptr<void> bufOwnership,
                            const std::string & resource = "",
-                           const std::string & compression = "");
+                           const std::string & compression = "",
+                           int decompressionThreads = -1);
 
     void openFromHandler(const UriHandler & handler,
                          const std::string & resource,
@@ -19,6 +19,8 @@
 #include "mldb/arch/endian.h"
 
 #include <boost/iostreams/concepts.hpp>
+#include <boost/iostreams/read.hpp>
+#include <boost/iostreams/write.hpp>
 #include <ios>
 #include <vector>
 #include <cstring>
@@ -121,22 +123,26 @@ struct MLDB_PACKED Header
     {
         Header head;
         lz4::read(src, &head, sizeof(head));
+        head.validate();
+        return head;
+    }
 
-        if (head.magic != MagicConst)
+    /// Throw if this isn't a header that we know how to decompress
+    void validate() const
+    {
+        if (magic != MagicConst)
             throw lz4_error("invalid magic number");
 
-        if (head.version() != 1)
+        if (version() != 1)
             throw lz4_error("unsupported lz4 version");
 
-        if (!head.blockIndependence())
+        if (!blockIndependence())
             throw lz4_error("unsupported option: block dependence");
 
-        checkBlockId(head.blockId());
+        checkBlockId(blockId());
 
-        if (head.checkBits != head.checksumOptions())
+        if (checkBits != checksumOptions())
             throw lz4_error("corrupted options");
-
-        return head;
     }
 
     template<typename Sink>
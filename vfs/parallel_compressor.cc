@@ -0,0 +1,648 @@
+/** parallel_compressor.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Multi-threaded gzip, zstd, lz4 and xz compression.
+*/
+
+#include "mldb/vfs/parallel_compressor.h"
+#include "mldb/vfs/lz4_filter.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/endian.h"
+#include "mldb/ext/zstd/lib/zstd.h"
+#include <zlib.h>
+#include <lzma.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Size of the blocks of input that are compressed by each job
+static constexpr size_t BLOCK_SIZE = 1024 * 1024;
+
+/// Size of the dictionary for deflate
+static constexpr size_t GZIP_WINDOW_SIZE = 32768;
+
+
+/*****************************************************************************/
+/* BLOCK                                                                     */
+/*****************************************************************************/
+
+/** A block of input that is compressed by one job.  The writer compresses
+    it itself if it needs the output before a job has started on it.
+*/
+struct Block {
+    enum State {
+        PENDING,
+        RUNNING,
+        DONE
+    };
+
+    std::atomic<int> state{PENDING};
+    std::string input;
+    size_t inputLength = 0;
+    std::string output;
+    std::exception_ptr exc;
+
+    /// For gzip: end of the previous block, to prime the compressor with
+    std::string dictionary;
+    /// For gzip: is this the last block of the stream?
+    bool last = false;
+    /// For gzip: CRC32 of the input
+    uint32_t crc = 0;
+    /// For xz: size of the compressed block without its padding
+    uint64_t unpaddedSize = 0;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    bool claim()
+    {
+        int expected = PENDING;
+        return state.compare_exchange_strong(expected, RUNNING);
+    }
+
+    void setDone()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        state = DONE;
+        finished.notify_all();
+    }
+
+    void waitUntilDone()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        finished.wait(guard, [&] () { return state == DONE; });
+    }
+};
+
+
+/*****************************************************************************/
+/* FORMAT                                                                    */
+/*****************************************************************************/
+
+struct Format {
+    virtual ~Format()
+    {
+    }
+
+    /// Size of the input blocks
+    virtual size_t blockSize() const
+    {
+        return BLOCK_SIZE;
+    }
+
+    /// Data written before the first block
+    virtual std::string header() const
+    {
+        return std::string();
+    }
+
+    /// Compress the block.  Called on any thread, concurrently.
+    virtual void compress(Block & block) const = 0;
+
+    /// Called on the writing thread for each block, in order, as its
+    /// output is written
+    virtual void written(const Block & block)
+    {
+    }
+
+    /// Data written after the last block
+    virtual std::string trailer() const
+    {
+        return std::string();
+    }
+
+    /** Does the stream need a last block, even if it has no input?
+        anyBlocks tells if any blocks were written before.
+    */
+    virtual bool needsLastBlock(bool anyBlocks) const
+    {
+        return false;
+    }
+
+    /** Length of the end of the previous block's input that is given to
+        the next one as a dictionary.
+    */
+    virtual size_t dictionarySize() const
+    {
+        return 0;
+    }
+};
+
+
+/*****************************************************************************/
+/* GZIP FORMAT                                                               */
+/*****************************************************************************/
+
+struct GzipFormat: public Format {
+
+    GzipFormat(int level)
+        : level(level)
+    {
+    }
+
+    virtual std::string header() const override
+    {
+        // No file name, no modification time, Unix
+        static const char header[10] = {
+            '\x1f', '\x8b', 8, 0, 0, 0, 0, 0, 0, 3 };
+        return std::string(header, 10);
+    }
+
+    virtual void compress(Block & block) const override
+    {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+
+        // Raw deflate; the header and trailer are written separately
+        if (deflateInit2(&stream, level, Z_DEFLATED, -15, 8,
+                         Z_DEFAULT_STRATEGY) != Z_OK)
+            throw Exception("deflateInit2 failed");
+        std::shared_ptr<void> guard(nullptr,
+                                    [&] (void *) { deflateEnd(&stream); });
+
+        if (!block.dictionary.empty()) {
+            deflateSetDictionary(&stream,
+                                 (const Bytef *)block.dictionary.data(),
+                                 block.dictionary.size());
+        }
+
+        block.crc = crc32(0, (const Bytef *)block.input.data(),
+                          block.input.size());
+
+        // The sync flush adds an empty stored block so that the next
+        // block starts on a byte boundary
+        size_t bound = deflateBound(&stream, block.input.size()) + 16;
+        block.output.resize(bound);
+
+        stream.next_in = (Bytef *)block.input.data();
+        stream.avail_in = block.input.size();
+        stream.next_out = (Bytef *)&block.output[0];
+        stream.avail_out = bound;
+
+        int res = deflate(&stream, block.last ? Z_FINISH : Z_SYNC_FLUSH);
+        if (res != (block.last ? Z_STREAM_END : Z_OK)
+            || stream.avail_in != 0 || stream.avail_out == 0)
+            throw Exception("gzip block compression failed");
+
+        block.output.resize(bound - stream.avail_out);
+    }
+
+    virtual size_t dictionarySize() const override
+    {
+        return GZIP_WINDOW_SIZE;
+    }
+
+    virtual bool needsLastBlock(bool anyBlocks) const override
+    {
+        // It finishes the deflate stream
+        return true;
+    }
+
+    virtual void written(const Block & block) override
+    {
+        crc = crc32_combine(crc, block.crc, block.inputLength);
+        length += block.inputLength;
+    }
+
+    virtual std::string trailer() const override
+    {
+        uint32_le trailer[2];
+        trailer[0] = crc;
+        trailer[1] = length;  // modulo 2^32
+        return std::string((const char *)trailer, sizeof(trailer));
+    }
+
+    int level;
+    uint32_t crc = 0;
+    uint64_t length = 0;
+};
+
+
+/*****************************************************************************/
+/* ZSTD FORMAT                                                               */
+/*****************************************************************************/
+
+struct ZstdFormat: public Format {
+
+    ZstdFormat(int level)
+        : level(level)
+    {
+    }
+
+    virtual void compress(Block & block) const override
+    {
+        size_t bound = ZSTD_compressBound(block.input.size());
+        block.output.resize(bound);
+        size_t res = ZSTD_compress(&block.output[0], bound,
+                                   block.input.data(), block.input.size(),
+                                   level);
+        if (ZSTD_isError(res)) {
+            throw Exception("Error compressing zstandard block: %s",
+                            ZSTD_getErrorName(res));
+        }
+        block.output.resize(res);
+    }
+
+    virtual bool needsLastBlock(bool anyBlocks) const override
+    {
+        // An empty file still needs a frame
+        return !anyBlocks;
+    }
+
+    int level;
+};
+
+
+/*****************************************************************************/
+/* LZ4 FORMAT                                                                */
+/*****************************************************************************/
+
+/** Writes the same frame as lz4_compressor, whose blocks are already
+    independent.  Each job compresses several lz4 blocks.
+*/
+struct Lz4Format: public Format {
+
+    Lz4Format(int level)
+        : head(7 /* 4MB blocks */,
+               true /* independent blocks */,
+               false /* block checksum */,
+               false /* stream checksum */)
+    {
+        compressFn = level < 3 ? LZ4_compress : LZ4_compressHC;
+    }
+
+    virtual size_t blockSize() const override
+    {
+        return std::max(BLOCK_SIZE, head.blockSize());
+    }
+
+    virtual std::string header() const override
+    {
+        return std::string((const char *)&head, sizeof(head));
+    }
+
+    virtual void compress(Block & block) const override
+    {
+        const char * p = block.input.data();
+        const char * e = p + block.input.size();
+        std::string compressed(LZ4_compressBound(head.blockSize()), '\0');
+
+        for (; p < e;  p += head.blockSize()) {
+            size_t n = std::min<size_t>(head.blockSize(), e - p);
+            int compressedSize = compressFn(p, &compressed[0], n);
+
+            if (compressedSize > 0) {
+                uint32_le blockHeader;
+                blockHeader = compressedSize;
+                block.output.append((const char *)&blockHeader, 4);
+                block.output.append(compressed.data(), compressedSize);
+            }
+            else {
+                uint32_le blockHeader;
+                blockHeader = n | lz4::NotCompressedMask;
+                block.output.append((const char *)&blockHeader, 4);
+                block.output.append(p, n);
+            }
+        }
+    }
+
+    virtual std::string trailer() const override
+    {
+        return std::string(4, '\0');  // end of stream marker
+    }
+
+    lz4::Header head;
+    int (*compressFn)(const char*, char*, int);
+};
+
+
+/*****************************************************************************/
+/* XZ FORMAT                                                                 */
+/*****************************************************************************/
+
+/** Writes a single xz stream made of independent blocks, as xz -T does,
+    so that it can be read by lzma_decompressor, which doesn't accept
+    concatenated streams.  The index of the blocks is built as they are
+    written.
+*/
+struct XzFormat: public Format {
+
+    XzFormat(int level)
+        : index(lzma_index_init(nullptr), lzma_index_end_default)
+    {
+        if (!index)
+            throw std::bad_alloc();
+        if (lzma_lzma_preset(&options, level == -1 ? 6 : level))
+            throw Exception("Invalid xz compression level %d", level);
+        std::memset(&flags, 0, sizeof(flags));
+        flags.version = 0;
+        flags.check = LZMA_CHECK_CRC32;
+    }
+
+    static void lzma_index_end_default(lzma_index * index)
+    {
+        lzma_index_end(index, nullptr);
+    }
+
+    virtual size_t blockSize() const override
+    {
+        // Independent blocks lose the matches that would cross them, so
+        // they are made as big as the dictionary, within reason
+        return std::min<size_t>(std::max<size_t>(BLOCK_SIZE,
+                                                 options.dict_size),
+                                8 * BLOCK_SIZE);
+    }
+
+    virtual std::string header() const override
+    {
+        char header[LZMA_STREAM_HEADER_SIZE];
+        check(lzma_stream_header_encode(&flags, (uint8_t *)header),
+              "encoding xz stream header");
+        return std::string(header, sizeof(header));
+    }
+
+    virtual void compress(Block & block) const override
+    {
+        lzma_options_lzma blockOptions = options;
+        lzma_filter filters[2] = {
+            { LZMA_FILTER_LZMA2, &blockOptions },
+            { LZMA_VLI_UNKNOWN, nullptr }
+        };
+
+        lzma_block header;
+        std::memset(&header, 0, sizeof(header));
+        header.version = 0;
+        header.check = flags.check;
+        header.filters = filters;
+
+        size_t bound = lzma_block_buffer_bound(block.input.size());
+        block.output.resize(bound);
+        size_t pos = 0;
+        check(lzma_block_buffer_encode(&header, nullptr,
+                                       (const uint8_t *)block.input.data(),
+                                       block.input.size(),
+                                       (uint8_t *)&block.output[0],
+                                       &pos, bound),
+              "compressing xz block");
+        block.output.resize(pos);
+        block.unpaddedSize = lzma_block_unpadded_size(&header);
+    }
+
+    virtual void written(const Block & block) override
+    {
+        check(lzma_index_append(index.get(), nullptr, block.unpaddedSize,
+                                block.inputLength),
+              "adding block to xz index");
+    }
+
+    virtual std::string trailer() const override
+    {
+        size_t indexSize = lzma_index_size(index.get());
+        std::string result(indexSize + LZMA_STREAM_HEADER_SIZE, '\0');
+        size_t pos = 0;
+        check(lzma_index_buffer_encode(index.get(), (uint8_t *)&result[0],
+                                       &pos, indexSize),
+              "encoding xz index");
+
+        lzma_stream_flags footer = flags;
+        footer.backward_size = indexSize;
+        check(lzma_stream_footer_encode(&footer,
+                                        (uint8_t *)&result[indexSize]),
+              "encoding xz stream footer");
+        return result;
+    }
+
+    static void check(lzma_ret res, const char * what)
+    {
+        if (res == LZMA_MEM_ERROR)
+            throw std::bad_alloc();
+        if (res != LZMA_OK)
+            throw Exception("Error %s: lzma error %d", what, (int)res);
+    }
+
+    lzma_options_lzma options;
+    lzma_stream_flags flags;
+    std::unique_ptr<lzma_index, void (*) (lzma_index *)> index;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+struct ParallelCompressor::Itl {
+
+    Itl(std::shared_ptr<Format> format, int numThreads)
+        : format(std::move(format)),
+          maxInFlight(2 * std::max(numThreads, 1))
+    {
+    }
+
+    ~Itl()
+    {
+        // Don't compress what will never be written
+        for (auto & block: inFlight) {
+            if (block->claim())
+                block->setDone();
+        }
+    }
+
+    std::shared_ptr<Format> format;
+    size_t maxInFlight;
+    std::string current;
+    std::string dictionary;
+    std::deque<std::shared_ptr<Block> > inFlight;
+    bool headerWritten = false;
+    bool anyBlocks = false;
+
+    static void run(const Format & format, Block & block) noexcept
+    {
+        try {
+            format.compress(block);
+        } catch (...) {
+            block.exc = std::current_exception();
+        }
+        block.input = std::string();
+        block.dictionary = std::string();
+        block.setDone();
+    }
+
+    /// Submit the current input as a block
+    void submit(bool last)
+    {
+        auto block = std::make_shared<Block>();
+        block->inputLength = current.size();
+        block->last = last;
+        size_t dictionarySize = format->dictionarySize();
+        if (dictionarySize) {
+            block->dictionary = dictionary;
+            dictionary += current;
+            if (dictionary.size() > dictionarySize)
+                dictionary.erase(0, dictionary.size() - dictionarySize);
+        }
+        block->input = std::move(current);
+        current = std::string();
+
+        inFlight.push_back(block);
+        anyBlocks = true;
+
+        auto format = this->format;
+        ThreadPool::instance().add([=] () noexcept
+            {
+                if (block->claim())
+                    run(*format, *block);
+            });
+    }
+
+    size_t writeHeader(const OnData & onData)
+    {
+        if (headerWritten)
+            return 0;
+        headerWritten = true;
+        std::string header = format->header();
+        if (!header.empty())
+            onData(header.data(), header.size());
+        return header.size();
+    }
+
+    /** Write out the finished blocks at the front, and then the others
+        (waiting for them if necessary) until there are at most maxBlocks
+        left in flight.
+    */
+    size_t drain(const OnData & onData, size_t maxBlocks)
+    {
+        size_t result = writeHeader(onData);
+
+        while (!inFlight.empty()) {
+            auto & block = *inFlight.front();
+            if (inFlight.size() > maxBlocks) {
+                if (block.claim())
+                    run(*format, block);
+                else block.waitUntilDone();
+            }
+            else if (block.state != Block::DONE)
+                break;
+
+            if (block.exc)
+                std::rethrow_exception(block.exc);
+
+            if (!block.output.empty())
+                onData(block.output.data(), block.output.size());
+            result += block.output.size();
+            format->written(block);
+            inFlight.pop_front();
+        }
+
+        return result;
+    }
+
+    size_t compress(const char * data, size_t len, const OnData & onData)
+    {
+        size_t blockSize = format->blockSize();
+        while (len > 0) {
+            size_t n = std::min(len, blockSize - current.size());
+            if (current.capacity() < blockSize)
+                current.reserve(blockSize);
+            current.append(data, n);
+            data += n;
+            len -= n;
+            if (current.size() == blockSize)
+                submit(false /* last */);
+        }
+
+        return drain(onData, maxInFlight);
+    }
+
+    size_t flush(FlushLevel flushLevel, const OnData & onData)
+    {
+        if (flushLevel == FLUSH_NONE)
+            return drain(onData, maxInFlight);
+        if (!current.empty())
+            submit(false /* last */);
+        return drain(onData, 0);
+    }
+
+    size_t finish(const OnData & onData)
+    {
+        if (!current.empty() || format->needsLastBlock(anyBlocks))
+            submit(true /* last */);
+
+        size_t result = drain(onData, 0);
+        std::string trailer = format->trailer();
+        if (!trailer.empty())
+            onData(trailer.data(), trailer.size());
+        return result + trailer.size();
+    }
+};
+
+ParallelCompressor::
+ParallelCompressor(const std::string & compression, int level,
+                   int numThreads)
+{
+    std::shared_ptr<Format> format;
+    if (compression == "gz" || compression == "gzip")
+        format = std::make_shared<GzipFormat>(level);
+    else if (compression == "zst" || compression == "zstd")
+        format = std::make_shared<ZstdFormat>(level);
+    else if (compression == "lz4")
+        format = std::make_shared<Lz4Format>(level);
+    else if (compression == "xz" || compression == "lzma")
+        format = std::make_shared<XzFormat>(level);
+    else throw Exception("Compression '" + compression
+                         + "' can't be done in parallel");
+
+    itl.reset(new Itl(std::move(format), numThreads));
+}
+
+ParallelCompressor::
+~ParallelCompressor()
+{
+}
+
+size_t
+ParallelCompressor::
+compress(const char * data, size_t len, const OnData & onData)
+{
+    return itl->compress(data, len, onData);
+}
+
+size_t
+ParallelCompressor::
+flush(FlushLevel flushLevel, const OnData & onData)
+{
+    return itl->flush(flushLevel, onData);
+}
+
+size_t
+ParallelCompressor::
+finish(const OnData & onData)
+{
+    return itl->finish(onData);
+}
+
+bool
+ParallelCompressor::
+supported(const std::string & compression)
+{
+    return compression == "gz" || compression == "gzip"
+        || compression == "zst" || compression == "zstd"
+        || compression == "lz4"
+        || compression == "xz" || compression == "lzma";
+}
+
+} // namespace MLDB
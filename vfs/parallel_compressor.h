@@ -0,0 +1,66 @@
+/** parallel_compressor.h                                         -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Compressor that compresses blocks of its input on multiple threads.
+*/
+
+#pragma once
+
+#include "mldb/vfs/compressor.h"
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL COMPRESSOR                                                       */
+/*****************************************************************************/
+
+/** Compressor that splits its input into blocks, compresses them on the
+    global thread pool and writes them out in order.  The output can be
+    read by the standard tools:
+
+    - gzip: a single member, in which each block is a run of deflate
+      blocks ending on a byte boundary, primed with the last 32k of the
+      previous block as a dictionary (as pigz does);
+    - zstd: one frame per block;
+    - lz4: a single frame of independent blocks, exactly as written by
+      lz4_compressor;
+    - xz: a single stream of independent blocks with an index, like the
+      output of xz -T.
+
+    Up to 2 * numThreads blocks are in flight at once; compress() waits for
+    the oldest one to be written when there are more.
+*/
+struct ParallelCompressor: public Compressor {
+
+    ParallelCompressor(const std::string & compression, int level,
+                       int numThreads);
+
+    virtual ~ParallelCompressor();
+
+    virtual size_t compress(const char * data, size_t len,
+                            const OnData & onData) override;
+
+    /** Any flush level other than FLUSH_NONE compresses and writes
+        everything written so far.
+    */
+    virtual size_t flush(FlushLevel flushLevel,
+                         const OnData & onData) override;
+
+    virtual size_t finish(const OnData & onData) override;
+
+    /** Return true if the given compression (as returned by
+        filenameToCompression(), or "gz" / "lz4" / "xz") can be compressed in
+        parallel.
+    */
+    static bool supported(const std::string & compression);
+
+private:
+    struct Itl;
+    std::unique_ptr<Itl> itl;
+};
+
+} // namespace MLDB
@@ -0,0 +1,821 @@
+/** parallel_decompressor.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Multi-threaded decompression of zstd, lz4 and gzip (BGZF) streams.
+*/
+
+#include "mldb/vfs/parallel_decompressor.h"
+#include "mldb/vfs/lz4_filter.h"
+#include "mldb/base/thread_pool.h"
+#include "mldb/base/exc_assert.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/endian.h"
+#include "mldb/ext/zstd/lib/zstd.h"
+#include <zlib.h>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <deque>
+#include <cstring>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// We group the independent pieces of the input into chunks of about this
+/// much compressed data, which is what is given to each job
+static constexpr size_t CHUNK_SIZE = 1024 * 1024;
+
+/// Amount of data that we read from the source at once
+static constexpr size_t READ_SIZE = 1024 * 1024;
+
+/// zstd frames longer than this are decompressed sequentially, so that we
+/// don't need to hold huge frames in memory (the zstd command line tool
+/// writes a single frame for the whole file)
+static constexpr size_t MAX_ZSTD_FRAME_SIZE = 16 * CHUNK_SIZE;
+
+template<typename T>
+T loadLittleEndian(const char * p)
+{
+    LittleEndian<T> result;
+    std::memcpy(&result, p, sizeof(result));
+    return result;
+}
+
+
+/*****************************************************************************/
+/* COMPRESSED INPUT                                                          */
+/*****************************************************************************/
+
+/** Buffers the compressed data from the source streambuf, so that the
+    formats can look ahead to find where the next piece ends.
+*/
+struct CompressedInput {
+    CompressedInput(std::streambuf * source)
+        : source(source)
+    {
+    }
+
+    std::streambuf * source;
+    std::string buf;
+    size_t pos = 0;
+    bool eof = false;
+
+    size_t available() const { return buf.size() - pos; }
+
+    const char * data() const { return buf.data() + pos; }
+
+    void skip(size_t n)
+    {
+        ExcAssertLessEqual(n, available());
+        pos += n;
+    }
+
+    /** Make sure that at least n bytes are available.  Returns false if
+        the source finishes before there are.  Note that this may move the
+        data, so data() must be called again afterwards.
+    */
+    bool ensure(size_t n)
+    {
+        while (available() < n && !eof) {
+            if (pos > buf.size() / 2) {
+                buf.erase(0, pos);
+                pos = 0;
+            }
+            size_t toRead = std::max(n - available(), READ_SIZE);
+            size_t oldSize = buf.size();
+            buf.resize(oldSize + toRead);
+            std::streamsize numRead = source->sgetn(&buf[oldSize], toRead);
+            if (numRead <= 0) {
+                eof = true;
+                numRead = 0;
+            }
+            buf.resize(oldSize + numRead);
+        }
+        return available() >= n;
+    }
+};
+
+
+/*****************************************************************************/
+/* CHUNK                                                                     */
+/*****************************************************************************/
+
+/** A piece of the input that is decompressed in one go.  Either it's
+    PENDING, in which case input needs to be decompressed (on the thread
+    pool or by the reader if it gets there first), or it's already DONE.
+*/
+struct Chunk {
+    enum State {
+        PENDING,
+        RUNNING,
+        DONE
+    };
+
+    Chunk(State state = PENDING)
+        : state(state)
+    {
+    }
+
+    std::atomic<int> state;
+    std::string input;
+    std::string output;
+    std::exception_ptr exc;
+
+    /// For lz4: this chunk marks the end of the frame and holds its
+    /// checksum, if it has one
+    bool frameEnd = false;
+    bool hasChecksum = false;
+    uint32_t checksum = 0;
+
+    std::mutex mutex;
+    std::condition_variable finished;
+
+    /// Take over decompression of this chunk.  Only one thread will
+    /// succeed.
+    bool claim()
+    {
+        int expected = PENDING;
+        return state.compare_exchange_strong(expected, RUNNING);
+    }
+
+    void setDone()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        state = DONE;
+        finished.notify_all();
+    }
+
+    void waitUntilDone()
+    {
+        std::unique_lock<std::mutex> guard(mutex);
+        finished.wait(guard, [&] () { return state == DONE; });
+    }
+};
+
+
+/*****************************************************************************/
+/* FORMAT                                                                    */
+/*****************************************************************************/
+
+/** Knows how to split a compressed format into chunks and decompress
+    them.
+*/
+struct Format {
+    virtual ~Format()
+    {
+    }
+
+    /** Return the next chunk of the input, or null at the end.  Called on
+        the reading thread only.
+    */
+    virtual std::shared_ptr<Chunk> next(CompressedInput & input) = 0;
+
+    /** Decompress the input of a chunk, appending to output.  Called on
+        any thread, concurrently with the other methods.
+    */
+    virtual void decompress(const std::string & input,
+                            std::string & output) const = 0;
+
+    /** Called on the reading thread for each chunk, in order, as its
+        output is returned.
+    */
+    virtual void deliver(const Chunk & chunk)
+    {
+    }
+};
+
+
+/*****************************************************************************/
+/* LZ4 FORMAT                                                                */
+/*****************************************************************************/
+
+/** Splits an lz4 frame into blocks.  Only a single frame with independent
+    blocks is supported, which is the same as lz4_decompressor.
+*/
+struct Lz4Format: public Format {
+
+    ~Lz4Format()
+    {
+        if (streamChecksumState)
+            XXH32_freeState(streamChecksumState);
+    }
+
+    virtual std::shared_ptr<Chunk> next(CompressedInput & input) override
+    {
+        if (done)
+            return nullptr;
+
+        if (!head) {
+            if (!input.ensure(sizeof(head)))
+                throw lz4_error("premature end of stream");
+            std::memcpy(&head, input.data(), sizeof(head));
+            head.validate();
+            input.skip(sizeof(head));
+
+            if (head.streamChecksum()) {
+                streamChecksumState = XXH32_createState();
+                if (XXH32_reset(streamChecksumState, lz4::ChecksumSeed)
+                    != XXH_OK) {
+                    throw Exception("Error with XXhash checksum initialization");
+                }
+            }
+        }
+
+        auto chunk = std::make_shared<Chunk>();
+
+        while (chunk->input.size() < CHUNK_SIZE) {
+            if (!input.ensure(4))
+                throw lz4_error("premature end of stream");
+            uint32_t blockHeader = loadLittleEndian<uint32_t>(input.data());
+
+            if (blockHeader == 0) {
+                // EOS marker; return what we have before it
+                if (!chunk->input.empty())
+                    return chunk;
+
+                input.skip(4);
+                chunk->state = Chunk::DONE;
+                chunk->frameEnd = true;
+                if (head.streamChecksum()) {
+                    if (!input.ensure(4))
+                        throw lz4_error("premature end of stream");
+                    chunk->hasChecksum = true;
+                    chunk->checksum
+                        = loadLittleEndian<uint32_t>(input.data());
+                    input.skip(4);
+                }
+                done = true;
+                return chunk;
+            }
+
+            size_t blockLength
+                = 4 + (blockHeader & ~lz4::NotCompressedMask)
+                + (head.blockChecksum() ? 4 : 0);
+            if (!input.ensure(blockLength))
+                throw lz4_error("premature end of stream");
+            chunk->input.append(input.data(), blockLength);
+            input.skip(blockLength);
+        }
+
+        return chunk;
+    }
+
+    virtual void decompress(const std::string & input,
+                            std::string & output) const override
+    {
+        const char * p = input.data();
+        const char * e = p + input.size();
+
+        while (p < e) {
+            uint32_t blockHeader = loadLittleEndian<uint32_t>(p);
+            p += 4;
+            bool notCompressed = blockHeader & lz4::NotCompressedMask;
+            size_t compressedSize = blockHeader & ~lz4::NotCompressedMask;
+
+            if (head.blockChecksum()) {
+                uint32_t expected
+                    = loadLittleEndian<uint32_t>(p + compressedSize);
+                if (XXH32(p, compressedSize, lz4::ChecksumSeed) != expected)
+                    throw lz4_error("invalid checksum");
+            }
+
+            if (notCompressed) {
+                output.append(p, compressedSize);
+            }
+            else {
+                size_t oldSize = output.size();
+                output.resize(oldSize + head.blockSize());
+                int decompressed
+                    = LZ4_decompress_safe(p, &output[oldSize],
+                                          compressedSize, head.blockSize());
+                if (decompressed < 0)
+                    throw lz4_error("malformed lz4 stream");
+                output.resize(oldSize + decompressed);
+            }
+
+            p += compressedSize + (head.blockChecksum() ? 4 : 0);
+        }
+    }
+
+    virtual void deliver(const Chunk & chunk) override
+    {
+        if (!head.streamChecksum())
+            return;
+        if (chunk.frameEnd) {
+            if (XXH32_digest(streamChecksumState) != chunk.checksum)
+                throw lz4_error("invalid checksum");
+        }
+        else {
+            XXH32_update(streamChecksumState,
+                         chunk.output.data(), chunk.output.size());
+        }
+    }
+
+    // Set before the first chunk is created and never modified afterwards,
+    // so it's safe to read from decompress()
+    lz4::Header head;
+    bool done = false;
+    XXH32_state_t * streamChecksumState = nullptr;
+};
+
+
+/*****************************************************************************/
+/* ZSTD FORMAT                                                               */
+/*****************************************************************************/
+
+struct ZstdDStreamDeleter {
+    void operator () (ZSTD_DStream * stream) const
+    {
+        ZSTD_freeDStream(stream);
+    }
+};
+
+typedef std::unique_ptr<ZSTD_DStream, ZstdDStreamDeleter> ZstdDStreamPtr;
+
+/** Splits a zstd stream into frames.  The length of each frame is found
+    by walking the block headers.
+*/
+struct ZstdFormat: public Format {
+
+    static constexpr uint32_t SKIPPABLE_MAGIC = 0x184D2A50;
+    static constexpr uint32_t SKIPPABLE_MASK = 0xFFFFFFF0;
+
+    virtual std::shared_ptr<Chunk> next(CompressedInput & input) override
+    {
+        if (sequential)
+            return nextSequential(input);
+
+        auto chunk = std::make_shared<Chunk>();
+
+        while (chunk->input.size() < CHUNK_SIZE) {
+            if (!input.ensure(4)) {
+                if (input.available())
+                    throw Exception("Truncated zstandard stream");
+                break;
+            }
+
+            uint32_t magic = loadLittleEndian<uint32_t>(input.data());
+            if ((magic & SKIPPABLE_MASK) == SKIPPABLE_MAGIC) {
+                if (!input.ensure(8))
+                    throw Exception("Truncated zstandard stream");
+                size_t length
+                    = 8 + loadLittleEndian<uint32_t>(input.data() + 4);
+                if (!input.ensure(length))
+                    throw Exception("Truncated zstandard stream");
+                input.skip(length);
+                continue;
+            }
+
+            size_t length = 0;
+            if (magic == ZSTD_MAGICNUMBER)
+                length = frameLength(input);
+
+            if (length == 0) {
+                // Too long or not a format we can walk (eg, a legacy
+                // frame); let the zstd library deal with it
+                if (!chunk->input.empty())
+                    return chunk;
+                startSequential();
+                return nextSequential(input);
+            }
+
+            chunk->input.append(input.data(), length);
+            input.skip(length);
+        }
+
+        if (chunk->input.empty())
+            return nullptr;
+        return chunk;
+    }
+
+    /** Return the length of the frame at the start of the input, or zero
+        if it's longer than MAX_ZSTD_FRAME_SIZE.
+    */
+    static size_t frameLength(CompressedInput & input)
+    {
+        if (!input.ensure(5))
+            throw Exception("Truncated zstandard stream");
+
+        uint8_t descriptor = input.data()[4];
+        int contentSizeFlag = descriptor >> 6;
+        bool singleSegment = (descriptor >> 5) & 1;
+        bool hasChecksum = (descriptor >> 2) & 1;
+        int dictionaryIdFlag = descriptor & 3;
+
+        static const int dictionaryIdSizes[4] = { 0, 1, 2, 4 };
+        static const int contentSizeSizes[4] = { 0, 2, 4, 8 };
+
+        size_t offset = 5 + !singleSegment
+            + dictionaryIdSizes[dictionaryIdFlag]
+            + contentSizeSizes[contentSizeFlag]
+            + (singleSegment && contentSizeFlag == 0);
+
+        for (;;) {
+            if (offset > MAX_ZSTD_FRAME_SIZE)
+                return 0;
+            if (!input.ensure(offset + 3))
+                throw Exception("Truncated zstandard stream");
+            const unsigned char * p
+                = (const unsigned char *)input.data() + offset;
+            uint32_t blockHeader = p[0] | (p[1] << 8) | (p[2] << 16);
+            bool lastBlock = blockHeader & 1;
+            int blockType = (blockHeader >> 1) & 3;
+            size_t blockSize = blockHeader >> 3;
+
+            offset += 3 + (blockType == 1 /* RLE */ ? 1 : blockSize);
+            if (lastBlock)
+                break;
+        }
+
+        offset += hasChecksum ? 4 : 0;
+        if (offset > MAX_ZSTD_FRAME_SIZE)
+            return 0;
+        if (!input.ensure(offset))
+            throw Exception("Truncated zstandard stream");
+        return offset;
+    }
+
+    virtual void decompress(const std::string & input,
+                            std::string & output) const override
+    {
+        ZstdDStreamPtr stream(ZSTD_createDStream());
+        ZSTD_initDStream(stream.get());
+
+        size_t outSize = ZSTD_DStreamOutSize();
+        ZSTD_inBuffer inBuf{input.data(), input.size(), 0};
+
+        while (inBuf.pos < inBuf.size) {
+            size_t oldSize = output.size();
+            output.resize(oldSize + outSize);
+            ZSTD_outBuffer outBuf{&output[oldSize], outSize, 0};
+            size_t res = ZSTD_decompressStream(stream.get(), &outBuf, &inBuf);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error decompressing zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+            output.resize(oldSize + outBuf.pos);
+
+            // End of a frame; the next one needs a fresh start
+            if (res == 0 && inBuf.pos < inBuf.size)
+                ZSTD_initDStream(stream.get());
+        }
+    }
+
+    void startSequential()
+    {
+        if (!stream)
+            stream.reset(ZSTD_createDStream());
+        ZSTD_initDStream(stream.get());
+        sequential = true;
+    }
+
+    /** Decompress the next part of the current frame on this thread. */
+    std::shared_ptr<Chunk> nextSequential(CompressedInput & input)
+    {
+        auto chunk = std::make_shared<Chunk>(Chunk::DONE);
+        std::string & output = chunk->output;
+        size_t outSize = ZSTD_DStreamOutSize();
+
+        while (output.size() < CHUNK_SIZE) {
+            if (!input.available() && !input.ensure(1))
+                throw Exception("Truncated zstandard stream");
+
+            ZSTD_inBuffer inBuf{input.data(), input.available(), 0};
+            size_t oldSize = output.size();
+            output.resize(oldSize + outSize);
+            ZSTD_outBuffer outBuf{&output[oldSize], outSize, 0};
+            size_t res = ZSTD_decompressStream(stream.get(), &outBuf, &inBuf);
+            if (ZSTD_isError(res)) {
+                throw Exception("Error decompressing zstandard stream: %s",
+                                ZSTD_getErrorName(res));
+            }
+            output.resize(oldSize + outBuf.pos);
+            input.skip(inBuf.pos);
+
+            if (res == 0) {
+                // End of the frame; go back to splitting
+                sequential = false;
+                break;
+            }
+        }
+
+        return chunk;
+    }
+
+    bool sequential = false;
+    ZstdDStreamPtr stream;
+};
+
+
+/*****************************************************************************/
+/* GZIP FORMAT                                                               */
+/*****************************************************************************/
+
+/** Splits a gzip stream into its members.  Members from BGZF files have
+    their length in an extra field of the header, and so can be split off
+    without decompressing them.  Others are decompressed sequentially.
+*/
+struct GzipFormat: public Format {
+
+    GzipFormat()
+    {
+        std::memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+            throw Exception("Couldn't initialize zlib");
+    }
+
+    ~GzipFormat()
+    {
+        inflateEnd(&stream);
+    }
+
+    virtual std::shared_ptr<Chunk> next(CompressedInput & input) override
+    {
+        if (sequential)
+            return nextSequential(input);
+
+        auto chunk = std::make_shared<Chunk>();
+
+        while (chunk->input.size() < CHUNK_SIZE) {
+            // The header is at most 12 + 65535 bytes long
+            if (!input.ensure(1))
+                break;
+            input.ensure(12 + 65535);
+
+            size_t length
+                = bgzfMemberLength(input.data(), input.available());
+            if (length == 0) {
+                if (!chunk->input.empty())
+                    return chunk;
+                inflateReset(&stream);
+                sequential = true;
+                return nextSequential(input);
+            }
+
+            if (!input.ensure(length))
+                throw Exception("Truncated gzip stream");
+            chunk->input.append(input.data(), length);
+            input.skip(length);
+        }
+
+        if (chunk->input.empty())
+            return nullptr;
+        return chunk;
+    }
+
+    /** Return the length of the BGZF member that starts at data, or zero
+        if it's not a BGZF member (or its header is longer than length).
+    */
+    static size_t bgzfMemberLength(const char * data, size_t length)
+    {
+        const unsigned char * p = (const unsigned char *)data;
+
+        // Fixed header, then the length of the extra field
+        if (length < 12 || p[0] != 0x1f || p[1] != 0x8b
+            || p[2] != 8 /* deflate */ || !(p[3] & 4 /* FEXTRA */))
+            return 0;
+
+        size_t extraEnd = 12 + (p[10] | (p[11] << 8));
+        if (length < extraEnd)
+            return 0;
+
+        // Look for the BC subfield, which holds the member length - 1
+        for (size_t i = 12;  i + 4 <= extraEnd;) {
+            size_t fieldLength = p[i + 2] | (p[i + 3] << 8);
+            if (p[i] == 'B' && p[i + 1] == 'C' && fieldLength == 2
+                && i + 6 <= extraEnd) {
+                return (p[i + 4] | (p[i + 5] << 8)) + 1;
+            }
+            i += 4 + fieldLength;
+        }
+
+        return 0;
+    }
+
+    virtual void decompress(const std::string & input,
+                            std::string & output) const override
+    {
+        z_stream stream;
+        std::memset(&stream, 0, sizeof(stream));
+        if (inflateInit2(&stream, 16 + MAX_WBITS) != Z_OK)
+            throw Exception("Couldn't initialize zlib");
+        std::shared_ptr<void> guard(nullptr,
+                                    [&] (void *) { inflateEnd(&stream); });
+
+        const char * p = input.data();
+        const char * e = p + input.size();
+        char dummy;
+
+        while (p < e) {
+            size_t length = bgzfMemberLength(p, e - p);
+            ExcAssertGreater(length, 0);
+
+            // The uncompressed length is in the last four bytes
+            size_t outputLength = loadLittleEndian<uint32_t>(p + length - 4);
+            size_t oldSize = output.size();
+            output.resize(oldSize + outputLength);
+
+            inflateReset(&stream);
+            stream.next_in = (Bytef *)p;
+            stream.avail_in = length;
+            stream.next_out
+                = (Bytef *)(outputLength ? &output[oldSize] : &dummy);
+            stream.avail_out = outputLength;
+
+            int res = inflate(&stream, Z_FINISH);
+            if (res != Z_STREAM_END || stream.avail_out != 0
+                || stream.avail_in != 0) {
+                throw Exception("Error decompressing gzip stream: %s",
+                                stream.msg ? stream.msg : "corrupt member");
+            }
+
+            p += length;
+        }
+    }
+
+    /** Decompress the next part of the current member on this thread. */
+    std::shared_ptr<Chunk> nextSequential(CompressedInput & input)
+    {
+        auto chunk = std::make_shared<Chunk>(Chunk::DONE);
+        std::string & output = chunk->output;
+        static constexpr size_t OUT_SIZE = 256 * 1024;
+
+        while (output.size() < CHUNK_SIZE) {
+            if (!input.available() && !input.ensure(1))
+                throw Exception("Truncated gzip stream");
+
+            size_t inputLength
+                = std::min<size_t>(input.available(), 1U << 30);
+            size_t oldSize = output.size();
+            output.resize(oldSize + OUT_SIZE);
+
+            stream.next_in = (Bytef *)input.data();
+            stream.avail_in = inputLength;
+            stream.next_out = (Bytef *)&output[oldSize];
+            stream.avail_out = OUT_SIZE;
+
+            int res = inflate(&stream, Z_NO_FLUSH);
+            if (res != Z_OK && res != Z_STREAM_END) {
+                throw Exception("Error decompressing gzip stream: %s",
+                                stream.msg ? stream.msg : zError(res));
+            }
+
+            output.resize(oldSize + OUT_SIZE - stream.avail_out);
+            input.skip(inputLength - stream.avail_in);
+
+            if (res == Z_STREAM_END) {
+                // End of the member; the next one may be BGZF
+                sequential = false;
+                break;
+            }
+        }
+
+        return chunk;
+    }
+
+    bool sequential = false;
+    z_stream stream;
+};
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR STREAMBUF                                           */
+/*****************************************************************************/
+
+struct ParallelDecompressorStreambuf: public std::streambuf {
+
+    ParallelDecompressorStreambuf(std::streambuf * source,
+                                  std::shared_ptr<Format> format,
+                                  int numThreads)
+        : input(source), format(std::move(format)),
+          maxInFlight(2 * numThreads)
+    {
+    }
+
+    ~ParallelDecompressorStreambuf()
+    {
+        // Stop chunks that haven't started yet from being decompressed
+        // for nothing.  Those that are running own what they need.
+        for (auto & chunk: inFlight) {
+            if (chunk->claim())
+                chunk->setDone();
+        }
+    }
+
+    virtual int_type underflow() override
+    {
+        if (gptr() < egptr())
+            return traits_type::to_int_type(*gptr());
+
+        for (;;) {
+            current.reset();
+            fill();
+            if (inFlight.empty())
+                return traits_type::eof();
+
+            current = std::move(inFlight.front());
+            inFlight.pop_front();
+
+            // Keep the thread pool busy while we wait
+            fill();
+
+            if (current->claim())
+                run(*format, *current);
+            else current->waitUntilDone();
+
+            if (current->exc)
+                std::rethrow_exception(current->exc);
+
+            format->deliver(*current);
+
+            if (!current->output.empty()) {
+                char * data = &current->output[0];
+                setg(data, data, data + current->output.size());
+                return traits_type::to_int_type(*gptr());
+            }
+        }
+    }
+
+    /// Read chunks from the input until we have enough in flight
+    void fill()
+    {
+        while (!finished && inFlight.size() < maxInFlight) {
+            std::shared_ptr<Chunk> chunk = format->next(input);
+            if (!chunk) {
+                finished = true;
+                break;
+            }
+
+            inFlight.push_back(chunk);
+
+            if (chunk->state == Chunk::PENDING) {
+                auto format = this->format;
+                ThreadPool::instance().add([=] () noexcept
+                    {
+                        if (chunk->claim())
+                            run(*format, *chunk);
+                    });
+            }
+        }
+    }
+
+    static void run(const Format & format, Chunk & chunk) noexcept
+    {
+        try {
+            format.decompress(chunk.input, chunk.output);
+        } catch (...) {
+            chunk.exc = std::current_exception();
+        }
+        chunk.input = std::string();
+        chunk.setDone();
+    }
+
+    CompressedInput input;
+    std::shared_ptr<Format> format;
+    size_t maxInFlight;
+    bool finished = false;
+    std::deque<std::shared_ptr<Chunk> > inFlight;
+    std::shared_ptr<Chunk> current;
+};
+
+} // file scope
+
+
+/*****************************************************************************/
+/* PUBLIC INTERFACE                                                          */
+/*****************************************************************************/
+
+bool parallelDecompressionSupported(const std::string & compression)
+{
+    return compression == "gz" || compression == "gzip"
+        || compression == "zst" || compression == "zstd"
+        || compression == "lz4";
+}
+
+std::unique_ptr<std::streambuf>
+createParallelDecompressor(std::streambuf * source,
+                           const std::string & compression,
+                           int numThreads)
+{
+    std::shared_ptr<Format> format;
+    if (compression == "gz" || compression == "gzip")
+        format = std::make_shared<GzipFormat>();
+    else if (compression == "zst" || compression == "zstd")
+        format = std::make_shared<ZstdFormat>();
+    else if (compression == "lz4")
+        format = std::make_shared<Lz4Format>();
+    else return nullptr;
+
+    return std::unique_ptr<std::streambuf>
+        (new ParallelDecompressorStreambuf(source, std::move(format),
+                                           std::max(numThreads, 1)));
+}
+
+} // namespace MLDB
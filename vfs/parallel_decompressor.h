@@ -0,0 +1,54 @@
+/** parallel_decompressor.h                                       -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Streambuf that decompresses a compressed stream on multiple threads.
+*/
+
+#pragma once
+
+#include <streambuf>
+#include <memory>
+#include <string>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* PARALLEL DECOMPRESSOR                                                     */
+/*****************************************************************************/
+
+/** Return true if the given compression (as returned by
+    Compressor::filenameToCompression(), or "gz" / "gzip" / "lz4") can be
+    decompressed in parallel.
+*/
+bool parallelDecompressionSupported(const std::string & compression);
+
+/** Return a streambuf that reads compressed data from source and returns
+    the decompressed data.  The input is split into pieces that can be
+    decompressed independently, and those pieces are decompressed on the
+    global thread pool with up to numThreads of them in flight at once.
+    The output is returned in order.
+
+    The pieces are:
+    - zstd: frames (several small frames are grouped together);
+    - lz4: blocks, which must be independent (as for lz4_decompressor);
+    - gzip: members of BGZF files (as written by bgzip), which record
+      their compressed size in the header.
+
+    Parts of the input that can't be split (a gzip member that isn't BGZF,
+    like those written by gzip itself, or a very large zstd frame) are
+    decompressed sequentially on the reading thread, so that every file
+    can be read through this streambuf.
+
+    The source must outlive the returned streambuf.  Returns a null
+    pointer if the compression isn't supported.
+*/
+std::unique_ptr<std::streambuf>
+createParallelDecompressor(std::streambuf * source,
+                           const std::string & compression,
+                           int numThreads);
+
+} // namespace MLDB
@@ -0,0 +1,203 @@
+/** parallel_compressor_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of multi-threaded gzip, zstd, lz4 and xz compression.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/parallel_compressor.h"
+#include "mldb/vfs/parallel_decompressor.h"
+#include "mldb/vfs/lz4_filter.h"
+#include "mldb/ext/lzma/lzma.h"
+#include "mldb/arch/timers.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/iostreams/device/array.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <random>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+static std::string makeData(size_t numLines)
+{
+    std::mt19937 rng(1);
+    std::string result;
+    for (size_t i = 0;  i < numLines;  ++i) {
+        result += std::to_string(i) + "," + std::to_string(rng() % 100000)
+            + ",some text that repeats " + std::to_string(rng() % 100) + "\n";
+    }
+    return result;
+}
+
+/// Compress the data, written in pieces of the given size, with a flush
+/// every flushEvery pieces if it's non-zero
+static std::string compress(const std::string & data,
+                            const std::string & compression,
+                            int numThreads = 4,
+                            size_t pieceSize = 100000,
+                            size_t flushEvery = 0)
+{
+    std::string result;
+    auto onData = [&] (const char * p, size_t n) -> size_t
+        {
+            result.append(p, n);
+            return n;
+        };
+
+    ParallelCompressor compressor(compression, -1, numThreads);
+    size_t numPieces = 0;
+    for (size_t i = 0;  i < data.size();  i += pieceSize) {
+        compressor.compress(data.data() + i,
+                            std::min(pieceSize, data.size() - i), onData);
+        if (flushEvery && ++numPieces % flushEvery == 0)
+            compressor.flush(Compressor::FLUSH_SYNC, onData);
+    }
+    compressor.finish(onData);
+    return result;
+}
+
+/// Decompress with the single threaded decompressors
+template<typename Filter>
+static std::string decompressWith(const std::string & compressed,
+                                  Filter filter)
+{
+    boost::iostreams::filtering_istream stream;
+    stream.push(filter);
+    stream.push(boost::iostreams::array_source(compressed.data(),
+                                               compressed.size()));
+    std::ostringstream result;
+    result << stream.rdbuf();
+    return result.str();
+}
+
+static std::string zstdDecompress(const std::string & compressed)
+{
+    std::string result;
+    std::unique_ptr<Decompressor> decompressor(Decompressor::create("zstd"));
+    decompressor->decompress(compressed.data(), compressed.size(),
+                             [&] (const char * p, size_t n) -> size_t
+                             {
+                                 result.append(p, n);
+                                 return n;
+                             });
+    return result;
+}
+
+static std::string parallelDecompress(const std::string & compressed,
+                                      const std::string & compression)
+{
+    std::stringbuf source(compressed);
+    auto buf = createParallelDecompressor(&source, compression, 4);
+    std::string result;
+    char block[100000];
+    while (std::streamsize n = buf->sgetn(block, sizeof(block)))
+        result.append(block, n);
+    return result;
+}
+
+static std::vector<std::string> testData()
+{
+    std::string data = makeData(200000);
+    return { "", "hello", std::string(data, 0, 1000000), data };
+}
+
+BOOST_AUTO_TEST_CASE( test_gzip )
+{
+    for (auto & data: testData()) {
+        BOOST_TEST_CHECKPOINT("size " << data.size());
+        for (size_t flushEvery: { 0, 3 }) {
+            std::string compressed = compress(data, "gzip", 4, 100000,
+                                              flushEvery);
+            BOOST_CHECK(decompressWith
+                        (compressed,
+                         boost::iostreams::gzip_decompressor()) == data);
+            BOOST_CHECK(parallelDecompress(compressed, "gzip") == data);
+        }
+    }
+
+    // Compression is about as good as single threaded gzip
+    std::string data = makeData(200000);
+    std::string sequential;
+    {
+        boost::iostreams::filtering_ostream stream;
+        stream.push(boost::iostreams::gzip_compressor());
+        stream.push(boost::iostreams::back_inserter(sequential));
+        stream << data;
+    }
+    std::string parallel = compress(data, "gz");
+    cerr << "gzip sequential " << sequential.size() << " parallel "
+         << parallel.size() << endl;
+    BOOST_CHECK_LT(parallel.size(), sequential.size() * 1.02);
+}
+
+BOOST_AUTO_TEST_CASE( test_zstd )
+{
+    for (auto & data: testData()) {
+        BOOST_TEST_CHECKPOINT("size " << data.size());
+        for (size_t flushEvery: { 0, 3 }) {
+            std::string compressed = compress(data, "zstd", 4, 100000,
+                                              flushEvery);
+            BOOST_CHECK(zstdDecompress(compressed) == data);
+            BOOST_CHECK(parallelDecompress(compressed, "zstd") == data);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4 )
+{
+    for (auto & data: testData()) {
+        BOOST_TEST_CHECKPOINT("size " << data.size());
+        std::string compressed = compress(data, "lz4");
+        BOOST_CHECK(decompressWith(compressed, lz4_decompressor()) == data);
+        BOOST_CHECK(parallelDecompress(compressed, "lz4") == data);
+
+        // Same output as the single threaded compressor
+        std::string sequential;
+        {
+            boost::iostreams::filtering_ostream stream;
+            stream.push(lz4_compressor());
+            stream.push(boost::iostreams::back_inserter(sequential));
+            stream << data;
+        }
+        BOOST_CHECK(compressed == sequential);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_xz )
+{
+    for (auto & data: testData()) {
+        BOOST_TEST_CHECKPOINT("size " << data.size());
+        for (size_t flushEvery: { 0, 3 }) {
+            std::string compressed = compress(data, "xz", 4, 100000,
+                                              flushEvery);
+            BOOST_CHECK(decompressWith(compressed,
+                                       boost::iostreams::lzma_decompressor())
+                        == data);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_speed )
+{
+    std::string data = makeData(1000000);
+
+    for (auto compression: { "gzip", "zstd", "lz4", "xz" }) {
+        for (int numThreads: { 1, 8 }) {
+            Timer timer;
+            std::string compressed = compress(data, compression, numThreads,
+                                              65536);
+            cerr << compression << " " << numThreads << " threads: "
+                 << data.size() / timer.elapsed_wall() / 1000000.0
+                 << "MB/s" << endl;
+        }
+    }
+}
@@ -0,0 +1,251 @@
+/** parallel_decompressor_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of multi-threaded decompression of zstd, lz4 and gzip streams.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/parallel_decompressor.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/compressor.h"
+#include "mldb/vfs/lz4_filter.h"
+#include "mldb/arch/exception_handler.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/test/unit_test.hpp>
+#include <zlib.h>
+#include <sstream>
+#include <random>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/// Lines of text, compressible but not too much
+static std::string makeData(size_t numLines)
+{
+    std::mt19937 rng(1);
+    std::string result;
+    for (size_t i = 0;  i < numLines;  ++i) {
+        result += std::to_string(i) + "," + std::to_string(rng() % 100000)
+            + ",some text that repeats " + std::to_string(rng() % 100) + "\n";
+    }
+    return result;
+}
+
+/// Compress each piece of the data as a separate zstd frame
+static std::string zstdFrames(const std::string & data, size_t frameSize)
+{
+    std::string result;
+    auto onData = [&] (const char * p, size_t n) -> size_t
+        {
+            result.append(p, n);
+            return n;
+        };
+
+    for (size_t i = 0;  i < data.size();  i += frameSize) {
+        std::unique_ptr<Compressor> compressor
+            (Compressor::create("zstd", 1));
+        compressor->compress(data.data() + i,
+                             std::min(frameSize, data.size() - i),
+                             onData);
+        compressor->finish(onData);
+    }
+    return result;
+}
+
+static std::string lz4Compress(const std::string & data, int blockSizeId)
+{
+    std::string result;
+    {
+        boost::iostreams::filtering_ostream stream;
+        stream.push(lz4_compressor(0, blockSizeId));
+        stream.push(boost::iostreams::back_inserter(result));
+        stream << data;
+    }
+    return result;
+}
+
+static std::string gzipCompress(const std::string & data)
+{
+    std::string result;
+    {
+        boost::iostreams::filtering_ostream stream;
+        stream.push(boost::iostreams::gzip_compressor());
+        stream.push(boost::iostreams::back_inserter(result));
+        stream << data;
+    }
+    return result;
+}
+
+/// Compress in the BGZF format, as bgzip does
+static std::string bgzfCompress(const std::string & data)
+{
+    std::string result;
+
+    auto writeBlock = [&] (const char * p, size_t n)
+        {
+            z_stream stream;
+            memset(&stream, 0, sizeof(stream));
+            BOOST_REQUIRE_EQUAL(deflateInit2(&stream, 6, Z_DEFLATED, -15, 8,
+                                             Z_DEFAULT_STRATEGY), Z_OK);
+            std::string compressed(65536, '\0');
+            stream.next_in = (Bytef *)p;
+            stream.avail_in = n;
+            stream.next_out = (Bytef *)&compressed[0];
+            stream.avail_out = compressed.size();
+            BOOST_REQUIRE_EQUAL(deflate(&stream, Z_FINISH), Z_STREAM_END);
+            compressed.resize(compressed.size() - stream.avail_out);
+            deflateEnd(&stream);
+
+            size_t blockSize = 18 + compressed.size() + 8;
+            unsigned char header[18] = {
+                0x1f, 0x8b, 8, 4, 0, 0, 0, 0, 0, 0xff, 6, 0, 'B', 'C', 2, 0,
+                (unsigned char)((blockSize - 1) & 0xff),
+                (unsigned char)((blockSize - 1) >> 8) };
+            result.append((const char *)header, 18);
+            result += compressed;
+
+            uint32_t trailer[2] = { (uint32_t)crc32(0, (const Bytef *)p, n),
+                                    (uint32_t)n };
+            result.append((const char *)trailer, 8);
+        };
+
+    for (size_t i = 0;  i < data.size();  i += 65280)
+        writeBlock(data.data() + i, std::min<size_t>(65280, data.size() - i));
+
+    // Empty end of file marker block
+    writeBlock(nullptr, 0);
+
+    return result;
+}
+
+static std::string decompress(const std::string & compressed,
+                              const std::string & compression,
+                              int numThreads = 4)
+{
+    std::stringbuf source(compressed);
+    auto buf = createParallelDecompressor(&source, compression, numThreads);
+    BOOST_REQUIRE(buf);
+
+    // Read directly from the streambuf, so that errors are thrown
+    std::string result;
+    char block[100000];
+    while (std::streamsize n = buf->sgetn(block, sizeof(block)))
+        result.append(block, n);
+    return result;
+}
+
+BOOST_AUTO_TEST_CASE( test_zstd_frames )
+{
+    std::string data = makeData(200000);
+
+    for (size_t frameSize: { 1000, 100000, 3000000, 100000000 }) {
+        BOOST_TEST_CHECKPOINT("frame size " << frameSize);
+        std::string compressed = zstdFrames(data, frameSize);
+        BOOST_CHECK(decompress(compressed, "zstd") == data);
+        BOOST_CHECK(decompress(compressed, "zst", 1) == data);
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_zstd_large_frame )
+{
+    // Bigger than the largest frame we decompress in one piece, so it
+    // goes through the sequential path
+    std::string data = makeData(3000000);
+    std::string compressed = zstdFrames(data, 100000000);
+    BOOST_REQUIRE_GT(compressed.size(), 16 * 1024 * 1024);
+    compressed += zstdFrames(data, 100000);
+    BOOST_CHECK(decompress(compressed, "zstd") == data + data);
+}
+
+BOOST_AUTO_TEST_CASE( test_lz4 )
+{
+    std::string data = makeData(200000);
+
+    for (int blockSizeId: { 4, 5, 7 }) {
+        BOOST_TEST_CHECKPOINT("block size id " << blockSizeId);
+        std::string compressed = lz4Compress(data, blockSizeId);
+        BOOST_CHECK(decompress(compressed, "lz4") == data);
+    }
+
+    // Incompressible data is stored uncompressed
+    std::mt19937 rng(2);
+    std::string random(1000000, '\0');
+    for (auto & c: random)
+        c = rng();
+    BOOST_CHECK(decompress(lz4Compress(random, 4), "lz4") == random);
+}
+
+BOOST_AUTO_TEST_CASE( test_gzip )
+{
+    std::string data = makeData(200000);
+
+    // BGZF, which is split into members
+    BOOST_CHECK(decompress(bgzfCompress(data), "gzip") == data);
+
+    // A normal gzip file
+    BOOST_CHECK(decompress(gzipCompress(data), "gz") == data);
+
+    // Multiple members, both BGZF and normal
+    std::string half(data, 0, data.size() / 2);
+    std::string compressed = gzipCompress(half) + bgzfCompress(half)
+        + gzipCompress(half) + bgzfCompress(half);
+    BOOST_CHECK(decompress(compressed, "gzip") == half + half + half + half);
+
+    BOOST_CHECK_EQUAL(decompress(std::string(), "gzip"), "");
+}
+
+BOOST_AUTO_TEST_CASE( test_errors )
+{
+    MLDB_TRACE_EXCEPTIONS(false);
+
+    std::string data = makeData(100000);
+
+    for (auto & c: { std::make_pair(zstdFrames(data, 10000), "zstd"),
+                     std::make_pair(lz4Compress(data, 4), "lz4"),
+                     std::make_pair(bgzfCompress(data), "gzip"),
+                     std::make_pair(gzipCompress(data), "gzip") }) {
+        BOOST_TEST_CHECKPOINT(c.second);
+
+        // Truncated
+        std::string truncated(c.first, 0, c.first.size() / 2);
+        BOOST_CHECK_THROW(decompress(truncated, c.second), std::exception);
+
+        // Corrupted.  Without checksums, that may not be detected, but we
+        // must not return the original data.
+        std::string corrupted = c.first;
+        for (size_t i = corrupted.size() / 3;  i < corrupted.size() / 3 + 100;
+             ++i)
+            corrupted[i] ^= 0x55;
+        try {
+            BOOST_CHECK(decompress(corrupted, c.second) != data);
+        } catch (const std::exception & exc) {
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE( test_filter_istream )
+{
+    std::string data = makeData(100000);
+
+    for (int numThreads: { -1, 1, 4 }) {
+        std::stringbuf source(zstdFrames(data, 10000));
+        filter_istream stream;
+        stream.openFromStreambuf(&source, nullptr, "file.csv.zst", "",
+                                 numThreads);
+        BOOST_CHECK(stream.readAll() == data);
+        stream.close();
+
+        std::stringbuf gzSource(bgzfCompress(data));
+        stream.openFromStreambuf(&gzSource, nullptr, "file.csv.gz", "",
+                                 numThreads);
+        BOOST_CHECK(stream.readAll() == data);
+    }
+}
@@ -0,0 +1,264 @@
+/** uri_cache_test.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Test of the local cache of remote URIs.
+*/
+
+#define BOOST_TEST_MAIN
+#define BOOST_TEST_DYN_LINK
+
+#include "mldb/vfs/uri_cache.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/vfs/filter_streams_registry.h"
+#include "mldb/vfs/fs_utils.h"
+#include "mldb/types/url.h"
+#include "mldb/arch/exception.h"
+#include <boost/iostreams/filtering_stream.hpp>
+#include <boost/iostreams/filter/gzip.hpp>
+#include <boost/iostreams/device/back_inserter.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <sstream>
+#include <mutex>
+
+
+using namespace std;
+using namespace MLDB;
+
+
+/*****************************************************************************/
+/* FAKE REMOTE FILESYSTEM                                                    */
+/*****************************************************************************/
+
+/// Contents of the files of the cachetest:// scheme, with a version used
+/// as their etag
+struct RemoteFile {
+    std::string contents;
+    int version = 0;
+};
+
+std::mutex remoteLock;
+std::map<std::string, RemoteFile> remoteFiles;
+int numOpens = 0;
+
+void setRemoteFile(const std::string & name, const std::string & contents)
+{
+    std::unique_lock<std::mutex> guard(remoteLock);
+    auto & file = remoteFiles[name];
+    file.contents = contents;
+    file.version += 1;
+}
+
+struct RemoteFsHandler: public UrlFsHandler {
+    virtual FsObjectInfo getInfo(const Url & url) const override
+    {
+        FsObjectInfo result = tryGetInfo(url);
+        if (!result.exists)
+            throw MLDB::Exception("no remote file " + url.toString());
+        return result;
+    }
+
+    virtual FsObjectInfo tryGetInfo(const Url & url) const override
+    {
+        std::unique_lock<std::mutex> guard(remoteLock);
+        FsObjectInfo result;
+        auto it = remoteFiles.find(url.path());
+        if (it == remoteFiles.end())
+            return result;
+        result.exists = true;
+        result.size = it->second.contents.size();
+        result.etag = "version" + std::to_string(it->second.version);
+        result.lastModified = Date::fromSecondsSinceEpoch(1000000000);
+        return result;
+    }
+
+    virtual void makeDirectory(const Url & url) const override
+    {
+    }
+
+    virtual bool erase(const Url & url, bool throwException) const override
+    {
+        return false;
+    }
+
+    virtual bool forEach(const Url & prefix,
+                         const OnUriObject & onObject,
+                         const OnUriSubdir & onSubdir,
+                         const std::string & delimiter,
+                         const std::string & startAt) const override
+    {
+        return true;
+    }
+};
+
+struct RegisterRemoteHandler {
+    static UriHandler
+    getRemoteHandler(const std::string & scheme,
+                     const std::string & resource,
+                     std::ios_base::openmode mode,
+                     const std::map<std::string, std::string> & options,
+                     const OnUriHandlerException & onException)
+    {
+        std::unique_lock<std::mutex> guard(remoteLock);
+        ++numOpens;
+        auto buf = std::make_shared<std::stringbuf>
+            (remoteFiles.at("/" + resource).contents);
+        FsObjectInfo info;
+        info.exists = true;
+        return UriHandler(buf.get(), buf, info);
+    }
+
+    RegisterRemoteHandler()
+    {
+        registerUriHandler("cachetest", getRemoteHandler);
+        registerUrlFsHandler("cachetest", new RemoteFsHandler());
+    }
+} registerRemoteHandler;
+
+std::string readUri(const std::string & uri,
+                    const std::map<std::string, std::string> & options = {})
+{
+    filter_istream stream(uri, options);
+    return stream.readAll();
+}
+
+std::string tempDirectory()
+{
+    char dir[] = "/tmp/uri_cache_test-XXXXXX";
+    BOOST_REQUIRE(mkdtemp(dir));
+    return dir;
+}
+
+size_t numEntries(const std::string & directory)
+{
+    size_t result = 0;
+    for (boost::filesystem::directory_iterator it(directory), end;
+         it != end;  ++it)
+        ++result;
+    return result;
+}
+
+
+/*****************************************************************************/
+/* TESTS                                                                     */
+/*****************************************************************************/
+
+BOOST_AUTO_TEST_CASE( test_no_cache )
+{
+    setUriCacheDirectory("", 0);
+    setRemoteFile("/nocache.txt", "hello");
+    numOpens = 0;
+    BOOST_CHECK_EQUAL(readUri("cachetest://nocache.txt"), "hello");
+    BOOST_CHECK_EQUAL(readUri("cachetest://nocache.txt"), "hello");
+    BOOST_CHECK_EQUAL(numOpens, 2);
+}
+
+BOOST_AUTO_TEST_CASE( test_cache_hit_and_invalidation )
+{
+    std::string dir = tempDirectory();
+    setUriCacheDirectory(dir, 1000000);
+
+    std::string contents(100000, 'x');
+    setRemoteFile("/data.txt", contents);
+    numOpens = 0;
+
+    BOOST_CHECK(readUri("cachetest://data.txt") == contents);
+    BOOST_CHECK_EQUAL(numOpens, 1);
+
+    // Second time comes from the cache, memory mapped
+    {
+        filter_istream stream("cachetest://data.txt");
+        BOOST_CHECK(stream.readAll() == contents);
+        BOOST_CHECK(stream.mapped().first != nullptr);
+        BOOST_CHECK_EQUAL(stream.info().etag, "version1");
+    }
+    BOOST_CHECK_EQUAL(numOpens, 1);
+
+    // The cache can be skipped
+    BOOST_CHECK(readUri("cachetest://data.txt", { { "cache", "false" } })
+                == contents);
+    BOOST_CHECK_EQUAL(numOpens, 2);
+
+    // A change to the file means a new etag, which is downloaded again
+    setRemoteFile("/data.txt", "changed");
+    BOOST_CHECK_EQUAL(readUri("cachetest://data.txt"), "changed");
+    BOOST_CHECK_EQUAL(numOpens, 3);
+    BOOST_CHECK_EQUAL(readUri("cachetest://data.txt"), "changed");
+    BOOST_CHECK_EQUAL(numOpens, 3);
+
+    setUriCacheDirectory("", 0);
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE( test_compressed )
+{
+    std::string dir = tempDirectory();
+    setUriCacheDirectory(dir, 1000000);
+
+    std::string contents;
+    for (int i = 0;  i < 10000;  ++i)
+        contents += "line " + std::to_string(i) + "\n";
+
+    std::string compressed;
+    {
+        boost::iostreams::filtering_ostream stream;
+        stream.push(boost::iostreams::gzip_compressor());
+        stream.push(boost::iostreams::back_inserter(compressed));
+        stream << contents;
+    }
+    setRemoteFile("/data.txt.gz", compressed);
+    numOpens = 0;
+
+    // The copy is compressed, and decompressed as it's read
+    BOOST_CHECK(readUri("cachetest://data.txt.gz") == contents);
+    BOOST_CHECK(readUri("cachetest://data.txt.gz") == contents);
+    BOOST_CHECK_EQUAL(numOpens, 1);
+
+    setUriCacheDirectory("", 0);
+    boost::filesystem::remove_all(dir);
+}
+
+BOOST_AUTO_TEST_CASE( test_eviction )
+{
+    std::string dir = tempDirectory();
+    setUriCacheDirectory(dir, 250000);
+
+    for (int i = 0;  i < 4;  ++i) {
+        setRemoteFile("/file" + std::to_string(i),
+                      std::string(100000, 'a' + i));
+    }
+    numOpens = 0;
+
+    // Only two fit
+    BOOST_CHECK_EQUAL(readUri("cachetest://file0").size(), 100000);
+    BOOST_CHECK_EQUAL(readUri("cachetest://file1").size(), 100000);
+    BOOST_CHECK_EQUAL(numEntries(dir), 2);
+
+    // file0 is now the most recently used
+    sleep(1);
+    readUri("cachetest://file0");
+    BOOST_CHECK_EQUAL(numOpens, 2);
+    sleep(1);
+
+    // This evicts file1
+    readUri("cachetest://file2");
+    BOOST_CHECK_EQUAL(numEntries(dir), 2);
+    BOOST_CHECK_EQUAL(numOpens, 3);
+
+    readUri("cachetest://file0");
+    BOOST_CHECK_EQUAL(numOpens, 3);
+    BOOST_CHECK_EQUAL(readUri("cachetest://file1"),
+                      std::string(100000, 'b'));
+    BOOST_CHECK_EQUAL(numOpens, 4);
+
+    // Files bigger than the cache aren't cached
+    setRemoteFile("/big", std::string(300000, 'z'));
+    readUri("cachetest://big");
+    readUri("cachetest://big");
+    BOOST_CHECK_EQUAL(numOpens, 6);
+
+    setUriCacheDirectory("", 0);
+    boost::filesystem::remove_all(dir);
+}
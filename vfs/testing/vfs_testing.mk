@@ -3,3 +3,7 @@
 $(eval $(call test,filter_streams_test,vfs boost_filesystem boost_system,boost))
 
 $(TESTS)/filter_streams_test:	$(BIN)/lz4cli $(BIN)/zstd
+
+$(eval $(call test,parallel_decompressor_test,vfs boost_iostreams,boost))
+$(eval $(call test,parallel_compressor_test,vfs boost_iostreams lzmapp,boost))
+$(eval $(call test,uri_cache_test,vfs boost_filesystem boost_system,boost))
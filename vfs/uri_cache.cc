@@ -0,0 +1,259 @@
+/** uri_cache.cc
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Local on-disk cache of the contents of remote URIs.
+*/
+
+#include "mldb/vfs/uri_cache.h"
+#include "mldb/vfs/filter_streams.h"
+#include "mldb/jml/utils/environment.h"
+#include "mldb/arch/exception.h"
+#include "mldb/arch/format.h"
+#include "mldb/ext/xxhash/xxhash.h"
+#include <boost/filesystem.hpp>
+#include <fstream>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <algorithm>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/types.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <errno.h>
+
+
+using namespace std;
+
+
+namespace MLDB {
+
+namespace {
+
+/// Directory for the cache; empty means that it's disabled
+EnvOption<std::string>
+MLDB_URI_CACHE_DIRECTORY("MLDB_URI_CACHE_DIRECTORY", "");
+
+/// Maximum size of the cache in bytes
+EnvOption<uint64_t>
+MLDB_URI_CACHE_SIZE("MLDB_URI_CACHE_SIZE", 10ULL * 1024 * 1024 * 1024);
+
+/// Temporary files of downloads older than this (in seconds) were left by
+/// a process that died, and are removed
+static constexpr int STALE_DOWNLOAD_AGE = 24 * 3600;
+
+struct CacheConfig {
+    CacheConfig()
+        : directory(MLDB_URI_CACHE_DIRECTORY),
+          maxSize(MLDB_URI_CACHE_SIZE)
+    {
+    }
+
+    std::mutex mutex;
+    std::string directory;
+    uint64_t maxSize;
+};
+
+CacheConfig & getConfig()
+{
+    static CacheConfig config;
+    return config;
+}
+
+std::atomic<uint64_t> downloadNumber(0);
+
+/// Name of the entry for the given object
+std::string cacheKey(const std::string & uri, const FsObjectInfo & info)
+{
+    std::string toHash = uri + "\n" + info.etag + "\n"
+        + std::to_string(info.lastModified.secondsSinceEpoch()) + "\n"
+        + std::to_string(info.size);
+    return MLDB::format("%016llx%016llx",
+                        (unsigned long long)XXH64(toHash.data(),
+                                                  toHash.size(), 0),
+                        (unsigned long long)XXH64(toHash.data(),
+                                                  toHash.size(), 1));
+}
+
+bool isCacheable(const std::string & uri)
+{
+    auto pos = uri.find("://");
+    if (pos == std::string::npos)
+        return false;  // local file
+    std::string scheme(uri, 0, pos);
+    return scheme != "file" && scheme != "mem";
+}
+
+/** Remove the least recently used entries until the total size is at most
+    maxSize.  The entry at keep is never removed.
+*/
+void evict(const std::string & directory, uint64_t maxSize,
+           const std::string & keep)
+{
+    struct Entry {
+        time_t lastUsed;
+        uint64_t size;
+        std::string path;
+    };
+
+    std::vector<Entry> entries;
+    uint64_t totalSize = 0;
+    time_t now = time(nullptr);
+
+    DIR * dir = opendir(directory.c_str());
+    if (!dir)
+        return;
+    while (dirent * ent = readdir(dir)) {
+        std::string name = ent->d_name;
+        if (name == "." || name == "..")
+            continue;
+        std::string path = directory + "/" + name;
+        struct stat st;
+        if (stat(path.c_str(), &st) != 0 || !S_ISREG(st.st_mode))
+            continue;
+        if (name.compare(0, 4, "tmp-") == 0) {
+            if (now - st.st_mtime > STALE_DOWNLOAD_AGE)
+                unlink(path.c_str());
+            continue;
+        }
+        entries.push_back({ st.st_mtime, (uint64_t)st.st_size, path });
+        totalSize += st.st_size;
+    }
+    closedir(dir);
+
+    if (totalSize <= maxSize)
+        return;
+
+    std::sort(entries.begin(), entries.end(),
+              [] (const Entry & e1, const Entry & e2)
+              {
+                  return e1.lastUsed < e2.lastUsed;
+              });
+
+    for (auto & e: entries) {
+        if (totalSize <= maxSize)
+            break;
+        if (e.path == keep)
+            continue;
+        if (unlink(e.path.c_str()) == 0)
+            totalSize -= e.size;
+    }
+}
+
+/** Download the uri to path.  Returns false if it couldn't be written or
+    wasn't the expected size.
+*/
+bool download(const std::string & uri,
+              const std::map<std::string, std::string> & options,
+              const FsObjectInfo & info,
+              const std::string & path)
+{
+    // Read the raw bytes; decompression happens when the copy is opened
+    auto downloadOptions = options;
+    downloadOptions["compression"] = "none";
+    downloadOptions["cache"] = "false";
+    downloadOptions.erase("mapped");
+
+    filter_istream stream(uri, downloadOptions);
+    std::ofstream out(path, std::ios::binary);
+    if (!out)
+        return false;
+
+    std::vector<char> buf(1024 * 1024);
+    int64_t size = 0;
+    while (stream) {
+        stream.read(buf.data(), buf.size());
+        out.write(buf.data(), stream.gcount());
+        size += stream.gcount();
+    }
+    if (stream.bad())
+        throw MLDB::Exception("Error downloading " + uri + " to the cache");
+
+    out.close();
+    return out && (info.size < 0 || size == info.size);
+}
+
+} // file scope
+
+void setUriCacheDirectory(const std::string & directory, uint64_t maxSize)
+{
+    auto & config = getConfig();
+    std::unique_lock<std::mutex> guard(config.mutex);
+    if (!directory.empty())
+        boost::filesystem::create_directories(directory);
+    config.directory = directory;
+    config.maxSize = maxSize;
+}
+
+std::string getUriCacheDirectory()
+{
+    auto & config = getConfig();
+    std::unique_lock<std::mutex> guard(config.mutex);
+    return config.directory;
+}
+
+std::string getCachedUri(const std::string & uri,
+                         const std::map<std::string, std::string> & options,
+                         FsObjectInfo & info)
+{
+    auto & config = getConfig();
+    std::string directory;
+    uint64_t maxSize;
+    {
+        std::unique_lock<std::mutex> guard(config.mutex);
+        directory = config.directory;
+        maxSize = config.maxSize;
+    }
+
+    if (directory.empty() || !isCacheable(uri))
+        return std::string();
+    auto it = options.find("cache");
+    if (it != options.end() && (it->second == "false" || it->second == "0"))
+        return std::string();
+
+    FsObjectInfo remoteInfo = tryGetUriObjectInfo(uri);
+    if (!remoteInfo.exists
+        || (remoteInfo.etag.empty()
+            && remoteInfo.lastModified.secondsSinceEpoch() == 0)
+        || (remoteInfo.size >= 0 && (uint64_t)remoteInfo.size > maxSize))
+        return std::string();
+
+    std::string path = directory + "/" + cacheKey(uri, remoteInfo);
+
+    struct stat st;
+    if (stat(path.c_str(), &st) == 0
+        && (remoteInfo.size < 0 || st.st_size == remoteInfo.size)) {
+        // Mark it as recently used
+        utimes(path.c_str(), nullptr);
+        info = std::move(remoteInfo);
+        return path;
+    }
+
+    std::string tmpPath = directory + "/tmp-" + cacheKey(uri, remoteInfo)
+        + "-" + std::to_string(getpid())
+        + "-" + std::to_string(downloadNumber++);
+
+    bool downloaded = false;
+    try {
+        downloaded = download(uri, options, remoteInfo, tmpPath);
+    } catch (...) {
+        unlink(tmpPath.c_str());
+        throw;
+    }
+
+    // Renaming is atomic, so nobody can see a partial entry
+    if (!downloaded || rename(tmpPath.c_str(), path.c_str()) != 0) {
+        unlink(tmpPath.c_str());
+        return std::string();
+    }
+
+    evict(directory, maxSize, path);
+
+    info = std::move(remoteInfo);
+    return path;
+}
+
+} // namespace MLDB
@@ -0,0 +1,50 @@
+/** uri_cache.h                                                   -*- C++ -*-
+    Copyright (c) 2017 mldb.ai inc.  All rights reserved.
+
+    This file is part of MLDB. Copyright 2017 mldb.ai inc. All rights reserved.
+
+    Local on-disk cache of the contents of remote URIs.
+*/
+
+#pragma once
+
+#include "mldb/vfs/fs_utils.h"
+#include <map>
+
+
+namespace MLDB {
+
+
+/*****************************************************************************/
+/* URI CACHE                                                                 */
+/*****************************************************************************/
+
+/** Keep local copies of remote files (s3://, http://, sftp://, ...) in
+    the given directory, so that reading them again only costs a request
+    for their metadata.  Entries are keyed by the URI and its etag, last
+    modified date and size, so a file that changed is downloaded again.
+
+    Once the total size of the entries is over maxSize bytes, the least
+    recently used are removed.  An empty directory disables the cache,
+    which is the default unless the MLDB_URI_CACHE_DIRECTORY (and
+    optionally MLDB_URI_CACHE_SIZE) environment variables are set.
+*/
+void setUriCacheDirectory(const std::string & directory, uint64_t maxSize);
+
+/// Return the cache directory, or the empty string if it's disabled
+std::string getUriCacheDirectory();
+
+/** Return the path of the local copy of the given URI, downloading it
+    into the cache if it's not already there.  info is set to the info
+    of the remote object.
+
+    Returns the empty string if the URI shouldn't be cached: the cache is
+    disabled, the URI is local (file:// or mem://), the "cache" option is
+    "false", or the object has neither an etag nor a modification date to
+    validate the copy with.
+*/
+std::string getCachedUri(const std::string & uri,
+                         const std::map<std::string, std::string> & options,
+                         FsObjectInfo & info);
+
+} // namespace MLDB
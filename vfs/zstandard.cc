@@ -146,8 +146,10 @@ struct ZStandardDecompressor: public Decompressor {
                                 ZSTD_getErrorName(res));
             }
             writeAll(onData);
+
+            // End of a frame; another one may follow
             if (res == 0 && inBuf.pos < inBuf.size) {
-                throw Exception("Extra bytes at end of decompressed zstandard stream");
+                ZSTD_initDStream(stream);
             }
         }
         